@@ -16,7 +16,6 @@
 
 #include <stdint.h>
 
-#include <deque>
 #include <string>
 
 #include <android-base/stringprintf.h>
@@ -35,15 +34,15 @@ static constexpr uint8_t LOG_CFA_REG = 64;
 
 void ArmExidx::LogRawData() {
   std::string log_str("Raw Data:");
-  for (const uint8_t data : data_) {
-    log_str += android::base::StringPrintf(" 0x%02x", data);
+  for (const uint8_t* data = data_; data != data_end_; data++) {
+    log_str += android::base::StringPrintf(" 0x%02x", *data);
   }
   log(log_indent_, log_str.c_str());
 }
 
 bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
-  data_.clear();
-  status_ = ARM_STATUS_NONE;
+  buffer_size_ = 0;
+  SetData(buffer_, 0);
 
   if (entry_offset & 1) {
     // The offset needs to be at least two byte aligned.
@@ -82,14 +81,15 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
       status_ = ARM_STATUS_INVALID_PERSONALITY;
       return false;
     }
-    data_.push_back((data >> 16) & 0xff);
-    data_.push_back((data >> 8) & 0xff);
+    PushByte((data >> 16) & 0xff);
+    PushByte((data >> 8) & 0xff);
     uint8_t last_op = data & 0xff;
-    data_.push_back(last_op);
+    PushByte(last_op);
     if (last_op != ARM_OP_FINISH) {
       // If this didn't end with a finish op, add one.
-      data_.push_back(ARM_OP_FINISH);
+      PushByte(ARM_OP_FINISH);
     }
+    SetData(buffer_, buffer_size_);
     if (log_type_ == ARM_LOG_FULL) {
       LogRawData();
     }
@@ -112,7 +112,7 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
     switch ((data >> 24) & 0xf) {
     case 0:
       num_table_words = 0;
-      data_.push_back((data >> 16) & 0xff);
+      PushByte((data >> 16) & 0xff);
       break;
     case 1:
     case 2:
@@ -124,8 +124,8 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
       status_ = ARM_STATUS_INVALID_PERSONALITY;
       return false;
     }
-    data_.push_back((data >> 8) & 0xff);
-    data_.push_back(data & 0xff);
+    PushByte((data >> 8) & 0xff);
+    PushByte(data & 0xff);
   } else {
     // Generic model.
 
@@ -138,9 +138,9 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
       return false;
     }
     num_table_words = (data >> 24) & 0xff;
-    data_.push_back((data >> 16) & 0xff);
-    data_.push_back((data >> 8) & 0xff);
-    data_.push_back(data & 0xff);
+    PushByte((data >> 16) & 0xff);
+    PushByte((data >> 8) & 0xff);
+    PushByte(data & 0xff);
     addr += 4;
   }
 
@@ -155,18 +155,19 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
       status_address_ = addr;
       return false;
     }
-    data_.push_back((data >> 24) & 0xff);
-    data_.push_back((data >> 16) & 0xff);
-    data_.push_back((data >> 8) & 0xff);
-    data_.push_back(data & 0xff);
+    PushByte((data >> 24) & 0xff);
+    PushByte((data >> 16) & 0xff);
+    PushByte((data >> 8) & 0xff);
+    PushByte(data & 0xff);
     addr += 4;
   }
 
-  if (data_.back() != ARM_OP_FINISH) {
+  if (buffer_[buffer_size_ - 1] != ARM_OP_FINISH) {
     // If this didn't end with a finish op, add one.
-    data_.push_back(ARM_OP_FINISH);
+    PushByte(ARM_OP_FINISH);
   }
 
+  SetData(buffer_, buffer_size_);
   if (log_type_ == ARM_LOG_FULL) {
     LogRawData();
   }
@@ -174,12 +175,11 @@ bool ArmExidx::ExtractEntryData(uint32_t entry_offset) {
 }
 
 inline bool ArmExidx::GetByte(uint8_t* byte) {
-  if (data_.empty()) {
+  if (data_ == data_end_) {
     status_ = ARM_STATUS_TRUNCATED;
     return false;
   }
-  *byte = data_.front();
-  data_.pop_front();
+  *byte = *data_++;
   return true;
 }
 
@@ -222,7 +222,7 @@ inline bool ArmExidx::DecodePrefix_10_00(uint8_t byte) {
       log_cfa_offset_ += cfa_offset;
       for (size_t reg = 4; reg < 16; reg++) {
         if (registers & (1 << reg)) {
-          log_regs_[reg] = cfa_offset;
+          (*log_regs_)[reg] = cfa_offset;
           cfa_offset -= 4;
         }
       }
@@ -274,7 +274,7 @@ inline bool ArmExidx::DecodePrefix_10_01(uint8_t byte) {
     if (log_type_ == ARM_LOG_FULL) {
       log(log_indent_, "vsp = r%d", bits);
     } else {
-      log_regs_[LOG_CFA_REG] = bits;
+      (*log_regs_)[LOG_CFA_REG] = bits;
     }
 
     if (log_skip_execution_) {
@@ -313,12 +313,12 @@ inline bool ArmExidx::DecodePrefix_10_10(uint8_t byte) {
       log_cfa_offset_ += cfa_offset;
 
       for (uint8_t reg = 4; reg <= end_reg; reg++) {
-        log_regs_[reg] = cfa_offset;
+        (*log_regs_)[reg] = cfa_offset;
         cfa_offset -= 4;
       }
 
       if (byte & 0x8) {
-        log_regs_[14] = cfa_offset;
+        (*log_regs_)[14] = cfa_offset;
       }
     }
 
@@ -406,7 +406,7 @@ inline bool ArmExidx::DecodePrefix_10_11_0001() {
       log_cfa_offset_ += cfa_offset;
       for (size_t reg = 0; reg < 4; reg++) {
         if (byte & (1 << reg)) {
-          log_regs_[reg] = cfa_offset;
+          (*log_regs_)[reg] = cfa_offset;
           cfa_offset -= 4;
         }
       }
@@ -431,7 +431,7 @@ inline bool ArmExidx::DecodePrefix_10_11_0001() {
 }
 
 inline void ArmExidx::AdjustRegisters(int32_t offset) {
-  for (auto& entry : log_regs_) {
+  for (auto& entry : *log_regs_) {
     if (entry.first >= LOG_CFA_REG) {
       break;
     }
@@ -833,10 +833,10 @@ void ArmExidx::LogByReg() {
   }
 
   uint8_t cfa_reg;
-  if (log_regs_.count(LOG_CFA_REG) == 0) {
+  if (log_regs_->count(LOG_CFA_REG) == 0) {
     cfa_reg = 13;
   } else {
-    cfa_reg = log_regs_[LOG_CFA_REG];
+    cfa_reg = (*log_regs_)[LOG_CFA_REG];
   }
 
   if (log_cfa_offset_ != 0) {
@@ -846,7 +846,7 @@ void ArmExidx::LogByReg() {
     log(log_indent_, "cfa = r%zu", cfa_reg);
   }
 
-  for (const auto& entry : log_regs_) {
+  for (const auto& entry : *log_regs_) {
     if (entry.first >= LOG_CFA_REG) {
       break;
     }
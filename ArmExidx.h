@@ -17,10 +17,11 @@
 #ifndef _LIBUNWINDSTACK_ARM_EXIDX_H
 #define _LIBUNWINDSTACK_ARM_EXIDX_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <deque>
 #include <map>
+#include <memory>
 
 namespace unwindstack {
 
@@ -67,7 +68,21 @@ class ArmExidx {
 
   bool Decode();
 
-  std::deque<uint8_t>* data() { return &data_; }
+  // Evaluates already extracted opcodes, for example from a pre-decoded
+  // table. The data must stay valid until Eval is done.
+  void SetData(const uint8_t* data, size_t size) {
+    data_ = data;
+    data_end_ = data + size;
+    status_ = ARM_STATUS_NONE;
+  }
+
+  // The opcodes that are left to evaluate.
+  const uint8_t* data() { return data_; }
+  size_t data_size() { return data_end_ - data_; }
+
+  // The longest opcode data ExtractEntryData can produce: three bytes from
+  // the first word, five more words and an added finish.
+  static constexpr size_t kMaxDataSize = 24;
 
   ArmStatus status() { return status_; }
   uint64_t status_address() { return status_address_; }
@@ -80,12 +95,19 @@ class ArmExidx {
   bool pc_set() { return pc_set_; }
   void set_pc_set(bool pc_set) { pc_set_ = pc_set; }
 
-  void set_log(ArmLogType log_type) { log_type_ = log_type; }
+  void set_log(ArmLogType log_type) {
+    log_type_ = log_type;
+    // Only logging uses the register map, so unwinding never allocates it.
+    if (log_type_ != ARM_LOG_NONE && log_regs_ == nullptr) {
+      log_regs_.reset(new std::map<uint8_t, int32_t>);
+    }
+  }
   void set_log_skip_execution(bool skip_execution) { log_skip_execution_ = skip_execution; }
   void set_log_indent(uint8_t indent) { log_indent_ = indent; }
 
  private:
   bool GetByte(uint8_t* byte);
+  void PushByte(uint8_t byte) { buffer_[buffer_size_++] = byte; }
   void AdjustRegisters(int32_t offset);
 
   bool DecodePrefix_10_00(uint8_t byte);
@@ -106,7 +128,10 @@ class ArmExidx {
 
   RegsArm* regs_ = nullptr;
   uint32_t cfa_ = 0;
-  std::deque<uint8_t> data_;
+  const uint8_t* data_ = nullptr;
+  const uint8_t* data_end_ = nullptr;
+  uint8_t buffer_[kMaxDataSize];
+  size_t buffer_size_ = 0;
   ArmStatus status_ = ARM_STATUS_NONE;
   uint64_t status_address_ = 0;
 
@@ -118,7 +143,7 @@ class ArmExidx {
   bool log_skip_execution_ = false;
   bool pc_set_ = false;
   int32_t log_cfa_offset_ = 0;
-  std::map<uint8_t, int32_t> log_regs_;
+  std::unique_ptr<std::map<uint8_t, int32_t>> log_regs_;
 };
 
 }  // namespace unwindstack
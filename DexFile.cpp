@@ -15,11 +15,13 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
 #define LOG_TAG "unwind"
@@ -33,6 +35,7 @@
 
 #include "DexFile.h"
 #include "MemoryBuffer.h"
+#include "MemoryUsage.h"
 
 namespace unwindstack {
 
@@ -44,6 +47,22 @@ static bool CheckDexSupport() {
   return true;
 }
 
+// The file on disk might have been replaced since it was mapped. The dex
+// header includes a checksum and a signature of the rest of the dex file,
+// so the file is only used if all of it is there and its header matches
+// the one in memory.
+static bool IsMappedDex(Memory* file_memory, uint64_t base_addr, uint64_t file_size,
+                        Memory* memory) {
+  constexpr size_t kHeaderSize = 0x70;
+  if (file_memory->GetPtr(file_size - 1) == nullptr) {
+    return false;
+  }
+  uint8_t header[kHeaderSize];
+  size_t header_size = std::min<uint64_t>(file_size, kHeaderSize);
+  return memory->ReadFully(base_addr, header, header_size) &&
+         memcmp(file_memory->GetPtr(0), header, header_size) == 0;
+}
+
 std::unique_ptr<DexFile> DexFile::Create(uint64_t base_addr, uint64_t file_size, Memory* memory,
                                          MapInfo* info) {
   static bool has_dex_support = CheckDexSupport();
@@ -51,15 +70,18 @@ std::unique_ptr<DexFile> DexFile::Create(uint64_t base_addr, uint64_t file_size,
     return nullptr;
   }
 
-  // Try to map the file directly from disk.
+  // Try to map the file directly from disk, which avoids copying the dex
+  // file. The dex file may continue into the following maps of the same
+  // file.
   std::unique_ptr<Memory> dex_memory;
   if (info != nullptr && !info->name.empty()) {
     if (info->start <= base_addr && base_addr < info->end) {
       uint64_t offset_in_file = (base_addr - info->start) + info->offset;
-      if (file_size <= info->end - base_addr) {
-        dex_memory = Memory::CreateFileMemory(info->name, offset_in_file, file_size);
-        // On error, the results is null and we fall through to the fallback code-path.
+      dex_memory = Memory::CreateFileMemory(info->name, offset_in_file, file_size);
+      if (dex_memory != nullptr && !IsMappedDex(dex_memory.get(), base_addr, file_size, memory)) {
+        dex_memory.reset();
       }
+      // On error, the results is null and we fall through to the fallback code-path.
     }
   }
 
@@ -85,9 +107,64 @@ std::unique_ptr<DexFile> DexFile::Create(uint64_t base_addr, uint64_t file_size,
   return nullptr;
 }
 
+void DexFile::IndexMethods() {
+  methods_indexed_ = true;
+  dex_->FindAllMethods([&](const auto& method) {
+    size_t code_size, name_size;
+    uint32_t offset = method.GetCodeOffset(&code_size);
+    if (code_size == 0) {
+      return;  // Abstract and native methods have no code.
+    }
+    const char* name = method.GetQualifiedName(/*with_params=*/false, &name_size);
+    methods_.push_back(MethodRange{offset, static_cast<uint32_t>(offset + code_size),
+                                   static_cast<uint32_t>(names_.size()),
+                                   static_cast<uint32_t>(name_size)});
+    names_.append(name, name_size);
+  });
+
+  // Methods can share a code item, keep the first one like FindMethodAtOffset.
+  std::stable_sort(methods_.begin(), methods_.end(),
+                   [](const MethodRange& a, const MethodRange& b) { return a.offset < b.offset; });
+  methods_.erase(std::unique(methods_.begin(), methods_.end(),
+                             [](const MethodRange& a, const MethodRange& b) {
+                               return a.offset == b.offset;
+                             }),
+                 methods_.end());
+  methods_.shrink_to_fit();
+  names_.shrink_to_fit();
+}
+
+size_t DexFile::MemoryUsage() {
+  size_t usage = sizeof(*this) + MapMemoryUsage(symbols_) + VectorMemoryUsage(methods_) +
+                 names_.capacity() + HashMapMemoryUsage(method_names_);
+  if (memory_ != nullptr) {
+    usage += memory_->MemoryUsage();
+  }
+  return usage;
+}
+
 bool DexFile::GetFunctionName(uint64_t dex_pc, SharedString* method_name, uint64_t* method_offset) {
   uint64_t dex_offset = dex_pc - base_addr_;  // Convert absolute PC to file-relative offset.
 
+  if (!methods_indexed_) {
+    IndexMethods();
+  }
+  if (!methods_.empty()) {
+    auto it = std::upper_bound(
+        methods_.begin(), methods_.end(), dex_offset,
+        [](uint64_t offset, const MethodRange& method) { return offset < method.offset; });
+    if (it == methods_.begin() || dex_offset >= (--it)->end) {
+      return false;
+    }
+    auto [entry, inserted] = method_names_.try_emplace(it - methods_.begin());
+    if (inserted) {
+      entry->second = names_.substr(it->name_offset, it->name_size);
+    }
+    *method_offset = dex_offset - it->offset;
+    *method_name = entry->second;
+    return true;
+  }
+
   // Lookup the function in the cache.
   auto it = symbols_.upper_bound(dex_offset);
   if (it == symbols_.end() || dex_offset < it->second.offset) {
@@ -17,11 +17,13 @@
 #ifndef _LIBUNWINDSTACK_DEX_FILE_H
 #define _LIBUNWINDSTACK_DEX_FILE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -40,6 +42,14 @@ class DexFile {
     SharedString name;
   };
 
+  // The code of one method, the name is a range of names_.
+  struct MethodRange {
+    uint32_t offset;  // Relative to start of dex file.
+    uint32_t end;
+    uint32_t name_offset;
+    uint32_t name_size;
+  };
+
  public:
   bool IsValidPc(uint64_t dex_pc) {
     return base_addr_ <= dex_pc && (dex_pc - base_addr_) < file_size_;
@@ -47,6 +57,13 @@ class DexFile {
 
   bool GetFunctionName(uint64_t dex_pc, SharedString* method_name, uint64_t* method_offset);
 
+  uint64_t base_addr() { return base_addr_; }
+  uint64_t file_size() { return file_size_; }
+
+  // Approximate bytes of heap memory held by the copy of the file, if any,
+  // and by the method index. The dex file support library is not counted.
+  size_t MemoryUsage();
+
   static std::unique_ptr<DexFile> Create(uint64_t base_addr, uint64_t file_size, Memory* memory,
                                          MapInfo* info);
 
@@ -64,6 +81,15 @@ class DexFile {
   std::unique_ptr<art_api::dex::DexFile> dex_;  // Loaded underling dex object.
 
   std::map<uint32_t, Info> symbols_;  // Cache of read symbols (keyed by *end* offset).
+
+  // Reads every method of the dex file once, sorted by offset, so that
+  // lookups do not call into the dex file support library.
+  void IndexMethods();
+
+  bool methods_indexed_ = false;
+  std::vector<MethodRange> methods_;
+  std::string names_;
+  std::unordered_map<uint32_t, SharedString> method_names_;  // Indexed by position in methods_.
 };
 
 }  // namespace unwindstack
@@ -28,11 +28,23 @@ namespace unwindstack {
 
 template <>
 bool GlobalDebugInterface<DexFile>::Load(Maps* maps, std::shared_ptr<Memory>& memory, uint64_t addr,
-                                         uint64_t size, /*out*/ std::unique_ptr<DexFile>& dex) {
+                                         uint64_t size, /*out*/ std::shared_ptr<DexFile>& dex) {
   dex = DexFile::Create(addr, size, memory.get(), maps->Find(addr));
   return dex.get() != nullptr;
 }
 
+template <>
+bool GlobalDebugInterface<DexFile>::GetPcRange(DexFile* dex, uint64_t* start, uint64_t* end) {
+  *start = dex->base_addr();
+  *end = dex->base_addr() + dex->file_size();
+  return true;
+}
+
+template <>
+size_t GlobalDebugInterface<DexFile>::SymfileMemoryUsage(DexFile* dex) {
+  return dex->MemoryUsage();
+}
+
 std::unique_ptr<DexFiles> CreateDexFiles(ArchEnum arch, std::shared_ptr<Memory>& memory,
                                          std::vector<std::string> search_libs) {
   return CreateGlobalDebugImpl<DexFile>(arch, memory, search_libs, "__dex_debug_descriptor");
@@ -42,10 +54,20 @@ std::unique_ptr<DexFiles> CreateDexFiles(ArchEnum arch, std::shared_ptr<Memory>&
 
 template <>
 bool GlobalDebugInterface<DexFile>::Load(Maps*, std::shared_ptr<Memory>&, uint64_t, uint64_t,
-                                         std::unique_ptr<DexFile>&) {
+                                         std::shared_ptr<DexFile>&) {
   return false;
 }
 
+template <>
+bool GlobalDebugInterface<DexFile>::GetPcRange(DexFile*, uint64_t*, uint64_t*) {
+  return false;
+}
+
+template <>
+size_t GlobalDebugInterface<DexFile>::SymfileMemoryUsage(DexFile*) {
+  return 0;
+}
+
 std::unique_ptr<DexFiles> CreateDexFiles(ArchEnum, std::shared_ptr<Memory>&,
                                          std::vector<std::string>) {
   return nullptr;
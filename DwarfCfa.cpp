@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <string>
 #include <type_traits>
 #include <vector>
@@ -43,15 +44,13 @@ template <typename AddressType>
 bool DwarfCfa<AddressType>::GetLocationInfo(uint64_t pc, uint64_t start_offset, uint64_t end_offset,
                                             DwarfLocations* loc_regs) {
   if (cie_loc_regs_ != nullptr) {
-    for (const auto& entry : *cie_loc_regs_) {
-      (*loc_regs)[entry.first] = entry.second;
-    }
+    // Start from the initial cie state.
+    *loc_regs = *cie_loc_regs_;
   }
   last_error_.code = DWARF_ERROR_NONE;
   last_error_.address = 0;
 
   memory_->set_cur_offset(start_offset);
-  uint64_t cfa_offset;
   cur_pc_ = fde_->pc_start;
   loc_regs->pc_start = cur_pc_;
   while (true) {
@@ -59,89 +58,137 @@ bool DwarfCfa<AddressType>::GetLocationInfo(uint64_t pc, uint64_t start_offset,
       loc_regs->pc_end = cur_pc_;
       return true;
     }
-    if ((cfa_offset = memory_->cur_offset()) >= end_offset) {
+    if (memory_->cur_offset() >= end_offset) {
       loc_regs->pc_end = fde_->pc_end;
       return true;
     }
     loc_regs->pc_start = cur_pc_;
-    operands_.clear();
-    // Read the cfa information.
-    uint8_t cfa_value;
-    if (!memory_->ReadBytes(&cfa_value, 1)) {
-      last_error_.code = DWARF_ERROR_MEMORY_INVALID;
-      last_error_.address = memory_->cur_offset();
+    if (!ProcessInstruction(loc_regs)) {
       return false;
     }
-    uint8_t cfa_low = cfa_value & 0x3f;
-    // Check the 2 high bits.
-    switch (cfa_value >> 6) {
-      case 1:
-        cur_pc_ += cfa_low * fde_->cie->code_alignment_factor;
-        break;
-      case 2: {
-        uint64_t offset;
-        if (!memory_->ReadULEB128(&offset)) {
-          last_error_.code = DWARF_ERROR_MEMORY_INVALID;
-          last_error_.address = memory_->cur_offset();
-          return false;
-        }
-        SignedType signed_offset =
-            static_cast<SignedType>(offset) * fde_->cie->data_alignment_factor;
-        (*loc_regs)[cfa_low] = {.type = DWARF_LOCATION_OFFSET,
-                                .values = {static_cast<uint64_t>(signed_offset)}};
-        break;
+  }
+}
+
+template <typename AddressType>
+bool DwarfCfa<AddressType>::GetLocationRows(uint64_t start_offset, uint64_t end_offset,
+                                            DwarfLocations* loc_regs,
+                                            std::vector<DwarfLocations>* rows) {
+  if (cie_loc_regs_ != nullptr) {
+    // Start from the initial cie state.
+    *loc_regs = *cie_loc_regs_;
+  }
+  last_error_.code = DWARF_ERROR_NONE;
+  last_error_.address = 0;
+
+  memory_->set_cur_offset(start_offset);
+  cur_pc_ = fde_->pc_start;
+  uint64_t row_start = cur_pc_;
+  while (row_start < fde_->pc_end) {
+    if (memory_->cur_offset() >= end_offset) {
+      cur_pc_ = fde_->pc_end;
+    }
+    if (cur_pc_ < row_start) {
+      // A DW_CFA_set_loc moved backwards, this cannot be represented
+      // as a sorted table of rows.
+      last_error_.code = DWARF_ERROR_ILLEGAL_STATE;
+      return false;
+    }
+    if (cur_pc_ > row_start) {
+      // The pc advanced, so the current state is complete for the pcs
+      // in the range [row_start, cur_pc_).
+      rows->push_back(*loc_regs);
+      rows->back().pc_start = row_start;
+      rows->back().pc_end = std::min<uint64_t>(cur_pc_, fde_->pc_end);
+      row_start = cur_pc_;
+      continue;
+    }
+    if (!ProcessInstruction(loc_regs)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename AddressType>
+bool DwarfCfa<AddressType>::ProcessInstruction(DwarfLocations* loc_regs) {
+  operands_.clear();
+  // Read the cfa information.
+  uint8_t cfa_value;
+  if (!memory_->ReadBytes(&cfa_value, 1)) {
+    last_error_.code = DWARF_ERROR_MEMORY_INVALID;
+    last_error_.address = memory_->cur_offset();
+    return false;
+  }
+  uint8_t cfa_low = cfa_value & 0x3f;
+  // Check the 2 high bits.
+  switch (cfa_value >> 6) {
+    case 1:
+      cur_pc_ += cfa_low * fde_->cie->code_alignment_factor;
+      break;
+    case 2: {
+      uint64_t offset;
+      if (!memory_->ReadULEB128(&offset)) {
+        last_error_.code = DWARF_ERROR_MEMORY_INVALID;
+        last_error_.address = memory_->cur_offset();
+        return false;
+      }
+      SignedType signed_offset =
+          static_cast<SignedType>(offset) * fde_->cie->data_alignment_factor;
+      (*loc_regs)[cfa_low] = {.type = DWARF_LOCATION_OFFSET,
+                              .values = {static_cast<uint64_t>(signed_offset)}};
+      break;
+    }
+    case 3: {
+      if (cie_loc_regs_ == nullptr) {
+        log(0, "restore while processing cie");
+        last_error_.code = DWARF_ERROR_ILLEGAL_STATE;
+        return false;
       }
-      case 3: {
-        if (cie_loc_regs_ == nullptr) {
-          log(0, "restore while processing cie");
-          last_error_.code = DWARF_ERROR_ILLEGAL_STATE;
-          return false;
-        }
 
-        auto reg_entry = cie_loc_regs_->find(cfa_low);
-        if (reg_entry == cie_loc_regs_->end()) {
-          loc_regs->erase(cfa_low);
-        } else {
-          (*loc_regs)[cfa_low] = reg_entry->second;
-        }
-        break;
+      auto reg_entry = cie_loc_regs_->find(cfa_low);
+      if (reg_entry == cie_loc_regs_->end()) {
+        loc_regs->erase(cfa_low);
+      } else {
+        (*loc_regs)[cfa_low] = reg_entry->second;
+      }
+      break;
+    }
+    case 0: {
+      const auto handle_func = DwarfCfa<AddressType>::kCallbackTable[cfa_low];
+      if (handle_func == nullptr) {
+        last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+        return false;
       }
-      case 0: {
-        const auto handle_func = DwarfCfa<AddressType>::kCallbackTable[cfa_low];
-        if (handle_func == nullptr) {
-          last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
-          return false;
-        }
 
-        const auto cfa = &DwarfCfaInfo::kTable[cfa_low];
-        for (size_t i = 0; i < cfa->num_operands; i++) {
-          if (cfa->operands[i] == DW_EH_PE_block) {
-            uint64_t block_length;
-            if (!memory_->ReadULEB128(&block_length)) {
-              last_error_.code = DWARF_ERROR_MEMORY_INVALID;
-              last_error_.address = memory_->cur_offset();
-              return false;
-            }
-            operands_.push_back(block_length);
-            memory_->set_cur_offset(memory_->cur_offset() + block_length);
-            continue;
-          }
-          uint64_t value;
-          if (!memory_->ReadEncodedValue<AddressType>(cfa->operands[i], &value)) {
+      const auto cfa = &DwarfCfaInfo::kTable[cfa_low];
+      for (size_t i = 0; i < cfa->num_operands; i++) {
+        if (cfa->operands[i] == DW_EH_PE_block) {
+          uint64_t block_length;
+          if (!memory_->ReadULEB128(&block_length)) {
             last_error_.code = DWARF_ERROR_MEMORY_INVALID;
             last_error_.address = memory_->cur_offset();
             return false;
           }
-          operands_.push_back(value);
+          operands_.push_back(block_length);
+          memory_->set_cur_offset(memory_->cur_offset() + block_length);
+          continue;
         }
-
-        if (!(this->*handle_func)(loc_regs)) {
+        uint64_t value;
+        if (!memory_->ReadEncodedValue<AddressType>(cfa->operands[i], &value)) {
+          last_error_.code = DWARF_ERROR_MEMORY_INVALID;
+          last_error_.address = memory_->cur_offset();
           return false;
         }
-        break;
+        operands_.push_back(value);
+      }
+
+      if (!(this->*handle_func)(loc_regs)) {
+        return false;
       }
+      break;
     }
   }
+  return true;
 }
 
 template <typename AddressType>
@@ -82,6 +82,12 @@ class DwarfCfa {
   bool GetLocationInfo(uint64_t pc, uint64_t start_offset, uint64_t end_offset,
                        DwarfLocations* loc_regs);
 
+  // Evaluates the whole instruction stream of the fde and appends one entry
+  // per row of the unwind table to rows. The rows are sorted by pc and cover
+  // the range [fde->pc_start, fde->pc_end).
+  bool GetLocationRows(uint64_t start_offset, uint64_t end_offset, DwarfLocations* loc_regs,
+                       std::vector<DwarfLocations>* rows);
+
   bool Log(uint32_t indent, uint64_t pc, uint64_t start_offset, uint64_t end_offset);
 
   const DwarfErrorData& last_error() { return last_error_; }
@@ -99,6 +105,8 @@ class DwarfCfa {
 
   bool LogInstruction(uint32_t indent, uint64_t cfa_offset, uint8_t op, uint64_t* cur_pc);
 
+  bool ProcessInstruction(DwarfLocations* loc_regs);
+
  private:
   DwarfErrorData last_error_;
   DwarfMemory* memory_;
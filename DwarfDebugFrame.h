@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include <unwindstack/DwarfSection.h>
@@ -43,6 +44,13 @@ class DwarfDebugFrame : public DwarfSectionImpl<AddressType> {
   }
 
   uint64_t AdjustPcFromFde(uint64_t pc) override { return pc; }
+
+  std::unique_ptr<DwarfSectionImpl<AddressType>> CreateIndexWorker() override {
+    auto worker = std::make_unique<DwarfDebugFrame<AddressType>>(this->memory_.memory());
+    worker->Init(this->entries_offset_, this->entries_end_ - this->entries_offset_,
+                 this->section_bias_);
+    return worker;
+  }
 };
 
 }  // namespace unwindstack
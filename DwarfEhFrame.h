@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <memory>
+
 #include <unwindstack/DwarfSection.h>
 #include <unwindstack/Memory.h>
 
@@ -42,6 +44,13 @@ class DwarfEhFrame : public DwarfSectionImpl<AddressType> {
     // The eh_frame uses relative pcs.
     return pc + this->memory_.cur_offset() - 4;
   }
+
+  std::unique_ptr<DwarfSectionImpl<AddressType>> CreateIndexWorker() override {
+    auto worker = std::make_unique<DwarfEhFrame<AddressType>>(this->memory_.memory());
+    worker->Init(this->entries_offset_, this->entries_end_ - this->entries_offset_,
+                 this->section_bias_);
+    return worker;
+  }
 };
 
 }  // namespace unwindstack
@@ -16,6 +16,11 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <vector>
+
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfStructs.h>
 #include <unwindstack/Memory.h>
@@ -23,6 +28,7 @@
 #include "Check.h"
 #include "DwarfEhFrameWithHdr.h"
 #include "DwarfEncoding.h"
+#include "MemoryUsage.h"
 
 namespace unwindstack {
 
@@ -115,7 +121,7 @@ const DwarfFde* DwarfEhFrameWithHdr<AddressType>::GetFdeFromPc(uint64_t pc) {
   // due to a bug. If this happens, try and find the non-zero length FDE
   // from eh_frame directly. See b/142483624.
   if (fde->pc_start == fde->pc_end) {
-    fde = DwarfSectionImpl<AddressType>::GetFdeFromPc(pc);
+    fde = RecoverZeroLengthFde(pc, fde_offset);
     if (fde == nullptr) {
       return nullptr;
     }
@@ -158,12 +164,113 @@ DwarfEhFrameWithHdr<AddressType>::GetFdeInfoFromIndex(size_t index) {
   return info;
 }
 
+// Number of lookups using the table in memory before it is decoded.
+static constexpr size_t kSearchTableMinLookups = 32;
+
+template <typename AddressType>
+static size_t FillSearchTable(
+    const std::vector<typename DwarfEhFrameWithHdr<AddressType>::FdeInfo>& sorted, size_t index,
+    size_t node, std::vector<AddressType>* pcs, std::vector<AddressType>* offsets) {
+  if (node < pcs->size()) {
+    index = FillSearchTable(sorted, index, 2 * node, pcs, offsets);
+    (*pcs)[node] = sorted[index].pc;
+    (*offsets)[node] = index == 0 ? std::numeric_limits<AddressType>::max()
+                                  : static_cast<AddressType>(sorted[index - 1].offset);
+    index = FillSearchTable(sorted, index + 1, 2 * node + 1, pcs, offsets);
+  }
+  return index;
+}
+
+template <typename AddressType>
+bool DwarfEhFrameWithHdr<AddressType>::BuildSearchTable() {
+  // Make sure the count is not corrupted before allocating the table.
+  if (fde_count_ > std::numeric_limits<uint64_t>::max() / (2 * table_entry_size_) ||
+      GetFdeInfoFromIndex(fde_count_ - 1) == nullptr) {
+    return false;
+  }
+
+  std::vector<FdeInfo> sorted(fde_count_);
+  memory_.set_data_offset(hdr_entries_data_offset_);
+  memory_.set_cur_offset(hdr_entries_offset_);
+  memory_.set_pc_offset(0);
+  for (FdeInfo& info : sorted) {
+    uint64_t value;
+    if (!memory_.template ReadEncodedValue<AddressType>(table_encoding_, &value) ||
+        !memory_.template ReadEncodedValue<AddressType>(table_encoding_, &info.offset) ||
+        info.offset >= std::numeric_limits<AddressType>::max()) {
+      return false;
+    }
+    // Relative encodings require adding in the load bias.
+    if (IsEncodingRelative(table_encoding_)) {
+      value += hdr_section_bias_;
+    }
+    info.pc = value;
+  }
+  auto comp = [](const FdeInfo& a, const FdeInfo& b) { return a.pc < b.pc; };
+  if (!std::is_sorted(sorted.begin(), sorted.end(), comp)) {
+    std::stable_sort(sorted.begin(), sorted.end(), comp);
+  }
+
+  search_pcs_.resize(sorted.size() + 1);
+  search_offsets_.resize(sorted.size() + 1);
+  FillSearchTable<AddressType>(sorted, 0, 1, &search_pcs_, &search_offsets_);
+  search_last_offset_ = sorted.back().offset;
+
+  // The decoded entries are not needed anymore.
+  fde_info_.clear();
+  return true;
+}
+
+template <typename AddressType>
+void DwarfEhFrameWithHdr<AddressType>::BuildIndex() {
+  if (fde_count_ != 0 && search_pcs_.empty() && !search_table_failed_) {
+    search_table_failed_ = !BuildSearchTable();
+  }
+}
+
 template <typename AddressType>
 bool DwarfEhFrameWithHdr<AddressType>::GetFdeOffsetFromPc(uint64_t pc, uint64_t* fde_offset) {
   if (fde_count_ == 0) {
     return false;
   }
 
+  if (search_pcs_.empty() && !search_table_failed_ && ++lookups_ >= kSearchTableMinLookups) {
+    search_table_failed_ = !BuildSearchTable();
+  }
+  if (!search_pcs_.empty()) {
+    // Find the first entry with a pc greater than the pc, the fde is the
+    // one before it. The nodes four levels down are fetched ahead of time.
+    const AddressType* pcs = search_pcs_.data();
+    size_t size = search_pcs_.size();
+    size_t node = 1;
+    while (node < size) {
+      if (16 * node < size) {
+        __builtin_prefetch(&pcs[16 * node]);
+      }
+      node = 2 * node + (pcs[node] <= pc);
+    }
+    node >>= __builtin_ffsll(~static_cast<long long>(node));
+    if (node == 0) {
+      *fde_offset = search_last_offset_;
+      return true;
+    }
+    if (search_offsets_[node] == std::numeric_limits<AddressType>::max()) {
+      return false;
+    }
+    *fde_offset = search_offsets_[node];
+    return true;
+  }
+
+  size_t index;
+  if (!GetFdeIndexFromPc(pc, &index)) {
+    return false;
+  }
+  *fde_offset = GetFdeInfoFromIndex(index)->offset;
+  return true;
+}
+
+template <typename AddressType>
+bool DwarfEhFrameWithHdr<AddressType>::GetFdeIndexFromPc(uint64_t pc, size_t* index) {
   size_t first = 0;
   size_t last = fde_count_;
   while (first < last) {
@@ -173,7 +280,7 @@ bool DwarfEhFrameWithHdr<AddressType>::GetFdeOffsetFromPc(uint64_t pc, uint64_t*
       return false;
     }
     if (pc == info->pc) {
-      *fde_offset = info->offset;
+      *index = current;
       return true;
     }
     if (pc < info->pc) {
@@ -183,16 +290,84 @@ bool DwarfEhFrameWithHdr<AddressType>::GetFdeOffsetFromPc(uint64_t pc, uint64_t*
     }
   }
   if (last != 0) {
-    const FdeInfo* info = GetFdeInfoFromIndex(last - 1);
-    if (info == nullptr) {
+    if (GetFdeInfoFromIndex(last - 1) == nullptr) {
       return false;
     }
-    *fde_offset = info->offset;
+    *index = last - 1;
     return true;
   }
   return false;
 }
 
+// The hdr entries on either side of a zero length FDE that are checked, and
+// the most eh_frame entries read after the lowest of them.
+static constexpr size_t kRecoveryHdrEntries = 8;
+static constexpr size_t kRecoveryMaxEntries = 256;
+
+template <typename AddressType>
+const DwarfFde* DwarfEhFrameWithHdr<AddressType>::RecoverZeroLengthFde(uint64_t pc,
+                                                                       uint64_t fde_offset) {
+  auto patch = zero_length_fdes_.find(fde_offset);
+  if (patch != zero_length_fdes_.end() && patch->second->pc_start <= pc &&
+      pc < patch->second->pc_end) {
+    return patch->second;
+  }
+
+  // The real FDE is usually a hdr entry with the same pc next to this one,
+  // or an entry close by in eh_frame that is missing from the hdr, so only
+  // fall back to indexing all of eh_frame when neither is found.
+  const DwarfFde* fde = nullptr;
+  size_t index;
+  if (GetFdeIndexFromPc(pc, &index)) {
+    size_t first = index < kRecoveryHdrEntries ? 0 : index - kRecoveryHdrEntries;
+    size_t last = std::min<uint64_t>(fde_count_, index + kRecoveryHdrEntries + 1);
+    uint64_t scan_offset = fde_offset;
+    for (size_t i = first; i < last && fde == nullptr; i++) {
+      const FdeInfo* info = GetFdeInfoFromIndex(i);
+      if (info == nullptr) {
+        continue;
+      }
+      scan_offset = std::min(scan_offset, info->offset);
+      const DwarfFde* neighbor = this->GetFdeFromOffset(info->offset);
+      if (neighbor != nullptr && neighbor->pc_start <= pc && pc < neighbor->pc_end) {
+        fde = neighbor;
+      }
+    }
+
+    uint64_t offset = std::max(scan_offset, this->entries_offset_);
+    for (size_t i = 0; i < kRecoveryMaxEntries && fde == nullptr && offset < this->entries_end_;
+         i++) {
+      const uint64_t entry_offset = offset;
+      std::optional<DwarfFde> entry;
+      if (!this->GetNextCieOrFde(offset, entry)) {
+        break;
+      }
+      if (entry.has_value() && entry->pc_start <= pc && pc < entry->pc_end) {
+        fde = this->GetFdeFromOffset(entry_offset);
+      }
+      if (offset < memory_.cur_offset()) {
+        break;
+      }
+    }
+  }
+
+  if (fde == nullptr) {
+    fde = DwarfSectionImpl<AddressType>::GetFdeFromPc(pc);
+    if (fde == nullptr) {
+      return nullptr;
+    }
+  }
+  zero_length_fdes_[fde_offset] = fde;
+  return fde;
+}
+
+template <typename AddressType>
+void DwarfEhFrameWithHdr<AddressType>::GetMemoryUsage(ElfMemoryUsage* usage) {
+  DwarfSectionImpl<AddressType>::GetMemoryUsage(usage);
+  usage->unwind_index += HashMapMemoryUsage(fde_info_) + VectorMemoryUsage(search_pcs_) +
+                         VectorMemoryUsage(search_offsets_) + HashMapMemoryUsage(zero_length_fdes_);
+}
+
 template <typename AddressType>
 void DwarfEhFrameWithHdr<AddressType>::GetFdes(std::vector<const DwarfFde*>* fdes) {
   for (size_t i = 0; i < fde_count_; i++) {
@@ -209,7 +384,7 @@ void DwarfEhFrameWithHdr<AddressType>::GetFdes(std::vector<const DwarfFde*>* fde
     // due to a bug. If this happens, try and find the non-zero length FDE
     // from eh_frame directly. See b/142483624.
     if (fde->pc_start == fde->pc_end) {
-      const DwarfFde* fde_real = DwarfSectionImpl<AddressType>::GetFdeFromPc(fde->pc_start);
+      const DwarfFde* fde_real = RecoverZeroLengthFde(fde->pc_start, info->offset);
       if (fde_real != nullptr) {
         fde = fde_real;
       }
@@ -19,7 +19,9 @@
 
 #include <stdint.h>
 
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/DwarfSection.h>
 
@@ -64,10 +66,30 @@ class DwarfEhFrameWithHdr : public DwarfSectionImpl<AddressType> {
 
   bool GetFdeOffsetFromPc(uint64_t pc, uint64_t* fde_offset);
 
+  // Binary searches the table in memory for the entry of pc.
+  bool GetFdeIndexFromPc(uint64_t pc, size_t* index);
+
+  // Finds the FDE of pc when the entry at fde_offset has a zero length,
+  // looking near it before indexing all of eh_frame.
+  const DwarfFde* RecoverZeroLengthFde(uint64_t pc, uint64_t fde_offset);
+
   const FdeInfo* GetFdeInfoFromIndex(size_t index);
 
+  // Decodes the whole table into search_pcs_ and search_offsets_.
+  bool BuildSearchTable();
+
   void GetFdes(std::vector<const DwarfFde*>* fdes) override;
 
+  void GetMemoryUsage(ElfMemoryUsage* usage) override;
+
+  // Decodes the search table now rather than after enough lookups.
+  void BuildIndex() override;
+
+  // The .eh_frame_hdr table is used instead of an fde index.
+  void SaveIndex(ElfIndexWriter*, ElfIndexScope) override {}
+  void LoadIndex(const std::shared_ptr<ElfIndexFile>&, ElfIndexScope) override {}
+  void ShareIndex(const std::string&, ElfIndexScope) override {}
+
  protected:
   uint8_t version_ = 0;
   uint8_t table_encoding_ = 0;
@@ -79,6 +101,19 @@ class DwarfEhFrameWithHdr : public DwarfSectionImpl<AddressType> {
 
   uint64_t fde_count_ = 0;
   std::unordered_map<uint64_t, FdeInfo> fde_info_;
+
+  // Once a section has been searched often enough, the table is decoded
+  // into an Eytzinger layout (the children of node k are 2k and 2k+1,
+  // node 0 is unused). For every node, search_offsets_ holds the fde offset
+  // of the entry right before it in pc order.
+  size_t lookups_ = 0;
+  bool search_table_failed_ = false;
+  std::vector<AddressType> search_pcs_;
+  std::vector<AddressType> search_offsets_;
+  AddressType search_last_offset_ = 0;
+
+  // The FDE found for each zero length FDE offset.
+  std::unordered_map<uint64_t, const DwarfFde*> zero_length_fdes_;
 };
 
 }  // namespace unwindstack
@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include <string>
 
@@ -26,7 +27,31 @@
 
 namespace unwindstack {
 
-bool DwarfMemory::ReadBytes(void* dst, size_t num_bytes) {
+bool DwarfMemory::FillWindow() {
+  const uint8_t* data = memory_->GetPointer(cur_offset_, kBorrowSize);
+  if (data != nullptr) {
+    window_ = data;
+    window_size_ = kBorrowSize;
+  } else {
+    // Near the end of the memory the read can be short, that is fine as
+    // long as some data is read.
+    window_size_ = memory_->Read(cur_offset_, buffer_, kBufferSize);
+    if (window_size_ == 0) {
+      ClearWindow();
+      return false;
+    }
+    window_ = buffer_;
+  }
+  window_start_ = cur_offset_;
+  return true;
+}
+
+bool DwarfMemory::ReadBytesSlow(void* dst, size_t num_bytes) {
+  if (buffered_ && num_bytes <= kBufferSize && FillWindow() && num_bytes <= window_size_) {
+    memcpy(dst, window_, num_bytes);
+    cur_offset_ += num_bytes;
+    return true;
+  }
   if (!memory_->ReadFully(cur_offset_, dst, num_bytes)) {
     return false;
   }
@@ -44,7 +69,46 @@ bool DwarfMemory::ReadSigned(uint64_t* value) {
   return true;
 }
 
+// Decodes an LEB128 value of up to 8 bytes without a loop. Returns the number
+// of bytes used, or 0 if the value does not end in the first 8 bytes.
+static inline size_t DecodeLEB128(const uint8_t* data, uint64_t* value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t word;
+  memcpy(&word, data, sizeof(word));
+  // The last byte of the value is the first without the continuation bit.
+  uint64_t ends = ~word & 0x8080808080808080ULL;
+  if (ends == 0) {
+    return 0;
+  }
+  size_t bytes = (__builtin_ctzll(ends) >> 3) + 1;
+  if (bytes < sizeof(word)) {
+    word &= (1ULL << (bytes * 8)) - 1;
+  }
+  // Squeeze out the continuation bits, merging the 7 bit groups in pairs.
+  word &= 0x7f7f7f7f7f7f7f7fULL;
+  word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+  word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+  word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+  *value = word;
+  return bytes;
+#else
+  (void)data;
+  (void)value;
+  return 0;
+#endif
+}
+
 bool DwarfMemory::ReadULEB128(uint64_t* value) {
+  // Fast-path: Decode directly from the window.
+  uint64_t index = cur_offset_ - window_start_;
+  if (index < window_size_ && window_size_ - index >= sizeof(uint64_t)) {
+    size_t bytes = DecodeLEB128(&window_[index], value);
+    if (bytes != 0) {
+      cur_offset_ += bytes;
+      return true;
+    }
+  }
+
   uint64_t cur_value = 0;
   uint64_t shift = 0;
   uint8_t byte;
@@ -60,6 +124,23 @@ bool DwarfMemory::ReadULEB128(uint64_t* value) {
 }
 
 bool DwarfMemory::ReadSLEB128(int64_t* value) {
+  // Fast-path: Decode directly from the window.
+  uint64_t index = cur_offset_ - window_start_;
+  if (index < window_size_ && window_size_ - index >= sizeof(uint64_t)) {
+    uint64_t cur_value;
+    size_t bytes = DecodeLEB128(&window_[index], &cur_value);
+    if (bytes != 0) {
+      uint64_t shift = bytes * 7;
+      if (cur_value & (1ULL << (shift - 1))) {
+        // Negative value, need to sign extend.
+        cur_value |= static_cast<uint64_t>(-1) << shift;
+      }
+      *value = static_cast<int64_t>(cur_value);
+      cur_offset_ += bytes;
+      return true;
+    }
+  }
+
   uint64_t cur_value = 0;
   uint64_t shift = 0;
   uint8_t byte;
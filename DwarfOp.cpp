@@ -16,7 +16,6 @@
 
 #include <stdint.h>
 
-#include <deque>
 #include <string>
 #include <vector>
 
@@ -24,6 +23,7 @@
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfMemory.h>
+#include <unwindstack/DwarfSection.h>
 #include <unwindstack/Log.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
@@ -1434,50 +1434,6 @@ constexpr static OpCallback kCallbackTable[256] = {
     {"", OP_ILLEGAL, 0, 0, {}},  // 0xff DW_OP_hi_user
 };
 
-template <typename AddressType>
-const typename DwarfOp<AddressType>::OpHandleFuncPtr DwarfOp<AddressType>::kOpHandleFuncList[] = {
-    [OP_ILLEGAL] = nullptr,
-    [OP_DEREF] = &DwarfOp<AddressType>::op_deref,
-    [OP_DEREF_SIZE] = &DwarfOp<AddressType>::op_deref_size,
-    [OP_PUSH] = &DwarfOp<AddressType>::op_push,
-    [OP_DUP] = &DwarfOp<AddressType>::op_dup,
-    [OP_DROP] = &DwarfOp<AddressType>::op_drop,
-    [OP_OVER] = &DwarfOp<AddressType>::op_over,
-    [OP_PICK] = &DwarfOp<AddressType>::op_pick,
-    [OP_SWAP] = &DwarfOp<AddressType>::op_swap,
-    [OP_ROT] = &DwarfOp<AddressType>::op_rot,
-    [OP_ABS] = &DwarfOp<AddressType>::op_abs,
-    [OP_AND] = &DwarfOp<AddressType>::op_and,
-    [OP_DIV] = &DwarfOp<AddressType>::op_div,
-    [OP_MINUS] = &DwarfOp<AddressType>::op_minus,
-    [OP_MOD] = &DwarfOp<AddressType>::op_mod,
-    [OP_MUL] = &DwarfOp<AddressType>::op_mul,
-    [OP_NEG] = &DwarfOp<AddressType>::op_neg,
-    [OP_NOT] = &DwarfOp<AddressType>::op_not,
-    [OP_OR] = &DwarfOp<AddressType>::op_or,
-    [OP_PLUS] = &DwarfOp<AddressType>::op_plus,
-    [OP_PLUS_UCONST] = &DwarfOp<AddressType>::op_plus_uconst,
-    [OP_SHL] = &DwarfOp<AddressType>::op_shl,
-    [OP_SHR] = &DwarfOp<AddressType>::op_shr,
-    [OP_SHRA] = &DwarfOp<AddressType>::op_shra,
-    [OP_XOR] = &DwarfOp<AddressType>::op_xor,
-    [OP_BRA] = &DwarfOp<AddressType>::op_bra,
-    [OP_EQ] = &DwarfOp<AddressType>::op_eq,
-    [OP_GE] = &DwarfOp<AddressType>::op_ge,
-    [OP_GT] = &DwarfOp<AddressType>::op_gt,
-    [OP_LE] = &DwarfOp<AddressType>::op_le,
-    [OP_LT] = &DwarfOp<AddressType>::op_lt,
-    [OP_NE] = &DwarfOp<AddressType>::op_ne,
-    [OP_SKIP] = &DwarfOp<AddressType>::op_skip,
-    [OP_LIT] = &DwarfOp<AddressType>::op_lit,
-    [OP_REG] = &DwarfOp<AddressType>::op_reg,
-    [OP_REGX] = &DwarfOp<AddressType>::op_regx,
-    [OP_BREG] = &DwarfOp<AddressType>::op_breg,
-    [OP_BREGX] = &DwarfOp<AddressType>::op_bregx,
-    [OP_NOP] = &DwarfOp<AddressType>::op_nop,
-    [OP_NOT_IMPLEMENTED] = &DwarfOp<AddressType>::op_not_implemented,
-};
-
 template <typename AddressType>
 bool DwarfOp<AddressType>::Eval(uint64_t start, uint64_t end) {
   is_register_ = false;
@@ -1498,7 +1454,7 @@ bool DwarfOp<AddressType>::Eval(uint64_t start, uint64_t end) {
     return true;
   }
   bool check_for_drop;
-  if (cur_op_ == 0x0c && operands_.back() == 0x31584544) {
+  if (cur_op_ == 0x0c && operands_[num_operands_ - 1] == 0x31584544) {
     check_for_drop = true;
   } else {
     check_for_drop = false;
@@ -1545,15 +1501,18 @@ bool DwarfOp<AddressType>::Decode() {
     return false;
   }
 
-  const auto handle_func = kOpHandleFuncList[op->handle_func];
-
-  // Make sure that the required number of stack elements is available.
+  // Make sure that the required number of stack elements is available,
+  // and that there is room for the values the op might push.
   if (stack_.size() < op->num_required_stack_values) {
     last_error_.code = DWARF_ERROR_STACK_INDEX_NOT_VALID;
     return false;
   }
+  if (stack_.size() + 2 > stack_.capacity()) {
+    last_error_.code = DWARF_ERROR_STACK_INDEX_NOT_VALID;
+    return false;
+  }
 
-  operands_.clear();
+  num_operands_ = 0;
   for (size_t i = 0; i < op->num_operands; i++) {
     uint64_t value;
     if (!memory_->ReadEncodedValue<AddressType>(op->operands[i], &value)) {
@@ -1561,9 +1520,185 @@ bool DwarfOp<AddressType>::Decode() {
       last_error_.address = memory_->cur_offset();
       return false;
     }
-    operands_.push_back(value);
+    operands_[num_operands_++] = value;
+  }
+  return Execute(op->handle_func);
+}
+
+template <typename AddressType>
+bool DwarfOp<AddressType>::Execute(uint8_t handle_func) {
+  // A switch instead of a table of member function pointers, which would
+  // be relocated data, one table per AddressType.
+  switch (handle_func) {
+    case OP_DEREF:
+      return op_deref();
+    case OP_DEREF_SIZE:
+      return op_deref_size();
+    case OP_PUSH:
+      return op_push();
+    case OP_DUP:
+      return op_dup();
+    case OP_DROP:
+      return op_drop();
+    case OP_OVER:
+      return op_over();
+    case OP_PICK:
+      return op_pick();
+    case OP_SWAP:
+      return op_swap();
+    case OP_ROT:
+      return op_rot();
+    case OP_ABS:
+      return op_abs();
+    case OP_AND:
+      return op_and();
+    case OP_DIV:
+      return op_div();
+    case OP_MINUS:
+      return op_minus();
+    case OP_MOD:
+      return op_mod();
+    case OP_MUL:
+      return op_mul();
+    case OP_NEG:
+      return op_neg();
+    case OP_NOT:
+      return op_not();
+    case OP_OR:
+      return op_or();
+    case OP_PLUS:
+      return op_plus();
+    case OP_PLUS_UCONST:
+      return op_plus_uconst();
+    case OP_SHL:
+      return op_shl();
+    case OP_SHR:
+      return op_shr();
+    case OP_SHRA:
+      return op_shra();
+    case OP_XOR:
+      return op_xor();
+    case OP_BRA:
+      return op_bra();
+    case OP_EQ:
+      return op_eq();
+    case OP_GE:
+      return op_ge();
+    case OP_GT:
+      return op_gt();
+    case OP_LE:
+      return op_le();
+    case OP_LT:
+      return op_lt();
+    case OP_NE:
+      return op_ne();
+    case OP_SKIP:
+      return op_skip();
+    case OP_LIT:
+      return op_lit();
+    case OP_REG:
+      return op_reg();
+    case OP_REGX:
+      return op_regx();
+    case OP_BREG:
+      return op_breg();
+    case OP_BREGX:
+      return op_bregx();
+    case OP_NOP:
+      return op_nop();
   }
-  return (this->*handle_func)();
+  return op_not_implemented();
+}
+
+template <typename AddressType>
+bool DwarfOp<AddressType>::Compile(uint64_t start, uint64_t end,
+                                   DwarfCompiledExpression* compiled) {
+  compiled->end = end;
+  compiled->kind = DwarfCompiledExpression::KIND_INTERPRETED;
+  compiled->dex_pc = false;
+  compiled->ops.clear();
+
+  memory_->set_cur_offset(start);
+  while (memory_->cur_offset() < end) {
+    uint8_t cur_op;
+    if (!memory_->ReadBytes(&cur_op, 1)) {
+      return false;
+    }
+    const auto* op = &kCallbackTable[cur_op];
+    switch (op->handle_func) {
+      case OP_ILLEGAL:
+      case OP_NOT_IMPLEMENTED:
+      case OP_BRA:
+      case OP_SKIP:
+        return false;
+      default:
+        break;
+    }
+    DwarfCompiledExpression::Op& entry = compiled->ops.emplace_back();
+    entry.op = cur_op;
+    for (size_t i = 0; i < op->num_operands; i++) {
+      uint64_t value;
+      if (!memory_->ReadEncodedValue<AddressType>(op->operands[i], &value)) {
+        return false;
+      }
+      entry.operands[i] = static_cast<AddressType>(value);
+    }
+    // Leave the iteration limit to Eval.
+    if (compiled->ops.size() > 1000) {
+      return false;
+    }
+  }
+
+  const std::vector<DwarfCompiledExpression::Op>& ops = compiled->ops;
+  // See Eval for this sequence.
+  compiled->dex_pc = ops.size() >= 2 && ops[0].op == 0x0c && ops[0].operands[0] == 0x31584544 &&
+                     ops[1].op == 0x13;
+
+  compiled->kind = DwarfCompiledExpression::KIND_OPS;
+  if (ops.size() == 1 || (ops.size() == 2 && ops[1].op == 0x06)) {
+    uint64_t reg = UINT64_MAX;
+    if (ops[0].op >= 0x70 && ops[0].op <= 0x8f) {
+      // DW_OP_breg0 through DW_OP_breg31.
+      reg = ops[0].op - 0x70;
+      compiled->offset = ops[0].operands[0];
+    } else if (ops[0].op == 0x92) {
+      // DW_OP_bregx
+      reg = ops[0].operands[0];
+      compiled->offset = ops[0].operands[1];
+    }
+    if (reg < UINT32_MAX) {
+      compiled->reg = reg;
+      compiled->kind = ops.size() == 1 ? DwarfCompiledExpression::KIND_BREG
+                                       : DwarfCompiledExpression::KIND_BREG_DEREF;
+    }
+  }
+  return true;
+}
+
+template <typename AddressType>
+bool DwarfOp<AddressType>::EvalCompiled(const DwarfCompiledExpression& compiled) {
+  is_register_ = false;
+  stack_.clear();
+  dex_pc_set_ = compiled.dex_pc;
+  for (const DwarfCompiledExpression::Op& entry : compiled.ops) {
+    last_error_.code = DWARF_ERROR_NONE;
+    cur_op_ = entry.op;
+    const auto* op = &kCallbackTable[cur_op_];
+    // The same checks as Decode.
+    if (stack_.size() < op->num_required_stack_values ||
+        stack_.size() + 2 > stack_.capacity()) {
+      last_error_.code = DWARF_ERROR_STACK_INDEX_NOT_VALID;
+      return false;
+    }
+    num_operands_ = op->num_operands;
+    for (size_t i = 0; i < num_operands_; i++) {
+      operands_[i] = entry.operands[i];
+    }
+    if (!Execute(op->handle_func)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 template <typename AddressType>
@@ -1644,8 +1779,8 @@ bool DwarfOp<AddressType>::op_deref_size() {
 template <typename AddressType>
 bool DwarfOp<AddressType>::op_push() {
   // Push all of the operands.
-  for (auto operand : operands_) {
-    stack_.push_front(operand);
+  for (size_t i = 0; i < num_operands_; i++) {
+    stack_.push_front(operands_[i]);
   }
   return true;
 }
@@ -17,9 +17,9 @@
 #ifndef _LIBUNWINDSTACK_DWARF_OP_H
 #define _LIBUNWINDSTACK_DWARF_OP_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <deque>
 #include <string>
 #include <type_traits>
 #include <vector>
@@ -34,9 +34,31 @@ namespace unwindstack {
 // Forward declarations.
 class DwarfMemory;
 class Memory;
+struct DwarfCompiledExpression;
 template <typename AddressType>
 class RegsImpl;
 
+// The subset of std::deque used as the expression stack, front being the
+// top of the stack, kept inline with a fixed capacity.
+template <typename ValueType, size_t kCapacity>
+class DwarfOpStack {
+ public:
+  ValueType& operator[](size_t index) { return values_[size_ - 1 - index]; }
+  ValueType& front() { return values_[size_ - 1]; }
+
+  void push_front(ValueType value) { values_[size_++] = value; }
+  void pop_front() { size_--; }
+
+  size_t size() const { return size_; }
+  void clear() { size_ = 0; }
+
+  static constexpr size_t capacity() { return kCapacity; }
+
+ private:
+  size_t size_ = 0;
+  ValueType values_[kCapacity];
+};
+
 template <typename AddressType>
 class DwarfOp {
   // Signed version of AddressType
@@ -51,6 +73,14 @@ class DwarfOp {
 
   bool Eval(uint64_t start, uint64_t end);
 
+  // Decodes the ops between start and end without evaluating them. Returns
+  // false, leaving the expression to Eval, if an op cannot be decoded, is
+  // not supported, or branches.
+  bool Compile(uint64_t start, uint64_t end, DwarfCompiledExpression* compiled);
+
+  // Same as Eval, using the decoded ops of the expression.
+  bool EvalCompiled(const DwarfCompiledExpression& compiled);
+
   void GetLogInfo(uint64_t start, uint64_t end, std::vector<std::string>* lines);
 
   AddressType StackAt(size_t index) { return stack_[index]; }
@@ -72,7 +102,7 @@ class DwarfOp {
 
  protected:
   AddressType OperandAt(size_t index) { return operands_[index]; }
-  size_t OperandsSize() { return operands_.size(); }
+  size_t OperandsSize() { return num_operands_; }
 
   AddressType StackPop() {
     AddressType value = stack_.front();
@@ -89,11 +119,16 @@ class DwarfOp {
   bool is_register_ = false;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
   uint8_t cur_op_;
-  std::vector<AddressType> operands_;
-  std::deque<AddressType> stack_;
+  // No op has more than two operands, or pushes more than two values.
+  AddressType operands_[2];
+  size_t num_operands_ = 0;
+  DwarfOpStack<AddressType, 64> stack_;
 
   inline AddressType bool_to_dwarf_bool(bool value) { return value ? 1 : 0; }
 
+  // Runs the handler of the current op, the operands are already set.
+  bool Execute(uint8_t handle_func);
+
   // Op processing functions.
   bool op_deref();
   bool op_deref_size();
@@ -134,9 +169,6 @@ class DwarfOp {
   bool op_bregx();
   bool op_nop();
   bool op_not_implemented();
-
-  using OpHandleFuncPtr = bool (DwarfOp::*)();
-  static const OpHandleFuncPtr kOpHandleFuncList[];
 };
 
 }  // namespace unwindstack
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfRowCache.h>
+
+namespace unwindstack {
+
+// Fibonacci hashing, so that pcs that are close together are spread across
+// the whole table.
+static uint64_t Hash(uint64_t value) {
+  return (value * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+DwarfRowCache::Set& DwarfRowCache::GetSet(uint64_t region) {
+  return sets_[Hash(region) & mask_];
+}
+
+std::shared_ptr<const DwarfLocations> DwarfRowCache::Find(uint64_t pc) {
+  if (sets_.empty()) {
+    return nullptr;
+  }
+  Set& set = GetSet(pc >> kRegionBits);
+  for (auto& slot : set.rows) {
+    std::shared_ptr<const DwarfLocations> row = std::atomic_load(&slot);
+    if (row != nullptr && pc >= row->pc_start && pc < row->pc_end) {
+      return row;
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<const DwarfLocations> DwarfRowCache::Add(uint64_t pc, DwarfLocations&& loc_regs) {
+  auto row = std::make_shared<const DwarfLocations>(std::move(loc_regs));
+  if (sets_.empty() || pc < row->pc_start || pc >= row->pc_end) {
+    return row;
+  }
+
+  size_t way = Hash(row->pc_start) % kWays;
+  uint64_t region = pc >> kRegionBits;
+  std::shared_ptr<const DwarfLocations> cached = std::atomic_load(&GetSet(region).rows[way]);
+  if (cached != nullptr && cached->pc_start == row->pc_start && cached->pc_end == row->pc_end) {
+    return cached;
+  }
+
+  // Store the row in the regions it covers around pc, so that the pcs near
+  // pc find it without evaluating the row again.
+  uint64_t first = region - std::min<uint64_t>(region - (row->pc_start >> kRegionBits),
+                                               kMaxRegions / 2);
+  uint64_t last = std::min<uint64_t>((row->pc_end - 1) >> kRegionBits, first + kMaxRegions - 1);
+  for (uint64_t cur = first; cur <= last; cur++) {
+    std::atomic_store(&GetSet(cur).rows[way], row);
+  }
+  return row;
+}
+
+void DwarfRowCache::Resize(size_t size) {
+  sets_.clear();
+  if (size == 0) {
+    mask_ = 0;
+    sets_.shrink_to_fit();
+    return;
+  }
+
+  size_t num_sets = 1;
+  while (num_sets * kWays < size) {
+    num_sets *= 2;
+  }
+  mask_ = num_sets - 1;
+  sets_.resize(num_sets);
+  sets_.shrink_to_fit();
+}
+
+size_t DwarfRowCache::MemoryUsage() {
+  size_t usage = sets_.capacity() * sizeof(Set);
+  // A row is shared by the sets of all of the regions it covers.
+  std::unordered_set<const DwarfLocations*> rows;
+  for (auto& set : sets_) {
+    for (auto& slot : set.rows) {
+      std::shared_ptr<const DwarfLocations> row = std::atomic_load(&slot);
+      if (row != nullptr && rows.insert(row.get()).second) {
+        // The row and the shared_ptr control block are in one allocation.
+        usage += sizeof(DwarfLocations) + 2 * sizeof(void*);
+      }
+    }
+  }
+  return usage;
+}
+
+void DwarfRowCache::Clear() {
+  for (auto& set : sets_) {
+    for (auto& slot : set.rows) {
+      std::atomic_store(&slot, std::shared_ptr<const DwarfLocations>());
+    }
+  }
+}
+
+}  // namespace unwindstack
@@ -15,6 +15,16 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
@@ -23,25 +33,61 @@
 #include <unwindstack/DwarfStructs.h>
 #include <unwindstack/Elf.h>
 #include <unwindstack/Log.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineX86_64.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
+#include <unwindstack/RegsArm.h>
+#include <unwindstack/RegsArm64.h>
+#include <unwindstack/RegsX86.h>
+#include <unwindstack/RegsX86_64.h>
 
 #include "DwarfCfa.h"
 #include "DwarfDebugFrame.h"
 #include "DwarfEhFrame.h"
 #include "DwarfEncoding.h"
 #include "DwarfOp.h"
+#include "MemoryUsage.h"
 #include "RegsInfo.h"
 
 namespace unwindstack {
 
-DwarfSection::DwarfSection(Memory* memory) : memory_(memory) {}
+// The step is also instantiated for the registers of the architecture this
+// library is built for, so that unwinding the current process does not go
+// through virtual calls for every register.
+#if defined(__arm__)
+using CurrentRegs = RegsArm;
+#elif defined(__aarch64__)
+using CurrentRegs = RegsArm64;
+#elif defined(__i386__)
+using CurrentRegs = RegsX86;
+#elif defined(__x86_64__)
+using CurrentRegs = RegsX86_64;
+#endif
+
+DwarfSection::DwarfSection(Memory* memory) : memory_(memory) {
+  // The section data is read from the elf, which does not change.
+  memory_.set_buffered(true);
+}
 
 bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
                         bool* is_signal_frame) {
+  if (compiled_unwind_tables_) {
+    const DwarfCompiledFde* compiled;
+    const DwarfCompiledRow* row = GetCompiledRow(pc, regs->Arch(), &compiled);
+    if (row != nullptr && !row->use_interpreter) {
+      last_error_.code = DWARF_ERROR_NONE;
+      StoreCompiledFde(pc, compiled);
+      *is_signal_frame = compiled->cie->is_signal_frame;
+      return EvalCompiledRow(compiled->cie, process_memory, *compiled, *row, regs, finished,
+                             &last_error_);
+    }
+    // Fall through and use the interpreter for this pc.
+  }
+
   // Lookup the pc in the cache.
-  auto it = loc_regs_.upper_bound(pc);
-  if (it == loc_regs_.end() || pc < it->second.pc_start) {
+  std::shared_ptr<const DwarfLocations> loc_regs = row_cache_.Find(pc);
+  if (loc_regs == nullptr) {
     last_error_.code = DWARF_ERROR_NONE;
     const DwarfFde* fde = GetFdeFromPc(pc);
     if (fde == nullptr || fde->cie == nullptr) {
@@ -49,38 +95,356 @@ bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
       return false;
     }
 
-    // Now get the location information for this pc.
-    DwarfLocations loc_regs;
-    if (!GetCfaLocationInfo(pc, fde, &loc_regs, regs->Arch())) {
-      return false;
+    // Now get the location information for this pc, from the rows of the
+    // fde if it can be compiled.
+    DwarfLocations new_loc_regs;
+    if (!GetRowLocations(pc, regs->Arch(), &new_loc_regs)) {
+      last_error_.code = DWARF_ERROR_NONE;
+      if (!GetCfaLocationInfo(pc, fde, &new_loc_regs, regs->Arch())) {
+        return false;
+      }
     }
-    loc_regs.cie = fde->cie;
+    new_loc_regs.cie = fde->cie;
 
     // Store it in the cache.
-    it = loc_regs_.emplace(loc_regs.pc_end, std::move(loc_regs)).first;
+    loc_regs = row_cache_.Add(pc, std::move(new_loc_regs));
   }
 
-  *is_signal_frame = it->second.cie->is_signal_frame;
+  *is_signal_frame = loc_regs->cie->is_signal_frame;
 
   // Now eval the actual registers.
-  return Eval(it->second.cie, process_memory, it->second, regs, finished);
+  return Eval(loc_regs->cie, process_memory, *loc_regs, regs, finished);
+}
+
+bool DwarfSection::GetRowLocations(uint64_t pc, ArchEnum arch, DwarfLocations* loc_regs) {
+  const DwarfCompiledFde* compiled;
+  const DwarfCompiledRow* row = GetCompiledRow(pc, arch, &compiled);
+  if (row == nullptr) {
+    return false;
+  }
+  loc_regs->clear();
+  if (row->cfa.type != DWARF_LOCATION_INVALID) {
+    (*loc_regs)[CFA_REG] = row->cfa;
+  }
+  auto begin = compiled->locations.begin() + row->locations_index;
+  for (auto entry = begin; entry != begin + row->locations_count; ++entry) {
+    (*loc_regs)[entry->first] = entry->second;
+  }
+  if (row->ra_signed) {
+    (*loc_regs)[Arm64Reg::ARM64_PREG_RA_SIGN_STATE] = {.type = DWARF_LOCATION_PSEUDO_REGISTER,
+                                                       .values = {1}};
+  }
+  loc_regs->pc_start = row->pc_start;
+  loc_regs->pc_end = row->pc_end;
+  loc_regs->cie = compiled->cie;
+  return true;
+}
+
+static const DwarfCompiledRow* FindCompiledRow(uint64_t pc, const DwarfCompiledFde& compiled) {
+  const std::vector<DwarfCompiledRow>& rows = compiled.rows;
+  auto comp = [](uint64_t pc, const DwarfCompiledRow& row) { return pc < row.pc_end; };
+  auto row = std::upper_bound(rows.begin(), rows.end(), pc, comp);
+  if (row == rows.end() || pc < row->pc_start) {
+    return nullptr;
+  }
+  return &*row;
+}
+
+bool DwarfSection::StepFromCache(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
+                                 bool* is_signal_frame) {
+  if (compiled_unwind_tables_) {
+    CompiledFdeSlots* slots = compiled_fde_slots_.load(std::memory_order_acquire);
+    if (slots == nullptr) {
+      return false;
+    }
+    const DwarfCompiledFde* compiled =
+        slots->fdes[CompiledFdeSlot(pc)].load(std::memory_order_acquire);
+    if (compiled == nullptr || pc < compiled->pc_start || pc >= compiled->pc_end) {
+      return false;
+    }
+    const DwarfCompiledRow* row = FindCompiledRow(pc, *compiled);
+    if (row == nullptr || row->use_interpreter) {
+      return false;
+    }
+    // The same as EvalCachedRow, the regs are put back if the row fails.
+    Regs::Snapshot snapshot;
+    regs->SaveSnapshot(&snapshot);
+    DwarfErrorData error;
+    if (!EvalCompiledRow(compiled->cie, process_memory, *compiled, *row, regs, finished, &error)) {
+      regs->RestoreSnapshot(snapshot);
+      return false;
+    }
+    *is_signal_frame = compiled->cie->is_signal_frame;
+    return true;
+  }
+
+  // The pinned rows are checked first, they are few and need no atomic
+  // reference count.
+  const DwarfLocations* row = nullptr;
+  size_t num_pinned = num_pinned_rows_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < num_pinned; i++) {
+    const DwarfLocations* pinned = pinned_rows_[i].get();
+    if (pc >= pinned->pc_start && pc < pinned->pc_end) {
+      row = pinned;
+      break;
+    }
+  }
+  std::shared_ptr<const DwarfLocations> loc_regs;
+  if (row == nullptr) {
+    loc_regs = row_cache_.Find(pc);
+    if (loc_regs == nullptr || HasExpression(*loc_regs)) {
+      return false;
+    }
+    row = loc_regs.get();
+  }
+
+  if (!EvalCachedRow(row->cie, process_memory, *row, regs, finished)) {
+    return false;
+  }
+  *is_signal_frame = row->cie->is_signal_frame;
+  return true;
+}
+
+// Expressions are evaluated using the section memory, which is not safe to
+// share between threads.
+bool DwarfSection::HasExpression(const DwarfLocations& loc_regs) {
+  for (const auto& entry : loc_regs) {
+    if (entry.second.type == DWARF_LOCATION_EXPRESSION ||
+        entry.second.type == DWARF_LOCATION_VAL_EXPRESSION) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DwarfSection::PinRow(uint64_t pc) {
+  size_t num_pinned = num_pinned_rows_.load(std::memory_order_relaxed);
+  if (compiled_unwind_tables_ || num_pinned == kMaxPinnedRows) {
+    return false;
+  }
+  std::shared_ptr<const DwarfLocations> loc_regs = row_cache_.Find(pc);
+  if (loc_regs == nullptr || HasExpression(*loc_regs)) {
+    return false;
+  }
+  for (size_t i = 0; i < num_pinned; i++) {
+    if (pinned_rows_[i] == loc_regs) {
+      return true;
+    }
+  }
+  pinned_rows_[num_pinned] = std::move(loc_regs);
+  num_pinned_rows_.store(num_pinned + 1, std::memory_order_release);
+  return true;
+}
+
+void DwarfSection::GetMemoryUsage(ElfMemoryUsage* usage) {
+  usage->unwind_index += sizeof(*this) + HashMapMemoryUsage(fde_entries_) +
+                         cies_.size() * sizeof(CieEntry) + HashMapMemoryUsage(cie_ids_);
+  for (const auto& entry : cies_) {
+    usage->unwind_index += entry.cie.augmentation_string.capacity();
+  }
+  usage->unwind_rows +=
+      row_cache_.MemoryUsage() + MapMemoryUsage(compiled_fdes_) +
+      num_pinned_rows_.load(std::memory_order_relaxed) * sizeof(DwarfLocations) +
+      (compiled_fde_slots_storage_ != nullptr ? sizeof(CompiledFdeSlots) : 0);
+  for (const auto& entry : compiled_fdes_) {
+    usage->unwind_rows +=
+        VectorMemoryUsage(entry.second.rows) + VectorMemoryUsage(entry.second.locations);
+  }
+}
+
+bool DwarfSection::StepCompiled(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
+                                bool* is_signal_frame) {
+  if (!compiled_unwind_tables_) {
+    return false;
+  }
+  auto it = compiled_fdes_.upper_bound(pc);
+  if (it == compiled_fdes_.end() || pc < it->second.pc_start) {
+    return false;
+  }
+  const DwarfCompiledFde& compiled = it->second;
+  const DwarfCompiledRow* row = FindCompiledRow(pc, compiled);
+  if (row == nullptr || row->use_interpreter) {
+    return false;
+  }
+  last_error_.code = DWARF_ERROR_NONE;
+  *is_signal_frame = compiled.cie->is_signal_frame;
+  return EvalCompiledRow(compiled.cie, process_memory, compiled, *row, regs, finished,
+                         &last_error_);
+}
+
+void DwarfSection::CompileAllFdes(ArchEnum arch) {
+  compiled_unwind_tables_ = true;
+  std::vector<const DwarfFde*> fdes;
+  GetFdes(&fdes);
+  for (const DwarfFde* fde : fdes) {
+    const DwarfCompiledFde* compiled;
+    GetCompiledRow(fde->pc_start, arch, &compiled);
+  }
+}
+
+static bool GetFramePointerReg(ArchEnum arch, uint32_t* fp_reg) {
+  switch (ArchDispatch(arch)) {
+    case ARCH_ARM64:
+      *fp_reg = ARM64_REG_R29;
+      return true;
+    case ARCH_X86_64:
+      *fp_reg = X86_64_REG_RBP;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static FramePointerRule GetRowFramePointerRule(const DwarfCompiledFde& compiled,
+                                               const DwarfCompiledRow& row, uint32_t fp_reg) {
+  if (row.use_interpreter || row.cfa.type != DWARF_LOCATION_REGISTER ||
+      row.cfa.values[0] != fp_reg || row.cfa.values[1] != 16) {
+    return FRAME_POINTER_NOT_USED;
+  }
+
+  // The frame record is the caller's frame pointer followed by the return
+  // address, right below the cfa.
+  bool fp_saved = false;
+  bool ra_saved = false;
+  auto begin = compiled.locations.begin() + row.locations_index;
+  for (auto entry = begin; entry != begin + row.locations_count; ++entry) {
+    if (entry->second.type != DWARF_LOCATION_OFFSET) {
+      continue;
+    }
+    int64_t offset = static_cast<int64_t>(entry->second.values[0]);
+    if (entry->first == fp_reg) {
+      fp_saved = offset == -16;
+    } else if (entry->first == compiled.cie->return_address_register) {
+      ra_saved = offset == -8;
+    }
+  }
+  return fp_saved && ra_saved ? FRAME_POINTER_USED : FRAME_POINTER_NOT_USED;
+}
+
+FramePointerRule DwarfSection::GetFramePointerRule(uint64_t pc, ArchEnum arch,
+                                                   std::unique_lock<std::mutex>* lock) {
+  uint32_t fp_reg;
+  if (!GetFramePointerReg(arch, &fp_reg)) {
+    return FRAME_POINTER_NOT_USED;
+  }
+
+  const DwarfCompiledFde* compiled;
+  const DwarfCompiledRow* row = GetCompiledRow(pc, arch, &compiled, lock);
+  if (row == nullptr) {
+    auto it = compiled_fdes_.upper_bound(pc);
+    if (it == compiled_fdes_.end() || pc < it->second.pc_start) {
+      return FRAME_POINTER_UNKNOWN;
+    }
+    return FRAME_POINTER_NOT_USED;
+  }
+  StoreCompiledFde(pc, compiled);
+  return GetRowFramePointerRule(*compiled, *row, fp_reg);
+}
+
+bool DwarfSection::GetCachedFramePointerRule(uint64_t pc, ArchEnum arch, FramePointerRule* rule) {
+  uint32_t fp_reg;
+  if (!GetFramePointerReg(arch, &fp_reg)) {
+    *rule = FRAME_POINTER_NOT_USED;
+    return true;
+  }
+  CompiledFdeSlots* slots = compiled_fde_slots_.load(std::memory_order_acquire);
+  if (slots == nullptr) {
+    return false;
+  }
+  const DwarfCompiledFde* compiled =
+      slots->fdes[CompiledFdeSlot(pc)].load(std::memory_order_acquire);
+  if (compiled == nullptr || pc < compiled->pc_start || pc >= compiled->pc_end) {
+    return false;
+  }
+  const DwarfCompiledRow* row = FindCompiledRow(pc, *compiled);
+  if (row == nullptr) {
+    return false;
+  }
+  *rule = GetRowFramePointerRule(*compiled, *row, fp_reg);
+  return true;
+}
+
+void DwarfSection::StoreCompiledFde(uint64_t pc, const DwarfCompiledFde* compiled) {
+  CompiledFdeSlots* slots = compiled_fde_slots_.load(std::memory_order_relaxed);
+  if (slots == nullptr) {
+    compiled_fde_slots_storage_.reset(new CompiledFdeSlots);
+    slots = compiled_fde_slots_storage_.get();
+    compiled_fde_slots_.store(slots, std::memory_order_release);
+  }
+  slots->fdes[CompiledFdeSlot(pc)].store(compiled, std::memory_order_release);
+}
+
+const DwarfCompiledRow* DwarfSection::GetCompiledRow(uint64_t pc, ArchEnum arch,
+                                                     const DwarfCompiledFde** compiled,
+                                                     std::unique_lock<std::mutex>* lock) {
+  auto it = compiled_fdes_.upper_bound(pc);
+  if (it == compiled_fdes_.end() || pc < it->second.pc_start) {
+    const DwarfFde* fde = GetFdeFromPc(pc);
+    if (fde == nullptr || fde->cie == nullptr) {
+      return nullptr;
+    }
+
+    // A failure to compile is stored as an fde without any rows so that
+    // the work is not repeated, all pcs in it will use the interpreter.
+    DwarfCompiledFde compiled_fde;
+    if (!CompileFde(fde, arch, &compiled_fde, lock)) {
+      compiled_fde.rows.clear();
+      compiled_fde.locations.clear();
+    }
+    compiled_fde.pc_start = fde->pc_start;
+    compiled_fde.pc_end = fde->pc_end;
+    compiled_fde.cie = fde->cie;
+    it = compiled_fdes_.emplace(fde->pc_end, std::move(compiled_fde)).first;
+    if (pc < it->second.pc_start) {
+      // Overlapping fdes with the same end pc.
+      return nullptr;
+    }
+  }
+
+  const DwarfCompiledRow* row = FindCompiledRow(pc, it->second);
+  if (row == nullptr) {
+    return nullptr;
+  }
+  *compiled = &it->second;
+  return row;
 }
 
 template <typename AddressType>
 const DwarfCie* DwarfSectionImpl<AddressType>::GetCieFromOffset(uint64_t offset) {
-  auto cie_entry = cie_entries_.find(offset);
-  if (cie_entry != cie_entries_.end()) {
-    return &cie_entry->second;
+  auto cie_id = cie_ids_.find(offset);
+  if (cie_id != cie_ids_.end()) {
+    return &cies_[cie_id->second].cie;
   }
-  DwarfCie* cie = &cie_entries_[offset];
+  DwarfCie cie;
   memory_.set_data_offset(entries_offset_);
   memory_.set_cur_offset(offset);
-  if (!FillInCieHeader(cie) || !FillInCie(cie)) {
-    // Erase the cached entry.
-    cie_entries_.erase(offset);
+  if (!FillInCieHeader(&cie) || !FillInCie(&cie)) {
     return nullptr;
   }
-  return cie;
+  return AddCie(offset, std::move(cie));
+}
+
+template <typename AddressType>
+const DwarfCie* DwarfSectionImpl<AddressType>::AddCie(uint64_t offset, DwarfCie&& cie) {
+  cie.id = cies_.size();
+  cie_ids_.emplace(offset, cie.id);
+  return &cies_.emplace_back(CieEntry{std::move(cie), DwarfLocations(), false}).cie;
+}
+
+template <typename AddressType>
+const DwarfLocations* DwarfSectionImpl<AddressType>::GetCieLocRegs(const DwarfFde* fde,
+                                                                   ArchEnum arch) {
+  CieEntry& entry = cies_[fde->cie->id];
+  if (!entry.has_initial_loc_regs) {
+    DwarfCfa<AddressType> cfa(&memory_, fde, arch);
+    if (!cfa.GetLocationInfo(fde->pc_start, entry.cie.cfa_instructions_offset,
+                             entry.cie.cfa_instructions_end, &entry.initial_loc_regs)) {
+      last_error_ = cfa.last_error();
+      return nullptr;
+    }
+    entry.has_initial_loc_regs = true;
+  }
+  return &entry.initial_loc_regs;
 }
 
 template <typename AddressType>
@@ -390,7 +754,38 @@ bool DwarfSectionImpl<AddressType>::EvalExpression(const DwarfLocation& loc, Mem
   // Need to evaluate the op data.
   uint64_t end = loc.values[1];
   uint64_t start = end - loc.values[0];
-  if (!op.Eval(start, end)) {
+  auto [entry, inserted] = expressions_.try_emplace(start);
+  DwarfCompiledExpression& compiled = entry->second;
+  if (inserted || compiled.end != end) {
+    op.Compile(start, end, &compiled);
+  }
+
+  bool result;
+  switch (compiled.kind) {
+    case DwarfCompiledExpression::KIND_BREG:
+    case DwarfCompiledExpression::KIND_BREG_DEREF: {
+      // The same errors that DwarfOp sets for these ops.
+      if (compiled.reg >= regs_info->Total()) {
+        last_error_ = {DWARF_ERROR_ILLEGAL_VALUE, 0};
+        return false;
+      }
+      AddressType addr = regs_info->Get(compiled.reg) + static_cast<AddressType>(compiled.offset);
+      if (compiled.kind == DwarfCompiledExpression::KIND_BREG) {
+        *value = addr;
+      } else if (!regular_memory->ReadFully(addr, value, sizeof(AddressType))) {
+        last_error_ = {DWARF_ERROR_MEMORY_INVALID, addr};
+        return false;
+      }
+      return true;
+    }
+    case DwarfCompiledExpression::KIND_OPS:
+      result = op.EvalCompiled(compiled);
+      break;
+    default:
+      result = op.Eval(start, end);
+      break;
+  }
+  if (!result) {
     last_error_ = op.last_error();
     return false;
   }
@@ -412,12 +807,13 @@ bool DwarfSectionImpl<AddressType>::EvalExpression(const DwarfLocation& loc, Mem
 
 template <typename AddressType>
 struct EvalInfo {
-  const DwarfLocations* loc_regs;
   const DwarfCie* cie;
   Memory* regular_memory;
   AddressType cfa;
   bool return_address_undefined = false;
   RegsInfo<AddressType> regs_info;
+  // Where errors found while evaluating the registers are stored.
+  DwarfErrorData* error;
 };
 
 template <typename AddressType>
@@ -428,8 +824,8 @@ bool DwarfSectionImpl<AddressType>::EvalRegister(const DwarfLocation* loc, uint3
   switch (loc->type) {
     case DWARF_LOCATION_OFFSET:
       if (!regular_memory->ReadFully(eval_info->cfa + loc->values[0], reg_ptr, sizeof(AddressType))) {
-        last_error_.code = DWARF_ERROR_MEMORY_INVALID;
-        last_error_.address = eval_info->cfa + loc->values[0];
+        eval_info->error->code = DWARF_ERROR_MEMORY_INVALID;
+        eval_info->error->address = eval_info->cfa + loc->values[0];
         return false;
       }
       break;
@@ -439,7 +835,7 @@ bool DwarfSectionImpl<AddressType>::EvalRegister(const DwarfLocation* loc, uint3
     case DWARF_LOCATION_REGISTER: {
       uint32_t cur_reg = loc->values[0];
       if (cur_reg >= eval_info->regs_info.Total()) {
-        last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+        eval_info->error->code = DWARF_ERROR_ILLEGAL_VALUE;
         return false;
       }
       *reg_ptr = eval_info->regs_info.Get(cur_reg) + loc->values[1];
@@ -454,8 +850,8 @@ bool DwarfSectionImpl<AddressType>::EvalRegister(const DwarfLocation* loc, uint3
       }
       if (loc->type == DWARF_LOCATION_EXPRESSION) {
         if (!regular_memory->ReadFully(value, reg_ptr, sizeof(AddressType))) {
-          last_error_.code = DWARF_ERROR_MEMORY_INVALID;
-          last_error_.address = value;
+          eval_info->error->code = DWARF_ERROR_MEMORY_INVALID;
+          eval_info->error->address = value;
           return false;
         }
       } else {
@@ -472,7 +868,7 @@ bool DwarfSectionImpl<AddressType>::EvalRegister(const DwarfLocation* loc, uint3
       }
       break;
     case DWARF_LOCATION_PSEUDO_REGISTER:
-      last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+      eval_info->error->code = DWARF_ERROR_ILLEGAL_VALUE;
       return false;
     default:
       break;
@@ -485,16 +881,82 @@ template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_memory,
                                          const DwarfLocations& loc_regs, Regs* regs,
                                          bool* finished) {
-  RegsImpl<AddressType>* cur_regs = reinterpret_cast<RegsImpl<AddressType>*>(regs);
+  static const DwarfLocation kCfaNotDefined{.type = DWARF_LOCATION_INVALID};
+  auto cfa_entry = loc_regs.find(CFA_REG);
+  const DwarfLocation& cfa_loc = cfa_entry != loc_regs.end() ? cfa_entry->second : kCfaNotDefined;
+  return EvalLocations(cie, regular_memory, cfa_loc, loc_regs.begin(), loc_regs.end(), regs,
+                       finished, &last_error_);
+}
+
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::EvalCompiledRow(const DwarfCie* cie, Memory* regular_memory,
+                                                    const DwarfCompiledFde& compiled,
+                                                    const DwarfCompiledRow& row, Regs* regs,
+                                                    bool* finished, DwarfErrorData* error) {
+  auto begin = compiled.locations.begin() + row.locations_index;
+  return EvalLocations(cie, regular_memory, row.cfa, begin, begin + row.locations_count, regs,
+                       finished, error, row.ra_signed);
+}
+
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::EvalCachedRow(const DwarfCie* cie, Memory* regular_memory,
+                                                  const DwarfLocations& loc_regs, Regs* regs,
+                                                  bool* finished) {
+  auto cfa_entry = loc_regs.find(CFA_REG);
+  if (cfa_entry == loc_regs.end()) {
+    return false;
+  }
+
+  // Keep a copy of the registers so that they can be put back if the
+  // evaluation fails part way through.
+  Regs::Snapshot snapshot;
+  regs->SaveSnapshot(&snapshot);
+  DwarfErrorData error;
+  if (!EvalLocations(cie, regular_memory, cfa_entry->second, loc_regs.begin(), loc_regs.end(),
+                     regs, finished, &error)) {
+    regs->RestoreSnapshot(snapshot);
+    return false;
+  }
+  return true;
+}
+
+template <typename AddressType>
+template <typename LocationIterator>
+bool DwarfSectionImpl<AddressType>::EvalLocations(const DwarfCie* cie, Memory* regular_memory,
+                                                  const DwarfLocation& cfa_loc,
+                                                  LocationIterator begin, LocationIterator end,
+                                                  Regs* regs, bool* finished,
+                                                  DwarfErrorData* error, bool ra_signed) {
+#if defined(__arm__) || defined(__aarch64__) || defined(__i386__) || defined(__x86_64__)
+  if constexpr (std::is_base_of_v<RegsImpl<AddressType>, CurrentRegs>) {
+    if (regs->IsCurrentArchRegs()) {
+      return EvalLocationsForRegs(cie, regular_memory, cfa_loc, begin, end,
+                                  static_cast<CurrentRegs*>(regs), finished, error, ra_signed);
+    }
+  }
+#endif
+  return EvalLocationsForRegs(cie, regular_memory, cfa_loc, begin, end,
+                              static_cast<RegsImpl<AddressType>*>(regs), finished, error,
+                              ra_signed);
+}
+
+template <typename AddressType>
+template <typename LocationIterator, typename RegsType>
+bool DwarfSectionImpl<AddressType>::EvalLocationsForRegs(const DwarfCie* cie,
+                                                         Memory* regular_memory,
+                                                         const DwarfLocation& cfa_loc,
+                                                         LocationIterator begin,
+                                                         LocationIterator end, RegsType* cur_regs,
+                                                         bool* finished, DwarfErrorData* error,
+                                                         bool ra_signed) {
   if (cie->return_address_register >= cur_regs->total_regs()) {
-    last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+    error->code = DWARF_ERROR_ILLEGAL_VALUE;
     return false;
   }
 
   // Get the cfa value;
-  auto cfa_entry = loc_regs.find(CFA_REG);
-  if (cfa_entry == loc_regs.end()) {
-    last_error_.code = DWARF_ERROR_CFA_NOT_DEFINED;
+  if (cfa_loc.type == DWARF_LOCATION_INVALID) {
+    error->code = DWARF_ERROR_CFA_NOT_DEFINED;
     return false;
   }
 
@@ -503,18 +965,21 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
 
   // Reset necessary pseudo registers before evaluation.
   // This is needed for ARM64, for example.
-  regs->ResetPseudoRegisters();
+  cur_regs->ResetPseudoRegisters();
+  if (ra_signed) {
+    cur_regs->SetPseudoRegister(Arm64Reg::ARM64_PREG_RA_SIGN_STATE, 1);
+  }
 
-  EvalInfo<AddressType> eval_info{.loc_regs = &loc_regs,
-                                  .cie = cie,
+  EvalInfo<AddressType> eval_info{.cie = cie,
                                   .regular_memory = regular_memory,
-                                  .regs_info = RegsInfo<AddressType>(cur_regs)};
-  const DwarfLocation* loc = &cfa_entry->second;
+                                  .regs_info = RegsInfo<AddressType>(cur_regs),
+                                  .error = error};
+  const DwarfLocation* loc = &cfa_loc;
   // Only a few location types are valid for the cfa.
   switch (loc->type) {
     case DWARF_LOCATION_REGISTER:
       if (loc->values[0] >= cur_regs->total_regs()) {
-        last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+        error->code = DWARF_ERROR_ILLEGAL_VALUE;
         return false;
       }
       eval_info.cfa = (*cur_regs)[loc->values[0]];
@@ -530,28 +995,28 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
       break;
     }
     default:
-      last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+      error->code = DWARF_ERROR_ILLEGAL_VALUE;
       return false;
   }
 
-  for (const auto& entry : loc_regs) {
-    uint32_t reg = entry.first;
+  for (auto entry = begin; entry != end; ++entry) {
+    uint32_t reg = entry->first;
     // Already handled the CFA register.
     if (reg == CFA_REG) continue;
 
     AddressType* reg_ptr;
     if (reg >= cur_regs->total_regs()) {
-      if (entry.second.type != DWARF_LOCATION_PSEUDO_REGISTER) {
+      if (entry->second.type != DWARF_LOCATION_PSEUDO_REGISTER) {
         // Skip this unknown register.
         continue;
       }
-      if (!eval_info.regs_info.regs->SetPseudoRegister(reg, entry.second.values[0])) {
-        last_error_.code = DWARF_ERROR_ILLEGAL_VALUE;
+      if (!cur_regs->SetPseudoRegister(reg, entry->second.values[0])) {
+        error->code = DWARF_ERROR_ILLEGAL_VALUE;
         return false;
       }
     } else {
       reg_ptr = eval_info.regs_info.Save(reg);
-      if (!EvalRegister(&entry.second, reg, reg_ptr, &eval_info)) {
+      if (!EvalRegister(&entry->second, reg, reg_ptr, &eval_info)) {
         return false;
       }
     }
@@ -577,19 +1042,12 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
 template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::GetCfaLocationInfo(uint64_t pc, const DwarfFde* fde,
                                                        DwarfLocations* loc_regs, ArchEnum arch) {
-  DwarfCfa<AddressType> cfa(&memory_, fde, arch);
-
-  // Look for the cached copy of the cie data.
-  auto reg_entry = cie_loc_regs_.find(fde->cie_offset);
-  if (reg_entry == cie_loc_regs_.end()) {
-    if (!cfa.GetLocationInfo(pc, fde->cie->cfa_instructions_offset, fde->cie->cfa_instructions_end,
-                             loc_regs)) {
-      last_error_ = cfa.last_error();
-      return false;
-    }
-    cie_loc_regs_[fde->cie_offset] = *loc_regs;
+  const DwarfLocations* cie_loc_regs = GetCieLocRegs(fde, arch);
+  if (cie_loc_regs == nullptr) {
+    return false;
   }
-  cfa.set_cie_loc_regs(&cie_loc_regs_[fde->cie_offset]);
+  DwarfCfa<AddressType> cfa(&memory_, fde, arch);
+  cfa.set_cie_loc_regs(cie_loc_regs);
   if (!cfa.GetLocationInfo(pc, fde->cfa_instructions_offset, fde->cfa_instructions_end, loc_regs)) {
     last_error_ = cfa.last_error();
     return false;
@@ -597,6 +1055,209 @@ bool DwarfSectionImpl<AddressType>::GetCfaLocationInfo(uint64_t pc, const DwarfF
   return true;
 }
 
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::CompileFde(const DwarfFde* fde, ArchEnum arch,
+                                               DwarfCompiledFde* compiled,
+                                               std::unique_lock<std::mutex>* lock) {
+  const DwarfLocations* cie_loc_regs = GetCieLocRegs(fde, arch);
+  if (cie_loc_regs == nullptr) {
+    return false;
+  }
+  if (lock == nullptr) {
+    return CompileFdeRows(fde, arch, cie_loc_regs, &memory_, compiled, &last_error_);
+  }
+
+  // The fde and the cie rules are never modified once read, and the
+  // instructions are read with a memory object of this call, so nothing
+  // in the section is used without the lock.
+  DwarfMemory memory(memory_.memory());
+  memory.set_buffered(true);
+  DwarfErrorData error{DWARF_ERROR_NONE, 0};
+  lock->unlock();
+  bool compiled_rows = CompileFdeRows(fde, arch, cie_loc_regs, &memory, compiled, &error);
+  lock->lock();
+  if (!compiled_rows) {
+    last_error_ = error;
+  }
+  return compiled_rows;
+}
+
+template <typename AddressType>
+bool DwarfSectionImpl<AddressType>::CompileFdeRows(const DwarfFde* fde, ArchEnum arch,
+                                                   const DwarfLocations* cie_loc_regs,
+                                                   DwarfMemory* memory,
+                                                   DwarfCompiledFde* compiled,
+                                                   DwarfErrorData* error) {
+  DwarfCfa<AddressType> cfa(memory, fde, arch);
+  cfa.set_cie_loc_regs(cie_loc_regs);
+
+  DwarfLocations loc_regs;
+  std::vector<DwarfLocations> rows;
+  if (!cfa.GetLocationRows(fde->cfa_instructions_offset, fde->cfa_instructions_end, &loc_regs,
+                           &rows)) {
+    *error = cfa.last_error();
+    return false;
+  }
+
+  compiled->rows.reserve(rows.size());
+  for (const DwarfLocations& row_regs : rows) {
+    DwarfCompiledRow& row = compiled->rows.emplace_back();
+    row.pc_start = row_regs.pc_start;
+    row.pc_end = row_regs.pc_end;
+    row.cfa.type = DWARF_LOCATION_INVALID;
+    row.locations_index = compiled->locations.size();
+    row.locations_count = 0;
+    row.use_interpreter = false;
+    row.ra_signed = false;
+    // The rows that need an expression are kept as well, GetRowLocations
+    // uses them to avoid interpreting the cfa instructions again.
+    for (const auto& entry : row_regs) {
+      if (entry.second.type == DWARF_LOCATION_EXPRESSION ||
+          entry.second.type == DWARF_LOCATION_VAL_EXPRESSION) {
+        row.use_interpreter = true;
+      }
+      if (entry.first == CFA_REG) {
+        row.cfa = entry.second;
+      } else if (arch == ARCH_ARM64 && entry.first == Arm64Reg::ARM64_PREG_RA_SIGN_STATE &&
+                 entry.second.type == DWARF_LOCATION_PSEUDO_REGISTER) {
+        row.ra_signed = (entry.second.values[0] & 1) != 0;
+      } else {
+        compiled->locations.emplace_back(entry.first, entry.second);
+        row.locations_count++;
+      }
+    }
+  }
+  compiled->locations.shrink_to_fit();
+  return true;
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::GetMemoryUsage(ElfMemoryUsage* usage) {
+  DwarfSection::GetMemoryUsage(usage);
+  usage->unwind_index += fde_index_.MemoryUsage() + compact_fde_index_.MemoryUsage();
+  usage->unwind_rows += HashMapMemoryUsage(expressions_);
+  for (const auto& entry : expressions_) {
+    usage->unwind_rows += VectorMemoryUsage(entry.second.ops);
+  }
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::BuildIndex() {
+  if (FdeIndexEmpty()) {
+    BuildFdeIndex();
+  }
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope) {
+  if (FdeIndexEmpty()) {
+    BuildFdeIndex();
+  }
+  if (compact_fde_index_.empty()) {
+    writer->Add(ELF_INDEX_FDE, scope, entries_offset_, fde_index_.data(),
+                fde_index_.size() * sizeof(DwarfFdeIndexEntry));
+    return;
+  }
+
+  // The index file always uses the full entries.
+  std::vector<DwarfFdeIndexEntry> index;
+  index.reserve(compact_fde_index_.size());
+  for (const auto& entry : compact_fde_index_) {
+    index.push_back(DwarfFdeIndexEntry{.pc_end = compact_fde_index_pc_base_ + entry.pc_end,
+                                       .fde_offset = entries_offset_ + entry.fde_offset});
+  }
+  writer->Add(ELF_INDEX_FDE, scope, entries_offset_, index.data(),
+              index.size() * sizeof(DwarfFdeIndexEntry));
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::LoadIndex(const std::shared_ptr<ElfIndexFile>& file,
+                                              ElfIndexScope scope) {
+  const void* data;
+  size_t size;
+  if (!file->Find(ELF_INDEX_FDE, scope, entries_offset_, &data, &size) ||
+      size % sizeof(DwarfFdeIndexEntry) != 0) {
+    return;
+  }
+  const DwarfFdeIndexEntry* entries = reinterpret_cast<const DwarfFdeIndexEntry*>(data);
+  size_t num_entries = size / sizeof(DwarfFdeIndexEntry);
+  // The lookups depend on the table being sorted. The fde offsets are
+  // checked when each fde is read.
+  for (size_t i = 1; i < num_entries; i++) {
+    if (entries[i].pc_end < entries[i - 1].pc_end) {
+      return;
+    }
+  }
+  fde_index_ = ElfIndexArray<DwarfFdeIndexEntry>(file, entries, num_entries);
+  compact_fde_index_ = ElfIndexArray<DwarfFdeCompactIndexEntry>();
+}
+
+struct DwarfFdeIndexTables {
+  std::vector<DwarfFdeIndexEntry> index;
+  std::vector<DwarfFdeCompactIndexEntry> compact_index;
+  uint64_t compact_index_pc_base = 0;
+};
+
+namespace {
+
+// Only weak references are kept, the tables are freed with the last
+// section using them.
+struct SharedFdeIndexTables {
+  std::mutex lock;
+  std::unordered_map<std::string, std::weak_ptr<const DwarfFdeIndexTables>> tables;
+};
+
+SharedFdeIndexTables* GetSharedFdeIndexTables() {
+  static SharedFdeIndexTables* shared = new SharedFdeIndexTables;
+  return shared;
+}
+
+std::shared_ptr<const DwarfFdeIndexTables> FindSharedFdeIndex(const std::string& key) {
+  SharedFdeIndexTables* shared = GetSharedFdeIndexTables();
+  std::lock_guard<std::mutex> guard(shared->lock);
+  auto entry = shared->tables.find(key);
+  return entry != shared->tables.end() ? entry->second.lock() : nullptr;
+}
+
+// Returns the tables already added for key by another section, if there
+// are any, otherwise adds tables.
+std::shared_ptr<const DwarfFdeIndexTables> AddSharedFdeIndex(
+    const std::string& key, std::shared_ptr<const DwarfFdeIndexTables> tables) {
+  SharedFdeIndexTables* shared = GetSharedFdeIndexTables();
+  std::lock_guard<std::mutex> guard(shared->lock);
+  for (auto entry = shared->tables.begin(); entry != shared->tables.end();) {
+    if (entry->second.expired()) {
+      entry = shared->tables.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+  auto entry = shared->tables.emplace(key, tables).first;
+  std::shared_ptr<const DwarfFdeIndexTables> existing = entry->second.lock();
+  return existing != nullptr ? existing : tables;
+}
+
+}  // namespace
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::ShareIndex(const std::string& build_id, ElfIndexScope scope) {
+  if (build_id.empty()) {
+    return;
+  }
+  shared_index_key_ = build_id;
+  shared_index_key_ += ':' + std::to_string(scope) + ':' + std::to_string(entries_offset_);
+}
+
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::UseFdeIndexTables(
+    const std::shared_ptr<const DwarfFdeIndexTables>& tables) {
+  fde_index_ =
+      ElfIndexArray<DwarfFdeIndexEntry>(tables, tables->index.data(), tables->index.size());
+  compact_fde_index_ = ElfIndexArray<DwarfFdeCompactIndexEntry>(
+      tables, tables->compact_index.data(), tables->compact_index.size());
+  compact_fde_index_pc_base_ = tables->compact_index_pc_base;
+}
+
 template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::Log(uint8_t indent, uint64_t pc, const DwarfFde* fde,
                                         ArchEnum arch) {
@@ -629,32 +1290,6 @@ bool DwarfSectionImpl<AddressType>::Init(uint64_t offset, uint64_t size, int64_t
   return true;
 }
 
-// Create a cached version of the fde information such that it is a std::map
-// that is indexed by end pc and contains a pair that represents the start pc
-// followed by the fde offset.
-// It is possible for an fde to be represented by multiple entries in
-// the map. This can happen if the the start pc and end pc overlap already
-// existing entries. For example, if there is already an entry of 0x400, 0x200,
-// and an fde has a start pc of 0x100 and end pc of 0x500, two new entries
-// will be added: 0x200, 0x100 and 0x500, 0x400.
-template <typename AddressType>
-void DwarfSectionImpl<AddressType>::InsertFde(uint64_t fde_offset, const DwarfFde* fde,
-                                              DwarfFdeMap& fdes) {
-  uint64_t start = fde->pc_start;
-  uint64_t end = fde->pc_end;
-  auto it = fdes.upper_bound(start);
-  while (it != fdes.end() && start < end && it->second.first < end) {
-    if (start < it->second.first) {
-      fdes[it->second.first] = std::make_pair(start, fde_offset);
-    }
-    start = it->first;
-    ++it;
-  }
-  if (start < end) {
-    fdes[end] = std::make_pair(start, fde_offset);
-  }
-}
-
 // Read CIE or FDE entry at the given offset, and set the offset to the following entry.
 // The 'fde' argument is set only if we have seen an FDE entry.
 template <typename AddressType>
@@ -716,17 +1351,16 @@ bool DwarfSectionImpl<AddressType>::GetNextCieOrFde(uint64_t& next_entries_offse
   }
 
   if (entry_is_cie) {
-    auto entry = cie_entries_.find(start_offset);
-    if (entry == cie_entries_.end()) {
-      DwarfCie* cie = &cie_entries_[start_offset];
-      cie->lsda_encoding = DW_EH_PE_omit;
-      cie->cfa_instructions_end = next_entries_offset;
-      cie->fde_address_encoding = cie_fde_encoding;
-
-      if (!FillInCie(cie)) {
-        cie_entries_.erase(start_offset);
+    if (cie_ids_.find(start_offset) == cie_ids_.end()) {
+      DwarfCie cie;
+      cie.lsda_encoding = DW_EH_PE_omit;
+      cie.cfa_instructions_end = next_entries_offset;
+      cie.fde_address_encoding = cie_fde_encoding;
+
+      if (!FillInCie(&cie)) {
         return false;
       }
+      AddCie(start_offset, std::move(cie));
     }
     fde_entry.reset();
   } else {
@@ -742,59 +1376,283 @@ bool DwarfSectionImpl<AddressType>::GetNextCieOrFde(uint64_t& next_entries_offse
 
 template <typename AddressType>
 void DwarfSectionImpl<AddressType>::GetFdes(std::vector<const DwarfFde*>* fdes) {
-  if (fde_index_.empty()) {
+  if (FdeIndexEmpty()) {
     BuildFdeIndex();
   }
   for (auto& it : fde_index_) {
-    fdes->push_back(GetFdeFromOffset(it.second));
+    fdes->push_back(GetFdeFromOffset(it.fde_offset));
+  }
+  for (auto& it : compact_fde_index_) {
+    fdes->push_back(GetFdeFromOffset(entries_offset_ + it.fde_offset));
   }
 }
 
 template <typename AddressType>
 const DwarfFde* DwarfSectionImpl<AddressType>::GetFdeFromPc(uint64_t pc) {
   // Ensure that the binary search table is initialized.
-  if (fde_index_.empty()) {
+  if (FdeIndexEmpty()) {
     BuildFdeIndex();
   }
 
   // Find the FDE offset in the binary search table.
-  auto comp = [](uint64_t pc, auto& entry) { return pc < entry.first; };
-  auto it = std::upper_bound(fde_index_.begin(), fde_index_.end(), pc, comp);
-  if (it == fde_index_.end()) {
-    return nullptr;
+  uint64_t fde_offset;
+  auto comp = [](auto pc, auto& entry) { return pc < entry.pc_end; };
+  if (!compact_fde_index_.empty()) {
+    // A pc below the base still finds the first entry, which is then
+    // rejected by the pc_start check.
+    uint64_t rel_pc = pc < compact_fde_index_pc_base_ ? 0 : pc - compact_fde_index_pc_base_;
+    if (rel_pc > UINT32_MAX) {
+      return nullptr;
+    }
+    auto it = std::upper_bound(compact_fde_index_.begin(), compact_fde_index_.end(),
+                               static_cast<uint32_t>(rel_pc), comp);
+    if (it == compact_fde_index_.end()) {
+      return nullptr;
+    }
+    fde_offset = entries_offset_ + it->fde_offset;
+  } else {
+    auto it = std::upper_bound(fde_index_.begin(), fde_index_.end(), pc, comp);
+    if (it == fde_index_.end()) {
+      return nullptr;
+    }
+    fde_offset = it->fde_offset;
   }
 
   // Load the full FDE entry based on the offset.
-  const DwarfFde* fde = GetFdeFromOffset(/*fde_offset=*/it->second);
+  const DwarfFde* fde = GetFdeFromOffset(fde_offset);
   return fde != nullptr && fde->pc_start <= pc ? fde : nullptr;
 }
 
-// Create binary search table to make FDE lookups fast.
-// We store only the FDE offset rather than the full entry to save memory.
+// Sections smaller than this are always indexed on the calling thread.
+static constexpr uint64_t kParallelFdeIndexMinSize = 1024 * 1024;
+
+template <typename Range>
+static bool CompareFdeRanges(const Range& a, const Range& b) {
+  return a.start < b.start || (a.start == b.start && a.order < b.order);
+}
+
+// Decodes the entries in chunks on multiple threads, each using its own
+// section object. The ranges are returned sorted. The result is the same
+// as decoding all of the entries in order, stopping at the first entry that
+// cannot be decoded.
 template <typename AddressType>
-void DwarfSectionImpl<AddressType>::BuildFdeIndex() {
-  DwarfFdeMap fdes;
+bool DwarfSectionImpl<AddressType>::GetFdeRangesParallel(size_t num_threads,
+                                                         std::vector<FdeRange>* ranges) {
+  // The workers read the memory at the same time, only allow it for memory
+  // that can be accessed directly.
+  Memory* memory = memory_.memory();
+  if (memory->GetPointer(entries_offset_, entries_end_ - entries_offset_) == nullptr) {
+    return false;
+  }
+  std::vector<std::unique_ptr<DwarfSectionImpl<AddressType>>> workers;
+  for (size_t i = 0; i < num_threads; i++) {
+    std::unique_ptr<DwarfSectionImpl<AddressType>> worker = CreateIndexWorker();
+    if (worker == nullptr) {
+      return false;
+    }
+    workers.push_back(std::move(worker));
+  }
+
+  // Only read the length of each entry to find where the entries start.
+  std::vector<uint64_t> entries;
   for (uint64_t offset = entries_offset_; offset < entries_end_;) {
-    const uint64_t fde_offset = offset;
-    std::optional<DwarfFde> fde;
-    if (!GetNextCieOrFde(offset, fde)) {
+    entries.push_back(offset);
+    memory_.set_cur_offset(offset);
+    uint32_t length32;
+    if (!memory_.ReadBytes(&length32, sizeof(length32))) {
+      break;
+    }
+    uint64_t length = length32;
+    if (length32 == static_cast<uint32_t>(-1) && !memory_.ReadBytes(&length, sizeof(length))) {
       break;
     }
-    if (fde.has_value()) {
-      InsertFde(fde_offset, &*fde, fdes);
+    uint64_t next_offset = memory_.cur_offset() + length;
+    if (next_offset < memory_.cur_offset()) {
+      break;
+    }
+    offset = next_offset;
+  }
+
+  struct Chunk {
+    std::vector<FdeRange> ranges;
+    bool stopped = false;
+  };
+  size_t num_chunks = std::min(num_threads, entries.size());
+  std::vector<Chunk> chunks(num_chunks);
+  auto decode = [&](size_t chunk_index) {
+    DwarfSectionImpl<AddressType>* worker = workers[chunk_index].get();
+    Chunk& chunk = chunks[chunk_index];
+    size_t end = entries.size() * (chunk_index + 1) / num_chunks;
+    for (size_t i = entries.size() * chunk_index / num_chunks; i < end; i++) {
+      uint64_t offset = entries[i];
+      std::optional<DwarfFde> fde;
+      if (!worker->GetNextCieOrFde(offset, fde)) {
+        chunk.stopped = true;
+        break;
+      }
+      if (fde.has_value() && fde->pc_start < fde->pc_end) {
+        chunk.ranges.push_back(FdeRange{fde->pc_start, fde->pc_end, entries[i], i});
+      }
+      if (offset < worker->memory_.cur_offset()) {
+        chunk.stopped = true;
+        break;
+      }
     }
+    std::sort(chunk.ranges.begin(), chunk.ranges.end(), CompareFdeRanges<FdeRange>);
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_chunks; i++) {
+    threads.emplace_back(decode, i);
+  }
+  if (num_chunks > 0) {
+    decode(0);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
 
-    if (offset < memory_.cur_offset()) {
-      // Simply consider the processing done in this case.
+  // Drop everything after the first chunk that stopped early.
+  std::vector<size_t> bounds{0};
+  for (Chunk& chunk : chunks) {
+    ranges->insert(ranges->end(), chunk.ranges.begin(), chunk.ranges.end());
+    bounds.push_back(ranges->size());
+    if (chunk.stopped) {
       break;
     }
   }
+  chunks.clear();
+
+  // Merge the sorted chunks in pairs.
+  while (bounds.size() > 2) {
+    threads.clear();
+    std::vector<size_t> merged_bounds;
+    for (size_t i = 0; i + 2 < bounds.size(); i += 2) {
+      auto begin = ranges->begin();
+      threads.emplace_back([begin, &bounds, i]() {
+        std::inplace_merge(begin + bounds[i], begin + bounds[i + 1], begin + bounds[i + 2],
+                           CompareFdeRanges<FdeRange>);
+      });
+      merged_bounds.push_back(bounds[i]);
+    }
+    if (bounds.size() % 2 == 0) {
+      merged_bounds.push_back(bounds[bounds.size() - 2]);
+    }
+    merged_bounds.push_back(bounds.back());
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    bounds = std::move(merged_bounds);
+  }
+  return true;
+}
+
+// Create binary search table to make FDE lookups fast.
+// We store only the FDE offset rather than the full entry to save memory.
+// The fdes can overlap, in which case every pc belongs to the first fde in
+// the section that contains it. An fde can then be represented by multiple
+// entries. For example, if there is an fde for 0x200-0x400 followed by an
+// fde for 0x100-0x500, the second one gets the entries 0x100-0x200 and
+// 0x400-0x500.
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::BuildFdeIndex() {
+  if (!shared_index_key_.empty()) {
+    std::shared_ptr<const DwarfFdeIndexTables> tables = FindSharedFdeIndex(shared_index_key_);
+    if (tables != nullptr) {
+      UseFdeIndexTables(tables);
+      return;
+    }
+  }
+
+  std::vector<FdeRange> ranges;
+  size_t num_threads = fde_index_threads_;
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  if (num_threads == 1 || entries_end_ - entries_offset_ < kParallelFdeIndexMinSize ||
+      !GetFdeRangesParallel(num_threads, &ranges)) {
+    ranges.clear();
+    for (uint64_t offset = entries_offset_; offset < entries_end_;) {
+      const uint64_t fde_offset = offset;
+      std::optional<DwarfFde> fde;
+      if (!GetNextCieOrFde(offset, fde)) {
+        break;
+      }
+      if (fde.has_value() && fde->pc_start < fde->pc_end) {
+        ranges.push_back(FdeRange{fde->pc_start, fde->pc_end, fde_offset, ranges.size()});
+      }
+
+      if (offset < memory_.cur_offset()) {
+        // Simply consider the processing done in this case.
+        break;
+      }
+    }
+    std::sort(ranges.begin(), ranges.end(), CompareFdeRanges<FdeRange>);
+  }
+  if (ranges.empty()) {
+    return;
+  }
+
+  // Sweep the pcs in order, keeping the fdes that contain the current pc in
+  // a heap ordered by their position in the section. The fdes that ended
+  // are only removed once they reach the top.
+  auto later = [](const FdeRange* a, const FdeRange* b) { return a->order > b->order; };
+  std::vector<const FdeRange*> active;
+  std::vector<DwarfFdeIndexEntry> index;
+  index.reserve(ranges.size());
+  uint64_t pc = ranges.front().start;
+  for (auto next = ranges.begin(); next != ranges.end() || !active.empty();) {
+    if (active.empty()) {
+      pc = std::max(pc, next->start);
+    }
+    for (; next != ranges.end() && next->start <= pc; ++next) {
+      active.push_back(&*next);
+      std::push_heap(active.begin(), active.end(), later);
+    }
+    while (!active.empty() && active.front()->end <= pc) {
+      std::pop_heap(active.begin(), active.end(), later);
+      active.pop_back();
+    }
+    if (active.empty()) {
+      continue;
+    }
+    const FdeRange* owner = active.front();
+    uint64_t end = owner->end;
+    if (next != ranges.end() && next->start < end) {
+      end = next->start;
+    }
+    if (!index.empty() && index.back().pc_end == pc && index.back().fde_offset == owner->offset) {
+      index.back().pc_end = end;
+    } else {
+      index.push_back(DwarfFdeIndexEntry{.pc_end = end, .fde_offset = owner->offset});
+    }
+    pc = end;
+  }
+  uint64_t pc_base = ranges.front().start;
+  ranges.clear();
+  ranges.shrink_to_fit();
+
+  DwarfFdeIndexTables tables;
+  if (index.back().pc_end - pc_base > UINT32_MAX || entries_end_ - entries_offset_ > UINT32_MAX) {
+    index.shrink_to_fit();
+    tables.index = std::move(index);
+  } else {
+    tables.compact_index.reserve(index.size());
+    for (const auto& entry : index) {
+      tables.compact_index.push_back(DwarfFdeCompactIndexEntry{
+          .pc_end = static_cast<uint32_t>(entry.pc_end - pc_base),
+          .fde_offset = static_cast<uint32_t>(entry.fde_offset - entries_offset_)});
+    }
+    tables.compact_index_pc_base = pc_base;
+  }
 
-  // Copy the map into vector for space efficiency. The entries are already sorted.
-  fde_index_.reserve(fdes.size());
-  for (const auto& it : fdes) {
-    fde_index_.emplace_back(/*end address=*/it.first, /*FDE offset=*/it.second.second);
+  if (!shared_index_key_.empty()) {
+    UseFdeIndexTables(AddSharedFdeIndex(
+        shared_index_key_, std::make_shared<DwarfFdeIndexTables>(std::move(tables))));
+    return;
   }
+  fde_index_ = ElfIndexArray<DwarfFdeIndexEntry>(std::move(tables.index));
+  compact_fde_index_ = ElfIndexArray<DwarfFdeCompactIndexEntry>(std::move(tables.compact_index));
+  compact_fde_index_pc_base_ = tables.compact_index_pc_base;
 }
 
 // Explicitly instantiate DwarfSectionImpl
@@ -16,29 +16,74 @@
 
 #include <elf.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #define LOG_TAG "unwind"
 #include <android-base/log_main.h>
+#include <android-base/stringprintf.h>
 
 #include <unwindstack/Elf.h>
+#include <unwindstack/ElfIndex.h>
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
 
+#include "ElfCache.h"
 #include "ElfInterfaceArm.h"
+#include "MergedSymbols.h"
 #include "Symbols.h"
 
 namespace unwindstack {
 
 bool Elf::cache_enabled_;
-std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* Elf::cache_;
-std::mutex* Elf::cache_lock_;
+ElfCache* Elf::cache_;
+size_t Elf::cache_max_entries_;
+size_t Elf::cache_memory_budget_;
+bool Elf::compiled_unwind_tables_enabled_;
+bool Elf::flat_symbol_tables_enabled_;
+bool Elf::merged_symbol_tables_enabled_;
+bool Elf::pinned_rows_enabled_;
+
+// The libraries at the bottom of almost every stack, and the functions in
+// them whose rows are pinned.
+static constexpr std::string_view kPinnedRowSonames[] = {
+    "libc.so",         "libc.so.6",         "ld-android.so",     "linux-vdso.so.1",
+    "linux-gate.so.1", "linux-vdso32.so.1", "linux-vdso64.so.1",
+};
+static constexpr std::string_view kPinnedRowFunctions[] = {
+    "__start_thread",         "__pthread_start", "__libc_init",          "start_thread",
+    "clone",                  "__clone",         "clone3",               "__libc_start_main",
+    "__libc_start_call_main", "__restore_rt",    "__kernel_rt_sigreturn",
+};
+size_t Elf::fde_index_threads_ = 1;
+bool Elf::shared_fde_index_enabled_;
+bool Elf::file_mapping_advice_enabled_;
+bool Elf::intern_names_enabled_;
+std::string Elf::index_cache_directory_;
+ElfIndexStore* Elf::index_store_;
+SymbolStore* Elf::symbol_store_;
+Elf::Executor Elf::symbols_executor_;
+
+Elf::~Elf() {
+  StopBackgroundTask();
+}
+
+void Elf::StopBackgroundTask() {
+  if (background_task_ != nullptr) {
+    std::lock_guard<std::mutex> guard(background_task_->lock);
+    background_task_->elf = nullptr;
+  }
+  background_task_.reset();
+}
 
 bool Elf::Init() {
   load_bias_ = 0;
@@ -55,6 +100,46 @@ bool Elf::Init() {
   if (valid_) {
     interface_->InitHeaders();
     InitGnuDebugdata();
+    if (compiled_unwind_tables_enabled_) {
+      interface_->SetCompiledUnwindTables(true);
+      if (gnu_debugdata_interface_ != nullptr) {
+        gnu_debugdata_interface_->SetCompiledUnwindTables(true);
+      }
+    }
+    if (flat_symbol_tables_enabled_) {
+      interface_->SetFlatSymbolTables(true);
+      if (gnu_debugdata_interface_ != nullptr) {
+        gnu_debugdata_interface_->SetFlatSymbolTables(true);
+      }
+    }
+    if (pinned_rows_enabled_) {
+      pinned_rows_ = PINNED_ROWS_UNKNOWN;
+    }
+    if (merged_symbol_tables_enabled_) {
+      merged_symbols_.reset(new MergedSymbols(interface_.get(), gnu_debugdata_interface_.get()));
+    }
+    if (fde_index_threads_ != 1) {
+      interface_->SetFdeIndexThreads(fde_index_threads_);
+      if (gnu_debugdata_interface_ != nullptr) {
+        gnu_debugdata_interface_->SetFdeIndexThreads(fde_index_threads_);
+      }
+    }
+    if (shared_fde_index_enabled_) {
+      std::string build_id = interface_->GetBuildID();
+      interface_->ShareIndex(build_id, ELF_INDEX_SCOPE_MAIN);
+      if (gnu_debugdata_interface_ != nullptr) {
+        gnu_debugdata_interface_->ShareIndex(build_id, ELF_INDEX_SCOPE_GNU_DEBUGDATA);
+      }
+    }
+    if (!index_cache_directory_.empty() || index_store_ != nullptr) {
+      InitIndex();
+    }
+    if (file_mapping_advice_enabled_) {
+      AdviseUnwindSections();
+    }
+    if (symbols_executor_ != nullptr) {
+      BuildSymbolsInBackground();
+    }
   } else {
     interface_.reset(nullptr);
   }
@@ -88,11 +173,138 @@ void Elf::InitGnuDebugdata() {
   }
 }
 
+void Elf::AdviseUnwindSections() {
+  auto advise = [this](uint64_t offset, uint64_t size) {
+    const uint8_t* data = size != 0 ? memory_->GetPointer(offset, size) : nullptr;
+    if (data == nullptr) {
+      return;
+    }
+    uintptr_t page_size = getpagesize();
+    uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+    madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+  };
+  advise(interface_->eh_frame_hdr_offset(), interface_->eh_frame_hdr_size());
+  advise(interface_->eh_frame_offset(), interface_->eh_frame_size());
+  advise(interface_->debug_frame_offset(), interface_->debug_frame_size());
+  if (arch_ == ARCH_ARM) {
+    ElfInterfaceArm* arm = static_cast<ElfInterfaceArm*>(interface_.get());
+    advise(arm->start_offset(), arm->total_entries() * 8);
+  }
+}
+
+void Elf::BuildSymbolsInBackground() {
+  StopBackgroundTask();
+  if (merged_symbols_ == nullptr) {
+    interface_->SetSymbolsPending();
+    if (gnu_debugdata_interface_ != nullptr) {
+      gnu_debugdata_interface_->SetSymbolsPending();
+    }
+  }
+  background_task_ = std::make_shared<BackgroundTask>();
+  background_task_->elf = this;
+  symbols_executor_([task = background_task_]() {
+    std::lock_guard<std::mutex> guard(task->lock);
+    Elf* elf = task->elf;
+    if (elf == nullptr || elf->interface_ == nullptr) {
+      return;
+    }
+    // The symbol tables do their own locking.
+    if (elf->merged_symbols_ != nullptr) {
+      elf->merged_symbols_->Build();
+      return;
+    }
+    elf->interface_->BuildSymbolsInBackground();
+    if (elf->gnu_debugdata_interface_ != nullptr) {
+      elf->gnu_debugdata_interface_->BuildSymbolsInBackground();
+    }
+  });
+}
+
+void Elf::InitIndex() {
+  std::string build_id = interface_->GetBuildID();
+  if (build_id.empty()) {
+    return;
+  }
+  std::string path;
+  std::shared_ptr<ElfIndexFile> file;
+  if (!index_cache_directory_.empty()) {
+    path = index_cache_directory_ + '/';
+    for (const char& c : build_id) {
+      path += android::base::StringPrintf("%02hhx", c);
+    }
+    path += ".idx";
+    file = ElfIndexFile::Open(path, build_id);
+  }
+  if (file == nullptr && index_store_ != nullptr) {
+    int fd = index_store_->Find(build_id);
+    if (fd != -1) {
+      file = ElfIndexFile::OpenFd(fd, build_id);
+      close(fd);
+    }
+  }
+  if (file != nullptr) {
+    interface_->LoadIndex(file, ELF_INDEX_SCOPE_MAIN);
+    if (gnu_debugdata_interface_ != nullptr) {
+      gnu_debugdata_interface_->LoadIndex(file, ELF_INDEX_SCOPE_GNU_DEBUGDATA);
+    }
+    return;
+  }
+
+  ElfIndexWriter writer;
+  interface_->SaveIndex(&writer, ELF_INDEX_SCOPE_MAIN);
+  if (gnu_debugdata_interface_ != nullptr) {
+    gnu_debugdata_interface_->SaveIndex(&writer, ELF_INDEX_SCOPE_GNU_DEBUGDATA);
+  }
+  if (writer.empty()) {
+    return;
+  }
+  // Failing to write the index only means it is built again next time.
+  if (!path.empty()) {
+    writer.Write(path, build_id);
+  }
+  if (index_store_ != nullptr) {
+    int fd = writer.WriteToMemfd(build_id);
+    if (fd != -1) {
+      index_store_->Add(build_id, fd);
+      close(fd);
+    }
+  }
+}
+
 void Elf::Invalidate() {
+  StopBackgroundTask();
+  merged_symbols_.reset();
   interface_.reset(nullptr);
   valid_ = false;
 }
 
+size_t Elf::MemoryUsage() {
+  ElfMemoryUsage usage;
+  GetMemoryUsage(&usage);
+  return usage.Total();
+}
+
+void Elf::GetMemoryUsage(ElfMemoryUsage* usage) {
+  std::lock_guard<std::mutex> guard(lock_);
+  usage->headers += sizeof(*this);
+  if (memory_ != nullptr) {
+    usage->data += memory_->MemoryUsage();
+  }
+  if (interface_ != nullptr) {
+    interface_->GetMemoryUsage(usage);
+  }
+  if (gnu_debugdata_memory_ != nullptr) {
+    usage->data += gnu_debugdata_memory_->MemoryUsage();
+  }
+  if (gnu_debugdata_interface_ != nullptr) {
+    gnu_debugdata_interface_->GetMemoryUsage(usage);
+  }
+  if (merged_symbols_ != nullptr) {
+    usage->symbols += merged_symbols_->MemoryUsage();
+  }
+}
+
 std::string Elf::GetSoname() {
   std::lock_guard<std::mutex> guard(lock_);
   if (!valid_) {
@@ -106,12 +318,46 @@ uint64_t Elf::GetRelPc(uint64_t pc, const MapInfo* map_info) {
 }
 
 bool Elf::GetFunctionName(uint64_t addr, SharedString* name, uint64_t* func_offset) {
-  std::lock_guard<std::mutex> guard(lock_);
+  // No lock needed, the symbol tables do their own locking.
+  if (valid_ && merged_symbols_ != nullptr) {
+    return merged_symbols_->GetName(addr, name, func_offset);
+  }
   return valid_ && (interface_->GetFunctionName(addr, name, func_offset) ||
                     (gnu_debugdata_interface_ &&
                      gnu_debugdata_interface_->GetFunctionName(addr, name, func_offset)));
 }
 
+bool Elf::GetFunctionNameView(uint64_t addr, std::string_view* name, uint64_t* func_offset) {
+  // No lock needed, the symbol tables do their own locking.
+  if (valid_ && merged_symbols_ != nullptr) {
+    // The merged table keeps its own reference to the name.
+    SharedString shared_name;
+    if (!merged_symbols_->GetName(addr, &shared_name, func_offset)) {
+      return false;
+    }
+    *name = static_cast<const std::string&>(shared_name);
+    return true;
+  }
+  return valid_ && (interface_->GetFunctionNameView(addr, name, func_offset) ||
+                    (gnu_debugdata_interface_ &&
+                     gnu_debugdata_interface_->GetFunctionNameView(addr, name, func_offset)));
+}
+
+void Elf::GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                           uint64_t* func_offsets, bool* found) {
+  if (!valid_) {
+    return;
+  }
+  if (merged_symbols_ != nullptr) {
+    merged_symbols_->GetNames(addrs, count, names, func_offsets, found);
+    return;
+  }
+  interface_->GetFunctionNames(addrs, count, names, func_offsets, found);
+  if (gnu_debugdata_interface_) {
+    gnu_debugdata_interface_->GetFunctionNames(addrs, count, names, func_offsets, found);
+  }
+}
+
 bool Elf::GetGlobalVariableOffset(const std::string& name, uint64_t* memory_offset) {
   if (!valid_) {
     return false;
@@ -177,6 +423,22 @@ uint64_t Elf::GetLastErrorAddress() {
   return 0;
 }
 
+uint64_t Elf::GetThumbInstructionSize(uint64_t elf_offset) {
+  uint8_t size;
+  if (thumb_sizes_.Find(elf_offset, &size)) {
+    return size;
+  }
+  uint32_t value;
+  if (elf_offset >= 5 && memory_->ReadFully(elf_offset - 5, &value, sizeof(value)) &&
+      (value & 0xe000f000) == 0xe000f000) {
+    size = 4;
+  } else {
+    size = 2;
+  }
+  thumb_sizes_.Set(elf_offset, size);
+  return size;
+}
+
 // The relative pc expectd by this function is relative to the start of the elf.
 bool Elf::StepIfSignalHandler(uint64_t rel_pc, Regs* regs, Memory* process_memory) {
   if (!valid_) {
@@ -187,19 +449,145 @@ bool Elf::StepIfSignalHandler(uint64_t rel_pc, Regs* regs, Memory* process_memor
   if (rel_pc < static_cast<uint64_t>(load_bias_)) {
     return false;
   }
-  return regs->StepIfSignalHandler(rel_pc - load_bias_, this, process_memory);
+  uint64_t elf_offset = rel_pc - load_bias_;
+
+  uint8_t is_handler;
+  if (!signal_handlers_.Find(elf_offset, &is_handler)) {
+    is_handler = regs->IsSignalHandler(elf_offset, this);
+    signal_handlers_.Set(elf_offset, is_handler);
+  }
+  if (!is_handler) {
+    return false;
+  }
+  return regs->StepIfSignalHandler(elf_offset, this, process_memory);
 }
 
 // The relative pc is always relative to the start of the map from which it comes.
 bool Elf::Step(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
-               bool* is_signal_frame) {
+               bool* is_signal_frame, ErrorData* error) {
   if (!valid_) {
+    if (error != nullptr) {
+      error->code = ERROR_INVALID_ELF;
+      error->address = 0;
+    }
     return false;
   }
 
+  // Rows that are already cached can be evaluated without the lock.
+  if (interface_->StepFromCache(rel_pc, regs, process_memory, finished, is_signal_frame)) {
+    if (error != nullptr) {
+      error->code = ERROR_NONE;
+      error->address = 0;
+    }
+    return true;
+  }
+
   // Lock during the step which can update information in the object.
   std::lock_guard<std::mutex> guard(lock_);
-  return interface_->Step(rel_pc, regs, process_memory, finished, is_signal_frame);
+  bool stepped = interface_->Step(rel_pc, regs, process_memory, finished, is_signal_frame);
+  if (error != nullptr) {
+    *error = interface_->last_error();
+  }
+  if (stepped && pinned_rows_ != PINNED_ROWS_DISABLED) {
+    PinRowIfStackBottom(rel_pc, *finished);
+  }
+  return stepped;
+}
+
+void Elf::PinRowIfStackBottom(uint64_t rel_pc, bool finished) {
+  if (pinned_rows_ == PINNED_ROWS_UNKNOWN) {
+    std::string soname = interface_->GetSoname();
+    pinned_rows_ = PINNED_ROWS_DISABLED;
+    for (std::string_view pinned_soname : kPinnedRowSonames) {
+      if (soname == pinned_soname) {
+        pinned_rows_ = PINNED_ROWS_ENABLED;
+        break;
+      }
+    }
+    if (pinned_rows_ == PINNED_ROWS_DISABLED) {
+      return;
+    }
+  }
+  // The outermost frame, such as clone, is pinned even without symbols.
+  if (finished) {
+    interface_->PinRow(rel_pc);
+    return;
+  }
+  // Only rows that were not found in the row cache get here. Rows that
+  // cannot be pinned keep getting here, so the recent pcs are remembered to
+  // look up the name only once.
+  uint8_t checked;
+  if (pinned_row_checks_.Find(rel_pc, &checked)) {
+    return;
+  }
+  pinned_row_checks_.Set(rel_pc, 1);
+  SharedString name;
+  uint64_t func_offset;
+  if (!GetFunctionName(rel_pc, &name, &func_offset)) {
+    return;
+  }
+  for (std::string_view function : kPinnedRowFunctions) {
+    if (static_cast<const std::string&>(name) == function) {
+      interface_->PinRow(rel_pc);
+      return;
+    }
+  }
+}
+
+bool Elf::StepSignalSafe(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
+                         bool* is_signal_frame) {
+  if (!valid_) {
+    return false;
+  }
+
+  // The interrupted thread might hold the lock.
+  std::unique_lock<std::mutex> guard(lock_, std::try_to_lock);
+  if (!guard.owns_lock()) {
+    return false;
+  }
+  return interface_->StepCompiled(rel_pc, regs, process_memory, finished, is_signal_frame);
+}
+
+FramePointerRule Elf::GetFramePointerRule(uint64_t rel_pc) {
+  if (!valid_) {
+    return FRAME_POINTER_UNKNOWN;
+  }
+  // The rule of an fde that is already compiled needs no lock.
+  FramePointerRule rule;
+  if (interface_->GetCachedFramePointerRule(rel_pc, arch_, &rule)) {
+    return rule;
+  }
+  // Lock to find the fde, which is compiled without the lock.
+  std::unique_lock<std::mutex> guard(lock_);
+  return interface_->GetFramePointerRule(rel_pc, arch_, &guard);
+}
+
+void Elf::CompileUnwindTables() {
+  if (!valid_) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  interface_->CompileUnwindTables(arch_);
+}
+
+void Elf::Preload(bool symbols) {
+  if (!valid_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    interface_->PreloadUnwindInfo();
+    if (gnu_debugdata_interface_ != nullptr) {
+      gnu_debugdata_interface_->PreloadUnwindInfo();
+    }
+  }
+  if (symbols) {
+    // The symbol tables do their own locking.
+    interface_->PreloadSymbols();
+    if (gnu_debugdata_interface_ != nullptr) {
+      gnu_debugdata_interface_->PreloadSymbols();
+    }
+  }
 }
 
 bool Elf::IsValidElf(Memory* memory) {
@@ -291,13 +679,13 @@ ElfInterface* Elf::CreateInterfaceFromMemory(Memory* memory) {
     }
 
     machine_type_ = e_machine;
-    if (e_machine == EM_ARM) {
+    if (e_machine == EM_ARM && ArchSupported(ARCH_ARM)) {
       arch_ = ARCH_ARM;
       interface.reset(new ElfInterfaceArm(memory));
-    } else if (e_machine == EM_386) {
+    } else if (e_machine == EM_386 && ArchSupported(ARCH_X86)) {
       arch_ = ARCH_X86;
       interface.reset(new ElfInterface32(memory));
-    } else if (e_machine == EM_MIPS) {
+    } else if (e_machine == EM_MIPS && ArchSupported(ARCH_MIPS)) {
       arch_ = ARCH_MIPS;
       interface.reset(new ElfInterface32(memory));
     } else {
@@ -312,11 +700,11 @@ ElfInterface* Elf::CreateInterfaceFromMemory(Memory* memory) {
     }
 
     machine_type_ = e_machine;
-    if (e_machine == EM_AARCH64) {
+    if (e_machine == EM_AARCH64 && ArchSupported(ARCH_ARM64)) {
       arch_ = ARCH_ARM64;
-    } else if (e_machine == EM_X86_64) {
+    } else if (e_machine == EM_X86_64 && ArchSupported(ARCH_X86_64)) {
       arch_ = ARCH_X86_64;
-    } else if (e_machine == EM_MIPS) {
+    } else if (e_machine == EM_MIPS && ArchSupported(ARCH_MIPS64)) {
       arch_ = ARCH_MIPS64;
     } else {
       // Unsupported.
@@ -351,76 +739,70 @@ int64_t Elf::GetLoadBias(Memory* memory) {
 void Elf::SetCachingEnabled(bool enable) {
   if (!cache_enabled_ && enable) {
     cache_enabled_ = true;
-    cache_ = new std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>;
-    cache_lock_ = new std::mutex;
+    cache_ = new ElfCache;
+    cache_->SetMaxEntries(cache_max_entries_);
+    cache_->SetMemoryBudget(cache_memory_budget_);
   } else if (cache_enabled_ && !enable) {
     cache_enabled_ = false;
     delete cache_;
-    delete cache_lock_;
   }
 }
 
-void Elf::CacheLock() {
-  cache_lock_->lock();
+void Elf::SetCacheMaxEntries(size_t max_entries) {
+  cache_max_entries_ = max_entries;
+  if (cache_enabled_) {
+    cache_->SetMaxEntries(max_entries);
+  }
 }
 
-void Elf::CacheUnlock() {
-  cache_lock_->unlock();
+void Elf::SetCacheMemoryBudget(size_t bytes) {
+  cache_memory_budget_ = bytes;
+  if (cache_enabled_) {
+    cache_->SetMemoryBudget(bytes);
+  }
 }
 
-void Elf::CacheAdd(MapInfo* info) {
-  // If elf_offset != 0, then cache both name:offset and name.
-  // The cached name is used to do lookups if multiple maps for the same
-  // named elf file exist.
-  // For example, if there are two maps boot.odex:1000 and boot.odex:2000
-  // where each reference the entire boot.odex, the cache will properly
-  // use the same cached elf object.
-
-  if (info->offset == 0 || info->elf_offset != 0) {
-    (*cache_)[info->name] = std::make_pair(info->elf, true);
+ElfCacheStats Elf::GetCacheStats() {
+  if (!cache_enabled_) {
+    return ElfCacheStats();
   }
+  return cache_->GetStats();
+}
 
-  if (info->offset != 0) {
-    // The second element in the pair indicates whether elf_offset should
-    // be set to offset when getting out of the cache.
-    std::string key = std::string(info->name) + ':' + std::to_string(info->offset);
-    (*cache_)[key] = std::make_pair(info->elf, info->elf_offset != 0);
+ElfMemoryUsage Elf::GetCacheMemoryUsage(size_t* num_elfs) {
+  ElfMemoryUsage usage;
+  size_t count = 0;
+  if (cache_enabled_) {
+    cache_->GetMemoryUsage(&usage, &count);
+  }
+  if (num_elfs != nullptr) {
+    *num_elfs = count;
   }
+  return usage;
 }
 
-bool Elf::CacheAfterCreateMemory(MapInfo* info) {
-  if (info->name.empty() || info->offset == 0 || info->elf_offset == 0) {
-    return false;
-  }
+void Elf::CacheLock(MapInfo* info) {
+  cache_->Lock(info);
+}
 
-  auto entry = cache_->find(info->name);
-  if (entry == cache_->end()) {
-    return false;
-  }
+void Elf::CacheUnlock(MapInfo* info) {
+  cache_->Unlock(info);
+}
 
-  // In this case, the whole file is the elf, and the name has already
-  // been cached. Add an entry at name:offset to get this directly out
-  // of the cache next time.
-  info->elf = entry->second.first;
-  std::string key = std::string(info->name) + ':' + std::to_string(info->offset);
-  (*cache_)[key] = std::make_pair(info->elf, true);
-  return true;
+void Elf::CacheAdd(MapInfo* info) {
+  cache_->Add(info);
+}
+
+bool Elf::CacheAfterCreateMemory(MapInfo* info) {
+  return cache_->AfterCreateMemory(info);
 }
 
 bool Elf::CacheGet(MapInfo* info) {
-  std::string name(info->name);
-  if (info->offset != 0) {
-    name += ':' + std::to_string(info->offset);
-  }
-  auto entry = cache_->find(name);
-  if (entry != cache_->end()) {
-    info->elf = entry->second.first;
-    if (entry->second.second) {
-      info->elf_offset = info->offset;
-    }
-    return true;
-  }
-  return false;
+  return cache_->Get(info);
+}
+
+bool Elf::CacheFind(MapInfo* info) {
+  return cache_->Find(info);
 }
 
 std::string Elf::GetBuildID(Memory* memory) {
@@ -441,4 +823,24 @@ std::string Elf::GetBuildID(Memory* memory) {
   return "";
 }
 
+bool Elf::GetLoadedInfo(Memory* memory, std::string* build_id, uint64_t* loaded_size) {
+  if (!IsValidElf(memory)) {
+    return false;
+  }
+
+  uint8_t class_type;
+  if (!memory->Read(EI_CLASS, &class_type, 1)) {
+    return false;
+  }
+
+  if (class_type == ELFCLASS32) {
+    return ElfInterface::ReadLoadedInfo<Elf32_Ehdr, Elf32_Phdr, Elf32_Nhdr>(memory, build_id,
+                                                                           loaded_size);
+  } else if (class_type == ELFCLASS64) {
+    return ElfInterface::ReadLoadedInfo<Elf64_Ehdr, Elf64_Phdr, Elf64_Nhdr>(memory, build_id,
+                                                                           loaded_size);
+  }
+  return false;
+}
+
 }  // namespace unwindstack
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_set>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+
+#include "ElfCache.h"
+
+namespace unwindstack {
+
+size_t ElfCache::HashName(std::string_view name) {
+  return std::hash<std::string_view>()(name);
+}
+
+size_t ElfCache::HashKey(size_t name_hash, uint64_t offset) {
+  return name_hash ^ static_cast<size_t>(offset * 0x9e3779b97f4a7c15ULL);
+}
+
+size_t ElfCache::FileKeyHash::operator()(const FileKey& key) const {
+  uint64_t hash = key.ino * 0x9e3779b97f4a7c15ULL;
+  hash ^= key.dev + (hash << 6) + (hash >> 2);
+  hash ^= key.elf_start + (hash << 6) + (hash >> 2);
+  hash ^= static_cast<uint64_t>(key.mtime_nsec) + (hash << 6) + (hash >> 2);
+  return static_cast<size_t>(hash);
+}
+
+void ElfCache::Lock(MapInfo* info) {
+  GetShard(HashName(info->name)).lock.lock();
+}
+
+void ElfCache::Unlock(MapInfo* info) {
+  GetShard(HashName(info->name)).lock.unlock();
+}
+
+ElfCache::Entry* ElfCache::FindEntry(Shard& shard, size_t name_hash, std::string_view name,
+                                     uint64_t offset) {
+  auto range = shard.entries.equal_range(HashKey(name_hash, offset));
+  for (auto it = range.first; it != range.second; ++it) {
+    Entry& entry = it->second;
+    if (entry.offset == offset && static_cast<std::string_view>(entry.name) == name) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+bool ElfCache::Tracking() {
+  return max_entries_per_shard_.load(std::memory_order_relaxed) != 0 ||
+         memory_budget_.load(std::memory_order_relaxed) != 0;
+}
+
+void ElfCache::Touch(Entry* entry) {
+  // Only keep track of the use order when entries can be evicted, this
+  // avoids every lookup writing to the same counter.
+  if (Tracking()) {
+    entry->last_used.store(clock_.fetch_add(1, std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+  }
+}
+
+void ElfCache::Erase(Shard& shard, std::unordered_multimap<size_t, Entry>::iterator it) {
+  // Any map that is using this elf keeps its own reference to it.
+  RemoveCharge(shard, it->second.elf.get());
+  shard.entries.erase(it);
+  evictions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ElfCache::EvictOldest(Shard& shard, const Entry* keep) {
+  auto oldest = shard.entries.end();
+  for (auto it = shard.entries.begin(); it != shard.entries.end(); ++it) {
+    if (&it->second == keep) {
+      continue;
+    }
+    if (oldest == shard.entries.end() ||
+        it->second.last_used.load(std::memory_order_relaxed) <
+            oldest->second.last_used.load(std::memory_order_relaxed)) {
+      oldest = it;
+    }
+  }
+  if (oldest == shard.entries.end()) {
+    return false;
+  }
+  Erase(shard, oldest);
+  return true;
+}
+
+void ElfCache::AddCharge(Shard& shard, Elf* elf) {
+  if (elf != nullptr) {
+    shard.charges[elf].entries++;
+  }
+}
+
+void ElfCache::RemoveCharge(Shard& shard, Elf* elf) {
+  if (elf == nullptr) {
+    return;
+  }
+  auto it = shard.charges.find(elf);
+  if (it != shard.charges.end() && --it->second.entries == 0) {
+    total_bytes_.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+    shard.charges.erase(it);
+  }
+}
+
+void ElfCache::UpdateCharge(Elf* elf, Charge* charge) {
+  size_t bytes = elf->MemoryUsage();
+  if (bytes >= charge->bytes) {
+    total_bytes_.fetch_add(bytes - charge->bytes, std::memory_order_relaxed);
+  } else {
+    total_bytes_.fetch_sub(charge->bytes - bytes, std::memory_order_relaxed);
+  }
+  charge->bytes = bytes;
+}
+
+void ElfCache::RefreshCharges(Shard& shard) {
+  for (auto& [elf, charge] : shard.charges) {
+    UpdateCharge(elf, &charge);
+  }
+}
+
+void ElfCache::EvictIfNeeded(Shard& shard, const Entry* keep) {
+  size_t max_entries = max_entries_per_shard_.load(std::memory_order_relaxed);
+  if (max_entries != 0) {
+    while (shard.entries.size() > max_entries && EvictOldest(shard, keep)) {
+    }
+  }
+
+  size_t budget = memory_budget_.load(std::memory_order_relaxed);
+  if (budget == 0) {
+    return;
+  }
+  // The footprint of an elf grows as its symbols and unwind rows are read,
+  // so the charge of the elf being added is recomputed. The other elf
+  // objects keep the charge from when they were last added.
+  if (keep->elf != nullptr) {
+    UpdateCharge(keep->elf.get(), &shard.charges[keep->elf.get()]);
+  }
+  while (total_bytes_.load(std::memory_order_relaxed) > budget && EvictOldest(shard, keep)) {
+  }
+  if (total_bytes_.load(std::memory_order_relaxed) <= budget) {
+    return;
+  }
+
+  // Still over budget, so take from the other shards. Only shards that are
+  // not in use are considered, waiting here could deadlock against another
+  // thread doing the same thing.
+  for (auto& other : shards_) {
+    if (&other == &shard || !other.lock.try_lock()) {
+      continue;
+    }
+    while (total_bytes_.load(std::memory_order_relaxed) > budget &&
+           EvictOldest(other, nullptr)) {
+    }
+    other.lock.unlock();
+    if (total_bytes_.load(std::memory_order_relaxed) <= budget) {
+      return;
+    }
+  }
+}
+
+void ElfCache::Put(Shard& shard, size_t name_hash, const SharedString& name, uint64_t offset,
+                   const std::shared_ptr<Elf>& elf, bool set_elf_offset) {
+  Entry* entry = FindEntry(shard, name_hash, name, offset);
+  if (entry != nullptr) {
+    if (entry->elf != elf) {
+      RemoveCharge(shard, entry->elf.get());
+      AddCharge(shard, elf.get());
+      entry->elf = elf;
+    }
+    entry->set_elf_offset = set_elf_offset;
+  } else {
+    auto it = shard.entries.emplace(std::piecewise_construct,
+                                    std::forward_as_tuple(HashKey(name_hash, offset)),
+                                    std::forward_as_tuple(name, offset, elf, set_elf_offset));
+    entry = &it->second;
+    AddCharge(shard, elf.get());
+  }
+  Touch(entry);
+  EvictIfNeeded(shard, entry);
+}
+
+void ElfCache::GetFromEntry(Entry* entry, MapInfo* info) {
+  info->elf = entry->elf;
+  if (entry->set_elf_offset) {
+    info->elf_offset = info->offset;
+  }
+  Touch(entry);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ElfCache::Get(MapInfo* info) {
+  size_t name_hash = HashName(info->name);
+  Entry* entry = FindEntry(GetShard(name_hash), name_hash, info->name, info->offset);
+  if (entry == nullptr) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  GetFromEntry(entry, info);
+  return true;
+}
+
+bool ElfCache::Find(MapInfo* info) {
+  size_t name_hash = HashName(info->name);
+  Shard& shard = GetShard(name_hash);
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  Entry* entry = FindEntry(shard, name_hash, info->name, info->offset);
+  if (entry == nullptr) {
+    return false;
+  }
+  GetFromEntry(entry, info);
+  return true;
+}
+
+void ElfCache::PutEntries(Shard& shard, size_t name_hash, MapInfo* info) {
+  // If elf_offset != 0, then cache both name:offset and name.
+  // The cached name is used to do lookups if multiple maps for the same
+  // named elf file exist.
+  // For example, if there are two maps boot.odex:1000 and boot.odex:2000
+  // where each reference the entire boot.odex, the cache will properly
+  // use the same cached elf object.
+  if (info->offset == 0 || info->elf_offset != 0) {
+    Put(shard, name_hash, info->name, 0, info->elf, true);
+  }
+
+  if (info->offset != 0) {
+    Put(shard, name_hash, info->name, info->offset, info->elf, info->elf_offset != 0);
+  }
+}
+
+void ElfCache::Add(MapInfo* info) {
+  size_t name_hash = HashName(info->name);
+  PutEntries(GetShard(name_hash), name_hash, info);
+  AddFile(info);
+}
+
+bool ElfCache::GetFileKey(MapInfo* info, FileKey* key) {
+  if (info->memory_backed_elf) {
+    return false;
+  }
+  struct stat st;
+  if (stat(info->name.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  key->dev = st.st_dev;
+  key->ino = st.st_ino;
+  key->size = st.st_size;
+  key->mtime_sec = st.st_mtim.tv_sec;
+  key->mtime_nsec = st.st_mtim.tv_nsec;
+  // Where the elf data starts in the file, which is the same for every map
+  // of one elf whether or not the linker split it into several segments.
+  key->elf_start = info->offset - info->elf_offset;
+  return true;
+}
+
+void ElfCache::AddFile(MapInfo* info) {
+  FileKey key;
+  if (info->elf == nullptr || !info->elf->valid() || !GetFileKey(info, &key)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(files_lock_);
+  files_[key] = info->elf;
+  if (files_.size() >= files_prune_size_) {
+    // Drop the files whose elf objects were freed.
+    for (auto it = files_.begin(); it != files_.end();) {
+      if (it->second.expired()) {
+        it = files_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    files_prune_size_ = std::max<size_t>(64, 2 * files_.size());
+  }
+}
+
+bool ElfCache::GetFromFile(Shard& shard, size_t name_hash, MapInfo* info) {
+  FileKey key;
+  if (!GetFileKey(info, &key)) {
+    return false;
+  }
+  std::shared_ptr<Elf> elf;
+  {
+    std::lock_guard<std::mutex> guard(files_lock_);
+    auto it = files_.find(key);
+    if (it == files_.end()) {
+      return false;
+    }
+    elf = it->second.lock();
+  }
+  if (elf == nullptr) {
+    return false;
+  }
+
+  // The same file under another name, cache it under this name too.
+  info->elf = std::move(elf);
+  PutEntries(shard, name_hash, info);
+  file_hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ElfCache::AfterCreateMemory(MapInfo* info) {
+  if (info->name.empty()) {
+    return false;
+  }
+
+  size_t name_hash = HashName(info->name);
+  Shard& shard = GetShard(name_hash);
+  if (info->offset != 0 && info->elf_offset != 0) {
+    Entry* entry = FindEntry(shard, name_hash, info->name, 0);
+    if (entry != nullptr) {
+      // In this case, the whole file is the elf, and the name has already
+      // been cached. Add an entry at name:offset to get this directly out
+      // of the cache next time.
+      info->elf = entry->elf;
+      Touch(entry);
+      Put(shard, name_hash, info->name, info->offset, info->elf, true);
+      return true;
+    }
+  }
+  return GetFromFile(shard, name_hash, info);
+}
+
+void ElfCache::SetMaxEntries(size_t max_entries) {
+  size_t per_shard = (max_entries + kNumShards - 1) / kNumShards;
+  max_entries_per_shard_.store(per_shard, std::memory_order_relaxed);
+}
+
+void ElfCache::SetMemoryBudget(size_t bytes) {
+  if (memory_budget_.exchange(bytes, std::memory_order_relaxed) == 0 && bytes != 0) {
+    // Start charging the entries that were added while there was no budget.
+    for (auto& shard : shards_) {
+      std::lock_guard<std::shared_mutex> guard(shard.lock);
+      RefreshCharges(shard);
+    }
+  }
+}
+
+ElfCacheStats ElfCache::GetStats() {
+  ElfCacheStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.evictions = evictions_.load(std::memory_order_relaxed);
+  stats.file_hits = file_hits_.load(std::memory_order_relaxed);
+  for (auto& shard : shards_) {
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    stats.entries += shard.entries.size();
+    std::unordered_set<const Elf*> counted;
+    for (auto& [key, entry] : shard.entries) {
+      if (entry.elf != nullptr && counted.insert(entry.elf.get()).second) {
+        stats.bytes += entry.elf->MemoryUsage();
+      }
+    }
+  }
+  return stats;
+}
+
+void ElfCache::GetMemoryUsage(ElfMemoryUsage* usage, size_t* num_elfs) {
+  // The same elf can be cached under names in different shards.
+  std::unordered_set<const Elf*> counted;
+  for (auto& shard : shards_) {
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    for (auto& [key, entry] : shard.entries) {
+      if (entry.elf != nullptr && counted.insert(entry.elf.get()).second) {
+        entry.elf->GetMemoryUsage(usage);
+      }
+    }
+  }
+  *num_elfs += counted.size();
+}
+
+}  // namespace unwindstack
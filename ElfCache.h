@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_ELF_CACHE_H
+#define _LIBUNWINDSTACK_ELF_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/SharedString.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+struct MapInfo;
+
+// The process wide cache of Elf objects used when Elf::SetCachingEnabled is
+// on. The entries are split into shards by file name, each with its own
+// reader/writer lock, so that threads resolving different files do not
+// contend. All of the entries for one file are always in the same shard.
+//
+// An entry is keyed by the file name and the map offset, an offset of zero
+// meaning the entry for the whole file. The elf objects are also indexed by
+// the identity of their file, so that a file found under another name, such
+// as through a symlink or a bind mount, still shares one elf and one mapping
+// of the file.
+class ElfCache {
+ public:
+  static constexpr size_t kNumShards = 16;
+
+  ElfCache() = default;
+  ~ElfCache() = default;
+
+  // Locks the shard that contains all of the entries for info.
+  void Lock(MapInfo* info);
+  void Unlock(MapInfo* info);
+
+  // These require the shard lock for info to be held.
+  bool Get(MapInfo* info);
+  void Add(MapInfo* info);
+  bool AfterCreateMemory(MapInfo* info);
+
+  // Same as Get, but only takes the shard lock in shared mode.
+  bool Find(MapInfo* info);
+
+  // A max_entries of zero means there is no limit. When the limit is reached
+  // the least recently used entries of a shard are evicted.
+  void SetMaxEntries(size_t max_entries);
+
+  // A budget of zero means there is no limit. When the approximate memory
+  // used by the cached elf objects goes over the budget, the least recently
+  // used entries are evicted, starting with the shard being added to.
+  void SetMemoryBudget(size_t bytes);
+
+  ElfCacheStats GetStats();
+  // Adds the memory used by the cached elf objects, each counted once, and
+  // their number.
+  void GetMemoryUsage(ElfMemoryUsage* usage, size_t* num_elfs);
+
+ private:
+  struct Entry {
+    Entry(const SharedString& name, uint64_t offset, const std::shared_ptr<Elf>& elf,
+          bool set_elf_offset)
+        : name(name), offset(offset), elf(elf), set_elf_offset(set_elf_offset) {}
+
+    SharedString name;
+    uint64_t offset;
+    std::shared_ptr<Elf> elf;
+    // Whether elf_offset should be set to offset when getting the elf.
+    bool set_elf_offset;
+    std::atomic<uint64_t> last_used = 0;
+  };
+
+  // The bytes counted against the memory budget for an elf, which is only
+  // charged once however many entries of a shard share it.
+  struct Charge {
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  // The device and inode of a file, with its size and modification time in
+  // case the inode was reused, and the offset of the elf in the file.
+  struct FileKey {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t elf_start;
+
+    bool operator==(const FileKey& other) const {
+      return dev == other.dev && ino == other.ino && size == other.size &&
+             mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+             elf_start == other.elf_start;
+    }
+  };
+  struct FileKeyHash {
+    size_t operator()(const FileKey& key) const;
+  };
+
+  struct alignas(64) Shard {
+    std::shared_mutex lock;
+    // Keyed by the hash of the name and offset.
+    std::unordered_multimap<size_t, Entry> entries;
+    std::unordered_map<Elf*, Charge> charges;
+  };
+
+  static size_t HashName(std::string_view name);
+  static size_t HashKey(size_t name_hash, uint64_t offset);
+
+  Shard& GetShard(size_t name_hash) { return shards_[(name_hash >> 8) % kNumShards]; }
+
+  Entry* FindEntry(Shard& shard, size_t name_hash, std::string_view name, uint64_t offset);
+  void Put(Shard& shard, size_t name_hash, const SharedString& name, uint64_t offset,
+           const std::shared_ptr<Elf>& elf, bool set_elf_offset);
+  bool Tracking();
+  void Touch(Entry* entry);
+  void Erase(Shard& shard, std::unordered_multimap<size_t, Entry>::iterator it);
+  bool EvictOldest(Shard& shard, const Entry* keep);
+  void AddCharge(Shard& shard, Elf* elf);
+  void RemoveCharge(Shard& shard, Elf* elf);
+  void UpdateCharge(Elf* elf, Charge* charge);
+  void RefreshCharges(Shard& shard);
+  void EvictIfNeeded(Shard& shard, const Entry* keep);
+  void GetFromEntry(Entry* entry, MapInfo* info);
+  void PutEntries(Shard& shard, size_t name_hash, MapInfo* info);
+  static bool GetFileKey(MapInfo* info, FileKey* key);
+  bool GetFromFile(Shard& shard, size_t name_hash, MapInfo* info);
+  void AddFile(MapInfo* info);
+
+  Shard shards_[kNumShards];
+  std::atomic<uint64_t> clock_ = 0;
+  std::atomic<size_t> max_entries_per_shard_ = 0;
+  std::atomic<size_t> memory_budget_ = 0;
+  // The sum of the charged bytes over all shards, only kept up to date while
+  // there is a memory budget.
+  std::atomic<size_t> total_bytes_ = 0;
+  std::atomic<uint64_t> hits_ = 0;
+  std::atomic<uint64_t> misses_ = 0;
+  std::atomic<uint64_t> evictions_ = 0;
+  std::atomic<uint64_t> file_hits_ = 0;
+
+  // Taken after a shard lock. The elf objects are not kept alive by this
+  // index, so evicted entries are still freed.
+  std::mutex files_lock_;
+  std::unordered_map<FileKey, std::weak_ptr<Elf>, FileKeyHash> files_;
+  size_t files_prune_size_ = 64;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_ELF_CACHE_H
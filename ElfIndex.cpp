@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+#include <unwindstack/ElfIndex.h>
+
+namespace unwindstack {
+
+// File layout, all values are in host byte order:
+//   FileHeader
+//   build id, padded to 8 bytes
+//   TableHeader[num_tables]
+//   table data, each one 8 byte aligned
+static constexpr char kMagic[8] = {'U', 'W', 'I', 'N', 'D', 'E', 'X', '\0'};
+static constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_tables;
+  uint64_t build_id_size;
+};
+
+struct TableHeader {
+  uint32_t type;
+  uint32_t scope;
+  uint64_t id;
+  uint64_t offset;
+  uint64_t size;
+};
+
+static uint64_t Align8(uint64_t value) {
+  return (value + 7) & ~static_cast<uint64_t>(7);
+}
+
+ElfIndexFile::~ElfIndexFile() {
+  if (map_ != nullptr) {
+    munmap(map_, size_);
+  }
+}
+
+std::shared_ptr<ElfIndexFile> ElfIndexFile::Open(const std::string& path,
+                                                 const std::string& build_id) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return nullptr;
+  }
+  return Map(fd, build_id);
+}
+
+// True if the contents of fd can no longer change, whoever else holds it.
+static bool IsSealed(int fd) {
+#if defined(F_GET_SEALS)
+  int seals = fcntl(fd, F_GET_SEALS);
+  constexpr int kRequired = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+  return seals != -1 && (seals & kRequired) == kRequired;
+#else
+  (void)fd;
+  return false;
+#endif
+}
+
+std::shared_ptr<ElfIndexFile> ElfIndexFile::OpenFd(int fd, const std::string& build_id) {
+  if (!IsSealed(fd)) {
+    return nullptr;
+  }
+  return Map(fd, build_id);
+}
+
+std::shared_ptr<ElfIndexFile> ElfIndexFile::Map(int fd, const std::string& build_id) {
+  struct stat buf;
+  if (fstat(fd, &buf) == -1 || static_cast<uint64_t>(buf.st_size) < sizeof(FileHeader)) {
+    return nullptr;
+  }
+  void* map = mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+  std::shared_ptr<ElfIndexFile> file(new ElfIndexFile);
+  file->map_ = map;
+  file->size_ = buf.st_size;
+  if (!file->Validate(build_id)) {
+    return nullptr;
+  }
+  return file;
+}
+
+bool ElfIndexFile::Validate(const std::string& build_id) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(map_);
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(data);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+      header->build_id_size != build_id.size()) {
+    return false;
+  }
+  uint64_t tables_offset = Align8(sizeof(FileHeader) + header->build_id_size);
+  uint64_t tables_end = tables_offset + header->num_tables * sizeof(TableHeader);
+  if (tables_end > size_ ||
+      memcmp(&data[sizeof(FileHeader)], build_id.data(), build_id.size()) != 0) {
+    return false;
+  }
+  const TableHeader* tables = reinterpret_cast<const TableHeader*>(&data[tables_offset]);
+  for (uint32_t i = 0; i < header->num_tables; i++) {
+    uint64_t end;
+    if ((tables[i].offset & 7) != 0 || tables[i].offset < tables_end ||
+        __builtin_add_overflow(tables[i].offset, tables[i].size, &end) || end > size_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ElfIndexFile::Find(ElfIndexType type, ElfIndexScope scope, uint64_t id, const void** data,
+                        size_t* size) const {
+  const uint8_t* base = reinterpret_cast<const uint8_t*>(map_);
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+  const TableHeader* tables = reinterpret_cast<const TableHeader*>(
+      &base[Align8(sizeof(FileHeader) + header->build_id_size)]);
+  for (uint32_t i = 0; i < header->num_tables; i++) {
+    if (tables[i].type == type && tables[i].scope == scope && tables[i].id == id) {
+      *data = &base[tables[i].offset];
+      *size = tables[i].size;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ElfIndexWriter::Add(ElfIndexType type, ElfIndexScope scope, uint64_t id, const void* data,
+                         size_t size) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+  tables_.push_back(Table{type, scope, id, std::vector<uint8_t>(bytes, bytes + size)});
+}
+
+void ElfIndexWriter::GetContents(const std::string& build_id, std::vector<uint8_t>* contents) {
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_tables = tables_.size();
+  header.build_id_size = build_id.size();
+
+  contents->assign(Align8(sizeof(header) + build_id.size()), 0);
+  memcpy(contents->data(), &header, sizeof(header));
+  memcpy(&(*contents)[sizeof(header)], build_id.data(), build_id.size());
+
+  uint64_t offset = contents->size() + tables_.size() * sizeof(TableHeader);
+  for (const auto& table : tables_) {
+    TableHeader table_header{table.type, table.scope, table.id, offset, table.data.size()};
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&table_header);
+    contents->insert(contents->end(), bytes, bytes + sizeof(table_header));
+    offset = Align8(offset + table.data.size());
+  }
+  for (const auto& table : tables_) {
+    contents->insert(contents->end(), table.data.begin(), table.data.end());
+    contents->resize(Align8(contents->size()));
+  }
+}
+
+bool ElfIndexWriter::Write(const std::string& path, const std::string& build_id) {
+  std::vector<uint8_t> contents;
+  GetContents(build_id, &contents);
+
+  // A unique name, so that threads and processes writing the same path at
+  // once each rename a complete file of their own.
+  std::string temp_path = path + ".tmp.XXXXXX";
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(mkostemp(&temp_path[0], O_CLOEXEC)));
+  if (fd == -1) {
+    return false;
+  }
+  if (fchmod(fd, 0644) != 0 || !android::base::WriteFully(fd, contents.data(), contents.size()) ||
+      rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+int ElfIndexWriter::WriteToMemfd(const std::string& build_id) {
+#if defined(__NR_memfd_create) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+  std::vector<uint8_t> contents;
+  GetContents(build_id, &contents);
+
+  // Called directly, older libcs do not have a wrapper.
+  android::base::unique_fd fd(static_cast<int>(
+      syscall(__NR_memfd_create, "unwind_index", MFD_CLOEXEC | MFD_ALLOW_SEALING)));
+  if (fd == -1 || !android::base::WriteFully(fd, contents.data(), contents.size())) {
+    return -1;
+  }
+  // Sealed, so that no process it is given to can change the tables under
+  // the others.
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+    return -1;
+  }
+  return fd.release();
+#else
+  (void)build_id;
+  return -1;
+#endif
+}
+
+ElfIndexFdStore::~ElfIndexFdStore() {
+  Clear();
+}
+
+int ElfIndexFdStore::Find(const std::string& build_id) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = fds_.find(build_id);
+  if (entry == fds_.end()) {
+    return -1;
+  }
+  return fcntl(entry->second, F_DUPFD_CLOEXEC, 0);
+}
+
+void ElfIndexFdStore::Add(const std::string& build_id, int fd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  // The first index of a build id wins, processes that already mapped it
+  // keep using it.
+  if (fds_.count(build_id) != 0 || !IsSealed(fd)) {
+    return;
+  }
+  int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd != -1) {
+    fds_.emplace(build_id, dup_fd);
+  }
+}
+
+std::vector<std::string> ElfIndexFdStore::GetBuildIds() {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<std::string> build_ids;
+  for (const auto& entry : fds_) {
+    build_ids.push_back(entry.first);
+  }
+  return build_ids;
+}
+
+void ElfIndexFdStore::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const auto& entry : fds_) {
+    close(entry.second);
+  }
+  fds_.clear();
+}
+
+}  // namespace unwindstack
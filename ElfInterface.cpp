@@ -16,10 +16,14 @@
 
 #include <elf.h>
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfSection.h>
@@ -31,6 +35,9 @@
 #include "DwarfEhFrame.h"
 #include "DwarfEhFrameWithHdr.h"
 #include "MemoryBuffer.h"
+#include "MemoryCompressed.h"
+#include "MemoryRange.h"
+#include "MemoryUsage.h"
 #include "Symbols.h"
 
 namespace unwindstack {
@@ -41,16 +48,127 @@ ElfInterface::~ElfInterface() {
   }
 }
 
+void ElfInterface::GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                                    uint64_t* offsets, bool* found) {
+  for (size_t i = 0; i < count; i++) {
+    if (!found[i]) {
+      found[i] = GetFunctionName(addrs[i], &names[i], &offsets[i]);
+    }
+  }
+}
+
+void ElfInterface::InitSymbols() {
+  std::call_once(symbols_once_, [this]() {
+    for (const SymbolTable& table : symbol_tables_) {
+      Symbols* symbol = new Symbols(table.offset, table.size, table.entry_size, table.str_offset,
+                                    table.str_size);
+      symbol->set_flat_table(flat_symbol_tables_);
+      if (symbols_pending_) {
+        symbol->set_remap_pending();
+      }
+      if (table.hash_size != 0) {
+        symbol->set_hash_table(table.hash_offset, table.hash_size, table.gnu_hash);
+      }
+      if (index_file_ != nullptr) {
+        symbol->LoadIndex(index_file_, index_scope_);
+      }
+      symbols_.push_back(symbol);
+    }
+    index_file_.reset();
+    symbols_initialized_.store(true, std::memory_order_release);
+  });
+}
+
+void ElfInterface::GetMemoryUsage(ElfMemoryUsage* usage) {
+  usage->headers += sizeof(*this) + HashMapMemoryUsage(pt_loads_) +
+                    VectorMemoryUsage(executable_ranges_) + VectorMemoryUsage(symbol_tables_) +
+                    VectorMemoryUsage(strtabs_);
+  if (symbols_initialized_.load(std::memory_order_acquire)) {
+    usage->symbols += VectorMemoryUsage(symbols_);
+    for (auto symbol : symbols_) {
+      usage->symbols += symbol->MemoryUsage();
+    }
+  }
+  if (eh_frame_ != nullptr) {
+    eh_frame_->GetMemoryUsage(usage);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->GetMemoryUsage(usage);
+  }
+  for (const auto& memory : decompressed_sections_) {
+    usage->data += memory->MemoryUsage();
+  }
+}
+
+void ElfInterface::SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope) {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->SaveIndex(writer, scope);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->SaveIndex(writer, scope);
+  }
+}
+
+void ElfInterface::LoadIndex(const std::shared_ptr<ElfIndexFile>& file, ElfIndexScope scope) {
+  if (symbols_initialized_.load(std::memory_order_acquire)) {
+    for (auto symbol : symbols_) {
+      symbol->LoadIndex(file, scope);
+    }
+  } else if (!symbol_tables_.empty()) {
+    // Applied when the symbols are created.
+    index_file_ = file;
+    index_scope_ = scope;
+  }
+  if (eh_frame_ != nullptr) {
+    eh_frame_->LoadIndex(file, scope);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->LoadIndex(file, scope);
+  }
+}
+
+void ElfInterface::ShareIndex(const std::string& build_id, ElfIndexScope scope) {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->ShareIndex(build_id, scope);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->ShareIndex(build_id, scope);
+  }
+}
+
+void ElfInterface::InitExecutableRanges() {
+  executable_ranges_.clear();
+  for (const auto& entry : pt_loads_) {
+    uint64_t start = entry.second.table_offset;
+    uint64_t end;
+    if (__builtin_add_overflow(start, entry.second.table_size, &end)) {
+      end = UINT64_MAX;
+    }
+    executable_ranges_.push_back(PcRange{start, end});
+  }
+  std::sort(executable_ranges_.begin(), executable_ranges_.end(),
+            [](const PcRange& a, const PcRange& b) { return a.start < b.start; });
+  size_t merged = 0;
+  for (const PcRange& range : executable_ranges_) {
+    if (merged != 0 && range.start <= executable_ranges_[merged - 1].end) {
+      executable_ranges_[merged - 1].end = std::max(executable_ranges_[merged - 1].end, range.end);
+    } else {
+      executable_ranges_[merged++] = range;
+    }
+  }
+  executable_ranges_.resize(merged);
+  executable_ranges_.shrink_to_fit();
+}
+
 bool ElfInterface::IsValidPc(uint64_t pc) {
   if (!pt_loads_.empty()) {
-    for (auto& entry : pt_loads_) {
-      uint64_t start = entry.second.table_offset;
-      uint64_t end = start + entry.second.table_size;
-      if (pc >= start && pc < end) {
-        return true;
-      }
+    // Almost every elf has a single executable load.
+    if (executable_ranges_.size() == 1) {
+      return pc >= executable_ranges_[0].start && pc < executable_ranges_[0].end;
     }
-    return false;
+    auto range = std::upper_bound(executable_ranges_.begin(), executable_ranges_.end(), pc,
+                                  [](uint64_t pc, const PcRange& range) { return pc < range.end; });
+    return range != executable_ranges_.end() && pc >= range->start;
   }
 
   // No PT_LOAD data, look for a fde for this pc in the section data.
@@ -74,6 +192,54 @@ bool ElfInterface::GetTextRange(uint64_t* addr, uint64_t* size) {
   return false;
 }
 
+void ElfInterface::SetCompiledUnwindTables(bool enable) {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->set_compiled_unwind_tables(enable);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->set_compiled_unwind_tables(enable);
+  }
+}
+
+void ElfInterface::SetFdeIndexThreads(size_t threads) {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->set_fde_index_threads(threads);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->set_fde_index_threads(threads);
+  }
+}
+
+void ElfInterface::CompileUnwindTables(ArchEnum arch) {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->CompileAllFdes(arch);
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->CompileAllFdes(arch);
+  }
+  if (gnu_debugdata_interface_ != nullptr) {
+    gnu_debugdata_interface_->CompileUnwindTables(arch);
+  }
+}
+
+void ElfInterface::PreloadUnwindInfo() {
+  if (eh_frame_ != nullptr) {
+    eh_frame_->BuildIndex();
+  }
+  if (debug_frame_ != nullptr) {
+    debug_frame_->BuildIndex();
+  }
+}
+
+void ElfInterface::SetFlatSymbolTables(bool enable) {
+  flat_symbol_tables_ = enable;
+  if (symbols_initialized_.load(std::memory_order_acquire)) {
+    for (auto symbol : symbols_) {
+      symbol->set_flat_table(enable);
+    }
+  }
+}
+
 std::unique_ptr<Memory> ElfInterface::CreateGnuDebugdataMemory() {
   return nullptr;
 }
@@ -108,8 +274,10 @@ void ElfInterfaceImpl<ElfTypes>::InitHeaders() {
   }
 
   if (debug_frame_offset_ != 0) {
-    debug_frame_.reset(new DwarfDebugFrame<AddressType>(memory_));
-    if (!debug_frame_->Init(debug_frame_offset_, debug_frame_size_, debug_frame_section_bias_)) {
+    Memory* memory = debug_frame_memory_ != nullptr ? debug_frame_memory_ : memory_;
+    uint64_t offset = debug_frame_memory_ != nullptr ? 0 : debug_frame_offset_;
+    debug_frame_.reset(new DwarfDebugFrame<AddressType>(memory));
+    if (!debug_frame_->Init(offset, debug_frame_size_, debug_frame_section_bias_)) {
       debug_frame_.reset(nullptr);
       debug_frame_offset_ = 0;
       debug_frame_size_ = static_cast<uint64_t>(-1);
@@ -117,6 +285,142 @@ void ElfInterfaceImpl<ElfTypes>::InitHeaders() {
   }
 }
 
+// The largest header table, section name table or note that is copied with
+// a single read, rather than being read one piece at a time.
+static constexpr uint64_t kMaxBulkReadSize = 1024 * 1024;
+
+// Returns the header table in one contiguous buffer, so that the headers can
+// be copied out of it directly. If the memory cannot point at the table, it
+// is copied into buffer with one read. Returns nullptr if that read fails,
+// then the headers have to be read one at a time.
+template <typename HeaderType>
+static const uint8_t* GetHeaderTable(Memory* memory, uint64_t offset, uint64_t count,
+                                     uint64_t entry_size, std::vector<uint8_t>* buffer) {
+  if (entry_size < sizeof(HeaderType)) {
+    return nullptr;
+  }
+  const uint8_t* table = memory->GetTablePointer(offset, count, entry_size);
+  uint64_t size;
+  if (table != nullptr || count == 0 || __builtin_mul_overflow(count, entry_size, &size) ||
+      size > kMaxBulkReadSize) {
+    return table;
+  }
+  buffer->resize(size);
+  if (!memory->ReadFully(offset, buffer->data(), size)) {
+    buffer->clear();
+    return nullptr;
+  }
+  return buffer->data();
+}
+
+template <typename HeaderType>
+static bool ReadHeader(Memory* memory, const uint8_t* table, uint64_t table_offset,
+                       uint64_t offset, HeaderType* header) {
+  if (table != nullptr) {
+    memcpy(header, &table[offset - table_offset], sizeof(HeaderType));
+    return true;
+  }
+  return memory->ReadFully(offset, header, sizeof(HeaderType));
+}
+
+// Same as GetHeaderTable for the section name table. Returns an empty view
+// if the names have to be read one at a time.
+static std::string_view GetSectionNames(Memory* memory, uint64_t offset, uint64_t size,
+                                        std::string* buffer) {
+  if (size == 0) {
+    return std::string_view();
+  }
+  const uint8_t* names = memory->GetPointer(offset, size);
+  if (names != nullptr) {
+    return std::string_view(reinterpret_cast<const char*>(names), size);
+  }
+  if (size > kMaxBulkReadSize) {
+    return std::string_view();
+  }
+  buffer->resize(size);
+  if (!memory->ReadFully(offset, buffer->data(), size)) {
+    buffer->clear();
+    return std::string_view();
+  }
+  return *buffer;
+}
+
+// Gets the name at sh_name in the section name table at names_offset, from
+// names when it is not empty.
+static bool GetSectionName(Memory* memory, std::string_view names, uint64_t names_offset,
+                           uint64_t names_size, uint64_t sh_name, std::string_view* name,
+                           std::string* buffer) {
+  if (sh_name >= names_size) {
+    return false;
+  }
+  if (names.empty()) {
+    if (!memory->ReadString(names_offset + sh_name, buffer, names_size - sh_name)) {
+      return false;
+    }
+    *name = *buffer;
+    return true;
+  }
+  size_t end = names.find('\0', sh_name);
+  if (end == std::string_view::npos) {
+    return false;
+  }
+  *name = names.substr(sh_name, end - sh_name);
+  return true;
+}
+
+// Finds the build id in the note section at note_offset. The whole section
+// is read at once.
+template <typename NhdrType>
+static std::string ReadBuildIDNote(Memory* memory, uint64_t note_offset, uint64_t note_size) {
+  // Ensure there is no overflow in any of the calculations below.
+  uint64_t tmp;
+  if (__builtin_add_overflow(note_offset, note_size, &tmp) || note_size > kMaxBulkReadSize) {
+    return "";
+  }
+  std::string buffer;
+  const uint8_t* note = memory->GetPointer(note_offset, note_size);
+  if (note == nullptr) {
+    buffer.resize(note_size);
+    if (!memory->ReadFully(note_offset, buffer.data(), note_size)) {
+      return "";
+    }
+    note = reinterpret_cast<const uint8_t*>(buffer.data());
+  }
+
+  uint64_t offset = 0;
+  while (offset < note_size) {
+    if (note_size - offset < sizeof(NhdrType)) {
+      return "";
+    }
+    NhdrType hdr;
+    memcpy(&hdr, &note[offset], sizeof(hdr));
+    offset += sizeof(hdr);
+
+    if (note_size - offset < hdr.n_namesz) {
+      return "";
+    }
+    if (hdr.n_namesz > 0) {
+      std::string_view name(reinterpret_cast<const char*>(&note[offset]), hdr.n_namesz);
+
+      // Trim trailing \0 as GNU is stored as a C string in the ELF file.
+      if (name.back() == '\0') name.remove_suffix(1);
+
+      // Align hdr.n_namesz to next power multiple of 4. See man 5 elf.
+      offset += (hdr.n_namesz + 3) & ~3;
+
+      if (name == "GNU" && hdr.n_type == NT_GNU_BUILD_ID) {
+        if (offset > note_size || note_size - offset < hdr.n_descsz || hdr.n_descsz == 0) {
+          return "";
+        }
+        return std::string(reinterpret_cast<const char*>(&note[offset]), hdr.n_descsz);
+      }
+    }
+    // Align hdr.n_descsz to next power multiple of 4. See man 5 elf.
+    offset += (hdr.n_descsz + 3) & ~3;
+  }
+  return "";
+}
+
 template <typename ElfTypes>
 bool ElfInterfaceImpl<ElfTypes>::ReadAllHeaders(int64_t* load_bias) {
   EhdrType ehdr;
@@ -129,6 +433,7 @@ bool ElfInterfaceImpl<ElfTypes>::ReadAllHeaders(int64_t* load_bias) {
   // If we have enough information that this is an elf file, then allow
   // malformed program and section headers.
   ReadProgramHeaders(ehdr, load_bias);
+  InitExecutableRanges();
   ReadSectionHeaders(ehdr);
   return true;
 }
@@ -140,10 +445,13 @@ int64_t ElfInterface::GetLoadBias(Memory* memory) {
     return false;
   }
 
+  std::vector<uint8_t> buffer;
+  const uint8_t* table =
+      GetHeaderTable<PhdrType>(memory, ehdr.e_phoff, ehdr.e_phnum, ehdr.e_phentsize, &buffer);
   uint64_t offset = ehdr.e_phoff;
   for (size_t i = 0; i < ehdr.e_phnum; i++, offset += ehdr.e_phentsize) {
     PhdrType phdr;
-    if (!memory->ReadFully(offset, &phdr, sizeof(phdr))) {
+    if (!ReadHeader(memory, table, ehdr.e_phoff, offset, &phdr)) {
       return 0;
     }
 
@@ -155,13 +463,44 @@ int64_t ElfInterface::GetLoadBias(Memory* memory) {
   return 0;
 }
 
+template <typename EhdrType, typename PhdrType, typename NhdrType>
+bool ElfInterface::ReadLoadedInfo(Memory* memory, std::string* build_id, uint64_t* loaded_size) {
+  EhdrType ehdr;
+  if (!memory->ReadFully(0, &ehdr, sizeof(ehdr))) {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer;
+  const uint8_t* table =
+      GetHeaderTable<PhdrType>(memory, ehdr.e_phoff, ehdr.e_phnum, ehdr.e_phentsize, &buffer);
+  build_id->clear();
+  *loaded_size = 0;
+  uint64_t offset = ehdr.e_phoff;
+  for (size_t i = 0; i < ehdr.e_phnum; i++, offset += ehdr.e_phentsize) {
+    PhdrType phdr;
+    if (!ReadHeader(memory, table, ehdr.e_phoff, offset, &phdr)) {
+      return false;
+    }
+    uint64_t end;
+    if (phdr.p_type == PT_LOAD && !__builtin_add_overflow(phdr.p_offset, phdr.p_filesz, &end)) {
+      *loaded_size = std::max(*loaded_size, end);
+    } else if (phdr.p_type == PT_NOTE && build_id->empty()) {
+      *build_id = ReadBuildIDNote<NhdrType>(memory, phdr.p_offset, phdr.p_filesz);
+    }
+  }
+  return true;
+}
+
 template <typename ElfTypes>
 void ElfInterfaceImpl<ElfTypes>::ReadProgramHeaders(const EhdrType& ehdr, int64_t* load_bias) {
   uint64_t offset = ehdr.e_phoff;
   bool first_exec_load_header = true;
+  std::vector<uint8_t> buffer;
+  const uint8_t* table =
+      GetHeaderTable<PhdrType>(memory_, ehdr.e_phoff, ehdr.e_phnum, ehdr.e_phentsize, &buffer);
   for (size_t i = 0; i < ehdr.e_phnum; i++, offset += ehdr.e_phentsize) {
     PhdrType phdr;
-    if (!memory_->ReadFully(offset, &phdr, sizeof(phdr))) {
+    if (!ReadHeader(memory_, table, ehdr.e_phoff, offset, &phdr)) {
       return;
     }
 
@@ -208,55 +547,9 @@ void ElfInterfaceImpl<ElfTypes>::ReadProgramHeaders(const EhdrType& ehdr, int64_
 
 template <typename ElfTypes>
 std::string ElfInterfaceImpl<ElfTypes>::ReadBuildID() {
-  // Ensure there is no overflow in any of the calulations below.
-  uint64_t tmp;
-  if (__builtin_add_overflow(gnu_build_id_offset_, gnu_build_id_size_, &tmp)) {
-    return "";
-  }
-
-  uint64_t offset = 0;
-  while (offset < gnu_build_id_size_) {
-    if (gnu_build_id_size_ - offset < sizeof(NhdrType)) {
-      return "";
-    }
-    NhdrType hdr;
-    if (!memory_->ReadFully(gnu_build_id_offset_ + offset, &hdr, sizeof(hdr))) {
-      return "";
-    }
-    offset += sizeof(hdr);
-
-    if (gnu_build_id_size_ - offset < hdr.n_namesz) {
-      return "";
-    }
-    if (hdr.n_namesz > 0) {
-      std::string name(hdr.n_namesz, '\0');
-      if (!memory_->ReadFully(gnu_build_id_offset_ + offset, &(name[0]), hdr.n_namesz)) {
-        return "";
-      }
-
-      // Trim trailing \0 as GNU is stored as a C string in the ELF file.
-      if (name.back() == '\0')
-        name.resize(name.size() - 1);
-
-      // Align hdr.n_namesz to next power multiple of 4. See man 5 elf.
-      offset += (hdr.n_namesz + 3) & ~3;
-
-      if (name == "GNU" && hdr.n_type == NT_GNU_BUILD_ID) {
-        if (gnu_build_id_size_ - offset < hdr.n_descsz || hdr.n_descsz == 0) {
-          return "";
-        }
-        std::string build_id(hdr.n_descsz, '\0');
-        if (memory_->ReadFully(gnu_build_id_offset_ + offset, &build_id[0], hdr.n_descsz)) {
-          return build_id;
-        }
-        return "";
-      }
-    }
-    // Align hdr.n_descsz to next power multiple of 4. See man 5 elf.
-    offset += (hdr.n_descsz + 3) & ~3;
-  }
-  return "";
+  return ReadBuildIDNote<NhdrType>(memory_, gnu_build_id_offset_, gnu_build_id_size_);
 }
+
 template <typename ElfTypes>
 void ElfInterfaceImpl<ElfTypes>::ReadSectionHeaders(const EhdrType& ehdr) {
   uint64_t offset = ehdr.e_shoff;
@@ -266,20 +559,38 @@ void ElfInterfaceImpl<ElfTypes>::ReadSectionHeaders(const EhdrType& ehdr) {
   // Get the location of the section header names.
   // If something is malformed in the header table data, we aren't going
   // to terminate, we'll simply ignore this part.
+  std::vector<uint8_t> buffer;
+  const uint8_t* table =
+      GetHeaderTable<ShdrType>(memory_, ehdr.e_shoff, ehdr.e_shnum, ehdr.e_shentsize, &buffer);
   ShdrType shdr;
   if (ehdr.e_shstrndx < ehdr.e_shnum) {
     uint64_t sh_offset = offset + ehdr.e_shstrndx * ehdr.e_shentsize;
-    if (memory_->ReadFully(sh_offset, &shdr, sizeof(shdr))) {
+    if (ReadHeader(memory_, table, ehdr.e_shoff, sh_offset, &shdr)) {
       sec_offset = shdr.sh_offset;
       sec_size = shdr.sh_size;
     }
   }
+  std::string names_buffer;
+  std::string_view names = GetSectionNames(memory_, sec_offset, sec_size, &names_buffer);
+  std::string name_buffer;
+  std::string_view name;
+  // The section index of every entry of symbol_tables_ added here, and the
+  // hash sections, to match them up with their symbol tables at the end.
+  std::vector<size_t> symbol_sections;
+  struct HashSection {
+    uint64_t link;
+    uint64_t offset;
+    uint64_t size;
+    bool gnu;
+  };
+  std::vector<HashSection> hash_sections;
+  size_t first_symbol_table = symbol_tables_.size();
 
   // Skip the first header, it's always going to be NULL.
   offset += ehdr.e_shentsize;
   for (size_t i = 1; i < ehdr.e_shnum; i++, offset += ehdr.e_shentsize) {
-    if (!memory_->ReadFully(offset, &shdr, sizeof(shdr))) {
-      return;
+    if (!ReadHeader(memory_, table, ehdr.e_shoff, offset, &shdr)) {
+      break;
     }
 
     if (shdr.sh_type == SHT_SYMTAB || shdr.sh_type == SHT_DYNSYM) {
@@ -290,20 +601,36 @@ void ElfInterfaceImpl<ElfTypes>::ReadSectionHeaders(const EhdrType& ehdr) {
         continue;
       }
       uint64_t str_offset = ehdr.e_shoff + shdr.sh_link * ehdr.e_shentsize;
-      if (!memory_->ReadFully(str_offset, &str_shdr, sizeof(str_shdr))) {
+      if (!ReadHeader(memory_, table, ehdr.e_shoff, str_offset, &str_shdr)) {
         continue;
       }
       if (str_shdr.sh_type != SHT_STRTAB) {
         continue;
       }
-      symbols_.push_back(new Symbols(shdr.sh_offset, shdr.sh_size, shdr.sh_entsize,
-                                     str_shdr.sh_offset, str_shdr.sh_size));
+      SymbolTable symbol_table{shdr.sh_offset,   shdr.sh_size, shdr.sh_entsize, str_shdr.sh_offset,
+                               str_shdr.sh_size, 0,            0,               false,
+                               nullptr};
+      if (((shdr.sh_flags | str_shdr.sh_flags) & SHF_COMPRESSED) &&
+          !InitCompressedSymbolTable(shdr, str_shdr, &symbol_table)) {
+        continue;
+      }
+      symbol_tables_.push_back(std::move(symbol_table));
+      symbol_sections.push_back(i);
+    } else if (shdr.sh_type == SHT_GNU_HASH || shdr.sh_type == SHT_HASH) {
+      hash_sections.push_back(
+          {shdr.sh_link, shdr.sh_offset, shdr.sh_size, shdr.sh_type == SHT_GNU_HASH});
     } else if ((shdr.sh_type == SHT_PROGBITS || shdr.sh_type == SHT_NOBITS) && sec_size != 0) {
       // Look for the .debug_frame and .gnu_debugdata.
       if (shdr.sh_name < sec_size) {
-        std::string name;
-        if (memory_->ReadString(sec_offset + shdr.sh_name, &name, sec_size - shdr.sh_name)) {
-          if (name == ".debug_frame") {
+        if (GetSectionName(memory_, names, sec_offset, sec_size, shdr.sh_name, &name,
+                           &name_buffer)) {
+          if (name == ".debug_frame" && (shdr.sh_flags & SHF_COMPRESSED)) {
+            debug_frame_memory_ = DecompressSection(shdr, &debug_frame_size_);
+            if (debug_frame_memory_ != nullptr) {
+              debug_frame_offset_ = shdr.sh_offset;
+              debug_frame_section_bias_ = shdr.sh_addr;
+            }
+          } else if (name == ".debug_frame") {
             debug_frame_offset_ = shdr.sh_offset;
             debug_frame_size_ = shdr.sh_size;
             debug_frame_section_bias_ = static_cast<uint64_t>(shdr.sh_addr) - shdr.sh_offset;
@@ -338,8 +665,8 @@ void ElfInterfaceImpl<ElfTypes>::ReadSectionHeaders(const EhdrType& ehdr) {
                                                             static_cast<uint64_t>(shdr.sh_offset)));
     } else if (shdr.sh_type == SHT_NOTE) {
       if (shdr.sh_name < sec_size) {
-        std::string name;
-        if (memory_->ReadString(sec_offset + shdr.sh_name, &name, sec_size - shdr.sh_name) &&
+        if (GetSectionName(memory_, names, sec_offset, sec_size, shdr.sh_name, &name,
+                           &name_buffer) &&
             name == ".note.gnu.build-id") {
           gnu_build_id_offset_ = shdr.sh_offset;
           gnu_build_id_size_ = shdr.sh_size;
@@ -347,6 +674,66 @@ void ElfInterfaceImpl<ElfTypes>::ReadSectionHeaders(const EhdrType& ehdr) {
       }
     }
   }
+
+  // The global variable lookups use the hash of a table, .gnu.hash when
+  // there are both.
+  for (const HashSection& hash : hash_sections) {
+    for (size_t i = 0; i < symbol_sections.size(); i++) {
+      SymbolTable& symbol_table = symbol_tables_[first_symbol_table + i];
+      if (symbol_sections[i] == hash.link &&
+          (symbol_table.hash_size == 0 || (hash.gnu && !symbol_table.gnu_hash))) {
+        symbol_table.hash_offset = hash.offset;
+        symbol_table.hash_size = hash.size;
+        symbol_table.gnu_hash = hash.gnu;
+      }
+    }
+  }
+}
+
+template <typename ElfTypes>
+Memory* ElfInterfaceImpl<ElfTypes>::DecompressSection(const ShdrType& shdr, uint64_t* size) {
+  ChdrType chdr;
+  if (shdr.sh_size < sizeof(chdr) || !memory_->ReadFully(shdr.sh_offset, &chdr, sizeof(chdr)) ||
+      chdr.ch_type != ELFCOMPRESS_ZLIB) {
+    return nullptr;
+  }
+  std::shared_ptr<MemoryCompressed> memory(new MemoryCompressed(
+      memory_, shdr.sh_offset + sizeof(chdr), shdr.sh_size - sizeof(chdr), chdr.ch_size));
+  if (!memory->Init()) {
+    return nullptr;
+  }
+  decompressed_sections_.push_back(memory);
+  *size = chdr.ch_size;
+  return memory.get();
+}
+
+template <typename ElfTypes>
+bool ElfInterfaceImpl<ElfTypes>::InitCompressedSymbolTable(const ShdrType& shdr,
+                                                           const ShdrType& str_shdr,
+                                                           SymbolTable* table) {
+  // The elf memory is not owned by the ranges.
+  std::shared_ptr<Memory> elf_memory(std::shared_ptr<Memory>(), memory_);
+  std::shared_ptr<MemoryRanges> ranges(new MemoryRanges);
+  auto add_section = [this, &elf_memory, &ranges](const ShdrType& section, uint64_t offset,
+                                                  uint64_t* size) {
+    if (!(section.sh_flags & SHF_COMPRESSED)) {
+      *size = section.sh_size;
+      ranges->Insert(new MemoryRange(elf_memory, section.sh_offset, *size, offset));
+      return true;
+    }
+    if (DecompressSection(section, size) == nullptr) {
+      return false;
+    }
+    ranges->Insert(new MemoryRange(decompressed_sections_.back(), 0, *size, offset));
+    return true;
+  };
+  if (!add_section(shdr, shdr.sh_offset, &table->size) ||
+      __builtin_add_overflow(shdr.sh_offset, table->size, &table->str_offset) ||
+      !add_section(str_shdr, table->str_offset, &table->str_size)) {
+    return false;
+  }
+  table->memory = std::move(ranges);
+  return true;
 }
 
 template <typename ElfTypes>
@@ -364,12 +751,19 @@ std::string ElfInterfaceImpl<ElfTypes>::GetSoname() {
   uint64_t strtab_addr = 0;
   uint64_t strtab_size = 0;
 
-  // Find the soname location from the dynamic headers section.
+  // Find the soname location from the dynamic headers section. Read as
+  // much of the section as possible at once, an entry that is not in the
+  // read part is read on its own, to report the error.
   DynType dyn;
   uint64_t offset = dynamic_offset_;
   uint64_t max_offset = offset + dynamic_vaddr_end_ - dynamic_vaddr_start_;
+  std::vector<uint8_t> buffer(
+      max_offset > offset ? std::min(max_offset - offset, kMaxBulkReadSize) : 0);
+  size_t bytes = buffer.empty() ? 0 : memory_->Read(offset, buffer.data(), buffer.size());
   for (uint64_t offset = dynamic_offset_; offset < max_offset; offset += sizeof(DynType)) {
-    if (!memory_->ReadFully(offset, &dyn, sizeof(dyn))) {
+    if (offset - dynamic_offset_ + sizeof(dyn) <= bytes) {
+      memcpy(&dyn, &buffer[offset - dynamic_offset_], sizeof(dyn));
+    } else if (!memory_->ReadFully(offset, &dyn, sizeof(dyn))) {
       last_error_.code = ERROR_MEMORY_INVALID;
       last_error_.address = offset;
       return "";
@@ -407,55 +801,236 @@ std::string ElfInterfaceImpl<ElfTypes>::GetSoname() {
 template <typename ElfTypes>
 bool ElfInterfaceImpl<ElfTypes>::GetFunctionName(uint64_t addr, SharedString* name,
                                                  uint64_t* func_offset) {
-  if (symbols_.empty()) {
+  if (symbol_tables_.empty()) {
     return false;
   }
+  InitSymbols();
+
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    if (symbol->template GetName<SymType>(addr, symbol_memory(i), name, func_offset)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  for (const auto symbol : symbols_) {
-    if (symbol->template GetName<SymType>(addr, memory_, name, func_offset)) {
+template <typename ElfTypes>
+bool ElfInterfaceImpl<ElfTypes>::GetFunctionNameView(uint64_t addr, std::string_view* name,
+                                                     uint64_t* func_offset) {
+  if (symbol_tables_.empty()) {
+    return false;
+  }
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    if (symbol->template GetNameView<SymType>(addr, symbol_memory(i), name, func_offset)) {
       return true;
     }
   }
   return false;
 }
 
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::GetFunctionNames(const uint64_t* addrs, size_t count,
+                                                  SharedString* names, uint64_t* offsets,
+                                                  bool* found) {
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    symbol->template GetNames<SymType>(addrs, count, symbol_memory(i), names, offsets, found);
+  }
+}
+
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope) {
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    symbol->template SaveIndex<SymType>(symbol_memory(i), writer, scope);
+  }
+  ElfInterface::SaveIndex(writer, scope);
+}
+
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::PreloadSymbols() {
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    symbol->template BuildIndex<SymType>(symbol_memory(i));
+  }
+}
+
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::BuildSymbolsInBackground() {
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    symbol->template BuildIndexInBackground<SymType>(symbol_memory(i));
+  }
+}
+
+template <typename ElfTypes>
+void ElfInterfaceImpl<ElfTypes>::GetFunctionSymbols(std::vector<FunctionSymbol>* functions) {
+  InitSymbols();
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    symbols_[i]->template GetFunctions<SymType>(symbol_memory(i), i, functions);
+  }
+}
+
+template <typename ElfTypes>
+bool ElfInterfaceImpl<ElfTypes>::GetFunctionSymbolName(uint32_t table, uint32_t name_offset,
+                                                       SharedString* name) {
+  InitSymbols();
+  return table < symbols_.size() &&
+         symbols_[table]->ReadName(name_offset, symbol_memory(table), name);
+}
+
 template <typename ElfTypes>
 bool ElfInterfaceImpl<ElfTypes>::GetGlobalVariable(const std::string& name,
                                                    uint64_t* memory_address) {
-  if (symbols_.empty()) {
+  if (symbol_tables_.empty()) {
     return false;
   }
+  InitSymbols();
 
-  for (const auto symbol : symbols_) {
-    if (symbol->template GetGlobal<SymType>(memory_, name, memory_address)) {
+  for (size_t i = 0; i < symbols_.size(); i++) {
+    Symbols* symbol = symbols_[i];
+    if (symbol->template GetGlobal<SymType>(symbol_memory(i), name, memory_address)) {
       return true;
     }
   }
   return false;
 }
 
+bool ElfInterface::StepFromCache(uint64_t pc, Regs* regs, Memory* process_memory,
+                                 bool* finished, bool* is_signal_frame) {
+  // Step always tries the debug_frame first, so only use the eh_frame rows
+  // when there is no debug_frame, or Step found the pc in the eh_frame.
+  DwarfSection* section = debug_frame_ != nullptr ? debug_frame_.get() : eh_frame_.get();
+  uint8_t source;
+  if (unwind_sources_.Find(pc, &source)) {
+    switch (source) {
+      case UNWIND_SOURCE_EH_FRAME:
+        section = eh_frame_.get();
+        break;
+      case UNWIND_SOURCE_GNU_DEBUGDATA:
+        return gnu_debugdata_interface_->StepFromCache(pc, regs, process_memory, finished,
+                                                       is_signal_frame);
+      case UNWIND_SOURCE_NONE:
+        return false;
+    }
+  }
+  return section != nullptr &&
+         section->StepFromCache(pc, regs, process_memory, finished, is_signal_frame);
+}
+
+bool ElfInterface::PinRow(uint64_t pc) {
+  DwarfSection* section = debug_frame_ != nullptr ? debug_frame_.get() : eh_frame_.get();
+  return section != nullptr && section->PinRow(pc);
+}
+
+bool ElfInterface::StepCompiled(uint64_t pc, Regs* regs, Memory* process_memory,
+                                bool* finished, bool* is_signal_frame) {
+  if (debug_frame_ != nullptr &&
+      debug_frame_->StepCompiled(pc, regs, process_memory, finished, is_signal_frame)) {
+    return true;
+  }
+  if (eh_frame_ != nullptr &&
+      eh_frame_->StepCompiled(pc, regs, process_memory, finished, is_signal_frame)) {
+    return true;
+  }
+  return gnu_debugdata_interface_ != nullptr &&
+         gnu_debugdata_interface_->StepCompiled(pc, regs, process_memory, finished,
+                                                is_signal_frame);
+}
+
+FramePointerRule ElfInterface::GetFramePointerRule(uint64_t pc, ArchEnum arch,
+                                                   std::unique_lock<std::mutex>* lock) {
+  FramePointerRule rule = FRAME_POINTER_UNKNOWN;
+  if (debug_frame_ != nullptr) {
+    rule = debug_frame_->GetFramePointerRule(pc, arch, lock);
+  }
+  if (rule == FRAME_POINTER_UNKNOWN && eh_frame_ != nullptr) {
+    rule = eh_frame_->GetFramePointerRule(pc, arch, lock);
+  }
+  if (rule == FRAME_POINTER_UNKNOWN && gnu_debugdata_interface_ != nullptr) {
+    rule = gnu_debugdata_interface_->GetFramePointerRule(pc, arch, lock);
+  }
+  return rule;
+}
+
+bool ElfInterface::GetCachedFramePointerRule(uint64_t pc, ArchEnum arch,
+                                             FramePointerRule* rule) {
+  // A published fde of the eh_frame is only used when there is no
+  // debug_frame, or Step found the pc in the eh_frame, the same as
+  // StepFromCache.
+  DwarfSection* section = debug_frame_ != nullptr ? debug_frame_.get() : eh_frame_.get();
+  uint8_t source;
+  if (unwind_sources_.Find(pc, &source)) {
+    switch (source) {
+      case UNWIND_SOURCE_EH_FRAME:
+        section = eh_frame_.get();
+        break;
+      case UNWIND_SOURCE_GNU_DEBUGDATA:
+        return gnu_debugdata_interface_->GetCachedFramePointerRule(pc, arch, rule);
+      case UNWIND_SOURCE_NONE:
+        return false;
+    }
+  }
+  return section != nullptr && section->GetCachedFramePointerRule(pc, arch, rule);
+}
+
+bool ElfInterface::HasFde(uint64_t pc) {
+  return (debug_frame_ != nullptr && debug_frame_->GetFdeFromPc(pc) != nullptr) ||
+         (eh_frame_ != nullptr && eh_frame_->GetFdeFromPc(pc) != nullptr) ||
+         (gnu_debugdata_interface_ != nullptr && gnu_debugdata_interface_->HasFde(pc));
+}
+
+bool ElfInterface::StepSource(uint8_t source, uint64_t pc, Regs* regs, Memory* process_memory,
+                              bool* finished, bool* is_signal_frame) {
+  switch (source) {
+    case UNWIND_SOURCE_DEBUG_FRAME:
+      return debug_frame_ != nullptr &&
+             debug_frame_->Step(pc, regs, process_memory, finished, is_signal_frame);
+    case UNWIND_SOURCE_EH_FRAME:
+      return eh_frame_ != nullptr &&
+             eh_frame_->Step(pc, regs, process_memory, finished, is_signal_frame);
+    case UNWIND_SOURCE_GNU_DEBUGDATA:
+      return gnu_debugdata_interface_ != nullptr &&
+             gnu_debugdata_interface_->Step(pc, regs, process_memory, finished, is_signal_frame);
+    default:
+      return false;
+  }
+}
+
 bool ElfInterface::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
                         bool* is_signal_frame) {
   last_error_.code = ERROR_NONE;
   last_error_.address = 0;
 
-  // Try the debug_frame first since it contains the most specific unwind
-  // information.
-  DwarfSection* debug_frame = debug_frame_.get();
-  if (debug_frame != nullptr &&
-      debug_frame->Step(pc, regs, process_memory, finished, is_signal_frame)) {
-    return true;
-  }
-
-  // Try the eh_frame next.
-  DwarfSection* eh_frame = eh_frame_.get();
-  if (eh_frame != nullptr && eh_frame->Step(pc, regs, process_memory, finished, is_signal_frame)) {
-    return true;
+  // A pc seen before is only searched for in the section that unwound it,
+  // or not at all if no section has an fde for it.
+  uint8_t source = 0;
+  if (unwind_sources_.Find(pc, &source)) {
+    if (source == UNWIND_SOURCE_NONE) {
+      last_error_.code = ERROR_UNWIND_INFO;
+      return false;
+    }
+    if (StepSource(source, pc, regs, process_memory, finished, is_signal_frame)) {
+      return true;
+    }
   }
 
-  if (gnu_debugdata_interface_ != nullptr &&
-      gnu_debugdata_interface_->Step(pc, regs, process_memory, finished, is_signal_frame)) {
-    return true;
+  // Try the debug_frame first since it contains the most specific unwind
+  // information, then the eh_frame, then the gnu_debugdata. A section that
+  // already failed above is not tried again.
+  for (uint8_t next : {UNWIND_SOURCE_DEBUG_FRAME, UNWIND_SOURCE_EH_FRAME,
+                       UNWIND_SOURCE_GNU_DEBUGDATA}) {
+    if (next != source && StepSource(next, pc, regs, process_memory, finished, is_signal_frame)) {
+      unwind_sources_.Set(pc, next);
+      return true;
+    }
   }
 
   // Set the error code based on the first error encountered.
@@ -466,6 +1041,7 @@ bool ElfInterface::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
     section = eh_frame_.get();
   } else if (gnu_debugdata_interface_ != nullptr) {
     last_error_ = gnu_debugdata_interface_->last_error();
+    SetNoUnwindSource(pc);
     return false;
   } else {
     return false;
@@ -497,9 +1073,17 @@ bool ElfInterface::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
       last_error_.code = ERROR_UNSUPPORTED;
       break;
   }
+  SetNoUnwindSource(pc);
   return false;
 }
 
+void ElfInterface::SetNoUnwindSource(uint64_t pc) {
+  // Only a missing fde is remembered, other errors can depend on the regs.
+  if (last_error_.code == ERROR_UNWIND_INFO && !HasFde(pc)) {
+    unwind_sources_.Set(pc, UNWIND_SOURCE_NONE);
+  }
+}
+
 // This is an estimation of the size of the elf file using the location
 // of the section headers and size. This assumes that the section headers
 // are at the end of the elf file. If the elf has a load bias, the size
@@ -531,22 +1115,28 @@ bool GetBuildIDInfo(Memory* memory, uint64_t* build_id_offset, uint64_t* build_i
     return false;
   }
 
+  std::vector<uint8_t> buffer;
+  const uint8_t* table =
+      GetHeaderTable<ShdrType>(memory, ehdr.e_shoff, ehdr.e_shnum, ehdr.e_shentsize, &buffer);
   uint64_t sh_offset = offset + ehdr.e_shstrndx * ehdr.e_shentsize;
-  if (!memory->ReadFully(sh_offset, &shdr, sizeof(shdr))) {
+  if (!ReadHeader(memory, table, ehdr.e_shoff, sh_offset, &shdr)) {
     return false;
   }
   sec_offset = shdr.sh_offset;
   sec_size = shdr.sh_size;
+  std::string names_buffer;
+  std::string_view names = GetSectionNames(memory, sec_offset, sec_size, &names_buffer);
+  std::string name_buffer;
+  std::string_view name;
 
   // Skip the first header, it's always going to be NULL.
   offset += ehdr.e_shentsize;
   for (size_t i = 1; i < ehdr.e_shnum; i++, offset += ehdr.e_shentsize) {
-    if (!memory->ReadFully(offset, &shdr, sizeof(shdr))) {
+    if (!ReadHeader(memory, table, ehdr.e_shoff, offset, &shdr)) {
       return false;
     }
-    std::string name;
-    if (shdr.sh_type == SHT_NOTE && shdr.sh_name < sec_size &&
-        memory->ReadString(sec_offset + shdr.sh_name, &name, sec_size - shdr.sh_name) &&
+    if (shdr.sh_type == SHT_NOTE &&
+        GetSectionName(memory, names, sec_offset, sec_size, shdr.sh_name, &name, &name_buffer) &&
         name == ".note.gnu.build-id") {
       *build_id_offset = shdr.sh_offset;
       *build_id_size = shdr.sh_size;
@@ -565,53 +1155,7 @@ std::string ElfInterface::ReadBuildIDFromMemory(Memory* memory) {
     return "";
   }
 
-  // Ensure there is no overflow in any of the calculations below.
-  uint64_t tmp;
-  if (__builtin_add_overflow(note_offset, note_size, &tmp)) {
-    return "";
-  }
-
-  uint64_t offset = 0;
-  while (offset < note_size) {
-    if (note_size - offset < sizeof(NhdrType)) {
-      return "";
-    }
-    NhdrType hdr;
-    if (!memory->ReadFully(note_offset + offset, &hdr, sizeof(hdr))) {
-      return "";
-    }
-    offset += sizeof(hdr);
-
-    if (note_size - offset < hdr.n_namesz) {
-      return "";
-    }
-    if (hdr.n_namesz > 0) {
-      std::string name(hdr.n_namesz, '\0');
-      if (!memory->ReadFully(note_offset + offset, &(name[0]), hdr.n_namesz)) {
-        return "";
-      }
-
-      // Trim trailing \0 as GNU is stored as a C string in the ELF file.
-      if (name.back() == '\0') name.resize(name.size() - 1);
-
-      // Align hdr.n_namesz to next power multiple of 4. See man 5 elf.
-      offset += (hdr.n_namesz + 3) & ~3;
-
-      if (name == "GNU" && hdr.n_type == NT_GNU_BUILD_ID) {
-        if (note_size - offset < hdr.n_descsz || hdr.n_descsz == 0) {
-          return "";
-        }
-        std::string build_id(hdr.n_descsz, '\0');
-        if (memory->ReadFully(note_offset + offset, &build_id[0], hdr.n_descsz)) {
-          return build_id;
-        }
-        return "";
-      }
-    }
-    // Align hdr.n_descsz to next power multiple of 4. See man 5 elf.
-    offset += (hdr.n_descsz + 3) & ~3;
-  }
-  return "";
+  return ReadBuildIDNote<NhdrType>(memory, note_offset, note_size);
 }
 
 // Instantiate all of the needed template functions.
@@ -626,4 +1170,11 @@ template std::string ElfInterface::ReadBuildIDFromMemory<Elf32_Ehdr, Elf32_Shdr,
 template std::string ElfInterface::ReadBuildIDFromMemory<Elf64_Ehdr, Elf64_Shdr, Elf64_Nhdr>(
     Memory*);
 
+template bool ElfInterface::ReadLoadedInfo<Elf32_Ehdr, Elf32_Phdr, Elf32_Nhdr>(Memory*,
+                                                                               std::string*,
+                                                                               uint64_t*);
+template bool ElfInterface::ReadLoadedInfo<Elf64_Ehdr, Elf64_Phdr, Elf64_Nhdr>(Memory*,
+                                                                               std::string*,
+                                                                               uint64_t*);
+
 }  // namespace unwindstack
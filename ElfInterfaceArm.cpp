@@ -17,6 +17,11 @@
 #include <elf.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/RegsArm.h>
@@ -34,35 +39,94 @@ bool ElfInterfaceArm::Init(int64_t* load_bias) {
   return true;
 }
 
+bool ElfInterfaceArm::BuildTable() {
+  if (table_state_ != TABLE_NOT_BUILT) {
+    return table_state_ == TABLE_BUILT;
+  }
+  table_state_ = TABLE_UNAVAILABLE;
+
+  std::vector<uint32_t> raw(total_entries_ * 2);
+  if (raw.empty() || !memory_->ReadFully(start_offset_, raw.data(), raw.size() * 4)) {
+    return false;
+  }
+
+  table_.resize(total_entries_);
+  std::unordered_map<std::string, uint32_t> programs;
+  ArmExidx arm(nullptr, memory_, nullptr);
+  for (size_t i = 0; i < total_entries_; i++) {
+    uint32_t entry_offset = start_offset_ + i * 8;
+    TableEntry& entry = table_[i];
+    // Sign extend the value if necessary.
+    entry.addr = entry_offset + ((static_cast<int32_t>(raw[i * 2]) << 1) >> 1);
+
+    if (raw[i * 2 + 1] == 1) {
+      entry.program = kProgramCantUnwind;
+    } else if (arm.ExtractEntryData(entry_offset)) {
+      std::string key(reinterpret_cast<const char*>(arm.data()), arm.data_size());
+      auto [iter, inserted] = programs.try_emplace(
+          key, program_data_.size() << kProgramOffsetShift | arm.data_size());
+      if (inserted) {
+        program_data_.insert(program_data_.end(), arm.data(), arm.data() + arm.data_size());
+      }
+      entry.program = iter->second;
+    } else if (arm.status() == ARM_STATUS_NO_UNWIND) {
+      entry.program = kProgramCantUnwind;
+    } else {
+      // Decoded again by the step, so that it reports the error.
+      entry.program = kProgramNotDecoded;
+    }
+  }
+  program_data_.shrink_to_fit();
+  table_state_ = TABLE_BUILT;
+  return true;
+}
+
+bool ElfInterfaceArm::GetEntryAddr(size_t index, uint32_t* addr) {
+  if (BuildTable()) {
+    *addr = table_[index].addr;
+    return true;
+  }
+  return GetPrel31Addr(start_offset_ + index * 8, addr);
+}
+
 bool ElfInterfaceArm::FindEntry(uint32_t pc, uint64_t* entry_offset) {
+  size_t index;
+  if (!FindEntryIndex(pc, &index)) {
+    return false;
+  }
+  *entry_offset = start_offset_ + index * 8;
+  return true;
+}
+
+bool ElfInterfaceArm::FindEntryIndex(uint32_t pc, size_t* index) {
   if (start_offset_ == 0 || total_entries_ == 0) {
     last_error_.code = ERROR_UNWIND_INFO;
     return false;
   }
 
-  size_t first = 0;
-  size_t last = total_entries_;
-  while (first < last) {
-    size_t current = (first + last) / 2;
-    uint32_t addr = addrs_[current];
-    if (addr == 0) {
+  size_t last;
+  if (BuildTable()) {
+    auto iter = std::upper_bound(table_.begin(), table_.end(), pc,
+                                 [](uint32_t pc, const TableEntry& entry) { return pc < entry.addr; });
+    last = iter - table_.begin();
+  } else {
+    size_t first = 0;
+    last = total_entries_;
+    while (first < last) {
+      size_t current = (first + last) / 2;
+      uint32_t addr;
       if (!GetPrel31Addr(start_offset_ + current * 8, &addr)) {
         return false;
       }
-      addrs_[current] = addr;
-    }
-    if (pc == addr) {
-      *entry_offset = start_offset_ + current * 8;
-      return true;
-    }
-    if (pc < addr) {
-      last = current;
-    } else {
-      first = current + 1;
+      if (pc < addr) {
+        last = current;
+      } else {
+        first = current + 1;
+      }
     }
   }
   if (last != 0) {
-    *entry_offset = start_offset_ + (last - 1) * 8;
+    *index = last - 1;
     return true;
   }
   last_error_.code = ERROR_UNWIND_INFO;
@@ -119,15 +183,28 @@ bool ElfInterfaceArm::StepExidx(uint64_t pc, Regs* regs, Memory* process_memory,
   pc -= load_bias_;
 
   RegsArm* regs_arm = reinterpret_cast<RegsArm*>(regs);
-  uint64_t entry_offset;
-  if (!FindEntry(pc, &entry_offset)) {
+  size_t index;
+  if (!FindEntryIndex(pc, &index)) {
     return false;
   }
 
+  uint32_t program = table_state_ == TABLE_BUILT ? table_[index].program : kProgramNotDecoded;
+  if (program == kProgramCantUnwind) {
+    *finished = true;
+    return true;
+  }
+
   ArmExidx arm(regs_arm, memory_, process_memory);
   arm.set_cfa(regs_arm->sp());
+  bool extracted;
+  if (program != kProgramNotDecoded) {
+    arm.SetData(&program_data_[program >> kProgramOffsetShift], program & kProgramSizeMask);
+    extracted = true;
+  } else {
+    extracted = arm.ExtractEntryData(start_offset_ + index * 8);
+  }
   bool return_value = false;
-  if (arm.ExtractEntryData(entry_offset) && arm.Eval()) {
+  if (extracted && arm.Eval()) {
     // If the pc was not set, then use the LR registers for the PC.
     if (!arm.pc_set()) {
       (*regs_arm)[ARM_REG_PC] = (*regs_arm)[ARM_REG_LR];
@@ -170,6 +247,18 @@ bool ElfInterfaceArm::StepExidx(uint64_t pc, Regs* regs, Memory* process_memory,
   return return_value;
 }
 
+void ElfInterfaceArm::PreloadUnwindInfo() {
+  ElfInterface32::PreloadUnwindInfo();
+  if (start_offset_ != 0 && total_entries_ != 0) {
+    BuildTable();
+  }
+}
+
+void ElfInterfaceArm::GetMemoryUsage(ElfMemoryUsage* usage) {
+  ElfInterface32::GetMemoryUsage(usage);
+  usage->unwind_index += table_.capacity() * sizeof(TableEntry) + program_data_.capacity();
+}
+
 bool ElfInterfaceArm::GetFunctionName(uint64_t addr, SharedString* name, uint64_t* offset) {
   // For ARM, thumb function symbols have bit 0 set, but the address passed
   // in here might not have this bit set and result in a failure to find
@@ -182,4 +271,31 @@ bool ElfInterfaceArm::GetFunctionName(uint64_t addr, SharedString* name, uint64_
   return false;
 }
 
+bool ElfInterfaceArm::GetFunctionNameView(uint64_t addr, std::string_view* name,
+                                          uint64_t* offset) {
+  // See GetFunctionName for why bit 0 is set.
+  if (ElfInterface32::GetFunctionNameView(addr | 1, name, offset)) {
+    *offset &= ~1;
+    return true;
+  }
+  return false;
+}
+
+void ElfInterfaceArm::GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                                       uint64_t* offsets, bool* found) {
+  // See GetFunctionName for why bit 0 is set, setting it keeps the
+  // addresses sorted.
+  std::vector<uint64_t> thumb_addrs(addrs, addrs + count);
+  std::vector<bool> found_before(found, found + count);
+  for (uint64_t& addr : thumb_addrs) {
+    addr |= 1;
+  }
+  ElfInterface32::GetFunctionNames(thumb_addrs.data(), count, names, offsets, found);
+  for (size_t i = 0; i < count; i++) {
+    if (found[i] && !found_before[i]) {
+      offsets[i] &= ~1;
+    }
+  }
+}
+
 }  // namespace unwindstack
@@ -21,7 +21,7 @@
 #include <stdint.h>
 
 #include <iterator>
-#include <unordered_map>
+#include <vector>
 
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
@@ -46,12 +46,9 @@ class ElfInterfaceArm : public ElfInterface32 {
     bool operator!=(const iterator& rhs) { return this->index_ != rhs.index_; }
 
     uint32_t operator*() {
-      uint32_t addr = interface_->addrs_[index_];
-      if (addr == 0) {
-        if (!interface_->GetPrel31Addr(interface_->start_offset_ + index_ * 8, &addr)) {
-          return 0;
-        }
-        interface_->addrs_[index_] = addr;
+      uint32_t addr;
+      if (!interface_->GetEntryAddr(index_, &addr)) {
+        return 0;
       }
       return addr;
     }
@@ -68,8 +65,12 @@ class ElfInterfaceArm : public ElfInterface32 {
 
   bool GetPrel31Addr(uint32_t offset, uint32_t* addr);
 
+  bool GetEntryAddr(size_t index, uint32_t* addr);
+
   bool FindEntry(uint32_t pc, uint64_t* entry_offset);
 
+  bool FindEntryIndex(uint32_t pc, size_t* index);
+
   void HandleUnknownType(uint32_t type, uint64_t ph_offset, uint64_t ph_filesz) override;
 
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
@@ -79,6 +80,15 @@ class ElfInterfaceArm : public ElfInterface32 {
 
   bool GetFunctionName(uint64_t addr, SharedString* name, uint64_t* offset) override;
 
+  bool GetFunctionNameView(uint64_t addr, std::string_view* name, uint64_t* offset) override;
+
+  void GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                        uint64_t* offsets, bool* found) override;
+
+  void PreloadUnwindInfo() override;
+
+  void GetMemoryUsage(ElfMemoryUsage* usage) override;
+
   uint64_t start_offset() { return start_offset_; }
 
   size_t total_entries() { return total_entries_; }
@@ -86,11 +96,37 @@ class ElfInterfaceArm : public ElfInterface32 {
   void set_load_bias(uint64_t load_bias) { load_bias_ = load_bias; }
 
  protected:
+  // Decodes the whole table the first time it is used: the start address
+  // of every entry and its opcodes, with identical opcodes stored once.
+  // If the table cannot be read in one go, every lookup reads the entries
+  // it needs instead.
+  bool BuildTable();
+
+  // The opcodes of an entry are program & kProgramSizeMask bytes at
+  // program >> kProgramOffsetShift in program_data_.
+  static constexpr uint32_t kProgramOffsetShift = 5;
+  static constexpr uint32_t kProgramSizeMask = (1 << kProgramOffsetShift) - 1;
+  static constexpr uint32_t kProgramNotDecoded = UINT32_MAX;
+  static constexpr uint32_t kProgramCantUnwind = UINT32_MAX - 1;
+
+  struct TableEntry {
+    uint32_t addr;
+    uint32_t program;
+  };
+
+  enum TableState : uint8_t {
+    TABLE_NOT_BUILT,
+    TABLE_BUILT,
+    TABLE_UNAVAILABLE,
+  };
+
   uint64_t start_offset_ = 0;
   size_t total_entries_ = 0;
   uint64_t load_bias_ = 0;
 
-  std::unordered_map<size_t, uint32_t> addrs_;
+  TableState table_state_ = TABLE_NOT_BUILT;
+  std::vector<TableEntry> table_;
+  std::vector<uint8_t> program_data_;
 };
 
 }  // namespace unwindstack
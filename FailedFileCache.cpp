@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <unwindstack/MapInfo.h>
+
+#include "FailedFileCache.h"
+
+namespace unwindstack {
+
+size_t FailedFileCache::KeyHash::operator()(const Key& key) const {
+  uint64_t hash = std::hash<std::string_view>()(key.name);
+  hash ^= key.file.offset + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+  hash ^= key.file.ino + (hash << 6) + (hash >> 2);
+  hash ^= key.file.map_size + (hash << 6) + (hash >> 2);
+  hash ^= static_cast<uint64_t>(key.file.mtime_nsec) + (hash << 6) + (hash >> 2);
+  return static_cast<size_t>(hash);
+}
+
+void FailedFileCache::GetKey(const MapInfo* info, Key* key) {
+  key->name = info->name;
+  // A deleted file, or one that cannot be looked at, gets no identity.
+  if (!FileInfoCache::GetKey(info, &key->file)) {
+    key->file = FileInfoCache::Key{};
+    key->file.offset = info->offset;
+    key->file.map_size = info->end - info->start;
+  }
+}
+
+void FailedFileCache::SetTtl(std::chrono::milliseconds ttl) {
+  std::lock_guard<std::mutex> guard(lock_);
+  ttl_ = ttl;
+}
+
+FailedFileCache::Failure FailedFileCache::Find(const MapInfo* info, uint64_t* elf_offset,
+                                               uint64_t* elf_start_offset) {
+  Key key;
+  GetKey(info, &key);
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    return FAILURE_NONE;
+  }
+  if (std::chrono::steady_clock::now() - entry->second.time >= ttl_) {
+    entries_.erase(entry);
+    return FAILURE_NONE;
+  }
+  *elf_offset = entry->second.elf_offset;
+  *elf_start_offset = entry->second.elf_start_offset;
+  return entry->second.failure;
+}
+
+void FailedFileCache::Add(const MapInfo* info, Failure failure) {
+  Key key;
+  GetKey(info, &key);
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> guard(lock_);
+  if (entries_.size() >= kMaxEntries) {
+    // Drop the expired entries, and everything if that is not enough.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      it = now - it->second.time >= ttl_ ? entries_.erase(it) : std::next(it);
+    }
+    if (entries_.size() >= kMaxEntries) {
+      entries_.clear();
+    }
+  }
+  entries_[std::move(key)] = Entry{failure, info->elf_offset, info->elf_start_offset, now};
+}
+
+void FailedFileCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+}
+
+}  // namespace unwindstack
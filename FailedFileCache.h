@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_FAILED_FILE_CACHE_H
+#define _LIBUNWINDSTACK_FAILED_FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "FileInfoCache.h"
+
+namespace unwindstack {
+
+// Forward declarations.
+struct MapInfo;
+
+// The process wide cache of the map files that could not be used, used
+// when MapInfo::SetFailedFileCacheTtl is set, so that the maps of a file
+// that cannot be opened, or that is not a valid elf, do not open and read
+// it again. The entries are keyed by the name and by the same identity of
+// the file, the map and the read-only map before it as FileInfoCache
+// entries, where the file fields are zero when it does not exist. They are
+// forgotten after the ttl so that a file that appears or is fixed later is
+// used again.
+class FailedFileCache {
+ public:
+  static constexpr size_t kMaxEntries = 4096;
+
+  enum Failure : uint8_t {
+    FAILURE_NONE = 0,
+    // No memory could be made from the file, the process memory is used.
+    FAILURE_NO_FILE_MEMORY,
+    // The file could be read, but the elf in it is not valid.
+    FAILURE_INVALID_ELF,
+  };
+
+  explicit FailedFileCache(std::chrono::milliseconds ttl) : ttl_(ttl) {}
+  ~FailedFileCache() = default;
+
+  void SetTtl(std::chrono::milliseconds ttl);
+
+  // Returns the failure recorded for the file of info less than the ttl
+  // ago, and sets elf_offset and elf_start_offset to the values the failed
+  // attempt set.
+  Failure Find(const MapInfo* info, uint64_t* elf_offset, uint64_t* elf_start_offset);
+
+  void Add(const MapInfo* info, Failure failure);
+
+  void Clear();
+
+ private:
+  struct Key {
+    std::string name;
+    FileInfoCache::Key file;
+
+    bool operator==(const Key& other) const { return file == other.file && name == other.name; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  struct Entry {
+    Failure failure;
+    uint64_t elf_offset;
+    uint64_t elf_start_offset;
+    std::chrono::steady_clock::time_point time;
+  };
+
+  static void GetKey(const MapInfo* info, Key* key);
+
+  std::mutex lock_;
+  std::chrono::milliseconds ttl_;
+  std::unordered_map<Key, Entry, KeyHash> entries_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_FAILED_FILE_CACHE_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <unwindstack/MapInfo.h>
+
+#include "FileInfoCache.h"
+
+namespace unwindstack {
+
+size_t FileInfoCache::KeyHash::operator()(const Key& key) const {
+  uint64_t hash = key.ino * 0x9e3779b97f4a7c15ULL;
+  hash ^= key.dev + (hash << 6) + (hash >> 2);
+  hash ^= key.offset + (hash << 6) + (hash >> 2);
+  hash ^= key.map_size + (hash << 6) + (hash >> 2);
+  hash ^= static_cast<uint64_t>(key.mtime_nsec) + (hash << 6) + (hash >> 2);
+  return static_cast<size_t>(hash);
+}
+
+bool FileInfoCache::GetKey(const MapInfo* info, Key* key) {
+  if (info->name.empty() || info->end <= info->start) {
+    return false;
+  }
+  struct stat st;
+  if (stat(info->name.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  key->dev = st.st_dev;
+  key->ino = st.st_ino;
+  key->size = st.st_size;
+  key->mtime_sec = st.st_mtim.tv_sec;
+  key->mtime_nsec = st.st_mtim.tv_nsec;
+  key->offset = info->offset;
+  key->map_size = info->end - info->start;
+  const MapInfo* prev = info->prev_real_map;
+  if (prev != nullptr && prev->flags == PROT_READ && std::string_view(prev->name) == info->name) {
+    key->prev_offset = prev->offset;
+    key->prev_distance = info->end - prev->end;
+  } else {
+    key->prev_offset = UINT64_MAX;
+    key->prev_distance = UINT64_MAX;
+  }
+  return true;
+}
+
+bool FileInfoCache::Find(const Key& key, Info* found) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  *found = entry->second;
+  return true;
+}
+
+FileInfoCache::Info* FileInfoCache::GetEntry(const Key& key, const MapInfo* info) {
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    // The entries are small and only ever reread, so a full cache simply
+    // starts over rather than tracking which entries are in use.
+    if (entries_.size() >= kMaxEntries) {
+      entries_.clear();
+    }
+    entry = entries_.emplace(key, Info()).first;
+  }
+  entry->second.elf_offset = info->elf_offset;
+  entry->second.elf_start_offset = info->elf_start_offset;
+  return &entry->second;
+}
+
+void FileInfoCache::SetBuildID(const Key& key, const MapInfo* info, const std::string& build_id) {
+  std::lock_guard<std::mutex> guard(lock_);
+  Info* entry = GetEntry(key, info);
+  entry->has_build_id = true;
+  entry->build_id = build_id;
+}
+
+void FileInfoCache::SetLoadBias(const Key& key, const MapInfo* info, int64_t load_bias) {
+  std::lock_guard<std::mutex> guard(lock_);
+  GetEntry(key, info)->load_bias = load_bias;
+}
+
+void FileInfoCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_FILE_INFO_CACHE_H
+#define _LIBUNWINDSTACK_FILE_INFO_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace unwindstack {
+
+// Forward declarations.
+struct MapInfo;
+
+// The process wide cache of the build ids and load biases of file backed
+// maps used when MapInfo::SetFileInfoCacheEnabled is on, so that maps of
+// the same file in any number of processes read the elf headers once.
+//
+// An entry is keyed by the identity of the file, the offset and size of
+// the map, and the read-only map before it, which together decide where
+// MapInfo::GetFileMemory finds the elf.
+class FileInfoCache {
+ public:
+  static constexpr size_t kMaxEntries = 4096;
+
+  struct Key {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t offset;
+    uint64_t map_size;
+    // The offset of the previous read-only map of the same file, and the
+    // distance from its end to the end of this map, UINT64_MAX if there is
+    // no such map.
+    uint64_t prev_offset;
+    uint64_t prev_distance;
+
+    bool operator==(const Key& other) const {
+      return dev == other.dev && ino == other.ino && size == other.size &&
+             mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+             offset == other.offset && map_size == other.map_size &&
+             prev_offset == other.prev_offset && prev_distance == other.prev_distance;
+    }
+  };
+
+  struct Info {
+    // The values GetFileMemory set in the map.
+    uint64_t elf_offset = 0;
+    uint64_t elf_start_offset = 0;
+    bool has_build_id = false;
+    std::string build_id;
+    // INT64_MAX if not read yet, like MapInfo::load_bias.
+    int64_t load_bias = INT64_MAX;
+  };
+
+  FileInfoCache() = default;
+  ~FileInfoCache() = default;
+
+  // Returns false if info is not a map of a regular file.
+  static bool GetKey(const MapInfo* info, Key* key);
+
+  // Returns false if there is no entry for key.
+  bool Find(const Key& key, Info* found);
+
+  // Saves the build id or the load bias read for info, with the offsets
+  // GetFileMemory set while reading it.
+  void SetBuildID(const Key& key, const MapInfo* info, const std::string& build_id);
+  void SetLoadBias(const Key& key, const MapInfo* info, int64_t load_bias);
+
+  void Clear();
+
+ private:
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  Info* GetEntry(const Key& key, const MapInfo* info);
+
+  std::mutex lock_;
+  std::unordered_map<Key, Info, KeyHash> entries_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_FILE_INFO_CACHE_H
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unwindstack/FrameEncoding.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/SharedString.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+// The start of a dump.
+static constexpr uint8_t kMagic[] = {'U', 'W', 'F', 'E'};
+static constexpr uint8_t kVersion = 1;
+
+// The first byte of every record.
+enum Record : uint8_t {
+  RECORD_MAP = 1,
+  RECORD_NAME,
+  RECORD_BEGIN_TRACE,
+  RECORD_FRAME,
+  RECORD_END_TRACE,
+};
+
+// The rel_pc of a frame when the elf of the map covers the file from
+// elf_start_offset, which holds for almost all frames.
+static uint64_t ExpectedRelPc(uint64_t pc, uint64_t map_start, uint64_t exact_offset,
+                              uint64_t elf_start_offset, uint64_t load_bias) {
+  return pc - map_start + exact_offset - elf_start_offset + load_bias;
+}
+
+void FrameEncoder::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    data_.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  data_.push_back(static_cast<uint8_t>(value));
+}
+
+void FrameEncoder::WriteSigned(int64_t value) {
+  // Zigzag, so that small negative values are small too.
+  WriteVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void FrameEncoder::WriteString(std::string_view value) {
+  WriteVarint(value.size());
+  data_.insert(data_.end(), value.begin(), value.end());
+}
+
+void FrameEncoder::Reset() {
+  data_.clear();
+  started_ = false;
+  map_table_.clear();
+  map_indices_.clear();
+  name_indices_.clear();
+  prev_pc_ = 0;
+  prev_sp_ = 0;
+}
+
+uint32_t FrameEncoder::GetMapIndex(const FrameData& frame) {
+  auto entry = map_indices_.find(frame.map_start);
+  if (entry != map_indices_.end()) {
+    const EncodedMap& map = map_table_[entry->second];
+    if (map.end == frame.map_end && map.exact_offset == frame.map_exact_offset &&
+        map.elf_start_offset == frame.map_elf_start_offset &&
+        map.load_bias == frame.map_load_bias && map.flags == frame.map_flags &&
+        static_cast<std::string_view>(map.name) == frame.map_name) {
+      return entry->second;
+    }
+  }
+
+  // A new map, or one that changed since it was written.
+  EncodedMap map;
+  map.start = frame.map_start;
+  map.end = frame.map_end;
+  map.exact_offset = frame.map_exact_offset;
+  map.elf_start_offset = frame.map_elf_start_offset;
+  map.load_bias = frame.map_load_bias;
+  map.flags = frame.map_flags;
+  map.name = frame.map_name;
+  if (maps_ != nullptr) {
+    MapInfo* info = maps_->Find(frame.map_start);
+    if (info != nullptr && info->start == frame.map_start) {
+      map.build_id = info->GetBuildID();
+    }
+  }
+
+  data_.push_back(RECORD_MAP);
+  WriteVarint(map.start);
+  WriteVarint(map.end - map.start);
+  WriteVarint(map.exact_offset);
+  WriteVarint(map.elf_start_offset);
+  WriteSigned(static_cast<int64_t>(map.load_bias));
+  WriteVarint(static_cast<uint32_t>(map.flags));
+  WriteString(map.name);
+  WriteString(map.build_id);
+
+  uint32_t index = map_table_.size();
+  map_table_.emplace_back(std::move(map));
+  map_indices_[frame.map_start] = index;
+  return index;
+}
+
+uint32_t FrameEncoder::GetNameIndex(const SharedString& name) {
+  auto entry = name_indices_.find(static_cast<const std::string&>(name));
+  if (entry != name_indices_.end()) {
+    return entry->second;
+  }
+  data_.push_back(RECORD_NAME);
+  WriteString(name);
+  uint32_t index = name_indices_.size();
+  name_indices_.emplace(static_cast<const std::string&>(name), index);
+  return index;
+}
+
+void FrameEncoder::BeginTrace() {
+  if (!started_) {
+    data_.insert(data_.end(), kMagic, kMagic + sizeof(kMagic));
+    data_.push_back(kVersion);
+    started_ = true;
+  }
+  data_.push_back(RECORD_BEGIN_TRACE);
+  prev_pc_ = 0;
+  prev_sp_ = 0;
+}
+
+void FrameEncoder::AddFrame(const FrameData& frame) {
+  // The maps and names go before the frame that uses them, so that the dump
+  // can be decoded as it is received.
+  bool has_map = frame.map_end > frame.map_start;
+  uint32_t map_index = has_map ? GetMapIndex(frame) : 0;
+  bool has_name = !frame.function_name.empty();
+  uint32_t name_index = has_name ? GetNameIndex(frame.function_name) : 0;
+
+  data_.push_back(RECORD_FRAME);
+  WriteVarint(has_map ? map_index + 1 : 0);
+  WriteSigned(static_cast<int64_t>(frame.pc - prev_pc_));
+  WriteSigned(static_cast<int64_t>(frame.sp - prev_sp_));
+  uint64_t expected_rel_pc =
+      has_map ? ExpectedRelPc(frame.pc, frame.map_start, frame.map_exact_offset,
+                              frame.map_elf_start_offset, frame.map_load_bias)
+              : frame.pc;
+  WriteSigned(static_cast<int64_t>(frame.rel_pc - expected_rel_pc));
+  WriteVarint(has_name ? name_index + 1 : 0);
+  if (has_name) {
+    WriteVarint(frame.function_offset);
+  }
+  prev_pc_ = frame.pc;
+  prev_sp_ = frame.sp;
+}
+
+void FrameEncoder::EndTrace() {
+  data_.push_back(RECORD_END_TRACE);
+}
+
+void FrameEncoder::AddTrace(const std::vector<FrameData>& frames) {
+  BeginTrace();
+  for (const FrameData& frame : frames) {
+    AddFrame(frame);
+  }
+  EndTrace();
+}
+
+namespace {
+
+// Reads the values of records, every read fails once the data ran out.
+class RecordReader {
+ public:
+  RecordReader(const uint8_t* data, size_t size) : cur_(data), end_(data + size) {}
+
+  bool done() const { return cur_ == end_; }
+
+  bool ReadByte(uint8_t* value) {
+    if (cur_ == end_) {
+      return false;
+    }
+    *value = *cur_++;
+    return true;
+  }
+
+  bool ReadVarint(uint64_t* value) {
+    uint64_t result = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+      uint8_t byte;
+      if (!ReadByte(&byte)) {
+        return false;
+      }
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadSigned(uint64_t* value) {
+    uint64_t zigzag;
+    if (!ReadVarint(&zigzag)) {
+      return false;
+    }
+    *value = (zigzag >> 1) ^ -(zigzag & 1);
+    return true;
+  }
+
+  bool ReadString(std::string* value) {
+    uint64_t size;
+    if (!ReadVarint(&size) || size > static_cast<uint64_t>(end_ - cur_)) {
+      return false;
+    }
+    value->assign(reinterpret_cast<const char*>(cur_), size);
+    cur_ += size;
+    return true;
+  }
+
+  bool ReadMagic() {
+    if (static_cast<size_t>(end_ - cur_) < sizeof(kMagic) + 1 ||
+        memcmp(cur_, kMagic, sizeof(kMagic)) != 0 || cur_[sizeof(kMagic)] != kVersion) {
+      return false;
+    }
+    cur_ += sizeof(kMagic) + 1;
+    return true;
+  }
+
+ private:
+  const uint8_t* cur_;
+  const uint8_t* end_;
+};
+
+}  // namespace
+
+void FrameDecoder::Reset() {
+  maps_.clear();
+  names_.clear();
+  started_ = false;
+  trace_ = DecodedTrace();
+  in_trace_ = false;
+  prev_pc_ = 0;
+  prev_sp_ = 0;
+}
+
+bool FrameDecoder::Decode(const uint8_t* data, size_t size, std::vector<DecodedTrace>* traces) {
+  RecordReader reader(data, size);
+  if (!started_) {
+    if (!reader.ReadMagic()) {
+      return false;
+    }
+    started_ = true;
+  }
+
+  while (!reader.done()) {
+    uint8_t record;
+    reader.ReadByte(&record);
+    switch (record) {
+      case RECORD_MAP: {
+        EncodedMap map;
+        uint64_t size, flags;
+        std::string name;
+        if (!reader.ReadVarint(&map.start) || !reader.ReadVarint(&size) ||
+            !reader.ReadVarint(&map.exact_offset) || !reader.ReadVarint(&map.elf_start_offset) ||
+            !reader.ReadSigned(&map.load_bias) || !reader.ReadVarint(&flags) ||
+            !reader.ReadString(&name) || !reader.ReadString(&map.build_id)) {
+          return false;
+        }
+        map.end = map.start + size;
+        map.flags = static_cast<int>(flags);
+        map.name = SharedString(std::move(name));
+        maps_.emplace_back(std::move(map));
+        break;
+      }
+      case RECORD_NAME: {
+        std::string name;
+        if (!reader.ReadString(&name)) {
+          return false;
+        }
+        names_.emplace_back(std::move(name));
+        break;
+      }
+      case RECORD_BEGIN_TRACE:
+        trace_ = DecodedTrace();
+        in_trace_ = true;
+        prev_pc_ = 0;
+        prev_sp_ = 0;
+        break;
+      case RECORD_FRAME: {
+        uint64_t map_index, pc_delta, sp_delta, rel_pc_delta, name_index;
+        if (!in_trace_ || !reader.ReadVarint(&map_index) || !reader.ReadSigned(&pc_delta) ||
+            !reader.ReadSigned(&sp_delta) || !reader.ReadSigned(&rel_pc_delta) ||
+            !reader.ReadVarint(&name_index) || map_index > maps_.size() ||
+            name_index > names_.size()) {
+          return false;
+        }
+        FrameData frame;
+        frame.num = trace_.frames.size();
+        frame.pc = prev_pc_ + pc_delta;
+        frame.sp = prev_sp_ + sp_delta;
+        uint64_t expected_rel_pc = frame.pc;
+        if (map_index != 0) {
+          const EncodedMap& map = maps_[map_index - 1];
+          frame.map_name = map.name;
+          frame.map_start = map.start;
+          frame.map_end = map.end;
+          frame.map_exact_offset = map.exact_offset;
+          frame.map_elf_start_offset = map.elf_start_offset;
+          frame.map_load_bias = map.load_bias;
+          frame.map_flags = map.flags;
+          expected_rel_pc = ExpectedRelPc(frame.pc, map.start, map.exact_offset,
+                                          map.elf_start_offset, map.load_bias);
+        }
+        frame.rel_pc = expected_rel_pc + rel_pc_delta;
+        if (name_index != 0) {
+          if (!reader.ReadVarint(&frame.function_offset)) {
+            return false;
+          }
+          frame.function_name = names_[name_index - 1];
+        }
+        prev_pc_ = frame.pc;
+        prev_sp_ = frame.sp;
+        trace_.frames.emplace_back(std::move(frame));
+        trace_.map_indices.push_back(map_index != 0 ? map_index - 1 : DecodedTrace::kNoMap);
+        break;
+      }
+      case RECORD_END_TRACE:
+        if (!in_trace_) {
+          return false;
+        }
+        traces->emplace_back(std::move(trace_));
+        trace_ = DecodedTrace();
+        in_trace_ = false;
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace unwindstack
@@ -19,7 +19,10 @@
 #include <sys/mman.h>
 #include <libgen.h>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <unwindstack/Global.h>
@@ -58,6 +61,24 @@ bool Global::Searchable(const std::string& name) {
   return false;
 }
 
+size_t Global::search_threads_ = 1;
+
+bool Global::GetVariableAddress(const Candidate& candidate, const std::string& variable,
+                                uint64_t* addr) {
+  Elf* elf = candidate.map_zero->GetElf(memory_, arch());
+  uint64_t ptr;
+  if (!elf->GetGlobalVariableOffset(variable, &ptr) || ptr == 0) {
+    return false;
+  }
+  MapInfo* info = candidate.info;
+  uint64_t offset_end = info->offset + info->end - info->start;
+  if (ptr < info->offset || ptr >= offset_end) {
+    return false;
+  }
+  *addr = info->start + ptr - info->offset;
+  return true;
+}
+
 void Global::FindAndReadVariable(Maps* maps, const char* var_str) {
   std::string variable(var_str);
   // When looking for global variables, do not arbitrarily search every
@@ -76,23 +97,63 @@ void Global::FindAndReadVariable(Maps* maps, const char* var_str) {
   //   f1000-f2000 0 ---
   //   f2000-f3000 1000 r-x /system/lib/libc.so
   //   f3000-f4000 2000 rw- /system/lib/libc.so
+  std::vector<Candidate> candidates;
   MapInfo* map_zero = nullptr;
   for (const auto& info : *maps) {
     if (info->offset != 0 && (info->flags & (PROT_READ | PROT_WRITE)) == (PROT_READ | PROT_WRITE) &&
         map_zero != nullptr && Searchable(info->name) && info->name == map_zero->name) {
-      Elf* elf = map_zero->GetElf(memory_, arch());
-      uint64_t ptr;
-      if (elf->GetGlobalVariableOffset(variable, &ptr) && ptr != 0) {
-        uint64_t offset_end = info->offset + info->end - info->start;
-        if (ptr >= info->offset && ptr < offset_end) {
-          ptr = info->start + ptr - info->offset;
-          if (ReadVariableData(ptr)) {
-            break;
+      candidates.push_back(Candidate{map_zero, info.get()});
+    } else if (info->offset == 0 && !info->name.empty()) {
+      map_zero = info.get();
+    }
+  }
+
+  size_t num_threads = search_threads_;
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, candidates.size());
+
+  // The variable is read from the first candidate that has it, so the
+  // workers open the elfs in order, and stop at the candidates after the
+  // first one found. The descriptor is then read in order, and a candidate
+  // not looked at because an earlier one was found is looked at if reading
+  // the earlier one fails.
+  std::vector<uint64_t> addrs(candidates.size(), 0);
+  std::vector<uint8_t> searched(candidates.size(), 0);
+  if (num_threads > 1) {
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> first_found(candidates.size());
+    auto worker = [&]() {
+      while (true) {
+        size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= candidates.size() || i > first_found.load(std::memory_order_relaxed)) {
+          break;
+        }
+        searched[i] = 1;
+        if (GetVariableAddress(candidates[i], variable, &addrs[i])) {
+          size_t found = first_found.load(std::memory_order_relaxed);
+          while (i < found && !first_found.compare_exchange_weak(found, i)) {
           }
         }
       }
-    } else if (info->offset == 0 && !info->name.empty()) {
-      map_zero = info.get();
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; i++) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (!searched[i] && !GetVariableAddress(candidates[i], variable, &addrs[i])) {
+      continue;
+    }
+    if (addrs[i] != 0 && ReadVariableData(addrs[i])) {
+      break;
     }
   }
 }
@@ -21,7 +21,10 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <memory>
+#include <optional>
+#include <utility>
 #include <vector>
 
 #include <unwindstack/Global.h>
@@ -30,6 +33,7 @@
 #include "Check.h"
 #include "GlobalDebugInterface.h"
 #include "MemoryRange.h"
+#include "MemoryUsage.h"
 
 // This implements the JIT Compilation Interface.
 // See https://sourceware.org/gdb/onlinedocs/gdb/JIT-Interface.html
@@ -86,6 +90,9 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
     bool operator<(const UID& other) const {
       return std::tie(address, seqlock) < std::tie(other.address, other.seqlock);
     }
+    bool operator==(const UID& other) const {
+      return address == other.address && seqlock == other.seqlock;
+    }
   };
 
   GlobalDebugImpl(ArchEnum arch, std::shared_ptr<Memory>& memory,
@@ -126,10 +133,11 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
 
   bool ReadVariableData(uint64_t ptr) { return ReadDescriptor(ptr); }
 
-  // Iterate over all symfiles and call the provided callback for reach symfile.
+  // Iterate over the symfiles that might contain pc and call the provided callback for each
+  // symfile, in the order of entries_.
   // Returns true if any callback returns true (which also aborts the iteration).
   template <typename Callback /* (Symfile*) -> bool */>
-  bool ForEachSymfile(Maps* maps, Callback callback) {
+  bool ForEachSymfile(Maps* maps, uint64_t pc, Callback callback) {
     // Use a single lock, this object should be used so infrequently that
     // a fine grain lock is unnecessary.
     std::lock_guard<std::mutex> guard(lock_);
@@ -141,38 +149,145 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
     }
 
     // Try to find the entry in already loaded symbol files.
-    for (auto& it : entries_) {
-      if (callback(it.first, it.second.get())) {
-        return true;
-      }
+    if (ForEachEntry(pc, callback)) {
+      return true;
     }
 
     // Update all entries and retry.
-    ReadAllEntries(maps);
-    for (auto& it : entries_) {
-      if (callback(it.first, it.second.get())) {
-        return true;
+    if (!UpdateEntries(maps)) {
+      return false;
+    }
+    return ForEachEntry(pc, callback);
+  }
+
+  // Reads the entries again, unless the list did not change since they
+  // were read. Returns false if they were not read.
+  bool UpdateEntries(Maps* maps) {
+    std::pair<uint32_t, uint64_t> version;
+    bool has_version = ReadVersion(&version);
+    if (has_version && entries_version_ == version) {
+      return false;
+    }
+    if (ReadAllEntries(maps) && has_version) {
+      entries_version_ = version;
+    } else {
+      entries_version_.reset();
+    }
+    return true;
+  }
+
+  bool Update(Maps* maps) override {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (descriptor_addr_ == 0) {
+      FindAndReadVariable(maps, global_variable_name_);
+      if (descriptor_addr_ == 0) {
+        return false;
       }
     }
+    UpdateEntries(maps);
+    if (!index_valid_) {
+      BuildIndex();
+    }
+    return true;
+  }
 
-    return false;
+  // Calls callback for every cached entry whose pc range contains pc, until
+  // it returns true. Then drops the entries that callback found to be
+  // removed from the list.
+  template <typename Callback /* (Symfile*) -> bool */>
+  bool ForEachEntry(uint64_t pc, Callback callback) {
+    if (!index_valid_) {
+      BuildIndex();
+    }
+
+    // Walk back from the last entry that starts at or before pc, until no
+    // earlier entry can end after pc.
+    candidates_.clear();
+    auto it = std::upper_bound(index_.begin(), index_.end(), pc,
+                               [](uint64_t pc, const IndexEntry& entry) { return pc < entry.start; });
+    for (size_t i = it - index_.begin(); i > 0 && index_[i - 1].max_end > pc; i--) {
+      if (pc < index_[i - 1].end) {
+        candidates_.push_back(&index_[i - 1]);
+      }
+    }
+    for (const IndexEntry& entry : unbounded_index_) {
+      candidates_.push_back(&entry);
+    }
+    if (candidates_.size() > 1) {
+      std::sort(candidates_.begin(), candidates_.end(),
+                [](const IndexEntry* a, const IndexEntry* b) { return a->uid < b->uid; });
+    }
+
+    bool found = false;
+    for (const IndexEntry* entry : candidates_) {
+      if (callback(entry->uid, entry->file)) {
+        found = true;
+        break;
+      }
+    }
+    if (!removed_entries_.empty()) {
+      for (const UID& uid : removed_entries_) {
+        entries_.erase(uid);
+      }
+      removed_entries_.clear();
+      index_valid_ = false;
+    }
+    return found;
+  }
+
+  // Sorts the pc ranges of all of the entries, so that ForEachEntry only
+  // checks the few entries that can contain the pc.
+  void BuildIndex() {
+    index_.clear();
+    unbounded_index_.clear();
+    for (auto& it : entries_) {
+      IndexEntry entry{.uid = it.first, .file = it.second.get()};
+      if (this->GetPcRange(entry.file, &entry.start, &entry.end)) {
+        if (entry.start < entry.end) {
+          index_.push_back(entry);
+        }
+      } else {
+        unbounded_index_.push_back(entry);
+      }
+    }
+    std::sort(index_.begin(), index_.end(),
+              [](const IndexEntry& a, const IndexEntry& b) { return a.start < b.start; });
+    uint64_t max_end = 0;
+    for (IndexEntry& entry : index_) {
+      max_end = std::max(max_end, entry.end);
+      entry.max_end = max_end;
+    }
+    index_valid_ = true;
   }
 
   bool GetFunctionName(Maps* maps, uint64_t pc, SharedString* name, uint64_t* offset) {
     // NB: If symfiles overlap in PC ranges, this will check all of them.
-    return ForEachSymfile(maps, [pc, name, offset, this](UID uid, Symfile* file) {
-      return file->IsValidPc(pc) && CheckSeqlock(uid) && file->GetFunctionName(pc, name, offset);
+    return ForEachSymfile(maps, pc, [pc, name, offset, this](UID uid, Symfile* file) {
+      return file->IsValidPc(pc) && CheckLive(uid) && file->GetFunctionName(pc, name, offset);
     });
   }
 
+  size_t MemoryUsage() override {
+    std::lock_guard<std::mutex> guard(lock_);
+    size_t usage = sizeof(*this) + MapMemoryUsage(entries_) + MapMemoryUsage(partial_entries_) +
+                   VectorMemoryUsage(removed_entries_) + VectorMemoryUsage(index_) +
+                   VectorMemoryUsage(unbounded_index_) + VectorMemoryUsage(candidates_);
+    for (const auto& entry : entries_) {
+      if (entry.second != nullptr) {
+        usage += this->SymfileMemoryUsage(entry.second.get());
+      }
+    }
+    return usage;
+  }
+
   Symfile* Find(Maps* maps, uint64_t pc) {
     // NB: If symfiles overlap in PC ranges (which can happen for both ELF and DEX),
     // this will check all of them and return one that also has a matching function.
     // If there is no such symfile, it will return any symfile for which the PC is valid.
     // This is a useful fallback for tests, which often have symfiles with no functions.
     Symfile* result = nullptr;
-    ForEachSymfile(maps, [&result, pc, this](UID uid, Symfile* file) {
-      if (file->IsValidPc(pc) && CheckSeqlock(uid)) {
+    ForEachSymfile(maps, pc, [&result, pc, this](UID uid, Symfile* file) {
+      if (file->IsValidPc(pc) && CheckLive(uid)) {
         result = file;
         SharedString name;
         uint64_t offset;
@@ -186,36 +301,59 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
   }
 
   // Read all entries from the process and cache them locally.
-  // The linked list might be concurrently modified. We detect races and retry.
+  // The linked list might be concurrently modified. We detect races and retry,
+  // keeping the entries read consistently, so a retry only reads the entries
+  // it has not seen yet, starting from where the last walk stopped.
   bool ReadAllEntries(Maps* maps) {
+    // With seqlocks, entries are only added at the head of the list, and a
+    // removed entry never matches its UID again. So start from the cached
+    // entries, then the walk stops at the first live one of them, and only
+    // the new entries are read. The cached entries that were removed since
+    // are dropped here, so they do not pile up when lookups never hit them.
+    std::map<UID, std::shared_ptr<Symfile>> entries;
+    if (seqlock_offset_ != 0) {
+      for (const auto& it : entries_) {
+        if (CheckSeqlock(it.first)) {
+          entries.emplace_hint(entries.end(), it);
+        }
+      }
+    }
     for (int i = 0; i < kMaxRaceRetries; i++) {
       bool race = false;
-      if (!ReadAllEntries(maps, &race)) {
-        if (race) {
-          continue;  // Retry due to concurrent modification of the linked list.
-        }
-        return false;  // Failed to read entries.
+      if (ReadAllEntries(maps, &entries, &race)) {
+        entries_.swap(entries);
+        index_valid_ = false;
+        return true;  // Success.
+      }
+      if (!race) {
+        break;  // Failed to read entries.
       }
-      return true;  // Success.
+    }
+    if (seqlock_offset_ != 0) {
+      // Every entry read was validated by its seqlock, so keep them, and let
+      // the next call go on from where this one stopped.
+      entries_.swap(entries);
+      index_valid_ = false;
+    } else {
+      partial_entries_.clear();
+      resume_entry_.reset();
     }
     return false;  // Too many retries.
   }
 
   // Read all JIT entries while assuming there might be concurrent modifications.
   // If there is a race, the method will fail and the caller should retry the call.
-  bool ReadAllEntries(Maps* maps, bool* race) {
+  bool ReadAllEntries(Maps* maps, std::map<UID, std::shared_ptr<Symfile>>* entries, bool* race) {
     // New entries might be added while we iterate over the linked list.
     // In particular, an entry could be effectively moved from end to start due to
     // the ART repacking algorithm, which groups smaller entries into a big one.
     // Therefore keep reading the most recent entries until we reach a fixed point.
-    std::map<UID, std::shared_ptr<Symfile>> entries;
     for (size_t i = 0; i < kMaxHeadRetries; i++) {
-      size_t old_size = entries.size();
-      if (!ReadNewEntries(maps, &entries, race)) {
+      size_t old_size = entries->size();
+      if (!ReadNewEntries(maps, entries, race)) {
         return false;
       }
-      if (entries.size() == old_size) {
-        entries_.swap(entries);
+      if (entries->size() == old_size) {
         return true;
       }
     }
@@ -232,53 +370,82 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
     }
 
     // Follow the linked list.
+    bool resumed = !resume_entry_.has_value();
+    uint32_t segment = ++last_segment_;
+    size_t partial_visits = 0;
     while (uid.address != 0) {
-      // Check if we have reached an already cached entry (we restart from head repeatedly).
-      if (entries->count(uid) != 0) {
-        return true;
-      }
-
-      // Read the entry.
-      JITCodeEntry data{};
-      if (!memory_->ReadFully(uid.address, &data, jit_entry_size_)) {
-        return false;
-      }
-
-      // Check the seqlock to verify the symfile_addr and symfile_size.
-      if (!CheckSeqlock(uid, race)) {
-        return false;
-      }
+      auto partial = partial_entries_.find(uid);
+      if (partial != partial_entries_.end()) {
+        // Seeing more of them than there are means the list has a loop.
+        if (++partial_visits > partial_entries_.size()) {
+          return false;
+        }
+        // Read by a walk that raced, so the entries after it are not known
+        // to be read. Entries are only inserted at the head, so nothing
+        // comes between the entries read by one walk, and the walk skips
+        // ahead to where the furthest one stopped, if that entry is live.
+        if (!resumed && partial->second == resume_segment_) {
+          resumed = true;
+          segment = resume_segment_;
+          if (CheckSeqlock(*resume_entry_)) {
+            uid = *resume_entry_;
+          }
+        }
+      } else if (entries->count(uid) != 0) {
+        // Check if we have reached an already cached entry (we restart from head repeatedly).
+        break;
+      } else {
+        // Read the entry.
+        JITCodeEntry data{};
+        if (!memory_->ReadFully(uid.address, &data, jit_entry_size_)) {
+          return false;
+        }
 
-      // Copy and load the symfile.
-      auto it = entries_.find(uid);
-      if (it != entries_.end()) {
-        // The symfile was already loaded - just copy the reference.
-        entries->emplace(uid, it->second);
-      } else if (data.symfile_addr != 0) {
-        std::unique_ptr<Symfile> symfile;
-        bool ok = this->Load(maps, memory_, data.symfile_addr, data.symfile_size.value, symfile);
-        // Check seqlock first because load can fail due to race (so we want to trigger retry).
-        // TODO: Extract the memory copy code before the load, so that it is immune to races.
+        // Check the seqlock to verify the symfile_addr and symfile_size.
         if (!CheckSeqlock(uid, race)) {
-          return false;  // The ELF/DEX data was removed before we loaded it.
+          return false;
         }
-        // Exclude symbol files that fail to load (but continue loading other files).
-        if (ok) {
-          entries->emplace(uid, symfile.release());
+
+        // Copy and load the symfile.
+        auto it = entries_.find(uid);
+        if (it != entries_.end()) {
+          // The symfile was already loaded - just copy the reference.
+          entries->emplace(uid, it->second);
+        } else if (data.symfile_addr != 0) {
+          std::shared_ptr<Symfile> symfile;
+          bool ok = this->Load(maps, memory_, data.symfile_addr, data.symfile_size.value, symfile);
+          // Check seqlock first because load can fail due to race (so we want to trigger retry).
+          // TODO: Extract the memory copy code before the load, so that it is immune to races.
+          if (!CheckSeqlock(uid, race)) {
+            return false;  // The ELF/DEX data was removed before we loaded it.
+          }
+          // Exclude symbol files that fail to load (but continue loading other files).
+          if (ok) {
+            entries->emplace(uid, std::move(symfile));
+          }
         }
+        partial_entries_.emplace(uid, segment);
       }
 
       // Go to next entry.
       UID next_uid;
-      if (!ReadNextField(uid.address + offsetof(JITCodeEntry, next), &next_uid, race)) {
-        return false;  // The next pointer was modified while we were reading it.
-      }
-      if (!CheckSeqlock(uid, race)) {
-        return false;  // This entry was deleted before we moved to the next one.
+      if (!ReadNextField(uid.address + offsetof(JITCodeEntry, next), &next_uid, race) ||
+          !CheckSeqlock(uid, race)) {
+        // The next pointer was modified, or this entry was deleted, before
+        // we moved to the next one. A later walk resumes from here, unless
+        // it stopped before reaching where the last one did.
+        if (resumed) {
+          resume_entry_ = uid;
+          resume_segment_ = segment;
+        }
+        return false;
       }
       uid = next_uid;
     }
 
+    // The list is read from the head down to entries read completely before.
+    partial_entries_.clear();
+    resume_entry_.reset();
     return true;
   }
 
@@ -316,6 +483,36 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
     return true;
   }
 
+  // Reads the seqlock and timestamp of the descriptor, which change every
+  // time the list is modified. Returns false if the descriptor has no
+  // seqlock, or is being modified.
+  bool ReadVersion(std::pair<uint32_t, uint64_t>* version) {
+    if (seqlock_offset_ == 0) {
+      return false;
+    }
+    JITDescriptor desc{};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!memory_->ReadFully(descriptor_addr_, &desc, kSizeOfDescriptorV2) ||
+        (desc.seqlock & 1) == 1) {
+      return false;
+    }
+    *version = std::make_pair(desc.seqlock, static_cast<uint64_t>(desc.timestamp.value));
+    return true;
+  }
+
+  // Same as CheckSeqlock, and remembers the entry if it was removed from the
+  // list, so that ForEachEntry drops it.
+  bool CheckLive(UID uid) {
+    bool removed = false;
+    if (CheckSeqlock(uid, &removed)) {
+      return true;
+    }
+    if (removed) {
+      removed_entries_.push_back(uid);
+    }
+    return false;
+  }
+
   // Check that the given entry has not been deleted (or replaced by new entry at same address).
   bool CheckSeqlock(UID uid, bool* race = nullptr) {
     if (seqlock_offset_ == 0) {
@@ -344,6 +541,29 @@ class GlobalDebugImpl : public GlobalDebugInterface<Symfile>, public Global {
   uint32_t jit_entry_size_ = 0;
   uint32_t seqlock_offset_ = 0;
   std::map<UID, std::shared_ptr<Symfile>> entries_;  // Cached loaded entries.
+  // The descriptor version when entries_ was last read completely.
+  std::optional<std::pair<uint32_t, uint64_t>> entries_version_;
+  std::vector<UID> removed_entries_;
+  // The entries read by walks that raced since the list was last read
+  // completely, with the segment of the list they are in, and the last
+  // entry read by the walk that got the furthest.
+  std::map<UID, uint32_t> partial_entries_;
+  std::optional<UID> resume_entry_;
+  uint32_t resume_segment_ = 0;
+  uint32_t last_segment_ = 0;
+
+  struct IndexEntry {
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t max_end = 0;  // The largest end of this and all earlier entries.
+    UID uid;
+    Symfile* file;
+  };
+  // The entries with a pc range sorted by start, and the ones without one.
+  std::vector<IndexEntry> index_;
+  std::vector<IndexEntry> unbounded_index_;
+  bool index_valid_ = false;
+  std::vector<const IndexEntry*> candidates_;
 
   std::mutex lock_;
 };
@@ -362,7 +582,7 @@ std::unique_ptr<GlobalDebugInterface<Symfile>> CreateGlobalDebugImpl(
     ArchEnum arch, std::shared_ptr<Memory>& memory, std::vector<std::string> search_libs,
     const char* global_variable_name) {
   CHECK(arch != ARCH_UNKNOWN);
-  switch (arch) {
+  switch (ArchDispatch(arch)) {
     case ARCH_X86: {
       using Impl = GlobalDebugImpl<Symfile, uint32_t, Uint64_P>;
       static_assert(offsetof(typename Impl::JITCodeEntry, symfile_size) == 12, "layout");
@@ -390,6 +610,9 @@ std::unique_ptr<GlobalDebugInterface<Symfile>> CreateGlobalDebugImpl(
       static_assert(sizeof(typename Impl::JITDescriptor) == 56, "layout");
       return std::make_unique<Impl>(arch, memory, search_libs, global_variable_name);
     }
+    case ARCH_UNKNOWN:
+      // The support for arch is left out of the build.
+      return nullptr;
     default:
       abort();
   }
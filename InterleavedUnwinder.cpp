@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/InterleavedUnwinder.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+#include "Check.h"
+
+namespace unwindstack {
+
+// The pages read so far, shared by all of the unwinds, and the pages they
+// are waiting for.
+class InterleavedUnwinder::PageStore {
+ public:
+  // The most pages a single Prefetch asks for.
+  static constexpr size_t kMaxPrefetchPages = 64;
+  // The pages read for a missing page, starting with it. The unwinds walk
+  // up the stack, so the pages after it are likely wanted next.
+  static constexpr size_t kMissPages = 4;
+
+  PageStore(std::shared_ptr<Memory> memory, size_t page_size)
+      : memory_(std::move(memory)), page_size_(page_size) {}
+
+  size_t page_size() const { return page_size_; }
+
+  // Returns nullptr if the page was not read yet. A page that could only
+  // be read in part, or not at all, is shorter than page_size.
+  const std::vector<uint8_t>* Find(uint64_t page) const {
+    auto entry = pages_.find(page);
+    return entry == pages_.end() ? nullptr : &entry->second;
+  }
+
+  void Want(uint64_t page) {
+    if (pages_.count(page) == 0 && wanted_set_.insert(page).second) {
+      wanted_.push_back(page);
+    }
+  }
+
+  // Reads every wanted page with one ReadBatch, returns the number read.
+  size_t ReadWanted() {
+    std::vector<MemoryReadRequest> requests(wanted_.size());
+    std::vector<std::vector<uint8_t>> buffers(wanted_.size());
+    for (size_t i = 0; i < wanted_.size(); i++) {
+      buffers[i].resize(page_size_);
+      requests[i].addr = wanted_[i];
+      requests[i].dst = buffers[i].data();
+      requests[i].size = page_size_;
+    }
+    if (memory_ != nullptr && !requests.empty()) {
+      memory_->ReadBatch(requests.data(), requests.size());
+    }
+    for (size_t i = 0; i < wanted_.size(); i++) {
+      buffers[i].resize(requests[i].bytes_read);
+      buffers[i].shrink_to_fit();
+      pages_[wanted_[i]] = std::move(buffers[i]);
+    }
+    size_t count = wanted_.size();
+    wanted_.clear();
+    wanted_set_.clear();
+    return count;
+  }
+
+ private:
+  std::shared_ptr<Memory> memory_;
+  size_t page_size_;
+  std::unordered_map<uint64_t, std::vector<uint8_t>> pages_;
+  std::vector<uint64_t> wanted_;
+  std::unordered_set<uint64_t> wanted_set_;
+};
+
+// The memory of one unwind, which notes when a read needed a page that
+// was not read yet.
+class InterleavedUnwinder::SampleMemory : public Memory {
+ public:
+  explicit SampleMemory(PageStore* store) : store_(store) {}
+  virtual ~SampleMemory() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+    uint64_t page_size = store_->page_size();
+    size_t done = 0;
+    while (done < size) {
+      uint64_t cur = addr + done;
+      uint64_t page = cur & ~(page_size - 1);
+      const std::vector<uint8_t>* data = store_->Find(page);
+      if (data == nullptr) {
+        for (size_t i = 0; i < PageStore::kMissPages; i++) {
+          store_->Want(page + i * page_size);
+        }
+        missed_ = true;
+        return done;
+      }
+      uint64_t offset = cur - page;
+      if (offset >= data->size()) {
+        // The rest of the page could not be read.
+        return done;
+      }
+      size_t len = std::min<uint64_t>(size - done, data->size() - offset);
+      memcpy(out + done, data->data() + offset, len);
+      done += len;
+    }
+    return done;
+  }
+
+  void Prefetch(uint64_t addr, size_t size) override {
+    if (size == 0) {
+      return;
+    }
+    uint64_t page_size = store_->page_size();
+    uint64_t page = addr & ~(page_size - 1);
+    for (size_t i = 0; i < PageStore::kMaxPrefetchPages && page < addr + size;
+         i++, page += page_size) {
+      store_->Want(page);
+    }
+  }
+
+  bool missed() const { return missed_; }
+  void ClearMissed() { missed_ = false; }
+
+ private:
+  PageStore* store_;
+  bool missed_ = false;
+};
+
+InterleavedUnwinder::InterleavedUnwinder(Unwinder* unwinder, std::shared_ptr<Memory> memory,
+                                         size_t page_size)
+    : unwinder_(unwinder), store_(new PageStore(std::move(memory), page_size)) {
+  CHECK(page_size != 0 && (page_size & (page_size - 1)) == 0);
+}
+
+InterleavedUnwinder::~InterleavedUnwinder() = default;
+
+size_t InterleavedUnwinder::Add(Regs* regs) {
+  size_t index = results_.size();
+  results_.emplace_back();
+  pending_.push_back(Pending{index, std::unique_ptr<Regs>(regs->Clone()),
+                             std::make_shared<SampleMemory>(store_.get())});
+  return index;
+}
+
+bool InterleavedUnwinder::Step() {
+  if (pending_.empty()) {
+    return false;
+  }
+
+  // Every round starts the unwinds over from copies of their registers.
+  std::vector<std::unique_ptr<Regs>> regs(pending_.size());
+  std::vector<UnwindSample> samples(pending_.size());
+  for (size_t i = 0; i < pending_.size(); i++) {
+    regs[i].reset(pending_[i].regs->Clone());
+    pending_[i].memory->ClearMissed();
+    samples[i].regs = regs[i].get();
+    samples[i].process_memory = pending_[i].memory;
+  }
+  std::vector<UnwindBatchResult> batch = unwinder_->UnwindBatch(samples);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < pending_.size(); i++) {
+    if (pending_[i].memory->missed()) {
+      pending_[kept++] = std::move(pending_[i]);
+    } else {
+      results_[pending_[i].index] = std::move(batch[i]);
+    }
+  }
+  pending_.resize(kept);
+  if (pending_.empty()) {
+    return false;
+  }
+
+  rounds_++;
+  pages_read_ += store_->ReadWanted();
+  return true;
+}
+
+std::vector<UnwindBatchResult> InterleavedUnwinder::Run() {
+  while (Step()) {
+  }
+  std::vector<UnwindBatchResult> results = std::move(results_);
+  results_.clear();
+  return results;
+}
+
+}  // namespace unwindstack
@@ -14,24 +14,106 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
 #include <unwindstack/JitDebug.h>
 
 #include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
 
 #include "GlobalDebugImpl.h"
 #include "MemoryBuffer.h"
 
 namespace unwindstack {
 
+// Identical symfiles, for example the same code in processes forked from
+// one zygote, or an entry that is read again after the list changed, share
+// a single Elf. The elfs are found by a hash of the contents, and only used
+// if the contents match.
+struct JitElfCache {
+  std::mutex lock;
+  std::unordered_multimap<size_t, std::weak_ptr<Elf>> elfs;
+  size_t sweep_size = 64;
+};
+
+static JitElfCache& GetJitElfCache() {
+  static JitElfCache* cache = new JitElfCache;
+  return *cache;
+}
+
 template <>
 bool GlobalDebugInterface<Elf>::Load(Maps*, std::shared_ptr<Memory>& memory, uint64_t addr,
-                                     uint64_t size, /*out*/ std::unique_ptr<Elf>& elf) {
+                                     uint64_t size, /*out*/ std::shared_ptr<Elf>& elf) {
   std::unique_ptr<MemoryBuffer> copy(new MemoryBuffer());
   if (!copy->Resize(size) || !memory->ReadFully(addr, copy->GetPtr(0), size)) {
     return false;
   }
+  std::string_view contents(reinterpret_cast<const char*>(copy->GetPtr(0)), size);
+  size_t hash = std::hash<std::string_view>()(contents);
+
+  JitElfCache& cache = GetJitElfCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+  auto range = cache.elfs.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    std::shared_ptr<Elf> cached = it->second.lock();
+    if (cached == nullptr) {
+      continue;
+    }
+    // Every cached elf was created from a MemoryBuffer below.
+    MemoryBuffer* cached_memory = static_cast<MemoryBuffer*>(cached->memory());
+    if (cached_memory->Size() == size && memcmp(cached_memory->GetPtr(0), contents.data(), size) == 0) {
+      elf = std::move(cached);
+      return true;
+    }
+  }
+
   elf.reset(new Elf(copy.release()));
-  return elf->Init() && elf->valid();
+  if (!elf->Init() || !elf->valid()) {
+    return false;
+  }
+  cache.elfs.emplace(hash, elf);
+  if (cache.elfs.size() >= cache.sweep_size) {
+    for (auto it = cache.elfs.begin(); it != cache.elfs.end();) {
+      it = it->second.expired() ? cache.elfs.erase(it) : std::next(it);
+    }
+    cache.sweep_size = std::max<size_t>(64, 2 * cache.elfs.size());
+  }
+  return true;
+}
+
+template <>
+size_t GlobalDebugInterface<Elf>::SymfileMemoryUsage(Elf* elf) {
+  return elf->MemoryUsage();
+}
+
+template <>
+bool GlobalDebugInterface<Elf>::GetPcRange(Elf* elf, uint64_t* start, uint64_t* end) {
+  if (!elf->valid()) {
+    *start = *end = 0;
+    return true;
+  }
+  // Without PT_LOAD segments, or with a gnu_debugdata section, the pc is
+  // checked against the unwind information instead.
+  const std::unordered_map<uint64_t, LoadInfo>& pt_loads = elf->interface()->pt_loads();
+  if (pt_loads.empty() || elf->gnu_debugdata_interface() != nullptr) {
+    return false;
+  }
+  *start = UINT64_MAX;
+  *end = 0;
+  for (const auto& entry : pt_loads) {
+    *start = std::min(*start, entry.second.table_offset);
+    *end = std::max(*end, entry.second.table_offset + entry.second.table_size);
+  }
+  return true;
 }
 
 std::unique_ptr<JitDebug> CreateJitDebug(ArchEnum arch, std::shared_ptr<Memory>& memory,
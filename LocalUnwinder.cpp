@@ -30,34 +30,229 @@
 #include <stdint.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <sys/mman.h>
+
 #include <unwindstack/Elf.h>
 #include <unwindstack/LocalUnwinder.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineX86_64.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
+#include <unwindstack/RegsArm64.h>
 #include <unwindstack/RegsGetLocal.h>
 
+#include "MemoryLocal.h"
+
 namespace unwindstack {
 
+LocalUnwinder::~LocalUnwinder() {
+  if (init_thread_.joinable()) {
+    init_thread_.join();
+  }
+}
+
 bool LocalUnwinder::Init() {
   pthread_rwlock_init(&maps_rwlock_, nullptr);
 
+  if (lazy_init_) {
+    return true;
+  }
+  return InitOnce();
+}
+
+void LocalUnwinder::InitInBackground() {
+  if (!lazy_init_ || init_thread_.joinable()) {
+    return;
+  }
+  init_thread_ = std::thread([this]() { InitOnce(); });
+}
+
+bool LocalUnwinder::InitOnce() {
+  std::call_once(init_once_, [this]() { init_result_ = InitState(); });
+  return init_result_;
+}
+
+bool LocalUnwinder::InitState() {
   // Create the maps.
   maps_.reset(new unwindstack::LocalUpdatableMaps());
-  if (!maps_->Parse()) {
+  bool parsed = maps_from_loaded_objects_ ? maps_->ParseLoadedObjects() : maps_->Parse();
+  if (!parsed) {
     maps_.reset();
     return false;
   }
 
-  process_memory_ = unwindstack::Memory::CreateProcessMemoryThreadCached(getpid());
+  if (direct_memory_reads_) {
+    // Direct reads are cheaper than copying pages into a cache.
+    process_memory_ = Memory::CreateLocalMemoryDirect(maps_.get());
+  } else {
+    process_memory_ = unwindstack::Memory::CreateProcessMemoryThreadCached(getpid());
+  }
 
   return true;
 }
 
+bool LocalUnwinder::PrepareSignalUnwind(size_t max_concurrent) {
+  if (!InitOnce() || max_concurrent == 0) {
+    return false;
+  }
+  // Maps built from the loaded objects have none of the stacks, which the
+  // frame pointer fallback looks up, and a signal unwind cannot parse the
+  // maps file to find them.
+  if (maps_from_loaded_objects_ && !maps_->Update(nullptr, nullptr)) {
+    return false;
+  }
+
+  // Local memory does not cache, so reads never allocate or lock. A fault
+  // safe read could be the first thread local access of the thread.
+  signal_memory_.reset(new MemoryLocal(false));
+  signal_regs_.clear();
+  for (size_t i = 0; i < max_concurrent; i++) {
+    signal_regs_.emplace_back(Regs::CreateFromLocal());
+  }
+  signal_regs_busy_.reset(new std::atomic_bool[max_concurrent]);
+  for (size_t i = 0; i < max_concurrent; i++) {
+    signal_regs_busy_[i] = false;
+  }
+
+  ArchEnum arch = Regs::CurrentArch();
+  for (const auto& map_info : *maps_) {
+    // Skip maps that cannot be read, such as [vsyscall].
+    if ((map_info->flags & (PROT_READ | PROT_EXEC)) == (PROT_READ | PROT_EXEC) &&
+        !(map_info->flags & MAPS_FLAGS_DEVICE_MAP)) {
+      Elf* elf = map_info->GetElf(process_memory_, arch);
+      elf->CompileUnwindTables();
+    }
+  }
+  return true;
+}
+
+// Steps through the frame record pointed to by the frame pointer, without
+// allocating or locking. The record has to be inside the stack map of the
+// sp, so reading it cannot fault, and has to return into an executable map.
+static bool StepFramePointerSignalSafe(LocalUpdatableMaps* maps, Regs* regs, Memory* memory) {
+  uint16_t fp_reg;
+  switch (ArchDispatch(regs->Arch())) {
+    case ARCH_ARM64:
+      fp_reg = ARM64_REG_R29;
+      break;
+    case ARCH_X86_64:
+      fp_reg = X86_64_REG_RBP;
+      break;
+    default:
+      return false;
+  }
+
+  RegsImpl<uint64_t>* regs64 = reinterpret_cast<RegsImpl<uint64_t>*>(regs);
+  uint64_t fp = (*regs64)[fp_reg];
+  uint64_t sp = regs->sp();
+  if (fp < sp || (fp & 7) != 0) {
+    return false;
+  }
+  MapInfo* stack_info = maps->TryFind(sp);
+  if (stack_info == nullptr || !(stack_info->flags & PROT_READ) || fp >= stack_info->end ||
+      stack_info->end - fp < 16) {
+    return false;
+  }
+
+  uint64_t record[2];
+  if (!memory->ReadFully(fp, record, sizeof(record))) {
+    return false;
+  }
+  // The saved lr of a function that signs it is signed.
+  uint64_t return_address = record[1];
+  if (regs->Arch() == ARCH_ARM64) {
+    return_address = static_cast<RegsArm64*>(regs)->StripPAC(return_address);
+  }
+  MapInfo* pc_info = maps->TryFind(return_address);
+  if (pc_info == nullptr || !(pc_info->flags & PROT_EXEC)) {
+    return false;
+  }
+
+  regs->ResetPseudoRegisters();
+  (*regs64)[fp_reg] = record[0];
+  if (regs->Arch() == ARCH_ARM64) {
+    (*regs64)[ARM64_REG_LR] = record[1];
+  }
+  regs->set_sp(fp + 16);
+  regs->set_pc(return_address);
+  return true;
+}
+
+size_t LocalUnwinder::UnwindFromSignal(void* ucontext, uint64_t* pcs, uint64_t* sps,
+                                       size_t max_frames) {
+  Regs* regs = nullptr;
+  size_t regs_index;
+  for (regs_index = 0; regs_index < signal_regs_.size(); regs_index++) {
+    if (!signal_regs_busy_[regs_index].exchange(true)) {
+      regs = signal_regs_[regs_index].get();
+      break;
+    }
+  }
+  if (regs == nullptr) {
+    return 0;
+  }
+  Regs::SetFromLocalUcontext(regs, ucontext);
+  ArchEnum arch = regs->Arch();
+
+  size_t num_frames = 0;
+  bool adjust_pc = false;
+  while (num_frames < max_frames) {
+    uint64_t cur_pc = regs->pc();
+    uint64_t cur_sp = regs->sp();
+
+    MapInfo* map_info = maps_->TryFind(cur_pc);
+    Elf* elf = map_info != nullptr ? map_info->GetElfIfCreated() : nullptr;
+    uint64_t rel_pc = 0;
+    uint64_t pc_adjustment = 0;
+    if (elf != nullptr) {
+      rel_pc = elf->GetRelPc(cur_pc, map_info);
+      if (adjust_pc) {
+        pc_adjustment = GetPcAdjustment(rel_pc, elf, arch);
+      }
+    }
+    pcs[num_frames] = cur_pc - pc_adjustment;
+    if (sps != nullptr) {
+      sps[num_frames] = cur_sp;
+    }
+    num_frames++;
+
+    bool finished = false;
+    bool is_signal_frame = false;
+    Regs::Snapshot snapshot;
+    if (signal_frame_pointer_fallback_) {
+      regs->SaveSnapshot(&snapshot);
+    }
+    if (elf == nullptr ||
+        (!elf->StepIfSignalHandler(rel_pc, regs, signal_memory_.get()) &&
+         !elf->StepSignalSafe(rel_pc - pc_adjustment, regs, signal_memory_.get(), &finished,
+                              &is_signal_frame))) {
+      if (!signal_frame_pointer_fallback_) {
+        break;
+      }
+      // The failed step can leave some registers changed.
+      regs->RestoreSnapshot(snapshot);
+      if (!StepFramePointerSignalSafe(maps_.get(), regs, signal_memory_.get())) {
+        break;
+      }
+      finished = false;
+    }
+    if (finished || (cur_pc == regs->pc() && cur_sp == regs->sp())) {
+      break;
+    }
+    adjust_pc = true;
+  }
+
+  signal_regs_busy_[regs_index] = false;
+  return num_frames;
+}
+
 bool LocalUnwinder::ShouldSkipLibrary(const std::string& map_name) {
   for (const std::string& skip_library : skip_libraries_) {
     if (skip_library == map_name) {
@@ -68,6 +263,10 @@ bool LocalUnwinder::ShouldSkipLibrary(const std::string& map_name) {
 }
 
 bool LocalUnwinder::Unwind(std::vector<LocalFrameData>* frame_info, size_t max_frames) {
+  if (!InitOnce()) {
+    return false;
+  }
+
   std::unique_ptr<unwindstack::Regs> regs(unwindstack::Regs::CreateFromLocal());
   unwindstack::RegsGetLocal(regs.get());
   ArchEnum arch = regs->Arch();
@@ -107,7 +306,7 @@ bool LocalUnwinder::Unwind(std::vector<LocalFrameData>* frame_info, size_t max_f
     }
 
     // Skip any locations that are within this library.
-    if (num_frames != 0 || !ShouldSkipLibrary(map_info->name)) {
+    if (num_frames != 0 || !skip_filter_.MatchesName(map_info)) {
       // Add frame information.
       SharedString func_name;
       uint64_t func_offset;
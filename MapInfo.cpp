@@ -28,12 +28,66 @@
 #include <unwindstack/Elf.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
+#include <unwindstack/SymbolStore.h>
 
+#include "FailedFileCache.h"
+#include "FileInfoCache.h"
+#include "MemoryElfCache.h"
 #include "MemoryFileAtOffset.h"
 #include "MemoryRange.h"
 
 namespace unwindstack {
 
+bool MapInfo::file_info_cache_enabled_ = false;
+FileInfoCache* MapInfo::file_info_cache_ = nullptr;
+
+void MapInfo::SetFileInfoCacheEnabled(bool enable) {
+  if (!file_info_cache_enabled_ && enable) {
+    file_info_cache_enabled_ = true;
+    file_info_cache_ = new FileInfoCache;
+  } else if (file_info_cache_enabled_ && !enable) {
+    file_info_cache_enabled_ = false;
+    delete file_info_cache_;
+    file_info_cache_ = nullptr;
+  }
+}
+
+void MapInfo::ClearFileInfoCache() {
+  if (file_info_cache_enabled_) {
+    file_info_cache_->Clear();
+  }
+}
+
+FailedFileCache* MapInfo::failed_file_cache_ = nullptr;
+
+void MapInfo::SetFailedFileCacheTtl(std::chrono::milliseconds ttl) {
+  if (ttl.count() == 0) {
+    delete failed_file_cache_;
+    failed_file_cache_ = nullptr;
+  } else if (failed_file_cache_ == nullptr) {
+    failed_file_cache_ = new FailedFileCache(ttl);
+  } else {
+    failed_file_cache_->SetTtl(ttl);
+  }
+}
+
+MemoryElfCache* MapInfo::memory_elf_cache_ = nullptr;
+
+void MapInfo::SetMemoryElfCacheEnabled(bool enable) {
+  if (memory_elf_cache_ == nullptr && enable) {
+    memory_elf_cache_ = new MemoryElfCache;
+  } else if (memory_elf_cache_ != nullptr && !enable) {
+    delete memory_elf_cache_;
+    memory_elf_cache_ = nullptr;
+  }
+}
+
+void MapInfo::ClearMemoryElfCache() {
+  if (memory_elf_cache_ != nullptr) {
+    memory_elf_cache_->Clear();
+  }
+}
+
 bool MapInfo::InitFileMemoryFromPreviousReadOnlyMap(MemoryFileAtOffset* memory) {
   // One last attempt, see if the previous map is read-only with the
   // same name and stretches across this map.
@@ -133,7 +187,37 @@ Memory* MapInfo::GetFileMemory() {
   return nullptr;
 }
 
+// Creates the memory of an elf whose start is in one map and whose rest,
+// starting at second_offset in the elf, is in a second map. The maps of an
+// elf are usually adjacent, with the same distance between their starts as
+// between their offsets, and then a single range covers both, so that the
+// reads go straight to the process memory instead of looking up a range of
+// a MemoryRanges first.
+static Memory* CreateSplitElfMemory(const std::shared_ptr<Memory>& process_memory,
+                                    uint64_t first_start, uint64_t first_end,
+                                    uint64_t second_start, uint64_t second_end,
+                                    uint64_t second_offset) {
+  if (first_end == second_start && second_start - first_start == second_offset) {
+    return new MemoryRange(process_memory, first_start, second_end - first_start, 0);
+  }
+
+  MemoryRanges* ranges = new MemoryRanges;
+  ranges->Insert(new MemoryRange(process_memory, first_start, first_end - first_start, 0));
+  ranges->Insert(
+      new MemoryRange(process_memory, second_start, second_end - second_start, second_offset));
+  return ranges;
+}
+
 Memory* MapInfo::CreateMemory(const std::shared_ptr<Memory>& process_memory) {
+  uint64_t failed_elf_offset;
+  uint64_t failed_elf_start_offset;
+  bool use_file = failed_file_cache_ == nullptr || name.empty() ||
+                  failed_file_cache_->Find(this, &failed_elf_offset, &failed_elf_start_offset) !=
+                      FailedFileCache::FAILURE_NO_FILE_MEMORY;
+  return CreateMemory(process_memory, use_file);
+}
+
+Memory* MapInfo::CreateMemory(const std::shared_ptr<Memory>& process_memory, bool use_file) {
   if (end <= start) {
     return nullptr;
   }
@@ -146,11 +230,14 @@ Memory* MapInfo::CreateMemory(const std::shared_ptr<Memory>& process_memory) {
   }
 
   // First try and use the file associated with the info.
-  if (!name.empty()) {
+  if (!name.empty() && use_file) {
     Memory* memory = GetFileMemory();
     if (memory != nullptr) {
       return memory;
     }
+    if (failed_file_cache_ != nullptr) {
+      failed_file_cache_->Add(this, FailedFileCache::FAILURE_NO_FILE_MEMORY);
+    }
   }
 
   if (process_memory == nullptr) {
@@ -177,13 +264,8 @@ Memory* MapInfo::CreateMemory(const std::shared_ptr<Memory>& process_memory) {
     // in the next map. Since this should be a very uncommon path, just
     // redo the work. If this happens, the elf for this map will eventually
     // be discarded.
-    MemoryRanges* ranges = new MemoryRanges;
-    ranges->Insert(new MemoryRange(process_memory, start, end - start, 0));
-    ranges->Insert(new MemoryRange(process_memory, next_real_map->start,
-                                   next_real_map->end - next_real_map->start,
-                                   next_real_map->offset - offset));
-
-    return ranges;
+    return CreateSplitElfMemory(process_memory, start, end, next_real_map->start,
+                                next_real_map->end, next_real_map->offset - offset);
   }
 
   // Find the read-only map by looking at the previous map. The linker
@@ -202,64 +284,216 @@ Memory* MapInfo::CreateMemory(const std::shared_ptr<Memory>& process_memory) {
   // the r-x section, which is not quite the right information.
   elf_start_offset = prev_real_map->offset;
 
-  MemoryRanges* ranges = new MemoryRanges;
-  ranges->Insert(new MemoryRange(process_memory, prev_real_map->start,
-                                 prev_real_map->end - prev_real_map->start, 0));
-  ranges->Insert(new MemoryRange(process_memory, start, end - start, elf_offset));
+  return CreateSplitElfMemory(process_memory, prev_real_map->start, prev_real_map->end, start, end,
+                              elf_offset);
+}
+
+bool MapInfo::GetElfFromSymbolStore(ArchEnum expected_arch) {
+  SharedString* id = build_id.load();
+  if (id == nullptr || id->empty()) {
+    return false;
+  }
+  std::shared_ptr<Elf> store_elf = Elf::GetSymbolStore()->Find(*id, expected_arch);
+  if (store_elf == nullptr) {
+    return false;
+  }
+
+  // The store has the whole elf, so only the start of the elf in the file
+  // of the map is needed. Like the file case, a read-only map of the same
+  // file before this one is taken to be the start of the elf, and otherwise
+  // the elf starts at the offset of this map.
+  if (prev_real_map != nullptr && prev_real_map->flags == PROT_READ &&
+      prev_real_map->name == name && prev_real_map->offset < offset) {
+    elf_start_offset = prev_real_map->offset;
+  } else {
+    elf_start_offset = offset;
+  }
+  elf_offset = offset - elf_start_offset;
+  elf = std::move(store_elf);
+  return true;
+}
+
+// The memory of every read-only map of the elf that info is a map of, as
+// would be read from the file. The memory made by CreateMemory only covers
+// the maps with the start of the elf and the code, this also has the data
+// that is mapped after them, such as the eh_frame_hdr.
+static Memory* CreateLoadedElfMemory(MapInfo* info, const std::shared_ptr<Memory>& process_memory) {
+  uint64_t elf_file_start = info->offset - info->elf_offset;
+  MapInfo* first = info;
+  while (first->prev_real_map != nullptr && first->prev_real_map->name == info->name &&
+         first->prev_real_map->offset >= elf_file_start) {
+    first = first->prev_real_map;
+  }
 
+  MemoryRanges* ranges = new MemoryRanges;
+  for (MapInfo* cur = first; cur != nullptr && cur->name == info->name; cur = cur->next_real_map) {
+    if (cur->offset < elf_file_start || (cur->flags & (PROT_READ | PROT_WRITE)) != PROT_READ ||
+        (cur->flags & MAPS_FLAGS_DEVICE_MAP)) {
+      continue;
+    }
+    ranges->Insert(new MemoryRange(process_memory, cur->start, cur->end - cur->start,
+                                   cur->offset - elf_file_start));
+  }
   return ranges;
 }
 
+// Returns true if the elf was found in the cache. Otherwise, if it can be
+// cached, memory is replaced by a copy to make the elf from, and build_id
+// is set.
+bool MapInfo::GetElfFromMemoryElfCache(const std::shared_ptr<Memory>& process_memory,
+                                       Memory** memory, ArchEnum expected_arch,
+                                       std::string* build_id) {
+  // Only the headers and the notes are read from the process, which are at
+  // the start of the elf.
+  uint64_t loaded_size;
+  if (!Elf::GetLoadedInfo(*memory, build_id, &loaded_size) || build_id->empty()) {
+    build_id->clear();
+    return false;
+  }
+
+  std::shared_ptr<Elf> cached_elf = memory_elf_cache_->Find(*build_id, expected_arch);
+  if (cached_elf != nullptr) {
+    delete *memory;
+    *memory = nullptr;
+    elf = std::move(cached_elf);
+    SetBuildID(std::move(*build_id));
+    return true;
+  }
+
+  // The elf to cache must not read from this process. Without a name, the
+  // maps of the elf cannot be told apart from the maps around it.
+  Memory* copy;
+  if (name.empty()) {
+    copy = MemoryElfCache::CopyMemory(*memory, loaded_size);
+  } else {
+    std::unique_ptr<Memory> loaded_memory(CreateLoadedElfMemory(this, process_memory));
+    copy = MemoryElfCache::CopyMemory(loaded_memory.get(), loaded_size);
+  }
+  if (copy == nullptr) {
+    build_id->clear();
+    return false;
+  }
+  delete *memory;
+  *memory = copy;
+  return false;
+}
+
+Elf* MapInfo::GetElfIfCreated() {
+  Elf* published = published_elf_.load(std::memory_order_acquire);
+  if (published != nullptr) {
+    return published;
+  }
+  std::unique_lock<std::mutex> guard(mutex_, std::try_to_lock);
+  if (!guard.owns_lock()) {
+    return nullptr;
+  }
+  return elf.get();
+}
+
+Elf* MapInfo::PublishElf() {
+  published_elf_.store(elf.get(), std::memory_order_release);
+  return elf.get();
+}
+
 Elf* MapInfo::GetElf(const std::shared_ptr<Memory>& process_memory, ArchEnum expected_arch) {
-  {
-    // Make sure no other thread is trying to add the elf to this map.
-    std::lock_guard<std::mutex> guard(mutex_);
+  // Once published, the elf never changes, so there is no need to lock.
+  Elf* published = published_elf_.load(std::memory_order_acquire);
+  if (published != nullptr) {
+    return published;
+  }
 
-    if (elf.get() != nullptr) {
-      return elf.get();
-    }
+  // Make sure no other thread is trying to add the elf to this map.
+  std::lock_guard<std::mutex> guard(mutex_);
 
-    bool locked = false;
-    if (Elf::CachingEnabled() && !name.empty()) {
-      Elf::CacheLock();
-      locked = true;
-      if (Elf::CacheGet(this)) {
-        Elf::CacheUnlock();
-        return elf.get();
-      }
+  if (elf.get() != nullptr) {
+    return PublishElf();
+  }
+
+  if (base_map != nullptr) {
+    // The base map creates the elf once for every process forked from it.
+    // This map is always locked before its base map.
+    base_map->GetElf(process_memory, expected_arch);
+    std::lock_guard<std::mutex> base_guard(base_map->mutex_);
+    CopyElfLocked(base_map);
+    return elf.get();
+  }
+
+  if (Elf::GetSymbolStore() != nullptr && GetElfFromSymbolStore(expected_arch)) {
+    return PublishElf();
+  }
+
+  bool locked = false;
+  if (Elf::CachingEnabled() && !name.empty()) {
+    // Most lookups find an existing entry, try that in shared mode first.
+    if (Elf::CacheFind(this)) {
+      return PublishElf();
     }
+    Elf::CacheLock(this);
+    locked = true;
+    if (Elf::CacheGet(this)) {
+      Elf::CacheUnlock(this);
+      return PublishElf();
+    }
+  }
 
-    Memory* memory = CreateMemory(process_memory);
+  // A file known not to contain a valid elf gets an invalid elf without
+  // being read, one known not to be readable is not tried.
+  FailedFileCache::Failure failure = FailedFileCache::FAILURE_NONE;
+  uint64_t failed_elf_offset;
+  uint64_t failed_elf_start_offset;
+  if (failed_file_cache_ != nullptr && !name.empty()) {
+    failure = failed_file_cache_->Find(this, &failed_elf_offset, &failed_elf_start_offset);
+  }
+  Memory* memory = nullptr;
+  if (failure == FailedFileCache::FAILURE_INVALID_ELF) {
+    elf_offset = failed_elf_offset;
+    elf_start_offset = failed_elf_start_offset;
+  } else {
+    memory = CreateMemory(process_memory, failure != FailedFileCache::FAILURE_NO_FILE_MEMORY);
     if (locked) {
       if (Elf::CacheAfterCreateMemory(this)) {
         delete memory;
-        Elf::CacheUnlock();
-        return elf.get();
+        Elf::CacheUnlock(this);
+        return PublishElf();
       }
     }
+  }
+  // The build id of an elf read from the process memory, if it is to be
+  // added to the memory elf cache.
+  std::string memory_build_id;
+  if (memory == nullptr || !memory_backed_elf || memory_elf_cache_ == nullptr ||
+      !GetElfFromMemoryElfCache(process_memory, &memory, expected_arch, &memory_build_id)) {
+    bool file_memory = memory != nullptr && !memory_backed_elf;
     elf.reset(new Elf(memory));
     // If the init fails, keep the elf around as an invalid object so we
     // don't try to reinit the object.
     elf->Init();
+    if (!elf->valid() && file_memory && failed_file_cache_ != nullptr) {
+      failed_file_cache_->Add(this, FailedFileCache::FAILURE_INVALID_ELF);
+    }
     if (elf->valid() && expected_arch != elf->arch()) {
       // Make the elf invalid, mismatch between arch and expected arch.
       elf->Invalidate();
     }
-
-    if (locked) {
-      Elf::CacheAdd(this);
-      Elf::CacheUnlock();
+    if (elf->valid() && !memory_build_id.empty()) {
+      memory_elf_cache_->Add(memory_build_id, elf);
     }
   }
 
+  if (locked) {
+    Elf::CacheAdd(this);
+    Elf::CacheUnlock(this);
+  }
+
   if (!elf->valid()) {
     elf_start_offset = offset;
   } else if (prev_real_map != nullptr && elf_start_offset != offset &&
              prev_real_map->offset == elf_start_offset && prev_real_map->name == name) {
     // If there is a read-only map then a read-execute map that represents the
     // same elf object, make sure the previous map is using the same elf
-    // object if it hasn't already been set.
-    std::lock_guard<std::mutex> guard(prev_real_map->mutex_);
+    // object if it hasn't already been set. The previous map is always
+    // locked after this one, so the locks cannot be taken in the other order.
+    std::lock_guard<std::mutex> prev_guard(prev_real_map->mutex_);
     if (prev_real_map->elf.get() == nullptr) {
       prev_real_map->elf = elf;
       prev_real_map->memory_backed_elf = memory_backed_elf;
@@ -268,20 +502,46 @@ Elf* MapInfo::GetElf(const std::shared_ptr<Memory>& process_memory, ArchEnum exp
       elf = prev_real_map->elf;
     }
   }
-  return elf.get();
+  return PublishElf();
 }
 
 bool MapInfo::GetFunctionName(uint64_t addr, SharedString* name, uint64_t* func_offset) {
-  {
+  Elf* elf_ptr = published_elf_.load(std::memory_order_acquire);
+  if (elf_ptr == nullptr) {
     // Make sure no other thread is trying to update this elf object.
     std::lock_guard<std::mutex> guard(mutex_);
     if (elf == nullptr) {
       return false;
     }
+    elf_ptr = elf.get();
   }
   // No longer need the lock, once the elf object is created, it is not deleted
   // until this object is deleted.
-  return elf->GetFunctionName(addr, name, func_offset);
+  return elf_ptr->GetFunctionName(addr, name, func_offset);
+}
+
+void MapInfo::ShareElf(MapInfo* other) {
+  // This map is not in use yet, so the locks cannot be taken in the other
+  // order.
+  std::lock_guard<std::mutex> other_guard(other->mutex_);
+  if (other->elf == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  CopyElfLocked(other);
+}
+
+void MapInfo::CopyElfLocked(MapInfo* other) {
+  elf = other->elf;
+  elf_offset = other->elf_offset;
+  elf_start_offset = other->elf_start_offset;
+  memory_backed_elf = other->memory_backed_elf;
+  load_bias = other->load_bias.load();
+  SharedString* other_build_id = other->build_id.load();
+  if (other_build_id != nullptr) {
+    SetBuildID(std::string(*other_build_id));
+  }
+  PublishElf();
 }
 
 uint64_t MapInfo::GetLoadBias(const std::shared_ptr<Memory>& process_memory) {
@@ -290,6 +550,12 @@ uint64_t MapInfo::GetLoadBias(const std::shared_ptr<Memory>& process_memory) {
     return cur_load_bias;
   }
 
+  if (base_map != nullptr) {
+    cur_load_bias = base_map->GetLoadBias(process_memory);
+    load_bias = cur_load_bias;
+    return cur_load_bias;
+  }
+
   {
     // Make sure no other thread is trying to add the elf to this map.
     std::lock_guard<std::mutex> guard(mutex_);
@@ -305,11 +571,27 @@ uint64_t MapInfo::GetLoadBias(const std::shared_ptr<Memory>& process_memory) {
     }
   }
 
+  FileInfoCache::Key key;
+  bool cacheable = file_info_cache_enabled_ && !(flags & MAPS_FLAGS_DEVICE_MAP) &&
+                   FileInfoCache::GetKey(this, &key);
+  FileInfoCache::Info info;
+  if (cacheable && file_info_cache_->Find(key, &info) && info.load_bias != INT64_MAX) {
+    elf_offset = info.elf_offset;
+    elf_start_offset = info.elf_start_offset;
+    load_bias = info.load_bias;
+    return info.load_bias;
+  }
+
   // Call lightweight static function that will only read enough of the
   // elf data to get the load bias.
   std::unique_ptr<Memory> memory(CreateMemory(process_memory));
   cur_load_bias = Elf::GetLoadBias(memory.get());
   load_bias = cur_load_bias;
+  // Only the load bias read from the file itself is the same in every
+  // process.
+  if (cacheable && memory != nullptr && !memory_backed_elf) {
+    file_info_cache_->SetLoadBias(key, this, cur_load_bias);
+  }
   return cur_load_bias;
 }
 
@@ -317,6 +599,54 @@ MapInfo::~MapInfo() {
   delete build_id.load();
 }
 
+namespace {
+
+constexpr size_t kMapInfoSlabEntries = 64;
+
+union MapInfoSlot {
+  MapInfoSlot* next;
+  alignas(MapInfo) unsigned char data[sizeof(MapInfo)];
+};
+
+std::mutex g_map_info_slab_lock;
+MapInfoSlot* g_map_info_free_list = nullptr;
+
+}  // namespace
+
+void* MapInfo::operator new(size_t size) {
+  if (size != sizeof(MapInfo)) {
+    return ::operator new(size);
+  }
+
+  std::lock_guard<std::mutex> guard(g_map_info_slab_lock);
+  if (g_map_info_free_list == nullptr) {
+    // Slabs are never released, freed entries are reused by later maps.
+    MapInfoSlot* slab = new MapInfoSlot[kMapInfoSlabEntries];
+    for (size_t i = kMapInfoSlabEntries; i > 0; i--) {
+      slab[i - 1].next = g_map_info_free_list;
+      g_map_info_free_list = &slab[i - 1];
+    }
+  }
+  MapInfoSlot* slot = g_map_info_free_list;
+  g_map_info_free_list = slot->next;
+  return slot;
+}
+
+void MapInfo::operator delete(void* ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (size != sizeof(MapInfo)) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(g_map_info_slab_lock);
+  MapInfoSlot* slot = reinterpret_cast<MapInfoSlot*>(ptr);
+  slot->next = g_map_info_free_list;
+  g_map_info_free_list = slot;
+}
+
 SharedString MapInfo::GetBuildID() {
   SharedString* id = build_id.load();
   if (id != nullptr) {
@@ -329,19 +659,36 @@ SharedString MapInfo::GetBuildID() {
 
   // Now need to see if the elf object exists.
   // Make sure no other thread is trying to add the elf to this map.
-  mutex_.lock();
-  Elf* elf_obj = elf.get();
-  mutex_.unlock();
+  Elf* elf_obj = published_elf_.load(std::memory_order_acquire);
+  if (elf_obj == nullptr) {
+    mutex_.lock();
+    elf_obj = elf.get();
+    mutex_.unlock();
+  }
   std::string result;
   if (elf_obj != nullptr) {
     result = elf_obj->GetBuildID();
+  } else if (base_map != nullptr) {
+    result = base_map->GetBuildID();
   } else {
+    FileInfoCache::Key key;
+    bool cacheable = file_info_cache_enabled_ && FileInfoCache::GetKey(this, &key);
+    FileInfoCache::Info info;
+    if (cacheable && file_info_cache_->Find(key, &info) && info.has_build_id) {
+      elf_offset = info.elf_offset;
+      elf_start_offset = info.elf_start_offset;
+      return SetBuildID(std::move(info.build_id));
+    }
+
     // This will only work if we can get the file associated with this memory.
     // If this is only available in memory, then the section name information
     // is not present and we will not be able to find the build id info.
     std::unique_ptr<Memory> memory(GetFileMemory());
     if (memory != nullptr) {
       result = Elf::GetBuildID(memory.get());
+      if (cacheable) {
+        file_info_cache_->SetBuildID(key, this, result);
+      }
     }
   }
   return SetBuildID(std::move(result));
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/MapNameFilter.h>
+
+namespace unwindstack {
+
+static std::atomic_uint64_t g_filter_generation;
+
+void MapNameFilter::Set(const std::vector<std::string>* names,
+                        const std::vector<std::string>* suffixes, bool full_names) {
+  bool has_names = names != nullptr && !names->empty();
+  bool has_suffixes = suffixes != nullptr && !suffixes->empty();
+  if (generation_ != 0 && has_names == has_names_ && has_suffixes == has_suffixes_ &&
+      full_names == full_names_ && (!has_names || *names == names_) &&
+      (!has_suffixes || *suffixes == suffixes_)) {
+    return;
+  }
+  has_names_ = has_names;
+  has_suffixes_ = has_suffixes;
+  full_names_ = full_names;
+  names_ = has_names ? *names : std::vector<std::string>();
+  suffixes_ = has_suffixes ? *suffixes : std::vector<std::string>();
+  generation_ = g_filter_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+uint64_t MapNameFilter::Flags(MapInfo* info) {
+  uint64_t value = info->filter_flags.load(std::memory_order_relaxed);
+  if ((value >> kFlagBits) == generation_) {
+    return value;
+  }
+
+  std::string_view name = info->name;
+  uint64_t flags = 0;
+  std::string_view match_name = name;
+  if (!full_names_) {
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string_view::npos) {
+      match_name = name.substr(slash + 1);
+    }
+  }
+  if (std::find(names_.begin(), names_.end(), match_name) != names_.end()) {
+    flags |= kNameMatch;
+  }
+  size_t dot = name.find_last_of('.');
+  if (dot != std::string_view::npos &&
+      std::find(suffixes_.begin(), suffixes_.end(), name.substr(dot + 1)) != suffixes_.end()) {
+    flags |= kSuffixMatch;
+  }
+  // Maps can be shared between unwinders with different filters, the last
+  // one to look at the map keeps its result there.
+  info->filter_flags.store((generation_ << kFlagBits) | flags, std::memory_order_relaxed);
+  return flags;
+}
+
+}  // namespace unwindstack
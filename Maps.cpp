@@ -17,9 +17,12 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <link.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/auxv.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -29,54 +32,224 @@
 
 #include <algorithm>
 #include <cctype>
+#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <unwindstack/Elf.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
+#include "MemoryUsage.h"
+
 namespace unwindstack {
 
-MapInfo* Maps::Find(uint64_t pc) {
-  if (maps_.empty()) {
-    return nullptr;
-  }
-  size_t first = 0;
-  size_t last = maps_.size();
+template <typename Entries, typename GetRange>
+static size_t FindIndex(const Entries& entries, size_t first, size_t last, uint64_t pc,
+                        GetRange get_range) {
   while (first < last) {
     size_t index = (first + last) / 2;
-    const auto& cur = maps_[index];
-    if (pc >= cur->start && pc < cur->end) {
-      return cur.get();
-    } else if (pc < cur->start) {
+    uint64_t start, end;
+    get_range(entries[index], &start, &end);
+    if (pc >= start && pc < end) {
+      return index;
+    } else if (pc < start) {
       last = index;
     } else {
       first = index + 1;
     }
   }
-  return nullptr;
+  return entries.size();
 }
 
-bool Maps::Parse() {
+// Lists with fewer ranges fit in a few pages and are searched directly.
+static constexpr size_t kMinIndexedRanges = 1024;
+// The index has the start of every kRangeIndexStride-th range, so a lookup
+// only searches the small index and then one block of 1 KiB of ranges.
+static constexpr size_t kRangeIndexStride = 64;
+
+static void BuildRangeIndex(const std::vector<Maps::MapRange>& ranges,
+                            std::vector<uint64_t>* index) {
+  index->clear();
+  if (ranges.size() < kMinIndexedRanges) {
+    return;
+  }
+  index->reserve((ranges.size() + kRangeIndexStride - 1) / kRangeIndexStride);
+  for (size_t i = 0; i < ranges.size(); i += kRangeIndexStride) {
+    index->push_back(ranges[i].start);
+  }
+}
+
+static size_t FindRange(const std::vector<Maps::MapRange>& ranges,
+                        const std::vector<uint64_t>& index, uint64_t pc) {
+  auto get_range = [](const Maps::MapRange& range, uint64_t* start, uint64_t* end) {
+    *start = range.start;
+    *end = range.end;
+  };
+  if (index.empty()) {
+    return FindIndex(ranges, 0, ranges.size(), pc, get_range);
+  }
+  size_t block = std::upper_bound(index.begin(), index.end(), pc) - index.begin();
+  if (block == 0) {
+    return ranges.size();
+  }
+  size_t first = (block - 1) * kRangeIndexStride;
+  return FindIndex(ranges, first, std::min(first + kRangeIndexStride, ranges.size()), pc,
+                   get_range);
+}
+
+MapInfo* Maps::Find(uint64_t pc) {
+  if (maps_.empty()) {
+    return nullptr;
+  }
+  size_t index;
+  if (ranges_.size() == maps_.size()) {
+    index = FindRange(ranges_, range_index_, pc);
+  } else {
+    // maps_ was modified without updating the ranges.
+    index = FindIndex(maps_, 0, maps_.size(), pc,
+                      [](const std::unique_ptr<MapInfo>& info, uint64_t* start, uint64_t* end) {
+                        *start = info->start;
+                        *end = info->end;
+                      });
+  }
+  if (index == maps_.size()) {
+    return nullptr;
+  }
+  return maps_[index].get();
+}
+
+MapInfo* Maps::FindPc(uint64_t pc) {
+  if (ranges_.size() == maps_.size()) {
+    size_t index = FindIndex(exec_ranges_, 0, exec_ranges_.size(), pc,
+                             [](const MapRange& range, uint64_t* start, uint64_t* end) {
+                               *start = range.start;
+                               *end = range.end;
+                             });
+    if (index != exec_ranges_.size()) {
+      return maps_[exec_indices_[index]].get();
+    }
+  }
+  // A pc can still be in a map that is not executable, such as after a bad
+  // step.
+  return Find(pc);
+}
+
+Maps::Maps(Maps&& other)
+    : maps_(std::move(other.maps_)),
+      ranges_(std::move(other.ranges_)),
+      range_index_(std::move(other.range_index_)),
+      exec_ranges_(std::move(other.exec_ranges_)),
+      exec_indices_(std::move(other.exec_indices_)),
+      names_(std::move(other.names_)),
+      generation_(other.generation_.load()) {}
+
+Maps& Maps::operator=(Maps&& other) {
+  maps_ = std::move(other.maps_);
+  ranges_ = std::move(other.ranges_);
+  range_index_ = std::move(other.range_index_);
+  exec_ranges_ = std::move(other.exec_ranges_);
+  exec_indices_ = std::move(other.exec_indices_);
+  names_ = std::move(other.names_);
+  generation_ = generation_ + other.generation_ + 1;
+  return *this;
+}
+
+void Maps::UpdateRanges() {
+  ranges_.resize(maps_.size());
+  for (size_t i = 0; i < maps_.size(); i++) {
+    ranges_[i].start = maps_[i]->start;
+    ranges_[i].end = maps_[i]->end;
+  }
+  BuildRangeIndex(ranges_, &range_index_);
+
+  exec_ranges_.clear();
+  exec_indices_.clear();
+  for (size_t i = 0; i < maps_.size(); i++) {
+    AddExecRange(i);
+  }
+}
+
+void Maps::AddExecRange(size_t index) {
+  const MapInfo* map_info = maps_[index].get();
+  if (map_info->flags & (PROT_EXEC | MAPS_FLAGS_JIT_SYMFILE_MAP)) {
+    exec_ranges_.push_back(MapRange{map_info->start, map_info->end});
+    exec_indices_.push_back(index);
+  }
+}
+
+SharedString Maps::InternName(std::string_view name) {
+  auto entry = names_.find(name);
+  if (entry != names_.end()) {
+    return entry->second;
+  }
+  SharedString interned = Elf::InternNamesEnabled()
+                              ? SharedString::Intern(name)
+                              : SharedString(std::string(name.data(), name.size()));
+  // The key points into the string owned by the value.
+  names_.emplace(static_cast<std::string_view>(interned), interned);
+  return interned;
+}
+
+// Reads the whole file straight into content. The chunks are much larger
+// than BUFSIZ so that a big maps file only takes a few reads.
+static bool ReadMapsFile(const std::string& file, std::string* content) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return false;
+  }
+
+  constexpr size_t kChunkSize = 64 * 1024;
+  size_t size = 0;
+  while (true) {
+    content->resize(size + kChunkSize);
+    ssize_t bytes = TEMP_FAILURE_RETRY(read(fd.get(), &(*content)[size], kChunkSize));
+    if (bytes < 0) {
+      return false;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    size += bytes;
+  }
+  content->resize(size);
+  return true;
+}
+
+bool Maps::ParseContent(char* content) {
   MapInfo* prev_map = nullptr;
   MapInfo* prev_real_map = nullptr;
-  return android::procinfo::ReadMapFile(GetMapsFile(),
-                      [&](const android::procinfo::MapInfo& mapinfo) {
-    // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-    auto flags = mapinfo.flags;
-    if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
-        strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
-      flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-    }
-    maps_.emplace_back(new MapInfo(prev_map, prev_real_map, mapinfo.start, mapinfo.end,
-                                   mapinfo.pgoff, flags, mapinfo.name));
-    prev_map = maps_.back().get();
-    if (!prev_map->IsBlank()) {
-      prev_real_map = prev_map;
-    }
-  });
+  bool parsed = android::procinfo::ReadMapFileContent(
+      content, [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t,
+                   const char* name, bool shared) {
+        // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
+        if (strncmp(name, "/dev/", 5) == 0 && strncmp(name + 5, "ashmem/", 7) != 0) {
+          flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
+        }
+        if (shared) {
+          flags |= unwindstack::MAPS_FLAGS_SHARED_MAP;
+        }
+        maps_.emplace_back(
+            new MapInfo(prev_map, prev_real_map, start, end, pgoff, flags, InternName(name)));
+        prev_map = maps_.back().get();
+        if (!prev_map->IsBlank()) {
+          prev_real_map = prev_map;
+        }
+      });
+  UpdateRanges();
+  return parsed;
+}
+
+bool Maps::Parse() {
+  std::string content;
+  if (!ReadMapsFile(GetMapsFile(), &content)) {
+    return false;
+  }
+  bool parsed = ParseContent(&content[0]);
+  generation_.fetch_add(1, std::memory_order_release);
+  return parsed;
 }
 
 void Maps::Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags,
@@ -87,10 +260,22 @@ void Maps::Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags,
     prev_real_map = prev_real_map->prev_map;
   }
 
-  auto map_info =
-      std::make_unique<MapInfo>(prev_map, prev_real_map, start, end, offset, flags, name);
+  auto map_info = std::make_unique<MapInfo>(prev_map, prev_real_map, start, end, offset, flags,
+                                            InternName(name));
   map_info->load_bias = load_bias;
   maps_.emplace_back(std::move(map_info));
+  if (ranges_.size() + 1 == maps_.size()) {
+    ranges_.push_back(MapRange{start, end});
+    if (ranges_.size() == kMinIndexedRanges) {
+      BuildRangeIndex(ranges_, &range_index_);
+    } else if (!range_index_.empty() && (ranges_.size() - 1) % kRangeIndexStride == 0) {
+      range_index_.push_back(start);
+    }
+    AddExecRange(maps_.size() - 1);
+  } else {
+    UpdateRanges();
+  }
+  generation_.fetch_add(1, std::memory_order_release);
 }
 
 void Maps::Sort() {
@@ -109,27 +294,33 @@ void Maps::Sort() {
       prev_real_map = prev_map;
     }
   }
+  UpdateRanges();
+  generation_.fetch_add(1, std::memory_order_release);
+}
+
+size_t Maps::MemoryUsage() {
+  size_t usage = sizeof(*this) + VectorMemoryUsage(maps_) + VectorMemoryUsage(ranges_) +
+                 VectorMemoryUsage(range_index_) + VectorMemoryUsage(exec_ranges_) +
+                 VectorMemoryUsage(exec_indices_) + HashMapMemoryUsage(names_);
+  // Every name is interned through names_, so each is counted once.
+  for (const auto& entry : names_) {
+    usage += entry.first.size();
+  }
+  for (const auto& map_info : maps_) {
+    usage += sizeof(MapInfo);
+    SharedString* build_id = map_info->build_id.load(std::memory_order_acquire);
+    if (build_id != nullptr) {
+      usage += sizeof(SharedString) + build_id->size();
+    }
+  }
+  return usage;
 }
 
 bool BufferMaps::Parse() {
   std::string content(buffer_);
-  MapInfo* prev_map = nullptr;
-  MapInfo* prev_real_map = nullptr;
-  return android::procinfo::ReadMapFileContent(
-      &content[0], [&](const android::procinfo::MapInfo& mapinfo) {
-        // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-        auto flags = mapinfo.flags;
-        if (strncmp(mapinfo.name.c_str(), "/dev/", 5) == 0 &&
-            strncmp(mapinfo.name.c_str() + 5, "ashmem/", 7) != 0) {
-          flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-        }
-        maps_.emplace_back(new MapInfo(prev_map, prev_real_map, mapinfo.start, mapinfo.end,
-                                       mapinfo.pgoff, flags, mapinfo.name));
-        prev_map = maps_.back().get();
-        if (!prev_map->IsBlank()) {
-          prev_real_map = prev_map;
-        }
-      });
+  bool parsed = ParseContent(&content[0]);
+  generation_.fetch_add(1, std::memory_order_release);
+  return parsed;
 }
 
 const std::string RemoteMaps::GetMapsFile() const {
@@ -145,16 +336,15 @@ LocalUpdatableMaps::LocalUpdatableMaps() : Maps() {
 }
 
 MapInfo* LocalUpdatableMaps::Find(uint64_t pc) {
-  pthread_rwlock_rdlock(&maps_rwlock_);
-  MapInfo* map_info = Maps::Find(pc);
-  pthread_rwlock_unlock(&maps_rwlock_);
-
+  MapInfo* map_info = FindInSnapshot(pc);
   if (map_info == nullptr) {
     pthread_rwlock_wrlock(&maps_rwlock_);
+    // Another thread might have reparsed while this one waited for the lock.
+    map_info = FindInSnapshot(pc);
     // This is guaranteed not to invalidate any previous MapInfo objects so
     // we don't need to worry about any MapInfo* values already in use.
-    if (Reparse()) {
-      map_info = Maps::Find(pc);
+    if (map_info == nullptr && Reparse()) {
+      map_info = FindInSnapshot(pc);
     }
     pthread_rwlock_unlock(&maps_rwlock_);
   }
@@ -162,32 +352,182 @@ MapInfo* LocalUpdatableMaps::Find(uint64_t pc) {
   return map_info;
 }
 
+MapInfo* LocalUpdatableMaps::TryFind(uint64_t pc) {
+  return FindInSnapshot(pc);
+}
+
+MapInfo* LocalUpdatableMaps::FindCurrent(uint64_t pc) {
+  pthread_rwlock_rdlock(&maps_rwlock_);
+  MapInfo* map_info = FindInSnapshot(pc);
+  pthread_rwlock_unlock(&maps_rwlock_);
+  return map_info;
+}
+
+MapInfo* LocalUpdatableMaps::FindInSnapshot(uint64_t pc) {
+  // Counted before the snapshot is loaded, so that PublishSnapshot never
+  // frees one that is still searched.
+  snapshot_readers_.fetch_add(1, std::memory_order_seq_cst);
+  Snapshot* snapshot = snapshot_.load(std::memory_order_seq_cst);
+  MapInfo* map_info = nullptr;
+  if (snapshot != nullptr) {
+    size_t index = FindRange(snapshot->ranges, snapshot->range_index, pc);
+    if (index != snapshot->maps.size()) {
+      map_info = snapshot->maps[index];
+    }
+  }
+  snapshot_readers_.fetch_sub(1, std::memory_order_release);
+  return map_info;
+}
+
+void LocalUpdatableMaps::PublishSnapshot() {
+  std::unique_ptr<Snapshot> snapshot(new Snapshot);
+  snapshot->ranges = ranges_;
+  snapshot->range_index = range_index_;
+  snapshot->maps.reserve(maps_.size());
+  for (const auto& map_info : maps_) {
+    snapshot->maps.push_back(map_info.get());
+  }
+  snapshot_.store(snapshot.get(), std::memory_order_seq_cst);
+  snapshots_.emplace_back(std::move(snapshot));
+  // A search that starts from now on finds the new snapshot, so without
+  // searches in progress none of the older ones can be in use. Otherwise
+  // they are freed by a later publish.
+  if (snapshots_.size() > 1 && snapshot_readers_.load(std::memory_order_seq_cst) == 0) {
+    snapshots_.erase(snapshots_.begin(), snapshots_.end() - 1);
+  }
+}
+
+size_t LocalUpdatableMaps::MemoryUsage() {
+  pthread_rwlock_rdlock(&maps_rwlock_);
+  size_t usage = Maps::MemoryUsage() + VectorMemoryUsage(saved_maps_) +
+                 saved_maps_.size() * sizeof(MapInfo) + VectorMemoryUsage(snapshots_);
+  for (const auto& snapshot : snapshots_) {
+    usage += sizeof(Snapshot) + VectorMemoryUsage(snapshot->ranges) +
+             VectorMemoryUsage(snapshot->range_index) + VectorMemoryUsage(snapshot->maps);
+  }
+  pthread_rwlock_unlock(&maps_rwlock_);
+  return usage;
+}
+
 bool LocalUpdatableMaps::Parse() {
   pthread_rwlock_wrlock(&maps_rwlock_);
-  bool parsed = Maps::Parse();
+  std::string content;
+  bool parsed = ReadMapsFile(GetMapsFile(), &content) && ParseContent(&content[0]);
+  PublishSnapshot();
+  generation_.fetch_add(1, std::memory_order_release);
   pthread_rwlock_unlock(&maps_rwlock_);
   return parsed;
 }
 
-bool LocalUpdatableMaps::Reparse() {
+namespace {
+
+struct LoadedSegment {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;
+  uint64_t flags;
+  std::string name;
+};
+
+struct LoadedObjects {
+  uint64_t page_size;
+  uint64_t vdso;
+  std::string exe;
+  std::vector<LoadedSegment> segments;
+};
+
+}  // namespace
+
+// Adds every loaded segment of info, with the bounds and offset rounded to
+// pages the way the loader maps them.
+static int AddLoadedObject(struct dl_phdr_info* info, size_t, void* data) {
+  LoadedObjects* objects = reinterpret_cast<LoadedObjects*>(data);
+  uint64_t page_mask = ~(objects->page_size - 1);
+  size_t first_segment = objects->segments.size();
+  for (size_t i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0) {
+      continue;
+    }
+    uint64_t start = info->dlpi_addr + phdr.p_vaddr;
+    uint64_t flags = 0;
+    if (phdr.p_flags & PF_R) flags |= PROT_READ;
+    if (phdr.p_flags & PF_W) flags |= PROT_WRITE;
+    if (phdr.p_flags & PF_X) flags |= PROT_EXEC;
+    objects->segments.push_back(LoadedSegment{
+        start & page_mask, (start + phdr.p_memsz + objects->page_size - 1) & page_mask,
+        phdr.p_offset & page_mask, flags, ""});
+  }
+  if (first_segment == objects->segments.size()) {
+    return 0;
+  }
+
+  // The main executable has no name, and the vdso has one that is not the
+  // name of a file.
+  std::string name = info->dlpi_name != nullptr ? info->dlpi_name : "";
+  if (objects->vdso != 0 && objects->segments[first_segment].start == objects->vdso) {
+    name = "[vdso]";
+  } else if (name.empty()) {
+    name = objects->exe;
+  }
+  for (size_t i = first_segment; i < objects->segments.size(); i++) {
+    objects->segments[i].name = name;
+  }
+  return 0;
+}
+
+bool LocalUpdatableMaps::ParseLoadedObjects() {
+  LoadedObjects objects;
+  objects.page_size = getpagesize();
+  objects.vdso = getauxval(AT_SYSINFO_EHDR) & ~(objects.page_size - 1);
+  char exe[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (len > 0) {
+    objects.exe.assign(exe, len);
+  }
+  dl_iterate_phdr(AddLoadedObject, &objects);
+
+  pthread_rwlock_wrlock(&maps_rwlock_);
+  for (const auto& segment : objects.segments) {
+    Add(segment.start, segment.end, segment.offset, segment.flags, segment.name, INT64_MAX);
+  }
+  Sort();
+  PublishSnapshot();
+  pthread_rwlock_unlock(&maps_rwlock_);
+  return !objects.segments.empty();
+}
+
+bool LocalUpdatableMaps::Update(std::vector<MapRange>* added, std::vector<MapRange>* removed) {
+  pthread_rwlock_wrlock(&maps_rwlock_);
+  bool parsed = Reparse(added, removed);
+  pthread_rwlock_unlock(&maps_rwlock_);
+  return parsed;
+}
+
+bool LocalUpdatableMaps::Reparse(std::vector<MapRange>* added, std::vector<MapRange>* removed) {
   // New maps will be added at the end without deleting the old ones.
   size_t last_map_idx = maps_.size();
-  if (!Maps::Parse()) {
+  std::string content;
+  if (!ReadMapsFile(GetMapsFile(), &content) || !ParseContent(&content[0])) {
     maps_.resize(last_map_idx);
+    UpdateRanges();
     return false;
   }
 
+  size_t saved_entries = saved_maps_.size();
   size_t total_entries = maps_.size();
   size_t search_map_idx = 0;
   for (size_t new_map_idx = last_map_idx; new_map_idx < maps_.size(); new_map_idx++) {
     auto& new_map_info = maps_[new_map_idx];
     uint64_t start = new_map_info->start;
     uint64_t end = new_map_info->end;
+    uint64_t offset = new_map_info->offset;
     uint64_t flags = new_map_info->flags;
     const std::string& name = new_map_info->name;
     for (size_t old_map_idx = search_map_idx; old_map_idx < last_map_idx; old_map_idx++) {
       auto& info = maps_[old_map_idx];
-      if (start == info->start && end == info->end && flags == info->flags && name == info->name) {
+      if (start == info->start && end == info->end && offset == info->offset &&
+          flags == info->flags && name == info->name) {
         // No need to check
         search_map_idx = old_map_idx + 1;
         if (new_map_idx + 1 < maps_.size()) {
@@ -207,6 +547,9 @@ bool LocalUpdatableMaps::Reparse() {
       // Never delete these maps, they may be in use. The assumption is
       // that there will only every be a handful of these so waiting
       // to destroy them is not too expensive.
+      if (removed != nullptr) {
+        removed->push_back(MapRange{info->start, info->end});
+      }
       saved_maps_.emplace_back(std::move(info));
       search_map_idx = old_map_idx + 1;
       maps_[old_map_idx] = nullptr;
@@ -219,11 +562,23 @@ bool LocalUpdatableMaps::Reparse() {
 
   // Now move out any of the maps that never were found.
   for (size_t i = search_map_idx; i < last_map_idx; i++) {
+    if (removed != nullptr) {
+      removed->push_back(MapRange{maps_[i]->start, maps_[i]->end});
+    }
     saved_maps_.emplace_back(std::move(maps_[i]));
     maps_[i] = nullptr;
     total_entries--;
   }
 
+  // Any new map that was not matched against an old one was added.
+  if (added != nullptr) {
+    for (size_t i = last_map_idx; i < maps_.size(); i++) {
+      if (maps_[i] != nullptr) {
+        added->push_back(MapRange{maps_[i]->start, maps_[i]->end});
+      }
+    }
+  }
+
   // Sort all of the values such that the nullptrs wind up at the end, then
   // resize them away.
   std::sort(maps_.begin(), maps_.end(), [](const auto& a, const auto& b) {
@@ -235,8 +590,252 @@ bool LocalUpdatableMaps::Reparse() {
     return a->start < b->start;
   });
   maps_.resize(total_entries);
+  UpdateRanges();
+  // Nothing was added or removed when no entry was saved and the count did
+  // not change, the current snapshot is still valid then.
+  if (snapshot_.load(std::memory_order_relaxed) == nullptr ||
+      saved_maps_.size() != saved_entries || total_entries != last_map_idx) {
+    // Publish first, a reader that sees the new generation must also see
+    // the new maps.
+    PublishSnapshot();
+    generation_.fetch_add(1, std::memory_order_release);
+  }
 
   return true;
 }
 
+// The maps file is compared in chunks of this size.
+static constexpr size_t kMapsHashChunkSize = 4096;
+
+static uint64_t HashChunk(const char* data, size_t size) {
+  return std::hash<std::string_view>()(std::string_view(data, size));
+}
+
+static void HashChunks(const std::string& content, std::vector<uint64_t>* hashes) {
+  hashes->clear();
+  for (size_t offset = 0; offset < content.size(); offset += kMapsHashChunkSize) {
+    hashes->push_back(
+        HashChunk(&content[offset], std::min(kMapsHashChunkSize, content.size() - offset)));
+  }
+}
+
+bool RemoteUpdatableMaps::Parse() {
+  std::string content;
+  if (!ReadMapsFile(GetMapsFile(), &content)) {
+    return false;
+  }
+  HashChunks(content, &chunk_hashes_);
+  bool parsed = ParseContent(&content[0]);
+  generation_.fetch_add(1, std::memory_order_release);
+  return parsed;
+}
+
+bool RemoteUpdatableMaps::Changed() {
+  std::string file(GetMapsFile());
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return true;
+  }
+  char buffer[kMapsHashChunkSize];
+  for (size_t index = 0;; index++) {
+    // A read of a proc file can return less than asked for before the end.
+    size_t size = 0;
+    while (size < sizeof(buffer)) {
+      ssize_t bytes = TEMP_FAILURE_RETRY(read(fd.get(), &buffer[size], sizeof(buffer) - size));
+      if (bytes < 0) {
+        return true;
+      }
+      if (bytes == 0) {
+        break;
+      }
+      size += bytes;
+    }
+    if (size == 0) {
+      return index != chunk_hashes_.size();
+    }
+    if (index >= chunk_hashes_.size() || HashChunk(buffer, size) != chunk_hashes_[index]) {
+      return true;
+    }
+    if (size < sizeof(buffer)) {
+      return index + 1 != chunk_hashes_.size();
+    }
+  }
+}
+
+bool RemoteUpdatableMaps::Update(bool* changed, std::vector<MapRange>* added,
+                                 std::vector<MapRange>* removed) {
+  if (changed != nullptr) {
+    *changed = false;
+  }
+  // The file is only read a second time, and parsed, when it changed.
+  if (!Changed()) {
+    return true;
+  }
+  std::string content;
+  if (!ReadMapsFile(GetMapsFile(), &content)) {
+    return false;
+  }
+  HashChunks(content, &chunk_hashes_);
+
+  std::vector<std::unique_ptr<MapInfo>> old_maps(std::move(maps_));
+  maps_.clear();
+  if (!ParseContent(&content[0])) {
+    maps_ = std::move(old_maps);
+    UpdateRanges();
+    chunk_hashes_.clear();
+    return false;
+  }
+
+  // Both lists are sorted by start, so an entry can only match the first
+  // old entry that does not start before it.
+  bool any_change = false;
+  size_t old_index = 0;
+  for (auto& map_info : maps_) {
+    while (old_index < old_maps.size() && old_maps[old_index]->start < map_info->start) {
+      if (removed != nullptr) {
+        removed->push_back(MapRange{old_maps[old_index]->start, old_maps[old_index]->end});
+      }
+      old_maps[old_index++].reset();
+      any_change = true;
+    }
+    if (old_index < old_maps.size()) {
+      const MapInfo* info = old_maps[old_index].get();
+      if (info->start == map_info->start && info->end == map_info->end &&
+          info->offset == map_info->offset && info->flags == map_info->flags &&
+          info->name == map_info->name) {
+        map_info = std::move(old_maps[old_index++]);
+        continue;
+      }
+    }
+    if (added != nullptr) {
+      added->push_back(MapRange{map_info->start, map_info->end});
+    }
+    any_change = true;
+  }
+  for (; old_index < old_maps.size(); old_index++) {
+    if (removed != nullptr) {
+      removed->push_back(MapRange{old_maps[old_index]->start, old_maps[old_index]->end});
+    }
+    any_change = true;
+  }
+
+  // The kept entries still point at their old neighbours.
+  MapInfo* prev_map = nullptr;
+  MapInfo* prev_real_map = nullptr;
+  for (const auto& map_info : maps_) {
+    map_info->prev_map = prev_map;
+    map_info->prev_real_map = prev_real_map;
+    map_info->next_real_map = nullptr;
+    if (prev_real_map != nullptr) {
+      prev_real_map->next_real_map = map_info.get();
+    }
+    prev_map = map_info.get();
+    if (!prev_map->IsBlank()) {
+      prev_real_map = prev_map;
+    }
+  }
+  UpdateRanges();
+  if (any_change) {
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+  if (changed != nullptr) {
+    *changed = any_change;
+  }
+  return true;
+}
+
+static bool SameMap(MapInfo* a, MapInfo* b) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  return a->start == b->start && a->end == b->end && a->offset == b->offset &&
+         a->flags == b->flags && a->name == b->name;
+}
+
+bool ForkedMaps::Parse() {
+  if (!RemoteMaps::Parse()) {
+    return false;
+  }
+  LinkBaseMaps();
+  return true;
+}
+
+void ForkedMaps::LinkBaseMaps() {
+  num_inherited_ = 0;
+  if (base_ == nullptr) {
+    return;
+  }
+  // Both lists are sorted by start, so an entry can only match the first
+  // base entry that does not start before it. The previous map decides
+  // where the elf of a map starts, so it has to be the same too.
+  auto base_it = base_->begin();
+  for (auto& map_info : maps_) {
+    while (base_it != base_->end() && (*base_it)->start < map_info->start) {
+      ++base_it;
+    }
+    if (base_it == base_->end()) {
+      break;
+    }
+    MapInfo* info = base_it->get();
+    if (SameMap(info, map_info.get()) &&
+        SameMap(info->prev_real_map, map_info->prev_real_map)) {
+      map_info->base_map = info;
+      num_inherited_++;
+    }
+  }
+}
+
+bool SharedMaps::Update(bool* changed) {
+  if (changed != nullptr) {
+    *changed = false;
+  }
+  std::lock_guard<std::mutex> update_guard(update_lock_);
+  std::shared_ptr<RemoteUpdatableMaps> old_maps;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    old_maps = maps_;
+  }
+  // Only the chunk hashes are read, which never change once parsed.
+  if (old_maps != nullptr && !old_maps->Changed()) {
+    return true;
+  }
+
+  auto new_maps = std::make_shared<RemoteUpdatableMaps>(pid_);
+  if (!new_maps->Parse()) {
+    return false;
+  }
+  if (old_maps != nullptr) {
+    // Both lists are sorted by start, so an entry can only match the first
+    // old entry that does not start before it.
+    auto old_it = old_maps->begin();
+    for (auto& map_info : *new_maps) {
+      while (old_it != old_maps->end() && (*old_it)->start < map_info->start) {
+        ++old_it;
+      }
+      if (old_it == old_maps->end()) {
+        break;
+      }
+      MapInfo* info = old_it->get();
+      if (info->start == map_info->start && info->end == map_info->end &&
+          info->offset == map_info->offset && info->flags == map_info->flags &&
+          info->name == map_info->name) {
+        map_info->ShareElf(info);
+      }
+    }
+    new_maps->generation_.store(old_maps->generation() + 1, std::memory_order_release);
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  maps_ = std::move(new_maps);
+  if (changed != nullptr) {
+    *changed = true;
+  }
+  return true;
+}
+
+std::shared_ptr<Maps> SharedMaps::Get() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return maps_;
+}
+
 }  // namespace unwindstack
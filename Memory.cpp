@@ -16,6 +16,10 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -28,13 +32,24 @@
 #include <sys/syscall.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
+#include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 
+#include <unwindstack/Elf.h>
 #include <unwindstack/Log.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 
 #include "Check.h"
@@ -46,6 +61,9 @@
 #include "MemoryOfflineBuffer.h"
 #include "MemoryRange.h"
 #include "MemoryRemote.h"
+#include "MemoryStackSnapshot.h"
+#include "MemoryTrace.h"
+#include "MemoryUsage.h"
 
 namespace unwindstack {
 
@@ -105,6 +123,74 @@ static size_t ProcessVmRead(pid_t pid, uint64_t remote_src, void* dst, size_t le
   return total_read;
 }
 
+// Does as many of the requests as possible with each process_vm_readv call.
+// Sets bytes_read for every request and returns true if any data was read.
+static bool ProcessVmReadBatch(pid_t pid, MemoryReadRequest* requests, size_t count) {
+  // A failure stops the transfer at the remote iovec that failed, so the
+  // request that failed is known, and the batch restarts after it.
+  constexpr size_t kMaxIovecs = 64;
+  struct iovec dst_iovs[kMaxIovecs];
+  struct iovec src_iovs[kMaxIovecs];
+  size_t batch[kMaxIovecs];
+  const size_t page_size = getpagesize();
+
+  bool any_read = false;
+  size_t next = 0;
+  while (next < count) {
+    size_t dst_used = 0;
+    size_t src_used = 0;
+    for (; next < count && dst_used < kMaxIovecs; next++) {
+      MemoryReadRequest& request = requests[next];
+      request.bytes_read = 0;
+      uint64_t end;
+      if (request.size == 0 || __builtin_add_overflow(request.addr, request.size, &end) ||
+          end > UINTPTR_MAX) {
+        continue;
+      }
+      size_t pages = ((end - 1) / page_size) - (request.addr / page_size) + 1;
+      if (pages > kMaxIovecs) {
+        // Too big to be part of a batch, do it on its own.
+        request.bytes_read = ProcessVmRead(pid, request.addr, request.dst, request.size);
+        any_read |= request.bytes_read != 0;
+        continue;
+      }
+      if (src_used + pages > kMaxIovecs) {
+        break;
+      }
+
+      batch[dst_used] = next;
+      dst_iovs[dst_used].iov_base = request.dst;
+      dst_iovs[dst_used].iov_len = request.size;
+      dst_used++;
+      // Split up the remote read across page boundaries, see ProcessVmRead.
+      for (uint64_t cur = request.addr; cur < end;) {
+        size_t iov_len = std::min(page_size - (cur & (page_size - 1)), end - cur);
+        src_iovs[src_used].iov_base = reinterpret_cast<void*>(cur);
+        src_iovs[src_used].iov_len = iov_len;
+        src_used++;
+        cur += iov_len;
+      }
+    }
+    if (dst_used == 0) {
+      continue;
+    }
+
+    ssize_t rc = syscall(__NR_process_vm_readv, pid, dst_iovs, dst_used, src_iovs, src_used, 0);
+    size_t bytes = rc == -1 ? 0 : rc;
+    for (size_t i = 0; i < dst_used; i++) {
+      MemoryReadRequest& request = requests[batch[i]];
+      request.bytes_read = std::min(bytes, request.size);
+      bytes -= request.bytes_read;
+      any_read |= request.bytes_read != 0;
+      if (request.bytes_read != request.size) {
+        next = batch[i] + 1;
+        break;
+      }
+    }
+  }
+  return any_read;
+}
+
 static bool PtraceReadLong(pid_t pid, uint64_t addr, long* value) {
   // ptrace() returns -1 and sets errno when the operation fails.
   // To disambiguate -1 from a valid result, we clear errno beforehand.
@@ -159,12 +245,73 @@ static size_t PtraceRead(pid_t pid, uint64_t addr, void* dst, size_t bytes) {
   return bytes_read;
 }
 
+static size_t ProcMemRead(int fd, uint64_t addr, void* dst, size_t size) {
+  // A read stops at the first page that is not mapped.
+  size_t total_read = 0;
+  while (total_read < size) {
+    uint64_t offset;
+    if (__builtin_add_overflow(addr, total_read, &offset) ||
+        offset > static_cast<uint64_t>(INT64_MAX)) {
+      break;
+    }
+    ssize_t rc = TEMP_FAILURE_RETRY(pread64(fd, &reinterpret_cast<uint8_t*>(dst)[total_read],
+                                            size - total_read, static_cast<off64_t>(offset)));
+    if (rc <= 0) {
+      break;
+    }
+    total_read += rc;
+  }
+  return total_read;
+}
+
 bool Memory::ReadFully(uint64_t addr, void* dst, size_t size) {
   size_t rc = Read(addr, dst, size);
   return rc == size;
 }
 
+size_t Memory::ReadBatch(MemoryReadRequest* requests, size_t count) {
+  size_t read_fully = 0;
+  for (size_t i = 0; i < count; i++) {
+    requests[i].bytes_read = Read(requests[i].addr, requests[i].dst, requests[i].size);
+    if (requests[i].bytes_read == requests[i].size) {
+      read_fully++;
+    }
+  }
+  return read_fully;
+}
+
+size_t Memory::ReadTags(uint64_t addr, size_t count, uint8_t* tags) {
+  addr &= ~(kTagGranuleSize - 1);
+  for (size_t i = 0; i < count; i++) {
+    long tag = ReadTag(addr + i * kTagGranuleSize);
+    if (tag < 0) {
+      return i;
+    }
+    tags[i] = tag;
+  }
+  return count;
+}
+
+const uint8_t* Memory::GetTablePointer(uint64_t addr, uint64_t count, uint64_t entry_size) {
+  uint64_t size;
+  if (__builtin_mul_overflow(count, entry_size, &size) || size > SIZE_MAX) {
+    return nullptr;
+  }
+  return GetPointer(addr, size);
+}
+
 bool Memory::ReadString(uint64_t addr, std::string* dst, size_t max_read) {
+  const uint8_t* data = GetPointer(addr, max_read);
+  if (data != nullptr) {
+    const void* terminator = memchr(data, '\0', max_read);
+    if (terminator == nullptr) {
+      return false;
+    }
+    dst->assign(reinterpret_cast<const char*>(data),
+                reinterpret_cast<const uint8_t*>(terminator) - data);
+    return true;
+  }
+
   char buffer[256];  // Large enough for 99% of symbol names.
   size_t size = 0;   // Number of bytes which were read into the buffer.
   for (size_t offset = 0; offset < max_read; offset += size) {
@@ -210,18 +357,50 @@ std::shared_ptr<Memory> Memory::CreateProcessMemory(pid_t pid) {
   return std::shared_ptr<Memory>(new MemoryRemote(pid));
 }
 
+// MemoryLocal falls back to copying directly when process_vm_readv fails,
+// so a local cache must never read memory outside of the page requested.
+static MemoryCacheConfig LocalCacheConfig(const MemoryCacheConfig& config) {
+  MemoryCacheConfig local_config = config;
+  local_config.page_bits = std::min<size_t>(local_config.page_bits, 12);
+  local_config.prefetch_pages = 0;
+  local_config.async_prefetch = false;
+  return local_config;
+}
+
 std::shared_ptr<Memory> Memory::CreateProcessMemoryCached(pid_t pid) {
+  return CreateProcessMemoryCached(pid, MemoryCacheConfig());
+}
+
+std::shared_ptr<Memory> Memory::CreateProcessMemoryCached(pid_t pid,
+                                                          const MemoryCacheConfig& config) {
+  if (config.concurrent) {
+    if (pid == getpid()) {
+      return std::shared_ptr<Memory>(
+          new MemoryConcurrentCache(new MemoryLocal(), LocalCacheConfig(config)));
+    }
+    return std::shared_ptr<Memory>(new MemoryConcurrentCache(new MemoryRemote(pid), config));
+  }
   if (pid == getpid()) {
-    return std::shared_ptr<Memory>(new MemoryCache(new MemoryLocal()));
+    return std::shared_ptr<Memory>(new MemoryCache(new MemoryLocal(), LocalCacheConfig(config)));
   }
-  return std::shared_ptr<Memory>(new MemoryCache(new MemoryRemote(pid)));
+  return std::shared_ptr<Memory>(new MemoryCache(new MemoryRemote(pid), config));
 }
 
 std::shared_ptr<Memory> Memory::CreateProcessMemoryThreadCached(pid_t pid) {
+  return CreateProcessMemoryThreadCached(pid, MemoryCacheConfig());
+}
+
+std::shared_ptr<Memory> Memory::CreateProcessMemoryThreadCached(pid_t pid,
+                                                                const MemoryCacheConfig& config) {
   if (pid == getpid()) {
-    return std::shared_ptr<Memory>(new MemoryThreadCache(new MemoryLocal()));
+    return std::shared_ptr<Memory>(
+        new MemoryThreadCache(new MemoryLocal(), LocalCacheConfig(config)));
   }
-  return std::shared_ptr<Memory>(new MemoryThreadCache(new MemoryRemote(pid)));
+  return std::shared_ptr<Memory>(new MemoryThreadCache(new MemoryRemote(pid), config));
+}
+
+std::shared_ptr<Memory> Memory::CreateLocalMemoryDirect(LocalUpdatableMaps* maps) {
+  return std::shared_ptr<Memory>(new MemoryLocalDirect(maps));
 }
 
 std::shared_ptr<Memory> Memory::CreateOfflineMemory(const uint8_t* data, uint64_t start,
@@ -249,21 +428,165 @@ uint8_t* MemoryBuffer::GetPtr(size_t offset) {
   return nullptr;
 }
 
+struct MappedFile {
+  MappedFile(void* map, size_t map_size, uint64_t offset, size_t size)
+      : map(map), map_size(map_size), data(&reinterpret_cast<uint8_t*>(map)[offset]), size(size) {}
+  ~MappedFile() { munmap(map, map_size); }
+
+  void* const map;
+  const size_t map_size;
+  // The mapped file data, starting at file offset 0 for pooled files.
+  uint8_t* const data;
+  const size_t size;
+};
+
+namespace {
+
+// Identifies the contents of a file. The size and modification time catch
+// a file that was rewritten in place.
+struct FileId {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+
+  FileId(const struct stat& st)
+      : dev(st.st_dev),
+        ino(st.st_ino),
+        size(st.st_size),
+        mtime_sec(st.st_mtim.tv_sec),
+        mtime_nsec(st.st_mtim.tv_nsec) {}
+
+  bool operator==(const FileId& other) const {
+    return dev == other.dev && ino == other.ino && size == other.size &&
+           mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec;
+  }
+};
+
+struct FileIdHash {
+  size_t operator()(const FileId& id) const {
+    uint64_t hash = static_cast<uint64_t>(id.ino) * 0x9e3779b97f4a7c15ULL;
+    hash ^= static_cast<uint64_t>(id.dev) + (hash << 6) + (hash >> 2);
+    hash ^= static_cast<uint64_t>(id.mtime_nsec) + (hash << 6) + (hash >> 2);
+    return static_cast<size_t>(hash);
+  }
+};
+
+// The files currently mapped. The pool does not keep a file mapped, the
+// mapping goes away with the last window using it.
+class MappedFilePool {
+ public:
+  std::shared_ptr<MappedFile> Get(const std::string& path);
+
+#if defined(__LP64__)
+  static constexpr off_t kMaxPooledSize = std::numeric_limits<off_t>::max();
+#else
+  // Mapping large files whole could use up the address space, so they are
+  // mapped one window at a time.
+  static constexpr off_t kMaxPooledSize = 256 * 1024 * 1024;
+#endif
+
+ private:
+  std::shared_ptr<MappedFile> Find(const FileId& id);
+
+  std::mutex lock_;
+  std::unordered_map<FileId, std::weak_ptr<MappedFile>, FileIdHash> files_;
+  size_t prune_size_ = 64;
+};
+
+std::shared_ptr<MappedFile> MappedFilePool::Find(const FileId& id) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = files_.find(id);
+  return entry != files_.end() ? entry->second.lock() : nullptr;
+}
+
+std::shared_ptr<MappedFile> MappedFilePool::Get(const std::string& path) {
+  // Most windows are of a file that is already mapped, which only needs
+  // the stat.
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1) {
+    return nullptr;
+  }
+  std::shared_ptr<MappedFile> file = Find(FileId(st));
+  if (file != nullptr) {
+    return file;
+  }
+
+  if (st.st_size > kMaxPooledSize) {
+    return nullptr;
+  }
+
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1 || fstat(fd, &st) == -1 || st.st_size <= 0 || st.st_size > kMaxPooledSize) {
+    return nullptr;
+  }
+  FileId id(st);
+  size_t size = st.st_size;
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+  if (Elf::FileMappingAdviceEnabled()) {
+    // Only has an effect on kernels that support huge pages for read-only
+    // file mappings.
+    madvise(map, size, MADV_HUGEPAGE);
+  }
+  file = std::make_shared<MappedFile>(map, size, 0, size);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  std::weak_ptr<MappedFile>& entry = files_[id];
+  std::shared_ptr<MappedFile> existing = entry.lock();
+  if (existing != nullptr) {
+    // Another thread mapped the same file first.
+    return existing;
+  }
+  entry = file;
+  if (files_.size() >= prune_size_) {
+    for (auto it = files_.begin(); it != files_.end();) {
+      if (it->second.expired()) {
+        it = files_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    prune_size_ = std::max<size_t>(64, 2 * files_.size());
+  }
+  return file;
+}
+
+}  // namespace
+
 MemoryFileAtOffset::~MemoryFileAtOffset() {
   Clear();
 }
 
 void MemoryFileAtOffset::Clear() {
-  if (data_) {
-    munmap(&data_[-offset_], size_ + offset_);
-    data_ = nullptr;
-  }
+  file_.reset();
+  data_ = nullptr;
+  size_ = 0;
 }
 
 bool MemoryFileAtOffset::Init(const std::string& file, uint64_t offset, uint64_t size) {
   // Clear out any previous data if it exists.
   Clear();
 
+  // Intentionally leaked, windows can outlive static destruction.
+  static MappedFilePool* pool = new MappedFilePool;
+  std::shared_ptr<MappedFile> mapped = pool->Get(file);
+  if (mapped != nullptr) {
+    if (offset >= mapped->size) {
+      return false;
+    }
+    file_ = std::move(mapped);
+    data_ = &file_->data[offset];
+    size_ = std::min<uint64_t>(size, file_->size - offset);
+    return true;
+  }
+  return InitWindow(file, offset, size);
+}
+
+bool MemoryFileAtOffset::InitWindow(const std::string& file, uint64_t offset, uint64_t size) {
   android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY | O_CLOEXEC)));
   if (fd == -1) {
     return false;
@@ -276,33 +599,28 @@ bool MemoryFileAtOffset::Init(const std::string& file, uint64_t offset, uint64_t
     return false;
   }
 
-  offset_ = offset & (getpagesize() - 1);
+  uint64_t page_offset = offset & (getpagesize() - 1);
   uint64_t aligned_offset = offset & ~(getpagesize() - 1);
-  if (aligned_offset > static_cast<uint64_t>(buf.st_size) ||
-      offset > static_cast<uint64_t>(buf.st_size)) {
-    return false;
-  }
-
-  size_ = buf.st_size - aligned_offset;
+  uint64_t map_size = buf.st_size - aligned_offset;
   uint64_t max_size;
-  if (!__builtin_add_overflow(size, offset_, &max_size) && max_size < size_) {
+  if (!__builtin_add_overflow(size, page_offset, &max_size) && max_size < map_size) {
     // Truncate the mapped size.
-    size_ = max_size;
+    map_size = max_size;
   }
-  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, aligned_offset);
+  void* map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, aligned_offset);
   if (map == MAP_FAILED) {
     return false;
   }
 
-  data_ = &reinterpret_cast<uint8_t*>(map)[offset_];
-  size_ -= offset_;
-
+  file_ = std::make_shared<MappedFile>(map, map_size, page_offset, map_size - page_offset);
+  data_ = file_->data;
+  size_ = file_->size;
   return true;
 }
 
 size_t MemoryFileAtOffset::Read(uint64_t addr, void* dst, size_t size) {
   if (addr >= size_) {
-    return 0;
+    return TraceMemoryRead("file", addr, size, 0);
   }
 
   size_t bytes_left = size_ - static_cast<size_t>(addr);
@@ -310,7 +628,83 @@ size_t MemoryFileAtOffset::Read(uint64_t addr, void* dst, size_t size) {
   size_t actual_len = std::min(bytes_left, size);
 
   memcpy(dst, actual_base, actual_len);
-  return actual_len;
+  return TraceMemoryRead("file", addr, size, actual_len);
+}
+
+MemoryRemoteMethod MemoryRemote::default_methods_[kMaxMethods] = {
+    MEMORY_REMOTE_PROCESS_VM_READV, MEMORY_REMOTE_PROC_MEM, MEMORY_REMOTE_PTRACE};
+size_t MemoryRemote::num_default_methods_ = kMaxMethods;
+
+void MemoryRemote::SetMethods(const MemoryRemoteMethod* methods, size_t count) {
+  num_default_methods_ = 0;
+  for (size_t i = 0; i < count && num_default_methods_ < kMaxMethods; i++) {
+    if (std::find(default_methods_, default_methods_ + num_default_methods_, methods[i]) ==
+        default_methods_ + num_default_methods_) {
+      default_methods_[num_default_methods_++] = methods[i];
+    }
+  }
+}
+
+void Memory::SetRemoteReadMethods(const MemoryRemoteMethod* methods, size_t count) {
+  MemoryRemote::SetMethods(methods, count);
+}
+
+MemoryRemote::MemoryRemote(pid_t pid) : pid_(pid), num_methods_(num_default_methods_) {
+  std::copy(default_methods_, default_methods_ + num_methods_, methods_);
+}
+
+MemoryRemote::~MemoryRemote() {
+  int fd = proc_mem_fd_.load();
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+int MemoryRemote::ProcMemFd() {
+  int fd = proc_mem_fd_.load(std::memory_order_acquire);
+  if (fd != kProcMemUnopened) {
+    return fd;
+  }
+  std::string path = "/proc/" + std::to_string(pid_) + "/mem";
+  // A failed open is stored as -1, so it is not retried.
+  int new_fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (!proc_mem_fd_.compare_exchange_strong(fd, new_fd, std::memory_order_acq_rel)) {
+    // Another thread opened it first.
+    if (new_fd >= 0) {
+      close(new_fd);
+    }
+  } else {
+    fd = new_fd;
+  }
+  return fd;
+}
+
+size_t MemoryRemote::ReadWithMethod(MemoryRemoteMethod method, uint64_t addr, void* dst,
+                                    size_t size) {
+  switch (method) {
+    case MEMORY_REMOTE_PROCESS_VM_READV:
+      return ProcessVmRead(pid_, addr, dst, size);
+    case MEMORY_REMOTE_PROC_MEM: {
+      int fd = ProcMemFd();
+      return fd >= 0 ? ProcMemRead(fd, addr, dst, size) : 0;
+    }
+    case MEMORY_REMOTE_PTRACE:
+      return PtraceRead(pid_, addr, dst, size);
+  }
+  return 0;
+}
+
+size_t MemoryRemote::ReadFallback(size_t first, uint64_t addr, void* dst, size_t size) {
+  // The later methods can read some pages the working one cannot, such as
+  // pages without read permission through /proc/<pid>/mem.
+  size_t bytes = 0;
+  for (size_t i = first; bytes < size && i < num_methods_; i++) {
+    if (methods_[i] != MEMORY_REMOTE_PTRACE) {
+      bytes += ReadWithMethod(methods_[i], addr + bytes, &reinterpret_cast<uint8_t*>(dst)[bytes],
+                              size - bytes);
+    }
+  }
+  return bytes;
 }
 
 size_t MemoryRemote::Read(uint64_t addr, void* dst, size_t size) {
@@ -321,30 +715,215 @@ size_t MemoryRemote::Read(uint64_t addr, void* dst, size_t size) {
   }
 #endif
 
-  size_t (*read_func)(pid_t, uint64_t, void*, size_t) =
-      reinterpret_cast<size_t (*)(pid_t, uint64_t, void*, size_t)>(read_redirect_func_.load());
-  if (read_func != nullptr) {
-    return read_func(pid_, addr, dst, size);
-  } else {
-    // Prefer process_vm_read, try it first. If it doesn't work, use the
-    // ptrace function. If at least one of them returns at least some data,
-    // set that as the permanent function to use.
-    // This assumes that if process_vm_read works once, it will continue
-    // to work.
-    size_t bytes = ProcessVmRead(pid_, addr, dst, size);
-    if (bytes > 0) {
-      read_redirect_func_ = reinterpret_cast<uintptr_t>(ProcessVmRead);
-      return bytes;
+  int method = method_.load(std::memory_order_relaxed);
+  if (method == kMethodUnknown) {
+    // Try the methods in order, and keep using the first one that returns
+    // at least some data. This assumes that if a method works once, it
+    // will continue to work.
+    for (size_t i = 0; i < num_methods_; i++) {
+      size_t bytes = ReadWithMethod(methods_[i], addr, dst, size);
+      if (bytes > 0) {
+        method_.store(i, std::memory_order_relaxed);
+        return TraceMemoryRead("remote", addr, size, bytes);
+      }
+    }
+    return TraceMemoryRead("remote", addr, size, 0);
+  }
+
+  size_t bytes = ReadWithMethod(methods_[method], addr, dst, size);
+  if (bytes < size) {
+    bytes += ReadFallback(method + 1, addr + bytes, &reinterpret_cast<uint8_t*>(dst)[bytes],
+                          size - bytes);
+  }
+  return TraceMemoryRead("remote", addr, size, bytes);
+}
+
+size_t MemoryRemote::ReadBatch(MemoryReadRequest* requests, size_t count) {
+#if !defined(__LP64__)
+  // Reads of addresses greater than 32 bits are rejected by Read.
+  return Memory::ReadBatch(requests, count);
+#else
+  // Only process_vm_readv can do several reads in one call.
+  int method = method_.load(std::memory_order_relaxed);
+  size_t index = method == kMethodUnknown ? 0 : method;
+  if (index >= num_methods_ || methods_[index] != MEMORY_REMOTE_PROCESS_VM_READV) {
+    return Memory::ReadBatch(requests, count);
+  }
+  if (ProcessVmReadBatch(pid_, requests, count)) {
+    method_.store(index, std::memory_order_relaxed);
+  } else if (method == kMethodUnknown) {
+    // Nothing could be read, let Read decide which method works.
+    return Memory::ReadBatch(requests, count);
+  }
+  size_t read_fully = 0;
+  for (size_t i = 0; i < count; i++) {
+    MemoryReadRequest& request = requests[i];
+    if (request.bytes_read < request.size) {
+      request.bytes_read +=
+          ReadFallback(index + 1, request.addr + request.bytes_read,
+                       &reinterpret_cast<uint8_t*>(request.dst)[request.bytes_read],
+                       request.size - request.bytes_read);
+    }
+    if (request.bytes_read == request.size) {
+      read_fully++;
+    }
+    TraceMemoryRead("remote", request.addr, request.size, request.bytes_read);
+  }
+  return read_fully;
+#endif
+}
+
+// A fault raised while a thread copies in GuardedCopy jumps back to it, any
+// other fault goes to the handler installed before. The copying threads
+// are found by tid, the handler never touches a thread local, since the
+// first use of one by a thread can allocate.
+struct GuardedCopySlot {
+  std::atomic<pid_t> tid;
+  // Picks the innermost copy of a thread that copies in a signal handler
+  // that interrupted a copy.
+  std::atomic<uint64_t> sequence;
+  std::atomic<sigjmp_buf*> jump;
+};
+static constexpr size_t kMaxGuardedCopies = 64;
+static GuardedCopySlot g_guarded_copies[kMaxGuardedCopies];
+static std::atomic<size_t> g_num_guarded_copies;
+static std::atomic<uint64_t> g_guarded_copy_sequence;
+static struct sigaction g_old_segv_action;
+static struct sigaction g_old_bus_action;
+
+static sigjmp_buf* FindFaultJump() {
+  if (g_num_guarded_copies.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  pid_t tid = syscall(SYS_gettid);
+  sigjmp_buf* jump = nullptr;
+  uint64_t sequence = 0;
+  for (GuardedCopySlot& slot : g_guarded_copies) {
+    if (slot.tid.load(std::memory_order_acquire) == tid &&
+        slot.sequence.load(std::memory_order_relaxed) >= sequence) {
+      sequence = slot.sequence.load(std::memory_order_relaxed);
+      jump = slot.jump.load(std::memory_order_relaxed);
+    }
+  }
+  return jump;
+}
+
+static void FaultHandler(int sig, siginfo_t* info, void* ucontext) {
+  sigjmp_buf* jump = FindFaultJump();
+  if (jump != nullptr) {
+    siglongjmp(*jump, 1);
+  }
+
+  const struct sigaction& old_action = sig == SIGSEGV ? g_old_segv_action : g_old_bus_action;
+  // A signal sent by kill or sigqueue does not happen again on return.
+  bool sent = info->si_code <= 0;
+  if (!(old_action.sa_flags & SA_SIGINFO) && old_action.sa_handler == SIG_IGN) {
+    // A fault is never ignored, the kernel gives it the default action.
+    if (!sent) {
+      signal(sig, SIG_DFL);
     }
-    bytes = PtraceRead(pid_, addr, dst, size);
-    if (bytes > 0) {
-      read_redirect_func_ = reinterpret_cast<uintptr_t>(PtraceRead);
+    return;
+  }
+  if (!(old_action.sa_flags & SA_SIGINFO) && old_action.sa_handler == SIG_DFL) {
+    // A fault happens again on return, and gets the default action.
+    signal(sig, SIG_DFL);
+    if (sent) {
+      raise(sig);
+    }
+    return;
+  }
+
+  // Run the handler the way the kernel would have.
+  sigset_t mask = old_action.sa_mask;
+  if (!(old_action.sa_flags & SA_NODEFER)) {
+    sigaddset(&mask, sig);
+  }
+  sigset_t old_mask;
+  sigprocmask(SIG_BLOCK, &mask, &old_mask);
+  if (old_action.sa_flags & SA_RESETHAND) {
+    signal(sig, SIG_DFL);
+  }
+  if (old_action.sa_flags & SA_SIGINFO) {
+    old_action.sa_sigaction(sig, info, ucontext);
+  } else {
+    old_action.sa_handler(sig);
+  }
+  sigprocmask(SIG_SETMASK, &old_mask, nullptr);
+}
+
+static void InstallFaultHandler() {
+  // SA_NODEFER, since jumping out of the handler does not unblock the
+  // signal.
+  struct sigaction action = {};
+  action.sa_sigaction = FaultHandler;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &g_old_segv_action);
+  sigaction(SIGBUS, &action, &g_old_bus_action);
+}
+
+// Returns false if the copy faulted, dst is then partially written. Also
+// returns false without copying if too many threads copy at once.
+static bool GuardedCopy(void* dst, uint64_t addr, size_t size) {
+  static thread_local pid_t tid = syscall(SYS_gettid);
+  GuardedCopySlot* slot = nullptr;
+  for (GuardedCopySlot& free_slot : g_guarded_copies) {
+    pid_t expected = 0;
+    if (free_slot.tid.load(std::memory_order_relaxed) == 0 &&
+        free_slot.tid.compare_exchange_strong(expected, -1, std::memory_order_acquire)) {
+      slot = &free_slot;
+      break;
     }
-    return bytes;
   }
+  if (slot == nullptr) {
+    return false;
+  }
+
+  sigjmp_buf jump;
+  // Set after sigsetjmp, and read after the jump back.
+  volatile bool copied = false;
+  if (sigsetjmp(jump, 0) == 0) {
+    slot->jump.store(&jump, std::memory_order_relaxed);
+    slot->sequence.store(g_guarded_copy_sequence.fetch_add(1, std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    slot->tid.store(tid, std::memory_order_release);
+    g_num_guarded_copies.fetch_add(1, std::memory_order_release);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    memcpy(dst, reinterpret_cast<const void*>(static_cast<uintptr_t>(addr)), size);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    copied = true;
+  }
+  g_num_guarded_copies.fetch_sub(1, std::memory_order_release);
+  slot->tid.store(0, std::memory_order_release);
+  return copied;
+}
+
+std::atomic_bool MemoryLocal::fault_safe_reads_ = false;
+
+void MemoryLocal::SetFaultSafeReads(bool enable) {
+  static std::once_flag installed;
+  if (enable) {
+    std::call_once(installed, InstallFaultHandler);
+  }
+  fault_safe_reads_.store(enable, std::memory_order_relaxed);
+}
+
+void Memory::SetLocalFaultSafeReads(bool enable) {
+  MemoryLocal::SetFaultSafeReads(enable);
 }
 
 size_t MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
+  if (fault_safe_) {
+    uint64_t end;
+    if (size != 0 && !__builtin_add_overflow(addr, size, &end) &&
+        end <= std::numeric_limits<uintptr_t>::max() && GuardedCopy(dst, addr, size)) {
+      return size;
+    }
+    // Finds how much of the range can be read, without the unguarded copy
+    // below.
+    return ProcessVmRead(getpid(), addr, dst, size);
+  }
+
   // Prefer process_vm_read, try it first. If it doesn't work, use direct memory read.
   size_t result = ProcessVmRead(getpid(), addr, dst, size);
   if (!result && size) {
@@ -354,27 +933,135 @@ size_t MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
   return result;
 }
 
+bool GetLocalThreadStack(uint64_t* start, uint64_t* end) {
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return false;
+  }
+  void* stack_addr;
+  size_t stack_size;
+  bool found = pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0;
+  if (found) {
+    *start = reinterpret_cast<uintptr_t>(stack_addr);
+    *end = *start + stack_size;
+  }
+  pthread_attr_destroy(&attr);
+  return found;
+}
+
+// The stack of the calling thread, empty if it cannot be found.
+struct ThreadStack {
+  ThreadStack() { GetLocalThreadStack(&start, &end); }
+
+  uint64_t start = 0;
+  uint64_t end = 0;
+};
+
+bool MemoryLocalDirect::IsDirect(uint64_t addr, size_t size) {
+  uint64_t end;
+  if (size == 0 || __builtin_add_overflow(addr, size, &end) ||
+      end > std::numeric_limits<uintptr_t>::max()) {
+    return false;
+  }
+
+  // Everything from the current frame to the top of the stack is mapped,
+  // unless this runs on another stack, such as a signal stack.
+  thread_local ThreadStack stack;
+  uint64_t frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  if (frame >= stack.start && frame < stack.end && addr >= frame && end <= stack.end) {
+    return true;
+  }
+
+  MapInfo* map_info = maps_->FindCurrent(addr);
+  if (map_info == nullptr || end > map_info->end || !(map_info->flags & PROT_READ) ||
+      (map_info->flags & (PROT_WRITE | MAPS_FLAGS_DEVICE_MAP))) {
+    return false;
+  }
+  // Anonymous maps can go away at any time, a library only when the caller
+  // unloads it. Shared memory is anonymous memory with a name.
+  const char* name = map_info->name.c_str();
+  if (strcmp(name, "[vdso]") == 0) {
+    return true;
+  }
+  if (name[0] != '/' || strncmp(name, "/dev/", 5) == 0 || strncmp(name, "/memfd:", 7) == 0) {
+    return false;
+  }
+  return end <= GetFileEnd(map_info);
+}
+
+uint64_t MemoryLocalDirect::GetFileEnd(MapInfo* map_info) {
+  std::lock_guard<std::mutex> guard(file_ends_lock_);
+  auto entry = file_ends_.find(map_info);
+  if (entry != file_ends_.end()) {
+    return entry->second;
+  }
+  // The map_files link is the file that is mapped, even if another file
+  // has replaced it under the same name since.
+  struct stat buf;
+  std::string map_file = android::base::StringPrintf("/proc/self/map_files/%" PRIx64 "-%" PRIx64,
+                                                     map_info->start, map_info->end);
+  uint64_t file_end = 0;
+  if (stat(map_file.c_str(), &buf) == 0 || stat(map_info->name.c_str(), &buf) == 0) {
+    uint64_t file_size = buf.st_size;
+    if (file_size > map_info->offset) {
+      file_end = std::min(map_info->end, map_info->start + (file_size - map_info->offset));
+    }
+  }
+  file_ends_.emplace(map_info, file_end);
+  return file_end;
+}
+
+size_t MemoryLocalDirect::Read(uint64_t addr, void* dst, size_t size) {
+  if (IsDirect(addr, size)) {
+    memcpy(dst, reinterpret_cast<const void*>(static_cast<uintptr_t>(addr)), size);
+    return size;
+  }
+  return MemoryLocal::Read(addr, dst, size);
+}
+
+const uint8_t* MemoryLocalDirect::GetPointer(uint64_t addr, size_t size) {
+  if (IsDirect(addr, size)) {
+    return reinterpret_cast<const uint8_t*>(static_cast<uintptr_t>(addr));
+  }
+  return nullptr;
+}
+
 MemoryRange::MemoryRange(const std::shared_ptr<Memory>& memory, uint64_t begin, uint64_t length,
                          uint64_t offset)
     : memory_(memory), begin_(begin), length_(length), offset_(offset) {}
 
 size_t MemoryRange::Read(uint64_t addr, void* dst, size_t size) {
   if (addr < offset_) {
-    return 0;
+    return TraceMemoryRead("range", addr, size, 0);
   }
 
   uint64_t read_offset = addr - offset_;
   if (read_offset >= length_) {
-    return 0;
+    return TraceMemoryRead("range", addr, size, 0);
   }
 
   uint64_t read_length = std::min(static_cast<uint64_t>(size), length_ - read_offset);
   uint64_t read_addr;
   if (__builtin_add_overflow(read_offset, begin_, &read_addr)) {
-    return 0;
+    return TraceMemoryRead("range", addr, size, 0);
   }
 
-  return memory_->Read(read_addr, dst, read_length);
+  return TraceMemoryRead("range", addr, size, memory_->Read(read_addr, dst, read_length));
+}
+
+const uint8_t* MemoryRange::GetPointer(uint64_t addr, size_t size) {
+  if (addr < offset_) {
+    return nullptr;
+  }
+  uint64_t read_offset = addr - offset_;
+  if (read_offset > length_ || size > length_ - read_offset) {
+    return nullptr;
+  }
+  uint64_t read_addr;
+  if (__builtin_add_overflow(read_offset, begin_, &read_addr)) {
+    return nullptr;
+  }
+  return memory_->GetPointer(read_addr, size);
 }
 
 void MemoryRanges::Insert(MemoryRange* memory) {
@@ -397,6 +1084,14 @@ size_t MemoryRanges::Read(uint64_t addr, void* dst, size_t size) {
   return 0;
 }
 
+const uint8_t* MemoryRanges::GetPointer(uint64_t addr, size_t size) {
+  auto entry = maps_.upper_bound(addr);
+  if (entry != maps_.end()) {
+    return entry->second->GetPointer(addr, size);
+  }
+  return nullptr;
+}
+
 bool MemoryOffline::Init(const std::string& file, uint64_t offset) {
   auto memory_file = std::make_shared<MemoryFileAtOffset>();
   if (!memory_file->Init(file, offset)) {
@@ -426,6 +1121,13 @@ size_t MemoryOffline::Read(uint64_t addr, void* dst, size_t size) {
   return memory_->Read(addr, dst, size);
 }
 
+const uint8_t* MemoryOffline::GetPointer(uint64_t addr, size_t size) {
+  if (!memory_) {
+    return nullptr;
+  }
+  return memory_->GetPointer(addr, size);
+}
+
 MemoryOfflineBuffer::MemoryOfflineBuffer(const uint8_t* data, uint64_t start, uint64_t end)
     : data_(data), start_(start), end_(end) {}
 
@@ -445,73 +1147,495 @@ size_t MemoryOfflineBuffer::Read(uint64_t addr, void* dst, size_t size) {
   return read_length;
 }
 
+const uint8_t* MemoryOfflineBuffer::GetPointer(uint64_t addr, size_t size) {
+  if (addr < start_ || addr > end_ || size > end_ - addr) {
+    return nullptr;
+  }
+  return &data_[addr - start_];
+}
+
+size_t MemoryStackSnapshot::Take(Memory* memory, uint64_t start, size_t size) {
+  memory_ = memory;
+  data_.resize(size);
+  start_ = start;
+  end_ = start + memory->Read(start, data_.data(), size);
+  return end_ - start_;
+}
+
+void MemoryStackSnapshot::Reset() {
+  memory_ = nullptr;
+  start_ = end_ = 0;
+}
+
+size_t MemoryStackSnapshot::Read(uint64_t addr, void* dst, size_t size) {
+  if (addr < start_ || addr >= end_) {
+    return memory_->Read(addr, dst, size);
+  }
+
+  size_t read_length = std::min(size, static_cast<size_t>(end_ - addr));
+  memcpy(dst, &data_[addr - start_], read_length);
+  if (read_length == size) {
+    return size;
+  }
+  return read_length +
+         memory_->Read(end_, reinterpret_cast<uint8_t*>(dst) + read_length, size - read_length);
+}
+
+const uint8_t* MemoryStackSnapshot::GetPointer(uint64_t addr, size_t size) {
+  if (addr < start_ || addr > end_ || size > end_ - addr) {
+    return memory_->GetPointer(addr, size);
+  }
+  return &data_[addr - start_];
+}
+
+void MemoryStackOverlay::Set(const uint8_t* data, uint64_t start, size_t size,
+                             std::shared_ptr<Memory> memory) {
+  memory_ = std::move(memory);
+  data_ = data;
+  start_ = start;
+  end_ = start + size < start ? UINT64_MAX : start + size;
+}
+
+void MemoryStackOverlay::Reset() {
+  memory_.reset();
+  data_ = nullptr;
+  start_ = end_ = 0;
+}
+
+size_t MemoryStackOverlay::Read(uint64_t addr, void* dst, size_t size) {
+  if (addr < start_ || addr >= end_) {
+    return memory_ ? memory_->Read(addr, dst, size) : 0;
+  }
+
+  size_t read_length = std::min(size, static_cast<size_t>(end_ - addr));
+  memcpy(dst, &data_[addr - start_], read_length);
+  if (read_length == size || !memory_) {
+    return read_length;
+  }
+  return read_length +
+         memory_->Read(end_, reinterpret_cast<uint8_t*>(dst) + read_length, size - read_length);
+}
+
+const uint8_t* MemoryStackOverlay::GetPointer(uint64_t addr, size_t size) {
+  if (addr < start_ || addr > end_ || size > end_ - addr) {
+    return memory_ ? memory_->GetPointer(addr, size) : nullptr;
+  }
+  return &data_[addr - start_];
+}
+
+std::shared_ptr<Memory> Memory::CreateStackOverlay(const uint8_t* data, uint64_t start,
+                                                   size_t size, std::shared_ptr<Memory> memory) {
+  std::shared_ptr<MemoryStackOverlay> overlay(new MemoryStackOverlay);
+  overlay->Set(data, start, size, std::move(memory));
+  return overlay;
+}
+
 MemoryOfflineParts::~MemoryOfflineParts() {
-  for (auto memory : memories_) {
-    delete memory;
+  for (auto& part : parts_) {
+    delete part.memory;
   }
 }
 
-size_t MemoryOfflineParts::Read(uint64_t addr, void* dst, size_t size) {
-  if (memories_.empty()) {
-    return 0;
+void MemoryOfflineParts::Add(MemoryOffline* memory) {
+  Part part{memory->start(), memory->end(), 0, memory};
+  auto it = std::upper_bound(parts_.begin(), parts_.end(), part.start,
+                             [](uint64_t start, const Part& p) { return start < p.start; });
+  it = parts_.insert(it, part);
+  uint64_t max_end = it == parts_.begin() ? 0 : (it - 1)->max_end;
+  for (; it != parts_.end(); ++it) {
+    max_end = std::max(max_end, it->end);
+    it->max_end = max_end;
   }
+}
 
-  // Do a read on each memory object, no support for reading across the
+size_t MemoryOfflineParts::Read(uint64_t addr, void* dst, size_t size) {
+  // Find the last part starting at or before addr. Parts normally do not
+  // overlap, but if they do, walk back to every earlier part that might
+  // still contain addr. There is no support for reading across the
   // different memory objects.
-  for (MemoryOffline* memory : memories_) {
-    size_t bytes = memory->Read(addr, dst, size);
-    if (bytes != 0) {
-      return bytes;
+  auto it = std::upper_bound(parts_.begin(), parts_.end(), addr,
+                             [](uint64_t addr, const Part& p) { return addr < p.start; });
+  while (it != parts_.begin()) {
+    --it;
+    if (it->max_end <= addr) {
+      break;
+    }
+    if (addr < it->end) {
+      size_t bytes = it->memory->Read(addr, dst, size);
+      if (bytes != 0) {
+        return bytes;
+      }
     }
   }
   return 0;
 }
 
-size_t MemoryCacheBase::InternalCachedRead(uint64_t addr, void* dst, size_t size,
-                                           CacheDataType* cache) {
-  uint64_t addr_page = addr >> kCacheBits;
-  auto entry = cache->find(addr_page);
-  uint8_t* cache_dst;
-  if (entry != cache->end()) {
-    cache_dst = entry->second;
+MemoryCacheBase::MemoryCacheBase(Memory* memory, const MemoryCacheConfig& config)
+    : impl_(memory),
+      page_bits_(std::clamp<size_t>(config.page_bits, 8, 16)),
+      page_size_(static_cast<size_t>(1) << page_bits_),
+      max_pages_(config.max_pages),
+      eviction_(config.eviction),
+      max_cached_read_(config.max_cached_read),
+      fill_large_reads_(config.fill_large_reads) {
+  set_prefetch_pages(config.prefetch_pages);
+}
+
+void MemoryCacheBase::set_prefetch_pages(size_t pages) {
+  pages = std::min(pages, kMaxPrefetchPages);
+  // All of the pages of one fill have to fit in the cache.
+  if (max_pages_ != 0) {
+    pages = std::min(pages, max_pages_ - 1);
+  }
+  prefetch_pages_ = pages;
+}
+
+void MemoryCacheBase::Unlink(uint32_t slot, CacheData* cache) {
+  CacheData::Slot& entry = cache->slots[slot];
+  if (entry.prev == kNoSlot && cache->head != slot) {
+    // Not in the list.
+    return;
+  }
+  if (entry.prev != kNoSlot) {
+    cache->slots[entry.prev].next = entry.next;
+  } else {
+    cache->head = entry.next;
+  }
+  if (entry.next != kNoSlot) {
+    cache->slots[entry.next].prev = entry.prev;
+  } else {
+    cache->tail = entry.prev;
+  }
+  entry.prev = entry.next = kNoSlot;
+}
+
+void MemoryCacheBase::LinkFront(uint32_t slot, CacheData* cache) {
+  CacheData::Slot& entry = cache->slots[slot];
+  entry.prev = kNoSlot;
+  entry.next = cache->head;
+  if (cache->head != kNoSlot) {
+    cache->slots[cache->head].prev = slot;
   } else {
-    cache_dst = (*cache)[addr_page];
-    if (!impl_->ReadFully(addr_page << kCacheBits, cache_dst, kCacheSize)) {
-      // Erase the entry.
-      cache->erase(addr_page);
-      return impl_->Read(addr, dst, size);
+    cache->tail = slot;
+  }
+  cache->head = slot;
+}
+
+uint32_t MemoryCacheBase::FindSlot(uint64_t page, CacheData* cache) {
+  auto entry = cache->pages.find(page);
+  if (entry == cache->pages.end()) {
+    return kNoSlot;
+  }
+  // Entries of stale or reused slots are left in place, so that filling
+  // the page again, which is what happens to the stack pages on every
+  // unwind, reuses the entry instead of allocating a new one.
+  const CacheData::Slot& slot = cache->slots[entry->second];
+  if (slot.page != page || cache->Stale(slot)) {
+    return kNoSlot;
+  }
+  return entry->second;
+}
+
+void MemoryCacheBase::PrunePages(CacheData* cache) {
+  for (auto entry = cache->pages.begin(); entry != cache->pages.end();) {
+    const CacheData::Slot& slot = cache->slots[entry->second];
+    if (slot.page != entry->first || cache->Stale(slot)) {
+      entry = cache->pages.erase(entry);
+    } else {
+      ++entry;
     }
   }
-  size_t max_read = ((addr_page + 1) << kCacheBits) - addr;
-  if (size <= max_read) {
-    memcpy(dst, &cache_dst[addr & kCacheMask], size);
-    return size;
+}
+
+uint8_t* MemoryCacheBase::NewPageData(CacheData* cache) {
+  size_t pages = SlabPages();
+  if (cache->slab_pages_left == 0) {
+    cache->slabs.emplace_back(new uint8_t[pages * page_size_]);
+    cache->slab_pages_left = pages;
+  }
+  uint8_t* data = &cache->slabs.back()[(pages - cache->slab_pages_left) * page_size_];
+  cache->slab_pages_left--;
+  return data;
+}
+
+uint32_t MemoryCacheBase::AllocateSlot(CacheData* cache) {
+  uint32_t slot;
+  if (!cache->free_slots.empty()) {
+    slot = cache->free_slots.back();
+    cache->free_slots.pop_back();
+  } else if (cache->live_slots < cache->slots.size()) {
+    // Reuse a stale slot, each one is found once per generation so this is
+    // amortized constant time.
+    while (!cache->Stale(cache->slots[cache->stale_hand])) {
+      cache->stale_hand = (cache->stale_hand + 1) % cache->slots.size();
+    }
+    slot = cache->stale_hand;
+    Unlink(slot, cache);
+  } else if (max_pages_ == 0 || cache->slots.size() < max_pages_) {
+    slot = cache->slots.size();
+    cache->slots.emplace_back();
+    cache->slots.back().data = NewPageData(cache);
+  } else {
+    // The cache is full, evict a page that is not part of the current fill.
+    if (eviction_ == MemoryCacheConfig::EVICTION_LRU) {
+      slot = cache->tail;
+      while (cache->slots[slot].fill == cache->fills) {
+        slot = cache->slots[slot].prev;
+      }
+    } else {
+      while (true) {
+        slot = cache->clock_hand;
+        cache->clock_hand = (cache->clock_hand + 1) % cache->slots.size();
+        CacheData::Slot& entry = cache->slots[slot];
+        if (entry.fill == cache->fills) {
+          continue;
+        }
+        if (!entry.referenced) {
+          break;
+        }
+        entry.referenced = false;
+      }
+    }
+    cache->pages.erase(cache->slots[slot].page);
+    Unlink(slot, cache);
+    cache->live_slots--;
+    if (cache->slots[slot].writable) {
+      cache->writable_slots--;
+    }
+    cache->stats.evictions++;
   }
+  CacheData::Slot& entry = cache->slots[slot];
+  entry.generation = cache->generation;
+  entry.writable_generation = cache->writable_generation;
+  entry.writable = false;
+  entry.fill = cache->fills;
+  entry.referenced = true;
+  if (eviction_ == MemoryCacheConfig::EVICTION_LRU) {
+    LinkFront(slot, cache);
+  }
+  cache->live_slots++;
+  return slot;
+}
 
-  // The read crossed into another cached entry, since a read can only cross
-  // into one extra cached page, duplicate the code rather than looping.
-  memcpy(dst, &cache_dst[addr & kCacheMask], max_read);
-  dst = &reinterpret_cast<uint8_t*>(dst)[max_read];
-  addr_page++;
+void MemoryCacheBase::FreeSlot(uint32_t slot, CacheData* cache) {
+  cache->pages.erase(cache->slots[slot].page);
+  Unlink(slot, cache);
+  cache->free_slots.push_back(slot);
+  cache->live_slots--;
+  if (cache->slots[slot].writable) {
+    cache->writable_slots--;
+  }
+}
+
+bool MemoryCacheBase::IsWritable(uint64_t page, Maps* maps) {
+  if (maps == nullptr) {
+    return true;
+  }
+  uint64_t start = page << page_bits_;
+  MapInfo* info = maps->Find(start);
+  // The whole page has to be in one private read-only map. A shared map
+  // can be written through another map of the same memory, such as the
+  // writable view of a jit code cache.
+  return info == nullptr || (info->flags & (PROT_WRITE | MAPS_FLAGS_SHARED_MAP)) ||
+         info->start > start || info->end - start < page_size_;
+}
 
-  entry = cache->find(addr_page);
-  if (entry != cache->end()) {
-    cache_dst = entry->second;
+void MemoryCacheBase::ClearWritable(CacheData* cache) {
+  Maps* maps = maps_;
+  if (maps == nullptr || maps != cache->maps) {
+    // The writable pages are only known for the maps used to fill the cache.
+    cache->Clear();
+    cache->maps = maps;
   } else {
-    cache_dst = (*cache)[addr_page];
-    if (!impl_->ReadFully(addr_page << kCacheBits, cache_dst, kCacheSize)) {
-      // Erase the entry.
-      cache->erase(addr_page);
-      return impl_->Read(addr_page << kCacheBits, dst, size - max_read) + max_read;
+    cache->ClearWritable();
+  }
+}
+
+uint32_t MemoryCacheBase::AddPage(uint64_t page, CacheData* cache) {
+  uint32_t slot = AllocateSlot(cache);
+  cache->slots[slot].page = page;
+  if (IsWritable(page, cache->maps)) {
+    cache->slots[slot].writable = true;
+    cache->writable_slots++;
+  }
+  if (cache->pages.size() > 2 * cache->slots.size()) {
+    PrunePages(cache);
+  }
+  cache->pages[page] = slot;
+  return slot;
+}
+
+uint8_t* MemoryCacheBase::FillPages(uint64_t page, CacheData* cache) {
+  cache->fills++;
+  MemoryReadRequest requests[kMaxPrefetchPages + 1];
+  uint32_t slots[kMaxPrefetchPages + 1];
+  size_t count = 0;
+  for (uint64_t cur_page = page; cur_page <= page + prefetch_pages_; cur_page++) {
+    if (cur_page != page && FindSlot(cur_page, cache) != kNoSlot) {
+      continue;
     }
+    uint32_t slot = AddPage(cur_page, cache);
+    slots[count] = slot;
+    requests[count].addr = cur_page << page_bits_;
+    requests[count].dst = cache->slots[slot].data;
+    requests[count].size = page_size_;
+    count++;
+  }
+  impl_->ReadBatch(requests, count);
+  for (size_t i = 0; i < count; i++) {
+    if (requests[i].bytes_read != page_size_) {
+      FreeSlot(slots[i], cache);
+    }
+  }
+  // The first request is always for page.
+  return requests[0].bytes_read == page_size_ ? reinterpret_cast<uint8_t*>(requests[0].dst)
+                                              : nullptr;
+}
+
+uint8_t* MemoryCacheBase::GetPage(uint64_t page, CacheData* cache) {
+  uint32_t slot = FindSlot(page, cache);
+  if (slot == kNoSlot) {
+    cache->stats.misses++;
+    return FillPages(page, cache);
+  }
+  cache->stats.hits++;
+  if (max_pages_ != 0) {
+    if (eviction_ == MemoryCacheConfig::EVICTION_LRU) {
+      if (cache->head != slot) {
+        Unlink(slot, cache);
+        LinkFront(slot, cache);
+      }
+    } else {
+      cache->slots[slot].referenced = true;
+    }
+  }
+  return cache->slots[slot].data;
+}
+
+size_t MemoryCacheBase::InternalCachedRead(uint64_t addr, void* dst, size_t size,
+                                           CacheData* cache) {
+  // Only look at the cache for small reads.
+  if (size > max_cached_read_ && !fill_large_reads_) {
+    cache->stats.uncached_reads++;
+    return impl_->Read(addr, dst, size);
+  }
+
+  uint8_t* data = reinterpret_cast<uint8_t*>(dst);
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    uint64_t cur_addr = addr + bytes_read;
+    uint8_t* page_data = GetPage(cur_addr >> page_bits_, cache);
+    if (page_data == nullptr) {
+      return bytes_read + impl_->Read(cur_addr, &data[bytes_read], size - bytes_read);
+    }
+    size_t offset = cur_addr & (page_size_ - 1);
+    size_t length = std::min(size - bytes_read, page_size_ - offset);
+    memcpy(&data[bytes_read], &page_data[offset], length);
+    bytes_read += length;
   }
-  memcpy(dst, cache_dst, size - max_read);
   return size;
 }
 
+MemoryCache::~MemoryCache() {
+  if (prefetch_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(prefetch_lock_);
+      prefetch_stop_ = true;
+    }
+    prefetch_cond_.notify_one();
+    prefetch_thread_.join();
+  }
+}
+
+void MemoryCache::Prefetch(uint64_t addr, size_t size) {
+  // Keep the pages of one prefetch from evicting each other.
+  size_t max_pages = max_pages_ != 0 ? std::min(max_pages_ / 2, kMaxAsyncPrefetchPages)
+                                     : kMaxAsyncPrefetchPages;
+  if (!async_prefetch_ || size == 0 || max_pages == 0 || addr + (size - 1) < addr) {
+    return;
+  }
+  uint64_t first = addr >> page_bits_;
+  uint64_t last = std::min<uint64_t>((addr + size - 1) >> page_bits_, first + max_pages - 1);
+
+  std::lock_guard<std::mutex> lock(prefetch_lock_);
+  if (prefetch_queue_.size() >= kMaxQueuedPrefetches) {
+    return;
+  }
+  prefetch_queue_.emplace_back(first, last);
+  if (!prefetch_thread_.joinable()) {
+    prefetch_thread_ = std::thread(&MemoryCache::PrefetchLoop, this);
+  } else {
+    prefetch_cond_.notify_one();
+  }
+}
+
+void MemoryCache::PrefetchLoop() {
+  std::unique_lock<std::mutex> lock(prefetch_lock_);
+  while (true) {
+    prefetch_cond_.wait(lock, [this] { return prefetch_stop_ || !prefetch_queue_.empty(); });
+    if (prefetch_stop_) {
+      return;
+    }
+    std::pair<uint64_t, uint64_t> range = prefetch_queue_.front();
+    prefetch_queue_.pop_front();
+    lock.unlock();
+    PrefetchPages(range.first, range.second);
+    lock.lock();
+  }
+}
+
+void MemoryCache::PrefetchPages(uint64_t first, uint64_t last) {
+  std::vector<uint64_t> pages;
+  uint64_t generation;
+  uint64_t writable_generation;
+  {
+    std::lock_guard<std::mutex> lock(cache_lock_);
+    for (uint64_t page = first; page <= last; page++) {
+      if (FindSlot(page, &cache_) == kNoSlot) {
+        pages.push_back(page);
+      }
+    }
+    generation = cache_.generation;
+    writable_generation = cache_.writable_generation;
+  }
+  if (pages.empty()) {
+    return;
+  }
+
+  // The pages are read without the cache lock, so readers of other pages
+  // are not blocked while the data arrives.
+  std::unique_ptr<uint8_t[]> data(new uint8_t[pages.size() * page_size_]);
+  std::vector<MemoryReadRequest> requests(pages.size());
+  for (size_t i = 0; i < pages.size(); i++) {
+    requests[i].addr = pages[i] << page_bits_;
+    requests[i].dst = &data[i * page_size_];
+    requests[i].size = page_size_;
+  }
+  impl_->ReadBatch(requests.data(), requests.size());
+
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  // Data read before a clear might be out of date.
+  if (cache_.generation != generation || cache_.writable_generation != writable_generation) {
+    return;
+  }
+  cache_.fills++;
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (requests[i].bytes_read == page_size_ && FindSlot(pages[i], &cache_) == kNoSlot) {
+      uint32_t slot = AddPage(pages[i], &cache_);
+      memcpy(cache_.slots[slot].data, requests[i].dst, page_size_);
+      cache_.stats.prefetched_pages++;
+    }
+  }
+}
+
 void MemoryCache::Clear() {
   std::lock_guard<std::mutex> lock(cache_lock_);
-  cache_.clear();
+  cache_.Clear();
+}
+
+void MemoryCache::ClearWritable() {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  MemoryCacheBase::ClearWritable(&cache_);
 }
 
 size_t MemoryCache::CachedRead(uint64_t addr, void* dst, size_t size) {
@@ -522,11 +1646,232 @@ size_t MemoryCache::CachedRead(uint64_t addr, void* dst, size_t size) {
   return InternalCachedRead(addr, dst, size, &cache_);
 }
 
-MemoryThreadCache::MemoryThreadCache(Memory* memory) : MemoryCacheBase(memory) {
+bool MemoryCache::GetCacheStats(MemoryCacheStats* stats) {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  *stats = cache_.stats;
+  stats->pages = cache_.live_slots;
+  return true;
+}
+
+size_t MemoryCache::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(cache_lock_);
+  return cache_.slabs.size() * SlabPages() * page_size_ + VectorMemoryUsage(cache_.slots) +
+         VectorMemoryUsage(cache_.slabs) + HashMapMemoryUsage(cache_.pages);
+}
+
+MemoryConcurrentCache::MemoryConcurrentCache(Memory* memory, const MemoryCacheConfig& config)
+    : MemoryCacheBase(memory, config) {
+  size_t slots = kDefaultSlots;
+  if (max_pages_ != 0) {
+    // Keep the table at most half full.
+    slots = 1;
+    while (slots < 2 * max_pages_) {
+      slots <<= 1;
+    }
+  }
+  slots_.reset(new Slot[slots]);
+  slot_mask_ = slots - 1;
+}
+
+MemoryConcurrentCache::~MemoryConcurrentCache() {
+  for (size_t i = 0; i <= slot_mask_; i++) {
+    delete[] slots_[i].data.load(std::memory_order_relaxed);
+  }
+}
+
+bool MemoryConcurrentCache::Stale(const Slot& slot) {
+  return slot.generation.load(std::memory_order_relaxed) !=
+             generation_.load(std::memory_order_relaxed) ||
+         (slot.writable.load(std::memory_order_relaxed) &&
+          slot.writable_generation.load(std::memory_order_relaxed) !=
+              writable_generation_.load(std::memory_order_relaxed));
+}
+
+MemoryConcurrentCache::Lookup MemoryConcurrentCache::ReadPage(uint64_t page, size_t offset,
+                                                              uint8_t* dst, size_t length) {
+  size_t first = FirstSlot(page);
+  for (size_t probe = 0; probe < kMaxProbes; probe++) {
+    Slot& slot = slots_[(first + probe) & slot_mask_];
+    while (true) {
+      uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+      uint64_t slot_page = slot.page.load(std::memory_order_relaxed);
+      if (slot_page == kNoPage) {
+        // Pages are never removed, so the page is not further along either.
+        return LOOKUP_MISS;
+      }
+      if (slot_page != page) {
+        break;
+      }
+      if (sequence & 1) {
+        return LOOKUP_BUSY;
+      }
+      if (Stale(slot)) {
+        return LOOKUP_MISS;
+      }
+      memcpy(dst, slot.data.load(std::memory_order_relaxed) + offset, length);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+        return LOOKUP_HIT;
+      }
+      // The slot was refilled during the copy.
+    }
+  }
+  return LOOKUP_MISS;
+}
+
+bool MemoryConcurrentCache::FillPage(uint64_t page, size_t offset, uint8_t* dst, size_t length) {
+  size_t first = FirstSlot(page);
+  while (true) {
+    // Look for the slot of the page, otherwise the first one that is free or
+    // stale, and not in use by another thread.
+    Slot* found = nullptr;
+    uint64_t found_sequence = 0;
+    uint64_t found_page = kNoPage;
+    bool busy = false;
+    for (size_t probe = 0; probe < kMaxProbes; probe++) {
+      Slot& slot = slots_[(first + probe) & slot_mask_];
+      uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+      uint64_t slot_page = slot.page.load(std::memory_order_relaxed);
+      if (sequence & 1) {
+        if (slot_page == page) {
+          busy = true;
+          break;
+        }
+        continue;
+      }
+      if (slot_page == page) {
+        found = &slot;
+        found_sequence = sequence;
+        found_page = slot_page;
+        break;
+      }
+      if (found == nullptr && (slot_page == kNoPage || Stale(slot))) {
+        found = &slot;
+        found_sequence = sequence;
+        found_page = slot_page;
+      }
+      if (slot_page == kNoPage) {
+        break;
+      }
+    }
+    if (busy) {
+      // Wait for the other read of the page.
+      std::this_thread::yield();
+      Lookup lookup = ReadPage(page, offset, dst, length);
+      if (lookup == LOOKUP_HIT) {
+        return true;
+      }
+      continue;
+    }
+    if (found == nullptr) {
+      return false;
+    }
+    if (!found->sequence.compare_exchange_strong(found_sequence, found_sequence + 1,
+                                                 std::memory_order_acquire)) {
+      continue;
+    }
+    // The data must not be written before the sequence is odd.
+    std::atomic_thread_fence(std::memory_order_release);
+    if (found->page.load(std::memory_order_relaxed) != found_page ||
+        (found_page == page && !Stale(*found))) {
+      // Another thread filled the slot before it was claimed.
+      found->sequence.store(found_sequence + 2, std::memory_order_release);
+      if (ReadPage(page, offset, dst, length) == LOOKUP_HIT) {
+        return true;
+      }
+      continue;
+    }
+
+    uint64_t generation = generation_.load(std::memory_order_relaxed);
+    uint64_t writable_generation = writable_generation_.load(std::memory_order_relaxed);
+    found->page.store(page, std::memory_order_relaxed);
+    uint8_t* data = found->data.load(std::memory_order_relaxed);
+    if (data == nullptr) {
+      data = new uint8_t[page_size_];
+      found->data.store(data, std::memory_order_relaxed);
+      data_pages_++;
+    }
+    bool filled = impl_->Read(page << page_bits_, data, page_size_) == page_size_;
+    if (filled) {
+      found->writable.store(IsWritable(page, fill_maps_.load(std::memory_order_relaxed)),
+                            std::memory_order_relaxed);
+      found->writable_generation.store(writable_generation, std::memory_order_relaxed);
+      found->generation.store(generation, std::memory_order_relaxed);
+      memcpy(dst, data + offset, length);
+    } else {
+      // Leave the slot stale, a later read tries again.
+      found->generation.store(0, std::memory_order_relaxed);
+    }
+    found->sequence.store(found_sequence + 2, std::memory_order_release);
+    return filled;
+  }
+}
+
+size_t MemoryConcurrentCache::CachedRead(uint64_t addr, void* dst, size_t size) {
+  // Only look at the cache for small reads.
+  if (size > max_cached_read_ && !fill_large_reads_) {
+    uncached_reads_.fetch_add(1, std::memory_order_relaxed);
+    return impl_->Read(addr, dst, size);
+  }
+
+  uint8_t* data = reinterpret_cast<uint8_t*>(dst);
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    uint64_t cur_addr = addr + bytes_read;
+    uint64_t page = cur_addr >> page_bits_;
+    size_t offset = cur_addr & (page_size_ - 1);
+    size_t length = std::min(size - bytes_read, page_size_ - offset);
+    if (ReadPage(page, offset, &data[bytes_read], length) == LOOKUP_HIT) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      if (!FillPage(page, offset, &data[bytes_read], length)) {
+        return bytes_read + impl_->Read(cur_addr, &data[bytes_read], size - bytes_read);
+      }
+    }
+    bytes_read += length;
+  }
+  return size;
+}
+
+void MemoryConcurrentCache::Clear() {
+  generation_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryConcurrentCache::ClearWritable() {
+  Maps* maps = maps_;
+  if (maps == nullptr || fill_maps_.exchange(maps) != maps) {
+    // The writable pages are only known for the maps used to fill the cache.
+    generation_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    writable_generation_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool MemoryConcurrentCache::GetCacheStats(MemoryCacheStats* stats) {
+  *stats = MemoryCacheStats();
+  stats->hits = hits_.load(std::memory_order_relaxed);
+  stats->misses = misses_.load(std::memory_order_relaxed);
+  stats->uncached_reads = uncached_reads_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i <= slot_mask_; i++) {
+    const Slot& slot = slots_[i];
+    if (slot.page.load(std::memory_order_relaxed) != kNoPage && !Stale(slot)) {
+      stats->pages++;
+    }
+  }
+  return true;
+}
+
+size_t MemoryConcurrentCache::MemoryUsage() {
+  return (slot_mask_ + 1) * sizeof(Slot) + data_pages_.load(std::memory_order_relaxed) * page_size_;
+}
+
+MemoryThreadCache::MemoryThreadCache(Memory* memory, const MemoryCacheConfig& config)
+    : MemoryCacheBase(memory, config) {
   thread_cache_ = std::make_optional<pthread_t>();
   if (pthread_key_create(&*thread_cache_, [](void* memory) {
-        CacheDataType* cache = reinterpret_cast<CacheDataType*>(memory);
-        delete cache;
+        ThreadCacheData* cache = reinterpret_cast<ThreadCacheData*>(memory);
+        cache->owner->Release(cache);
       }) != 0) {
     thread_cache_.reset();
   }
@@ -534,20 +1879,37 @@ MemoryThreadCache::MemoryThreadCache(Memory* memory) : MemoryCacheBase(memory) {
 
 MemoryThreadCache::~MemoryThreadCache() {
   if (thread_cache_) {
-    CacheDataType* cache = reinterpret_cast<CacheDataType*>(pthread_getspecific(*thread_cache_));
-    delete cache;
     pthread_key_delete(*thread_cache_);
   }
 }
 
+void MemoryThreadCache::Release(ThreadCacheData* cache) {
+  // The next thread starts with an empty cache, but keeps the page data.
+  cache->Clear();
+  cache->stats = MemoryCacheStats();
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  free_caches_.push_back(cache);
+}
+
 size_t MemoryThreadCache::CachedRead(uint64_t addr, void* dst, size_t size) {
   if (!thread_cache_) {
     return impl_->Read(addr, dst, size);
   }
 
-  CacheDataType* cache = reinterpret_cast<CacheDataType*>(pthread_getspecific(*thread_cache_));
+  ThreadCacheData* cache =
+      reinterpret_cast<ThreadCacheData*>(pthread_getspecific(*thread_cache_));
   if (cache == nullptr) {
-    cache = new CacheDataType;
+    {
+      std::lock_guard<std::mutex> lock(pool_lock_);
+      if (!free_caches_.empty()) {
+        cache = free_caches_.back();
+        free_caches_.pop_back();
+      } else {
+        caches_.emplace_back(new ThreadCacheData);
+        cache = caches_.back().get();
+        cache->owner = this;
+      }
+    }
     pthread_setspecific(*thread_cache_, cache);
   }
 
@@ -555,10 +1917,35 @@ size_t MemoryThreadCache::CachedRead(uint64_t addr, void* dst, size_t size) {
 }
 
 void MemoryThreadCache::Clear() {
-  CacheDataType* cache = reinterpret_cast<CacheDataType*>(pthread_getspecific(*thread_cache_));
+  if (!thread_cache_) {
+    return;
+  }
+  CacheData* cache = reinterpret_cast<CacheData*>(pthread_getspecific(*thread_cache_));
   if (cache != nullptr) {
-    delete cache;
-    pthread_setspecific(*thread_cache_, nullptr);
+    cache->Clear();
   }
 }
+
+void MemoryThreadCache::ClearWritable() {
+  if (!thread_cache_) {
+    return;
+  }
+  CacheData* cache = reinterpret_cast<CacheData*>(pthread_getspecific(*thread_cache_));
+  if (cache != nullptr) {
+    MemoryCacheBase::ClearWritable(cache);
+  }
+}
+
+bool MemoryThreadCache::GetCacheStats(MemoryCacheStats* stats) {
+  *stats = MemoryCacheStats();
+  if (!thread_cache_) {
+    return true;
+  }
+  CacheData* cache = reinterpret_cast<CacheData*>(pthread_getspecific(*thread_cache_));
+  if (cache != nullptr) {
+    *stats = cache->stats;
+    stats->pages = cache->live_slots;
+  }
+  return true;
+}
 }  // namespace unwindstack
@@ -35,6 +35,10 @@ class MemoryBuffer : public Memory {
 
   uint8_t* GetPtr(size_t offset) override;
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override {
+    return addr <= size_ && size <= size_ - addr ? &raw_[addr] : nullptr;
+  }
+
   bool Resize(size_t size) {
     void* new_raw = realloc(raw_, size);
     if (new_raw == nullptr) {
@@ -50,6 +54,8 @@ class MemoryBuffer : public Memory {
 
   uint64_t Size() { return size_; }
 
+  size_t MemoryUsage() override { return size_; }
+
  private:
   uint8_t* raw_ = nullptr;
   size_t size_ = 0;
@@ -20,70 +20,288 @@
 #include <pthread.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <thread>
+#include <utility>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/Memory.h>
 
+#include "MemoryTrace.h"
+
 namespace unwindstack {
 
 class MemoryCacheBase : public Memory {
  public:
-  MemoryCacheBase(Memory* memory) : impl_(memory) {}
+  MemoryCacheBase(Memory* memory, const MemoryCacheConfig& config = MemoryCacheConfig());
   virtual ~MemoryCacheBase() = default;
 
   size_t Read(uint64_t addr, void* dst, size_t size) override {
-    // Only look at the cache for small reads.
-    if (size > 64) {
-      return impl_->Read(addr, dst, size);
-    }
-    return CachedRead(addr, dst, size);
+    return TraceMemoryRead("cache", addr, size, CachedRead(addr, dst, size));
   }
 
   long ReadTag(uint64_t addr) override { return impl_->ReadTag(addr); }
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override {
+    return impl_->ReadTags(addr, count, tags);
+  }
+
+  void SetMaps(Maps* maps) override { maps_ = maps; }
+
+  // The number of pages after a missing page that are read along with it,
+  // in a single Memory::ReadBatch call.
+  void set_prefetch_pages(size_t pages);
+  size_t prefetch_pages() { return prefetch_pages_; }
 
  protected:
-  constexpr static size_t kCacheBits = 12;
-  constexpr static size_t kCacheMask = (1 << kCacheBits) - 1;
-  constexpr static size_t kCacheSize = 1 << kCacheBits;
+  constexpr static size_t kMaxPrefetchPages = 8;
+  constexpr static size_t kSlabSize = 64 * 1024;
+  constexpr static uint32_t kNoSlot = UINT32_MAX;
+
+  // The pages of one cache. Each page lives in a slot, and the page data
+  // of the slots is carved out of slabs that are never freed. Clear only
+  // bumps the generation, slots from an older generation are stale and
+  // get reused before the cache grows. ClearWritable does the same with
+  // the writable generation, which only applies to writable pages.
+  struct CacheData {
+    struct Slot {
+      uint64_t page;
+      uint8_t* data;
+      // The least recently used list, only kept up to date for LRU eviction.
+      uint32_t prev = kNoSlot;
+      uint32_t next = kNoSlot;
+      uint64_t generation = 0;
+      uint64_t writable_generation = 0;
+      bool writable = true;
+      // The FillPages call that last filled this slot.
+      uint64_t fill = 0;
+      bool referenced = false;
+    };
 
-  using CacheDataType = std::unordered_map<uint64_t, uint8_t[kCacheSize]>;
+    void Clear() {
+      generation++;
+      live_slots = 0;
+      writable_slots = 0;
+      free_slots.clear();
+    }
+
+    void ClearWritable() {
+      writable_generation++;
+      live_slots -= writable_slots;
+      writable_slots = 0;
+    }
+
+    bool Stale(const Slot& slot) {
+      return slot.generation != generation ||
+             (slot.writable && slot.writable_generation != writable_generation);
+    }
+
+    std::unordered_map<uint64_t, uint32_t> pages;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<std::unique_ptr<uint8_t[]>> slabs;
+    size_t slab_pages_left = 0;
+    // The slots that are not stale, and the writable ones among them.
+    size_t live_slots = 0;
+    size_t writable_slots = 0;
+    uint32_t head = kNoSlot;
+    uint32_t tail = kNoSlot;
+    uint32_t clock_hand = 0;
+    uint32_t stale_hand = 0;
+    uint64_t generation = 1;
+    uint64_t writable_generation = 1;
+    // The maps used to find writable pages.
+    Maps* maps = nullptr;
+    uint64_t fills = 0;
+    MemoryCacheStats stats;
+  };
 
   virtual size_t CachedRead(uint64_t addr, void* dst, size_t size) = 0;
 
-  size_t InternalCachedRead(uint64_t addr, void* dst, size_t size, CacheDataType* cache);
+  // Returns the data of the page, reading it into the cache if needed, or
+  // nullptr if it cannot be read.
+  uint8_t* GetPage(uint64_t page, CacheData* cache);
+  uint8_t* FillPages(uint64_t page, CacheData* cache);
+  // Puts page in a new slot, its data is left to the caller.
+  uint32_t AddPage(uint64_t page, CacheData* cache);
+  // Returns the slot holding the page in the current generation, or kNoSlot.
+  uint32_t FindSlot(uint64_t page, CacheData* cache);
+  // Drops the entries of pages that are no longer cached.
+  void PrunePages(CacheData* cache);
+  // True unless the whole page is in one private read-only map of maps. The
+  // flags are the ones the maps were parsed with, so a map that is made
+  // writable later, with mprotect, keeps its pages until the maps are
+  // parsed again and the cache is cleared.
+  bool IsWritable(uint64_t page, Maps* maps);
+  void ClearWritable(CacheData* cache);
+  uint8_t* NewPageData(CacheData* cache);
+  // A bounded cache gets all of its pages in one slab.
+  size_t SlabPages() {
+    return max_pages_ != 0 ? max_pages_ : std::max<size_t>(1, kSlabSize >> page_bits_);
+  }
+  uint32_t AllocateSlot(CacheData* cache);
+  void FreeSlot(uint32_t slot, CacheData* cache);
+  void Unlink(uint32_t slot, CacheData* cache);
+  void LinkFront(uint32_t slot, CacheData* cache);
+
+  size_t InternalCachedRead(uint64_t addr, void* dst, size_t size, CacheData* cache);
 
   std::unique_ptr<Memory> impl_;
+  std::atomic<Maps*> maps_ = nullptr;
+  size_t page_bits_;
+  size_t page_size_;
+  size_t max_pages_;
+  MemoryCacheConfig::Eviction eviction_;
+  size_t max_cached_read_;
+  bool fill_large_reads_;
+  size_t prefetch_pages_ = 0;
 };
 
 class MemoryCache : public MemoryCacheBase {
  public:
-  MemoryCache(Memory* memory) : MemoryCacheBase(memory) {}
-  virtual ~MemoryCache() = default;
+  MemoryCache(Memory* memory, const MemoryCacheConfig& config = MemoryCacheConfig())
+      : MemoryCacheBase(memory, config), async_prefetch_(config.async_prefetch) {}
+  virtual ~MemoryCache();
 
   size_t CachedRead(uint64_t addr, void* dst, size_t size) override;
 
+  // Queues the pages for the prefetch thread, which is started by the
+  // first call.
+  void Prefetch(uint64_t addr, size_t size) override;
+
   void Clear() override;
+  void ClearWritable() override;
+
+  bool GetCacheStats(MemoryCacheStats* stats) override;
+
+  size_t MemoryUsage() override;
 
  protected:
-  CacheDataType cache_;
+  constexpr static size_t kMaxAsyncPrefetchPages = 64;
+  constexpr static size_t kMaxQueuedPrefetches = 16;
+
+  void PrefetchLoop();
+  // Reads the missing pages of [first, last] and adds them to the cache.
+  void PrefetchPages(uint64_t first, uint64_t last);
+
+  CacheData cache_;
 
   std::mutex cache_lock_;
+
+  bool async_prefetch_;
+  std::mutex prefetch_lock_;
+  std::condition_variable prefetch_cond_;
+  // The [first, last] page ranges waiting to be read.
+  std::deque<std::pair<uint64_t, uint64_t>> prefetch_queue_;
+  bool prefetch_stop_ = false;
+  std::thread prefetch_thread_;
+};
+
+// A cache shared by all of the threads reading through it, for many threads
+// unwinding the same process. The pages live in a fixed open addressed
+// table. Every slot has a sequence number that is odd while the slot is
+// being filled, readers copy a page without any lock and retry if the
+// sequence changed meanwhile. A thread that misses a page another thread
+// is reading waits for that read instead of reading the page again. When
+// there is no free slot near a page, it is read without being cached.
+//
+// Eviction and async prefetch are not supported, Clear and ClearWritable
+// only bump a generation, and the slots of older generations are reused.
+class MemoryConcurrentCache : public MemoryCacheBase {
+ public:
+  MemoryConcurrentCache(Memory* memory, const MemoryCacheConfig& config = MemoryCacheConfig());
+  virtual ~MemoryConcurrentCache();
+
+  size_t CachedRead(uint64_t addr, void* dst, size_t size) override;
+
+  void Clear() override;
+  void ClearWritable() override;
+
+  bool GetCacheStats(MemoryCacheStats* stats) override;
+
+  size_t MemoryUsage() override;
+
+ protected:
+  // The number of slots when max_pages is not set.
+  constexpr static size_t kDefaultSlots = 8192;
+  // The slots searched for a page, starting at its hash.
+  constexpr static size_t kMaxProbes = 16;
+  constexpr static uint64_t kNoPage = UINT64_MAX;
+
+  struct Slot {
+    std::atomic_uint64_t sequence = 0;
+    std::atomic_uint64_t page = kNoPage;
+    std::atomic_uint64_t generation = 0;
+    std::atomic_uint64_t writable_generation = 0;
+    std::atomic_bool writable = false;
+    // Allocated the first time the slot is filled, freed with the cache.
+    std::atomic<uint8_t*> data = nullptr;
+  };
+
+  enum Lookup : uint8_t {
+    LOOKUP_HIT,
+    LOOKUP_MISS,
+    // Another thread is reading the page.
+    LOOKUP_BUSY,
+  };
+
+  size_t FirstSlot(uint64_t page) {
+    return ((page * 0x9e3779b97f4a7c15ULL) >> 32) & slot_mask_;
+  }
+  bool Stale(const Slot& slot);
+
+  // Copies length bytes at offset of page into dst if the page is cached.
+  Lookup ReadPage(uint64_t page, size_t offset, uint8_t* dst, size_t length);
+  // Reads page into a slot and copies the part wanted into dst. Returns
+  // false if the page cannot be read completely.
+  bool FillPage(uint64_t page, size_t offset, uint8_t* dst, size_t length);
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t slot_mask_;
+  std::atomic_uint64_t generation_ = 1;
+  std::atomic_uint64_t writable_generation_ = 1;
+  // The maps used to find writable pages.
+  std::atomic<Maps*> fill_maps_ = nullptr;
+
+  std::atomic_uint64_t hits_ = 0;
+  std::atomic_uint64_t misses_ = 0;
+  std::atomic_uint64_t uncached_reads_ = 0;
+  std::atomic_size_t data_pages_ = 0;
 };
 
 class MemoryThreadCache : public MemoryCacheBase {
  public:
-  MemoryThreadCache(Memory* memory);
+  MemoryThreadCache(Memory* memory, const MemoryCacheConfig& config = MemoryCacheConfig());
   virtual ~MemoryThreadCache();
 
   size_t CachedRead(uint64_t addr, void* dst, size_t size) override;
 
   void Clear() override;
+  void ClearWritable() override;
+
+  bool GetCacheStats(MemoryCacheStats* stats) override;
 
  protected:
+  struct ThreadCacheData : public CacheData {
+    MemoryThreadCache* owner;
+  };
+
+  // Called when a thread exits, its cache goes back to the pool.
+  void Release(ThreadCacheData* cache);
+
   std::optional<pthread_key_t> thread_cache_;
+
+  // Every cache handed out to a thread, the free ones are kept for the
+  // next thread that needs one.
+  std::mutex pool_lock_;
+  std::vector<std::unique_ptr<ThreadCacheData>> caches_;
+  std::vector<ThreadCacheData*> free_caches_;
 };
 
 }  // namespace unwindstack
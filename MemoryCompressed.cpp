@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unwindstack/Memory.h>
+
+#include "MemoryCompressed.h"
+#include "MemoryTrace.h"
+
+namespace unwindstack {
+
+// The compressed data is read in chunks of this size.
+static constexpr size_t kInputSize = 64 * 1024;
+
+// Approximate heap memory of an inflate state, most of it is the window.
+static constexpr size_t kStreamStateSize = 48 * 1024;
+
+static constexpr uint64_t kInvalidBlock = UINT64_MAX;
+
+struct MemoryCompressed::Checkpoint {
+  Checkpoint() { memset(&stream, 0, sizeof(stream)); }
+  ~Checkpoint() {
+    if (initialized) {
+      inflateEnd(&stream);
+    }
+  }
+
+  bool CopyFrom(Checkpoint* other) {
+    if (initialized) {
+      inflateEnd(&stream);
+      initialized = false;
+    }
+    if (inflateCopy(&stream, &other->stream) != Z_OK) {
+      return false;
+    }
+    initialized = true;
+    // The input that was not consumed yet is read again if needed, since
+    // the buffer it points into is reused.
+    input_offset = other->input_offset - other->stream.avail_in;
+    stream.next_in = nullptr;
+    stream.avail_in = 0;
+    return true;
+  }
+
+  z_stream stream;
+  bool initialized = false;
+  // Offset of the compressed data after the input given to the stream.
+  uint64_t input_offset = 0;
+};
+
+MemoryCompressed::MemoryCompressed(Memory* memory, uint64_t addr, uint64_t size,
+                                   uint64_t decompressed_size)
+    : compressed_memory_(memory),
+      compressed_addr_(addr),
+      compressed_size_(size),
+      size_(decompressed_size) {}
+
+MemoryCompressed::~MemoryCompressed() = default;
+
+bool MemoryCompressed::Init() {
+  if (compressed_size_ == 0 || size_ == 0) {
+    return false;
+  }
+  stream_.reset(new Checkpoint);
+  if (inflateInit(&stream_->stream) != Z_OK) {
+    return false;
+  }
+  stream_->initialized = true;
+  std::unique_ptr<Checkpoint> start(new Checkpoint);
+  if (!start->CopyFrom(stream_.get())) {
+    return false;
+  }
+  checkpoints_.push_back(std::move(start));
+  input_.resize(std::min<uint64_t>(compressed_size_, kInputSize));
+  return true;
+}
+
+bool MemoryCompressed::RestoreCheckpoint(size_t index) {
+  if (!stream_->CopyFrom(checkpoints_[index].get())) {
+    stream_block_ = kInvalidBlock;
+    return false;
+  }
+  stream_block_ = index * kCheckpointBlocks;
+  return true;
+}
+
+bool MemoryCompressed::DecompressBlock(uint8_t* data) {
+  z_stream* stream = &stream_->stream;
+  uint64_t start = stream_block_ * kBlockSize;
+  if (start >= size_) {
+    return false;
+  }
+  stream->next_out = data;
+  stream->avail_out = std::min<uint64_t>(kBlockSize, size_ - start);
+  while (stream->avail_out != 0) {
+    if (stream->avail_in == 0) {
+      uint64_t offset = stream_->input_offset;
+      if (offset >= compressed_size_) {
+        return false;
+      }
+      size_t size = std::min<uint64_t>(input_.size(), compressed_size_ - offset);
+      if (!compressed_memory_->ReadFully(compressed_addr_ + offset, input_.data(), size)) {
+        return false;
+      }
+      stream->next_in = input_.data();
+      stream->avail_in = size;
+      stream_->input_offset += size;
+    }
+    int result = inflate(stream, Z_NO_FLUSH);
+    if (result == Z_STREAM_END) {
+      if (stream->avail_out != 0) {
+        return false;
+      }
+    } else if (result != Z_OK) {
+      return false;
+    }
+  }
+
+  stream_block_++;
+  if (stream_block_ % kCheckpointBlocks == 0 &&
+      checkpoints_.size() == stream_block_ / kCheckpointBlocks) {
+    std::unique_ptr<Checkpoint> checkpoint(new Checkpoint);
+    if (checkpoint->CopyFrom(stream_.get())) {
+      checkpoints_.push_back(std::move(checkpoint));
+    }
+  }
+  return true;
+}
+
+const uint8_t* MemoryCompressed::GetBlock(uint64_t index) {
+  use_count_++;
+  for (Block& block : blocks_) {
+    if (block.index == index) {
+      block.last_used = use_count_;
+      return block.data.get();
+    }
+  }
+
+  // Continue with the stream if it did not go past the block yet, and
+  // there is no checkpoint closer to it.
+  size_t checkpoint = std::min<uint64_t>(index / kCheckpointBlocks, checkpoints_.size() - 1);
+  if (stream_block_ == kInvalidBlock || stream_block_ > index ||
+      stream_block_ < checkpoint * kCheckpointBlocks) {
+    if (!RestoreCheckpoint(checkpoint)) {
+      return nullptr;
+    }
+  }
+
+  Block* block;
+  if (blocks_.size() < kMaxCachedBlocks) {
+    block = &blocks_.emplace_back();
+    block->data.reset(new uint8_t[kBlockSize]);
+  } else {
+    block = &*std::min_element(blocks_.begin(), blocks_.end(), [](const Block& a, const Block& b) {
+      return a.last_used < b.last_used;
+    });
+  }
+  // The blocks before the one wanted are decompressed into the same buffer,
+  // and dropped.
+  block->index = kInvalidBlock;
+  while (stream_block_ <= index) {
+    if (!DecompressBlock(block->data.get())) {
+      stream_block_ = kInvalidBlock;
+      return nullptr;
+    }
+  }
+  block->index = index;
+  block->last_used = use_count_;
+  return block->data.get();
+}
+
+size_t MemoryCompressed::Read(uint64_t addr, void* dst, size_t size) {
+  if (addr >= size_) {
+    return TraceMemoryRead("compressed", addr, size, 0);
+  }
+  size_t read_size = std::min<uint64_t>(size, size_ - addr);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+  size_t bytes = 0;
+  while (bytes < read_size) {
+    uint64_t index = (addr + bytes) / kBlockSize;
+    size_t block_offset = (addr + bytes) % kBlockSize;
+    const uint8_t* data = GetBlock(index);
+    if (data == nullptr) {
+      break;
+    }
+    size_t copy = std::min(read_size - bytes, kBlockSize - block_offset);
+    memcpy(&out[bytes], &data[block_offset], copy);
+    bytes += copy;
+  }
+  return TraceMemoryRead("compressed", addr, size, bytes);
+}
+
+size_t MemoryCompressed::MemoryUsage() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return blocks_.size() * kBlockSize + (checkpoints_.size() + 1) * kStreamStateSize +
+         input_.capacity();
+}
+
+}  // namespace unwindstack
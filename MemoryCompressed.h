@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_COMPRESSED_H
+#define _LIBUNWINDSTACK_MEMORY_COMPRESSED_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unwindstack/Memory.h>
+
+namespace unwindstack {
+
+// The decompressed data of a zlib stream, such as an elf section with the
+// SHF_COMPRESSED flag. The data is decompressed in blocks as it is read, and
+// only the most recently used blocks are kept. The state of the stream is
+// saved every kCheckpointBlocks blocks, so reading a block that was dropped
+// only decompresses from the checkpoint before it. Thread safe.
+class MemoryCompressed : public Memory {
+ public:
+  MemoryCompressed(Memory* memory, uint64_t addr, uint64_t size, uint64_t decompressed_size);
+  virtual ~MemoryCompressed();
+
+  bool Init();
+  uint64_t Size() { return size_; }
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+  size_t MemoryUsage() override;
+
+  static constexpr size_t kBlockSize = 64 * 1024;
+  static constexpr size_t kCheckpointBlocks = 16;
+  static constexpr size_t kMaxCachedBlocks = 32;
+
+ private:
+  struct Checkpoint;
+  struct Block {
+    uint64_t index;
+    uint64_t last_used;
+    std::unique_ptr<uint8_t[]> data;
+  };
+
+  // Returns the data of the block, decompressing it if needed.
+  const uint8_t* GetBlock(uint64_t index);
+  // Decompresses the next block of the stream into data.
+  bool DecompressBlock(uint8_t* data);
+  bool RestoreCheckpoint(size_t index);
+
+  Memory* compressed_memory_;
+  uint64_t compressed_addr_;
+  uint64_t compressed_size_;
+  uint64_t size_;
+
+  std::mutex lock_;
+  std::vector<Block> blocks_;
+  uint64_t use_count_ = 0;
+  // checkpoints_[i] is the state before block i * kCheckpointBlocks.
+  std::vector<std::unique_ptr<Checkpoint>> checkpoints_;
+  // The stream used to decompress, positioned before stream_block_.
+  std::unique_ptr<Checkpoint> stream_;
+  uint64_t stream_block_ = 0;
+  std::vector<uint8_t> input_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_COMPRESSED_H
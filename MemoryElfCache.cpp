@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/Memory.h>
+
+#include "MemoryBuffer.h"
+#include "MemoryElfCache.h"
+#include "MemoryRange.h"
+
+namespace unwindstack {
+
+std::shared_ptr<Elf> MemoryElfCache::Find(const std::string& build_id, ArchEnum arch) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = elfs_.find(build_id);
+  if (entry == elfs_.end() || entry->second->arch() != arch) {
+    return nullptr;
+  }
+  return entry->second;
+}
+
+void MemoryElfCache::Add(const std::string& build_id, const std::shared_ptr<Elf>& elf) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (elfs_.size() >= kMaxEntries) {
+    // Drop the elf objects no map uses any more.
+    for (auto it = elfs_.begin(); it != elfs_.end();) {
+      it = it->second.use_count() == 1 ? elfs_.erase(it) : std::next(it);
+    }
+    if (elfs_.size() >= kMaxEntries) {
+      return;
+    }
+  }
+  elfs_.emplace(build_id, elf);
+}
+
+void MemoryElfCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  elfs_.clear();
+}
+
+Memory* MemoryElfCache::CopyMemory(Memory* memory, uint64_t size) {
+  static constexpr uint64_t kChunkSize = 64 * 1024;
+  static constexpr uint64_t kPageSize = 4096;
+
+  std::unique_ptr<MemoryBuffer> buffer(new MemoryBuffer);
+  if (size == 0 || size > kMaxCopySize || !buffer->Resize(size)) {
+    return nullptr;
+  }
+
+  // The parts that could be read, the maps of the elf usually are one run.
+  std::vector<std::pair<uint64_t, uint64_t>> runs;
+  uint64_t addr = 0;
+  while (addr < size) {
+    size_t len = std::min(kChunkSize, size - addr);
+    size_t bytes = memory->Read(addr, buffer->GetPtr(addr), len);
+    if (bytes != 0) {
+      if (!runs.empty() && runs.back().second == addr) {
+        runs.back().second += bytes;
+      } else {
+        runs.emplace_back(addr, addr + bytes);
+      }
+      addr += bytes;
+    } else {
+      // Skip to the next page, where the next map may start.
+      addr = (addr + kPageSize) & ~(kPageSize - 1);
+    }
+  }
+
+  if (runs.empty()) {
+    return nullptr;
+  }
+  if (runs.size() == 1 && runs[0].first == 0) {
+    return buffer->Resize(runs[0].second) ? buffer.release() : nullptr;
+  }
+
+  std::shared_ptr<Memory> shared(buffer.release());
+  MemoryRanges* ranges = new MemoryRanges;
+  for (const auto& [begin, end] : runs) {
+    ranges->Insert(new MemoryRange(shared, begin, end - begin, begin));
+  }
+  return ranges;
+}
+
+}  // namespace unwindstack
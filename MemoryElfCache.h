@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_ELF_CACHE_H
+#define _LIBUNWINDSTACK_MEMORY_ELF_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <unwindstack/Arch.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Elf;
+class Memory;
+
+// The process wide cache of the elf objects made from the memory of a
+// process, used when MapInfo::SetMemoryElfCacheEnabled is on, keyed by the
+// build id in the notes of the elf. The maps of a library that cannot be
+// read from its file, in any number of processes, such as the apps forked
+// from one zygote, then share one elf and its unwind tables, and only read
+// its headers from the memory of each process.
+//
+// The cached elf objects read a copy of the memory of the process they
+// were made in, so they keep working after that process is gone.
+class MemoryElfCache {
+ public:
+  static constexpr size_t kMaxEntries = 256;
+  // Larger elfs are not copied, and not cached.
+  static constexpr uint64_t kMaxCopySize = 256 * 1024 * 1024;
+
+  MemoryElfCache() = default;
+  ~MemoryElfCache() = default;
+
+  // Returns nullptr if there is no elf with build_id for arch.
+  std::shared_ptr<Elf> Find(const std::string& build_id, ArchEnum arch);
+
+  void Add(const std::string& build_id, const std::shared_ptr<Elf>& elf);
+
+  void Clear();
+
+  // Copies the first size bytes of memory, reading nothing for the parts
+  // that cannot be read, so that reads of those still fail in the copy.
+  // Returns nullptr if nothing could be read.
+  static Memory* CopyMemory(Memory* memory, uint64_t size);
+
+ private:
+  std::mutex lock_;
+  std::unordered_map<std::string, std::shared_ptr<Elf>> elfs_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_ELF_CACHE_H
@@ -19,10 +19,19 @@
 
 #include <stdint.h>
 
+#include <memory>
+#include <string>
+
 #include <unwindstack/Memory.h>
 
 namespace unwindstack {
 
+// A whole file mapped once, shared by every window of the file.
+struct MappedFile;
+
+// A window into a file. The file is mapped whole and the mapping is kept in
+// a process wide pool, so all of the windows of a file, from every map and
+// every elf, share a single mapping for as long as one of them is alive.
 class MemoryFileAtOffset : public Memory {
  public:
   MemoryFileAtOffset() = default;
@@ -32,6 +41,10 @@ class MemoryFileAtOffset : public Memory {
 
   uint8_t* GetPtr(size_t addr = 0) override { return addr < size_ ? data_ + addr : nullptr; }
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override {
+    return addr <= size_ && size <= size_ - addr ? data_ + addr : nullptr;
+  }
+
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
   size_t Size() { return size_; }
@@ -39,9 +52,12 @@ class MemoryFileAtOffset : public Memory {
   void Clear() override;
 
  protected:
+  // Maps only the window, for files that are not pooled.
+  bool InitWindow(const std::string& file, uint64_t offset, uint64_t size);
+
   size_t size_ = 0;
-  size_t offset_ = 0;
   uint8_t* data_ = nullptr;
+  std::shared_ptr<MappedFile> file_;
 };
 
 }  // namespace unwindstack
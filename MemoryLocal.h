@@ -19,17 +19,67 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
 #include <unwindstack/Memory.h>
 
 namespace unwindstack {
 
+// Forward declarations.
+class LocalUpdatableMaps;
+struct MapInfo;
+
 class MemoryLocal : public Memory {
  public:
-  MemoryLocal() = default;
+  MemoryLocal() : fault_safe_(fault_safe_reads_.load(std::memory_order_relaxed)) {}
+  // A fault safe read must not be the first thread local access of a
+  // thread inside a signal handler, since that can allocate.
+  explicit MemoryLocal(bool fault_safe) : fault_safe_(fault_safe) {}
   virtual ~MemoryLocal() = default;
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
   long ReadTag(uint64_t addr) override;
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override;
+
+  static void SetFaultSafeReads(bool enable);
+
+ private:
+  bool fault_safe_;
+
+  static std::atomic_bool fault_safe_reads_;
+};
+
+// Finds the stack of the calling thread, returns false if it cannot be
+// found. Not async-signal-safe.
+bool GetLocalThreadStack(uint64_t* start, uint64_t* end);
+
+// Reads the memory of this process without a system call where it is known
+// to be readable and to stay mapped while the caller unwinds: the stack of
+// the calling thread above its current frame, and the read only maps of
+// files in maps, up to the end of the file. Everything else is read as
+// MemoryLocal does.
+class MemoryLocalDirect : public MemoryLocal {
+ public:
+  explicit MemoryLocalDirect(LocalUpdatableMaps* maps) : maps_(maps) {}
+  virtual ~MemoryLocalDirect() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
+ private:
+  bool IsDirect(uint64_t addr, size_t size);
+
+  // The end of the part of map_info backed by the file, pages past the end
+  // of a file fault when touched. Returns 0 if the file cannot be found.
+  uint64_t GetFileEnd(MapInfo* map_info);
+
+  LocalUpdatableMaps* maps_;
+
+  std::mutex file_ends_lock_;
+  // The map entries are never freed while the maps exist.
+  std::unordered_map<MapInfo*, uint64_t> file_ends_;
 };
 
 }  // namespace unwindstack
@@ -14,21 +14,104 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/ptrace.h>
 #include <sys/uio.h>
-#include <sys/ptrace.h>
+#include <unistd.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
 
 #include "MemoryLocal.h"
 #include "MemoryRemote.h"
 
+#if defined(__aarch64__)
+#if !defined(PTRACE_PEEKMTETAGS)
+#define PTRACE_PEEKMTETAGS 33
+#endif
+#if !defined(HWCAP2_MTE)
+#define HWCAP2_MTE (1 << 18)
+#endif
+#endif
+
 namespace unwindstack {
 
+#if defined(__aarch64__)
+static bool LocalMteSupported() {
+  static const bool supported = (getauxval(AT_HWCAP2) & HWCAP2_MTE) != 0;
+  return supported;
+}
+
+// Memory mapped without PROT_MTE has tag zero.
+static uint8_t LoadTag(uint64_t addr) {
+  __asm__ volatile(".arch_extension memtag\n\tldg %0, [%0]" : "+r"(addr) : : "memory");
+  return (addr >> 56) & 0xf;
+}
+#endif
+
 long MemoryRemote::ReadTag(uint64_t addr) {
-  return -1;
+  uint8_t tag;
+  return ReadTags(addr, 1, &tag) == 1 ? tag : -1;
+}
+
+size_t MemoryRemote::ReadTags(uint64_t addr, size_t count, uint8_t* tags) {
+#if defined(__aarch64__)
+  addr &= ~(kTagGranuleSize - 1);
+  size_t read = 0;
+  while (read < count) {
+    // The kernel stops at the end of the tagged memory, and sets iov_len to
+    // the number of tags it read.
+    iovec iov = {tags + read, count - read};
+    if (ptrace(PTRACE_PEEKMTETAGS, pid_, reinterpret_cast<void*>(addr + read * kTagGranuleSize),
+               &iov) != 0 ||
+        iov.iov_len == 0) {
+      break;
+    }
+    read += iov.iov_len;
+  }
+  return read;
+#else
+  (void)addr;
+  (void)count;
+  (void)tags;
+  return 0;
+#endif
 }
 
 long MemoryLocal::ReadTag(uint64_t addr) {
-  return -1;
+  uint8_t tag;
+  return ReadTags(addr, 1, &tag) == 1 ? tag : -1;
+}
+
+size_t MemoryLocal::ReadTags(uint64_t addr, size_t count, uint8_t* tags) {
+#if defined(__aarch64__)
+  if (!LocalMteSupported()) {
+    return 0;
+  }
+  addr &= ~(kTagGranuleSize - 1);
+  uint64_t page_mask = ~static_cast<uint64_t>(getpagesize() - 1);
+  uint64_t checked_page = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t granule = addr + i * kTagGranuleSize;
+    // ldg faults on memory that is not mapped, so check that each page can
+    // be read before loading its tags.
+    if (i == 0 || (granule & page_mask) != checked_page) {
+      uint8_t byte;
+      if (Read(granule, &byte, 1) != 1) {
+        return i;
+      }
+      checked_page = granule & page_mask;
+    }
+    tags[i] = LoadTag(granule);
+  }
+  return count;
+#else
+  (void)addr;
+  (void)count;
+  (void)tags;
+  return 0;
+#endif
 }
 
 }  // namespace unwindstack
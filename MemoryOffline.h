@@ -38,6 +38,12 @@ class MemoryOffline : public Memory {
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
+  // The address range of the data, empty if Init failed.
+  uint64_t start() { return memory_ ? memory_->offset() : 0; }
+  uint64_t end() { return memory_ ? memory_->offset() + memory_->length() : 0; }
+
  private:
   std::unique_ptr<MemoryRange> memory_;
 };
@@ -47,12 +53,22 @@ class MemoryOfflineParts : public Memory {
   MemoryOfflineParts() = default;
   virtual ~MemoryOfflineParts();
 
-  void Add(MemoryOffline* memory) { memories_.push_back(memory); }
+  void Add(MemoryOffline* memory);
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
  private:
-  std::vector<MemoryOffline*> memories_;
+  struct Part {
+    uint64_t start;
+    uint64_t end;
+    // The largest end of this part and all the parts before it, so that a
+    // lookup can stop walking back as soon as no earlier part can overlap.
+    uint64_t max_end;
+    MemoryOffline* memory;
+  };
+
+  // Sorted by start address.
+  std::vector<Part> parts_;
 };
 
 }  // namespace unwindstack
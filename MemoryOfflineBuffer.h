@@ -32,6 +32,8 @@ class MemoryOfflineBuffer : public Memory {
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
  private:
   const uint8_t* data_;
   uint64_t start_;
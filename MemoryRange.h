@@ -38,6 +38,8 @@ class MemoryRange : public Memory {
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
   uint64_t offset() { return offset_; }
   uint64_t length() { return length_; }
 
@@ -57,6 +59,8 @@ class MemoryRanges : public Memory {
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
  private:
   std::map<uint64_t, std::unique_ptr<MemoryRange>> maps_;
 };
@@ -28,17 +28,40 @@ namespace unwindstack {
 
 class MemoryRemote : public Memory {
  public:
-  MemoryRemote(pid_t pid) : pid_(pid), read_redirect_func_(0) {}
-  virtual ~MemoryRemote() = default;
+  static constexpr size_t kMaxMethods = 3;
+
+  MemoryRemote(pid_t pid);
+  virtual ~MemoryRemote();
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
+  size_t ReadBatch(MemoryReadRequest* requests, size_t count) override;
   long ReadTag(uint64_t addr) override;
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override;
 
   pid_t pid() { return pid_; }
 
+  static void SetMethods(const MemoryRemoteMethod* methods, size_t count);
+
  private:
+  static constexpr int kMethodUnknown = -1;
+  static constexpr int kProcMemUnopened = -2;
+
+  size_t ReadWithMethod(MemoryRemoteMethod method, uint64_t addr, void* dst, size_t size);
+  // Reads with the methods from index first on, other than ptrace.
+  size_t ReadFallback(size_t first, uint64_t addr, void* dst, size_t size);
+
+  // Returns the /proc/<pid>/mem file, opening it the first time.
+  int ProcMemFd();
+
   pid_t pid_;
-  std::atomic_uintptr_t read_redirect_func_;
+  MemoryRemoteMethod methods_[kMaxMethods];
+  size_t num_methods_ = 0;
+  // The index in methods_ of the method that worked.
+  std::atomic_int method_ = kMethodUnknown;
+  std::atomic_int proc_mem_fd_ = kProcMemUnopened;
+
+  static MemoryRemoteMethod default_methods_[kMaxMethods];
+  static size_t num_default_methods_;
 };
 
 }  // namespace unwindstack
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_STACK_SNAPSHOT_H
+#define _LIBUNWINDSTACK_MEMORY_STACK_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <unwindstack/Memory.h>
+
+namespace unwindstack {
+
+// A copy of a range of memory, usually the stack of a thread, taken with a
+// single read. Reads in the copied range are served from the copy, all
+// other reads go to the underlying memory.
+class MemoryStackSnapshot : public Memory {
+ public:
+  MemoryStackSnapshot() = default;
+  virtual ~MemoryStackSnapshot() = default;
+
+  // Copies [start, start + size) from memory, and returns the number of
+  // bytes copied. The memory object must outlive any reads until Reset.
+  size_t Take(Memory* memory, uint64_t start, size_t size);
+  void Reset();
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
+  long ReadTag(uint64_t addr) override { return memory_->ReadTag(addr); }
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override {
+    return memory_->ReadTags(addr, count, tags);
+  }
+
+ private:
+  Memory* memory_ = nullptr;
+  std::vector<uint8_t> data_;
+  uint64_t start_ = 0;
+  uint64_t end_ = 0;
+};
+
+// A stack that was copied elsewhere, for example into a perf sample, read
+// in place. Reads in the copied range are served from the copy, all other
+// reads go to the underlying memory, and fail if there is none.
+class MemoryStackOverlay : public Memory {
+ public:
+  MemoryStackOverlay() = default;
+  virtual ~MemoryStackOverlay() = default;
+
+  // The data must stay valid for any reads until Reset.
+  void Set(const uint8_t* data, uint64_t start, size_t size, std::shared_ptr<Memory> memory);
+  void Reset();
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override;
+
+  long ReadTag(uint64_t addr) override { return memory_ ? memory_->ReadTag(addr) : -1; }
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override {
+    return memory_ ? memory_->ReadTags(addr, count, tags) : 0;
+  }
+
+ private:
+  std::shared_ptr<Memory> memory_;
+  const uint8_t* data_ = nullptr;
+  uint64_t start_ = 0;
+  uint64_t end_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_STACK_SNAPSHOT_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <unwindstack/Memory.h>
+#include <unwindstack/MemoryTracer.h>
+
+#include "MemoryTrace.h"
+
+namespace unwindstack {
+
+static std::atomic<MemoryTracer*> g_tracer;
+
+void Memory::SetTracer(MemoryTracer* tracer) {
+  g_tracer.store(tracer, std::memory_order_release);
+}
+
+#if defined(UNWINDSTACK_MEMORY_TRACE)
+size_t TraceMemoryRead(const char* name, uint64_t addr, size_t size, size_t bytes_read) {
+  MemoryTracer* tracer = g_tracer.load(std::memory_order_acquire);
+  if (tracer != nullptr) {
+    tracer->Read(name, addr, size, bytes_read);
+  }
+  return bytes_read;
+}
+#endif
+
+std::shared_ptr<Memory> Memory::CreateTracedMemory(std::shared_ptr<Memory> memory,
+                                                   const char* name, MemoryTracer* tracer) {
+  return std::shared_ptr<Memory>(new MemoryTraced(std::move(memory), name, tracer));
+}
+
+size_t MemoryTraced::Read(uint64_t addr, void* dst, size_t size) {
+  size_t bytes = memory_->Read(addr, dst, size);
+  tracer_->Read(name_, addr, size, bytes);
+  return bytes;
+}
+
+size_t MemoryTraced::ReadBatch(MemoryReadRequest* requests, size_t count) {
+  size_t read_fully = memory_->ReadBatch(requests, count);
+  for (size_t i = 0; i < count; i++) {
+    tracer_->Read(name_, requests[i].addr, requests[i].size, requests[i].bytes_read);
+  }
+  return read_fully;
+}
+
+void MemoryReadCounter::Read(const char* name, uint64_t addr, size_t size, size_t bytes_read) {
+  size_t bucket = size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+  bucket = std::min(bucket, MemoryReadCounts::kNumSizeBuckets - 1);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = counts_.find(std::string_view(name));
+  if (entry == counts_.end()) {
+    entry = counts_.emplace(name, MemoryReadCounts()).first;
+  }
+  MemoryReadCounts& counts = entry->second;
+  counts.reads++;
+  if (bytes_read < size) {
+    counts.short_reads++;
+  }
+  counts.bytes_requested += size;
+  counts.bytes_read += bytes_read;
+  counts.size_buckets[bucket]++;
+  counts.regions[(addr >> region_shift_) << region_shift_]++;
+}
+
+void MemoryReadCounter::ForEach(
+    const std::function<void(const std::string&, const MemoryReadCounts&)>& callback) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const auto& [name, counts] : counts_) {
+    callback(name, counts);
+  }
+}
+
+MemoryReadCounts MemoryReadCounter::Get(const std::string& name) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = counts_.find(name);
+  return entry != counts_.end() ? entry->second : MemoryReadCounts();
+}
+
+void MemoryReadCounter::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  counts_.clear();
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_TRACE_H
+#define _LIBUNWINDSTACK_MEMORY_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <utility>
+
+#include <unwindstack/Memory.h>
+#include <unwindstack/MemoryTracer.h>
+
+namespace unwindstack {
+
+// Passes a read to the tracer set with Memory::SetTracer and returns
+// bytes_read. Without UNWINDSTACK_MEMORY_TRACE this does nothing.
+#if defined(UNWINDSTACK_MEMORY_TRACE)
+size_t TraceMemoryRead(const char* name, uint64_t addr, size_t size, size_t bytes_read);
+#else
+inline size_t TraceMemoryRead(const char*, uint64_t, size_t, size_t bytes_read) {
+  return bytes_read;
+}
+#endif
+
+class MemoryTraced : public Memory {
+ public:
+  MemoryTraced(std::shared_ptr<Memory> memory, const char* name, MemoryTracer* tracer)
+      : memory_(std::move(memory)), name_(name), tracer_(tracer) {}
+  virtual ~MemoryTraced() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+  size_t ReadBatch(MemoryReadRequest* requests, size_t count) override;
+  long ReadTag(uint64_t addr) override { return memory_->ReadTag(addr); }
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override {
+    return memory_->ReadTags(addr, count, tags);
+  }
+
+  void Clear() override { memory_->Clear(); }
+  void ClearWritable() override { memory_->ClearWritable(); }
+  void SetMaps(Maps* maps) override { memory_->SetMaps(maps); }
+  bool GetCacheStats(MemoryCacheStats* stats) override { return memory_->GetCacheStats(stats); }
+  void Prefetch(uint64_t addr, size_t size) override { memory_->Prefetch(addr, size); }
+  size_t MemoryUsage() override { return memory_->MemoryUsage(); }
+
+ private:
+  std::shared_ptr<Memory> memory_;
+  const char* name_;
+  MemoryTracer* tracer_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_TRACE_H
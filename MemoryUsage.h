@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_USAGE_H
+#define _LIBUNWINDSTACK_MEMORY_USAGE_H
+
+#include <stddef.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace unwindstack {
+
+// Rough estimates of the heap memory used by standard containers. These are
+// only meant for accounting, they do not need to be exact.
+
+template <typename T>
+static inline size_t VectorMemoryUsage(const std::vector<T>& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+template <typename Key, typename Value>
+static inline size_t MapMemoryUsage(const std::map<Key, Value>& map) {
+  // Each node holds the value plus the parent, left and right pointers and
+  // the color.
+  return map.size() * (sizeof(typename std::map<Key, Value>::value_type) + 4 * sizeof(void*));
+}
+
+template <typename Key, typename Value>
+static inline size_t HashMapMemoryUsage(const std::unordered_map<Key, Value>& map) {
+  // Each node holds the value, the next pointer and the cached hash.
+  return map.bucket_count() * sizeof(void*) +
+         map.size() *
+             (sizeof(typename std::unordered_map<Key, Value>::value_type) + 2 * sizeof(void*));
+}
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_USAGE_H
@@ -34,8 +34,9 @@ class MemoryXz : public Memory {
   size_t Size() { return size_; }
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
+  size_t MemoryUsage() override { return used_; }
+
   // Methods used in tests.
-  size_t MemoryUsage() { return used_; }
   size_t BlockCount() { return blocks_.size(); }
   size_t BlockSize() { return 1 << block_size_log2_; }
 
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include <unwindstack/ElfInterface.h>
+
+#include "MemoryUsage.h"
+#include "MergedSymbols.h"
+#include "Symbols.h"
+
+namespace unwindstack {
+
+void MergedSymbols::Build() {
+  std::call_once(once_, [this]() {
+    std::vector<FunctionSymbol> functions;
+    interfaces_[0]->GetFunctionSymbols(&functions);
+    size_t main_count = functions.size();
+    if (interfaces_[1] != nullptr) {
+      interfaces_[1]->GetFunctionSymbols(&functions);
+    }
+    for (size_t i = main_count; i < functions.size(); i++) {
+      functions[i].table |= kGnuDebugdataTable;
+    }
+    // The symbols are appended in search order, so a stable sort by
+    // address keeps the first table first for the same address.
+    std::stable_sort(functions.begin(), functions.end(),
+                     [](const FunctionSymbol& a, const FunctionSymbol& b) {
+                       return a.start < b.start;
+                     });
+
+    std::lock_guard<std::shared_mutex> guard(lock_);
+    starts_.reserve(functions.size());
+    sizes_.reserve(functions.size());
+    sources_.reserve(functions.size());
+    parents_.reserve(functions.size());
+    // The functions that contain the current start, the innermost last.
+    std::vector<uint32_t> open;
+    for (const FunctionSymbol& function : functions) {
+      if (!starts_.empty() && starts_.back() == function.start) {
+        continue;
+      }
+      while (!open.empty() && starts_[open.back()] + sizes_[open.back()] <= function.start) {
+        open.pop_back();
+      }
+      parents_.push_back(open.empty() ? kNoParent : open.back());
+      open.push_back(starts_.size());
+      starts_.push_back(function.start);
+      sizes_.push_back(function.size);
+      sources_.push_back(Source{function.name_offset, function.table});
+    }
+    starts_.shrink_to_fit();
+    sizes_.shrink_to_fit();
+    parents_.shrink_to_fit();
+    sources_.shrink_to_fit();
+    names_.resize(starts_.size());
+  });
+}
+
+size_t MergedSymbols::FindContaining(size_t last, uint64_t addr) {
+  // The closer a function starts to addr, the more inner it is.
+  for (size_t index = last; index != kNoParent; index = parents_[index]) {
+    if (addr - starts_[index] < sizes_[index]) {
+      return index;
+    }
+  }
+  return starts_.size();
+}
+
+bool MergedSymbols::ReadName(size_t index) {
+  if (!names_[index].is_null()) {
+    return true;
+  }
+  const Source& source = sources_[index];
+  ElfInterface* interface = interfaces_[(source.table & kGnuDebugdataTable) != 0];
+  return interface->GetFunctionSymbolName(source.table & ~kGnuDebugdataTable, source.name_offset,
+                                          &names_[index]);
+}
+
+bool MergedSymbols::GetName(uint64_t addr, SharedString* name, uint64_t* func_offset) {
+  Build();
+  // The table does not change once built, only the names are filled in.
+  auto next = std::upper_bound(starts_.begin(), starts_.end(), addr);
+  if (next == starts_.begin()) {
+    return false;
+  }
+  size_t index = FindContaining(next - starts_.begin() - 1, addr);
+  if (index == starts_.size()) {
+    return false;
+  }
+  {
+    std::shared_lock<std::shared_mutex> guard(lock_);
+    if (!names_[index].is_null()) {
+      *func_offset = addr - starts_[index];
+      *name = names_[index];
+      return true;
+    }
+  }
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  if (!ReadName(index)) {
+    return false;
+  }
+  *func_offset = addr - starts_[index];
+  *name = names_[index];
+  return true;
+}
+
+void MergedSymbols::GetNames(const uint64_t* addrs, size_t count, SharedString* names,
+                             uint64_t* func_offsets, bool* found) {
+  Build();
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  // The last start <= addr, found as in GetName, but since the addresses
+  // are sorted the position only ever moves forward.
+  size_t last = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (found[i]) {
+      continue;
+    }
+    uint64_t addr = addrs[i];
+    while (last + 1 < starts_.size() && starts_[last + 1] <= addr) {
+      last++;
+    }
+    if (starts_.empty() || starts_[last] > addr) {
+      continue;
+    }
+    size_t index = FindContaining(last, addr);
+    if (index == starts_.size() || !ReadName(index)) {
+      continue;
+    }
+    names[i] = names_[index];
+    func_offsets[i] = addr - starts_[index];
+    found[i] = true;
+  }
+}
+
+size_t MergedSymbols::MemoryUsage() {
+  std::shared_lock<std::shared_mutex> guard(lock_);
+  size_t usage = sizeof(*this) + VectorMemoryUsage(starts_) + VectorMemoryUsage(sizes_) +
+                 VectorMemoryUsage(parents_) + VectorMemoryUsage(sources_) +
+                 VectorMemoryUsage(names_);
+  for (const auto& name : names_) {
+    usage += name.size();
+  }
+  return usage;
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MERGED_SYMBOLS_H
+#define _LIBUNWINDSTACK_MERGED_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include <unwindstack/SharedString.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class ElfInterface;
+
+// One sorted table of the function symbols of every symbol table of an
+// elf, including the ones in the gnu_debugdata section, so that a lookup is
+// a single search, whether a symbol is found or not. A function at the
+// same address in more than one table is kept only from the table that
+// would be searched first. When functions overlap, the innermost one that
+// contains an address is found. The names are only read on demand.
+class MergedSymbols {
+ public:
+  MergedSymbols(ElfInterface* interface, ElfInterface* gnu_debugdata_interface)
+      : interfaces_{interface, gnu_debugdata_interface} {}
+
+  // Builds the table, if it was not built yet. Called by the first lookup.
+  void Build();
+
+  bool GetName(uint64_t addr, SharedString* name, uint64_t* func_offset);
+
+  // Same as GetName for count sorted addresses, skipping the ones already
+  // found.
+  void GetNames(const uint64_t* addrs, size_t count, SharedString* names,
+                uint64_t* func_offsets, bool* found);
+
+  size_t MemoryUsage();
+
+ private:
+  // Returns the index of the innermost function containing addr, or the
+  // table size. last is the index of the last function that starts at or
+  // before addr.
+  size_t FindContaining(size_t last, uint64_t addr);
+
+  // Reads the name of the function at index if it was not read yet.
+  // Requires the exclusive lock to be held.
+  bool ReadName(size_t index);
+
+  // Set in the table of the symbols of the gnu_debugdata section.
+  static constexpr uint32_t kGnuDebugdataTable = 1U << 31;
+  static constexpr uint32_t kNoParent = UINT32_MAX;
+
+  struct Source {
+    uint32_t name_offset;
+    uint32_t table;
+  };
+
+  ElfInterface* interfaces_[2];
+  std::once_flag once_;
+  std::shared_mutex lock_;
+  std::vector<uint64_t> starts_;
+  std::vector<uint32_t> sizes_;
+  // The closest function before each one that contains its start, the
+  // chain from any function holds every earlier one that contains it.
+  std::vector<uint32_t> parents_;
+  std::vector<Source> sources_;
+  std::vector<SharedString> names_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MERGED_SYMBOLS_H
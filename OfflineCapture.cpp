@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/OfflineCapture.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsArm.h>
+#include <unwindstack/RegsArm64.h>
+#include <unwindstack/RegsMips.h>
+#include <unwindstack/RegsMips64.h>
+#include <unwindstack/RegsX86.h>
+#include <unwindstack/RegsX86_64.h>
+#include <unwindstack/SymbolStore.h>
+
+#include "MemoryCompressed.h"
+#include "MemoryFileAtOffset.h"
+
+namespace unwindstack {
+
+// The layout of a capture file, every part starts at a multiple of 8 bytes:
+//   CaptureHeader
+//   CaptureMap[num_maps]
+//   strings, the names and build ids of the maps
+//   samples, each a CaptureSample, the raw registers, CaptureChunk[num_chunks]
+//     and the data of the chunks
+//   uint64_t[num_samples], the offsets of the samples
+// The data of a sample with kSampleCompressed is a uint64_t with its size,
+// followed by a zlib stream of the data of its chunks. Version 1 files have
+// no compressed samples, and are otherwise the same.
+static constexpr char kCaptureMagic[8] = {'U', 'N', 'W', 'C', 'A', 'P', 'T', 0};
+static constexpr uint32_t kCaptureMinVersion = 1;
+static constexpr uint32_t kCaptureVersion = 2;
+
+static constexpr uint32_t kSampleCompressed = 1;
+
+struct CaptureHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t arch;
+  uint64_t num_maps;
+  uint64_t maps_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t num_samples;
+  uint64_t samples_offset;
+};
+
+struct CaptureMap {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;
+  uint64_t elf_start_offset;
+  // Relative to the start of the strings.
+  uint64_t name_offset;
+  uint64_t build_id_offset;
+  uint32_t flags;
+  uint32_t name_size;
+  uint32_t build_id_size;
+  uint32_t reserved;
+};
+
+struct CaptureSample {
+  uint32_t tid;
+  uint32_t regs_size;
+  uint32_t num_chunks;
+  uint32_t flags;
+};
+
+struct CaptureChunk {
+  uint64_t start;
+  uint64_t size;
+};
+
+static uint64_t AlignUp(uint64_t value) {
+  return (value + 7) & ~static_cast<uint64_t>(7);
+}
+
+// The chunks of memory of the current sample, sorted by address. The data
+// of a compressed sample is only decompressed as it is read.
+class MemoryOfflineChunks : public Memory {
+ public:
+  struct Chunk {
+    uint64_t start;
+    uint64_t end;
+    // nullptr if the data is at data_offset in the compressed data.
+    const uint8_t* data;
+    uint64_t data_offset;
+  };
+
+  MemoryOfflineChunks() = default;
+  virtual ~MemoryOfflineChunks() = default;
+
+  std::vector<Chunk>& chunks() { return chunks_; }
+  std::unique_ptr<MemoryCompressed>& compressed() { return compressed_; }
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    const Chunk* chunk = Find(addr);
+    if (chunk == nullptr) {
+      return 0;
+    }
+    size_t bytes = std::min<uint64_t>(size, chunk->end - addr);
+    if (chunk->data == nullptr) {
+      return compressed_->Read(chunk->data_offset + addr - chunk->start, dst, bytes);
+    }
+    memcpy(dst, &chunk->data[addr - chunk->start], bytes);
+    return bytes;
+  }
+
+  const uint8_t* GetPointer(uint64_t addr, size_t size) override {
+    const Chunk* chunk = Find(addr);
+    if (chunk == nullptr || chunk->data == nullptr || size > chunk->end - addr) {
+      return nullptr;
+    }
+    return &chunk->data[addr - chunk->start];
+  }
+
+  size_t MemoryUsage() override {
+    return compressed_ == nullptr ? 0 : compressed_->MemoryUsage();
+  }
+
+ private:
+  const Chunk* Find(uint64_t addr) {
+    auto it = std::upper_bound(chunks_.begin(), chunks_.end(), addr,
+                               [](uint64_t addr, const Chunk& chunk) { return addr < chunk.start; });
+    if (it == chunks_.begin() || addr >= (--it)->end) {
+      return nullptr;
+    }
+    return &*it;
+  }
+
+  std::vector<Chunk> chunks_;
+  std::unique_ptr<MemoryCompressed> compressed_;
+};
+
+static Regs* CreateRegs(ArchEnum arch) {
+  switch (ArchDispatch(arch)) {
+    case ARCH_X86:
+      return new RegsX86();
+    case ARCH_X86_64:
+      return new RegsX86_64();
+    case ARCH_ARM:
+      return new RegsArm();
+    case ARCH_ARM64:
+      return new RegsArm64();
+    case ARCH_MIPS:
+      return new RegsMips();
+    case ARCH_MIPS64:
+      return new RegsMips64();
+    case ARCH_UNKNOWN:
+    default:
+      return nullptr;
+  }
+}
+
+static size_t RegsSize(Regs* regs) {
+  return regs->total_regs() * (regs->Is32Bit() ? sizeof(uint32_t) : sizeof(uint64_t));
+}
+
+OfflineCaptureWriter::~OfflineCaptureWriter() {
+  if (fp_ != nullptr) {
+    fclose(fp_);
+  }
+}
+
+bool OfflineCaptureWriter::Write(const void* data, size_t size) {
+  static constexpr uint8_t kZeroes[8] = {};
+  size_t padding = AlignUp(size) - size;
+  if (fwrite(data, 1, size, fp_) != size || fwrite(kZeroes, 1, padding, fp_) != padding) {
+    return false;
+  }
+  offset_ += size + padding;
+  return true;
+}
+
+bool OfflineCaptureWriter::Open(const std::string& file, ArchEnum arch, Maps* maps,
+                                const std::shared_ptr<Memory>& process_memory) {
+  if (fp_ != nullptr) {
+    return false;
+  }
+  fp_ = fopen(file.c_str(), "w");
+  if (fp_ == nullptr) {
+    return false;
+  }
+  arch_ = arch;
+  offset_ = 0;
+  sample_offsets_.clear();
+
+  // Creating the elf of an executable map also sets the elf of the read
+  // only map before it, when the linker split the library in two. Only
+  // maps of files are looked up in a symbol directory, so special maps
+  // like [vsyscall], that might not even be readable, are skipped.
+  for (const auto& map_info : *maps) {
+    if ((map_info->flags & PROT_EXEC) && map_info->name.c_str()[0] == '/') {
+      map_info->GetElf(process_memory, arch);
+    }
+  }
+
+  CaptureHeader header = {};
+  memcpy(header.magic, kCaptureMagic, sizeof(header.magic));
+  header.version = kCaptureVersion;
+  header.arch = arch;
+  header.num_maps = maps->Total();
+  header.maps_offset = sizeof(header);
+
+  std::vector<CaptureMap> records;
+  std::string strings;
+  for (const auto& map_info : *maps) {
+    CaptureMap& record = records.emplace_back();
+    record = {};
+    record.start = map_info->start;
+    record.end = map_info->end;
+    record.offset = map_info->offset;
+    record.flags = map_info->flags;
+    record.elf_start_offset = map_info->offset;
+    record.name_offset = strings.size();
+    record.name_size = map_info->name.size();
+    strings += map_info->name;
+    if (map_info->elf != nullptr && map_info->elf->valid()) {
+      record.elf_start_offset = map_info->elf_start_offset;
+      std::string build_id = map_info->GetBuildID();
+      record.build_id_offset = strings.size();
+      record.build_id_size = build_id.size();
+      strings += build_id;
+    }
+  }
+  header.strings_offset = header.maps_offset + records.size() * sizeof(CaptureMap);
+  header.strings_size = strings.size();
+
+  if (!Write(&header, sizeof(header)) ||
+      !Write(records.data(), records.size() * sizeof(CaptureMap)) ||
+      !Write(strings.data(), strings.size())) {
+    fclose(fp_);
+    fp_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool OfflineCaptureWriter::AddSample(pid_t tid, Regs* regs, Memory* memory,
+                                     std::vector<std::pair<uint64_t, uint64_t>> ranges) {
+  if (fp_ == nullptr || regs->Arch() != arch_) {
+    return false;
+  }
+
+  // Chunks are kept sorted and not overlapping, so a read can find its
+  // chunk with a binary search.
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<CaptureChunk> chunks;
+  for (const auto& [start, end] : ranges) {
+    if (start >= end) {
+      continue;
+    }
+    if (!chunks.empty() && start <= chunks.back().start + chunks.back().size) {
+      CaptureChunk& last = chunks.back();
+      last.size = std::max(last.size, end - last.start);
+    } else {
+      chunks.push_back({start, end - start});
+    }
+  }
+
+  // Read all of the data first, the size of a chunk is only known after.
+  size_t total = 0;
+  for (CaptureChunk& chunk : chunks) {
+    total += AlignUp(chunk.size);
+  }
+  buffer_.resize(total);
+  uint8_t* data = buffer_.data();
+  size_t data_size = 0;
+  for (CaptureChunk& chunk : chunks) {
+    chunk.size = memory->Read(chunk.start, &data[data_size], chunk.size);
+    memset(&data[data_size + chunk.size], 0, AlignUp(chunk.size) - chunk.size);
+    data_size += AlignUp(chunk.size);
+  }
+
+  CaptureSample sample = {};
+  sample.tid = tid;
+  sample.regs_size = RegsSize(regs);
+  sample.num_chunks = chunks.size();
+
+  // The data is only stored compressed if that makes it smaller.
+  uint64_t compressed_size = 0;
+  if (compression_ && data_size != 0) {
+    uLongf size = compressBound(data_size);
+    compressed_buffer_.resize(size);
+    if (compress2(compressed_buffer_.data(), &size, data, data_size, Z_DEFAULT_COMPRESSION) ==
+            Z_OK &&
+        size + sizeof(compressed_size) < data_size) {
+      sample.flags |= kSampleCompressed;
+      compressed_size = size;
+    }
+  }
+
+  sample_offsets_.push_back(offset_);
+  if (!Write(&sample, sizeof(sample)) || !Write(regs->RawData(), sample.regs_size) ||
+      !Write(chunks.data(), chunks.size() * sizeof(CaptureChunk))) {
+    return false;
+  }
+  if (sample.flags & kSampleCompressed) {
+    return Write(&compressed_size, sizeof(compressed_size)) &&
+           Write(compressed_buffer_.data(), compressed_size);
+  }
+  return Write(data, data_size);
+}
+
+bool OfflineCaptureWriter::Finish() {
+  if (fp_ == nullptr) {
+    return false;
+  }
+  uint64_t samples_offset = offset_;
+  uint64_t num_samples = sample_offsets_.size();
+  bool written =
+      Write(sample_offsets_.data(), sample_offsets_.size() * sizeof(uint64_t)) &&
+      fseek(fp_, offsetof(CaptureHeader, num_samples), SEEK_SET) == 0 &&
+      fwrite(&num_samples, sizeof(num_samples), 1, fp_) == 1 &&
+      fwrite(&samples_offset, sizeof(samples_offset), 1, fp_) == 1;
+  written = fclose(fp_) == 0 && written;
+  fp_ = nullptr;
+  return written;
+}
+
+OfflineCapture::OfflineCapture() {
+  chunks_ = new MemoryOfflineChunks();
+  memory_.reset(chunks_);
+}
+
+OfflineCapture::~OfflineCapture() = default;
+
+bool OfflineCapture::Init(const std::string& file, SymbolStore* store) {
+  file_ = std::make_unique<MemoryFileAtOffset>();
+  if (!file_->Init(file, 0)) {
+    return false;
+  }
+  data_ = file_->GetPtr();
+  size_ = file_->Size();
+
+  CaptureHeader header;
+  if (data_ == nullptr || size_ < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data_, sizeof(header));
+  if (memcmp(header.magic, kCaptureMagic, sizeof(header.magic)) != 0 ||
+      header.version < kCaptureMinVersion || header.version > kCaptureVersion) {
+    return false;
+  }
+  arch_ = static_cast<ArchEnum>(header.arch);
+  regs_.reset(CreateRegs(arch_));
+  if (regs_ == nullptr) {
+    return false;
+  }
+  if (header.maps_offset > size_ ||
+      header.num_maps > (size_ - header.maps_offset) / sizeof(CaptureMap) ||
+      header.strings_offset > size_ || header.strings_size > size_ - header.strings_offset ||
+      header.samples_offset > size_ || header.samples_offset % sizeof(uint64_t) != 0 ||
+      header.num_samples > (size_ - header.samples_offset) / sizeof(uint64_t)) {
+    return false;
+  }
+
+  const char* strings = reinterpret_cast<const char*>(&data_[header.strings_offset]);
+  maps_ = Maps();
+  for (uint64_t i = 0; i < header.num_maps; i++) {
+    CaptureMap record;
+    memcpy(&record, &data_[header.maps_offset + i * sizeof(record)], sizeof(record));
+    if (record.name_offset > header.strings_size ||
+        record.name_size > header.strings_size - record.name_offset ||
+        record.build_id_offset > header.strings_size ||
+        record.build_id_size > header.strings_size - record.build_id_offset) {
+      return false;
+    }
+    std::string name(&strings[record.name_offset], record.name_size);
+    maps_.Add(record.start, record.end, record.offset, record.flags, name, INT64_MAX);
+    if (record.build_id_size == 0) {
+      continue;
+    }
+
+    MapInfo* map_info = (maps_.end() - 1)->get();
+    std::string build_id(&strings[record.build_id_offset], record.build_id_size);
+    if (store != nullptr) {
+      std::shared_ptr<Elf> elf = store->Find(build_id, arch_);
+      if (elf != nullptr && record.elf_start_offset <= record.offset) {
+        map_info->elf = elf;
+        map_info->elf_start_offset = record.elf_start_offset;
+        map_info->elf_offset = record.offset - record.elf_start_offset;
+      }
+    }
+    map_info->SetBuildID(std::move(build_id));
+  }
+
+  sample_offsets_ = reinterpret_cast<const uint64_t*>(&data_[header.samples_offset]);
+  num_samples_ = header.num_samples;
+  return true;
+}
+
+bool OfflineCapture::SetSample(size_t index) {
+  if (index >= num_samples_) {
+    return false;
+  }
+  uint64_t offset = sample_offsets_[index];
+  CaptureSample sample;
+  if (offset > size_ || sizeof(sample) > size_ - offset) {
+    return false;
+  }
+  memcpy(&sample, &data_[offset], sizeof(sample));
+  offset += sizeof(sample);
+  if (sample.regs_size != RegsSize(regs_.get()) || sample.regs_size > size_ - offset) {
+    return false;
+  }
+  memcpy(regs_->RawData(), &data_[offset], sample.regs_size);
+  regs_->ResetPseudoRegisters();
+  regs_->set_dex_pc(0);
+  offset += AlignUp(sample.regs_size);
+
+  if (offset > size_ || sample.num_chunks > (size_ - offset) / sizeof(CaptureChunk)) {
+    return false;
+  }
+  uint64_t data_offset = offset + sample.num_chunks * sizeof(CaptureChunk);
+  const uint8_t* chunk_data = &data_[data_offset];
+  uint64_t data_left = size_ - data_offset;
+  std::vector<MemoryOfflineChunks::Chunk>& chunks = chunks_->chunks();
+  std::unique_ptr<MemoryCompressed>& compressed = chunks_->compressed();
+  chunks.clear();
+  compressed.reset();
+
+  // The data of a compressed sample is not read here, so the chunks are
+  // only limited by the size of the data they decompress to.
+  bool is_compressed = sample.flags & kSampleCompressed;
+  uint64_t compressed_size = 0;
+  if (is_compressed) {
+    if (data_left < sizeof(compressed_size)) {
+      return false;
+    }
+    memcpy(&compressed_size, chunk_data, sizeof(compressed_size));
+    data_offset += sizeof(compressed_size);
+    if (compressed_size > data_left - sizeof(compressed_size)) {
+      return false;
+    }
+    data_left = UINT64_MAX;
+  }
+  uint64_t chunk_offset = 0;
+  for (uint32_t i = 0; i < sample.num_chunks; i++) {
+    CaptureChunk chunk;
+    memcpy(&chunk, &data_[offset + i * sizeof(chunk)], sizeof(chunk));
+    // Reads find their chunk with a binary search, which needs the chunks
+    // sorted and not overlapping, the same as they are written.
+    if (chunk.size > data_left || chunk.size > UINT64_MAX - chunk.start ||
+        (!chunks.empty() && chunk.start < chunks.back().end)) {
+      chunks.clear();
+      return false;
+    }
+    if (is_compressed) {
+      chunks.push_back({chunk.start, chunk.start + chunk.size, nullptr, chunk_offset});
+    } else {
+      chunks.push_back({chunk.start, chunk.start + chunk.size, &chunk_data[chunk_offset], 0});
+    }
+    uint64_t aligned_size = std::min(AlignUp(chunk.size), data_left);
+    chunk_offset += aligned_size;
+    data_left -= aligned_size;
+  }
+  if (is_compressed) {
+    compressed.reset(new MemoryCompressed(file_.get(), data_offset, compressed_size, chunk_offset));
+    if (!compressed->Init()) {
+      chunks.clear();
+      compressed.reset();
+      return false;
+    }
+  }
+  tid_ = sample.tid;
+  return true;
+}
+
+}  // namespace unwindstack
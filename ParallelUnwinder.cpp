@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/ParallelUnwinder.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+ParallelUnwinder::ParallelUnwinder(size_t max_frames, Maps* maps,
+                                   std::shared_ptr<Memory> process_memory, size_t num_threads)
+    : max_frames_(max_frames), maps_(maps), process_memory_(process_memory) {
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  num_threads_ = num_threads;
+}
+
+std::vector<UnwindBatchResult> ParallelUnwinder::Unwind(
+    const std::vector<UnwindSample>& samples,
+    const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  std::vector<UnwindBatchResult> results(samples.size());
+  if (samples.empty()) {
+    return results;
+  }
+
+  std::atomic<size_t> next_sample(0);
+  auto worker = [&]() {
+    Unwinder unwinder(max_frames_, maps_, process_memory_);
+    unwinder.SetResolveNames(resolve_names_);
+    unwinder.SetEmbeddedSoname(embedded_soname_);
+    unwinder.SetJitDebug(jit_debug_);
+
+    std::vector<UnwindSample> chunk;
+    while (true) {
+      size_t start = next_sample.fetch_add(kChunkSize, std::memory_order_relaxed);
+      if (start >= samples.size()) {
+        break;
+      }
+      size_t end = std::min(start + kChunkSize, samples.size());
+      chunk.assign(samples.begin() + start, samples.begin() + end);
+
+      std::vector<UnwindBatchResult> chunk_results =
+          unwinder.UnwindBatch(chunk, initial_map_names_to_skip, map_suffixes_to_ignore);
+      std::move(chunk_results.begin(), chunk_results.end(), results.begin() + start);
+    }
+  };
+
+  size_t num_chunks = (samples.size() + kChunkSize - 1) / kChunkSize;
+  size_t num_threads = std::min(num_threads_, num_chunks);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  // The calling thread does its share of the work too.
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+// Appends the threads of pid that are not in the set yet, returns false if
+// the task directory cannot be read.
+static bool ListNewThreads(pid_t pid, std::unordered_set<pid_t>* seen, std::vector<pid_t>* tids) {
+  std::string task_dir = "/proc/" + std::to_string(pid) + "/task";
+  DIR* dir = opendir(task_dir.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    char* end;
+    pid_t tid = strtol(entry->d_name, &end, 10);
+    if (end == entry->d_name || *end != '\0') {
+      continue;
+    }
+    if (seen->insert(tid).second) {
+      tids->push_back(tid);
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+bool ParallelUnwinder::UnwindProcess(pid_t pid, std::vector<ThreadUnwindResult>* threads,
+                                     const std::vector<std::string>* initial_map_names_to_skip,
+                                     const std::vector<std::string>* map_suffixes_to_ignore) {
+  threads->clear();
+  std::unordered_set<pid_t> seen;
+  std::vector<pid_t> tids;
+  if (!ListNewThreads(pid, &seen, &tids)) {
+    return false;
+  }
+
+  // Seize and interrupt every thread before waiting for any of them, so
+  // that all of the threads stop at the same time. Threads created while
+  // this is going on are picked up by listing the threads again, a few
+  // passes are enough unless the process creates threads nonstop.
+  std::vector<pid_t> attached;
+  constexpr size_t kMaxPasses = 4;
+  for (size_t pass = 0; pass < kMaxPasses && !tids.empty(); pass++) {
+    for (pid_t tid : tids) {
+      ThreadUnwindResult& thread = threads->emplace_back();
+      thread.tid = tid;
+      if (ptrace(PTRACE_SEIZE, tid, 0, 0) == 0) {
+        if (ptrace(PTRACE_INTERRUPT, tid, 0, 0) == 0) {
+          attached.push_back(tid);
+        } else {
+          ptrace(PTRACE_DETACH, tid, 0, 0);
+        }
+      }
+    }
+    tids.clear();
+    ListNewThreads(pid, &seen, &tids);
+  }
+
+  std::vector<pid_t> stopped;
+  // A thread can stop for a signal that arrived before the interrupt. The
+  // signal is only delivered if it is passed to the detach.
+  std::vector<int> pending_signals;
+  for (pid_t tid : attached) {
+    int status;
+    if (TEMP_FAILURE_RETRY(waitpid(tid, &status, __WALL)) == tid && WIFSTOPPED(status)) {
+      stopped.push_back(tid);
+      bool event_stop = (status >> 16) == PTRACE_EVENT_STOP;
+      pending_signals.push_back(event_stop ? 0 : WSTOPSIG(status));
+    }
+  }
+
+  // The results are in the order the threads were listed, find the entry of
+  // every stopped thread.
+  std::vector<std::unique_ptr<Regs>> regs;
+  std::vector<UnwindSample> samples;
+  std::vector<ThreadUnwindResult*> sample_threads;
+  auto thread_iter = threads->begin();
+  for (pid_t tid : stopped) {
+    while (thread_iter->tid != tid) {
+      ++thread_iter;
+    }
+    Regs* thread_regs = Regs::RemoteGet(tid);
+    if (thread_regs == nullptr) {
+      continue;
+    }
+    regs.emplace_back(thread_regs);
+    samples.emplace_back().regs = thread_regs;
+    sample_threads.push_back(&*thread_iter);
+  }
+
+  if (!regs.empty()) {
+    arch_ = regs[0]->Arch();
+  }
+  bool resolve_names = resolve_names_;
+  if (group_identical_stacks_) {
+    resolve_names_ = false;
+  }
+  std::vector<UnwindBatchResult> results =
+      Unwind(samples, initial_map_names_to_skip, map_suffixes_to_ignore);
+  resolve_names_ = resolve_names;
+  for (size_t i = 0; i < stopped.size(); i++) {
+    ptrace(PTRACE_DETACH, stopped[i], 0, pending_signals[i]);
+  }
+
+  for (size_t i = 0; i < results.size(); i++) {
+    sample_threads[i]->captured = true;
+    sample_threads[i]->result = std::move(results[i]);
+  }
+  if (group_identical_stacks_) {
+    GroupIdenticalStacks(threads);
+  }
+  return true;
+}
+
+static uint64_t HashPcs(const std::vector<FrameData>& frames) {
+  uint64_t hash = frames.size();
+  for (const FrameData& frame : frames) {
+    hash = (hash ^ frame.pc) * 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+static bool SamePcs(const std::vector<FrameData>& a, const std::vector<FrameData>& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+                                            [](const FrameData& frame_a, const FrameData& frame_b) {
+                                              return frame_a.pc == frame_b.pc;
+                                            });
+}
+
+void ParallelUnwinder::GroupIdenticalStacks(std::vector<ThreadUnwindResult>* threads) {
+  Unwinder symbolizer(max_frames_, maps_, process_memory_);
+  symbolizer.SetArch(arch_);
+  symbolizer.SetResolveNames(resolve_names_);
+  symbolizer.SetEmbeddedSoname(embedded_soname_);
+  symbolizer.SetJitDebug(jit_debug_);
+
+  // The first thread of every distinct stack, by the hash of its pcs.
+  std::unordered_map<uint64_t, std::vector<size_t>> stacks;
+  std::vector<CapturedFrame> captured;
+  for (size_t i = 0; i < threads->size(); i++) {
+    ThreadUnwindResult& thread = (*threads)[i];
+    if (!thread.captured) {
+      continue;
+    }
+    std::vector<FrameData>& frames = thread.result.frames;
+    std::vector<size_t>& firsts = stacks[HashPcs(frames)];
+    auto first = std::find_if(firsts.begin(), firsts.end(), [&](size_t index) {
+      return SamePcs((*threads)[index].result.frames, frames);
+    });
+    if (first != firsts.end()) {
+      thread.same_stack_as = *first;
+      continue;
+    }
+    firsts.push_back(i);
+
+    captured.clear();
+    for (const FrameData& frame : frames) {
+      CapturedFrame& entry = captured.emplace_back();
+      entry.pc = frame.pc;
+      entry.rel_pc = frame.rel_pc;
+      entry.num = frame.num;
+      entry.map_info = frame.map_end != 0 ? maps_->Find(frame.map_start) : nullptr;
+    }
+    std::vector<FrameData> named = symbolizer.Symbolize(captured);
+    for (size_t j = 0; j < frames.size(); j++) {
+      frames[j].map_name = named[j].map_name;
+      frames[j].function_name = named[j].function_name;
+      frames[j].function_offset = named[j].function_offset;
+      frames[j].demangled_name = named[j].demangled_name;
+    }
+  }
+}
+
+std::string ParallelUnwinder::FormatThreads(const std::vector<ThreadUnwindResult>& threads) {
+  Unwinder formatter(max_frames_, maps_, process_memory_);
+  formatter.SetArch(arch_);
+  std::string output;
+  for (const ThreadUnwindResult& thread : threads) {
+    output += "Thread " + std::to_string(thread.tid);
+    if (!thread.captured) {
+      output += ": not captured\n";
+    } else if (thread.same_stack_as < threads.size()) {
+      output += ": same stack as thread " + std::to_string(threads[thread.same_stack_as].tid) + "\n";
+    } else {
+      output += ":\n";
+      for (const FrameData& frame : thread.result.frames) {
+        output += "  " + formatter.FormatFrame(frame) + "\n";
+      }
+    }
+  }
+  return output;
+}
+
+bool ParallelUnwinder::DumpProcess(pid_t pid, size_t max_frames,
+                                   std::vector<ThreadUnwindResult>* threads, size_t num_threads,
+                                   bool group_identical_stacks) {
+  RemoteMaps maps(pid);
+  if (!maps.Parse()) {
+    return false;
+  }
+  ParallelUnwinder unwinder(max_frames, &maps, Memory::CreateProcessMemoryCached(pid),
+                            num_threads);
+  unwinder.SetGroupIdenticalStacks(group_identical_stacks);
+  return unwinder.UnwindProcess(pid, threads);
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <unwindstack/PerfSample.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+#include "MemoryStackSnapshot.h"
+
+namespace unwindstack {
+
+// Newer than some of the kernel headers this is built with.
+static constexpr uint64_t kPerfFormatLost = 1ULL << 4;
+static constexpr uint64_t kPerfSampleBranchHwIndex = 1ULL << 17;
+
+// Reads the fields of a record in order, failing once past its end.
+class RecordReader {
+ public:
+  RecordReader(const uint8_t* data, const uint8_t* end) : data_(data), end_(end) {}
+
+  bool Get(uint64_t* value) {
+    const uint8_t* data = Take(sizeof(*value));
+    if (data == nullptr) {
+      return false;
+    }
+    memcpy(value, data, sizeof(*value));
+    return true;
+  }
+
+  bool Skip(uint64_t size) { return Take(size) != nullptr; }
+
+  const uint8_t* Take(uint64_t size) {
+    if (size > static_cast<uint64_t>(end_ - data_)) {
+      return nullptr;
+    }
+    const uint8_t* data = data_;
+    data_ += size;
+    return data;
+  }
+
+ private:
+  const uint8_t* data_;
+  const uint8_t* end_;
+};
+
+static ArchEnum Arch32(ArchEnum arch) {
+  switch (arch) {
+    case ARCH_ARM64:
+      return ARCH_ARM;
+    case ARCH_X86_64:
+      return ARCH_X86;
+    case ARCH_MIPS64:
+      return ARCH_MIPS;
+    default:
+      return arch;
+  }
+}
+
+static bool SkipReadValues(const PerfEventFormat& format, RecordReader* reader) {
+  uint64_t times = ((format.read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) ? 8 : 0) +
+                   ((format.read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) ? 8 : 0);
+  uint64_t value_size = 8 + ((format.read_format & PERF_FORMAT_ID) ? 8 : 0) +
+                        ((format.read_format & kPerfFormatLost) ? 8 : 0);
+  if ((format.read_format & PERF_FORMAT_GROUP) == 0) {
+    return reader->Skip(value_size + times);
+  }
+  uint64_t nr;
+  return reader->Get(&nr) && reader->Skip(times) && nr <= UINT32_MAX &&
+         reader->Skip(nr * value_size);
+}
+
+bool PerfSample::Parse(const PerfEventFormat& format, const perf_event_header* record,
+                       PerfSample* sample) {
+  if (record->type != PERF_RECORD_SAMPLE || record->size < sizeof(*record)) {
+    return false;
+  }
+  const uint8_t* start = reinterpret_cast<const uint8_t*>(record);
+  RecordReader reader(start + sizeof(*record), start + record->size);
+  *sample = PerfSample();
+
+  uint64_t type = format.sample_type;
+  uint64_t value;
+  if ((type & PERF_SAMPLE_IDENTIFIER) && !reader.Skip(8)) {
+    return false;
+  }
+  if ((type & PERF_SAMPLE_IP) && !reader.Get(&sample->ip)) {
+    return false;
+  }
+  if (type & PERF_SAMPLE_TID) {
+    if (!reader.Get(&value)) {
+      return false;
+    }
+    // The pid is written first, as a u32.
+    memcpy(&sample->pid, &value, sizeof(sample->pid));
+    memcpy(&sample->tid, reinterpret_cast<uint8_t*>(&value) + 4, sizeof(sample->tid));
+  }
+  if ((type & PERF_SAMPLE_TIME) && !reader.Get(&sample->time)) {
+    return false;
+  }
+  if ((type & PERF_SAMPLE_ADDR) && !reader.Skip(8)) {
+    return false;
+  }
+  if ((type & PERF_SAMPLE_ID) && !reader.Skip(8)) {
+    return false;
+  }
+  if ((type & PERF_SAMPLE_STREAM_ID) && !reader.Skip(8)) {
+    return false;
+  }
+  if (type & PERF_SAMPLE_CPU) {
+    if (!reader.Get(&value)) {
+      return false;
+    }
+    memcpy(&sample->cpu, &value, sizeof(sample->cpu));
+  }
+  if ((type & PERF_SAMPLE_PERIOD) && !reader.Get(&sample->period)) {
+    return false;
+  }
+  if ((type & PERF_SAMPLE_READ) && !SkipReadValues(format, &reader)) {
+    return false;
+  }
+  if (type & PERF_SAMPLE_CALLCHAIN) {
+    if (!reader.Get(&value) || value > UINT32_MAX || !reader.Skip(value * 8)) {
+      return false;
+    }
+  }
+  if (type & PERF_SAMPLE_RAW) {
+    // The u32 size and the data together keep the record 8 byte aligned.
+    uint32_t raw_size;
+    const uint8_t* data = reader.Take(sizeof(raw_size));
+    if (data == nullptr) {
+      return false;
+    }
+    memcpy(&raw_size, data, sizeof(raw_size));
+    if (!reader.Skip(raw_size)) {
+      return false;
+    }
+  }
+  if (type & PERF_SAMPLE_BRANCH_STACK) {
+    if (!reader.Get(&value) || value > UINT32_MAX) {
+      return false;
+    }
+    if ((format.branch_sample_type & kPerfSampleBranchHwIndex) && !reader.Skip(8)) {
+      return false;
+    }
+    if (!reader.Skip(value * sizeof(perf_branch_entry))) {
+      return false;
+    }
+  }
+  if (type & PERF_SAMPLE_REGS_USER) {
+    uint64_t abi;
+    if (!reader.Get(&abi)) {
+      return false;
+    }
+    if (abi != PERF_SAMPLE_REGS_ABI_NONE) {
+      size_t count = __builtin_popcountll(format.sample_regs_user);
+      const uint8_t* data = reader.Take(count * sizeof(uint64_t));
+      if (data == nullptr) {
+        return false;
+      }
+      sample->arch = abi == PERF_SAMPLE_REGS_ABI_32 ? Arch32(format.arch) : format.arch;
+      sample->regs_mask = format.sample_regs_user;
+      sample->regs = reinterpret_cast<const uint64_t*>(data);
+    }
+  }
+  if (type & PERF_SAMPLE_STACK_USER) {
+    uint64_t size;
+    if (!reader.Get(&size)) {
+      return false;
+    }
+    if (size != 0) {
+      const uint8_t* data = reader.Take(size);
+      uint64_t dyn_size;
+      if (data == nullptr || !reader.Get(&dyn_size)) {
+        return false;
+      }
+      sample->stack = data;
+      sample->stack_size = std::min(size, dyn_size);
+    }
+  }
+  return true;
+}
+
+PerfRingBuffer::PerfRingBuffer(void* base, size_t size) {
+  page_ = reinterpret_cast<perf_event_mmap_page*>(base);
+  uint64_t data_offset = page_->data_offset;
+  data_size_ = page_->data_size;
+  if (data_size_ == 0) {
+    // Kernels before 4.1 always put the data after the first page.
+    data_offset = getpagesize();
+    data_size_ = size - data_offset;
+  }
+  data_ = reinterpret_cast<uint8_t*>(base) + data_offset;
+  pos_ = head_ = page_->data_tail;
+}
+
+PerfRingBuffer::~PerfRingBuffer() = default;
+
+const perf_event_header* PerfRingBuffer::Next() {
+  if (pos_ == head_) {
+    // Pairs with the barrier of the kernel after it writes the records.
+    head_ = __atomic_load_n(&page_->data_head, __ATOMIC_ACQUIRE);
+    if (pos_ == head_) {
+      return nullptr;
+    }
+  }
+
+  // The records are 8 byte aligned, so a header never wraps.
+  uint64_t offset = pos_ & (data_size_ - 1);
+  const perf_event_header* header = reinterpret_cast<const perf_event_header*>(&data_[offset]);
+  uint64_t size = header->size;
+  if (size < sizeof(*header) || size > head_ - pos_) {
+    // The buffer is corrupt, drop everything written so far.
+    pos_ = head_;
+    return nullptr;
+  }
+  pos_ += size;
+  if (offset + size <= data_size_) {
+    return header;
+  }
+
+  if (num_copies_ == copies_.size()) {
+    copies_.emplace_back();
+  }
+  std::vector<uint8_t>& copy = copies_[num_copies_++];
+  copy.resize(size);
+  size_t first = data_size_ - offset;
+  memcpy(copy.data(), &data_[offset], first);
+  memcpy(&copy[first], data_, size - first);
+  return reinterpret_cast<const perf_event_header*>(copy.data());
+}
+
+void PerfRingBuffer::Release() {
+  // Makes sure the records are read before the kernel can overwrite them.
+  __atomic_store_n(&page_->data_tail, pos_, __ATOMIC_RELEASE);
+  num_copies_ = 0;
+}
+
+struct PerfSampleUnwinder::Entry {
+  Unwinder* unwinder = nullptr;
+  PerfSample sample;
+  std::unique_ptr<Regs> regs;
+  std::shared_ptr<MemoryStackOverlay> stack;
+};
+
+PerfSampleUnwinder::PerfSampleUnwinder(const PerfEventFormat& format, size_t max_batch)
+    : format_(format), max_batch_(std::max<size_t>(max_batch, 1)) {}
+
+PerfSampleUnwinder::~PerfSampleUnwinder() = default;
+
+size_t PerfSampleUnwinder::Unwind(PerfRingBuffer* buffer, const GetUnwinderCallback& get_unwinder,
+                                  const SampleCallback& callback,
+                                  const RecordCallback& record_callback) {
+  size_t num_unwound = 0;
+  const perf_event_header* record;
+  while ((record = buffer->Next()) != nullptr) {
+    if (record->type != PERF_RECORD_SAMPLE) {
+      if (record_callback != nullptr) {
+        num_unwound += num_entries_;
+        UnwindEntries(callback);
+        record_callback(record);
+      }
+      continue;
+    }
+
+    if (num_entries_ == entries_.size()) {
+      entries_.emplace_back();
+    }
+    Entry* entry = &entries_[num_entries_];
+    if (!PerfSample::Parse(format_, record, &entry->sample) || entry->sample.regs == nullptr) {
+      continue;
+    }
+    entry->unwinder = get_unwinder(entry->sample);
+    if (entry->unwinder == nullptr) {
+      continue;
+    }
+    const PerfSample& sample = entry->sample;
+    if (entry->regs != nullptr && entry->regs->Arch() == sample.arch) {
+      if (!Regs::SetFromPerfRegs(entry->regs.get(), sample.regs_mask, sample.regs)) {
+        continue;
+      }
+    } else {
+      entry->regs.reset(Regs::CreateFromPerfRegs(sample.arch, sample.regs_mask, sample.regs));
+      if (entry->regs == nullptr) {
+        continue;
+      }
+    }
+    if (entry->stack == nullptr) {
+      entry->stack = std::make_shared<MemoryStackOverlay>();
+    }
+    entry->stack->Set(sample.stack, entry->regs->sp(), sample.stack_size,
+                      entry->unwinder->GetProcessMemory());
+
+    if (++num_entries_ == max_batch_) {
+      num_unwound += num_entries_;
+      UnwindEntries(callback);
+      buffer->Release();
+    }
+  }
+  num_unwound += num_entries_;
+  UnwindEntries(callback);
+  buffer->Release();
+  return num_unwound;
+}
+
+void PerfSampleUnwinder::UnwindEntries(const SampleCallback& callback) {
+  // The samples of each unwinder are unwound together, in the order they
+  // were recorded.
+  std::vector<UnwindSample> samples;
+  for (size_t i = 0; i < num_entries_; i++) {
+    Unwinder* unwinder = entries_[i].unwinder;
+    if (unwinder == nullptr) {
+      continue;
+    }
+    samples.clear();
+    for (size_t j = i; j < num_entries_; j++) {
+      if (entries_[j].unwinder == unwinder) {
+        samples.push_back(UnwindSample{entries_[j].regs.get(), entries_[j].stack});
+      }
+    }
+    std::vector<UnwindBatchResult> results = unwinder->UnwindBatch(samples);
+    size_t result = 0;
+    for (size_t j = i; j < num_entries_; j++) {
+      Entry* entry = &entries_[j];
+      if (entry->unwinder == unwinder) {
+        callback(entry->sample, &results[result++]);
+        entry->unwinder = nullptr;
+        entry->stack->Reset();
+      }
+    }
+  }
+  num_entries_ = 0;
+}
+
+}  // namespace unwindstack
@@ -15,12 +15,18 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/ptrace.h>
 #include <sys/uio.h>
 
 #include <vector>
 
 #include <unwindstack/Elf.h>
+#include <unwindstack/MachineArm.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineMips.h>
+#include <unwindstack/MachineX86.h>
+#include <unwindstack/MachineX86_64.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Regs.h>
 #include <unwindstack/RegsArm.h>
@@ -29,6 +35,10 @@
 #include <unwindstack/RegsMips64.h>
 #include <unwindstack/RegsX86.h>
 #include <unwindstack/RegsX86_64.h>
+#include <unwindstack/UcontextArm.h>
+#include <unwindstack/UcontextArm64.h>
+#include <unwindstack/UcontextX86.h>
+#include <unwindstack/UcontextX86_64.h>
 #include <unwindstack/UserArm.h>
 #include <unwindstack/UserArm64.h>
 #include <unwindstack/UserMips.h>
@@ -56,23 +66,23 @@ Regs* Regs::RemoteGet(pid_t pid) {
 
   switch (io.iov_len) {
   case sizeof(x86_user_regs):
-    return RegsX86::Read(buffer.data());
+    return ArchSupported(ARCH_X86) ? RegsX86::Read(buffer.data()) : nullptr;
   case sizeof(x86_64_user_regs):
-    return RegsX86_64::Read(buffer.data());
+    return ArchSupported(ARCH_X86_64) ? RegsX86_64::Read(buffer.data()) : nullptr;
   case sizeof(arm_user_regs):
-    return RegsArm::Read(buffer.data());
+    return ArchSupported(ARCH_ARM) ? RegsArm::Read(buffer.data()) : nullptr;
   case sizeof(arm64_user_regs):
-    return RegsArm64::Read(buffer.data());
+    return ArchSupported(ARCH_ARM64) ? RegsArm64::Read(buffer.data()) : nullptr;
   case sizeof(mips_user_regs):
-    return RegsMips::Read(buffer.data());
+    return ArchSupported(ARCH_MIPS) ? RegsMips::Read(buffer.data()) : nullptr;
   case sizeof(mips64_user_regs):
-    return RegsMips64::Read(buffer.data());
+    return ArchSupported(ARCH_MIPS64) ? RegsMips64::Read(buffer.data()) : nullptr;
   }
   return nullptr;
 }
 
 Regs* Regs::CreateFromUcontext(ArchEnum arch, void* ucontext) {
-  switch (arch) {
+  switch (ArchDispatch(arch)) {
     case ARCH_X86:
       return RegsX86::CreateFromUcontext(ucontext);
     case ARCH_X86_64:
@@ -121,8 +131,156 @@ Regs* Regs::CreateFromLocal() {
   return regs;
 }
 
+void Regs::SetFromLocalUcontext(Regs* regs, void* ucontext) {
+#if defined(__arm__)
+  arm_ucontext_t* arm_ucontext = reinterpret_cast<arm_ucontext_t*>(ucontext);
+  memcpy(regs->RawData(), &arm_ucontext->uc_mcontext.regs[0], ARM_REG_LAST * sizeof(uint32_t));
+#elif defined(__aarch64__)
+  arm64_ucontext_t* arm64_ucontext = reinterpret_cast<arm64_ucontext_t*>(ucontext);
+  memcpy(regs->RawData(), &arm64_ucontext->uc_mcontext.regs[0], ARM64_REG_LAST * sizeof(uint64_t));
+#elif defined(__i386__)
+  static_cast<RegsX86*>(regs)->SetFromUcontext(reinterpret_cast<x86_ucontext_t*>(ucontext));
+#elif defined(__x86_64__)
+  static_cast<RegsX86_64*>(regs)->SetFromUcontext(reinterpret_cast<x86_64_ucontext_t*>(ucontext));
+#else
+  abort();
+#endif
+}
+
+// Maps the perf_regs indices of the kernel to the registers of an arch.
+struct PerfRegsMap {
+  const int8_t* regs;
+  size_t count;
+  size_t pc;
+  size_t sp;
+};
+
+static constexpr int8_t kPerfRegsArm[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+static constexpr int8_t kPerfRegsArm64[] = {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10,
+                                            11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21,
+                                            22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32};
+
+// The kernel has no perf register for r0, which is always zero.
+static constexpr int8_t kPerfRegsMips[] = {MIPS_REG_PC, 1,  2,  3,  4,  5,  6,  7,
+                                           8,           9,  10, 11, 12, 13, 14, 15,
+                                           16,          17, 18, 19, 20, 21, 22, 23,
+                                           24,          25, 26, 27, 28, 29, 30, 31};
+
+static constexpr int8_t kPerfRegsX86[] = {
+    X86_REG_EAX, X86_REG_EBX, X86_REG_ECX, X86_REG_EDX, X86_REG_ESI,
+    X86_REG_EDI, X86_REG_EBP, X86_REG_ESP, X86_REG_EIP,
+};
+
+// The flags and segment registers are not used to unwind.
+static constexpr int8_t kPerfRegsX86_64[] = {
+    X86_64_REG_RAX, X86_64_REG_RBX, X86_64_REG_RCX, X86_64_REG_RDX, X86_64_REG_RSI,
+    X86_64_REG_RDI, X86_64_REG_RBP, X86_64_REG_RSP, X86_64_REG_RIP, -1,
+    -1,             -1,             -1,             -1,             -1,
+    -1,             X86_64_REG_R8,  X86_64_REG_R9,  X86_64_REG_R10, X86_64_REG_R11,
+    X86_64_REG_R12, X86_64_REG_R13, X86_64_REG_R14, X86_64_REG_R15,
+};
+
+static const PerfRegsMap* GetPerfRegsMap(ArchEnum arch) {
+  static constexpr PerfRegsMap kArm{kPerfRegsArm, sizeof(kPerfRegsArm), 15, 13};
+  static constexpr PerfRegsMap kArm64{kPerfRegsArm64, sizeof(kPerfRegsArm64), 32, 31};
+  static constexpr PerfRegsMap kMips{kPerfRegsMips, sizeof(kPerfRegsMips), 0, 29};
+  static constexpr PerfRegsMap kX86{kPerfRegsX86, sizeof(kPerfRegsX86), 8, 7};
+  static constexpr PerfRegsMap kX86_64{kPerfRegsX86_64, sizeof(kPerfRegsX86_64), 8, 7};
+  switch (ArchDispatch(arch)) {
+    case ARCH_ARM:
+      return &kArm;
+    case ARCH_ARM64:
+      return &kArm64;
+    case ARCH_MIPS:
+    case ARCH_MIPS64:
+      return &kMips;
+    case ARCH_X86:
+      return &kX86;
+    case ARCH_X86_64:
+      return &kX86_64;
+    case ARCH_UNKNOWN:
+    default:
+      return nullptr;
+  }
+}
+
+bool Regs::SetFromPerfRegs(Regs* regs, uint64_t mask, const uint64_t* values) {
+  const PerfRegsMap* map = GetPerfRegsMap(regs->Arch());
+  if (map == nullptr || (mask & (1ULL << map->pc)) == 0 || (mask & (1ULL << map->sp)) == 0) {
+    return false;
+  }
+
+  bool is_32bit = regs->Is32Bit();
+  void* data = regs->RawData();
+  memset(data, 0, regs->total_regs() * (is_32bit ? sizeof(uint32_t) : sizeof(uint64_t)));
+  for (size_t perf_reg = 0; mask != 0; perf_reg++, mask >>= 1) {
+    if ((mask & 1) == 0) {
+      continue;
+    }
+    uint64_t value = *values++;
+    if (perf_reg >= map->count || map->regs[perf_reg] < 0) {
+      continue;
+    }
+    if (is_32bit) {
+      reinterpret_cast<uint32_t*>(data)[map->regs[perf_reg]] = static_cast<uint32_t>(value);
+    } else {
+      reinterpret_cast<uint64_t*>(data)[map->regs[perf_reg]] = value;
+    }
+  }
+  regs->ResetPseudoRegisters();
+  regs->set_dex_pc(0);
+  return true;
+}
+
+Regs* Regs::CreateFromPerfRegs(ArchEnum arch, uint64_t mask, const uint64_t* values) {
+  Regs* regs;
+  switch (ArchDispatch(arch)) {
+    case ARCH_X86:
+      regs = new RegsX86();
+      break;
+    case ARCH_X86_64:
+      regs = new RegsX86_64();
+      break;
+    case ARCH_ARM:
+      regs = new RegsArm();
+      break;
+    case ARCH_ARM64:
+      regs = new RegsArm64();
+      break;
+    case ARCH_MIPS:
+      regs = new RegsMips();
+      break;
+    case ARCH_MIPS64:
+      regs = new RegsMips64();
+      break;
+    case ARCH_UNKNOWN:
+    default:
+      return nullptr;
+  }
+  if (!SetFromPerfRegs(regs, mask, values)) {
+    delete regs;
+    return nullptr;
+  }
+  return regs;
+}
+
+uint64_t Regs::PerfRegsMask(ArchEnum arch) {
+  const PerfRegsMap* map = GetPerfRegsMap(arch);
+  if (map == nullptr) {
+    return 0;
+  }
+  uint64_t mask = 0;
+  for (size_t perf_reg = 0; perf_reg < map->count; perf_reg++) {
+    if (map->regs[perf_reg] >= 0) {
+      mask |= 1ULL << perf_reg;
+    }
+  }
+  return mask;
+}
+
 uint64_t GetPcAdjustment(uint64_t rel_pc, Elf* elf, ArchEnum arch) {
-  switch (arch) {
+  switch (ArchDispatch(arch)) {
     case ARCH_ARM: {
       if (!elf->valid()) {
         return 2;
@@ -145,11 +303,7 @@ uint64_t GetPcAdjustment(uint64_t rel_pc, Elf* elf, ArchEnum arch) {
 
       if (adjusted_rel_pc & 1) {
         // This is a thumb instruction, it could be 2 or 4 bytes.
-        uint32_t value;
-        if (!elf->memory()->ReadFully(adjusted_rel_pc - 5, &value, sizeof(value)) ||
-            (value & 0xe000f000) != 0xe000f000) {
-          return 2;
-        }
+        return elf->GetThumbInstructionSize(adjusted_rel_pc);
       }
       return 4;
     }
@@ -29,12 +29,22 @@
 
 namespace unwindstack {
 
+static_assert(ARM_REG_LAST <= RegsImpl<uint32_t>::MAX_REGISTERS);
+
 RegsArm::RegsArm() : RegsImpl<uint32_t>(ARM_REG_LAST, Location(LOCATION_REGISTER, ARM_REG_LR)) {}
 
 ArchEnum RegsArm::Arch() {
   return ARCH_ARM;
 }
 
+bool RegsArm::IsCurrentArchRegs() {
+#if defined(__arm__)
+  return true;
+#else
+  return false;
+#endif
+}
+
 uint64_t RegsArm::pc() {
   return regs_[ARM_REG_PC];
 }
@@ -96,6 +106,25 @@ Regs* RegsArm::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
+bool RegsArm::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
+  uint32_t data;
+  if (!elf->memory()->ReadFully(elf_offset, &data, sizeof(data))) {
+    return false;
+  }
+  // The non-RT and RT sigreturn calls described in StepIfSignalHandler.
+  switch (data) {
+    case 0xe3a07077:
+    case 0xef900077:
+    case 0xdf002777:
+    case 0xe3a070ad:
+    case 0xef9000ad:
+    case 0xdf0027ad:
+      return true;
+    default:
+      return false;
+  }
+}
+
 bool RegsArm::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
   uint32_t data;
   Memory* elf_memory = elf->memory();
@@ -161,7 +190,7 @@ bool RegsArm::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process
     return false;
   }
 
-  if (!process_memory->ReadFully(offset, regs_.data(), sizeof(uint32_t) * ARM_REG_LAST)) {
+  if (!process_memory->ReadFully(offset, regs_, sizeof(uint32_t) * ARM_REG_LAST)) {
     return false;
   }
   return true;
@@ -16,7 +16,11 @@
 
 #include <stdint.h>
 #include <string.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
 
+#include <atomic>
 #include <functional>
 
 #include <unwindstack/Elf.h>
@@ -29,16 +33,27 @@
 
 namespace unwindstack {
 
+static_assert(ARM64_REG_LAST <= RegsImpl<uint64_t>::MAX_REGISTERS);
+static_assert(ARM64_PREG_LAST - ARM64_PREG_FIRST <= Regs::MAX_PSEUDO_REGISTERS);
+
 RegsArm64::RegsArm64()
     : RegsImpl<uint64_t>(ARM64_REG_LAST, Location(LOCATION_REGISTER, ARM64_REG_LR)) {
   ResetPseudoRegisters();
-  pac_mask_ = 0;
+  pac_mask_ = GetLocalPACMask();
 }
 
 ArchEnum RegsArm64::Arch() {
   return ARCH_ARM64;
 }
 
+bool RegsArm64::IsCurrentArchRegs() {
+#if defined(__aarch64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
 uint64_t RegsArm64::pc() {
   return regs_[ARM64_REG_PC];
 }
@@ -52,11 +67,10 @@ void RegsArm64::set_pc(uint64_t pc) {
   // signed using the Armv8.3-A Pointer Authentication extension. The
   // original return address can be restored by stripping out the
   // authentication code using a mask or xpaclri. xpaclri is a NOP on
-  // pre-Armv8.3-A architectures.
-  if ((0 != pc) && IsRASigned()) {
-    if (pac_mask_) {
-      pc &= ~pac_mask_;
-    }
+  // pre-Armv8.3-A architectures. The mask is known once per process, so
+  // this is a single check of the sign state.
+  if (pseudo_regs_[ARM64_PREG_RA_SIGN_STATE - ARM64_PREG_FIRST] != 0) {
+    pc = StripPAC(pc);
   }
   regs_[ARM64_REG_PC] = pc;
 }
@@ -66,7 +80,8 @@ void RegsArm64::set_sp(uint64_t sp) {
 }
 
 bool RegsArm64::SetPcFromReturnAddress(Memory*) {
-  uint64_t lr = regs_[ARM64_REG_LR];
+  // The lr of a function that signs it is signed for most of its body.
+  uint64_t lr = StripPAC(regs_[ARM64_REG_LR]);
   if (regs_[ARM64_REG_PC] == lr) {
     return false;
   }
@@ -132,12 +147,11 @@ Regs* RegsArm64::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
-bool RegsArm64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+bool RegsArm64::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
   uint64_t data;
-  Memory* elf_memory = elf->memory();
   // Read from elf memory since it is usually more expensive to read from
   // process memory.
-  if (!elf_memory->ReadFully(elf_offset, &data, sizeof(data))) {
+  if (!elf->memory()->ReadFully(elf_offset, &data, sizeof(data))) {
     return false;
   }
 
@@ -145,12 +159,16 @@ bool RegsArm64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* proce
   // __kernel_rt_sigreturn:
   // 0xd2801168     mov x8, #0x8b
   // 0xd4000001     svc #0x0
-  if (data != 0xd4000001d2801168ULL) {
+  return data == 0xd4000001d2801168ULL;
+}
+
+bool RegsArm64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+  if (!IsSignalHandler(elf_offset, elf)) {
     return false;
   }
 
   // SP + sizeof(siginfo_t) + uc_mcontext offset + X0 offset.
-  if (!process_memory->ReadFully(regs_[ARM64_REG_SP] + 0x80 + 0xb0 + 0x08, regs_.data(),
+  if (!process_memory->ReadFully(regs_[ARM64_REG_SP] + 0x80 + 0xb0 + 0x08, regs_,
                                  sizeof(uint64_t) * ARM64_REG_LAST)) {
     return false;
   }
@@ -178,6 +196,16 @@ bool RegsArm64::GetPseudoRegister(uint16_t id, uint64_t* value) {
   return false;
 }
 
+void RegsArm64::SaveSnapshot(Snapshot* snapshot) {
+  RegsImpl<uint64_t>::SaveSnapshot(snapshot);
+  memcpy(snapshot->pseudo_regs, pseudo_regs_, sizeof(pseudo_regs_));
+}
+
+void RegsArm64::RestoreSnapshot(const Snapshot& snapshot) {
+  RegsImpl<uint64_t>::RestoreSnapshot(snapshot);
+  memcpy(pseudo_regs_, snapshot.pseudo_regs, sizeof(pseudo_regs_));
+}
+
 bool RegsArm64::IsRASigned() {
   uint64_t value;
   auto result = this->GetPseudoRegister(Arm64Reg::ARM64_PREG_RA_SIGN_STATE, &value);
@@ -188,6 +216,39 @@ void RegsArm64::SetPACMask(uint64_t mask) {
   pac_mask_ = mask;
 }
 
+#if defined(__aarch64__)
+#if !defined(HWCAP_PACA)
+#define HWCAP_PACA (1 << 30)
+#endif
+
+// An address with bit 55 clear, so the code of it is cleared to zeros.
+static constexpr uint64_t kPACProbe = ~(1ULL << 55);
+// Never a mask, since the mask does not cover the address bits.
+static constexpr uint64_t kPACMaskUnknown = ~0ULL;
+#endif
+
+uint64_t RegsArm64::GetLocalPACMask() {
+#if defined(__aarch64__)
+  // Set without a lock, so that regs can be created in a signal handler.
+  static std::atomic<uint64_t> local_mask(kPACMaskUnknown);
+  uint64_t mask = local_mask.load(std::memory_order_relaxed);
+  if (mask == kPACMaskUnknown) {
+    mask = 0;
+    if (getauxval(AT_HWCAP) & HWCAP_PACA) {
+      // xpaclri strips the code of the address in lr, the bits it clears
+      // are the code. The same for every process on the device.
+      register uint64_t x30 __asm__("x30") = kPACProbe;
+      __asm__ volatile("hint 0x7" : "+r"(x30));
+      mask = kPACProbe ^ x30;
+    }
+    local_mask.store(mask, std::memory_order_relaxed);
+  }
+  return mask;
+#else
+  return 0;
+#endif
+}
+
 Regs* RegsArm64::Clone() {
   return new RegsArm64(*this);
 }
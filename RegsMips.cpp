@@ -29,6 +29,8 @@
 
 namespace unwindstack {
 
+static_assert(MIPS_REG_LAST <= RegsImpl<uint32_t>::MAX_REGISTERS);
+
 RegsMips::RegsMips()
     : RegsImpl<uint32_t>(MIPS_REG_LAST, Location(LOCATION_REGISTER, MIPS_REG_RA)) {}
 
@@ -121,6 +123,16 @@ Regs* RegsMips::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
+bool RegsMips::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
+  uint64_t data;
+  if (!elf->memory()->ReadFully(elf_offset, &data, sizeof(data))) {
+    return false;
+  }
+  // The __vdso_rt_sigreturn and __vdso_sigreturn sequences described in
+  // StepIfSignalHandler.
+  return data == 0x0000000c24021061ULL || data == 0x0000000c24021017ULL;
+}
+
 bool RegsMips::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
   uint64_t data;
   uint64_t offset = 0;
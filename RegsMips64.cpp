@@ -29,6 +29,8 @@
 
 namespace unwindstack {
 
+static_assert(MIPS64_REG_LAST <= RegsImpl<uint64_t>::MAX_REGISTERS);
+
 RegsMips64::RegsMips64()
     : RegsImpl<uint64_t>(MIPS64_REG_LAST, Location(LOCATION_REGISTER, MIPS64_REG_RA)) {}
 
@@ -119,12 +121,11 @@ Regs* RegsMips64::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
-bool RegsMips64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+bool RegsMips64::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
   uint64_t data;
-  Memory* elf_memory = elf->memory();
   // Read from elf memory since it is usually more expensive to read from
   // process memory.
-  if (!elf_memory->Read(elf_offset, &data, sizeof(data))) {
+  if (!elf->memory()->Read(elf_offset, &data, sizeof(data))) {
     return false;
   }
 
@@ -132,7 +133,11 @@ bool RegsMips64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* proc
   // __vdso_rt_sigreturn:
   // 0x2402145b     li  v0, 0x145b
   // 0x0000000c     syscall
-  if (data != 0x0000000c2402145bULL) {
+  return data == 0x0000000c2402145bULL;
+}
+
+bool RegsMips64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+  if (!IsSignalHandler(elf_offset, elf)) {
     return false;
   }
 
@@ -140,7 +145,7 @@ bool RegsMips64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* proc
   // offset = siginfo offset + sizeof(siginfo) + uc_mcontext offset
   // read 64 bit sc_regs[32] from stack into 64 bit regs_
   uint64_t sp = regs_[MIPS64_REG_SP];
-  if (!process_memory->Read(sp + 24 + 128 + 40, regs_.data(),
+  if (!process_memory->Read(sp + 24 + 128 + 40, regs_,
                             sizeof(uint64_t) * (MIPS64_REG_LAST - 1))) {
     return false;
   }
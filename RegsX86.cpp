@@ -28,12 +28,22 @@
 
 namespace unwindstack {
 
+static_assert(X86_REG_LAST <= RegsImpl<uint32_t>::MAX_REGISTERS);
+
 RegsX86::RegsX86() : RegsImpl<uint32_t>(X86_REG_LAST, Location(LOCATION_SP_OFFSET, -4)) {}
 
 ArchEnum RegsX86::Arch() {
   return ARCH_X86;
 }
 
+bool RegsX86::IsCurrentArchRegs() {
+#if defined(__i386__)
+  return true;
+#else
+  return false;
+#endif
+}
+
 uint64_t RegsX86::pc() {
   return regs_[X86_REG_PC];
 }
@@ -112,6 +122,16 @@ Regs* RegsX86::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
+bool RegsX86::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
+  uint64_t data;
+  if (!elf->memory()->ReadFully(elf_offset, &data, sizeof(data))) {
+    return false;
+  }
+  // The __restore and __restore_rt sequences described in
+  // StepIfSignalHandler.
+  return data == 0x80cd00000077b858ULL || (data & 0x00ffffffffffffffULL) == 0x0080cd000000adb8ULL;
+}
+
 bool RegsX86::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
   uint64_t data;
   Memory* elf_memory = elf->memory();
@@ -29,12 +29,22 @@
 
 namespace unwindstack {
 
+static_assert(X86_64_REG_LAST <= RegsImpl<uint64_t>::MAX_REGISTERS);
+
 RegsX86_64::RegsX86_64() : RegsImpl<uint64_t>(X86_64_REG_LAST, Location(LOCATION_SP_OFFSET, -8)) {}
 
 ArchEnum RegsX86_64::Arch() {
   return ARCH_X86_64;
 }
 
+bool RegsX86_64::IsCurrentArchRegs() {
+#if defined(__x86_64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
 uint64_t RegsX86_64::pc() {
   return regs_[X86_64_REG_PC];
 }
@@ -132,7 +142,7 @@ Regs* RegsX86_64::CreateFromUcontext(void* ucontext) {
   return regs;
 }
 
-bool RegsX86_64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+bool RegsX86_64::IsSignalHandler(uint64_t elf_offset, Elf* elf) {
   uint64_t data;
   Memory* elf_memory = elf->memory();
   // Read from elf memory since it is usually more expensive to read from
@@ -141,14 +151,17 @@ bool RegsX86_64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* proc
     return false;
   }
 
-  uint8_t data2;
-  if (!elf_memory->ReadFully(elf_offset + 8, &data2, sizeof(data2)) || data2 != 0x05) {
-    return false;
-  }
-
   // __restore_rt:
   // 0x48 0xc7 0xc0 0x0f 0x00 0x00 0x00   mov $0xf,%rax
   // 0x0f 0x05                            syscall
+  uint8_t data2;
+  return elf_memory->ReadFully(elf_offset + 8, &data2, sizeof(data2)) && data2 == 0x05;
+}
+
+bool RegsX86_64::StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) {
+  if (!IsSignalHandler(elf_offset, elf)) {
+    return false;
+  }
 
   // Read the mcontext data from the stack.
   // sp points to the ucontext data structure, read only the mcontext part.
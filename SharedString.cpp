@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <unwindstack/SharedString.h>
+
+namespace unwindstack {
+
+namespace {
+
+// The pool only holds weak references, a string is removed by the deleter
+// of its last SharedString.
+class SharedStringPool {
+ public:
+  static constexpr size_t kNumShards = 16;
+
+  struct Shard {
+    std::mutex lock;
+    // The key points into the string of the value.
+    std::unordered_map<std::string_view, std::weak_ptr<const std::string>> strings;
+  };
+
+  struct Release {
+    Shard* shard;
+
+    void operator()(const std::string* data) const {
+      {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        // The entry might already have been replaced by a new string.
+        auto entry = shard->strings.find(*data);
+        if (entry != shard->strings.end() && entry->first.data() == data->data()) {
+          shard->strings.erase(entry);
+        }
+      }
+      delete data;
+    }
+  };
+
+  std::shared_ptr<const std::string> Intern(std::string_view s) {
+    Shard& shard = shards_[std::hash<std::string_view>()(s) % kNumShards];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto entry = shard.strings.find(s);
+    if (entry != shard.strings.end()) {
+      std::shared_ptr<const std::string> data = entry->second.lock();
+      if (data != nullptr) {
+        return data;
+      }
+      // The last reference is being dropped on another thread.
+      shard.strings.erase(entry);
+    }
+    std::shared_ptr<const std::string> data(new std::string(s), Release{&shard});
+    shard.strings.emplace(*data, data);
+    return data;
+  }
+
+ private:
+  Shard shards_[kNumShards];
+};
+
+}  // namespace
+
+SharedString SharedString::Intern(std::string_view s) {
+  static SharedStringPool* pool = new SharedStringPool;
+  return SharedString(pool->Intern(s));
+}
+
+}  // namespace unwindstack
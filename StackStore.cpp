@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <unwindstack/StackStore.h>
+
+namespace unwindstack {
+
+static constexpr size_t kInitialSlots = 64;
+
+static size_t Hash(StackStore::StackId parent, uint64_t pc) {
+  uint64_t hash = (pc ^ (static_cast<uint64_t>(parent) << 32 | parent)) * 0x9e3779b97f4a7c15ULL;
+  return hash >> 32 ^ hash;
+}
+
+StackStore::StackStore() {
+  Clear();
+}
+
+void StackStore::Clear() {
+  pcs_.assign(1, 0);
+  parents_.assign(1, kEmptyStack);
+  slots_.assign(kInitialSlots, kEmptyStack);
+}
+
+StackStore::StackId StackStore::Push(StackId parent, uint64_t pc) {
+  size_t mask = slots_.size() - 1;
+  size_t index = Hash(parent, pc) & mask;
+  while (true) {
+    StackId id = slots_[index];
+    if (id == kEmptyStack) {
+      break;
+    }
+    if (pcs_[id] == pc && parents_[id] == parent) {
+      return id;
+    }
+    index = (index + 1) & mask;
+  }
+
+  StackId id = pcs_.size();
+  pcs_.push_back(pc);
+  parents_.push_back(parent);
+  slots_[index] = id;
+  // Keep the table at most half full.
+  if (pcs_.size() * 2 > slots_.size()) {
+    Grow();
+  }
+  return id;
+}
+
+void StackStore::Grow() {
+  slots_.assign(slots_.size() * 2, kEmptyStack);
+  size_t mask = slots_.size() - 1;
+  for (StackId id = 1; id < pcs_.size(); id++) {
+    size_t index = Hash(parents_[id], pcs_[id]) & mask;
+    while (slots_[index] != kEmptyStack) {
+      index = (index + 1) & mask;
+    }
+    slots_[index] = id;
+  }
+}
+
+StackStore::StackId StackStore::Intern(const uint64_t* pcs, size_t count) {
+  StackId id = kEmptyStack;
+  for (size_t i = count; i > 0; i--) {
+    id = Push(id, pcs[i - 1]);
+  }
+  return id;
+}
+
+void StackStore::GetStack(StackId id, std::vector<uint64_t>* pcs) const {
+  pcs->clear();
+  for (; id != kEmptyStack; id = parents_[id]) {
+    pcs->push_back(pcs_[id]);
+  }
+}
+
+size_t StackStore::MemoryUsage() const {
+  return pcs_.capacity() * sizeof(uint64_t) + parents_.capacity() * sizeof(StackId) +
+         slots_.capacity() * sizeof(StackId);
+}
+
+}  // namespace unwindstack
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/SymbolStore.h>
+
+#include "MemoryFileAtOffset.h"
+#include "MemoryRange.h"
+
+namespace unwindstack {
+
+// The layout of an archive, every part starts at a multiple of 8 bytes:
+//   ArchiveHeader
+//   ArchiveEntry[num_entries], sorted by build id
+//   the build ids
+//   the elf files
+static constexpr char kArchiveMagic[8] = {'U', 'N', 'W', 'S', 'Y', 'M', 'S', 0};
+
+struct ArchiveHeader {
+  char magic[8];
+  uint64_t num_entries;
+  uint64_t entries_offset;
+};
+
+struct ArchiveEntry {
+  uint64_t build_id_offset;
+  uint64_t build_id_size;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+static uint64_t AlignUp(uint64_t value) {
+  return (value + 7) & ~static_cast<uint64_t>(7);
+}
+
+static std::string PrintableBuildID(const std::string& build_id) {
+  std::string printable_build_id;
+  for (const char& c : build_id) {
+    // Use %hhx to avoid sign extension on abis that have signed chars.
+    printable_build_id += android::base::StringPrintf("%02hhx", c);
+  }
+  return printable_build_id;
+}
+
+static MemoryFileAtOffset* OpenFile(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+    return nullptr;
+  }
+  std::unique_ptr<MemoryFileAtOffset> memory(new MemoryFileAtOffset);
+  if (!memory->Init(path, 0)) {
+    return nullptr;
+  }
+  return memory.release();
+}
+
+SymbolStore::~SymbolStore() = default;
+
+void SymbolStore::ForgetMissing() {
+  // Build ids that were not found before might be in the new files.
+  for (auto it = elfs_.begin(); it != elfs_.end();) {
+    if (it->second == nullptr) {
+      it = elfs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SymbolStore::AddDirectory(const std::string& directory) {
+  std::lock_guard<std::mutex> guard(lock_);
+  directories_.push_back(directory);
+  directories_scanned_ = false;
+  ForgetMissing();
+}
+
+bool SymbolStore::AddArchive(const std::string& file) {
+  std::shared_ptr<MemoryFileAtOffset> memory(new MemoryFileAtOffset);
+  if (!memory->Init(file, 0)) {
+    return false;
+  }
+  const uint8_t* data = memory->GetPtr();
+  uint64_t size = memory->Size();
+  ArchiveHeader header;
+  if (data == nullptr || size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kArchiveMagic, sizeof(header.magic)) != 0 ||
+      header.entries_offset > size ||
+      header.num_entries > (size - header.entries_offset) / sizeof(ArchiveEntry)) {
+    return false;
+  }
+  for (uint64_t i = 0; i < header.num_entries; i++) {
+    ArchiveEntry entry;
+    memcpy(&entry, &data[header.entries_offset + i * sizeof(entry)], sizeof(entry));
+    if (entry.build_id_offset > size || entry.build_id_size > size - entry.build_id_offset ||
+        entry.data_offset > size || entry.data_size > size - entry.data_offset) {
+      return false;
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  archives_.push_back({memory, data, header.num_entries, header.entries_offset});
+  ForgetMissing();
+  return true;
+}
+
+bool SymbolStore::WriteArchive(const std::string& file, const std::vector<std::string>& elf_files) {
+  struct Input {
+    std::string build_id;
+    const std::string* path;
+    uint64_t size;
+  };
+  std::vector<Input> inputs;
+  for (const std::string& path : elf_files) {
+    std::unique_ptr<MemoryFileAtOffset> memory(OpenFile(path));
+    if (memory == nullptr) {
+      return false;
+    }
+    std::string build_id = Elf::GetBuildID(memory.get());
+    if (!build_id.empty()) {
+      inputs.push_back({std::move(build_id), &path, memory->Size()});
+    }
+  }
+  std::sort(inputs.begin(), inputs.end(),
+            [](const Input& a, const Input& b) { return a.build_id < b.build_id; });
+  inputs.erase(std::unique(inputs.begin(), inputs.end(),
+                           [](const Input& a, const Input& b) { return a.build_id == b.build_id; }),
+               inputs.end());
+
+  ArchiveHeader header = {};
+  memcpy(header.magic, kArchiveMagic, sizeof(header.magic));
+  header.num_entries = inputs.size();
+  header.entries_offset = sizeof(header);
+  std::vector<ArchiveEntry> entries;
+  std::string build_ids;
+  uint64_t offset = header.entries_offset + inputs.size() * sizeof(ArchiveEntry);
+  for (const Input& input : inputs) {
+    entries.push_back({offset + build_ids.size(), input.build_id.size(), 0, input.size});
+    build_ids += input.build_id;
+  }
+  build_ids.resize(AlignUp(build_ids.size()));
+  offset += build_ids.size();
+  for (ArchiveEntry& entry : entries) {
+    entry.data_offset = offset;
+    offset += AlignUp(entry.data_size);
+  }
+
+  std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(file.c_str(), "w"), &fclose);
+  if (fp == nullptr || fwrite(&header, sizeof(header), 1, fp.get()) != 1 ||
+      fwrite(entries.data(), sizeof(ArchiveEntry), entries.size(), fp.get()) != entries.size() ||
+      fwrite(build_ids.data(), 1, build_ids.size(), fp.get()) != build_ids.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < inputs.size(); i++) {
+    std::unique_ptr<MemoryFileAtOffset> memory(OpenFile(*inputs[i].path));
+    if (memory == nullptr || memory->Size() != inputs[i].size) {
+      return false;
+    }
+    static constexpr uint8_t kZeroes[8] = {};
+    size_t padding = AlignUp(inputs[i].size) - inputs[i].size;
+    if (fwrite(memory->GetPtr(), 1, inputs[i].size, fp.get()) != inputs[i].size ||
+        fwrite(kZeroes, 1, padding, fp.get()) != padding) {
+      return false;
+    }
+  }
+  return fclose(fp.release()) == 0;
+}
+
+Memory* SymbolStore::FindInArchives(const std::string& build_id) {
+  for (const Archive& archive : archives_) {
+    auto entry_build_id = [&archive](uint64_t index) {
+      ArchiveEntry entry;
+      memcpy(&entry, &archive.data[archive.entries_offset + index * sizeof(entry)],
+             sizeof(entry));
+      return std::string_view(reinterpret_cast<const char*>(&archive.data[entry.build_id_offset]),
+                              entry.build_id_size);
+    };
+    uint64_t first = 0;
+    uint64_t last = archive.num_entries;
+    while (first < last) {
+      uint64_t middle = first + (last - first) / 2;
+      if (entry_build_id(middle) < build_id) {
+        first = middle + 1;
+      } else {
+        last = middle;
+      }
+    }
+    if (first < archive.num_entries && entry_build_id(first) == build_id) {
+      ArchiveEntry entry;
+      memcpy(&entry, &archive.data[archive.entries_offset + first * sizeof(entry)],
+             sizeof(entry));
+      return new MemoryRange(archive.memory, entry.data_offset, entry.data_size, 0);
+    }
+  }
+  return nullptr;
+}
+
+Memory* SymbolStore::FindInDirectories(const std::string& build_id) {
+  std::string printable_build_id = PrintableBuildID(build_id);
+  for (const std::string& directory : directories_) {
+    Memory* memory = OpenFile(directory + '/' + printable_build_id);
+    if (memory != nullptr) {
+      return memory;
+    }
+  }
+
+  if (!directories_scanned_) {
+    directories_scanned_ = true;
+    scanned_.clear();
+    for (const std::string& directory : directories_) {
+      DIR* dir = opendir(directory.c_str());
+      if (dir == nullptr) {
+        continue;
+      }
+      dirent* entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        std::string path = directory + '/' + entry->d_name;
+        std::unique_ptr<Memory> memory(OpenFile(path));
+        if (memory != nullptr) {
+          std::string file_build_id = Elf::GetBuildID(memory.get());
+          if (!file_build_id.empty()) {
+            scanned_.emplace(std::move(file_build_id), std::move(path));
+          }
+        }
+      }
+      closedir(dir);
+    }
+  }
+  auto entry = scanned_.find(build_id);
+  return entry != scanned_.end() ? OpenFile(entry->second) : nullptr;
+}
+
+std::shared_ptr<Elf> SymbolStore::Find(const std::string& build_id, ArchEnum arch) {
+  if (build_id.empty()) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  auto entry = elfs_.find(build_id);
+  if (entry == elfs_.end()) {
+    entry = elfs_.emplace(build_id, nullptr).first;
+    Memory* memory = FindInArchives(build_id);
+    if (memory == nullptr) {
+      memory = FindInDirectories(build_id);
+    }
+    if (memory != nullptr) {
+      std::shared_ptr<Elf> elf(new Elf(memory));
+      elf->Init();
+      if (elf->valid() && elf->GetBuildID() == build_id) {
+        entry->second = std::move(elf);
+      }
+    }
+  }
+  if (entry->second == nullptr || entry->second->arch() != arch) {
+    return nullptr;
+  }
+  return entry->second;
+}
+
+}  // namespace unwindstack
@@ -15,16 +15,21 @@
  */
 
 #include <elf.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <algorithm>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
+#include <unwindstack/Elf.h>
 #include <unwindstack/Memory.h>
 
 #include "Check.h"
+#include "MemoryUsage.h"
 #include "Symbols.h"
 
 namespace unwindstack {
@@ -37,11 +42,35 @@ Symbols::Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t s
       str_offset_(str_offset),
       str_end_(str_offset_ + str_size) {}
 
+static SharedString NewName(std::string&& name) {
+  return Elf::InternNamesEnabled() ? SharedString::Intern(name) : SharedString(std::move(name));
+}
+
 template <typename SymType>
 static bool IsFunc(const SymType* entry) {
   return entry->st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry->st_info) == STT_FUNC;
 }
 
+template <typename SymType>
+const uint8_t* Symbols::GetSymbolTable(Memory* elf_memory) {
+  if (entry_size_ < sizeof(SymType)) {
+    return nullptr;
+  }
+  return elf_memory->GetTablePointer(offset_, count_, entry_size_);
+}
+
+template <typename SymType>
+bool Symbols::ReadSymbol(const uint8_t* table, Memory* elf_memory, uint64_t index, SymType* sym) {
+  if (table != nullptr) {
+    if (index >= count_) {
+      return false;
+    }
+    memcpy(sym, &table[index * entry_size_], sizeof(SymType));  // Copy to ensure alignment.
+    return true;
+  }
+  return elf_memory->ReadFully(offset_ + index * entry_size_, sym, sizeof(SymType));
+}
+
 // Binary search the symbol table to find function containing the given address.
 // Without remap, the symbol table is assumed to be sorted and accessed directly.
 // If the symbol table is not sorted this method might fail but should not crash.
@@ -63,11 +92,12 @@ Symbols::Info* Symbols::BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t
   uint32_t last = (it != symbols_.end()) ? it->second.index : count;
   uint32_t first = (it != symbols_.begin()) ? std::prev(it)->second.index + 1 : 0;
 
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
   while (first < last) {
     uint32_t current = first + (last - first) / 2;
     uint32_t symbol_index = RemapIndices ? remap_.value()[current] : current;
     SymType sym;
-    if (!elf_memory->ReadFully(offset_ + symbol_index * entry_size_, &sym, sizeof(sym))) {
+    if (!ReadSymbol(table, elf_memory, symbol_index, &sym)) {
       return nullptr;
     }
     Info info{.size = static_cast<uint32_t>(sym.st_size), .index = current};
@@ -84,57 +114,462 @@ Symbols::Info* Symbols::BinarySearch(uint64_t addr, Memory* elf_memory, uint64_t
   return nullptr;
 }
 
-// Create remapping table which allows us to access symbols as if they were sorted by address.
+namespace {
+
+// The address and index of a function symbol, sorted by BuildRemapTable.
+struct SymbolAddr {
+  uint64_t addr;
+  uint32_t index;
+};
+
+// Stable LSD radix sort by address, so that symbols with the same address
+// keep their index order. The digits that are the same for all addresses,
+// typically the high ones, are skipped.
+void RadixSortByAddr(std::vector<SymbolAddr>* entries) {
+  constexpr size_t kDigitBits = 11;
+  constexpr size_t kBuckets = 1 << kDigitBits;
+  constexpr size_t kDigits = (64 + kDigitBits - 1) / kDigitBits;
+  if (entries->size() < 256) {
+    std::stable_sort(entries->begin(), entries->end(),
+                     [](const SymbolAddr& a, const SymbolAddr& b) { return a.addr < b.addr; });
+    return;
+  }
+  std::vector<uint32_t> counts(kDigits * kBuckets);
+  for (const SymbolAddr& entry : *entries) {
+    for (size_t digit = 0; digit < kDigits; digit++) {
+      counts[digit * kBuckets + ((entry.addr >> (digit * kDigitBits)) & (kBuckets - 1))]++;
+    }
+  }
+  std::vector<SymbolAddr> temp(entries->size());
+  for (size_t digit = 0; digit < kDigits; digit++) {
+    uint32_t* count = &counts[digit * kBuckets];
+    uint64_t first = ((*entries)[0].addr >> (digit * kDigitBits)) & (kBuckets - 1);
+    if (count[first] == entries->size()) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (size_t bucket = 0; bucket < kBuckets; bucket++) {
+      uint32_t bucket_count = count[bucket];
+      count[bucket] = offset;
+      offset += bucket_count;
+    }
+    for (const SymbolAddr& entry : *entries) {
+      temp[count[(entry.addr >> (digit * kDigitBits)) & (kBuckets - 1)]++] = entry;
+    }
+    entries->swap(temp);
+  }
+}
+
+}  // namespace
+
+// Only st_info, st_shndx and st_value are looked at, so the scan reads three
+// fields per entry straight from the table, and keeps only the functions.
 template <typename SymType>
-void Symbols::BuildRemapTable(Memory* elf_memory) {
-  std::vector<uint64_t> addrs;  // Addresses of all symbols (addrs[i] == symbols[i].st_value).
-  addrs.reserve(count_);
-  remap_.emplace();  // Construct the optional remap table.
-  remap_->reserve(count_);
-  for (size_t symbol_idx = 0; symbol_idx < count_;) {
+std::vector<uint32_t> Symbols::SortFunctions(Memory* elf_memory) {
+  std::vector<SymbolAddr> funcs;
+  auto scan = [this, &funcs](const uint8_t* data, size_t size, uint32_t symbol_idx) {
+    for (size_t offset = 0; offset + sizeof(SymType) <= size;
+         offset += entry_size_, symbol_idx++) {
+      const uint8_t* entry = &data[offset];
+      uint8_t info = entry[offsetof(SymType, st_info)];
+      decltype(SymType::st_shndx) shndx;
+      memcpy(&shndx, &entry[offsetof(SymType, st_shndx)], sizeof(shndx));
+      if (ELF32_ST_TYPE(info) != STT_FUNC || shndx == SHN_UNDEF) {
+        continue;
+      }
+      decltype(SymType::st_value) value;
+      memcpy(&value, &entry[offsetof(SymType, st_value)], sizeof(value));  // Unaligned.
+      funcs.push_back(SymbolAddr{value, symbol_idx});
+    }
+  };
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  if (table != nullptr) {
+    scan(table, count_ * entry_size_, 0);
+  } else if (entry_size_ >= sizeof(SymType)) {
     // Read symbols from memory.  We intentionally bypass the cache to save memory.
     // Do the reads in batches so that we minimize the number of memory read calls.
-    uint8_t buffer[1024];
-    size_t read = std::min<size_t>(sizeof(buffer), (count_ - symbol_idx) * entry_size_);
-    size_t size = elf_memory->Read(offset_ + symbol_idx * entry_size_, buffer, read);
-    if (size < sizeof(SymType)) {
-      break;  // Stop processing, something looks like it is corrupted.
-    }
-    for (size_t offset = 0; offset + sizeof(SymType) <= size; offset += entry_size_, symbol_idx++) {
-      SymType sym;
-      memcpy(&sym, &buffer[offset], sizeof(SymType));  // Copy to ensure alignment.
-      addrs.push_back(sym.st_value);  // Always insert so it is indexable by symbol index.
-      if (IsFunc(&sym)) {
-        remap_->push_back(symbol_idx);  // Indices of function symbols only.
+    uint8_t buffer[4096];
+    size_t batch = std::max<size_t>(1, sizeof(buffer) / entry_size_);
+    for (size_t symbol_idx = 0; symbol_idx < count_;) {
+      size_t read = std::min<uint64_t>(batch, count_ - symbol_idx) * entry_size_;
+      if (read > sizeof(buffer)) {
+        read = sizeof(SymType);  // Entries larger than the buffer, read them one at a time.
+      }
+      size_t size = elf_memory->Read(offset_ + symbol_idx * entry_size_, buffer, read);
+      if (size < sizeof(SymType)) {
+        break;  // Stop processing, something looks like it is corrupted.
       }
+      scan(buffer, size, symbol_idx);
+      symbol_idx += (size - sizeof(SymType)) / entry_size_ + 1;
     }
   }
-  // Sort by address to make the remap list binary searchable (stable due to the a<b tie break).
-  auto comp = [&addrs](auto a, auto b) { return std::tie(addrs[a], a) < std::tie(addrs[b], b); };
-  std::sort(remap_->begin(), remap_->end(), comp);
+  // Sort by address to make the remap list binary searchable, the sort
+  // keeps the index order of symbols with the same address.
+  RadixSortByAddr(&funcs);
   // Remove duplicate entries (methods de-duplicated by the linker).
-  auto pred = [&addrs](auto a, auto b) { return addrs[a] == addrs[b]; };
-  remap_->erase(std::unique(remap_->begin(), remap_->end(), pred), remap_->end());
-  remap_->shrink_to_fit();
+  std::vector<uint32_t> remap;
+  remap.reserve(funcs.size());
+  for (size_t i = 0; i < funcs.size(); i++) {
+    if (i == 0 || funcs[i].addr != funcs[i - 1].addr) {
+      remap.push_back(funcs[i].index);
+    }
+  }
+  return remap;
 }
 
+// Create remapping table which allows us to access symbols as if they were sorted by address.
 template <typename SymType>
-bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
-                      uint64_t* func_offset) {
-  Info* info;
+void Symbols::BuildRemapTable(Memory* elf_memory) {
+  remap_.emplace(SortFunctions<SymType>(elf_memory));
+}
+
+template <typename SymType>
+void Symbols::BuildIndexInBackground(Memory* elf_memory) {
+  bool needed;
+  {
+    std::shared_lock<std::shared_mutex> guard(lock_);
+    needed = !remap_.has_value();
+  }
+  std::vector<uint32_t> remap;
+  if (needed) {
+    remap = SortFunctions<SymType>(elf_memory);
+  }
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  if (!remap_.has_value()) {
+    remap_.emplace(std::move(remap));
+    // Remove cached symbols since the access pattern will be different.
+    symbols_.clear();
+  }
+  unsorted_symbols_.clear();
+  if (flat_table_ && !flat_.has_value()) {
+    BuildFlatTable<SymType>(elf_memory);
+  }
+  remap_pending_.store(false, std::memory_order_release);
+}
+
+template <typename SymType>
+void Symbols::SaveIndex(Memory* elf_memory, ElfIndexWriter* writer, ElfIndexScope scope) {
+  std::lock_guard<std::shared_mutex> guard(lock_);
   if (!remap_.has_value()) {
-    // Assume the symbol table is sorted. If it is not, this will gracefully fail.
-    info = BinarySearch<SymType, false>(addr, elf_memory, func_offset);
-    if (info == nullptr) {
-      // Create the remapping table and retry the search.
-      BuildRemapTable<SymType>(elf_memory);
-      symbols_.clear();  // Remove cached symbols since the access pattern will be different.
-      info = BinarySearch<SymType, true>(addr, elf_memory, func_offset);
-    }
-  } else {
+    BuildRemapTable<SymType>(elf_memory);
+    symbols_.clear();  // Remove cached symbols since the access pattern will be different.
+  }
+  writer->Add(ELF_INDEX_SYMBOL_REMAP, scope, offset_, remap_->data(),
+              remap_->size() * sizeof(uint32_t));
+}
+
+template <typename SymType>
+void Symbols::BuildIndex(Memory* elf_memory) {
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  if (flat_table_) {
+    if (!flat_.has_value()) {
+      BuildFlatTable<SymType>(elf_memory);
+    }
+  } else if (!remap_.has_value()) {
+    BuildRemapTable<SymType>(elf_memory);
+    symbols_.clear();  // Remove cached symbols since the access pattern will be different.
+  }
+}
+
+void Symbols::LoadIndex(const std::shared_ptr<ElfIndexFile>& file, ElfIndexScope scope) {
+  const void* data;
+  size_t size;
+  if (!file->Find(ELF_INDEX_SYMBOL_REMAP, scope, offset_, &data, &size) ||
+      size % sizeof(uint32_t) != 0) {
+    return;
+  }
+  const uint32_t* indices = reinterpret_cast<const uint32_t*>(data);
+  size_t num_indices = size / sizeof(uint32_t);
+  for (size_t i = 0; i < num_indices; i++) {
+    if (indices[i] >= count_) {
+      return;
+    }
+  }
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  remap_.emplace(file, indices, num_indices);
+  symbols_.clear();
+}
+
+template <typename SymType>
+void Symbols::BuildFlatTable(Memory* elf_memory) {
+  if (!remap_.has_value()) {
+    BuildRemapTable<SymType>(elf_memory);
+  }
+  FlatTable& flat = flat_.emplace();
+  flat.starts.reserve(remap_->size());
+  flat.sizes.reserve(remap_->size());
+  flat.name_offsets.reserve(remap_->size());
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  for (uint32_t symbol_index : *remap_) {
+    SymType sym;
+    if (!ReadSymbol(table, elf_memory, symbol_index, &sym)) {
+      break;
+    }
+    if (sym.st_size == 0) {
+      continue;
+    }
+    flat.starts.push_back(sym.st_value);
+    flat.sizes.push_back(static_cast<uint32_t>(sym.st_size));
+    flat.name_offsets.push_back(sym.st_name);
+  }
+  flat.names.resize(flat.starts.size());
+  flat.starts.shrink_to_fit();
+  flat.sizes.shrink_to_fit();
+  flat.name_offsets.shrink_to_fit();
+}
+
+// Returns the index of the symbol containing addr, or the size of the table.
+size_t Symbols::FlatSearch(uint64_t addr) {
+  return FindFunction(flat_->starts.data(), flat_->sizes.data(), flat_->starts.size(), addr);
+}
+
+size_t Symbols::FindFunction(const uint64_t* starts, const uint32_t* sizes, size_t count,
+                             uint64_t addr) {
+  if (count == 0 || addr < starts[0]) {
+    return count;
+  }
+  // Find the last start <= addr. The loop has a fixed trip count for a
+  // given table size and the compiler turns the select into a cmov.
+  const uint64_t* base = starts;
+  size_t remaining = count;
+  while (remaining > 1) {
+    size_t half = remaining / 2;
+    base = (base[half] <= addr) ? base + half : base;
+    remaining -= half;
+  }
+  size_t index = base - starts;
+  if (addr - *base >= sizes[index]) {
+    return count;
+  }
+  return index;
+}
+
+template <typename SymType>
+bool Symbols::GetFlatName(uint64_t addr, Memory* elf_memory, SharedString* name,
+                          uint64_t* func_offset) {
+  {
+    // Fast-path: The table exists and the name for this function has been read.
+    std::shared_lock<std::shared_mutex> guard(lock_);
+    if (flat_.has_value()) {
+      size_t index = FlatSearch(addr);
+      if (index == flat_->starts.size()) {
+        return false;
+      }
+      if (!flat_->names[index].is_null()) {
+        *func_offset = addr - flat_->starts[index];
+        *name = flat_->names[index];
+        return true;
+      }
+    }
+  }
+
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  if (!flat_.has_value()) {
+    BuildFlatTable<SymType>(elf_memory);
+  }
+  size_t index = FlatSearch(addr);
+  if (index == flat_->starts.size()) {
+    return false;
+  }
+  if (!ReadFlatName(index, elf_memory)) {
+    return false;
+  }
+  *func_offset = addr - flat_->starts[index];
+  *name = flat_->names[index];
+  return true;
+}
+
+bool Symbols::ReadFlatName(size_t index, Memory* elf_memory) {
+  SharedString& cached_name = flat_->names[index];
+  if (!cached_name.is_null()) {
+    return true;
+  }
+  return ReadName(flat_->name_offsets[index], elf_memory, &cached_name);
+}
+
+bool Symbols::ReadName(uint32_t name_offset, Memory* elf_memory, SharedString* name) {
+  uint64_t str;
+  if (__builtin_add_overflow(str_offset_, name_offset, &str) || str >= str_end_) {
+    return false;
+  }
+  std::string symbol_name;
+  if (!elf_memory->ReadString(str, &symbol_name, str_end_ - str)) {
+    return false;
+  }
+  *name = NewName(std::move(symbol_name));
+  return true;
+}
+
+template <typename SymType>
+void Symbols::GetFunctions(Memory* elf_memory, uint32_t table,
+                           std::vector<FunctionSymbol>* functions) {
+  std::vector<uint32_t> remap;
+  {
+    std::shared_lock<std::shared_mutex> guard(lock_);
+    if (remap_.has_value()) {
+      remap.assign(remap_->begin(), remap_->end());
+    }
+  }
+  if (remap.empty()) {
+    remap = SortFunctions<SymType>(elf_memory);
+  }
+  const uint8_t* symbol_table = GetSymbolTable<SymType>(elf_memory);
+  for (uint32_t symbol_index : remap) {
+    SymType sym;
+    if (!ReadSymbol(symbol_table, elf_memory, symbol_index, &sym)) {
+      break;
+    }
+    if (sym.st_size != 0) {
+      functions->push_back(FunctionSymbol{sym.st_value, static_cast<uint32_t>(sym.st_size),
+                                          sym.st_name, table});
+    }
+  }
+}
+
+template <typename SymType>
+void Symbols::GetNames(const uint64_t* addrs, size_t count, Memory* elf_memory,
+                       SharedString* names, uint64_t* func_offsets, bool* found) {
+  if (!UseFlatTable()) {
+    for (size_t i = 0; i < count; i++) {
+      if (!found[i]) {
+        found[i] = GetName<SymType>(addrs[i], elf_memory, &names[i], &func_offsets[i]);
+      }
+    }
+    return;
+  }
+
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  if (!flat_.has_value()) {
+    BuildFlatTable<SymType>(elf_memory);
+  }
+  const std::vector<uint64_t>& starts = flat_->starts;
+  // Same result as FlatSearch, the last start <= addr, but since the
+  // addresses are sorted the position only ever moves forward.
+  size_t index = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (found[i]) {
+      continue;
+    }
+    uint64_t addr = addrs[i];
+    while (index + 1 < starts.size() && starts[index + 1] <= addr) {
+      index++;
+    }
+    if (starts.empty() || starts[index] > addr || addr - starts[index] >= flat_->sizes[index] ||
+        !ReadFlatName(index, elf_memory)) {
+      continue;
+    }
+    names[i] = flat_->names[index];
+    func_offsets[i] = addr - starts[index];
+    found[i] = true;
+  }
+}
+
+bool Symbols::FindCachedName(uint64_t addr, SharedString* name, uint64_t* func_offset) {
+  std::shared_lock<std::shared_mutex> guard(lock_);
+  auto it = symbols_.upper_bound(addr);
+  if (it == symbols_.end() || it->second.name.is_null()) {
+    return false;
+  }
+  uint64_t sym_value = it->first - it->second.size;  // Function address.
+  if (sym_value > addr) {
+    return false;
+  }
+  *func_offset = addr - sym_value;
+  *name = it->second.name;
+  return true;
+}
+
+size_t Symbols::MemoryUsage() {
+  std::shared_lock<std::shared_mutex> guard(lock_);
+  size_t usage = sizeof(*this) + MapMemoryUsage(symbols_) + MapMemoryUsage(unsorted_symbols_) +
+                 HashMapMemoryUsage(global_variables_);
+  for (const auto& entry : symbols_) {
+    usage += entry.second.name.size();
+  }
+  for (const auto& entry : unsorted_symbols_) {
+    usage += entry.second.name.size();
+  }
+  if (remap_.has_value()) {
+    usage += remap_->MemoryUsage();
+  }
+  if (flat_.has_value()) {
+    usage += VectorMemoryUsage(flat_->starts) + VectorMemoryUsage(flat_->sizes) +
+             VectorMemoryUsage(flat_->name_offsets) + VectorMemoryUsage(flat_->names);
+    for (const auto& name : flat_->names) {
+      usage += name.size();
+    }
+  }
+  return usage;
+}
+
+template <typename SymType>
+Symbols::Info* Symbols::ScanUnsorted(uint64_t addr, Memory* elf_memory, uint64_t* func_offset) {
+  auto it = unsorted_symbols_.upper_bound(addr);
+  if (it != unsorted_symbols_.end() && it->first - it->second.size <= addr) {
+    *func_offset = addr - (it->first - it->second.size);
+    return &it->second;
+  }
+  // Unlike the sorted table, the scan reads every symbol for every miss, but
+  // it does not allocate and costs less than sorting.
+  unsorted_scans_++;
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  for (uint32_t symbol_idx = 0; symbol_idx < count_; symbol_idx++) {
+    SymType sym;
+    if (!ReadSymbol(table, elf_memory, symbol_idx, &sym)) {
+      return nullptr;
+    }
+    if (IsFunc(&sym) && sym.st_value <= addr && addr < sym.st_value + sym.st_size) {
+      Info info{.size = static_cast<uint32_t>(sym.st_size), .index = symbol_idx, .name = {}};
+      it = unsorted_symbols_.emplace(sym.st_value + sym.st_size, info).first;
+      *func_offset = addr - sym.st_value;
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+template <typename SymType>
+Symbols::Info* Symbols::Search(uint64_t addr, Memory* elf_memory, uint64_t* func_offset) {
+  if (remap_.has_value()) {
     // Fast search using the previously created remap table.
+    return BinarySearch<SymType, true>(addr, elf_memory, func_offset);
+  }
+  // Assume the symbol table is sorted. If it is not, this will gracefully fail.
+  Info* info = BinarySearch<SymType, false>(addr, elf_memory, func_offset);
+  bool pending = remap_pending_.load(std::memory_order_relaxed);
+  if (info == nullptr && pending && unsorted_scans_ < kMaxUnsortedScans) {
+    // The remapping table is being built, do not wait for it.
+    return ScanUnsorted<SymType>(addr, elf_memory, func_offset);
+  }
+  if (info == nullptr) {
+    // Create the remapping table and retry the search. If it is still
+    // pending, the scans already read the table more often than sorting it
+    // once would, so the background build is not waited for any longer.
+    BuildRemapTable<SymType>(elf_memory);
+    symbols_.clear();  // Remove cached symbols since the access pattern will be different.
+    if (pending) {
+      unsorted_symbols_.clear();
+      remap_pending_.store(false, std::memory_order_release);
+    }
     info = BinarySearch<SymType, true>(addr, elf_memory, func_offset);
   }
+  return info;
+}
+
+template <typename SymType>
+bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
+                      uint64_t* func_offset) {
+  if (UseFlatTable()) {
+    return GetFlatName<SymType>(addr, elf_memory, name, func_offset);
+  }
+
+  // Fast-path: The name for this function has already been read.
+  if (FindCachedName(addr, name, func_offset)) {
+    return true;
+  }
+
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  Info* info = Search<SymType>(addr, elf_memory, func_offset);
   if (info == nullptr) {
     return false;
   }
@@ -153,14 +588,259 @@ bool Symbols::GetName(uint64_t addr, Memory* elf_memory, SharedString* name,
     if (!IsFunc(&sym) || !elf_memory->ReadString(str, &symbol_name, str_end_ - str)) {
       return false;
     }
-    info->name = SharedString(std::move(symbol_name));
+    info->name = NewName(std::move(symbol_name));
   }
   *name = info->name;
   return true;
 }
 
+const char* Symbols::GetStringTable(Memory* elf_memory) {
+  if (str_end_ <= str_offset_) {
+    return nullptr;
+  }
+  const uint8_t* data = elf_memory->GetPointer(str_offset_, str_end_ - str_offset_);
+  return reinterpret_cast<const char*>(data);
+}
+
+template <typename SymType>
+bool Symbols::GetNameOffset(uint64_t addr, Memory* elf_memory, uint32_t* name_offset,
+                            uint64_t* func_offset) {
+  if (UseFlatTable()) {
+    {
+      std::shared_lock<std::shared_mutex> guard(lock_);
+      if (flat_.has_value()) {
+        size_t index = FlatSearch(addr);
+        if (index == flat_->starts.size()) {
+          return false;
+        }
+        *func_offset = addr - flat_->starts[index];
+        *name_offset = flat_->name_offsets[index];
+        return true;
+      }
+    }
+    std::lock_guard<std::shared_mutex> guard(lock_);
+    if (!flat_.has_value()) {
+      BuildFlatTable<SymType>(elf_memory);
+    }
+    size_t index = FlatSearch(addr);
+    if (index == flat_->starts.size()) {
+      return false;
+    }
+    *func_offset = addr - flat_->starts[index];
+    *name_offset = flat_->name_offsets[index];
+    return true;
+  }
+
+  std::lock_guard<std::shared_mutex> guard(lock_);
+  Info* info = Search<SymType>(addr, elf_memory, func_offset);
+  if (info == nullptr) {
+    return false;
+  }
+  SymType sym;
+  uint32_t symbol_index = remap_.has_value() ? remap_.value()[info->index] : info->index;
+  if (!elf_memory->ReadFully(offset_ + symbol_index * entry_size_, &sym, sizeof(sym)) ||
+      !IsFunc(&sym)) {
+    return false;
+  }
+  *name_offset = sym.st_name;
+  return true;
+}
+
+template <typename SymType>
+bool Symbols::GetNameView(uint64_t addr, Memory* elf_memory, std::string_view* name,
+                          uint64_t* func_offset) {
+  const char* strtab = GetStringTable(elf_memory);
+  if (strtab == nullptr) {
+    SharedString shared_name;
+    if (!GetName<SymType>(addr, elf_memory, &shared_name, func_offset)) {
+      return false;
+    }
+    // The cache keeps its own reference to the string.
+    *name = static_cast<const std::string&>(shared_name);
+    return true;
+  }
+
+  uint32_t name_offset;
+  if (!GetNameOffset<SymType>(addr, elf_memory, &name_offset, func_offset)) {
+    return false;
+  }
+  uint64_t str;
+  if (__builtin_add_overflow(str_offset_, name_offset, &str) || str >= str_end_) {
+    return false;
+  }
+  const char* start = &strtab[str - str_offset_];
+  size_t max_size = str_end_ - str;
+  const void* terminator = memchr(start, '\0', max_size);
+  if (terminator == nullptr) {
+    return false;
+  }
+  *name = std::string_view(start, reinterpret_cast<const char*>(terminator) - start);
+  return true;
+}
+
+template <typename SymType>
+static bool IsGlobalObject(const SymType& sym) {
+  return sym.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(sym.st_info) == STT_OBJECT &&
+         ELF32_ST_BIND(sym.st_info) == STB_GLOBAL;
+}
+
+template <typename SymType>
+bool Symbols::IsGlobal(const SymType& sym, Memory* elf_memory, const std::string& name) {
+  uint64_t str;
+  if (!IsGlobalObject(sym) || __builtin_add_overflow(str_offset_, sym.st_name, &str) ||
+      str >= str_end_) {
+    return false;
+  }
+  std::string symbol;
+  return elf_memory->ReadString(str, &symbol, std::min<uint64_t>(str_end_ - str, name.size() + 1)) &&
+         symbol == name;
+}
+
+template <typename SymType>
+bool Symbols::GnuHashLookup(Memory* elf_memory, const std::string& name,
+                            uint64_t* memory_address) {
+  // The header is nbuckets, symoffset, bloom_size and bloom_shift, followed
+  // by the bloom filter words, the buckets and the hash chains.
+  uint32_t header[4];
+  if (hash_size_ < sizeof(header) || !elf_memory->ReadFully(hash_offset_, header, sizeof(header))) {
+    return false;
+  }
+  uint32_t nbuckets = header[0];
+  uint32_t symoffset = header[1];
+  uint32_t bloom_size = header[2];
+  uint32_t bloom_shift = header[3];
+  // The bloom filter words are the size of an address.
+  constexpr uint64_t kWordSize = sizeof(SymType) == sizeof(Elf64_Sym) ? 8 : 4;
+  constexpr uint32_t kWordBits = kWordSize * 8;
+  uint64_t buckets_offset = sizeof(header) + bloom_size * kWordSize;
+  uint64_t chains_offset = buckets_offset + nbuckets * sizeof(uint32_t);
+  if (nbuckets == 0 || bloom_size == 0 || bloom_shift >= 32 || chains_offset > hash_size_) {
+    return false;
+  }
+
+  uint32_t hash = 5381;
+  for (unsigned char c : name) {
+    hash = hash * 33 + c;
+  }
+
+  uint64_t word = 0;
+  if (!elf_memory->ReadFully(
+          hash_offset_ + sizeof(header) + ((hash / kWordBits) % bloom_size) * kWordSize, &word,
+          kWordSize)) {
+    return false;
+  }
+  uint64_t mask = (1ULL << (hash % kWordBits)) | (1ULL << ((hash >> bloom_shift) % kWordBits));
+  if ((word & mask) != mask) {
+    return false;
+  }
+
+  uint32_t index;
+  if (!elf_memory->Read32(hash_offset_ + buckets_offset + (hash % nbuckets) * sizeof(uint32_t),
+                          &index) ||
+      index < symoffset) {
+    return false;
+  }
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  for (; index < count_; index++) {
+    uint64_t chain_offset = chains_offset + (index - symoffset) * sizeof(uint32_t);
+    uint32_t chain_hash;
+    if (chain_offset >= hash_size_ ||
+        !elf_memory->Read32(hash_offset_ + chain_offset, &chain_hash)) {
+      return false;
+    }
+    if ((chain_hash | 1) == (hash | 1)) {
+      SymType sym;
+      if (!ReadSymbol(table, elf_memory, index, &sym)) {
+        return false;
+      }
+      if (IsGlobal(sym, elf_memory, name)) {
+        *memory_address = sym.st_value;
+        return true;
+      }
+    }
+    // The last entry of a chain has the low bit set.
+    if (chain_hash & 1) {
+      break;
+    }
+  }
+  return false;
+}
+
+template <typename SymType>
+bool Symbols::HashLookup(Memory* elf_memory, const std::string& name, uint64_t* memory_address) {
+  // The header is nbucket and nchain, followed by the buckets and the chains.
+  uint32_t header[2];
+  if (hash_size_ < sizeof(header) || !elf_memory->ReadFully(hash_offset_, header, sizeof(header))) {
+    return false;
+  }
+  uint32_t nbucket = header[0];
+  uint32_t nchain = header[1];
+  uint64_t chains_offset = sizeof(header) + static_cast<uint64_t>(nbucket) * sizeof(uint32_t);
+  if (nbucket == 0 || chains_offset + static_cast<uint64_t>(nchain) * sizeof(uint32_t) > hash_size_) {
+    return false;
+  }
+
+  uint32_t hash = 0;
+  for (unsigned char c : name) {
+    hash = (hash << 4) + c;
+    uint32_t high = hash & 0xf0000000;
+    hash ^= high >> 24;
+    hash &= ~high;
+  }
+
+  uint32_t index;
+  if (!elf_memory->Read32(hash_offset_ + sizeof(header) + (hash % nbucket) * sizeof(uint32_t),
+                          &index)) {
+    return false;
+  }
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  // Bound the walk in case the chains form a loop.
+  for (uint32_t steps = 0; index != STN_UNDEF && index < nchain && steps < nchain; steps++) {
+    SymType sym;
+    if (!ReadSymbol(table, elf_memory, index, &sym)) {
+      return false;
+    }
+    if (IsGlobal(sym, elf_memory, name)) {
+      *memory_address = sym.st_value;
+      return true;
+    }
+    if (!elf_memory->Read32(hash_offset_ + chains_offset + index * sizeof(uint32_t), &index)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+template <typename SymType>
+void Symbols::ScanGlobals(Memory* elf_memory) {
+  const uint8_t* table = GetSymbolTable<SymType>(elf_memory);
+  for (uint32_t i = 0; i < count_; i++) {
+    SymType entry;
+    if (!ReadSymbol(table, elf_memory, i, &entry)) {
+      break;
+    }
+    uint64_t str;
+    if (!IsGlobalObject(entry) || __builtin_add_overflow(str_offset_, entry.st_name, &str) ||
+        str >= str_end_) {
+      continue;
+    }
+    std::string symbol;
+    if (elf_memory->ReadString(str, &symbol, str_end_ - str)) {
+      // Same as the linear scan this replaces, the first symbol wins.
+      global_variables_.emplace(std::move(symbol), entry.st_value);
+    }
+  }
+}
+
 template <typename SymType>
 bool Symbols::GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* memory_address) {
+  std::lock_guard<std::shared_mutex> guard(lock_);
+
+  if (hash_size_ == 0 && !globals_scanned_) {
+    globals_scanned_ = true;
+    ScanGlobals<SymType>(elf_memory);
+  }
+
   // Lookup from cache.
   auto it = global_variables_.find(name);
   if (it != global_variables_.end()) {
@@ -171,25 +851,12 @@ bool Symbols::GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* m
     return false;
   }
 
-  // Linear scan of all symbols.
-  for (uint32_t i = 0; i < count_; i++) {
-    SymType entry;
-    if (!elf_memory->ReadFully(offset_ + i * entry_size_, &entry, sizeof(entry))) {
-      return false;
-    }
-
-    if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_OBJECT &&
-        ELF32_ST_BIND(entry.st_info) == STB_GLOBAL) {
-      uint64_t str_offset = str_offset_ + entry.st_name;
-      if (str_offset < str_end_) {
-        std::string symbol;
-        if (elf_memory->ReadString(str_offset, &symbol, str_end_ - str_offset) && symbol == name) {
-          global_variables_.emplace(name, entry.st_value);
-          *memory_address = entry.st_value;
-          return true;
-        }
-      }
-    }
+  uint64_t address;
+  if (hash_size_ != 0 && (gnu_hash_ ? GnuHashLookup<SymType>(elf_memory, name, &address)
+                                    : HashLookup<SymType>(elf_memory, name, &address))) {
+    global_variables_.emplace(name, address);
+    *memory_address = address;
+    return true;
   }
   global_variables_.emplace(name, std::optional<uint64_t>());  // Remember "not found" outcome.
   return false;
@@ -199,6 +866,26 @@ bool Symbols::GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* m
 template bool Symbols::GetName<Elf32_Sym>(uint64_t, Memory*, SharedString*, uint64_t*);
 template bool Symbols::GetName<Elf64_Sym>(uint64_t, Memory*, SharedString*, uint64_t*);
 
+template bool Symbols::GetNameView<Elf32_Sym>(uint64_t, Memory*, std::string_view*, uint64_t*);
+template bool Symbols::GetNameView<Elf64_Sym>(uint64_t, Memory*, std::string_view*, uint64_t*);
+
+template void Symbols::GetNames<Elf32_Sym>(const uint64_t*, size_t, Memory*, SharedString*,
+                                           uint64_t*, bool*);
+template void Symbols::GetNames<Elf64_Sym>(const uint64_t*, size_t, Memory*, SharedString*,
+                                           uint64_t*, bool*);
+
 template bool Symbols::GetGlobal<Elf32_Sym>(Memory*, const std::string&, uint64_t*);
 template bool Symbols::GetGlobal<Elf64_Sym>(Memory*, const std::string&, uint64_t*);
+
+template void Symbols::SaveIndex<Elf32_Sym>(Memory*, ElfIndexWriter*, ElfIndexScope);
+template void Symbols::SaveIndex<Elf64_Sym>(Memory*, ElfIndexWriter*, ElfIndexScope);
+
+template void Symbols::BuildIndex<Elf32_Sym>(Memory*);
+template void Symbols::BuildIndex<Elf64_Sym>(Memory*);
+
+template void Symbols::GetFunctions<Elf32_Sym>(Memory*, uint32_t, std::vector<FunctionSymbol>*);
+template void Symbols::GetFunctions<Elf64_Sym>(Memory*, uint32_t, std::vector<FunctionSymbol>*);
+
+template void Symbols::BuildIndexInBackground<Elf32_Sym>(Memory*);
+template void Symbols::BuildIndexInBackground<Elf64_Sym>(Memory*);
 }  // namespace unwindstack
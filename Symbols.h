@@ -19,11 +19,18 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include <unwindstack/ElfIndex.h>
+#include <unwindstack/ElfInterface.h>
 #include <unwindstack/SharedString.h>
 
 namespace unwindstack {
@@ -46,12 +53,87 @@ class Symbols {
   template <typename SymType>
   bool GetName(uint64_t addr, Memory* elf_memory, SharedString* name, uint64_t* func_offset);
 
+  // Same as GetName, but when the string table is in a contiguous buffer,
+  // such as a mapped file, the name points directly into it. Otherwise it
+  // points at the cached name. Either way it stays valid until the elf
+  // memory or the cache is cleared.
+  template <typename SymType>
+  bool GetNameView(uint64_t addr, Memory* elf_memory, std::string_view* name,
+                   uint64_t* func_offset);
+
+  // Looks up the function containing each of count addresses, which must be
+  // sorted. Addresses whose found entry is already true are skipped. In flat
+  // mode this is a single merge over the sorted table under one lock.
+  template <typename SymType>
+  void GetNames(const uint64_t* addrs, size_t count, Memory* elf_memory, SharedString* names,
+                uint64_t* func_offsets, bool* found);
+
   template <typename SymType>
   bool GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* memory_address);
 
+  // Approximate number of bytes used by the caches.
+  size_t MemoryUsage();
+
+  // In flat mode, all of the function symbols are read into sorted arrays
+  // on the first lookup instead of being cached one at a time in a map. The
+  // names are only read when a symbol is first found. Must be set before
+  // any lookups.
+  void set_flat_table(bool enable) { flat_table_ = enable; }
+  bool flat_table() { return flat_table_; }
+
+  // The .gnu.hash or .hash section of the table, used by GetGlobal to find
+  // a name without reading the other symbols. Must be set before any
+  // lookups.
+  void set_hash_table(uint64_t offset, uint64_t size, bool gnu) {
+    hash_offset_ = offset;
+    hash_size_ = size;
+    gnu_hash_ = gnu;
+  }
+
+  // Adds the sorted remap table to the index, building it if needed.
+  template <typename SymType>
+  void SaveIndex(Memory* elf_memory, ElfIndexWriter* writer, ElfIndexScope scope);
+
+  // Builds the sorted table used by the lookups, the flat table in flat
+  // mode, instead of doing it on the first lookup.
+  template <typename SymType>
+  void BuildIndex(Memory* elf_memory);
+
+  // Appends the function symbols with a size to functions, sorted by
+  // address, using the sorted table if it was built. Does not keep any of
+  // them in the caches.
+  template <typename SymType>
+  void GetFunctions(Memory* elf_memory, uint32_t table, std::vector<FunctionSymbol>* functions);
+
+  // Reads the name at name_offset in the string table.
+  bool ReadName(uint32_t name_offset, Memory* elf_memory, SharedString* name);
+
+  // Returns the index of the function containing addr given the sorted
+  // starts and the sizes of count functions, or count if there is none.
+  static size_t FindFunction(const uint64_t* starts, const uint32_t* sizes, size_t count,
+                             uint64_t addr);
+
+  // Uses the remap table from the index file instead of building it.
+  void LoadIndex(const std::shared_ptr<ElfIndexFile>& file, ElfIndexScope scope);
+
+  // Set when BuildIndexInBackground is going to be called. Until then, a
+  // lookup in a table that is not sorted scans the table for the symbol
+  // instead of building the sorted table itself, and flat mode is not used.
+  // After kMaxUnsortedScans scans, the next lookup that misses builds the
+  // sorted table and clears this. Must be set before any lookups.
+  void set_remap_pending() { remap_pending_.store(true, std::memory_order_relaxed); }
+
+  // Builds the sorted table without holding the lock, so that lookups can
+  // go on meanwhile, then the flat table in flat mode.
+  template <typename SymType>
+  void BuildIndexInBackground(Memory* elf_memory);
+
   void ClearCache() {
+    std::lock_guard<std::shared_mutex> guard(lock_);
     symbols_.clear();
+    unsorted_symbols_.clear();
     remap_.reset();
+    flat_.reset();
   }
 
  private:
@@ -61,17 +143,111 @@ class Symbols {
   template <typename SymType>
   void BuildRemapTable(Memory* elf_memory);
 
+  // Returns the indices of the function symbols sorted by address. Only
+  // reads the symbol table, so the lock does not need to be held.
+  template <typename SymType>
+  std::vector<uint32_t> SortFunctions(Memory* elf_memory);
+
+  // Finds the function containing addr with one pass over the symbol table,
+  // used while the sorted table is pending. Requires the exclusive lock.
+  template <typename SymType>
+  Info* ScanUnsorted(uint64_t addr, Memory* elf_memory, uint64_t* func_offset);
+
+  bool UseFlatTable() {
+    return flat_table_ && !remap_pending_.load(std::memory_order_acquire);
+  }
+
+  // Finds the cached info for the function containing addr, reading the
+  // symbols as needed. Requires the exclusive lock to be held.
+  template <typename SymType>
+  Info* Search(uint64_t addr, Memory* elf_memory, uint64_t* func_offset);
+
+  // Returns the offset of the name of the function containing addr in the
+  // string table.
+  template <typename SymType>
+  bool GetNameOffset(uint64_t addr, Memory* elf_memory, uint32_t* name_offset,
+                     uint64_t* func_offset);
+
+  const char* GetStringTable(Memory* elf_memory);
+
+  // Returns true if the symbol is a global variable called name.
+  template <typename SymType>
+  bool IsGlobal(const SymType& sym, Memory* elf_memory, const std::string& name);
+
+  // Look up name in the hash table, returns false if it is not found.
+  template <typename SymType>
+  bool GnuHashLookup(Memory* elf_memory, const std::string& name, uint64_t* memory_address);
+  template <typename SymType>
+  bool HashLookup(Memory* elf_memory, const std::string& name, uint64_t* memory_address);
+
+  // Adds all of the global variables to global_variables_.
+  template <typename SymType>
+  void ScanGlobals(Memory* elf_memory);
+
+  // Returns the symbol table if it is in one contiguous buffer.
+  template <typename SymType>
+  const uint8_t* GetSymbolTable(Memory* elf_memory);
+
+  // Reads from the table returned by GetSymbolTable when there is one.
+  template <typename SymType>
+  bool ReadSymbol(const uint8_t* table, Memory* elf_memory, uint64_t index, SymType* sym);
+
+  bool FindCachedName(uint64_t addr, SharedString* name, uint64_t* func_offset);
+
+  template <typename SymType>
+  void BuildFlatTable(Memory* elf_memory);
+
+  size_t FlatSearch(uint64_t addr);
+
+  template <typename SymType>
+  bool GetFlatName(uint64_t addr, Memory* elf_memory, SharedString* name, uint64_t* func_offset);
+
+  // Reads the name of the flat table entry if it was not read yet. Requires
+  // the exclusive lock to be held.
+  bool ReadFlatName(size_t index, Memory* elf_memory);
+
   const uint64_t offset_;
   const uint64_t count_;
   const uint64_t entry_size_;
   const uint64_t str_offset_;
   const uint64_t str_end_;
 
+  // Lookups of already cached names only need the shared lock. All other
+  // accesses to the caches below need the exclusive lock.
+  std::shared_mutex lock_;
   std::map<uint64_t, Info> symbols_;  // Cache of read symbols (keyed by function *end* address).
-  std::optional<std::vector<uint32_t>> remap_;  // Indices of function symbols sorted by address.
+  // Indices of function symbols sorted by address.
+  std::optional<ElfIndexArray<uint32_t>> remap_;
+  // Set while the remap table is built in the background.
+  std::atomic<bool> remap_pending_ = false;
+  // Symbols found by ScanUnsorted, keyed by function end address. The index
+  // is the index in the symbol table.
+  std::map<uint64_t, Info> unsorted_symbols_;
+  // The number of full scans done by ScanUnsorted. After kMaxUnsortedScans
+  // of them, a lookup sorts the table itself instead of waiting longer for
+  // the background build.
+  static constexpr uint32_t kMaxUnsortedScans = 8;
+  uint32_t unsorted_scans_ = 0;
+
+  // The function symbols sorted by address, used in flat mode. Symbols
+  // with a size of zero are left out. The names are only read on demand.
+  struct FlatTable {
+    std::vector<uint64_t> starts;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> name_offsets;  // Offsets into the string table.
+    std::vector<SharedString> names;
+  };
+  bool flat_table_ = false;
+  std::optional<FlatTable> flat_;
+
+  uint64_t hash_offset_ = 0;
+  uint64_t hash_size_ = 0;
+  bool gnu_hash_ = false;
 
-  // Cache of global data (non-function) symbols.
+  // Cache of global data (non-function) symbols. Without a hash table, all
+  // of them are added by the first lookup.
   std::unordered_map<std::string, std::optional<uint64_t>> global_variables_;
+  bool globals_scanned_ = false;
 };
 
 }  // namespace unwindstack
@@ -14,12 +14,17 @@
  * limitations under the License.
  */
 
+#include <limits.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <time.h>
 #include <ucontext.h>
+#include <unistd.h>
 
 #include <chrono>
 
@@ -31,15 +36,94 @@ namespace unwindstack {
 
 std::mutex ThreadEntry::entries_mutex_;
 std::map<pid_t, ThreadEntry*> ThreadEntry::entries_;
+std::atomic<pid_t> ThreadEntry::slot_tids_[kNumSlots];
+std::atomic<ThreadEntry*> ThreadEntry::slot_entries_[kNumSlots];
+std::atomic_bool ThreadEntry::slots_full_;
+std::atomic_int ThreadEntry::lockless_readers_;
+
+static size_t SlotIndex(pid_t tid, size_t probe, size_t num_slots) {
+  return (static_cast<size_t>(tid) * 0x9e3779b1 + probe) & (num_slots - 1);
+}
 
 // Assumes that ThreadEntry::entries_mutex_ has already been locked before
 // creating a ThreadEntry object.
 ThreadEntry::ThreadEntry(pid_t tid) : tid_(tid), ref_count_(1), wait_value_(0) {
   // Add ourselves to the global list.
   entries_[tid_] = this;
+  AddSlot(this);
+}
+
+void ThreadEntry::AddSlot(ThreadEntry* entry) {
+  for (size_t probe = 0; probe < kNumSlots; probe++) {
+    size_t index = SlotIndex(entry->tid_, probe, kNumSlots);
+    pid_t tid = slot_tids_[index].load(std::memory_order_relaxed);
+    if (tid == 0 || tid == kRemovedTid) {
+      // The entry has to be visible before the tid that finds it.
+      slot_entries_[index].store(entry, std::memory_order_relaxed);
+      slot_tids_[index].store(entry->tid_, std::memory_order_release);
+      return;
+    }
+  }
+  slots_full_ = true;
+}
+
+void ThreadEntry::RemoveSlot(ThreadEntry* entry) {
+  for (size_t probe = 0; probe < kNumSlots; probe++) {
+    size_t index = SlotIndex(entry->tid_, probe, kNumSlots);
+    pid_t tid = slot_tids_[index].load(std::memory_order_relaxed);
+    if (tid == 0) {
+      return;
+    }
+    if (tid == entry->tid_ && slot_entries_[index].load(std::memory_order_relaxed) == entry) {
+      slot_tids_[index].store(kRemovedTid, std::memory_order_seq_cst);
+      slot_entries_[index].store(nullptr, std::memory_order_seq_cst);
+      return;
+    }
+  }
+}
+
+bool ThreadEntry::TryAddRef() {
+  int count = ref_count_.load(std::memory_order_relaxed);
+  while (count != 0) {
+    if (ref_count_.compare_exchange_weak(count, count + 1, std::memory_order_acquire)) {
+      return true;
+    }
+  }
+  // The last reference is gone and the entry is about to be freed.
+  return false;
+}
+
+ThreadEntry* ThreadEntry::FindSlot(pid_t tid) {
+  // Remove does not free an entry while a lookup is running, since the
+  // lookup might have loaded the entry just before it was removed.
+  lockless_readers_.fetch_add(1, std::memory_order_seq_cst);
+  ThreadEntry* found = nullptr;
+  for (size_t probe = 0; probe < kNumSlots; probe++) {
+    size_t index = SlotIndex(tid, probe, kNumSlots);
+    pid_t slot_tid = slot_tids_[index].load(std::memory_order_seq_cst);
+    if (slot_tid == 0) {
+      break;
+    }
+    if (slot_tid == tid) {
+      ThreadEntry* entry = slot_entries_[index].load(std::memory_order_seq_cst);
+      if (entry != nullptr && entry->TryAddRef()) {
+        found = entry;
+        break;
+      }
+    }
+  }
+  lockless_readers_.fetch_sub(1, std::memory_order_release);
+  return found;
 }
 
 ThreadEntry* ThreadEntry::Get(pid_t tid, bool create) {
+  if (!create) {
+    ThreadEntry* entry = FindSlot(tid);
+    if (entry != nullptr || !slots_full_) {
+      return entry;
+    }
+  }
+
   ThreadEntry* entry = nullptr;
 
   std::lock_guard<std::mutex> guard(entries_mutex_);
@@ -61,6 +145,13 @@ void ThreadEntry::Remove(ThreadEntry* entry) {
 
   std::lock_guard<std::mutex> guard(entries_mutex_);
   if (--entry->ref_count_ == 0) {
+    // No new lookup can find the entry once the slot is gone, wait for the
+    // ones that might already hold it. They refuse an entry without
+    // references, and never block, so this is short.
+    RemoveSlot(entry);
+    while (lockless_readers_.load(std::memory_order_seq_cst) != 0) {
+      sched_yield();
+    }
     delete entry;
   }
 }
@@ -74,23 +165,37 @@ ThreadEntry::~ThreadEntry() {
   }
 }
 
+static long Futex(std::atomic_int* value, int op, int arg, const timespec* timeout) {
+  return syscall(SYS_futex, reinterpret_cast<int*>(value), op, arg, timeout, nullptr, 0);
+}
+
 bool ThreadEntry::Wait(WaitType type) {
   static const std::chrono::duration wait_time(std::chrono::seconds(5));
-  std::unique_lock<std::mutex> lock(wait_mutex_);
-  if (wait_cond_.wait_for(lock, wait_time, [this, type] { return wait_value_ == type; })) {
-    return true;
-  } else {
-    log_async_safe("pthread_cond_timedwait for value %d failed", type);
-    return false;
+  auto deadline = std::chrono::steady_clock::now() + wait_time;
+  while (true) {
+    int value = wait_value_.load(std::memory_order_acquire);
+    if (value == type) {
+      return true;
+    }
+    auto remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::steady_clock::duration::zero()) {
+      break;
+    }
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+    timespec timeout = {
+        .tv_sec = static_cast<time_t>(seconds.count()),
+        .tv_nsec = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds).count())};
+    // Returns right away if the value changed since it was loaded.
+    Futex(&wait_value_, FUTEX_WAIT_PRIVATE, value, &timeout);
   }
+  log_async_safe("futex wait for value %d failed", type);
+  return false;
 }
 
 void ThreadEntry::Wake() {
-  wait_mutex_.lock();
-  wait_value_++;
-  wait_mutex_.unlock();
-
-  wait_cond_.notify_one();
+  wait_value_.fetch_add(1, std::memory_order_release);
+  Futex(&wait_value_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
 }
 
 void ThreadEntry::CopyUcontextFromSigcontext(void* sigcontext) {
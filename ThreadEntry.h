@@ -21,7 +21,7 @@
 #include <sys/types.h>
 #include <ucontext.h>
 
-#include <condition_variable>
+#include <atomic>
 #include <map>
 #include <mutex>
 
@@ -35,6 +35,8 @@ enum WaitType : int {
 
 class ThreadEntry {
  public:
+  // Without create, the lookup does not take any locks so that it can be
+  // used from a signal handler.
   static ThreadEntry* Get(pid_t tid, bool create = true);
 
   static void Remove(ThreadEntry* entry);
@@ -50,7 +52,7 @@ class ThreadEntry {
 
     // Always reset the wait value since this could be the first or nth
     // time this entry is locked.
-    wait_value_ = 0;
+    wait_value_.store(0, std::memory_order_relaxed);
   }
 
   inline void Unlock() { mutex_.unlock(); }
@@ -61,16 +63,36 @@ class ThreadEntry {
   ThreadEntry(pid_t tid);
   ~ThreadEntry();
 
+  // Only modified with entries_mutex_ held.
+  static void AddSlot(ThreadEntry* entry);
+  static void RemoveSlot(ThreadEntry* entry);
+
+  // The lookup without locks.
+  static ThreadEntry* FindSlot(pid_t tid);
+
+  // Adds a reference unless the count already dropped to zero.
+  bool TryAddRef();
+
   pid_t tid_;
-  int ref_count_;
+  std::atomic_int ref_count_;
   std::mutex mutex_;
-  std::mutex wait_mutex_;
-  std::condition_variable wait_cond_;
-  int wait_value_;
+  // The handshake counter, waited on and woken with a futex.
+  std::atomic_int wait_value_;
   ucontext_t ucontext_;
 
   static std::mutex entries_mutex_;
   static std::map<pid_t, ThreadEntry*> entries_;
+
+  // An open addressed copy of entries_ for lookups without locks. A slot
+  // tid of zero ends a probe, removed entries leave kRemovedTid behind.
+  // Entries that do not fit are only in entries_.
+  static constexpr size_t kNumSlots = 1024;
+  static constexpr pid_t kRemovedTid = -1;
+  static std::atomic<pid_t> slot_tids_[kNumSlots];
+  static std::atomic<ThreadEntry*> slot_entries_[kNumSlots];
+  static std::atomic_bool slots_full_;
+  // The number of lookups without locks in progress.
+  static std::atomic_int lockless_readers_;
 };
 
 }  // namespace unwindstack
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/ThreadSampler.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+static size_t RoundUpToPowerOfTwo(size_t value) {
+  size_t power = 1;
+  while (power < value) {
+    power <<= 1;
+  }
+  return power;
+}
+
+ThreadSampler::ThreadSampler(size_t max_frames, size_t ring_size) : max_frames_(max_frames) {
+  ring_size = RoundUpToPowerOfTwo(std::max<size_t>(ring_size, 1));
+  ring_mask_ = ring_size - 1;
+  records_.reset(new Record[ring_size]);
+  pcs_.reset(new uint64_t[ring_size * max_frames_]);
+}
+
+ThreadSampler::~ThreadSampler() {
+  Stop();
+}
+
+bool ThreadSampler::Start(const std::vector<pid_t>& tids, std::chrono::microseconds interval,
+                          int signal) {
+  if (thread_.joinable()) {
+    return false;
+  }
+  if (maps_ == nullptr) {
+    maps_.reset(new LocalUpdatableMaps());
+    if (!maps_->Parse()) {
+      maps_.reset();
+      return false;
+    }
+    process_memory_ = Memory::CreateProcessMemoryThreadCached(getpid());
+  }
+  stop_ = false;
+  thread_ = std::thread(&ThreadSampler::Run, this, tids, interval, signal);
+  return true;
+}
+
+void ThreadSampler::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cond_.notify_one();
+  thread_.join();
+}
+
+void ThreadSampler::Run(std::vector<pid_t> tids, std::chrono::microseconds interval,
+                        int signal) {
+  ThreadUnwinder unwinder(max_frames_, maps_.get());
+  unwinder.SetResolveNames(false);
+
+  auto next = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_) {
+    lock.unlock();
+    std::vector<UnwindBatchResult> results = unwinder.UnwindWithSignal(signal, tids);
+    for (size_t i = 0; i < results.size(); i++) {
+      const std::vector<FrameData>& frames = results[i].frames;
+      if (frames.empty()) {
+        continue;
+      }
+      num_samples_++;
+      size_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) > ring_mask_) {
+        num_dropped_++;
+        continue;
+      }
+      size_t index = head & ring_mask_;
+      Record& record = records_[index];
+      record.tid = tids[i];
+      record.num_frames = std::min(frames.size(), max_frames_);
+      uint64_t* pcs = &pcs_[index * max_frames_];
+      for (size_t j = 0; j < record.num_frames; j++) {
+        pcs[j] = frames[j].pc;
+      }
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Keep the original schedule, unless a round took longer than the
+    // interval, then start over from now.
+    next += interval;
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      next = now;
+    }
+    lock.lock();
+    stop_cond_.wait_until(lock, next, [this] { return stop_; });
+  }
+}
+
+size_t ThreadSampler::Aggregate() {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  size_t head = head_.load(std::memory_order_acquire);
+  for (size_t i = tail; i != head; i++) {
+    size_t index = i & ring_mask_;
+    counts_[stacks_.Intern(&pcs_[index * max_frames_], records_[index].num_frames)]++;
+  }
+  tail_.store(head, std::memory_order_release);
+  return head - tail;
+}
+
+void ThreadSampler::ForEachStack(
+    const std::function<void(const std::vector<uint64_t>& pcs, uint64_t count)>& callback) {
+  std::vector<uint64_t> pcs;
+  for (const auto& [id, count] : counts_) {
+    stacks_.GetStack(id, &pcs);
+    callback(pcs, count);
+  }
+}
+
+std::string ThreadSampler::FoldedStacks() {
+  if (counts_.empty()) {
+    return "";
+  }
+
+  // Look up every distinct pc once, in a single Symbolize call.
+  std::unordered_map<uint64_t, size_t> pc_index;
+  std::vector<CapturedFrame> captured;
+  ArchEnum arch = Regs::CurrentArch();
+  for (StackStore::StackId id = 1; id <= stacks_.NumStacks(); id++) {
+    uint64_t pc = stacks_.pc(id);
+    if (pc_index.emplace(pc, captured.size()).second) {
+      CapturedFrame& frame = captured.emplace_back();
+      frame.pc = pc;
+      frame.rel_pc = pc;
+      frame.map_info = maps_->Find(pc);
+      if (frame.map_info != nullptr) {
+        frame.rel_pc = frame.map_info->GetElf(process_memory_, arch)->GetRelPc(pc, frame.map_info);
+      }
+    }
+  }
+  Unwinder symbolizer(max_frames_, maps_.get(), process_memory_);
+  symbolizer.SetArch(arch);
+  std::vector<FrameData> frames = symbolizer.Symbolize(captured);
+
+  std::vector<std::string> names(frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    const FrameData& frame = frames[i];
+    if (!frame.function_name.empty()) {
+      names[i] = frame.function_name;
+    } else if (frame.map_end != 0 && !frame.map_name.empty()) {
+      names[i] = android::base::StringPrintf("%s+0x%" PRIx64, frame.map_name.c_str(), frame.rel_pc);
+    } else {
+      names[i] = android::base::StringPrintf("0x%" PRIx64, frame.pc);
+    }
+  }
+
+  std::string data;
+  std::vector<uint64_t> pcs;
+  for (const auto& [id, count] : counts_) {
+    stacks_.GetStack(id, &pcs);
+    for (size_t i = pcs.size(); i > 0; i--) {
+      data += names[pc_index[pcs[i - 1]]];
+      data += i > 1 ? ';' : ' ';
+    }
+    data += std::to_string(count) + '\n';
+  }
+  return data;
+}
+
+}  // namespace unwindstack
@@ -76,13 +76,31 @@ ThreadUnwinder::ThreadUnwinder(size_t max_frames, const ThreadUnwinder* unwinder
     : UnwinderFromPid(max_frames, getpid(), Regs::CurrentArch()) {
   process_memory_ = unwinder->process_memory_;
   maps_ = unwinder->maps_;
+  shared_maps_ = unwinder->shared_maps_;
   jit_debug_ = unwinder->jit_debug_;
   dex_files_ = unwinder->dex_files_;
   initted_ = unwinder->initted_;
 }
 
+// Serializes every change of the signal action made by the unwinders.
+static std::mutex action_mutex;
+
+// If a wait failed, it could be that the signal could not be delivered
+// within the timeout. Add a signal handler that's simply going to log
+// something so that we don't crash if the signal eventually gets
+// delivered. Only do this if there isn't already an action set up.
+static void RestoreAfterTimeout(int signal, const struct sigaction& old_action) {
+  if (old_action.sa_sigaction == nullptr) {
+    struct sigaction log_action = {.sa_sigaction = SignalLogOnly,
+                                   .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
+    sigemptyset(&log_action.sa_mask);
+    sigaction(signal, &log_action, nullptr);
+  } else {
+    sigaction(signal, &old_action, nullptr);
+  }
+}
+
 ThreadEntry* ThreadUnwinder::SendSignalToThread(int signal, pid_t tid) {
-  static std::mutex action_mutex;
   std::lock_guard<std::mutex> guard(action_mutex);
 
   ThreadEntry* entry = ThreadEntry::Get(tid);
@@ -119,18 +137,7 @@ ThreadEntry* ThreadUnwinder::SendSignalToThread(int signal, pid_t tid) {
     return entry;
   }
 
-  if (old_action.sa_sigaction == nullptr) {
-    // If the wait failed, it could be that the signal could not be delivered
-    // within the timeout. Add a signal handler that's simply going to log
-    // something so that we don't crash if the signal eventually gets
-    // delivered. Only do this if there isn't already an action set up.
-    struct sigaction log_action = {.sa_sigaction = SignalLogOnly,
-                                   .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
-    sigemptyset(&log_action.sa_mask);
-    sigaction(signal, &log_action, nullptr);
-  } else {
-    sigaction(signal, &old_action, nullptr);
-  }
+  RestoreAfterTimeout(signal, old_action);
 
   // Check to see if the thread has disappeared.
   if (tgkill(getpid(), tid, 0) == -1 && errno == ESRCH) {
@@ -179,4 +186,99 @@ void ThreadUnwinder::UnwindWithSignal(int signal, pid_t tid,
   ThreadEntry::Remove(entry);
 }
 
+std::vector<UnwindBatchResult> ThreadUnwinder::UnwindWithSignal(
+    int signal, const std::vector<pid_t>& tids,
+    const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  ClearErrors();
+  std::vector<UnwindBatchResult> results(tids.size());
+  if (!Init()) {
+    for (auto& result : results) {
+      result.last_error = last_error_;
+    }
+    return results;
+  }
+
+  std::lock_guard<std::mutex> guard(action_mutex);
+  struct sigaction new_action = {.sa_sigaction = SignalHandler,
+                                 .sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK};
+  struct sigaction old_action = {};
+  sigemptyset(&new_action.sa_mask);
+  if (sigaction(signal, &new_action, &old_action) != 0) {
+    log_async_safe("sigaction failed: %s", strerror(errno));
+    for (auto& result : results) {
+      result.last_error.code = ERROR_SYSTEM_CALL;
+    }
+    return results;
+  }
+
+  // Signal every thread before waiting for any of them, so that all of the
+  // threads copy their ucontext at the same time.
+  std::vector<ThreadEntry*> entries(tids.size(), nullptr);
+  for (size_t i = 0; i < tids.size(); i++) {
+    if (tids[i] == pid_) {
+      results[i].last_error.code = ERROR_UNSUPPORTED;
+      continue;
+    }
+    ThreadEntry* entry = ThreadEntry::Get(tids[i]);
+    entry->Lock();
+    if (tgkill(getpid(), tids[i], signal) != 0) {
+      results[i].last_error.code =
+          errno == ESRCH ? ERROR_THREAD_DOES_NOT_EXIST : ERROR_SYSTEM_CALL;
+      ThreadEntry::Remove(entry);
+      continue;
+    }
+    entries[i] = entry;
+  }
+
+  bool timed_out = false;
+  for (size_t i = 0; i < tids.size(); i++) {
+    if (entries[i] == nullptr || entries[i]->Wait(WAIT_FOR_UCONTEXT)) {
+      continue;
+    }
+    timed_out = true;
+    if (tgkill(getpid(), tids[i], 0) == -1 && errno == ESRCH) {
+      results[i].last_error.code = ERROR_THREAD_DOES_NOT_EXIST;
+    } else {
+      results[i].last_error.code = ERROR_THREAD_TIMEOUT;
+      log_async_safe("Timed out waiting for signal handler to get ucontext data.");
+    }
+    ThreadEntry::Remove(entries[i]);
+    entries[i] = nullptr;
+  }
+  if (timed_out) {
+    RestoreAfterTimeout(signal, old_action);
+  }
+
+  // Every thread that answered is parked in the signal handler. Release
+  // each one as soon as its own unwind is done.
+  for (size_t i = 0; i < tids.size(); i++) {
+    ThreadEntry* entry = entries[i];
+    if (entry == nullptr) {
+      continue;
+    }
+    std::unique_ptr<Regs> regs(Regs::CreateFromUcontext(Regs::CurrentArch(), entry->GetUcontext()));
+    SetRegs(regs.get());
+    UnwinderFromPid::Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+    entry->Wake();
+
+    UnwindBatchResult& result = results[i];
+    result.frames = ConsumeFrames();
+    result.last_error = last_error_;
+    result.warnings = warnings_;
+  }
+  regs_ = nullptr;
+
+  for (ThreadEntry* entry : entries) {
+    if (entry == nullptr) {
+      continue;
+    }
+    if (!entry->Wait(WAIT_FOR_THREAD_TO_RESTART)) {
+      log_async_safe("Timed out waiting for signal handler to indicate it finished.");
+    }
+    ThreadEntry::Remove(entry);
+  }
+  return results;
+}
+
 }  // namespace unwindstack
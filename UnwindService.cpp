@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/DexFiles.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/JitDebug.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/UnwindService.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+struct UnwindService::Process {
+  // Held while the maps are parsed and while the process is unwound.
+  std::mutex lock;
+  std::unique_ptr<Maps> maps;
+  std::shared_ptr<Memory> memory;
+  std::unique_ptr<JitDebug> jit_debug;
+  std::unique_ptr<DexFiles> dex_files;
+  // Guarded by the service lock.
+  uint64_t last_used = 0;
+};
+
+UnwindService::UnwindService(const UnwindServiceConfig& config) : config_(config) {
+  Elf::SetCachingEnabled(true);
+  Elf::SetSharedFdeIndexEnabled(true);
+  Elf::SetInternNamesEnabled(true);
+  MapInfo::SetFileInfoCacheEnabled(true);
+  MapInfo::SetFailedFileCacheTtl(config_.failed_file_cache_ttl);
+  if (config_.elf_cache_memory_budget != 0) {
+    Elf::SetCacheMemoryBudget(config_.elf_cache_memory_budget);
+  }
+  if (!config_.index_cache_directory.empty()) {
+    Elf::SetIndexCacheDirectory(config_.index_cache_directory);
+  }
+}
+
+UnwindService::~UnwindService() = default;
+
+std::shared_ptr<UnwindService::Process> UnwindService::GetProcess(pid_t pid) {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::shared_ptr<Process>& process = processes_[pid];
+  if (process == nullptr) {
+    process = std::make_shared<Process>();
+    stats_.processes_added++;
+  }
+  process->last_used = ++clock_;
+  std::shared_ptr<Process> found = process;
+
+  // An evicted process is freed once the calls still using it are done.
+  while (config_.max_processes != 0 && processes_.size() > config_.max_processes) {
+    auto oldest = processes_.end();
+    for (auto it = processes_.begin(); it != processes_.end(); ++it) {
+      if (it->second != found &&
+          (oldest == processes_.end() || it->second->last_used < oldest->second->last_used)) {
+        oldest = it;
+      }
+    }
+    if (oldest == processes_.end()) {
+      break;
+    }
+    processes_.erase(oldest);
+    stats_.processes_evicted++;
+  }
+  return found;
+}
+
+bool UnwindService::ParseMaps(pid_t pid, Process* process) {
+  // The elf objects of the old maps stay in the elf cache, so parsing again
+  // only reads the maps file.
+  std::unique_ptr<Maps> maps(new RemoteMaps(pid));
+  if (!maps->Parse()) {
+    return false;
+  }
+  process->maps = std::move(maps);
+  if (process->memory == nullptr) {
+    MemoryCacheConfig cache_config;
+    cache_config.max_pages = config_.memory_cache_pages;
+    // Only one call unwinds a process at a time, so a cache shared by
+    // all of the threads is safe.
+    process->memory = Memory::CreateProcessMemoryCached(pid, cache_config);
+  }
+  process->memory->SetMaps(process->maps.get());
+  process->memory->Clear();
+  return true;
+}
+
+bool UnwindService::AddProcess(pid_t pid) {
+  std::shared_ptr<Process> process = GetProcess(pid);
+  std::lock_guard<std::mutex> guard(process->lock);
+  if (!ParseMaps(pid, process.get())) {
+    Drop(pid, process.get());
+    return false;
+  }
+  return true;
+}
+
+void UnwindService::RemoveProcess(pid_t pid) {
+  std::lock_guard<std::mutex> guard(lock_);
+  processes_.erase(pid);
+}
+
+void UnwindService::Drop(pid_t pid, const Process* process) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = processes_.find(pid);
+  if (it != processes_.end() && it->second.get() == process) {
+    processes_.erase(it);
+  }
+}
+
+bool UnwindService::Unwind(pid_t pid, const std::vector<UnwindSample>& samples,
+                           std::vector<UnwindBatchResult>* results) {
+  std::shared_ptr<Process> process = GetProcess(pid);
+  std::lock_guard<std::mutex> guard(process->lock);
+  if (process->maps == nullptr && !ParseMaps(pid, process.get())) {
+    Drop(pid, process.get());
+    return false;
+  }
+
+  Unwinder unwinder(config_.max_frames, process->maps.get(), process->memory);
+  unwinder.SetResolveNames(config_.resolve_names);
+  if (config_.resolve_jit && !samples.empty()) {
+    ArchEnum arch = samples[0].regs->Arch();
+    if (process->jit_debug == nullptr) {
+      process->jit_debug = CreateJitDebug(arch, process->memory);
+    }
+    unwinder.SetJitDebug(process->jit_debug.get());
+#if defined(DEXFILE_SUPPORT)
+    if (process->dex_files == nullptr) {
+      process->dex_files = CreateDexFiles(arch, process->memory);
+    }
+    unwinder.SetDexFiles(process->dex_files.get());
+#endif
+  }
+  *results = unwinder.UnwindBatch(samples);
+
+  std::lock_guard<std::mutex> stats_guard(lock_);
+  stats_.unwinds += samples.size();
+  return true;
+}
+
+UnwindServiceStats UnwindService::GetStats() {
+  UnwindServiceStats stats;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stats = stats_;
+    stats.processes = processes_.size();
+  }
+  stats.elf_cache = Elf::GetCacheStats();
+  return stats;
+}
+
+MemoryFootprint UnwindService::GetMemoryFootprint() {
+  std::vector<std::shared_ptr<Process>> processes;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    processes.reserve(processes_.size());
+    for (const auto& entry : processes_) {
+      processes.push_back(entry.second);
+    }
+  }
+
+  // Every elf of the processes is in the elf cache.
+  MemoryFootprint footprint;
+  footprint.elfs = Elf::GetCacheMemoryUsage(&footprint.num_elfs);
+  for (const auto& process : processes) {
+    std::lock_guard<std::mutex> guard(process->lock);
+    footprint.unwinder += sizeof(Process);
+    if (process->maps != nullptr) {
+      footprint.maps += process->maps->MemoryUsage();
+    }
+    if (process->memory != nullptr) {
+      footprint.memory_cache += process->memory->MemoryUsage();
+    }
+    if (process->jit_debug != nullptr) {
+      footprint.jit += process->jit_debug->MemoryUsage();
+    }
+    if (process->dex_files != nullptr) {
+      footprint.jit += process->dex_files->MemoryUsage();
+    }
+  }
+  return footprint;
+}
+
+}  // namespace unwindstack
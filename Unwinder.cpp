@@ -21,9 +21,17 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -31,19 +39,119 @@
 #include <unwindstack/DexFiles.h>
 #include <unwindstack/Elf.h>
 #include <unwindstack/JitDebug.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineX86_64.h>
 #include <unwindstack/MapInfo.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/RegsArm64.h>
 #include <unwindstack/Unwinder.h>
 
 #include "Check.h"
-#include <libgen.h>
+#include "MemoryLocal.h"
+#include "MemoryStackSnapshot.h"
+#include "MemoryUsage.h"
 
 // Use the demangler from libc++.
 extern "C" char* __cxa_demangle(const char*, char*, size_t*, int* status);
 
 namespace unwindstack {
 
+namespace {
+
+// Reused by every demangle on this thread, __cxa_demangle grows it with
+// realloc when needed.
+struct DemangleBuffer {
+  ~DemangleBuffer() { free(data); }
+  char* data = nullptr;
+  size_t size = 0;
+};
+
+// Returns the demangled name in a buffer of the calling thread, valid until
+// the next call, or nullptr if name is not a mangled name.
+const char* DemangleToBuffer(const char* name) {
+  static thread_local DemangleBuffer demangle;
+  int status;
+  size_t length = demangle.size;
+  char* demangled_name = __cxa_demangle(name, demangle.data, &length, &status);
+  if (demangled_name == nullptr) {
+    return nullptr;
+  }
+  // The buffer might have been reallocated, the size is only known to be at
+  // least as long as the name.
+  demangle.data = demangled_name;
+  demangle.size = std::max(demangle.size, length);
+  return demangled_name;
+}
+
+// The demangled names of the function names seen so far, shared by every
+// unwinder. Once full, an arbitrary entry is dropped for every one added.
+class DemangleCache {
+ public:
+  bool Find(std::string_view name, SharedString* demangled) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto entry = entries_.find(name);
+    if (entry == entries_.end()) {
+      return false;
+    }
+    *demangled = entry->second.demangled;
+    return true;
+  }
+
+  void Add(const SharedString& name, const SharedString& demangled, size_t max_entries) {
+    std::lock_guard<std::mutex> guard(lock_);
+    while (!entries_.empty() && entries_.size() >= max_entries) {
+      entries_.erase(entries_.begin());
+    }
+    // The key points into the name kept by the entry.
+    entries_.try_emplace(name, Entry{name, demangled});
+  }
+
+ private:
+  struct Entry {
+    SharedString name;
+    SharedString demangled;
+  };
+  std::mutex lock_;
+  std::unordered_map<std::string_view, Entry> entries_;
+};
+
+DemangleCache* GetDemangleCache() {
+  static DemangleCache* cache = new DemangleCache;
+  return cache;
+}
+
+std::atomic<size_t> g_demangle_cache_size = 4096;
+
+}  // namespace
+
+void Unwinder::SetDemangleCacheSize(size_t entries) {
+  g_demangle_cache_size.store(entries, std::memory_order_relaxed);
+}
+
+SharedString Unwinder::Demangle(const SharedString& name) {
+  if (name.empty()) {
+    return name;
+  }
+  size_t max_entries = g_demangle_cache_size.load(std::memory_order_relaxed);
+  SharedString demangled;
+  if (max_entries != 0 && GetDemangleCache()->Find(name, &demangled)) {
+    return demangled;
+  }
+  const char* demangled_name = DemangleToBuffer(name.c_str());
+  if (demangled_name == nullptr) {
+    demangled = name;
+  } else if (Elf::InternNamesEnabled()) {
+    demangled = SharedString::Intern(demangled_name);
+  } else {
+    demangled = SharedString(demangled_name);
+  }
+  if (max_entries != 0) {
+    GetDemangleCache()->Add(name, demangled, max_entries);
+  }
+  return demangled;
+}
+
 // Inject extra 'virtual' frame that represents the dex pc data.
 // The dex pc is a magic register defined in the Mterp interpreter,
 // and thus it will be restored/observed in the frame after it.
@@ -59,20 +167,26 @@ void Unwinder::FillInDexFrame() {
 
   uint64_t dex_pc = regs_->dex_pc();
   frame->pc = dex_pc;
-  frame->sp = regs_->sp();
+  if (frame_fields_ & FRAME_FIELD_SP) {
+    frame->sp = regs_->sp();
+  }
 
   MapInfo* info = maps_->Find(dex_pc);
   if (info != nullptr) {
-    frame->map_start = info->start;
-    frame->map_end = info->end;
-    // Since this is a dex file frame, the elf_start_offset is not set
-    // by any of the normal code paths. Use the offset of the map since
-    // that matches the actual offset.
-    frame->map_elf_start_offset = info->offset;
-    frame->map_exact_offset = info->offset;
-    frame->map_load_bias = info->load_bias;
-    frame->map_flags = info->flags;
-    if (resolve_names_) {
+    if (frame_fields_ & FRAME_FIELD_MAP_RANGE) {
+      frame->map_start = info->start;
+      frame->map_end = info->end;
+      // Since this is a dex file frame, the elf_start_offset is not set
+      // by any of the normal code paths. Use the offset of the map since
+      // that matches the actual offset.
+      frame->map_elf_start_offset = info->offset;
+      frame->map_exact_offset = info->offset;
+      frame->map_flags = info->flags;
+    }
+    if (frame_fields_ & FRAME_FIELD_MAP_LOAD_BIAS) {
+      frame->map_load_bias = info->load_bias;
+    }
+    if (resolve_names_ && (frame_fields_ & FRAME_FIELD_MAP_NAME)) {
       frame->map_name = info->name;
     }
     frame->rel_pc = dex_pc - info->start;
@@ -82,7 +196,7 @@ void Unwinder::FillInDexFrame() {
     return;
   }
 
-  if (!resolve_names_) {
+  if (!ResolveFunctionNames()) {
     return;
   }
 
@@ -92,16 +206,93 @@ void Unwinder::FillInDexFrame() {
   }
 
   dex_files_->GetFunctionName(maps_, dex_pc, &frame->function_name, &frame->function_offset);
+  if (demangle_names_) {
+    frame->demangled_name = Demangle(frame->function_name);
+  }
 #endif
 }
 
+struct Unwinder::FrameCache {
+  struct Entry {
+    bool valid = false;
+    // The FrameOptions used to fill it.
+    uint8_t options = 0;
+    uint64_t pc = 0;
+    uint64_t generation = 0;
+    SharedString map_name;
+    uint64_t map_elf_start_offset = 0;
+    uint64_t map_exact_offset = 0;
+    uint64_t map_start = 0;
+    uint64_t map_end = 0;
+    uint64_t map_load_bias = 0;
+    int map_flags = 0;
+    SharedString function_name;
+    SharedString demangled_name;
+    uint64_t function_offset = 0;
+  };
+  // Direct mapped, a colliding pc replaces the entry.
+  std::vector<Entry> entries;
+
+  Entry& Get(uint64_t pc) {
+    uint64_t hash = pc * 0x9e3779b97f4a7c15ULL;
+    return entries[(hash >> 32) & (entries.size() - 1)];
+  }
+};
+
+void Unwinder::FrameCacheDeleter::operator()(FrameCache* cache) const {
+  delete cache;
+}
+
+void Unwinder::SetFrameCacheSize(size_t entries) {
+  if (entries == 0) {
+    frame_cache_.reset();
+    return;
+  }
+  size_t size = 1;
+  while (size < entries) {
+    size <<= 1;
+  }
+  frame_cache_.reset(new FrameCache);
+  frame_cache_->entries.resize(size);
+}
+
+MemoryFootprint Unwinder::GetMemoryFootprint() {
+  MemoryFootprint footprint;
+  if (maps_ != nullptr) {
+    // Several maps of one file share its elf object.
+    std::unordered_set<Elf*> counted;
+    for (const auto& map_info : *maps_) {
+      Elf* elf = map_info->GetElfIfCreated();
+      if (elf != nullptr && counted.insert(elf).second) {
+        elf->GetMemoryUsage(&footprint.elfs);
+      }
+    }
+    footprint.num_elfs = counted.size();
+    footprint.maps = maps_->MemoryUsage();
+  }
+  if (process_memory_ != nullptr) {
+    footprint.memory_cache = process_memory_->MemoryUsage();
+  }
+  if (jit_debug_ != nullptr) {
+    footprint.jit += jit_debug_->MemoryUsage();
+  }
+  if (dex_files_ != nullptr) {
+    footprint.jit += dex_files_->MemoryUsage();
+  }
+  footprint.unwinder = sizeof(*this) + VectorMemoryUsage(frames_) + VectorMemoryUsage(frame_keys_);
+  if (frame_cache_ != nullptr) {
+    footprint.unwinder += sizeof(FrameCache) + VectorMemoryUsage(frame_cache_->entries);
+  }
+  return footprint;
+}
+
 FrameData* Unwinder::FillInFrame(MapInfo* map_info, Elf* elf, uint64_t rel_pc,
-                                 uint64_t pc_adjustment) {
+                                 uint64_t pc_adjustment, bool* cached) {
   size_t frame_num = frames_.size();
   frames_.resize(frame_num + 1);
   FrameData* frame = &frames_.at(frame_num);
   frame->num = frame_num;
-  frame->sp = regs_->sp();
+  frame->sp = (frame_fields_ & FRAME_FIELD_SP) ? regs_->sp() : 0;
   frame->rel_pc = rel_pc - pc_adjustment;
   frame->pc = regs_->pc() - pc_adjustment;
 
@@ -110,7 +301,31 @@ FrameData* Unwinder::FillInFrame(MapInfo* map_info, Elf* elf, uint64_t rel_pc,
     return nullptr;
   }
 
-  if (resolve_names_) {
+  if (cached != nullptr && frame_cache_ != nullptr) {
+    const FrameCache::Entry& entry = frame_cache_->Get(frame->pc);
+    if (entry.valid && entry.pc == frame->pc && entry.options == FrameOptions() &&
+        entry.generation == maps_->generation()) {
+      frame->map_name = entry.map_name;
+      frame->map_elf_start_offset = entry.map_elf_start_offset;
+      frame->map_exact_offset = entry.map_exact_offset;
+      frame->map_start = entry.map_start;
+      frame->map_end = entry.map_end;
+      frame->map_flags = entry.map_flags;
+      frame->map_load_bias = entry.map_load_bias;
+      frame->function_name = entry.function_name;
+      frame->demangled_name = entry.demangled_name;
+      frame->function_offset = entry.function_offset;
+      *cached = true;
+      return frame;
+    }
+  }
+
+  FillInMapFields(frame, map_info, elf);
+  return frame;
+}
+
+void Unwinder::FillInMapFields(FrameData* frame, MapInfo* map_info, Elf* elf) {
+  if (resolve_names_ && (frame_fields_ & FRAME_FIELD_MAP_NAME)) {
     frame->map_name = map_info->name;
     if (embedded_soname_ && map_info->elf_start_offset != 0 && !frame->map_name.empty()) {
       std::string soname = elf->GetSoname();
@@ -119,31 +334,539 @@ FrameData* Unwinder::FillInFrame(MapInfo* map_info, Elf* elf, uint64_t rel_pc,
         map_with_soname += frame->map_name;
         map_with_soname += '!';
         map_with_soname += soname;
-        frame->map_name = SharedString(std::move(map_with_soname));
+        frame->map_name = Elf::InternNamesEnabled() ? SharedString::Intern(map_with_soname)
+                                                    : SharedString(std::move(map_with_soname));
       }
     }
   }
-  frame->map_elf_start_offset = map_info->elf_start_offset;
-  frame->map_exact_offset = map_info->offset;
-  frame->map_start = map_info->start;
-  frame->map_end = map_info->end;
-  frame->map_flags = map_info->flags;
-  frame->map_load_bias = elf->GetLoadBias();
-  return frame;
+  if (frame_fields_ & FRAME_FIELD_MAP_RANGE) {
+    frame->map_elf_start_offset = map_info->elf_start_offset;
+    frame->map_exact_offset = map_info->offset;
+    frame->map_start = map_info->start;
+    frame->map_end = map_info->end;
+    frame->map_flags = map_info->flags;
+  }
+  if (frame_fields_ & FRAME_FIELD_MAP_LOAD_BIAS) {
+    frame->map_load_bias = elf->GetLoadBias();
+  }
+}
+
+void Unwinder::AddToFrameCache(const FrameData& frame, uint64_t generation) {
+  FrameCache::Entry& entry = frame_cache_->Get(frame.pc);
+  entry.valid = true;
+  entry.options = FrameOptions();
+  entry.pc = frame.pc;
+  entry.generation = generation;
+  entry.map_name = frame.map_name;
+  entry.map_elf_start_offset = frame.map_elf_start_offset;
+  entry.map_exact_offset = frame.map_exact_offset;
+  entry.map_start = frame.map_start;
+  entry.map_end = frame.map_end;
+  entry.map_flags = frame.map_flags;
+  entry.map_load_bias = frame.map_load_bias;
+  entry.function_name = frame.function_name;
+  entry.demangled_name = frame.demangled_name;
+  entry.function_offset = frame.function_offset;
+}
+
+struct Unwinder::BatchCache {
+  struct MapEntry {
+    MapInfo* map_info = nullptr;
+    Elf* elf = nullptr;
+  };
+  static constexpr size_t kNumMaps = 8;
+  MapEntry maps[kNumMaps];
+  size_t next_map = 0;
+
+  struct SymbolKey {
+    Elf* elf;
+    uint64_t pc;
+    bool operator==(const SymbolKey& rhs) const { return elf == rhs.elf && pc == rhs.pc; }
+  };
+  struct SymbolKeyHash {
+    size_t operator()(const SymbolKey& key) const {
+      return std::hash<uint64_t>()(key.pc) ^ std::hash<Elf*>()(key.elf);
+    }
+  };
+  struct SymbolValue {
+    bool found = false;
+    SharedString name;
+    uint64_t offset = 0;
+  };
+  std::unordered_map<SymbolKey, SymbolValue, SymbolKeyHash> symbols;
+
+  // The elf objects are created from the memory of the unwinder, not the
+  // memory of a sample, which might only be valid for that sample.
+  std::shared_ptr<Memory> elf_memory;
+};
+
+static std::mutex g_stats_mutex;
+static UnwindStats g_stats;
+static std::atomic<Unwinder::AllocationCounter> g_allocation_counter;
+
+void UnwindStats::Add(const UnwindStats& other) {
+  unwinds += other.unwinds;
+  frames += other.frames;
+  total_ns += other.total_ns;
+  find_map_ns += other.find_map_ns;
+  get_elf_ns += other.get_elf_ns;
+  step_ns += other.step_ns;
+  function_name_ns += other.function_name_ns;
+  jit_dex_ns += other.jit_dex_ns;
+  map_cache_hits += other.map_cache_hits;
+  map_cache_misses += other.map_cache_misses;
+  elfs_created += other.elfs_created;
+  frame_cache_hits += other.frame_cache_hits;
+  frame_cache_misses += other.frame_cache_misses;
+  suffix_frames_reused += other.suffix_frames_reused;
+  memory_cache_hits += other.memory_cache_hits;
+  memory_cache_misses += other.memory_cache_misses;
+  memory_uncached_reads += other.memory_uncached_reads;
+  total_allocs.Add(other.total_allocs);
+  find_map_allocs.Add(other.find_map_allocs);
+  get_elf_allocs.Add(other.get_elf_allocs);
+  step_allocs.Add(other.step_allocs);
+  function_name_allocs.Add(other.function_name_allocs);
+  jit_dex_allocs.Add(other.jit_dex_allocs);
+}
+
+UnwindStats Unwinder::GetGlobalStats() {
+  std::lock_guard<std::mutex> guard(g_stats_mutex);
+  return g_stats;
+}
+
+void Unwinder::ClearGlobalStats() {
+  std::lock_guard<std::mutex> guard(g_stats_mutex);
+  g_stats = UnwindStats();
 }
 
-static bool ShouldStop(const std::vector<std::string>* map_suffixes_to_ignore,
-                       const std::string& map_name) {
-  if (map_suffixes_to_ignore == nullptr) {
+void Unwinder::SetAllocationCounter(AllocationCounter counter) {
+  g_allocation_counter.store(counter, std::memory_order_relaxed);
+}
+
+static uint64_t NowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Adds the allocations made until it goes out of scope to allocs, when
+// there is an allocation counter.
+class AllocationScope {
+ public:
+  explicit AllocationScope(AllocationCounts* allocs) {
+    if (allocs != nullptr) {
+      counter_ = g_allocation_counter.load(std::memory_order_relaxed);
+      if (counter_ != nullptr) {
+        allocs_ = allocs;
+        start_ = counter_();
+      }
+    }
+  }
+  ~AllocationScope() {
+    if (allocs_ != nullptr) {
+      AllocationCounts end = counter_();
+      allocs_->allocs += end.allocs - start_.allocs;
+      allocs_->bytes += end.bytes - start_.bytes;
+    }
+  }
+
+ private:
+  Unwinder::AllocationCounter counter_ = nullptr;
+  AllocationCounts* allocs_ = nullptr;
+  AllocationCounts start_;
+};
+
+// Adds the time and allocations until it goes out of scope to the phase,
+// when measuring.
+class PhaseTimer {
+ public:
+  PhaseTimer(UnwindStats* stats, uint64_t UnwindStats::*phase,
+             AllocationCounts UnwindStats::*allocs)
+      : ns_(stats != nullptr ? &(stats->*phase) : nullptr),
+        allocs_(stats != nullptr ? &(stats->*allocs) : nullptr) {
+    if (ns_ != nullptr) {
+      start_ns_ = NowNs();
+    }
+  }
+  ~PhaseTimer() {
+    if (ns_ != nullptr) {
+      *ns_ += NowNs() - start_ns_;
+    }
+  }
+
+ private:
+  uint64_t* ns_;
+  uint64_t start_ns_ = 0;
+  AllocationScope allocs_;
+};
+
+// Fails all of the reads once they would go over max_bytes, so that a step
+// stops soon after using up the budget.
+class MemoryBudget : public Memory {
+ public:
+  MemoryBudget(Memory* memory, uint64_t max_bytes) : memory_(memory), bytes_left_(max_bytes) {}
+  virtual ~MemoryBudget() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    if (size > bytes_left_) {
+      exceeded_ = true;
+      return 0;
+    }
+    size_t bytes = memory_->Read(addr, dst, size);
+    bytes_left_ -= bytes;
+    return bytes;
+  }
+  long ReadTag(uint64_t addr) override { return memory_->ReadTag(addr); }
+  size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags) override {
+    return memory_->ReadTags(addr, count, tags);
+  }
+
+  bool exceeded() { return exceeded_; }
+
+ private:
+  Memory* memory_;
+  uint64_t bytes_left_;
+  bool exceeded_ = false;
+};
+
+MapInfo* Unwinder::FindMap(uint64_t addr, bool is_pc) {
+  for (size_t i = 0; i < kNumRecentMaps && recent_maps_[i] != nullptr; i++) {
+    MapInfo* map_info = recent_maps_[i];
+    if (addr >= map_info->start && addr < map_info->end) {
+      for (; i > 0; i--) {
+        recent_maps_[i] = recent_maps_[i - 1];
+      }
+      recent_maps_[0] = map_info;
+      map_cache_stats_.hits++;
+      return map_info;
+    }
+  }
+  map_cache_stats_.misses++;
+
+  MapInfo* map_info = nullptr;
+  if (batch_cache_ == nullptr) {
+    map_info = is_pc ? maps_->FindPc(addr) : maps_->Find(addr);
+  } else {
+    for (const auto& entry : batch_cache_->maps) {
+      if (entry.map_info != nullptr && addr >= entry.map_info->start &&
+          addr < entry.map_info->end) {
+        map_info = entry.map_info;
+        break;
+      }
+    }
+    if (map_info == nullptr) {
+      map_info = is_pc ? maps_->FindPc(addr) : maps_->Find(addr);
+      if (map_info != nullptr) {
+        BatchCache::MapEntry& entry = batch_cache_->maps[batch_cache_->next_map];
+        entry.map_info = map_info;
+        entry.elf = nullptr;
+        batch_cache_->next_map = (batch_cache_->next_map + 1) % BatchCache::kNumMaps;
+      }
+    }
+  }
+  if (map_info != nullptr) {
+    for (size_t i = kNumRecentMaps - 1; i > 0; i--) {
+      recent_maps_[i] = recent_maps_[i - 1];
+    }
+    recent_maps_[0] = map_info;
+  }
+  return map_info;
+}
+
+Elf* Unwinder::GetElf(MapInfo* map_info) {
+  if (batch_cache_ == nullptr) {
+    return map_info->GetElf(process_memory_, arch_);
+  }
+
+  std::shared_ptr<Memory>& memory =
+      batch_cache_->elf_memory != nullptr ? batch_cache_->elf_memory : process_memory_;
+  for (auto& entry : batch_cache_->maps) {
+    if (entry.map_info == map_info) {
+      if (entry.elf == nullptr) {
+        entry.elf = map_info->GetElf(memory, arch_);
+      }
+      return entry.elf;
+    }
+  }
+  return map_info->GetElf(memory, arch_);
+}
+
+bool Unwinder::GetFunctionName(Elf* elf, uint64_t pc, SharedString* name, uint64_t* offset) {
+  if (batch_cache_ == nullptr) {
+    return elf->GetFunctionName(pc, name, offset);
+  }
+
+  auto [entry, inserted] = batch_cache_->symbols.try_emplace(BatchCache::SymbolKey{elf, pc});
+  BatchCache::SymbolValue& value = entry->second;
+  if (inserted) {
+    value.found = elf->GetFunctionName(pc, &value.name, &value.offset);
+  }
+  if (value.found) {
+    *name = value.name;
+    *offset = value.offset;
+  }
+  return value.found;
+}
+
+bool Unwinder::StepFramePointer(Elf* elf, uint64_t step_pc, Memory* memory) {
+  uint16_t fp_reg;
+  switch (ArchDispatch(arch_)) {
+    case ARCH_ARM64:
+      fp_reg = ARM64_REG_R29;
+      break;
+    case ARCH_X86_64:
+      fp_reg = X86_64_REG_RBP;
+      break;
+    default:
+      return false;
+  }
+  if (elf->GetFramePointerRule(step_pc) == FRAME_POINTER_NOT_USED) {
+    return false;
+  }
+
+  // The frame record must be aligned and on the same stack as the sp.
+  RegsImpl<uint64_t>* regs = reinterpret_cast<RegsImpl<uint64_t>*>(regs_);
+  uint64_t fp = (*regs)[fp_reg];
+  uint64_t sp = regs_->sp();
+  if (fp < sp || (fp & 7) != 0) {
+    return false;
+  }
+  MapInfo* stack_info = FindMap(sp);
+  if (stack_info == nullptr || fp >= stack_info->end || stack_info->end - fp < 16) {
+    return false;
+  }
+
+  uint64_t record[2];
+  if (!memory->ReadFully(fp, record, sizeof(record))) {
     return false;
   }
-  auto pos = map_name.find_last_of('.');
-  if (pos == std::string::npos) {
+  // The saved lr of a function that signs it is signed.
+  uint64_t return_address = record[1];
+  if (regs_->Arch() == ARCH_ARM64) {
+    return_address = static_cast<RegsArm64*>(regs_)->StripPAC(return_address);
+  }
+  MapInfo* pc_info = FindMap(return_address, true);
+  if (pc_info == nullptr || !(pc_info->flags & PROT_EXEC)) {
     return false;
   }
 
-  return std::find(map_suffixes_to_ignore->begin(), map_suffixes_to_ignore->end(),
-                   map_name.substr(pos + 1)) != map_suffixes_to_ignore->end();
+  // The caller's frame record is checked against the new sp in the next step.
+  regs_->ResetPseudoRegisters();
+  (*regs)[fp_reg] = record[0];
+  if (arch_ == ARCH_ARM64) {
+    (*regs)[ARM64_REG_LR] = record[1];
+  }
+  regs_->set_sp(fp + 16);
+  regs_->set_pc(return_address);
+  return true;
+}
+
+// The name bionic gives to the maps of the shadow call stacks.
+static constexpr std::string_view kShadowCallStackName = "[anon:shadow call stack]";
+
+bool Unwinder::AddReturnAddressFrame(uint64_t pc, uint64_t sp, bool adjust_pc,
+                                     bool* skip_initial_maps, uint64_t maps_generation) {
+  MapInfo* map_info = FindMap(pc, true);
+  if (map_info == nullptr || !(map_info->flags & PROT_EXEC) ||
+      map_filter_.MatchesSuffix(map_info)) {
+    return false;
+  }
+  if (*skip_initial_maps && map_filter_.MatchesName(map_info)) {
+    return true;
+  }
+  *skip_initial_maps = false;
+
+  Elf* elf = GetElf(map_info);
+  regs_->set_pc(pc);
+  uint64_t rel_pc = elf->GetRelPc(pc, map_info);
+  uint64_t pc_adjustment = adjust_pc ? GetPcAdjustment(rel_pc, elf, arch_) : 0;
+  bool cached = false;
+  FrameData* frame = FillInFrame(map_info, elf, rel_pc, pc_adjustment,
+                                 frame_cache_ != nullptr ? &cached : nullptr);
+  frame->sp = sp;
+  if (cached) {
+    return true;
+  }
+  uint64_t step_pc = (map_info->flags & MAPS_FLAGS_JIT_SYMFILE_MAP) ? pc : rel_pc;
+  if (!ResolveFunctionNames() || !GetFunctionName(elf, step_pc - pc_adjustment,
+                                                   &frame->function_name,
+                                                   &frame->function_offset)) {
+    frame->function_name.clear();
+    frame->function_offset = 0;
+  }
+  if (demangle_names_) {
+    frame->demangled_name = Demangle(frame->function_name);
+  }
+  if (frame_cache_ != nullptr) {
+    AddToFrameCache(*frame, maps_generation);
+  }
+  return true;
+}
+
+bool Unwinder::UnwindShadowCallStack(Memory* memory, bool skip_initial_maps) {
+  if (!ArchSupported(ARCH_ARM64) || arch_ != ARCH_ARM64 || regs_->Arch() != ARCH_ARM64) {
+    return false;
+  }
+  RegsArm64* regs = static_cast<RegsArm64*>(regs_);
+  uint64_t scs = (*regs)[ARM64_REG_R18];
+  if (scs < 8 || (scs & 7) != 0) {
+    return false;
+  }
+  // x18 points past the newest entry, which can be the end of the map.
+  MapInfo* scs_info = FindMap(scs - 8);
+  if (scs_info == nullptr ||
+      (scs_info->flags & (PROT_READ | PROT_WRITE | PROT_EXEC)) != (PROT_READ | PROT_WRITE) ||
+      (scs_info->flags & MAPS_FLAGS_DEVICE_MAP) || scs_info == FindMap(regs_->sp())) {
+    return false;
+  }
+  MapInfo* pc_info = FindMap(regs_->pc(), true);
+  if (pc_info == nullptr || !(pc_info->flags & PROT_EXEC)) {
+    return false;
+  }
+
+  // The newest entries, as many as there can be frames, in a single read.
+  uint64_t total = (scs - scs_info->start) / 8;
+  size_t count = std::min<uint64_t>(total, max_frames_);
+  std::vector<uint64_t> entries(count);
+  if (!memory->ReadFully(scs - count * 8, entries.data(), count * 8)) {
+    return false;
+  }
+  for (uint64_t& entry : entries) {
+    entry = regs->StripPAC(entry);
+  }
+  // Without the name, such as on another libc, x18 could be pointing at any
+  // data, and only a map holding nothing but return addresses is trusted.
+  if (scs_info->name != kShadowCallStackName) {
+    for (uint64_t entry : entries) {
+      MapInfo* entry_info = FindMap(entry, true);
+      if (entry_info == nullptr || !(entry_info->flags & PROT_EXEC)) {
+        return false;
+      }
+    }
+  }
+
+  uint64_t maps_generation = frame_cache_ != nullptr ? maps_->generation() : 0;
+  uint64_t pc = regs_->pc();
+  uint64_t lr = regs->StripPAC((*regs)[ARM64_REG_LR]);
+  MapInfo* map_info = FindMap(pc, true);
+  Elf* elf = GetElf(map_info);
+  uint64_t rel_pc = elf->GetRelPc(pc, map_info);
+  uint64_t step_pc = (map_info->flags & MAPS_FLAGS_JIT_SYMFILE_MAP) ? pc : rel_pc;
+  uint64_t sp = regs_->sp();
+  if (!AddReturnAddressFrame(pc, sp, false, &skip_initial_maps, maps_generation)) {
+    return true;
+  }
+
+  // The first function may not have pushed its return address yet, only
+  // stepping it tells which it is. The lr is used if it cannot be stepped.
+  bool finished = false;
+  bool is_signal_frame = false;
+  regs_->set_pc(pc);
+  uint64_t caller = lr;
+  uint64_t caller_sp = 0;
+  size_t next = count;
+  if (elf->Step(step_pc, regs_, memory, &finished, &is_signal_frame)) {
+    caller = finished ? 0 : regs->StripPAC(regs_->pc());
+    caller_sp = regs_->sp();
+    // The push is the first instruction of the prologue, so the function
+    // pushed its return address if the step popped it from x18, or went
+    // past the start of the prologue. A recursive call has the same return
+    // address on top of the shadow stack, so the value alone is not enough.
+    bool pushed = (*regs)[ARM64_REG_R18] != scs || caller_sp != sp;
+    if (caller != 0 && pushed && next != 0 && entries[next - 1] == caller) {
+      next--;
+    }
+  } else if (next != 0 && entries[next - 1] == caller) {
+    // Without a step, only the value tells whether the lr was pushed.
+    next--;
+  }
+  if (caller != 0) {
+    if (frames_.size() == max_frames_ ||
+        !AddReturnAddressFrame(caller, caller_sp, true, &skip_initial_maps, maps_generation)) {
+      return true;
+    }
+  }
+  while (next != 0 && frames_.size() < max_frames_) {
+    uint64_t entry = entries[--next];
+    if (entry == 0 ||
+        !AddReturnAddressFrame(entry, 0, true, &skip_initial_maps, maps_generation)) {
+      return true;
+    }
+  }
+  if (frames_.size() == max_frames_ && (next != 0 || total > count)) {
+    last_error_.code = ERROR_MAX_FRAMES_EXCEEDED;
+  }
+  return true;
+}
+
+bool Unwinder::ReuseStackSuffix(uint64_t pc, uint64_t sp, uint64_t caller_sp, uint64_t dex_pc,
+                                size_t* next) {
+  const StackSuffixCache* cache = stack_suffix_cache_;
+  const std::vector<StackSuffixCache::Key>& keys = cache->keys;
+  // Both unwinds go toward the bottom of the stack, so the frames below sp
+  // cannot match anymore.
+  size_t index = *next;
+  while (index < keys.size() && (keys[index].sp == 0 || keys[index].sp < sp)) {
+    index++;
+  }
+  *next = index;
+
+  for (; index < keys.size() && (keys[index].sp == 0 || keys[index].sp == sp); index++) {
+    if (keys[index].pc != pc || keys[index].sp != sp) {
+      continue;
+    }
+    // The dex frame added by the step into this frame comes before it.
+    size_t prev = index;
+    if (dex_pc != 0) {
+      if (prev == 0 || keys[prev - 1].sp != 0 || cache->frames[prev - 1].pc != dex_pc) {
+        continue;
+      }
+      prev--;
+    }
+    if (prev == 0 || keys[prev - 1].sp != caller_sp) {
+      continue;
+    }
+    // The same function can run at the same sp when called from somewhere
+    // else, so the caller that the step of this frame found has to be the
+    // next frame of the last unwind, after the dex frame the step added.
+    size_t start = index + 1;
+    size_t caller = start;
+    if (regs_->dex_pc() != 0) {
+      if (caller == keys.size() || keys[caller].sp != 0 ||
+          cache->frames[caller].pc != regs_->dex_pc()) {
+        continue;
+      }
+      caller++;
+    }
+    if (caller == keys.size() || keys[caller].pc != regs_->pc() ||
+        keys[caller].sp != regs_->sp()) {
+      continue;
+    }
+
+    size_t remaining = keys.size() - start;
+    size_t count = std::min(remaining, max_frames_ - frames_.size());
+    // The last unwind stopped at the frame limit before the end of the
+    // stack, which is deeper than the frames it found.
+    if (cache->last_error.code == ERROR_MAX_FRAMES_EXCEEDED && count == remaining &&
+        frames_.size() + count < max_frames_) {
+      return false;
+    }
+    for (size_t i = start; i < start + count; i++) {
+      FrameData& frame = frames_.emplace_back(cache->frames[i]);
+      frame.num = frames_.size() - 1;
+    }
+    frame_keys_.resize(frames_.size() - count);
+    frame_keys_.insert(frame_keys_.end(), keys.begin() + start, keys.begin() + start + count);
+    last_error_ = cache->last_error;
+    warnings_ |= cache->warnings;
+    if (count < remaining) {
+      last_error_.code = ERROR_MAX_FRAMES_EXCEEDED;
+      last_error_.address = 0;
+    }
+    return true;
+  }
+  return false;
 }
 
 void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
@@ -153,31 +876,128 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
 
   frames_.clear();
   elf_from_memory_not_file_ = false;
+  ClearRecentMaps();
+  map_filter_.Set(initial_map_names_to_skip, map_suffixes_to_ignore);
+  bool skip_initial_maps = initial_map_names_to_skip != nullptr;
+
+  UnwindStats* stats = nullptr;
+  uint64_t start_ns = 0;
+  MapCacheStats start_map_stats = map_cache_stats_;
+  MemoryCacheStats start_memory_stats;
+  bool memory_stats = false;
+  std::optional<AllocationScope> total_allocs;
+  if (stats_enabled_) {
+    stats = &stats_;
+    stats_ = UnwindStats();
+    total_allocs.emplace(&stats_.total_allocs);
+    stats_.unwinds = 1;
+    start_ns = NowNs();
+    memory_stats = process_memory_ != nullptr && process_memory_->GetCacheStats(&start_memory_stats);
+  }
 
-  // Clear any cached data from previous unwinds.
-  process_memory_->Clear();
+  // Clear any cached data from previous unwinds that could have changed,
+  // pages of read-only maps are kept. When unwinding a batch, this is done
+  // once for the whole batch.
+  if (batch_cache_ == nullptr) {
+    process_memory_->SetMaps(maps_);
+    process_memory_->ClearWritable();
+  }
+  bool bounded_stack = stack_memory_ == nullptr && batch_cache_ == nullptr && UseStackBounds();
+  if (process_memory_ != nullptr && stack_memory_ == nullptr) {
+    process_memory_->Prefetch(regs_->sp(), kStackPrefetchSize);
+  }
 
+  Memory* step_memory = stack_memory_ != nullptr ? stack_memory_ : process_memory_.get();
+  uint64_t budget_start_ns = budget_.max_time_ns != 0 ? NowNs() : 0;
+  std::optional<MemoryBudget> budget_memory;
+  if (budget_.max_bytes_read != 0) {
+    budget_memory.emplace(step_memory, budget_.max_bytes_read);
+    step_memory = &*budget_memory;
+  }
+  size_t elfs_created = 0;
   bool return_address_attempt = false;
   bool adjust_pc = false;
-  for (; frames_.size() < max_frames_;) {
+  // Set when the pc is a return address, so the function is known to have
+  // finished its prologue.
+  bool at_call_site = false;
+  // Read before any map lookup, so frames added to the frame cache are never
+  // tagged with a generation newer than the maps they came from.
+  uint64_t maps_generation =
+      frame_cache_ != nullptr || stack_suffix_cache_ != nullptr ? maps_->generation() : 0;
+  uint8_t frame_options = FrameOptions();
+  bool reuse_suffix = false;
+  size_t suffix_next = 0;
+  uint64_t caller_sp = 0;
+  if (stack_suffix_cache_ != nullptr) {
+    frame_keys_.clear();
+    reuse_suffix = stack_suffix_cache_->valid &&
+                   stack_suffix_cache_->maps_generation == maps_generation &&
+                   stack_suffix_cache_->options == frame_options;
+  }
+  bool shadow_call_stack = false;
+  bool unwound = false;
+  if (shadow_call_stack_unwinding_) {
+    shadow_call_stack = UnwindShadowCallStack(step_memory, skip_initial_maps);
+    if (!shadow_call_stack && !shadow_call_stack_fallback_) {
+      last_error_.code = ERROR_UNSUPPORTED;
+      last_error_.address = 0;
+    }
+    unwound = shadow_call_stack || !shadow_call_stack_fallback_;
+  }
+  // Only the frame added by the current iteration can still be removed, so
+  // every frame that exists at the start of an iteration is final.
+  size_t emitted_frames = 0;
+  bool callback_stopped = false;
+  for (; !unwound && frames_.size() < max_frames_;) {
+    if (frame_callback_ != nullptr && !EmitFrames(&emitted_frames)) {
+      callback_stopped = true;
+      break;
+    }
+    if (budget_.max_time_ns != 0 && !frames_.empty() &&
+        NowNs() - budget_start_ns >= budget_.max_time_ns) {
+      last_error_.code = ERROR_BUDGET_EXCEEDED;
+      last_error_.address = 0;
+      break;
+    }
     uint64_t cur_pc = regs_->pc();
     uint64_t cur_sp = regs_->sp();
+    uint64_t cur_dex_pc = regs_->dex_pc();
 
-    MapInfo* map_info = maps_->Find(regs_->pc());
+    MapInfo* map_info;
+    {
+      PhaseTimer timer(stats, &UnwindStats::find_map_ns, &UnwindStats::find_map_allocs);
+      map_info = FindMap(regs_->pc(), true);
+    }
     uint64_t pc_adjustment = 0;
     uint64_t step_pc;
     uint64_t rel_pc;
     Elf* elf;
+    bool jit_frame = false;
     if (map_info == nullptr) {
       step_pc = regs_->pc();
       rel_pc = step_pc;
       last_error_.code = ERROR_INVALID_MAP;
       elf = nullptr;
     } else {
-      if (ShouldStop(map_suffixes_to_ignore, map_info->name)) {
+      if (map_filter_.MatchesSuffix(map_info)) {
         break;
       }
-      elf = map_info->GetElf(process_memory_, arch_);
+      if ((budget_.no_new_elfs || budget_.max_elf_creations != 0) &&
+          map_info->GetElfIfCreated() == nullptr) {
+        if (budget_.no_new_elfs || elfs_created == budget_.max_elf_creations) {
+          last_error_.code = ERROR_BUDGET_EXCEEDED;
+          last_error_.address = 0;
+          break;
+        }
+        elfs_created++;
+      }
+      {
+        PhaseTimer timer(stats, &UnwindStats::get_elf_ns, &UnwindStats::get_elf_allocs);
+        if (stats != nullptr && map_info->GetElfIfCreated() == nullptr) {
+          stats->elfs_created++;
+        }
+        elf = GetElf(map_info);
+      }
       // If this elf is memory backed, and there is a valid file, then set
       // an indicator that we couldn't open the file.
       const std::string& map_name = map_info->name;
@@ -201,23 +1021,29 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
       // If the pc is in an invalid elf file, try and get an Elf object
       // using the jit debug information.
       if (!elf->valid() && jit_debug_ != nullptr && (map_info->flags & PROT_EXEC)) {
+        PhaseTimer timer(stats, &UnwindStats::jit_dex_ns, &UnwindStats::jit_dex_allocs);
         uint64_t adjusted_jit_pc = regs_->pc() - pc_adjustment;
         Elf* jit_elf = jit_debug_->Find(maps_, adjusted_jit_pc);
         if (jit_elf != nullptr) {
           // The jit debug information requires a non relative adjusted pc.
           step_pc = adjusted_jit_pc;
           elf = jit_elf;
+          jit_frame = true;
         }
       }
     }
 
     FrameData* frame = nullptr;
-    if (map_info == nullptr || initial_map_names_to_skip == nullptr ||
-        std::find(initial_map_names_to_skip->begin(), initial_map_names_to_skip->end(),
-                  basename(map_info->name.c_str())) == initial_map_names_to_skip->end()) {
+    // Jit frames depend on more than the maps, so they are never cached.
+    bool frame_cached = false;
+    bool* cached = frame_cache_ != nullptr && !jit_frame ? &frame_cached : nullptr;
+    if (map_info == nullptr || !skip_initial_maps || !map_filter_.MatchesName(map_info)) {
       if (regs_->dex_pc() != 0) {
         // Add a frame to represent the dex file.
-        FillInDexFrame();
+        {
+          PhaseTimer timer(stats, &UnwindStats::jit_dex_ns, &UnwindStats::jit_dex_allocs);
+          FillInDexFrame();
+        }
         // Clear the dex pc so that we don't repeat this frame later.
         regs_->set_dex_pc(0);
 
@@ -228,16 +1054,32 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
         }
       }
 
-      frame = FillInFrame(map_info, elf, rel_pc, pc_adjustment);
+      frame = FillInFrame(map_info, elf, rel_pc, pc_adjustment, cached);
+      if (stack_suffix_cache_ != nullptr) {
+        // Dex frames are left without a key.
+        frame_keys_.resize(frames_.size());
+        frame_keys_.back() = StackSuffixCache::Key{cur_pc, cur_sp};
+      }
+      if (stats != nullptr && cached != nullptr) {
+        if (frame_cached) {
+          stats->frame_cache_hits++;
+        } else {
+          stats->frame_cache_misses++;
+        }
+      }
 
       // Once a frame is added, stop skipping frames.
-      initial_map_names_to_skip = nullptr;
+      skip_initial_maps = false;
     }
     adjust_pc = true;
 
     bool stepped = false;
     bool in_device_map = false;
     bool finished = false;
+    bool is_signal_frame = false;
+    bool frame_pointer_step = frame_pointer_unwinding_ && at_call_site;
+    bool reached_by_call = at_call_site;
+    at_call_site = false;
     if (map_info != nullptr) {
       if (map_info->flags & MAPS_FLAGS_DEVICE_MAP) {
         // Do not stop here, fall through in case we are
@@ -245,21 +1087,37 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
         // some of the speculative frames.
         in_device_map = true;
       } else {
-        MapInfo* sp_info = maps_->Find(regs_->sp());
+        MapInfo* sp_info;
+        {
+          PhaseTimer timer(stats, &UnwindStats::find_map_ns, &UnwindStats::find_map_allocs);
+          sp_info = FindMap(regs_->sp());
+        }
         if (sp_info != nullptr && sp_info->flags & MAPS_FLAGS_DEVICE_MAP) {
           // Do not stop here, fall through in case we are
           // in the speculative unwind path and need to remove
           // some of the speculative frames.
           in_device_map = true;
         } else {
-          bool is_signal_frame = false;
-          if (elf->StepIfSignalHandler(rel_pc, regs_, process_memory_.get())) {
+          PhaseTimer timer(stats, &UnwindStats::step_ns, &UnwindStats::step_allocs);
+          // A failed step can leave some registers changed, keep a copy so
+          // that the return address fallback starts from the original ones.
+          Regs::Snapshot snapshot;
+          regs_->SaveSnapshot(&snapshot);
+          if (elf->StepIfSignalHandler(rel_pc, regs_, step_memory)) {
             stepped = true;
             is_signal_frame = true;
-          } else if (elf->Step(step_pc, regs_, process_memory_.get(), &finished,
-                               &is_signal_frame)) {
+            elf->GetLastError(&last_error_);
+          } else if (frame_pointer_step && StepFramePointer(elf, step_pc, step_memory)) {
+            stepped = true;
+            last_error_.code = ERROR_NONE;
+            last_error_.address = 0;
+          } else if (elf->Step(step_pc, regs_, step_memory, &finished, &is_signal_frame,
+                               &last_error_)) {
             stepped = true;
+          } else {
+            regs_->RestoreSnapshot(snapshot);
           }
+          at_call_site = stepped && !is_signal_frame;
           if (is_signal_frame && frame != nullptr) {
             // Need to adjust the relative pc because the signal handler
             // pc should not be adjusted.
@@ -267,23 +1125,51 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
             frame->pc += pc_adjustment;
             step_pc = rel_pc;
           }
-          elf->GetLastError(&last_error_);
         }
       }
     }
 
-    if (frame != nullptr) {
-      if (!resolve_names_ ||
-          !elf->GetFunctionName(step_pc, &frame->function_name, &frame->function_offset)) {
-        frame->function_name = "";
+    // The function of a signal frame is looked up without the pc adjustment,
+    // so a cached name does not apply, and the frame is not added.
+    if (frame != nullptr && (!frame_cached || is_signal_frame)) {
+      PhaseTimer timer(stats, &UnwindStats::function_name_ns,
+                       &UnwindStats::function_name_allocs);
+      if (!ResolveFunctionNames() ||
+          !GetFunctionName(elf, step_pc, &frame->function_name, &frame->function_offset)) {
+        frame->function_name.clear();
         frame->function_offset = 0;
       }
+      if (demangle_names_) {
+        frame->demangled_name = Demangle(frame->function_name);
+      }
+      if (cached != nullptr && !frame_cached && !is_signal_frame) {
+        AddToFrameCache(*frame, maps_generation);
+      }
     }
 
     if (finished) {
       break;
     }
 
+    // Only a frame reached by a normal step is unwound from the registers
+    // saved by its callee alone, and only a normal step of it leaves the
+    // registers of its caller.
+    if (reuse_suffix && reached_by_call && at_call_site && frame != nullptr) {
+      size_t num_frames = frames_.size();
+      if (ReuseStackSuffix(cur_pc, cur_sp, caller_sp, cur_dex_pc, &suffix_next)) {
+        if (stats != nullptr) {
+          stats->suffix_frames_reused = frames_.size() - num_frames;
+        }
+        break;
+      }
+    }
+
+    if (!stepped && budget_memory && budget_memory->exceeded()) {
+      last_error_.code = ERROR_BUDGET_EXCEEDED;
+      last_error_.address = 0;
+      break;
+    }
+
     if (!stepped) {
       if (return_address_attempt) {
         // Only remove the speculative frame if there are more than two frames
@@ -301,7 +1187,7 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
         break;
       } else {
         // Steping didn't work, try this secondary method.
-        if (!regs_->SetPcFromReturnAddress(process_memory_.get())) {
+        if (!regs_->SetPcFromReturnAddress(step_memory)) {
           break;
         }
         return_address_attempt = true;
@@ -318,54 +1204,422 @@ void Unwinder::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
       last_error_.code = ERROR_REPEATED_FRAME;
       break;
     }
+    caller_sp = cur_sp;
+  }
+  if (stack_suffix_cache_ != nullptr) {
+    StackSuffixCache* cache = stack_suffix_cache_;
+    if (callback_stopped || last_error_.code == ERROR_BUDGET_EXCEEDED || shadow_call_stack) {
+      // A cut short unwind does not end where the stack does, and the
+      // frames from a shadow call stack have no sp to match.
+      cache->Clear();
+    } else {
+      frame_keys_.resize(frames_.size());
+      cache->frames.assign(frames_.begin(), frames_.end());
+      cache->keys.swap(frame_keys_);
+      cache->last_error = last_error_;
+      cache->warnings = warnings_;
+      cache->maps_generation = maps_generation;
+      cache->options = frame_options;
+      cache->valid = true;
+    }
+  }
+  if (frame_callback_ != nullptr && !callback_stopped) {
+    EmitFrames(&emitted_frames);
+  }
+  if (bounded_stack) {
+    ResetStackMemory();
+  }
+
+  if (stats != nullptr) {
+    total_allocs.reset();
+    stats_.total_ns = NowNs() - start_ns;
+    stats_.frames = frames_.size();
+    stats_.map_cache_hits = map_cache_stats_.hits - start_map_stats.hits;
+    stats_.map_cache_misses = map_cache_stats_.misses - start_map_stats.misses;
+    MemoryCacheStats memory_cache_stats;
+    if (memory_stats && process_memory_->GetCacheStats(&memory_cache_stats)) {
+      stats_.memory_cache_hits = memory_cache_stats.hits - start_memory_stats.hits;
+      stats_.memory_cache_misses = memory_cache_stats.misses - start_memory_stats.misses;
+      stats_.memory_uncached_reads =
+          memory_cache_stats.uncached_reads - start_memory_stats.uncached_reads;
+    }
+    std::lock_guard<std::mutex> guard(g_stats_mutex);
+    g_stats.Add(stats_);
   }
 }
 
-std::string Unwinder::FormatFrame(const FrameData& frame) const {
-  std::string data;
-  if (ArchIs32Bit(arch_)) {
-    data += android::base::StringPrintf("  #%02zu pc %08" PRIx64, frame.num, frame.rel_pc);
-  } else {
-    data += android::base::StringPrintf("  #%02zu pc %016" PRIx64, frame.num, frame.rel_pc);
+bool Unwinder::SetStackBoundsFromCurrentThread() {
+  uint64_t start;
+  uint64_t end;
+  if (!GetLocalThreadStack(&start, &end)) {
+    return false;
+  }
+  stack_start_ = start;
+  stack_end_ = end;
+  stack_in_place_ = true;
+  return true;
+}
+
+bool Unwinder::UseStackBounds() {
+  if (stack_end_ == 0 || regs_ == nullptr || process_memory_ == nullptr) {
+    return false;
+  }
+  uint64_t sp = regs_->sp();
+  if (sp < stack_start_ || sp >= stack_end_) {
+    return false;
+  }
+  if (stack_in_place_) {
+    // The frames of the unwinder are all below the captured sp.
+    if (stack_overlay_ == nullptr) {
+      stack_overlay_ = std::make_shared<MemoryStackOverlay>();
+    }
+    stack_overlay_->Set(reinterpret_cast<const uint8_t*>(static_cast<uintptr_t>(sp)), sp,
+                        stack_end_ - sp, process_memory_);
+    stack_memory_ = stack_overlay_.get();
+    return true;
+  }
+  if (stack_snapshot_ == nullptr) {
+    stack_snapshot_ = std::make_shared<MemoryStackSnapshot>();
+  }
+  uint64_t size = std::min<uint64_t>(stack_end_ - sp, kMaxStackCopySize);
+  if (stack_snapshot_->Take(process_memory_.get(), sp, size) == 0) {
+    return false;
+  }
+  stack_memory_ = stack_snapshot_.get();
+  return true;
+}
+
+void Unwinder::ResetStackMemory() {
+  stack_memory_ = nullptr;
+  if (stack_snapshot_ != nullptr) {
+    stack_snapshot_->Reset();
+  }
+  if (stack_overlay_ != nullptr) {
+    stack_overlay_->Reset();
+  }
+}
+
+bool Unwinder::EmitFrames(size_t* emitted) {
+  for (; *emitted < frames_.size(); (*emitted)++) {
+    if (!(*frame_callback_)(frames_[*emitted])) {
+      (*emitted)++;
+      return false;
+    }
+  }
+  return true;
+}
+
+void Unwinder::UnwindWithCallback(const FrameCallback& callback,
+                                  const std::vector<std::string>* initial_map_names_to_skip,
+                                  const std::vector<std::string>* map_suffixes_to_ignore) {
+  frame_callback_ = &callback;
+  Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+  frame_callback_ = nullptr;
+}
+
+std::vector<UnwindBatchResult> Unwinder::UnwindBatch(
+    const std::vector<UnwindSample>& samples,
+    const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  std::vector<UnwindBatchResult> results(samples.size());
+  if (samples.empty()) {
+    return results;
+  }
+
+  Regs* saved_regs = regs_;
+  ArchEnum saved_arch = arch_;
+  std::shared_ptr<Memory> saved_process_memory = process_memory_;
+  if (process_memory_ != nullptr) {
+    process_memory_->SetMaps(maps_);
+    process_memory_->ClearWritable();
+  }
+
+  BatchCache batch_cache;
+  batch_cache.elf_memory = saved_process_memory;
+  batch_cache_ = &batch_cache;
+  for (size_t i = 0; i < samples.size(); i++) {
+    const UnwindSample& sample = samples[i];
+    CHECK(sample.regs != nullptr);
+    SetRegs(sample.regs);
+    process_memory_ =
+        sample.process_memory != nullptr ? sample.process_memory : saved_process_memory;
+    // Read the stack of the next sample while this one is unwound.
+    if (i + 1 < samples.size()) {
+      const UnwindSample& next = samples[i + 1];
+      Memory* next_memory =
+          next.process_memory != nullptr ? next.process_memory.get() : saved_process_memory.get();
+      if (next.regs != nullptr && next_memory != nullptr) {
+        next_memory->Prefetch(next.regs->sp(), kStackPrefetchSize);
+      }
+    }
+
+    Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+
+    UnwindBatchResult& result = results[i];
+    result.frames = ConsumeFrames();
+    result.last_error = last_error_;
+    result.warnings = warnings_;
+  }
+  batch_cache_ = nullptr;
+
+  regs_ = saved_regs;
+  arch_ = saved_arch;
+  process_memory_ = saved_process_memory;
+  return results;
+}
+
+size_t Unwinder::UnwindCapture(std::vector<CapturedFrame>* captured,
+                               const std::vector<std::string>* initial_map_names_to_skip,
+                               const std::vector<std::string>* map_suffixes_to_ignore) {
+  // Only the map of every frame is kept.
+  uint8_t frame_fields = frame_fields_;
+  frame_fields_ = FRAME_FIELD_MAP_RANGE;
+  Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+  frame_fields_ = frame_fields;
+
+  captured->reserve(captured->size() + frames_.size());
+  for (const FrameData& frame : frames_) {
+    CapturedFrame& entry = captured->emplace_back();
+    entry.pc = frame.pc;
+    entry.rel_pc = frame.rel_pc;
+    entry.num = frame.num;
+    // The maps of all of the frames were just found, so these lookups are
+    // answered by the recently matched maps.
+    entry.map_info = frame.map_end != 0 ? FindMap(frame.map_start) : nullptr;
+  }
+  return frames_.size();
+}
+
+std::vector<FrameData> Unwinder::Symbolize(const std::vector<CapturedFrame>& captured) {
+  std::vector<FrameData> frames(captured.size());
+  struct Lookup {
+    Elf* elf;
+    uint64_t addr;
+    size_t index;
+  };
+  std::vector<Lookup> lookups;
+  for (size_t i = 0; i < captured.size(); i++) {
+    const CapturedFrame& entry = captured[i];
+    FrameData* frame = &frames[i];
+    frame->num = entry.num;
+    frame->pc = entry.pc;
+    frame->rel_pc = entry.rel_pc;
+    if (entry.map_info == nullptr) {
+      continue;
+    }
+    Elf* elf = GetElf(entry.map_info);
+    // This is the same pc the unwind used to look up the function name.
+    uint64_t addr = entry.rel_pc;
+    if (!elf->valid() && jit_debug_ != nullptr && (entry.map_info->flags & PROT_EXEC)) {
+      Elf* jit_elf = jit_debug_->Find(maps_, entry.pc);
+      if (jit_elf != nullptr) {
+        elf = jit_elf;
+        addr = entry.pc;
+      }
+    }
+    FillInMapFields(frame, entry.map_info, elf);
+    if (ResolveFunctionNames() && elf->valid()) {
+      lookups.push_back(Lookup{elf, addr, i});
+    }
+  }
+
+  // Resolve the names one elf at a time, in address order, looking up
+  // each distinct address once.
+  std::sort(lookups.begin(), lookups.end(), [](const Lookup& a, const Lookup& b) {
+    return a.elf != b.elf ? a.elf < b.elf : a.addr < b.addr;
+  });
+  std::vector<uint64_t> addrs;
+  std::vector<SharedString> names;
+  std::vector<uint64_t> offsets;
+  std::unique_ptr<bool[]> found;
+  for (size_t start = 0; start < lookups.size();) {
+    Elf* elf = lookups[start].elf;
+    size_t end = start;
+    addrs.clear();
+    for (; end < lookups.size() && lookups[end].elf == elf; end++) {
+      if (addrs.empty() || addrs.back() != lookups[end].addr) {
+        addrs.push_back(lookups[end].addr);
+      }
+    }
+    names.assign(addrs.size(), SharedString());
+    offsets.assign(addrs.size(), 0);
+    found.reset(new bool[addrs.size()]());
+    elf->GetFunctionNames(addrs.data(), addrs.size(), names.data(), offsets.data(), found.get());
+
+    for (size_t i = start, name_index = 0; i < end; i++) {
+      if (addrs[name_index] != lookups[i].addr) {
+        name_index++;
+      }
+      if (found[name_index]) {
+        FrameData* frame = &frames[lookups[i].index];
+        frame->function_name = names[name_index];
+        frame->function_offset = offsets[name_index];
+        if (demangle_names_) {
+          frame->demangled_name = Demangle(frame->function_name);
+        }
+      }
+    }
+    start = end;
+  }
+  return frames;
+}
+
+namespace {
+
+// Appends to a fixed buffer, counting the full length even when the buffer
+// is too small, like snprintf.
+class FrameWriter {
+ public:
+  FrameWriter(char* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+  void Append(char c) {
+    if (length_ + 1 < size_) {
+      buffer_[length_] = c;
+    }
+    length_++;
+  }
+
+  void Append(std::string_view str) {
+    if (length_ + 1 < size_) {
+      size_t copy = std::min(str.size(), size_ - length_ - 1);
+      memcpy(&buffer_[length_], str.data(), copy);
+    }
+    length_ += str.size();
   }
 
+  void AppendHex(uint64_t value, size_t min_digits) {
+    char digits[16];
+    size_t count = 0;
+    do {
+      digits[count++] = "0123456789abcdef"[value & 0xf];
+      value >>= 4;
+    } while (value != 0);
+    for (; count < min_digits; min_digits--) {
+      Append('0');
+    }
+    while (count > 0) {
+      Append(digits[--count]);
+    }
+  }
+
+  void AppendDecimal(int64_t value) {
+    uint64_t magnitude = value;
+    if (value < 0) {
+      Append('-');
+      magnitude = -magnitude;
+    }
+    char digits[20];
+    size_t count = 0;
+    do {
+      digits[count++] = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude != 0);
+    while (count > 0) {
+      Append(digits[--count]);
+    }
+  }
+
+  size_t Finish() {
+    if (size_ != 0) {
+      buffer_[std::min(length_, size_ - 1)] = '\0';
+    }
+    return length_;
+  }
+
+ private:
+  char* buffer_;
+  size_t size_;
+  size_t length_ = 0;
+};
+
+}  // namespace
+
+size_t Unwinder::FormatFrame(const FrameData& frame, char* buffer, size_t size) const {
+  FrameWriter writer(buffer, size);
+  writer.Append("  #");
+  if (frame.num < 10) {
+    writer.Append('0');
+  }
+  writer.AppendDecimal(frame.num);
+  writer.Append(" pc ");
+  writer.AppendHex(frame.rel_pc, ArchIs32Bit(arch_) ? 8 : 16);
+
   if (frame.map_start == frame.map_end) {
     // No valid map associated with this frame.
-    data += "  <unknown>";
+    writer.Append("  <unknown>");
   } else if (!frame.map_name.empty()) {
-    data += "  ";
-    data += frame.map_name;
+    writer.Append("  ");
+    writer.Append(frame.map_name);
   } else {
-    data += android::base::StringPrintf("  <anonymous:%" PRIx64 ">", frame.map_start);
+    writer.Append("  <anonymous:");
+    writer.AppendHex(frame.map_start, 0);
+    writer.Append('>');
   }
 
   if (frame.map_elf_start_offset != 0) {
-    data += android::base::StringPrintf(" (offset 0x%" PRIx64 ")", frame.map_elf_start_offset);
+    writer.Append(" (offset 0x");
+    writer.AppendHex(frame.map_elf_start_offset, 0);
+    writer.Append(')');
   }
 
   if (!frame.function_name.empty()) {
-    char* demangled_name = __cxa_demangle(frame.function_name.c_str(), nullptr, nullptr, nullptr);
-    if (demangled_name == nullptr) {
-      data += " (";
-      data += frame.function_name;
+    writer.Append(" (");
+    // Demangling takes locks and allocates, so only names demangled before
+    // are used here.
+    if (!frame.demangled_name.empty()) {
+      writer.Append(frame.demangled_name);
     } else {
-      data += " (";
-      data += demangled_name;
-      free(demangled_name);
+      writer.Append(frame.function_name);
     }
     if (frame.function_offset != 0) {
-      data += android::base::StringPrintf("+%" PRId64, frame.function_offset);
+      writer.Append('+');
+      writer.AppendDecimal(frame.function_offset);
+    }
+    writer.Append(')');
+  }
+
+  MapInfo* map_info = display_build_id_ ? maps_->Find(frame.map_start) : nullptr;
+  // Only a build id already read from the elf is used, reading it might
+  // allocate.
+  SharedString* build_id =
+      map_info != nullptr ? map_info->build_id.load(std::memory_order_acquire) : nullptr;
+  if (build_id != nullptr) {
+    std::string_view build_id_data(*build_id);
+    if (!build_id_data.empty()) {
+      writer.Append(" (BuildId: ");
+      for (char c : build_id_data) {
+        writer.AppendHex(static_cast<uint8_t>(c), 2);
+      }
+      writer.Append(')');
     }
-    data += ')';
   }
+  return writer.Finish();
+}
 
-  MapInfo* map_info = maps_->Find(frame.map_start);
-  if (map_info != nullptr && display_build_id_) {
-    std::string build_id = map_info->GetPrintableBuildID();
-    if (!build_id.empty()) {
-      data += " (BuildId: " + build_id + ')';
+std::string Unwinder::FormatFrame(const FrameData& frame) const {
+  // Do the work the buffer version skips, demangling and reading the
+  // build id.
+  const FrameData* format_frame = &frame;
+  FrameData demangled_frame;
+  if (frame.demangled_name.empty() && !frame.function_name.empty()) {
+    demangled_frame = frame;
+    demangled_frame.demangled_name = Demangle(frame.function_name);
+    format_frame = &demangled_frame;
+  }
+  if (display_build_id_) {
+    MapInfo* map_info = maps_->Find(frame.map_start);
+    if (map_info != nullptr) {
+      map_info->GetBuildID();
     }
   }
+
+  char buffer[256];
+  size_t length = FormatFrame(*format_frame, buffer, sizeof(buffer));
+  if (length < sizeof(buffer)) {
+    return std::string(buffer, length);
+  }
+  std::string data(length, '\0');
+  FormatFrame(*format_frame, &data[0], length + 1);
   return data;
 }
 
@@ -384,6 +1638,12 @@ void Unwinder::SetDexFiles(DexFiles* dex_files) {
   dex_files_ = dex_files;
 }
 
+UnwinderFromPid::~UnwinderFromPid() {
+  if (jit_init_thread_.joinable()) {
+    jit_init_thread_.join();
+  }
+}
+
 bool UnwinderFromPid::Init() {
   CHECK(arch_ != ARCH_UNKNOWN);
   if (initted_) {
@@ -392,11 +1652,8 @@ bool UnwinderFromPid::Init() {
   initted_ = true;
 
   if (maps_ == nullptr) {
-    if (pid_ == getpid()) {
-      maps_ptr_.reset(new LocalMaps());
-    } else {
-      maps_ptr_.reset(new RemoteMaps(pid_));
-    }
+    // The same as LocalMaps for the own pid, but can be updated by Refresh.
+    maps_ptr_.reset(new RemoteUpdatableMaps(pid_));
     if (!maps_ptr_->Parse()) {
       ClearErrors();
       last_error_.code = ERROR_INVALID_MAP;
@@ -415,24 +1672,112 @@ bool UnwinderFromPid::Init() {
     process_memory_ = Memory::CreateProcessMemoryCached(pid_);
   }
 
-  jit_debug_ptr_ = CreateJitDebug(arch_, process_memory_);
-  jit_debug_ = jit_debug_ptr_.get();
-  SetJitDebug(jit_debug_);
+  // Keep the objects set before Init, so that several unwinders of the same
+  // process can share them instead of each reading all of the entries.
+  if (jit_debug_ == nullptr) {
+    jit_debug_ptr_ = CreateJitDebug(arch_, process_memory_);
+    SetJitDebug(jit_debug_ptr_.get());
+  }
 #if defined(DEXFILE_SUPPORT)
-  dex_files_ptr_ = CreateDexFiles(arch_, process_memory_);
-  dex_files_ = dex_files_ptr_.get();
-  SetDexFiles(dex_files_);
+  if (dex_files_ == nullptr) {
+    dex_files_ptr_ = CreateDexFiles(arch_, process_memory_);
+    SetDexFiles(dex_files_ptr_.get());
+  }
 #endif
 
+  if (jit_init_in_background_ && (jit_debug_ptr_ != nullptr || dex_files_ptr_ != nullptr)) {
+    // The lookups lock the objects, so an unwind that gets to a jit or dex
+    // frame first waits for the thread, and the others do not.
+    jit_init_thread_ = std::thread(
+        [maps = maps_, jit_debug = jit_debug_ptr_.get(), dex_files = dex_files_ptr_.get()]() {
+          if (jit_debug != nullptr) {
+            jit_debug->Update(maps);
+          }
+          if (dex_files != nullptr) {
+            dex_files->Update(maps);
+          }
+        });
+  }
+
+  return true;
+}
+
+bool UnwinderFromPid::Refresh() {
+  if (!initted_) {
+    return Init();
+  }
+  if (maps_ptr_ == nullptr || maps_ != maps_ptr_.get()) {
+    return true;
+  }
+  // The thread iterates over the maps.
+  if (jit_init_thread_.joinable()) {
+    jit_init_thread_.join();
+  }
+  bool changed;
+  if (!maps_ptr_->Update(&changed)) {
+    ClearErrors();
+    last_error_.code = ERROR_INVALID_MAP;
+    return false;
+  }
+  if (changed) {
+    // Cached pages might belong to maps that went away.
+    ClearRecentMaps();
+    process_memory_->Clear();
+  }
   return true;
 }
 
+bool UnwinderFromPid::MapsChanged() {
+  return maps_ptr_ != nullptr && maps_ == maps_ptr_.get() && maps_ptr_->Changed();
+}
+
 void UnwinderFromPid::Unwind(const std::vector<std::string>* initial_map_names_to_skip,
                              const std::vector<std::string>* map_suffixes_to_ignore) {
   if (!Init()) {
     return;
   }
+  if (stack_snapshot_size_ == 0 || regs_ == nullptr) {
+    Unwinder::Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+    return;
+  }
+
+  // The snapshot must not see data cached by a previous unwind.
+  if (batch_cache_ == nullptr) {
+    process_memory_->SetMaps(maps_);
+    process_memory_->ClearWritable();
+  }
+  ClearRecentMaps();
+  uint64_t sp = regs_->sp();
+  MapInfo* map_info = FindMap(sp);
+  if (map_info != nullptr) {
+    uint64_t size = std::min<uint64_t>(stack_snapshot_size_, map_info->end - sp);
+    if (stack_snapshot_ == nullptr) {
+      stack_snapshot_ = std::make_shared<MemoryStackSnapshot>();
+    }
+    if (stack_snapshot_->Take(process_memory_.get(), sp, size) != 0) {
+      stack_memory_ = stack_snapshot_.get();
+    }
+  }
   Unwinder::Unwind(initial_map_names_to_skip, map_suffixes_to_ignore);
+  if (stack_memory_ != nullptr) {
+    ResetStackMemory();
+  }
+}
+
+std::vector<UnwindBatchResult> UnwinderFromPid::UnwindBatch(
+    const std::vector<UnwindSample>& samples,
+    const std::vector<std::string>* initial_map_names_to_skip,
+    const std::vector<std::string>* map_suffixes_to_ignore) {
+  // Init before the batch starts so the process memory it creates is the
+  // default memory for the samples.
+  if (!Init()) {
+    std::vector<UnwindBatchResult> results(samples.size());
+    for (auto& result : results) {
+      result.last_error = last_error_;
+    }
+    return results;
+  }
+  return Unwinder::UnwindBatch(samples, initial_map_names_to_skip, map_suffixes_to_ignore);
 }
 
 FrameData Unwinder::BuildFrameFromPcOnly(uint64_t pc, ArchEnum arch, Maps* maps,
@@ -441,7 +1786,7 @@ FrameData Unwinder::BuildFrameFromPcOnly(uint64_t pc, ArchEnum arch, Maps* maps,
                                          bool resolve_names) {
   FrameData frame;
 
-  MapInfo* map_info = maps->Find(pc);
+  MapInfo* map_info = maps->FindPc(pc);
   if (map_info == nullptr || arch == ARCH_UNKNOWN) {
     frame.pc = pc;
     frame.rel_pc = pc;
@@ -480,7 +1825,7 @@ FrameData Unwinder::BuildFrameFromPcOnly(uint64_t pc, ArchEnum arch, Maps* maps,
 
   if (!resolve_names ||
       !elf->GetFunctionName(debug_pc, &frame.function_name, &frame.function_offset)) {
-    frame.function_name = "";
+    frame.function_name.clear();
     frame.function_offset = 0;
   }
   return frame;
@@ -490,4 +1835,37 @@ FrameData Unwinder::BuildFrameFromPcOnly(uint64_t pc) {
   return BuildFrameFromPcOnly(pc, arch_, maps_, jit_debug_, process_memory_, resolve_names_);
 }
 
+size_t Unwinder::Preload(Maps* maps, ArchEnum arch, std::shared_ptr<Memory> process_memory,
+                         bool symbols, const std::function<bool(MapInfo*)>& filter) {
+  size_t preloaded = 0;
+  for (const auto& map_info : *maps) {
+    // Only maps of files, the other executable maps are either not elf
+    // files or are unwound from memory every time.
+    if (!(map_info->flags & PROT_EXEC) || (map_info->flags & MAPS_FLAGS_DEVICE_MAP) ||
+        map_info->name.c_str()[0] != '/') {
+      continue;
+    }
+    if (filter != nullptr && !filter(map_info.get())) {
+      continue;
+    }
+    Elf* elf = map_info->GetElf(process_memory, arch);
+    if (elf->valid()) {
+      elf->Preload(symbols);
+      preloaded++;
+    }
+  }
+  return preloaded;
+}
+
+size_t Unwinder::Preload(bool symbols, const std::function<bool(MapInfo*)>& filter) {
+  return Preload(maps_, arch_, process_memory_, symbols, filter);
+}
+
+std::thread Unwinder::PreloadInBackground(bool symbols, std::function<bool(MapInfo*)> filter) {
+  return std::thread([maps = maps_, arch = arch_, process_memory = process_memory_, symbols,
+                      filter = std::move(filter)]() {
+    Preload(maps, arch, process_memory, symbols, filter);
+  });
+}
+
 }  // namespace unwindstack
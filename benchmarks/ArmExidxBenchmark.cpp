@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/RegsArm.h>
+
+#include "ArmExidx.h"
+#include "MemoryBuffer.h"
+
+constexpr uint32_t kCompactEntry = 0x100;
+constexpr uint32_t kExtabEntry = 0x108;
+constexpr uint32_t kExtab = 0x200;
+constexpr uint32_t kSp = 0x1000;
+
+static void Write32(unwindstack::MemoryBuffer* memory, uint64_t addr, uint32_t value) {
+  memcpy(memory->GetPtr(addr), &value, sizeof(value));
+}
+
+static void ArmExidxEval(benchmark::State& state, uint32_t entry_offset) {
+  unwindstack::MemoryBuffer elf_memory;
+  elf_memory.Resize(0x1000);
+  memset(elf_memory.GetPtr(0), 0, 0x1000);
+  // The compact entry pops r4 and lr.
+  Write32(&elf_memory, kCompactEntry + 4, 0x80a8b0b0);
+  // The extab entry of personality routine 1 adds 256 and 4 to the vsp,
+  // then pops r4-r11 and lr.
+  Write32(&elf_memory, kExtabEntry + 4, kExtab - (kExtabEntry + 4));
+  Write32(&elf_memory, kExtab, 0x81013f00);
+  Write32(&elf_memory, kExtab + 4, 0x84ffb0b0);
+
+  unwindstack::MemoryBuffer process_memory;
+  process_memory.Resize(0x2000);
+  for (size_t i = 0; i < 0x2000; i += 4) {
+    Write32(&process_memory, i, 0x10000 + i);
+  }
+
+  unwindstack::RegsArm regs;
+  for (auto _ : state) {
+    regs.set_sp(kSp);
+    unwindstack::ArmExidx arm(&regs, &elf_memory, &process_memory);
+    arm.set_cfa(kSp);
+    if (!arm.ExtractEntryData(entry_offset) || !arm.Eval()) {
+      state.SkipWithError("Failed to evaluate the entry.");
+      break;
+    }
+  }
+}
+
+static void BM_arm_exidx_eval_compact(benchmark::State& state) {
+  ArmExidxEval(state, kCompactEntry);
+}
+BENCHMARK(BM_arm_exidx_eval_compact);
+
+static void BM_arm_exidx_eval_extab(benchmark::State& state) {
+  ArmExidxEval(state, kExtabEntry);
+}
+BENCHMARK(BM_arm_exidx_eval_extab);
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfMemory.h>
+#include <unwindstack/DwarfStructs.h>
+#include <unwindstack/Elf.h>
+
+#include "DwarfCfa.h"
+#include "DwarfEhFrameWithHdr.h"
+#include "Utils.h"
+
+static bool InitSection(const EhFrameFixture& fixture,
+                        unwindstack::DwarfEhFrameWithHdr<uint64_t>* section) {
+  return section->EhFrameInit(fixture.eh_frame_offset, fixture.eh_frame_size, 0) &&
+         section->Init(fixture.eh_frame_hdr_offset, fixture.eh_frame_hdr_size, 0);
+}
+
+static void BM_dwarf_eh_frame_hdr_get_fde(benchmark::State& state) {
+  EhFrameFixture fixture;
+  CreateEhFrameFixture(state.range(0), 4, &fixture);
+  unwindstack::DwarfEhFrameWithHdr<uint64_t> section(fixture.memory.get());
+  if (!InitSection(fixture, &section)) {
+    state.SkipWithError("Failed to init the eh_frame_hdr section.");
+    return;
+  }
+
+  size_t index = 0;
+  for (auto _ : state) {
+    if (section.GetFdeFromPc(fixture.pcs[index]) == nullptr) {
+      state.SkipWithError("Failed to find an fde.");
+      break;
+    }
+    index = (index + 1) % fixture.pcs.size();
+  }
+}
+BENCHMARK(BM_dwarf_eh_frame_hdr_get_fde)->Arg(100)->Arg(100000);
+
+// Evaluates the instructions of an fde up to its last row.
+static void BM_dwarf_cfa_get_location_info(benchmark::State& state) {
+  EhFrameFixture fixture;
+  CreateEhFrameFixture(1, state.range(0), &fixture);
+  unwindstack::DwarfEhFrameWithHdr<uint64_t> section(fixture.memory.get());
+  if (!InitSection(fixture, &section)) {
+    state.SkipWithError("Failed to init the eh_frame_hdr section.");
+    return;
+  }
+  const unwindstack::DwarfFde* fde = section.GetFdeFromPc(fixture.pcs[0]);
+  if (fde == nullptr) {
+    state.SkipWithError("Failed to find the fde.");
+    return;
+  }
+
+  unwindstack::DwarfMemory memory(fixture.memory.get());
+  unwindstack::DwarfCfa<uint64_t> cfa(&memory, fde, unwindstack::ARCH_X86_64);
+  unwindstack::DwarfLocations cie_loc_regs;
+  if (!cfa.GetLocationInfo(fde->pc_start, fde->cie->cfa_instructions_offset,
+                           fde->cie->cfa_instructions_end, &cie_loc_regs)) {
+    state.SkipWithError("Failed to evaluate the cie.");
+    return;
+  }
+  cfa.set_cie_loc_regs(&cie_loc_regs);
+
+  for (auto _ : state) {
+    unwindstack::DwarfLocations loc_regs;
+    if (!cfa.GetLocationInfo(fde->pc_end - 1, fde->cfa_instructions_offset,
+                             fde->cfa_instructions_end, &loc_regs)) {
+      state.SkipWithError("Failed to evaluate the fde.");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_dwarf_cfa_get_location_info)->Arg(4)->Arg(64);
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Maps.h>
+
+#include "Utils.h"
+
+static void BM_maps_parse(benchmark::State& state) {
+  std::vector<uint64_t> addrs;
+  std::string text = CreateMapsFixture(state.range(0), &addrs);
+  for (auto _ : state) {
+    unwindstack::BufferMaps maps(text.c_str());
+    if (!maps.Parse()) {
+      state.SkipWithError("Failed to parse the maps.");
+      break;
+    }
+  }
+}
+BENCHMARK(BM_maps_parse)->Arg(100)->Arg(5000);
+
+static void BM_maps_find(benchmark::State& state) {
+  std::vector<uint64_t> addrs;
+  std::string text = CreateMapsFixture(state.range(0), &addrs);
+  unwindstack::BufferMaps maps(text.c_str());
+  if (!maps.Parse()) {
+    state.SkipWithError("Failed to parse the maps.");
+    return;
+  }
+
+  size_t index = 0;
+  for (auto _ : state) {
+    if (maps.Find(addrs[index]) == nullptr) {
+      state.SkipWithError("Failed to find a map.");
+      break;
+    }
+    index = (index + 1) % addrs.size();
+  }
+}
+BENCHMARK(BM_maps_find)->Arg(100)->Arg(5000);
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Memory.h>
+
+#include "MemoryBuffer.h"
+#include "MemoryCache.h"
+#include "MemoryCompressed.h"
+#include "Utils.h"
+
+constexpr size_t kCachePages = 64;
+
+static unwindstack::MemoryBuffer* CreateCacheBacking() {
+  unwindstack::MemoryBuffer* memory = new unwindstack::MemoryBuffer;
+  memory->Resize(kCachePages * 4096);
+  memset(memory->GetPtr(0), 0x5a, kCachePages * 4096);
+  return memory;
+}
+
+// Reads eight bytes from pages that are all cached.
+static void BM_memory_cache_hit(benchmark::State& state) {
+  unwindstack::MemoryCache cache(CreateCacheBacking());
+  for (size_t page = 0; page < kCachePages; page++) {
+    uint64_t value;
+    cache.ReadFully(page * 4096, &value, sizeof(value));
+  }
+
+  uint64_t addr = 0;
+  for (auto _ : state) {
+    uint64_t value;
+    if (!cache.ReadFully(addr, &value, sizeof(value))) {
+      state.SkipWithError("Failed to read cached memory.");
+      break;
+    }
+    addr = (addr + 4096 + 8) % (kCachePages * 4096 - 8);
+  }
+}
+BENCHMARK(BM_memory_cache_hit);
+
+// Reads eight bytes from pages that were evicted, since the cache only
+// keeps a few of the pages read in turn.
+static void BM_memory_cache_miss(benchmark::State& state) {
+  unwindstack::MemoryCacheConfig config;
+  config.max_pages = 4;
+  config.prefetch_pages = 0;
+  unwindstack::MemoryCache cache(CreateCacheBacking(), config);
+
+  uint64_t addr = 0;
+  for (auto _ : state) {
+    uint64_t value;
+    if (!cache.ReadFully(addr, &value, sizeof(value))) {
+      state.SkipWithError("Failed to read cached memory.");
+      break;
+    }
+    addr = (addr + 4096 + 8) % (kCachePages * 4096 - 8);
+  }
+}
+BENCHMARK(BM_memory_cache_miss);
+
+// Decompresses all of a section of state.range(0) bytes, reading it in
+// page sized pieces.
+static void BM_memory_compressed_decompress(benchmark::State& state) {
+  const size_t size = state.range(0);
+  std::vector<uint8_t> data(size);
+  std::mt19937 rng(kFixtureSeed);
+  // Mostly runs of the same byte, with some noise, so it compresses about
+  // as well as the debug sections of a library.
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i % 97 < 60) ? static_cast<uint8_t>(i / 1000) : static_cast<uint8_t>(rng());
+  }
+  uLongf compressed_size = compressBound(size);
+  std::vector<uint8_t> compressed(compressed_size);
+  if (compress(compressed.data(), &compressed_size, data.data(), size) != Z_OK) {
+    state.SkipWithError("Failed to compress the data.");
+    return;
+  }
+  unwindstack::MemoryBuffer compressed_memory;
+  compressed_memory.Resize(compressed_size);
+  memcpy(compressed_memory.GetPtr(0), compressed.data(), compressed_size);
+
+  std::vector<uint8_t> buffer(4096);
+  for (auto _ : state) {
+    unwindstack::MemoryCompressed memory(&compressed_memory, 0, compressed_size, size);
+    if (!memory.Init()) {
+      state.SkipWithError("Failed to init the compressed memory.");
+      break;
+    }
+    for (uint64_t addr = 0; addr < size; addr += buffer.size()) {
+      memory.Read(addr, buffer.data(), buffer.size());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_memory_compressed_decompress)->Arg(1 << 20)->Arg(16 << 20);
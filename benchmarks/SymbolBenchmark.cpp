@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <elf.h>
+#include <stdint.h>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/SharedString.h>
+
+#include "Symbols.h"
+#include "Utils.h"
+
+// Looks up a single name in a new object, which has to scan the table.
+static void BM_symbols_get_name_cold(benchmark::State& state) {
+  SymbolFixture fixture;
+  CreateSymbolFixture(state.range(0), &fixture);
+
+  size_t index = 0;
+  for (auto _ : state) {
+    unwindstack::Symbols symbols(fixture.symtab_offset, fixture.symtab_size, sizeof(Elf64_Sym),
+                                 fixture.strtab_offset, fixture.strtab_size);
+    unwindstack::SharedString name;
+    uint64_t func_offset;
+    if (!symbols.GetName<Elf64_Sym>(fixture.addrs[index], fixture.memory.get(), &name,
+                                    &func_offset)) {
+      state.SkipWithError("Failed to find a symbol.");
+      break;
+    }
+    index = (index + 1) % fixture.addrs.size();
+  }
+}
+BENCHMARK(BM_symbols_get_name_cold)->Arg(1000)->Arg(100000);
+
+// Looks up names once every symbol has been seen.
+static void BM_symbols_get_name_warm(benchmark::State& state) {
+  SymbolFixture fixture;
+  CreateSymbolFixture(state.range(0), &fixture);
+  unwindstack::Symbols symbols(fixture.symtab_offset, fixture.symtab_size, sizeof(Elf64_Sym),
+                               fixture.strtab_offset, fixture.strtab_size);
+  unwindstack::SharedString name;
+  uint64_t func_offset;
+  for (uint64_t addr : fixture.addrs) {
+    symbols.GetName<Elf64_Sym>(addr, fixture.memory.get(), &name, &func_offset);
+  }
+
+  size_t index = 0;
+  for (auto _ : state) {
+    if (!symbols.GetName<Elf64_Sym>(fixture.addrs[index], fixture.memory.get(), &name,
+                                    &func_offset)) {
+      state.SkipWithError("Failed to find a symbol.");
+      break;
+    }
+    index = (index + 1) % fixture.addrs.size();
+  }
+}
+BENCHMARK(BM_symbols_get_name_warm)->Arg(1000)->Arg(100000);
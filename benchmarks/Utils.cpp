@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+
+#include "Utils.h"
+
+using unwindstack::MemoryBuffer;
+
+static void CopyToMemory(const std::vector<uint8_t>& data, std::unique_ptr<MemoryBuffer>* memory) {
+  memory->reset(new MemoryBuffer);
+  (*memory)->Resize(data.size());
+  memcpy((*memory)->GetPtr(0), data.data(), data.size());
+}
+
+static void Append32(std::vector<uint8_t>* data, uint32_t value) {
+  data->insert(data->end(), reinterpret_cast<uint8_t*>(&value),
+               reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+
+static void Write32(std::vector<uint8_t>* data, size_t offset, uint32_t value) {
+  memcpy(&(*data)[offset], &value, sizeof(value));
+}
+
+void CreateSymbolFixture(size_t count, SymbolFixture* fixture) {
+  constexpr uint64_t kSymbolBase = 0x10000;
+  constexpr uint64_t kSymbolSize = 0x40;
+  std::mt19937 rng(kFixtureSeed);
+
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; i++) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+
+  std::vector<uint8_t> strtab(1, '\0');
+  std::vector<Elf64_Sym> symtab(count);
+  for (size_t i = 0; i < count; i++) {
+    Elf64_Sym& sym = symtab[i];
+    memset(&sym, 0, sizeof(sym));
+    sym.st_name = strtab.size();
+    sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+    sym.st_shndx = 1;
+    sym.st_value = kSymbolBase + order[i] * kSymbolSize;
+    sym.st_size = kSymbolSize;
+    std::string name = "fn_" + std::to_string(order[i]);
+    strtab.insert(strtab.end(), name.c_str(), name.c_str() + name.size() + 1);
+  }
+
+  std::vector<uint8_t> data(reinterpret_cast<uint8_t*>(symtab.data()),
+                            reinterpret_cast<uint8_t*>(symtab.data() + count));
+  fixture->symtab_offset = 0;
+  fixture->symtab_size = data.size();
+  fixture->strtab_offset = data.size();
+  fixture->strtab_size = strtab.size();
+  data.insert(data.end(), strtab.begin(), strtab.end());
+  CopyToMemory(data, &fixture->memory);
+
+  fixture->addrs.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    fixture->addrs[i] = kSymbolBase + order[i] * kSymbolSize + rng() % kSymbolSize;
+  }
+}
+
+void CreateEhFrameFixture(size_t count, size_t rows_per_fde, EhFrameFixture* fixture) {
+  constexpr uint64_t kEhFrameOffset = 0x1000;
+  constexpr uint64_t kPcBase = 0x10000000;
+  // Every row after the first advances the pc by four bytes.
+  const uint64_t pc_range = 4 * rows_per_fde;
+  std::mt19937 rng(kFixtureSeed);
+
+  std::vector<uint8_t> data(kEhFrameOffset);
+
+  // The cie: version 1, augmentation "zR", code alignment 1, data
+  // alignment -8, return address register 16, pc relative sdata4 pointers.
+  // The initial rules are DW_CFA_def_cfa rsp+8 and DW_CFA_offset rip cfa-8.
+  const uint64_t cie_offset = data.size();
+  static const uint8_t kCie[] = {0, 0, 0, 0, 1,    'z',  'R',  0,    1,    0x78, 0x10,
+                                 1, 0x1b, 0x0c, 0x07, 0x08, 0x90, 0x01, 0,    0};
+  Append32(&data, sizeof(kCie));
+  data.insert(data.end(), kCie, kCie + sizeof(kCie));
+
+  std::vector<uint64_t> fde_offsets(count);
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t pc_start = kPcBase + i * pc_range;
+    const uint64_t offset = data.size();
+    fde_offsets[i] = offset;
+    Append32(&data, 0);
+    Append32(&data, offset + 4 - cie_offset);
+    Append32(&data, pc_start - (offset + 8));
+    Append32(&data, pc_range);
+    // No augmentation data.
+    data.push_back(0);
+    // Each row advances the pc and moves the cfa, as a function pushing
+    // and popping registers would.
+    for (size_t row = 1; row < rows_per_fde; row++) {
+      data.push_back(0x44);
+      data.push_back(0x0e);
+      data.push_back(16 + 8 * (row % 8));
+    }
+    while ((data.size() - offset) % 4 != 0) {
+      data.push_back(0);
+    }
+    Write32(&data, offset, data.size() - offset - 4);
+  }
+  // The zero length terminator.
+  Append32(&data, 0);
+  fixture->eh_frame_offset = kEhFrameOffset;
+  fixture->eh_frame_size = data.size() - kEhFrameOffset;
+
+  // The hdr: version 1, a pc relative sdata4 eh_frame pointer, a udata4
+  // count and a data relative sdata4 table.
+  const uint64_t hdr_offset = data.size();
+  data.insert(data.end(), {1, 0x1b, 0x03, 0x3b});
+  Append32(&data, kEhFrameOffset - (hdr_offset + 4));
+  Append32(&data, count);
+  for (size_t i = 0; i < count; i++) {
+    Append32(&data, kPcBase + i * pc_range - hdr_offset);
+    Append32(&data, fde_offsets[i] - hdr_offset);
+  }
+  fixture->eh_frame_hdr_offset = hdr_offset;
+  fixture->eh_frame_hdr_size = data.size() - hdr_offset;
+  CopyToMemory(data, &fixture->memory);
+
+  fixture->pcs.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    fixture->pcs[i] = kPcBase + i * pc_range + rng() % pc_range;
+  }
+  std::shuffle(fixture->pcs.begin(), fixture->pcs.end(), rng);
+}
+
+std::string CreateMapsFixture(size_t count, std::vector<uint64_t>* addrs) {
+  constexpr uint64_t kMapBase = 0x70000000;
+  constexpr uint64_t kMapStride = 0x10000;
+  constexpr uint64_t kMapSize = 0x8000;
+  static const char* kFlags[] = {"r--p", "r-xp", "rw-p"};
+  std::mt19937 rng(kFixtureSeed);
+
+  std::string text;
+  addrs->resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const uint64_t start = kMapBase + i * kMapStride;
+    // Every library has a read only, an executable and a writable map.
+    text += android::base::StringPrintf(
+        "%" PRIx64 "-%" PRIx64 " %s %08" PRIx64 " fd:00 %zu /system/lib64/libfixture%zu.so\n",
+        start, start + kMapSize, kFlags[i % 3], (i % 3) * kMapSize, 1000 + i / 3, i / 3);
+    (*addrs)[i] = start + rng() % kMapSize;
+  }
+  std::shuffle(addrs->begin(), addrs->end(), rng);
+  return text;
+}
+
+__attribute__((noinline)) size_t CallRecursively(size_t depth, const std::function<size_t()>& func) {
+  if (depth == 0) {
+    return func();
+  }
+  size_t result = CallRecursively(depth - 1, func);
+  // Keeps the call from becoming a tail call, so each level is a frame.
+  asm volatile("" : : : "memory");
+  return result;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_BENCHMARKS_UTILS_H
+#define _LIBUNWINDSTACK_BENCHMARKS_UTILS_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MemoryBuffer.h"
+
+// The fixtures are built from a fixed seed, so every run of the benchmarks
+// sees the same data.
+constexpr uint32_t kFixtureSeed = 0x71;
+
+// An Elf64 symbol table of STT_FUNC symbols in a random order, followed by
+// its string table. The symbols are named fn_<index> and do not overlap.
+struct SymbolFixture {
+  std::unique_ptr<unwindstack::MemoryBuffer> memory;
+  uint64_t symtab_offset;
+  uint64_t symtab_size;
+  uint64_t strtab_offset;
+  uint64_t strtab_size;
+  // An address inside each symbol, in a random order.
+  std::vector<uint64_t> addrs;
+};
+
+void CreateSymbolFixture(size_t count, SymbolFixture* fixture);
+
+// An x86_64 .eh_frame with one cie and count fdes, each with rows_per_fde
+// rows, and the .eh_frame_hdr that indexes it. The section bias is zero, so
+// the pcs are offsets in memory past the end of both sections.
+struct EhFrameFixture {
+  std::unique_ptr<unwindstack::MemoryBuffer> memory;
+  uint64_t eh_frame_offset;
+  uint64_t eh_frame_size;
+  uint64_t eh_frame_hdr_offset;
+  uint64_t eh_frame_hdr_size;
+  // A pc inside each fde, in a random order.
+  std::vector<uint64_t> pcs;
+};
+
+void CreateEhFrameFixture(size_t count, size_t rows_per_fde, EhFrameFixture* fixture);
+
+// The text of a maps file with count maps of shared libraries, and an
+// address inside each map in a random order.
+std::string CreateMapsFixture(size_t count, std::vector<uint64_t>* addrs);
+
+// Calls func from depth nested frames below the caller.
+size_t CallRecursively(size_t depth, const std::function<size_t()>& func);
+
+#endif  // _LIBUNWINDSTACK_BENCHMARKS_UTILS_H
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/LocalUnwinder.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsGetLocal.h>
+#include <unwindstack/Unwinder.h>
+
+#include "Utils.h"
+
+// The benchmarked frames are below the benchmark framework, so allow for
+// those as well.
+constexpr size_t kMaxFrames = 256;
+
+static void BM_local_unwind_unwinder(benchmark::State& state) {
+  unwindstack::LocalMaps maps;
+  if (!maps.Parse()) {
+    state.SkipWithError("Failed to parse local maps.");
+    return;
+  }
+  std::shared_ptr<unwindstack::Memory> process_memory =
+      unwindstack::Memory::CreateProcessMemoryThreadCached(getpid());
+
+  size_t frames = CallRecursively(state.range(0), [&]() {
+    size_t num_frames = 0;
+    for (auto _ : state) {
+      std::unique_ptr<unwindstack::Regs> regs(unwindstack::Regs::CreateFromLocal());
+      unwindstack::RegsGetLocal(regs.get());
+      unwindstack::Unwinder unwinder(kMaxFrames, &maps, regs.get(), process_memory);
+      unwinder.Unwind();
+      num_frames = unwinder.NumFrames();
+    }
+    return num_frames;
+  });
+  if (frames < static_cast<size_t>(state.range(0))) {
+    state.SkipWithError("Unwind stopped before the recursion.");
+  }
+  state.counters["frames"] = frames;
+}
+BENCHMARK(BM_local_unwind_unwinder)->Arg(8)->Arg(64);
+
+static void BM_local_unwind_local_unwinder(benchmark::State& state) {
+  static unwindstack::LocalUnwinder* unwinder = new unwindstack::LocalUnwinder;
+  if (!unwinder->Init()) {
+    state.SkipWithError("Failed to init the local unwinder.");
+    return;
+  }
+
+  size_t frames = CallRecursively(state.range(0), [&]() {
+    std::vector<unwindstack::LocalFrameData> frame_info;
+    for (auto _ : state) {
+      frame_info.clear();
+      unwinder->Unwind(&frame_info, kMaxFrames);
+    }
+    return frame_info.size();
+  });
+  if (frames < static_cast<size_t>(state.range(0))) {
+    state.SkipWithError("Unwind stopped before the recursion.");
+  }
+  state.counters["frames"] = frames;
+}
+BENCHMARK(BM_local_unwind_local_unwinder)->Arg(8)->Arg(64);
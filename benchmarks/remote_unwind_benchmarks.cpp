@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+#include "Utils.h"
+
+// Forks a child that spins depth frames deep and attaches to it.
+static pid_t StartRemoteProcess(size_t depth) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    CallRecursively(depth, []() {
+      while (true) {
+        asm volatile("" : : : "memory");
+      }
+      return size_t(0);
+    });
+    _exit(1);
+  }
+  if (pid == -1) {
+    return -1;
+  }
+
+  // Give the child time to reach the bottom of the recursion.
+  usleep(100000);
+  if (ptrace(PTRACE_ATTACH, pid, 0, 0) == -1) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+  }
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+  }
+  return pid;
+}
+
+static void StopRemoteProcess(pid_t pid) {
+  kill(pid, SIGKILL);
+  ptrace(PTRACE_DETACH, pid, 0, 0);
+  waitpid(pid, nullptr, 0);
+}
+
+static void RemoteUnwind(benchmark::State& state, bool cached_maps) {
+  pid_t pid = StartRemoteProcess(state.range(0));
+  if (pid == -1) {
+    state.SkipWithError("Failed to start the remote process.");
+    return;
+  }
+
+  std::unique_ptr<unwindstack::Regs> regs(unwindstack::Regs::RemoteGet(pid));
+  if (regs == nullptr) {
+    StopRemoteProcess(pid);
+    state.SkipWithError("Failed to get the remote registers.");
+    return;
+  }
+
+  std::unique_ptr<unwindstack::UnwinderFromPid> unwinder;
+  size_t frames = 0;
+  for (auto _ : state) {
+    if (!cached_maps || unwinder == nullptr) {
+      unwinder.reset(new unwindstack::UnwinderFromPid(256, pid, regs->Arch()));
+    } else if (!unwinder->Refresh()) {
+      state.SkipWithError("Failed to refresh the unwinder.");
+      break;
+    }
+    std::unique_ptr<unwindstack::Regs> unwind_regs(regs->Clone());
+    unwinder->SetRegs(unwind_regs.get());
+    unwinder->Unwind();
+    frames = unwinder->NumFrames();
+  }
+  unwinder.reset();
+  StopRemoteProcess(pid);
+
+  if (frames < static_cast<size_t>(state.range(0))) {
+    state.SkipWithError("Unwind stopped before the recursion.");
+  }
+  state.counters["frames"] = frames;
+}
+
+// Creates the maps and the elf objects of the process for every unwind.
+static void BM_remote_unwind_uncached(benchmark::State& state) {
+  RemoteUnwind(state, false);
+}
+BENCHMARK(BM_remote_unwind_uncached)->Arg(8)->Arg(64);
+
+// Refreshes the unwinder between unwinds, keeping the maps and the elf objects.
+static void BM_remote_unwind_cached(benchmark::State& state) {
+  RemoteUnwind(state, true);
+}
+BENCHMARK(BM_remote_unwind_cached)->Arg(8)->Arg(64);
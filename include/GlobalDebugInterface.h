@@ -17,6 +17,7 @@
 #ifndef _LIBUNWINDSTACK_GLOBAL_DEBUG_INTERFACE_H
 #define _LIBUNWINDSTACK_GLOBAL_DEBUG_INTERFACE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <memory>
 
@@ -35,9 +36,24 @@ class GlobalDebugInterface {
 
   virtual Symfile* Find(Maps* maps, uint64_t pc) = 0;
 
+  // Searches the maps for the descriptor if it was not found yet, then
+  // reads the entries added since they were last read, so that the next
+  // lookup does not have to. Returns false if there is no descriptor.
+  virtual bool Update(Maps* maps) = 0;
+
+  // Approximate bytes of heap memory held by the entries read so far and
+  // by their symfiles.
+  virtual size_t MemoryUsage() = 0;
+
  protected:
   bool Load(Maps* maps, std::shared_ptr<Memory>& memory, uint64_t addr, uint64_t size,
-            /*out*/ std::unique_ptr<Symfile>& dex);
+            /*out*/ std::shared_ptr<Symfile>& dex);
+
+  // Gets a range that contains every pc accepted by IsValidPc of file.
+  // Returns false if there is no such range.
+  bool GetPcRange(Symfile* file, uint64_t* start, uint64_t* end);
+
+  size_t SymfileMemoryUsage(Symfile* file);
 };
 
 }  // namespace unwindstack
@@ -18,6 +18,7 @@
 #define _LIBUNWINDSTACK_ARCH_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace unwindstack {
 
@@ -31,6 +32,38 @@ enum ArchEnum : uint8_t {
   ARCH_MIPS64,
 };
 
+// Building with UNWINDSTACK_NATIVE_ARCH_ONLY defined leaves out the support
+// for every arch but the one the library is compiled for, such as for a
+// library that only unwinds its own process. The switches on an arch go
+// through ArchDispatch, which is then a constant for the other archs, so
+// their code is dropped by the compiler.
+#if defined(UNWINDSTACK_NATIVE_ARCH_ONLY)
+#if defined(__arm__)
+constexpr ArchEnum kNativeArch = ARCH_ARM;
+#elif defined(__aarch64__)
+constexpr ArchEnum kNativeArch = ARCH_ARM64;
+#elif defined(__i386__)
+constexpr ArchEnum kNativeArch = ARCH_X86;
+#elif defined(__x86_64__)
+constexpr ArchEnum kNativeArch = ARCH_X86_64;
+#else
+#error "UNWINDSTACK_NATIVE_ARCH_ONLY is not supported on this arch"
+#endif
+#endif
+
+// Returns arch, or ARCH_UNKNOWN if its support is left out of the build.
+static constexpr inline ArchEnum ArchDispatch(ArchEnum arch) {
+#if defined(UNWINDSTACK_NATIVE_ARCH_ONLY)
+  return arch == kNativeArch ? arch : ARCH_UNKNOWN;
+#else
+  return arch;
+#endif
+}
+
+static constexpr inline bool ArchSupported(ArchEnum arch) {
+  return ArchDispatch(arch) != ARCH_UNKNOWN;
+}
+
 static inline bool ArchIs32Bit(ArchEnum arch) {
   switch (arch) {
     case ARCH_ARM:
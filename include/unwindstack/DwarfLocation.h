@@ -17,14 +17,13 @@
 #ifndef _LIBUNWINDSTACK_DWARF_LOCATION_H
 #define _LIBUNWINDSTACK_DWARF_LOCATION_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-#include <unordered_map>
+#include <unwindstack/DwarfStructs.h>
 
 namespace unwindstack {
 
-struct DwarfCie;
-
 enum DwarfLocationEnum : uint8_t {
   DWARF_LOCATION_INVALID = 0,
   DWARF_LOCATION_UNDEFINED,
@@ -41,11 +40,138 @@ struct DwarfLocation {
   uint64_t values[2];
 };
 
-struct DwarfLocations : public std::unordered_map<uint32_t, DwarfLocation> {
-  const DwarfCie* cie;
+// The set of register rules for one row of the unwind table.
+//
+// Register numbers are small on every supported architecture, so the rules
+// are kept in a fixed size array indexed by register with a bitmask of the
+// registers that are present. Copying a row, for example the initial cie
+// state into an fde row, only copies the entries that are present. The CFA_REG
+// rule is stored in the last entry. Rules for registers at or above
+// kMaxRegs are dropped, none of the supported architectures can unwind
+// such registers.
+//
+// The interface mimics the subset of std::unordered_map that the cfa code
+// uses, and the entries expose first/second like a map value.
+struct DwarfLocations {
+  static constexpr uint32_t kMaxRegs = 40;
+
+  struct Entry {
+    uint32_t first;
+    DwarfLocation second;
+  };
+
+  DwarfLocations() = default;
+  DwarfLocations(const DwarfLocations& other) { CopyFrom(other); }
+  DwarfLocations& operator=(const DwarfLocations& other) {
+    if (this != &other) {
+      CopyFrom(other);
+    }
+    return *this;
+  }
+
+  template <typename EntryType, typename LocationsType>
+  class Iterator {
+   public:
+    Iterator(LocationsType* locations, uint32_t index) : locations_(locations), index_(index) {
+      Advance();
+    }
+
+    Iterator& operator++() {
+      index_++;
+      Advance();
+      return *this;
+    }
+
+    EntryType& operator*() const { return locations_->entries_[index_]; }
+    EntryType* operator->() const { return &locations_->entries_[index_]; }
+
+    bool operator==(const Iterator& rhs) const { return index_ == rhs.index_; }
+    bool operator!=(const Iterator& rhs) const { return index_ != rhs.index_; }
+
+   private:
+    void Advance() {
+      uint64_t remaining = index_ < kNumEntries ? locations_->present_ >> index_ : 0;
+      index_ = remaining == 0 ? kNumEntries : index_ + __builtin_ctzll(remaining);
+    }
+
+    LocationsType* locations_;
+    uint32_t index_;
+  };
+
+  using iterator = Iterator<Entry, DwarfLocations>;
+  using const_iterator = Iterator<const Entry, const DwarfLocations>;
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, kNumEntries); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, kNumEntries); }
+
+  iterator find(uint32_t reg) {
+    uint32_t index = GetIndex(reg);
+    return (present_ & (1ULL << index)) ? iterator(this, index) : end();
+  }
+  const_iterator find(uint32_t reg) const {
+    uint32_t index = GetIndex(reg);
+    return (present_ & (1ULL << index)) ? const_iterator(this, index) : end();
+  }
+
+  DwarfLocation& operator[](uint32_t reg) {
+    uint32_t index = GetIndex(reg);
+    if (index == kNumEntries) {
+      // Register rules that are never used, write them to a scratch entry.
+      return discard_;
+    }
+    if (!(present_ & (1ULL << index))) {
+      present_ |= 1ULL << index;
+      entries_[index] = {.first = reg, .second = {}};
+    }
+    return entries_[index].second;
+  }
+
+  size_t erase(uint32_t reg) {
+    uint32_t index = GetIndex(reg);
+    uint64_t mask = index < kNumEntries ? 1ULL << index : 0;
+    size_t erased = (present_ & mask) ? 1 : 0;
+    present_ &= ~mask;
+    return erased;
+  }
+
+  size_t size() const { return __builtin_popcountll(present_); }
+  bool empty() const { return present_ == 0; }
+  void clear() { present_ = 0; }
+
+  const DwarfCie* cie = nullptr;
   // The range of PCs where the locations are valid (end is exclusive).
   uint64_t pc_start = 0;
   uint64_t pc_end = 0;
+
+ private:
+  static constexpr uint32_t kNumEntries = kMaxRegs + 1;
+  static constexpr uint32_t kCfaIndex = kMaxRegs;
+
+  static uint32_t GetIndex(uint32_t reg) {
+    if (reg == CFA_REG) {
+      return kCfaIndex;
+    }
+    return reg < kMaxRegs ? reg : kNumEntries;
+  }
+
+  // The entries that are not present are never read, so they are left as
+  // they are.
+  void CopyFrom(const DwarfLocations& other) {
+    present_ = other.present_;
+    for (uint64_t bits = present_; bits != 0; bits &= bits - 1) {
+      uint32_t index = __builtin_ctzll(bits);
+      entries_[index] = other.entries_[index];
+    }
+    cie = other.cie;
+    pc_start = other.pc_start;
+    pc_end = other.pc_end;
+  }
+
+  uint64_t present_ = 0;
+  Entry entries_[kNumEntries];
+  DwarfLocation discard_;
 };
 
 }  // namespace unwindstack
@@ -17,7 +17,9 @@
 #ifndef _LIBUNWINDSTACK_DWARF_MEMORY_H
 #define _LIBUNWINDSTACK_DWARF_MEMORY_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 namespace unwindstack {
 
@@ -29,7 +31,20 @@ class DwarfMemory {
   DwarfMemory(Memory* memory) : memory_(memory) {}
   virtual ~DwarfMemory() = default;
 
-  bool ReadBytes(void* dst, size_t num_bytes);
+  // The window can point into the object itself.
+  DwarfMemory(const DwarfMemory&) = delete;
+  DwarfMemory& operator=(const DwarfMemory&) = delete;
+
+  bool ReadBytes(void* dst, size_t num_bytes) {
+    // Fast-path: The data is already in the window.
+    uint64_t index = cur_offset_ - window_start_;
+    if (index < window_size_ && num_bytes <= window_size_ - index) {
+      memcpy(dst, &window_[index], num_bytes);
+      cur_offset_ += num_bytes;
+      return true;
+    }
+    return ReadBytesSlow(dst, num_bytes);
+  }
 
   template <typename SignedType>
   bool ReadSigned(uint64_t* value);
@@ -46,6 +61,8 @@ class DwarfMemory {
   template <typename AddressType>
   bool ReadEncodedValue(uint8_t encoding, uint64_t* value);
 
+  Memory* memory() { return memory_; }
+
   uint64_t cur_offset() { return cur_offset_; }
   void set_cur_offset(uint64_t cur_offset) { cur_offset_ = cur_offset; }
 
@@ -61,10 +78,39 @@ class DwarfMemory {
   void set_text_offset(uint64_t offset) { text_offset_ = offset; }
   void clear_text_offset() { text_offset_ = static_cast<uint64_t>(-1); }
 
+  // When buffered, reads are served from a window of the memory that is
+  // either borrowed from the memory object, or copied into a local buffer,
+  // instead of one Memory::Read per value. Only use this for memory that
+  // does not change while this object is in use.
+  void set_buffered(bool buffered) {
+    buffered_ = buffered;
+    ClearWindow();
+  }
+  void ClearWindow() {
+    window_ = nullptr;
+    window_start_ = 0;
+    window_size_ = 0;
+  }
+
  private:
+  // The size of the window that is borrowed with Memory::GetPointer.
+  static constexpr size_t kBorrowSize = 4096;
+  // The size of the window that is copied when it cannot be borrowed.
+  static constexpr size_t kBufferSize = 256;
+
+  bool ReadBytesSlow(void* dst, size_t num_bytes);
+
+  bool FillWindow();
+
   Memory* memory_;
   uint64_t cur_offset_ = 0;
 
+  bool buffered_ = false;
+  const uint8_t* window_ = nullptr;
+  uint64_t window_start_ = 0;
+  size_t window_size_ = 0;
+  uint8_t buffer_[kBufferSize];
+
   int64_t pc_offset_ = INT64_MAX;
   uint64_t data_offset_ = static_cast<uint64_t>(-1);
   uint64_t func_offset_ = static_cast<uint64_t>(-1);
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_DWARF_ROW_CACHE_H
+#define _LIBUNWINDSTACK_DWARF_ROW_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <unwindstack/DwarfLocation.h>
+
+namespace unwindstack {
+
+// A fixed capacity cache of evaluated cfa rows, keyed by the pc range of
+// each row rather than by the pc that was looked up, so that every pc of a
+// cached row finds it. The pc space is split into 256 byte regions, each
+// region maps to one set of kWays slots, and a row is stored in the sets of
+// the regions it covers, up to kMaxRegions of them around the pc that was
+// looked up. Within a set, the start of the row picks the slot, and a new
+// row replaces whatever row was in that slot before, so the memory used
+// never grows beyond the configured number of slots.
+//
+// Find, Add and Clear can be called from multiple threads at the same time
+// without any external locking. A row returned by Find stays valid for as
+// long as the caller holds on to the returned pointer, even if it is
+// evicted or cleared. Resize must not be called while other threads use the
+// cache.
+class DwarfRowCache {
+ public:
+  static constexpr size_t kDefaultSize = 1024;
+  static constexpr size_t kWays = 4;
+  static constexpr uint32_t kRegionBits = 8;
+  static constexpr size_t kMaxRegions = 16;
+
+  DwarfRowCache(size_t size = kDefaultSize) { Resize(size); }
+  ~DwarfRowCache() = default;
+
+  // Returns the cached row containing pc, or nullptr if there is none.
+  std::shared_ptr<const DwarfLocations> Find(uint64_t pc);
+
+  // Stores the row, which must contain pc, and returns it. If another
+  // thread already stored the same row, that row is returned instead.
+  std::shared_ptr<const DwarfLocations> Add(uint64_t pc, DwarfLocations&& loc_regs);
+
+  // Sets the number of slots, which is rounded up to a power of two of at
+  // least kWays. A size of zero disables the cache. All current entries are
+  // discarded.
+  void Resize(size_t size);
+
+  // Drops all of the cached rows, keeping the slots.
+  void Clear();
+
+  size_t size() { return sets_.size() * kWays; }
+
+  // Approximate number of bytes used by the slots and the cached rows.
+  size_t MemoryUsage();
+
+ private:
+  // One cache line of slots.
+  struct alignas(64) Set {
+    std::shared_ptr<const DwarfLocations> rows[kWays];
+  };
+
+  Set& GetSet(uint64_t region);
+
+  std::vector<Set> sets_;
+  uint64_t mask_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_DWARF_ROW_CACHE_H
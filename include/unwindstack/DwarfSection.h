@@ -19,15 +19,25 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <deque>
 #include <iterator>
 #include <map>
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
 #include <unwindstack/DwarfMemory.h>
+#include <unwindstack/DwarfRowCache.h>
 #include <unwindstack/DwarfStructs.h>
+#include <unwindstack/ElfIndex.h>
+#include <unwindstack/MemoryFootprint.h>
 
 namespace unwindstack {
 
@@ -38,6 +48,88 @@ class Regs;
 template <typename AddressType>
 struct RegsInfo;
 
+// An entry of the fde binary search table, sorted by pc_end.
+struct DwarfFdeIndexEntry {
+  uint64_t pc_end;
+  uint64_t fde_offset;
+};
+
+// Same as DwarfFdeIndexEntry, with the pc relative to the lowest pc in the
+// index and the offset relative to the start of the section entries. Used
+// whenever both fit in 32 bits.
+struct DwarfFdeCompactIndexEntry {
+  uint32_t pc_end;
+  uint32_t fde_offset;
+};
+
+// The fde index of a section shared between elf objects, see
+// DwarfSection::ShareIndex.
+struct DwarfFdeIndexTables;
+
+// A single row of a precompiled unwind table. The register rules for the row
+// are stored in the owning DwarfCompiledFde starting at locations_index.
+struct DwarfCompiledRow {
+  uint64_t pc_start;
+  uint64_t pc_end;
+  DwarfLocation cfa;
+  uint32_t locations_index;
+  uint16_t locations_count;
+  // Set when the row needs a DWARF expression to be evaluated. These rows
+  // are always unwound using the cfa interpreter.
+  bool use_interpreter;
+  // The return address is signed at this row, the arm64 RA_SIGN_STATE
+  // pseudo register, which is not kept in the locations.
+  bool ra_signed;
+};
+
+// What the unwind information says about the frame pointer at a pc.
+enum FramePointerRule : uint8_t {
+  // There is no unwind information for the pc.
+  FRAME_POINTER_UNKNOWN = 0,
+  // The cfa is the frame pointer plus the size of a frame record, and the
+  // frame record holds the caller's frame pointer and the return address.
+  FRAME_POINTER_USED,
+  // The frame is described in some other way.
+  FRAME_POINTER_NOT_USED,
+};
+
+struct DwarfCompiledFde {
+  uint64_t pc_start = 0;
+  uint64_t pc_end = 0;
+  const DwarfCie* cie = nullptr;
+  std::vector<DwarfCompiledRow> rows;
+  std::vector<std::pair<uint32_t, DwarfLocation>> locations;
+};
+
+// A DWARF expression decoded once, so that evaluating it again does not
+// read or decode it. Simple expressions are evaluated directly.
+struct DwarfCompiledExpression {
+  enum Kind : uint8_t {
+    // Read from memory on every evaluation, since the ops could not be
+    // decoded, or they branch.
+    KIND_INTERPRETED,
+    // Evaluated from the decoded ops.
+    KIND_OPS,
+    // The value of register reg plus offset.
+    KIND_BREG,
+    // The value read from the address register reg plus offset.
+    KIND_BREG_DEREF,
+  };
+
+  struct Op {
+    uint8_t op;
+    uint64_t operands[2];
+  };
+
+  uint64_t end = 0;
+  Kind kind = KIND_INTERPRETED;
+  // The ops start with the sequence that marks a dex pc.
+  bool dex_pc = false;
+  uint32_t reg = 0;
+  uint64_t offset = 0;
+  std::vector<Op> ops;
+};
+
 class DwarfSection {
  public:
   DwarfSection(Memory* memory);
@@ -107,9 +199,113 @@ class DwarfSection {
 
   virtual uint64_t AdjustPcFromFde(uint64_t pc) = 0;
 
+  // If lock is not null, it is released while the cfa instructions are
+  // evaluated.
+  virtual bool CompileFde(const DwarfFde* fde, ArchEnum arch, DwarfCompiledFde* compiled,
+                          std::unique_lock<std::mutex>* lock) = 0;
+
+  virtual bool EvalCompiledRow(const DwarfCie* cie, Memory* regular_memory,
+                               const DwarfCompiledFde& compiled, const DwarfCompiledRow& row,
+                               Regs* regs, bool* finished, DwarfErrorData* error) = 0;
+
+  virtual bool EvalCachedRow(const DwarfCie* cie, Memory* regular_memory,
+                             const DwarfLocations& loc_regs, Regs* regs, bool* finished) = 0;
+
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished, bool* is_signal_frame);
 
+  // Unwinds the pc only if its row is already in the row cache, or with
+  // compiled unwind tables if Step already found the compiled fde of this
+  // pc, and the row does not need a DWARF expression. This does not modify
+  // any of the section state, including the last error, so it can be called
+  // from multiple threads at the same time, and at the same time as a Step
+  // on another thread. On failure the regs are not modified, and Step
+  // should be used instead.
+  bool StepFromCache(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
+                     bool* is_signal_frame);
+
+  // Keeps the cached row of pc for the life of the section, so that
+  // StepFromCache finds it even after it is evicted from the row cache.
+  // Meant for the few functions at the bottom of every stack. Returns false
+  // if the row of pc is not cached, needs a DWARF expression, or
+  // kMaxPinnedRows rows are already pinned. Must not be called at the same
+  // time as another PinRow or a Step.
+  bool PinRow(uint64_t pc);
+
+  static constexpr size_t kMaxPinnedRows = 16;
+
+  // Same as Step, but only uses rows of fdes that are already compiled, and
+  // never allocates memory. The caller must make sure that no other thread
+  // uses the section at the same time.
+  bool StepCompiled(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
+                    bool* is_signal_frame);
+
+  // Sets loc_regs to the row for the pc. The cfa instructions of an fde are
+  // evaluated once, the first time one of its pcs is looked up, and the
+  // rows are kept so that every other pc in the fde is a binary search.
+  // Returns false if there is no fde for the pc, or it could not be
+  // evaluated.
+  bool GetRowLocations(uint64_t pc, ArchEnum arch, DwarfLocations* loc_regs);
+
+  // Inspects the row for the pc, compiling its fde if needed. Only arm64
+  // and x86_64 frame records are recognized. If lock is not null, it is
+  // released while the fde is compiled. The fde is then published, so that
+  // GetCachedFramePointerRule finds it.
+  FramePointerRule GetFramePointerRule(uint64_t pc, ArchEnum arch,
+                                       std::unique_lock<std::mutex>* lock = nullptr);
+
+  // Same as GetFramePointerRule, but only for pcs in an fde that was
+  // already published, so it can be called without the lock. Returns false
+  // if the fde of the pc is not published.
+  bool GetCachedFramePointerRule(uint64_t pc, ArchEnum arch, FramePointerRule* rule);
+
+  // Enables compiled unwind tables and compiles every fde in the section.
+  void CompileAllFdes(ArchEnum arch);
+
+  // When enabled, every fde is lowered into a sorted table of rows the first
+  // time a pc inside of it is unwound, instead of interpreting the cfa
+  // instructions again for each new pc.
+  void set_compiled_unwind_tables(bool enable) { compiled_unwind_tables_ = enable; }
+  bool compiled_unwind_tables() { return compiled_unwind_tables_; }
+
+  // Sets the number of rows kept in the cache of evaluated cfa rows. A size
+  // of zero disables the cache. Must not be called while unwinding.
+  void set_row_cache_size(size_t size) { row_cache_.Resize(size); }
+  size_t row_cache_size() { return row_cache_.size(); }
+
+  // Number of threads used to build the fde index of a large section, zero
+  // means one per cpu. Must not be called while unwinding.
+  void set_fde_index_threads(size_t threads) { fde_index_threads_ = threads; }
+
+  // Adds the approximate bytes of heap memory used by this section.
+  virtual void GetMemoryUsage(ElfMemoryUsage* usage);
+  size_t MemoryUsage() {
+    ElfMemoryUsage usage;
+    GetMemoryUsage(&usage);
+    return usage.Total();
+  }
+
+  // Builds the table used to find the fde of a pc, if it was not built
+  // yet, instead of doing it on the first lookup.
+  virtual void BuildIndex() {}
+
+  // Adds the fde index to the index file, building it if needed.
+  virtual void SaveIndex(ElfIndexWriter*, ElfIndexScope) {}
+
+  // Uses the fde index from the index file instead of building it.
+  virtual void LoadIndex(const std::shared_ptr<ElfIndexFile>&, ElfIndexScope) {}
+
+  // Shares the fde index with the sections of every other elf with the
+  // same raw build_id, so that it is only built once while any of them is
+  // alive. Must be called before the index is built.
+  virtual void ShareIndex(const std::string&, ElfIndexScope) {}
+
  protected:
+  const DwarfCompiledRow* GetCompiledRow(uint64_t pc, ArchEnum arch,
+                                         const DwarfCompiledFde** compiled,
+                                         std::unique_lock<std::mutex>* lock = nullptr);
+
+  static bool HasExpression(const DwarfLocations& loc_regs);
+
   DwarfMemory memory_;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
 
@@ -117,9 +313,42 @@ class DwarfSection {
   uint64_t cie64_value_ = 0;
 
   std::unordered_map<uint64_t, DwarfFde> fde_entries_;
-  std::unordered_map<uint64_t, DwarfCie> cie_entries_;
-  std::unordered_map<uint64_t, DwarfLocations> cie_loc_regs_;
-  std::map<uint64_t, DwarfLocations> loc_regs_;  // Single row indexed by pc_end.
+  struct CieEntry {
+    DwarfCie cie;
+    // The rules set by the cie instructions, the start of every fde row.
+    DwarfLocations initial_loc_regs;
+    bool has_initial_loc_regs = false;
+  };
+  // Indexed by DwarfCie::id, a deque so the cie pointers of the fdes stay
+  // valid. Only the first read of a cie looks up its offset.
+  std::deque<CieEntry> cies_;
+  std::unordered_map<uint64_t, uint32_t> cie_ids_;
+  DwarfRowCache row_cache_;
+  // Only the first num_pinned_rows_ slots are read, and a slot is not
+  // written again once it is counted.
+  std::shared_ptr<const DwarfLocations> pinned_rows_[kMaxPinnedRows];
+  std::atomic<size_t> num_pinned_rows_ = 0;
+
+  std::atomic_bool compiled_unwind_tables_ = false;
+  std::map<uint64_t, DwarfCompiledFde> compiled_fdes_;  // Indexed by fde pc_end.
+
+  // The compiled fdes that Step or GetFramePointerRule found, by pc, so that
+  // StepFromCache and GetCachedFramePointerRule can use them without the
+  // map. A slot holds the last fde stored for any pc that maps to it. The
+  // fdes are never freed before the section.
+  static constexpr size_t kCompiledFdeSlots = 256;
+  struct CompiledFdeSlots {
+    std::atomic<const DwarfCompiledFde*> fdes[kCompiledFdeSlots] = {};
+  };
+  // Allocated with the first stored fde, written with the object lock held.
+  void StoreCompiledFde(uint64_t pc, const DwarfCompiledFde* compiled);
+  static size_t CompiledFdeSlot(uint64_t pc) {
+    return ((pc * 0x9e3779b97f4a7c15ULL) >> 32) & (kCompiledFdeSlots - 1);
+  }
+  std::unique_ptr<CompiledFdeSlots> compiled_fde_slots_storage_;
+  std::atomic<CompiledFdeSlots*> compiled_fde_slots_ = nullptr;
+
+  size_t fde_index_threads_ = 1;
 };
 
 template <typename AddressType>
@@ -148,16 +377,43 @@ class DwarfSectionImpl : public DwarfSection {
 
   bool Log(uint8_t indent, uint64_t pc, const DwarfFde* fde, ArchEnum arch) override;
 
- protected:
-  using DwarfFdeMap =
-      std::map</*end*/ uint64_t, std::pair</*start*/ uint64_t, /*offset*/ uint64_t>>;
+  bool CompileFde(const DwarfFde* fde, ArchEnum arch, DwarfCompiledFde* compiled,
+                  std::unique_lock<std::mutex>* lock) override;
+
+  bool EvalCompiledRow(const DwarfCie* cie, Memory* regular_memory,
+                       const DwarfCompiledFde& compiled, const DwarfCompiledRow& row, Regs* regs,
+                       bool* finished, DwarfErrorData* error) override;
+
+  bool EvalCachedRow(const DwarfCie* cie, Memory* regular_memory, const DwarfLocations& loc_regs,
+                     Regs* regs, bool* finished) override;
+
+  void GetMemoryUsage(ElfMemoryUsage* usage) override;
+
+  void BuildIndex() override;
+
+  void SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope) override;
+
+  void LoadIndex(const std::shared_ptr<ElfIndexFile>& file, ElfIndexScope scope) override;
 
+  void ShareIndex(const std::string& build_id, ElfIndexScope scope) override;
+
+ protected:
   bool GetNextCieOrFde(/*inout*/ uint64_t& offset, /*out*/ std::optional<DwarfFde>& fde);
 
   bool FillInCieHeader(DwarfCie* cie);
 
   bool FillInCie(DwarfCie* cie);
 
+  // Stores a cie that was read successfully and gives it the next id.
+  const DwarfCie* AddCie(uint64_t offset, DwarfCie&& cie);
+
+  // Returns the rules set up by the instructions of the cie of fde,
+  // evaluating them the first time.
+  const DwarfLocations* GetCieLocRegs(const DwarfFde* fde, ArchEnum arch);
+
+  bool CompileFdeRows(const DwarfFde* fde, ArchEnum arch, const DwarfLocations* cie_loc_regs,
+                      DwarfMemory* memory, DwarfCompiledFde* compiled, DwarfErrorData* error);
+
   bool FillInFdeHeader(DwarfFde* fde);
 
   bool FillInFde(DwarfFde* fde);
@@ -165,17 +421,55 @@ class DwarfSectionImpl : public DwarfSection {
   bool EvalExpression(const DwarfLocation& loc, Memory* regular_memory, AddressType* value,
                       RegsInfo<AddressType>* regs_info, bool* is_dex_pc);
 
-  static void InsertFde(uint64_t fde_offset, const DwarfFde* fde, /*out*/ DwarfFdeMap& fdes);
+  template <typename LocationIterator>
+  bool EvalLocations(const DwarfCie* cie, Memory* regular_memory, const DwarfLocation& cfa_loc,
+                     LocationIterator begin, LocationIterator end, Regs* regs, bool* finished,
+                     DwarfErrorData* error, bool ra_signed = false);
+
+  // The same, with the virtual calls of a concrete Regs type resolved at
+  // compile time.
+  template <typename LocationIterator, typename RegsType>
+  bool EvalLocationsForRegs(const DwarfCie* cie, Memory* regular_memory,
+                            const DwarfLocation& cfa_loc, LocationIterator begin,
+                            LocationIterator end, RegsType* cur_regs, bool* finished,
+                            DwarfErrorData* error, bool ra_signed);
+
+  struct FdeRange {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    size_t order;  // Position of the entry in the section.
+  };
+
+  // Returns a section of the same type over the same memory, used to decode
+  // part of the entries on another thread. Returns nullptr if the section
+  // does not support it.
+  virtual std::unique_ptr<DwarfSectionImpl<AddressType>> CreateIndexWorker() { return nullptr; }
+
+  bool GetFdeRangesParallel(size_t num_threads, std::vector<FdeRange>* ranges);
 
   void BuildFdeIndex();
 
+  bool FdeIndexEmpty() { return fde_index_.empty() && compact_fde_index_.empty(); }
+
+  // Points the fde index at the shared tables.
+  void UseFdeIndexTables(const std::shared_ptr<const DwarfFdeIndexTables>& tables);
+
   int64_t section_bias_ = 0;
   uint64_t entries_offset_ = 0;
   uint64_t entries_end_ = 0;
   uint64_t pc_offset_ = 0;
 
   // Binary search table (similar to .eh_frame_hdr). Contains only FDE offsets to save memory.
-  std::vector<std::pair</*function end address*/ uint64_t, /*FDE offset*/ uint64_t>> fde_index_;
+  // Only one of the two is used, the compact one unless the index is loaded
+  // from an index file, or the section is too large.
+  ElfIndexArray<DwarfFdeIndexEntry> fde_index_;
+  ElfIndexArray<DwarfFdeCompactIndexEntry> compact_fde_index_;
+  uint64_t compact_fde_index_pc_base_ = 0;
+  // Set by ShareIndex, the key of the index in the process wide tables.
+  std::string shared_index_key_;
+
+  std::unordered_map<uint64_t, DwarfCompiledExpression> expressions_;  // Indexed by start offset.
 };
 
 }  // namespace unwindstack
@@ -36,6 +36,8 @@ struct DwarfCie {
   int64_t data_alignment_factor = 0;
   uint64_t return_address_register = 0;
   bool is_signal_frame = false;
+  // The dense id of the cie in its section, assigned when it is first read.
+  uint32_t id = 0;
 };
 
 struct DwarfFde {
@@ -19,15 +19,20 @@
 
 #include <stddef.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 
 #include <unwindstack/Arch.h>
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/MemoryFootprint.h>
+#include <unwindstack/OffsetMemo.h>
 #include <unwindstack/SharedString.h>
 
 #if !defined(EM_AARCH64)
@@ -37,32 +42,91 @@
 namespace unwindstack {
 
 // Forward declaration.
+class ElfCache;
+class ElfIndexStore;
 struct MapInfo;
+class MergedSymbols;
 class Regs;
+class SymbolStore;
+
+struct ElfCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  // Misses by name that found the elf of the same file under another name.
+  uint64_t file_hits = 0;
+  size_t entries = 0;
+  // Approximate memory used by the cached elf objects.
+  size_t bytes = 0;
+};
 
 class Elf {
  public:
   Elf(Memory* memory) : memory_(memory) {}
-  virtual ~Elf() = default;
+  virtual ~Elf();
 
   bool Init();
 
   void InitGnuDebugdata();
 
+  // Loads the lookup tables from the index cache directory, or creates the
+  // index file if there is none for this build id yet.
+  void InitIndex();
+
   void Invalidate();
 
   std::string GetSoname();
 
   bool GetFunctionName(uint64_t addr, SharedString* name, uint64_t* func_offset);
 
+  // Same as GetFunctionName, but avoids copying the name when the string
+  // table is mapped by pointing directly into it. The name stays valid as
+  // long as this object is alive and its memory has not been cleared.
+  bool GetFunctionNameView(uint64_t addr, std::string_view* name, uint64_t* func_offset);
+
+  // Looks up the functions of count addresses at once, the addresses must
+  // be sorted. For each address found is set to true when a name was found,
+  // addresses that already have found set are skipped. Cheaper than one
+  // GetFunctionName call per address for large batches.
+  void GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                        uint64_t* func_offsets, bool* found);
+
   bool GetGlobalVariableOffset(const std::string& name, uint64_t* memory_offset);
 
   uint64_t GetRelPc(uint64_t pc, const MapInfo* map_info);
 
+  // The answers of Regs::IsSignalHandler are kept for the most recent pcs,
+  // so that the instructions of a pc are only read the first time it is
+  // stepped from.
   bool StepIfSignalHandler(uint64_t rel_pc, Regs* regs, Memory* process_memory);
 
+  // The size of the thumb instruction that ends before elf_offset, which
+  // has the thumb bit set, either 2 or 4. Used for the pc adjustment of a
+  // thumb return address, and kept for the most recent offsets.
+  uint64_t GetThumbInstructionSize(uint64_t elf_offset);
+
+  // If error is not nullptr, it is set to the result of this step. Use this
+  // instead of GetLastError when multiple threads step using the same object.
   bool Step(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
-            bool* is_signal_frame);
+            bool* is_signal_frame, ErrorData* error = nullptr);
+
+  // Version of Step that can be used in a signal handler. It never waits
+  // for the lock or allocates, and it only uses unwind tables that were
+  // compiled before, see CompileUnwindTables.
+  bool StepSignalSafe(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
+                      bool* is_signal_frame);
+
+  // Tells whether the unwind information for the pc describes a standard
+  // frame record, see DwarfSection::GetFramePointerRule.
+  FramePointerRule GetFramePointerRule(uint64_t rel_pc);
+
+  // Compiles the unwind tables for every function in the elf.
+  void CompileUnwindTables();
+
+  // Builds the fde and exidx lookup tables now, and the symbol tables when
+  // symbols is true, so that the first unwind through this elf does not
+  // have to. The gnu_debugdata section is already decompressed by Init.
+  void Preload(bool symbols);
 
   ElfInterface* CreateInterfaceFromMemory(Memory* memory);
 
@@ -92,6 +156,13 @@ class Elf {
 
   ElfInterface* gnu_debugdata_interface() { return gnu_debugdata_interface_.get(); }
 
+  // Approximate number of bytes of heap memory used by this object, including
+  // any data read into memory, the decompressed gnu_debugdata and the cached
+  // symbols and unwind information.
+  size_t MemoryUsage();
+  // Same as MemoryUsage, split by what the memory holds, added to usage.
+  void GetMemoryUsage(ElfMemoryUsage* usage);
+
   static bool IsValidElf(Memory* memory);
 
   static bool GetInfo(Memory* memory, uint64_t* size);
@@ -100,16 +171,146 @@ class Elf {
 
   static std::string GetBuildID(Memory* memory);
 
+  // The build id from the notes, and the size of the elf data that is
+  // mapped when the elf is loaded, for the memory of a loaded elf. Returns
+  // false if memory is not an elf.
+  static bool GetLoadedInfo(Memory* memory, std::string* build_id, uint64_t* loaded_size);
+
   static void SetCachingEnabled(bool enable);
   static bool CachingEnabled() { return cache_enabled_; }
 
-  static void CacheLock();
-  static void CacheUnlock();
+  // When set, the symbol remap tables and fde indices of every elf with a
+  // build id are saved into a file in this directory the first time the elf
+  // is initialized, and later initializations map that file instead of
+  // rebuilding the tables. An empty directory disables the index cache.
+  // Only affects elf objects initialized after this call.
+  static void SetIndexCacheDirectory(const std::string& directory) {
+    index_cache_directory_ = directory;
+  }
+  static const std::string& IndexCacheDirectory() { return index_cache_directory_; }
+
+  // When set, the index of an elf that is not in the index cache directory
+  // is taken from the store, and an index that had to be built is added to
+  // it as a memfd, see ElfIndexStore. The store is not owned. Only affects
+  // elf objects initialized after this call.
+  static void SetIndexStore(ElfIndexStore* store) { index_store_ = store; }
+  static ElfIndexStore* GetIndexStore() { return index_store_; }
+
+  // When enabled, the fde index built for an unwind section without a
+  // binary search table, such as an .eh_frame without a valid
+  // .eh_frame_hdr, is shared by every elf object with the same build id.
+  // The index is only built again once all of them are freed.
+  // Only affects elf objects initialized after this call.
+  static void SetSharedFdeIndexEnabled(bool enable) { shared_fde_index_enabled_ = enable; }
+  static bool SharedFdeIndexEnabled() { return shared_fde_index_enabled_; }
+
+  // When enabled, the unwind information of an fde is converted into a
+  // flat table the first time a pc in it is seen. This uses more memory
+  // but avoids interpreting the cfa instructions over again for every pc.
+  // Only affects elf objects initialized after this call.
+  static void SetCompiledUnwindTablesEnabled(bool enable) {
+    compiled_unwind_tables_enabled_ = enable;
+  }
+  static bool CompiledUnwindTablesEnabled() { return compiled_unwind_tables_enabled_; }
+
+  // When enabled, the function symbols of a symbol table are read once into
+  // flat sorted arrays the first time a name is looked up, rather than being
+  // cached one lookup at a time. Uses less memory and has faster lookups for
+  // elf objects that are heavily symbolized.
+  // Only affects elf objects initialized after this call.
+  static void SetFlatSymbolTablesEnabled(bool enable) { flat_symbol_tables_enabled_ = enable; }
+  static bool FlatSymbolTablesEnabled() { return flat_symbol_tables_enabled_; }
+
+  // When enabled, the unwind rows of the functions that start every process
+  // and thread, such as __start_thread and start_thread, and of the signal
+  // return trampolines of the vdso, are kept for good the first time they
+  // are evaluated, so that the stack bottoms found in every sample are never
+  // evicted from the row cache. Only the libc, the dynamic linker and the
+  // vdso are checked for these functions, and the rows in them that end an
+  // unwind are pinned whether they have a symbol or not.
+  // Only affects elf objects initialized after this call.
+  static void SetPinnedRowsEnabled(bool enable) { pinned_rows_enabled_ = enable; }
+  static bool PinnedRowsEnabled() { return pinned_rows_enabled_; }
+
+  // When enabled, the function symbols of the .dynsym, the .symtab and the
+  // gnu_debugdata section are merged into one sorted table the first time a
+  // name is looked up, so that every lookup, including a miss, is a single
+  // search instead of one for each table.
+  // Only affects elf objects initialized after this call.
+  static void SetMergedSymbolTablesEnabled(bool enable) { merged_symbol_tables_enabled_ = enable; }
+  static bool MergedSymbolTablesEnabled() { return merged_symbol_tables_enabled_; }
+
+  // Number of threads used to build the fde index of large unwind sections
+  // that do not have a binary search table, such as the .debug_frame of an
+  // unstripped binary. Zero means one thread per cpu. The default of one
+  // builds the index on the calling thread.
+  // Only affects elf objects initialized after this call.
+  static void SetFdeIndexThreads(size_t threads) { fde_index_threads_ = threads; }
+  static size_t FdeIndexThreads() { return fde_index_threads_; }
+
+  // When enabled, files mapped whole for elf data ask for huge pages, and
+  // the unwind sections of every elf initialized afterwards are faulted in
+  // ahead of time with MADV_WILLNEED.
+  static void SetFileMappingAdviceEnabled(bool enable) { file_mapping_advice_enabled_ = enable; }
+  static bool FileMappingAdviceEnabled() { return file_mapping_advice_enabled_; }
+
+  // When enabled, function names, map names and map names joined with an
+  // embedded soname are interned with SharedString::Intern, so equal names
+  // read for different elf objects or different Maps share one string.
+  static void SetInternNamesEnabled(bool enable) { intern_names_enabled_ = enable; }
+  static bool InternNamesEnabled() { return intern_names_enabled_; }
+
+  // When set, the elf of a map with a known build id is taken from the
+  // store if it has that build id, before trying the file of the map. The
+  // store is not owned, and has to outlive every elf found through it.
+  static void SetSymbolStore(SymbolStore* store) { symbol_store_ = store; }
+  static SymbolStore* GetSymbolStore() { return symbol_store_; }
+
+  // When set, the sorted symbol tables of every elf initialized afterwards
+  // are built by a task given to executor, such as a thread pool, instead of
+  // by the first lookup. Lookups done meanwhile search the symbol table as
+  // it is. Destroying the elf waits for its task if it is running. Set to
+  // nullptr to build the tables on the first lookup again.
+  using Executor = std::function<void(std::function<void()>)>;
+  static void SetSymbolsExecutor(Executor executor) { symbols_executor_ = std::move(executor); }
+
+  // Limits the number of entries in the cache, zero means no limit. When the
+  // limit is reached, the least recently used entries are evicted. The limit
+  // is split evenly between the cache shards, so it is approximate.
+  static void SetCacheMaxEntries(size_t max_entries);
+  // Limits the approximate memory used by the cached elf objects, zero
+  // means no limit. Least recently used entries are evicted to stay under
+  // the budget. The usage is checked when entries are added, and an elf is
+  // never freed while a map still references it.
+  static void SetCacheMemoryBudget(size_t bytes);
+  static ElfCacheStats GetCacheStats();
+  // The memory used by the cached elf objects, each counted once. If
+  // num_elfs is not nullptr, it is set to the number of elf objects.
+  static ElfMemoryUsage GetCacheMemoryUsage(size_t* num_elfs = nullptr);
+
+  // The cache is split into shards, the lock only covers the entries for
+  // the file of info. CacheAdd, CacheGet and CacheAfterCreateMemory need
+  // the lock to be held. CacheFind takes the lock itself in shared mode.
+  static void CacheLock(MapInfo* info);
+  static void CacheUnlock(MapInfo* info);
   static void CacheAdd(MapInfo* info);
   static bool CacheGet(MapInfo* info);
+  static bool CacheFind(MapInfo* info);
   static bool CacheAfterCreateMemory(MapInfo* info);
 
  protected:
+  // Applies MADV_WILLNEED to the unwind sections that are mapped.
+  void AdviseUnwindSections();
+
+  // Pins the row of rel_pc if it is in one of the functions of the stack
+  // bottoms, or if it ended the unwind. Requires the lock to be held.
+  void PinRowIfStackBottom(uint64_t rel_pc, bool finished);
+
+  // Gives the building of the symbol tables to the symbols executor.
+  void BuildSymbolsInBackground();
+  // Waits for the task if it is running, and keeps it from running later.
+  void StopBackgroundTask();
+
   bool valid_ = false;
   int64_t load_bias_ = 0;
   std::unique_ptr<ElfInterface> interface_;
@@ -123,9 +324,47 @@ class Elf {
   std::unique_ptr<Memory> gnu_debugdata_memory_;
   std::unique_ptr<ElfInterface> gnu_debugdata_interface_;
 
+  // Whether rows are pinned, decided from the soname on the first step.
+  enum PinnedRows : uint8_t {
+    PINNED_ROWS_DISABLED,
+    PINNED_ROWS_UNKNOWN,
+    PINNED_ROWS_ENABLED,
+  };
+  PinnedRows pinned_rows_ = PINNED_ROWS_DISABLED;
+
+  // Set when merged symbol tables are enabled.
+  std::shared_ptr<MergedSymbols> merged_symbols_;
+
+  // Shared with the task building the symbol tables, which only uses this
+  // object while holding the lock and while it is not cleared.
+  struct BackgroundTask {
+    std::mutex lock;
+    Elf* elf;
+  };
+  std::shared_ptr<BackgroundTask> background_task_;
+
+  // See OffsetMemo.
+  OffsetMemo<> signal_handlers_;
+  OffsetMemo<> thumb_sizes_;
+  OffsetMemo<> pinned_row_checks_;
+
   static bool cache_enabled_;
-  static std::unordered_map<std::string, std::pair<std::shared_ptr<Elf>, bool>>* cache_;
-  static std::mutex* cache_lock_;
+  static ElfCache* cache_;
+  static size_t cache_max_entries_;
+  static size_t cache_memory_budget_;
+
+  static bool compiled_unwind_tables_enabled_;
+  static bool flat_symbol_tables_enabled_;
+  static bool merged_symbol_tables_enabled_;
+  static bool pinned_rows_enabled_;
+  static size_t fde_index_threads_;
+  static bool shared_fde_index_enabled_;
+  static bool file_mapping_advice_enabled_;
+  static bool intern_names_enabled_;
+  static std::string index_cache_directory_;
+  static ElfIndexStore* index_store_;
+  static SymbolStore* symbol_store_;
+  static Executor symbols_executor_;
 };
 
 }  // namespace unwindstack
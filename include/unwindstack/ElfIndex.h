@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_ELF_INDEX_H
+#define _LIBUNWINDSTACK_ELF_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace unwindstack {
+
+// The lookup tables of an elf that are expensive to build, the sorted
+// symbol remap tables and the fde indices, can be saved into an index file
+// keyed by the build id. Later runs map the file and use the tables directly
+// from it, see Elf::SetIndexCacheDirectory.
+enum ElfIndexType : uint32_t {
+  ELF_INDEX_SYMBOL_REMAP = 1,
+  ELF_INDEX_FDE = 2,
+};
+
+// Identifies which elf interface a table belongs to.
+enum ElfIndexScope : uint32_t {
+  ELF_INDEX_SCOPE_MAIN = 0,
+  ELF_INDEX_SCOPE_GNU_DEBUGDATA = 1,
+};
+
+// A read only index file mapped into memory.
+class ElfIndexFile {
+ public:
+  ElfIndexFile() = default;
+  ~ElfIndexFile();
+
+  ElfIndexFile(const ElfIndexFile&) = delete;
+  ElfIndexFile& operator=(const ElfIndexFile&) = delete;
+
+  // Returns nullptr if the file does not exist, is corrupted or was not
+  // written for build_id.
+  static std::shared_ptr<ElfIndexFile> Open(const std::string& path, const std::string& build_id);
+  // The same for an fd from another process, such as a memfd from
+  // WriteToMemfd. Returns nullptr unless the fd is sealed against writes,
+  // shrinking and growing, so the sender cannot change or truncate the
+  // file under the mapping. The fd is not kept open, the mapping stays
+  // valid after it is closed.
+  static std::shared_ptr<ElfIndexFile> OpenFd(int fd, const std::string& build_id);
+
+  // The id is chosen by the owner of the table, usually the offset of the
+  // section that the table indexes. The data is always 8 byte aligned.
+  bool Find(ElfIndexType type, ElfIndexScope scope, uint64_t id, const void** data,
+            size_t* size) const;
+
+ private:
+  static std::shared_ptr<ElfIndexFile> Map(int fd, const std::string& build_id);
+
+  bool Validate(const std::string& build_id);
+
+  void* map_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Collects tables and writes them into an index file.
+class ElfIndexWriter {
+ public:
+  ElfIndexWriter() = default;
+  ~ElfIndexWriter() = default;
+
+  // The data is copied.
+  void Add(ElfIndexType type, ElfIndexScope scope, uint64_t id, const void* data, size_t size);
+
+  // The file is written to a temporary name and then renamed, so readers in
+  // other processes never see a partial file.
+  bool Write(const std::string& path, const std::string& build_id);
+
+  // Writes the index into a new sealed memfd, which can be handed to other
+  // processes and mapped with ElfIndexFile::OpenFd. Returns the fd, which
+  // the caller closes, or -1 if memfds are not supported.
+  int WriteToMemfd(const std::string& build_id);
+
+  bool empty() { return tables_.empty(); }
+
+ private:
+  void GetContents(const std::string& build_id, std::vector<uint8_t>* contents);
+
+  struct Table {
+    ElfIndexType type;
+    ElfIndexScope scope;
+    uint64_t id;
+    std::vector<uint8_t> data;
+  };
+  std::vector<Table> tables_;
+};
+
+// Shares the index files between processes that do not have a common index
+// cache directory, see Elf::SetIndexStore. The index of an elf is looked up
+// by build id when the elf is initialized. If there is none, the index is
+// built, written to a memfd, and added. How the fds get from one process to
+// another, for example over a unix domain socket, is up to the store.
+class ElfIndexStore {
+ public:
+  virtual ~ElfIndexStore() = default;
+
+  // Returns an fd of the index of build_id, which the caller closes, or -1.
+  virtual int Find(const std::string& build_id) = 0;
+
+  // Called with the fd of an index that was just built. The fd is closed
+  // after the call, the store has to dup it to keep it.
+  virtual void Add(const std::string& build_id, int fd) = 0;
+};
+
+// A store that keeps the fds in this process. Fds received from another
+// process are passed to Add, which ignores fds that are not sealed, and the
+// fds to send to another process come from Find. Thread safe.
+class ElfIndexFdStore : public ElfIndexStore {
+ public:
+  ElfIndexFdStore() = default;
+  virtual ~ElfIndexFdStore();
+
+  int Find(const std::string& build_id) override;
+  void Add(const std::string& build_id, int fd) override;
+
+  std::vector<std::string> GetBuildIds();
+
+  void Clear();
+
+ private:
+  std::mutex lock_;
+  std::unordered_map<std::string, int> fds_;
+};
+
+// An array that either owns its elements, or borrows them from a mapped
+// index file, or any other shared owner, that it keeps alive.
+template <typename T>
+class ElfIndexArray {
+ public:
+  ElfIndexArray() = default;
+  ElfIndexArray(std::vector<T>&& values) : owned_(std::move(values)) { Reset(); }
+  ElfIndexArray(std::shared_ptr<const void> owner, const T* data, size_t size)
+      : owner_(std::move(owner)), data_(data), size_(size) {}
+
+  ElfIndexArray(const ElfIndexArray&) = delete;
+  ElfIndexArray& operator=(const ElfIndexArray&) = delete;
+  ElfIndexArray(ElfIndexArray&& other) { *this = std::move(other); }
+  ElfIndexArray& operator=(ElfIndexArray&& other) {
+    owned_ = std::move(other.owned_);
+    owner_ = std::move(other.owner_);
+    if (owner_ == nullptr) {
+      Reset();
+    } else {
+      data_ = other.data_;
+      size_ = other.size_;
+    }
+    other.owned_.clear();
+    other.Reset();
+    return *this;
+  }
+
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  const T& operator[](size_t index) const { return data_[index]; }
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Only the owned elements are counted.
+  size_t MemoryUsage() const { return owned_.capacity() * sizeof(T); }
+
+ private:
+  void Reset() {
+    data_ = owned_.data();
+    size_ = owned_.size();
+  }
+
+  std::vector<T> owned_;
+  std::shared_ptr<const void> owner_;
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_ELF_INDEX_H
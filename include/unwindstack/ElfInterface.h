@@ -20,13 +20,18 @@
 #include <elf.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include <unwindstack/DwarfSection.h>
+#include <unwindstack/ElfIndex.h>
 #include <unwindstack/Error.h>
+#include <unwindstack/OffsetMemo.h>
 #include <unwindstack/SharedString.h>
 
 namespace unwindstack {
@@ -36,6 +41,14 @@ class Memory;
 class Regs;
 class Symbols;
 
+// A function symbol with a size, as found in one of the symbol tables.
+struct FunctionSymbol {
+  uint64_t start;
+  uint32_t size;
+  uint32_t name_offset;  // Offset into the string table of the table.
+  uint32_t table;        // Index of the symbol table.
+};
+
 struct LoadInfo {
   uint64_t offset;
   uint64_t table_offset;
@@ -53,6 +66,7 @@ struct ElfTypes32 {
   using Dyn = Elf32_Dyn;
   using Ehdr = Elf32_Ehdr;
   using Nhdr = Elf32_Nhdr;
+  using Chdr = Elf32_Chdr;
   using Phdr = Elf32_Phdr;
   using Shdr = Elf32_Shdr;
   using Sym = Elf32_Sym;
@@ -63,6 +77,7 @@ struct ElfTypes64 {
   using Dyn = Elf64_Dyn;
   using Ehdr = Elf64_Ehdr;
   using Nhdr = Elf64_Nhdr;
+  using Chdr = Elf64_Chdr;
   using Phdr = Elf64_Phdr;
   using Shdr = Elf64_Shdr;
   using Sym = Elf64_Sym;
@@ -81,6 +96,13 @@ class ElfInterface {
 
   virtual bool GetFunctionName(uint64_t addr, SharedString* name, uint64_t* offset) = 0;
 
+  // See Elf::GetFunctionNameView.
+  virtual bool GetFunctionNameView(uint64_t addr, std::string_view* name, uint64_t* offset) = 0;
+
+  // See Elf::GetFunctionNames.
+  virtual void GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                                uint64_t* offsets, bool* found);
+
   virtual bool GetGlobalVariable(const std::string& name, uint64_t* memory_address) = 0;
 
   virtual std::string GetBuildID() = 0;
@@ -88,6 +110,33 @@ class ElfInterface {
   virtual bool Step(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
                     bool* is_signal_frame);
 
+  // Thread safe version of Step that only succeeds for pcs whose unwind rows
+  // are already cached, in the section Step last found the pc in. See
+  // DwarfSection::StepFromCache.
+  bool StepFromCache(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
+                     bool* is_signal_frame);
+
+  // Pins the cached row of rel_pc in the section StepFromCache uses, see
+  // DwarfSection::PinRow.
+  bool PinRow(uint64_t rel_pc);
+
+  // Version of Step that never allocates, see DwarfSection::StepCompiled.
+  bool StepCompiled(uint64_t rel_pc, Regs* regs, Memory* process_memory, bool* finished,
+                    bool* is_signal_frame);
+
+  // Uses the same sections, in the same order, as Step. See
+  // DwarfSection::GetFramePointerRule for the lock.
+  FramePointerRule GetFramePointerRule(uint64_t rel_pc, ArchEnum arch,
+                                       std::unique_lock<std::mutex>* lock = nullptr);
+
+  // Thread safe version of GetFramePointerRule that only succeeds for pcs
+  // whose fde is already published, see DwarfSection::GetCachedFramePointerRule.
+  bool GetCachedFramePointerRule(uint64_t rel_pc, ArchEnum arch, FramePointerRule* rule);
+
+  // Returns true if any of the dwarf sections, including the ones of the
+  // gnu_debugdata, has an fde for rel_pc.
+  bool HasFde(uint64_t rel_pc);
+
   virtual bool IsValidPc(uint64_t pc);
 
   bool GetTextRange(uint64_t* addr, uint64_t* size);
@@ -123,6 +172,54 @@ class ElfInterface {
   DwarfSection* eh_frame() { return eh_frame_.get(); }
   DwarfSection* debug_frame() { return debug_frame_.get(); }
 
+  void SetCompiledUnwindTables(bool enable);
+
+  void SetFdeIndexThreads(size_t threads);
+
+  // Compiles the unwind tables of every fde, including the ones in the
+  // gnu_debugdata section.
+  void CompileUnwindTables(ArchEnum arch);
+
+  void SetFlatSymbolTables(bool enable);
+
+  // Build the lookup tables of the unwind sections and of the symbols now,
+  // instead of on the first lookup.
+  virtual void PreloadUnwindInfo();
+  virtual void PreloadSymbols() {}
+
+  // Tells the symbol tables that BuildSymbolsInBackground is going to be
+  // called, so that lookups until then do not build the sorted tables
+  // themselves. Must be called before any lookups.
+  void SetSymbolsPending() { symbols_pending_ = true; }
+  // Builds the sorted symbol tables while lookups go on.
+  virtual void BuildSymbolsInBackground() {}
+
+  // Appends the function symbols of every symbol table, in the order the
+  // tables are searched, each table sorted by address without duplicates.
+  virtual void GetFunctionSymbols(std::vector<FunctionSymbol>*) {}
+  // Reads the name of a symbol returned by GetFunctionSymbols.
+  virtual bool GetFunctionSymbolName(uint32_t, uint32_t, SharedString*) { return false; }
+
+  // Adds the approximate bytes of heap memory used by the cached headers,
+  // symbols and unwind sections. Does not include the gnu_debugdata interface.
+  virtual void GetMemoryUsage(ElfMemoryUsage* usage);
+  size_t MemoryUsage() {
+    ElfMemoryUsage usage;
+    GetMemoryUsage(&usage);
+    return usage.Total();
+  }
+
+  // Adds the lookup tables of the symbols and unwind sections to the index,
+  // building any that do not exist yet.
+  virtual void SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope);
+
+  // Uses the lookup tables from the index file instead of building them.
+  void LoadIndex(const std::shared_ptr<ElfIndexFile>& file, ElfIndexScope scope);
+
+  // Shares the fde indices of the unwind sections with every other elf
+  // with the same build id, see DwarfSection::ShareIndex.
+  void ShareIndex(const std::string& build_id, ElfIndexScope scope);
+
   const ErrorData& last_error() { return last_error_; }
   ErrorCode LastErrorCode() { return last_error_.code; }
   uint64_t LastErrorAddress() { return last_error_.address; }
@@ -133,11 +230,36 @@ class ElfInterface {
   template <typename EhdrType, typename ShdrType, typename NhdrType>
   static std::string ReadBuildIDFromMemory(Memory* memory);
 
+  // Reads what is in the memory of a process that loaded the elf, which
+  // has no section headers: the build id from the PT_NOTE segments, empty
+  // if there is none, and the end of the file data of the PT_LOAD segments.
+  template <typename EhdrType, typename PhdrType, typename NhdrType>
+  static bool ReadLoadedInfo(Memory* memory, std::string* build_id, uint64_t* loaded_size);
+
  protected:
   virtual void HandleUnknownType(uint32_t, uint64_t, uint64_t) {}
 
+  // Steps with the section of source, one of UnwindSource.
+  bool StepSource(uint8_t source, uint64_t pc, Regs* regs, Memory* process_memory, bool* finished,
+                  bool* is_signal_frame);
+  // Remembers that no section has an fde for pc, if the error says so.
+  void SetNoUnwindSource(uint64_t pc);
+
+  // Builds executable_ranges_ from pt_loads_.
+  void InitExecutableRanges();
+
+  // Creates the symbol tables found by the section headers. Nothing needed
+  // by Step uses them, so they are only created by the first name lookup.
+  void InitSymbols();
+
   Memory* memory_;
   std::unordered_map<uint64_t, LoadInfo> pt_loads_;
+  // The pc ranges of pt_loads_, sorted and merged, used by IsValidPc.
+  struct PcRange {
+    uint64_t start;
+    uint64_t end;
+  };
+  std::vector<PcRange> executable_ranges_;
 
   // Stored elf data.
   uint64_t dynamic_offset_ = 0;
@@ -176,10 +298,52 @@ class ElfInterface {
 
   std::unique_ptr<DwarfSection> eh_frame_;
   std::unique_ptr<DwarfSection> debug_frame_;
+  // The source of the unwind information of the recent pcs given to Step,
+  // so that a pc is searched for in one section only, or in none when no
+  // section has an fde for it.
+  enum UnwindSource : uint8_t {
+    UNWIND_SOURCE_DEBUG_FRAME = 1,
+    UNWIND_SOURCE_EH_FRAME,
+    UNWIND_SOURCE_GNU_DEBUGDATA,
+    UNWIND_SOURCE_NONE,
+  };
+  static constexpr size_t kNumUnwindSources = 128;
+  OffsetMemo<kNumUnwindSources> unwind_sources_;
+  // The decompressed data of the sections with the SHF_COMPRESSED flag.
+  // When the .debug_frame is one of them, it is read from offset zero of
+  // debug_frame_memory_, and debug_frame_size_ is the decompressed size.
+  std::vector<std::shared_ptr<Memory>> decompressed_sections_;
+  Memory* debug_frame_memory_ = nullptr;
   // The Elf object owns the gnu_debugdata interface object.
   ElfInterface* gnu_debugdata_interface_ = nullptr;
 
+  struct SymbolTable {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t entry_size;
+    uint64_t str_offset;
+    uint64_t str_size;
+    // The .gnu.hash or .hash section of the table, if there is one.
+    uint64_t hash_offset = 0;
+    uint64_t hash_size = 0;
+    bool gnu_hash = false;
+    // Set when the tables are compressed, then the offsets are into this
+    // memory rather than the elf.
+    std::shared_ptr<Memory> memory;
+  };
+  std::vector<SymbolTable> symbol_tables_;
+  bool flat_symbol_tables_ = false;
+  bool symbols_pending_ = false;
+  std::shared_ptr<ElfIndexFile> index_file_;
+  ElfIndexScope index_scope_ = ELF_INDEX_SCOPE_MAIN;
+
+  std::once_flag symbols_once_;
+  std::atomic<bool> symbols_initialized_ = false;
   std::vector<Symbols*> symbols_;
+  Memory* symbol_memory(size_t index) {
+    Memory* memory = symbol_tables_[index].memory.get();
+    return memory != nullptr ? memory : memory_;
+  }
   std::vector<std::pair<uint64_t, uint64_t>> strtabs_;
 };
 
@@ -187,6 +351,7 @@ template <typename ElfTypes>
 class ElfInterfaceImpl : public ElfInterface {
  public:
   using AddressType = typename ElfTypes::AddressType;
+  using ChdrType = typename ElfTypes::Chdr;
   using DynType = typename ElfTypes::Dyn;
   using EhdrType = typename ElfTypes::Ehdr;
   using NhdrType = typename ElfTypes::Nhdr;
@@ -205,10 +370,22 @@ class ElfInterfaceImpl : public ElfInterface {
 
   bool GetFunctionName(uint64_t addr, SharedString* name, uint64_t* func_offset) override;
 
+  bool GetFunctionNameView(uint64_t addr, std::string_view* name, uint64_t* func_offset) override;
+
+  void GetFunctionNames(const uint64_t* addrs, size_t count, SharedString* names,
+                        uint64_t* offsets, bool* found) override;
+
   bool GetGlobalVariable(const std::string& name, uint64_t* memory_address) override;
 
   std::string GetBuildID() override { return ReadBuildID(); }
 
+  void SaveIndex(ElfIndexWriter* writer, ElfIndexScope scope) override;
+
+  void PreloadSymbols() override;
+  void BuildSymbolsInBackground() override;
+  void GetFunctionSymbols(std::vector<FunctionSymbol>* functions) override;
+  bool GetFunctionSymbolName(uint32_t table, uint32_t name_offset, SharedString* name) override;
+
   static void GetMaxSize(Memory* memory, uint64_t* size);
 
  protected:
@@ -218,6 +395,15 @@ class ElfInterfaceImpl : public ElfInterface {
 
   void ReadSectionHeaders(const EhdrType& ehdr);
 
+  // Returns the decompressed data of a section with the SHF_COMPRESSED
+  // flag, and sets size to its size. Only zlib is supported.
+  Memory* DecompressSection(const ShdrType& shdr, uint64_t* size);
+
+  // Points table at a memory holding the decompressed symbol table at its
+  // original offset, followed by the string table.
+  bool InitCompressedSymbolTable(const ShdrType& shdr, const ShdrType& str_shdr,
+                                 SymbolTable* table);
+
   std::string ReadBuildID();
 };
 
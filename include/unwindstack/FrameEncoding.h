@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_FRAME_ENCODING_H
+#define _LIBUNWINDSTACK_FRAME_ENCODING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <unwindstack/SharedString.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Maps;
+
+// A compact binary encoding of the frames of many unwinds, a dump, instead
+// of the text of FormatFrame. A dump is a stream of records. Every map and
+// function name is written once, the first time a frame uses it, and the
+// frames refer to them by index. The pcs and sps of a trace are stored as
+// the difference to those of the previous frame, and the rel_pc as the
+// difference to the value expected from the map, all as varints, so most
+// frames take a few bytes.
+
+// A map of a dump, with the build id of its elf if it is known.
+struct EncodedMap {
+  uint64_t start = 0;
+  uint64_t end = 0;
+  uint64_t exact_offset = 0;
+  uint64_t elf_start_offset = 0;
+  uint64_t load_bias = 0;
+  int flags = 0;
+  SharedString name;
+  std::string build_id;
+};
+
+// Encodes traces into data(). Not thread safe.
+//
+//   FrameEncoder encoder(maps);
+//   encoder.BeginTrace();
+//   unwinder.UnwindWithCallback(encoder.Callback());
+//   encoder.EndTrace();
+class FrameEncoder {
+ public:
+  // The build id of each map is read from the map of maps that starts at
+  // the same address, if maps is set.
+  explicit FrameEncoder(Maps* maps = nullptr) : maps_(maps) {}
+  ~FrameEncoder() = default;
+
+  void BeginTrace();
+  void AddFrame(const FrameData& frame);
+  void EndTrace();
+
+  // Adds the frames of a complete trace.
+  void AddTrace(const std::vector<FrameData>& frames);
+
+  // A callback for Unwinder::UnwindWithCallback that adds every frame. It
+  // refers to this object, which must outlive it.
+  Unwinder::FrameCallback Callback() {
+    return [this](const FrameData& frame) {
+      AddFrame(frame);
+      return true;
+    };
+  }
+
+  // The records encoded so far. They can be sent and cleared with
+  // ClearData after each trace; the next data then continues the same dump,
+  // and refers to the maps and names already sent.
+  const std::vector<uint8_t>& data() const { return data_; }
+  void ClearData() { data_.clear(); }
+
+  // Starts a new dump, which repeats the maps and names.
+  void Reset();
+
+ private:
+  uint32_t GetMapIndex(const FrameData& frame);
+  uint32_t GetNameIndex(const SharedString& name);
+
+  void WriteVarint(uint64_t value);
+  void WriteSigned(int64_t value);
+  void WriteString(std::string_view value);
+
+  Maps* maps_;
+  std::vector<uint8_t> data_;
+  bool started_ = false;
+
+  std::vector<EncodedMap> map_table_;
+  std::unordered_map<uint64_t, uint32_t> map_indices_;
+  std::unordered_map<std::string, uint32_t> name_indices_;
+
+  // The frame before the one being added in the current trace.
+  uint64_t prev_pc_ = 0;
+  uint64_t prev_sp_ = 0;
+};
+
+// A decoded trace. map_indices has the index in FrameDecoder::maps() of
+// the map of every frame, or kNoMap.
+struct DecodedTrace {
+  static constexpr uint32_t kNoMap = UINT32_MAX;
+
+  std::vector<FrameData> frames;
+  std::vector<uint32_t> map_indices;
+};
+
+// Decodes the data of a FrameEncoder. Not thread safe.
+class FrameDecoder {
+ public:
+  FrameDecoder() = default;
+  ~FrameDecoder() = default;
+
+  // Decodes the records in data, and appends the complete traces to traces.
+  // data can be the whole dump, or any of the pieces sent between calls to
+  // FrameEncoder::ClearData, in order. Returns false if the data is not
+  // valid, the traces decoded before the error are still appended.
+  bool Decode(const uint8_t* data, size_t size, std::vector<DecodedTrace>* traces);
+
+  const std::vector<EncodedMap>& maps() const { return maps_; }
+
+  void Reset();
+
+ private:
+  std::vector<EncodedMap> maps_;
+  std::vector<SharedString> names_;
+  bool started_ = false;
+
+  DecodedTrace trace_;
+  bool in_trace_ = false;
+  uint64_t prev_pc_ = 0;
+  uint64_t prev_sp_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_FRAME_ENCODING_H
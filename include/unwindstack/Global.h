@@ -17,6 +17,7 @@
 #ifndef _LIBUNWINDSTACK_GLOBAL_H
 #define _LIBUNWINDSTACK_GLOBAL_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <memory>
@@ -44,10 +45,23 @@ class Global {
 
   ArchEnum arch() { return arch_; }
 
+  // The number of threads that open the elfs of the maps that might have
+  // the variable, at most one per candidate map. 0 uses one per cpu. The
+  // default is 1, the maps are searched on the calling thread.
+  static void SetSearchThreads(size_t threads) { search_threads_ = threads; }
+
  protected:
   bool Searchable(const std::string& name);
   void FindAndReadVariable(Maps* maps, const char* variable);
 
+  // A read-only map at offset zero, and the read-write map of the same
+  // file that should contain the variable.
+  struct Candidate {
+    MapInfo* map_zero;
+    MapInfo* info;
+  };
+  bool GetVariableAddress(const Candidate& candidate, const std::string& variable, uint64_t* addr);
+
   virtual bool ReadVariableData(uint64_t offset) = 0;
 
   virtual void ProcessArch() = 0;
@@ -56,6 +70,8 @@ class Global {
 
   std::shared_ptr<Memory> memory_;
   std::vector<std::string> search_libs_;
+
+  static size_t search_threads_;
 };
 
 }  // namespace unwindstack
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_INTERLEAVED_UNWINDER_H
+#define _LIBUNWINDSTACK_INTERLEAVED_UNWINDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+// Unwinds many samples of one process on one thread when reading their
+// memory is slow, such as the memory of a remote process or of a capture
+// that is downloaded on demand. An unwind that reads memory that was not
+// read yet is suspended, and the memory wanted by all of the suspended
+// unwinds is read with a single Memory::ReadBatch, which for a remote
+// process is as few process_vm_readv calls as possible, before they are
+// resumed.
+//
+// An unwind is resumed by unwinding it again from its first frame, every
+// memory read it did before is then answered from the pages already read,
+// and the elf objects it found are still in the maps. The results are
+// the same as those of Unwinder::UnwindBatch with the memory read up
+// front.
+//
+// Only the reads of the samples go through the pages, the elf objects of
+// the maps are created from the process memory of the unwinder as usual.
+// The unwinder must not have a stack suffix cache.
+class InterleavedUnwinder {
+ public:
+  // memory is the slow memory the samples are read from, in pages of
+  // page_size bytes.
+  InterleavedUnwinder(Unwinder* unwinder, std::shared_ptr<Memory> memory,
+                      size_t page_size = 4096);
+  ~InterleavedUnwinder();
+
+  // Adds an unwind of a copy of regs. Returns its index in the results.
+  size_t Add(Regs* regs);
+
+  // Runs every unwind that is not done until it finishes or is suspended,
+  // then reads the memory the suspended ones are waiting for. Returns false
+  // if every unwind is done.
+  bool Step();
+
+  // Runs Step until every unwind is done, and returns the result of each
+  // one in the order they were added. New unwinds can be added afterwards,
+  // and reuse the pages already read.
+  std::vector<UnwindBatchResult> Run();
+
+  // The results so far, only complete once Step returns false.
+  std::vector<UnwindBatchResult>& results() { return results_; }
+
+  // The number of times Step suspended unwinds and read memory, and the
+  // pages read.
+  size_t rounds() const { return rounds_; }
+  size_t pages_read() const { return pages_read_; }
+
+ private:
+  class PageStore;
+  class SampleMemory;
+
+  struct Pending {
+    size_t index;
+    std::unique_ptr<Regs> regs;
+    std::shared_ptr<SampleMemory> memory;
+  };
+
+  Unwinder* unwinder_;
+  std::unique_ptr<PageStore> store_;
+  std::vector<Pending> pending_;
+  std::vector<UnwindBatchResult> results_;
+  size_t rounds_ = 0;
+  size_t pages_read_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_INTERLEAVED_UNWINDER_H
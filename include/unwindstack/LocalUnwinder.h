@@ -21,13 +21,18 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <unwindstack/Error.h>
+#include <unwindstack/MapNameFilter.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
 
 namespace unwindstack {
 
@@ -59,13 +64,62 @@ struct LocalFrameData {
 class LocalUnwinder {
  public:
   LocalUnwinder() = default;
-  LocalUnwinder(const std::vector<std::string>& skip_libraries) : skip_libraries_(skip_libraries) {}
-  ~LocalUnwinder() = default;
+  LocalUnwinder(const std::vector<std::string>& skip_libraries) : skip_libraries_(skip_libraries) {
+    skip_filter_.Set(&skip_libraries_, nullptr, true);
+  }
+  ~LocalUnwinder();
 
   bool Init();
 
+  // Makes Init only record the settings, and defers parsing the maps and
+  // creating the process memory to the first call that needs them, or to
+  // InitInBackground. Must be called before Init. This is disabled by
+  // default.
+  void SetLazyInit(bool enable) { lazy_init_ = enable; }
+
+  // With lazy init, does the deferred work on a new thread, so that it is
+  // usually done before the first unwind. An unwind started before it is
+  // done waits for it. Must be called after Init.
+  void InitInBackground();
+
+  // Builds the maps from the objects loaded by the dynamic linker, see
+  // LocalUpdatableMaps::ParseLoadedObjects, instead of parsing the maps
+  // file. Must be called before Init. This is disabled by default.
+  void SetMapsFromLoadedObjects(bool enable) { maps_from_loaded_objects_ = enable; }
+
+  // Lets Unwind read the stack of the calling thread and the read only maps
+  // of libraries directly, instead of with a system call per read. Must be
+  // called before Init. This is disabled by default.
+  void SetDirectMemoryReads(bool enable) { direct_memory_reads_ = enable; }
+
   bool Unwind(std::vector<LocalFrameData>* frame_info, size_t max_frames);
 
+  // Prepares for UnwindFromSignal by creating the elf objects of all of the
+  // executable maps and compiling their unwind tables, so that no state has
+  // to be created inside of a signal handler. Up to max_concurrent calls to
+  // UnwindFromSignal can run at the same time. With maps from the loaded
+  // objects, this parses the maps file as well, so that the stacks are
+  // known. Must be called after Init, and not at the same time as any other
+  // call on this object.
+  bool PrepareSignalUnwind(size_t max_concurrent = 8);
+
+  // Unwinds from the ucontext passed to a signal handler, and writes the pc
+  // of each frame to pcs and, if sps is not nullptr, the sp to sps. Returns
+  // the number of frames written. This is async-signal-safe: it never
+  // allocates or waits for a lock. The unwind stops at the first frame that
+  // cannot be unwound that way, for example one in a library loaded after
+  // PrepareSignalUnwind, or when the interrupted thread holds a lock needed.
+  size_t UnwindFromSignal(void* ucontext, uint64_t* pcs, uint64_t* sps, size_t max_frames);
+
+  // On arm64 and x86_64, let UnwindFromSignal continue through the frames
+  // it cannot unwind with the compiled tables by following the frame
+  // record pointed to by the frame pointer, instead of stopping. Frames
+  // found that way can be wrong or missing when a function does not keep a
+  // frame record, for example the crashing leaf function. The record has to
+  // be in a stack map known to PrepareSignalUnwind, so it is not followed on
+  // the stack of a thread created after it. This is disabled by default.
+  void SetSignalFramePointerFallback(bool enable) { signal_frame_pointer_fallback_ = enable; }
+
   bool ShouldSkipLibrary(const std::string& map_name);
 
   MapInfo* GetMapInfo(uint64_t pc);
@@ -74,11 +128,29 @@ class LocalUnwinder {
   uint64_t LastErrorAddress() { return last_error_.address; }
 
  private:
+  // Creates the maps and the process memory, only once.
+  bool InitOnce();
+  bool InitState();
+
   pthread_rwlock_t maps_rwlock_;
   std::unique_ptr<LocalUpdatableMaps> maps_ = nullptr;
   std::shared_ptr<Memory> process_memory_;
   std::vector<std::string> skip_libraries_;
+  MapNameFilter skip_filter_;
   ErrorData last_error_;
+
+  // Uncached memory and preallocated regs used by UnwindFromSignal.
+  std::shared_ptr<Memory> signal_memory_;
+  std::vector<std::unique_ptr<Regs>> signal_regs_;
+  std::unique_ptr<std::atomic_bool[]> signal_regs_busy_;
+  bool signal_frame_pointer_fallback_ = false;
+  bool direct_memory_reads_ = false;
+
+  bool lazy_init_ = false;
+  bool maps_from_loaded_objects_ = false;
+  std::once_flag init_once_;
+  bool init_result_ = false;
+  std::thread init_thread_;
 };
 
 }  // namespace unwindstack
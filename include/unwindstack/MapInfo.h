@@ -17,9 +17,11 @@
 #ifndef _LIBUNWINDSTACK_MAP_INFO_H
 #define _LIBUNWINDSTACK_MAP_INFO_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -29,6 +31,9 @@
 
 namespace unwindstack {
 
+class FailedFileCache;
+class FileInfoCache;
+class MemoryElfCache;
 class MemoryFileAtOffset;
 
 struct MapInfo {
@@ -58,8 +63,26 @@ struct MapInfo {
         build_id(0) {
     if (prev_real_map != nullptr) prev_real_map->next_real_map = this;
   }
+  MapInfo(MapInfo* prev_map, MapInfo* prev_real_map, uint64_t start, uint64_t end, uint64_t offset,
+          uint64_t flags, SharedString name)
+      : start(start),
+        end(end),
+        offset(offset),
+        flags(flags),
+        name(std::move(name)),
+        prev_map(prev_map),
+        prev_real_map(prev_real_map),
+        load_bias(INT64_MAX),
+        build_id(0) {
+    if (prev_real_map != nullptr) prev_real_map->next_real_map = this;
+  }
   ~MapInfo();
 
+  // MapInfo objects are carved out of shared slabs rather than allocated
+  // one at a time, a process can have thousands of them.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   uint64_t start = 0;
   uint64_t end = 0;
   uint64_t offset = 0;
@@ -100,9 +123,20 @@ struct MapInfo {
   // Set to true if the elf file data is coming from memory.
   bool memory_backed_elf = false;
 
+  // The same map in the maps of the process this one was forked from, see
+  // ForkedMaps. The elf, build id and load bias of that map are used.
+  MapInfo* base_map = nullptr;
+
+  // The results of the last MapNameFilter to look at this map.
+  std::atomic_uint64_t filter_flags = 0;
+
   // This function guarantees it will never return nullptr.
   Elf* GetElf(const std::shared_ptr<Memory>& process_memory, ArchEnum expected_arch);
 
+  // Returns the elf if it was already created, or nullptr. This never
+  // waits for the lock, so it can be used from a signal handler.
+  Elf* GetElfIfCreated();
+
   uint64_t GetLoadBias(const std::shared_ptr<Memory>& process_memory);
 
   Memory* CreateMemory(const std::shared_ptr<Memory>& process_memory);
@@ -118,17 +152,61 @@ struct MapInfo {
   // Returns the printable version of the build id (hex dump of raw data).
   std::string GetPrintableBuildID();
 
+  // Shares the elf of other, if it was created, where other is the same map
+  // in an older list of the maps that may still be in use.
+  void ShareElf(MapInfo* other);
+
   inline bool IsBlank() { return offset == 0 && flags == 0 && name.empty(); }
 
+  // When enabled, GetBuildID and GetLoadBias of a file backed map without
+  // an elf object look in a process wide cache keyed by the identity of the
+  // file before reading the elf headers, so the maps of one file in many
+  // processes only read them once. Not thread safe, must be called before
+  // any map uses the cache.
+  static void SetFileInfoCacheEnabled(bool enable);
+  static bool FileInfoCacheEnabled() { return file_info_cache_enabled_; }
+  static void ClearFileInfoCache();
+
+  // When not zero, a file that cannot be opened, or does not contain a
+  // valid elf, is not opened again for any map of it until ttl has passed,
+  // such as for the maps of a deleted file seen in many processes. Not
+  // thread safe, like SetFileInfoCacheEnabled.
+  static void SetFailedFileCacheTtl(std::chrono::milliseconds ttl);
+
+  // When enabled, an elf that is read from the memory of the process
+  // because its file cannot be used is looked up by the build id in its
+  // notes, and the elf made from a copy of that memory is shared by the
+  // maps with the same build id in every process. Not thread safe, like
+  // SetFileInfoCacheEnabled.
+  static void SetMemoryElfCacheEnabled(bool enable);
+  static void ClearMemoryElfCache();
+
  private:
   MapInfo(const MapInfo&) = delete;
   void operator=(const MapInfo&) = delete;
 
+  // Same as the public CreateMemory, which first looks if the file is known
+  // to be unusable, but the caller already did.
+  Memory* CreateMemory(const std::shared_ptr<Memory>& process_memory, bool use_file);
   Memory* GetFileMemory();
+  bool GetElfFromSymbolStore(ArchEnum expected_arch);
+  bool GetElfFromMemoryElfCache(const std::shared_ptr<Memory>& process_memory, Memory** memory,
+                                ArchEnum expected_arch, std::string* build_id);
   bool InitFileMemoryFromPreviousReadOnlyMap(MemoryFileAtOffset* memory);
+  // Makes elf visible to the lock free lookups, mutex_ must be held.
+  Elf* PublishElf();
+  // Takes the elf of other, the mutex_ of both must be held.
+  void CopyElfLocked(MapInfo* other);
+
+  static bool file_info_cache_enabled_;
+  static FileInfoCache* file_info_cache_;
+  static FailedFileCache* failed_file_cache_;
+  static MemoryElfCache* memory_elf_cache_;
 
   // Protect the creation of the elf object.
   std::mutex mutex_;
+  // Set once elf is final, it is read without holding mutex_.
+  std::atomic<Elf*> published_elf_ = nullptr;
 };
 
 }  // namespace unwindstack
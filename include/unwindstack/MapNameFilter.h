@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LIBUNWINDSTACK_MAP_NAME_FILTER_H
+#define _LIBUNWINDSTACK_MAP_NAME_FILTER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace unwindstack {
+
+// Forward declarations.
+struct MapInfo;
+
+// Matches maps against the names to skip and the suffixes to ignore of an
+// unwind. The result is kept in the map along with the generation of the
+// filters, so the name of a map is only looked at once for each set of
+// filters, and every later check is a bit test.
+class MapNameFilter {
+ public:
+  MapNameFilter() = default;
+
+  // Sets the filters, a null vector matches nothing. The names are matched
+  // against the basename of the map, or the whole name if full_names is set.
+  // The suffixes are matched against the part of the name after the last
+  // '.'. Setting the same filters again keeps the results of the maps.
+  void Set(const std::vector<std::string>* names, const std::vector<std::string>* suffixes,
+           bool full_names = false);
+
+  bool MatchesName(MapInfo* info) { return has_names_ && (Flags(info) & kNameMatch); }
+  bool MatchesSuffix(MapInfo* info) { return has_suffixes_ && (Flags(info) & kSuffixMatch); }
+
+ private:
+  static constexpr uint64_t kNameMatch = 1;
+  static constexpr uint64_t kSuffixMatch = 2;
+  static constexpr uint64_t kFlagBits = 2;
+
+  uint64_t Flags(MapInfo* info);
+
+  std::vector<std::string> names_;
+  std::vector<std::string> suffixes_;
+  bool has_names_ = false;
+  bool has_suffixes_ = false;
+  bool full_names_ = false;
+  // Unique to this set of filters, among all of the filter objects.
+  uint64_t generation_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MAP_NAME_FILTER_H
@@ -21,8 +21,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <unwindstack/MapInfo.h>
@@ -36,6 +40,9 @@ static constexpr int MAPS_FLAGS_DEVICE_MAP = 0x8000;
 // created by ART for use with the gdb jit debug interface.
 // This should only ever appear in offline maps data.
 static constexpr int MAPS_FLAGS_JIT_SYMFILE_MAP = 0x4000;
+// Flag to indicate a shared map. Its data can change through another map of
+// the same memory, even if this map is read-only.
+static constexpr int MAPS_FLAGS_SHARED_MAP = 0x2000;
 
 class Maps {
  public:
@@ -47,11 +54,15 @@ class Maps {
   // objects.
   Maps(const Maps&) = delete;
   Maps& operator=(const Maps&) = delete;
-  Maps(Maps&&) = default;
-  Maps& operator=(Maps&&) = default;
+  Maps(Maps&& other);
+  Maps& operator=(Maps&& other);
 
   virtual MapInfo* Find(uint64_t pc);
 
+  // Same as Find, but searches the executable maps first, a much smaller
+  // set in large processes, since that is where the pc of a frame lies.
+  virtual MapInfo* FindPc(uint64_t pc);
+
   virtual bool Parse();
 
   virtual const std::string GetMapsFile() const { return ""; }
@@ -71,13 +82,52 @@ class Maps {
 
   size_t Total() { return maps_.size(); }
 
+  // Changes every time maps are added or removed, so that data derived from
+  // the maps can be tagged with the generation it was computed for.
+  uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+  // Approximate bytes of heap memory held by the map info objects, their
+  // names and the range tables, not by the elf objects.
+  virtual size_t MemoryUsage();
+
   MapInfo* Get(size_t index) {
     if (index >= maps_.size()) return nullptr;
     return maps_[index].get();
   }
 
+  struct MapRange {
+    uint64_t start;
+    uint64_t end;
+  };
+
  protected:
+  friend class SharedMaps;
+
+  // Rebuilds ranges_ from maps_, must be called whenever maps_ changes.
+  void UpdateRanges();
+  // Adds maps_[index] to the executable ranges if it is executable.
+  void AddExecRange(size_t index);
+
+  // Returns a name that shares its storage with every other map of the
+  // same name.
+  SharedString InternName(std::string_view name);
+
+  // Parses maps data in the /proc/<pid>/maps format and appends the entries
+  // to maps_. The content is modified while parsing.
+  bool ParseContent(char* content);
+
   std::vector<std::unique_ptr<MapInfo>> maps_;
+  // The start and end of each entry in maps_, kept contiguous so that
+  // Find does not have to touch the MapInfo objects.
+  std::vector<MapRange> ranges_;
+  // For large lists, the start of every few entries of ranges_, searched
+  // before ranges_ itself.
+  std::vector<uint64_t> range_index_;
+  // The ranges of the executable entries, and their index in maps_.
+  std::vector<MapRange> exec_ranges_;
+  std::vector<size_t> exec_indices_;
+  std::unordered_map<std::string_view, SharedString> names_;
+  std::atomic_uint64_t generation_ = 0;
 };
 
 class RemoteMaps : public Maps {
@@ -91,6 +141,93 @@ class RemoteMaps : public Maps {
   pid_t pid_;
 };
 
+// The maps of a remote process that is unwound over and over, read again
+// with Update. The entries that did not change keep their MapInfo and Elf
+// objects. Unlike LocalUpdatableMaps, the entries that went away are freed,
+// so nothing may use the maps while they are updated.
+class RemoteUpdatableMaps : public RemoteMaps {
+ public:
+  RemoteUpdatableMaps(pid_t pid) : RemoteMaps(pid) {}
+  virtual ~RemoteUpdatableMaps() = default;
+
+  bool Parse() override;
+
+  // Returns true if the maps file is not the same as the last time it was
+  // parsed. The file is read and hashed in chunks, stopping at the first
+  // chunk that differs, and is not parsed.
+  bool Changed();
+
+  // Parses the maps file again if Changed. Sets changed to whether any
+  // entry was added or removed. The ranges of the entries that went away
+  // and of the new entries are appended to removed and added, when they
+  // are not nullptr.
+  bool Update(bool* changed = nullptr, std::vector<MapRange>* added = nullptr,
+              std::vector<MapRange>* removed = nullptr);
+
+ private:
+  // The hashes of the chunks of the maps file as of the last parse.
+  std::vector<uint64_t> chunk_hashes_;
+};
+
+// The maps of a remote process shared by any number of unwinders, in any
+// threads, without copying them. Get returns the current list, which never
+// changes and stays valid for as long as it is held, so an unwinder using it
+// is not affected by a later Update. Update parses the maps into a new list
+// when the maps file changed. The entries that did not change share the elf
+// objects of the old list, and the generation of the new list is newer than
+// that of every older list.
+class SharedMaps {
+ public:
+  SharedMaps(pid_t pid) : pid_(pid) {}
+  ~SharedMaps() = default;
+
+  // Sets changed to whether a new list was made. Returns false if the maps
+  // cannot be read, leaving the current list.
+  bool Update(bool* changed = nullptr);
+
+  // Returns nullptr before the first successful Update.
+  std::shared_ptr<Maps> Get();
+
+ private:
+  pid_t pid_;
+  // Serializes the updates, which do not block Get.
+  std::mutex update_lock_;
+  std::mutex lock_;
+  std::shared_ptr<RemoteUpdatableMaps> maps_;
+};
+
+// The maps of a process forked from another one, the base, such as an app
+// forked from zygote, most of whose maps are inherited from the base. Every
+// entry that is the same as an entry of the base, with the same neighbour,
+// uses the elf, build id and load bias of the entry of the base, which are
+// created the first time any of the processes forked from it needs them.
+// The maps of the hundreds of apps forked from zygote then only create elf
+// objects for their own libraries.
+//
+// base must be parsed first, and is not changed afterwards, it is kept
+// alive by this object. An elf that is read from the memory of a process
+// is read from the memory of the first process that needs it, use
+// MapInfo::SetMemoryElfCacheEnabled so that it does not depend on that
+// process.
+class ForkedMaps : public RemoteMaps {
+ public:
+  ForkedMaps(pid_t pid, std::shared_ptr<Maps> base) : RemoteMaps(pid), base_(std::move(base)) {}
+  virtual ~ForkedMaps() = default;
+
+  bool Parse() override;
+
+  // The number of entries that use an entry of the base.
+  size_t NumInherited() const { return num_inherited_; }
+
+  const std::shared_ptr<Maps>& base() const { return base_; }
+
+ protected:
+  void LinkBaseMaps();
+
+  std::shared_ptr<Maps> base_;
+  size_t num_inherited_ = 0;
+};
+
 class LocalMaps : public RemoteMaps {
  public:
   LocalMaps() : RemoteMaps(getpid()) {}
@@ -103,16 +240,61 @@ class LocalUpdatableMaps : public Maps {
   virtual ~LocalUpdatableMaps() = default;
 
   MapInfo* Find(uint64_t pc) override;
+  // The snapshots have no index of the executable maps.
+  MapInfo* FindPc(uint64_t pc) override { return Find(pc); }
+
+  // Same as Find, but never reparses the maps, so it can be used from a
+  // signal handler.
+  MapInfo* TryFind(uint64_t pc);
+
+  // Same as TryFind, but waits for a reparse in progress, so the entry
+  // comes from the latest parse of the maps.
+  MapInfo* FindCurrent(uint64_t pc);
 
   bool Parse() override;
 
+  // Same as Parse, but builds the maps from the loaded segments of the
+  // objects reported by dl_iterate_phdr, which is much cheaper than reading
+  // the maps file. Only those segments are known, the first Find of any
+  // other address, such as one on a stack, parses the maps file as usual.
+  bool ParseLoadedObjects();
+
   const std::string GetMapsFile() const override;
 
-  bool Reparse();
+  // Rereads the maps while holding the lock. Entries that did not change
+  // keep their MapInfo and Elf objects. The ranges of the entries that went
+  // away and of the new entries are appended to removed and added, when
+  // they are not nullptr, so that callers can drop cached data selectively.
+  bool Update(std::vector<MapRange>* added, std::vector<MapRange>* removed);
+
+  bool Reparse(std::vector<MapRange>* added = nullptr, std::vector<MapRange>* removed = nullptr);
+
+  // Also counts the replaced entries and the old snapshots.
+  size_t MemoryUsage() override;
 
  protected:
+  // An immutable copy of the map list that Find and TryFind search without
+  // taking any lock.
+  struct Snapshot {
+    std::vector<MapRange> ranges;
+    std::vector<uint64_t> range_index;
+    std::vector<MapInfo*> maps;
+  };
+
+  void PublishSnapshot();
+
+  MapInfo* FindInSnapshot(uint64_t pc);
+
   std::vector<std::unique_ptr<MapInfo>> saved_maps_;
 
+  // The current snapshot is the last one. The older ones are kept until
+  // no search is in progress, since a reader may still be searching one.
+  std::vector<std::unique_ptr<Snapshot>> snapshots_;
+  std::atomic<Snapshot*> snapshot_ = nullptr;
+  // The number of searches of a snapshot in progress.
+  std::atomic_int snapshot_readers_ = 0;
+
+  // Only taken by writers, readers use snapshot_.
   pthread_rwlock_t maps_rwlock_;
 };
 
@@ -26,6 +26,73 @@
 
 namespace unwindstack {
 
+// Forward declarations.
+class LocalUpdatableMaps;
+class Maps;
+class MemoryTracer;
+
+// A single read done by Memory::ReadBatch.
+struct MemoryReadRequest {
+  uint64_t addr = 0;
+  void* dst = nullptr;
+  size_t size = 0;
+  // Set to the number of bytes read, which is less than size if the read
+  // was partial.
+  size_t bytes_read = 0;
+};
+
+// The configuration of the caches created by CreateProcessMemoryCached and
+// CreateProcessMemoryThreadCached.
+struct MemoryCacheConfig {
+  enum Eviction : uint8_t {
+    EVICTION_LRU,
+    EVICTION_CLOCK,
+  };
+
+  // The log2 of the page size, between 8 and 16.
+  size_t page_bits = 12;
+  // The maximum number of pages kept, zero means no limit.
+  size_t max_pages = 0;
+  Eviction eviction = EVICTION_LRU;
+  // Reads larger than this go directly to the underlying memory, unless
+  // fill_large_reads is set, in which case they fill all of the pages covered.
+  size_t max_cached_read = 64;
+  bool fill_large_reads = false;
+  // The number of pages after a missing page that are read along with it.
+  size_t prefetch_pages = 1;
+  // Reads the ranges given to Memory::Prefetch on a background thread,
+  // only supported by CreateProcessMemoryCached. The reads of the unwinder
+  // then overlap with the reads of the upcoming stack pages.
+  bool async_prefetch = false;
+  // Shares the pages between all of the threads without a lock for cached
+  // pages, and reads a page missed by several threads at once only once,
+  // only supported by CreateProcessMemoryCached. max_pages then only sizes
+  // the table, eviction, prefetch_pages and async_prefetch are not used.
+  bool concurrent = false;
+};
+
+// The ways the memory of another process can be read.
+enum MemoryRemoteMethod : uint8_t {
+  // One process_vm_readv call per 64 pages.
+  MEMORY_REMOTE_PROCESS_VM_READV,
+  // pread of /proc/<pid>/mem, which also reads pages that are not readable
+  // by the process itself.
+  MEMORY_REMOTE_PROC_MEM,
+  // One PTRACE_PEEKTEXT call per word, the process must be ptrace stopped.
+  MEMORY_REMOTE_PTRACE,
+};
+
+struct MemoryCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  // Reads that were too large to go through the cache.
+  uint64_t uncached_reads = 0;
+  // Pages added by the background prefetch.
+  uint64_t prefetched_pages = 0;
+  size_t pages = 0;
+};
+
 class Memory {
  public:
   Memory() = default;
@@ -33,24 +100,108 @@ class Memory {
 
   static std::shared_ptr<Memory> CreateProcessMemory(pid_t pid);
   static std::shared_ptr<Memory> CreateProcessMemoryCached(pid_t pid);
+  static std::shared_ptr<Memory> CreateProcessMemoryCached(pid_t pid,
+                                                           const MemoryCacheConfig& config);
   static std::shared_ptr<Memory> CreateProcessMemoryThreadCached(pid_t pid);
+  static std::shared_ptr<Memory> CreateProcessMemoryThreadCached(pid_t pid,
+                                                                 const MemoryCacheConfig& config);
+  // The memory of this process, read directly instead of with a system
+  // call where maps and the stack of the calling thread show it is safe.
+  // Not async-signal-safe, and maps must outlive the object.
+  static std::shared_ptr<Memory> CreateLocalMemoryDirect(LocalUpdatableMaps* maps);
   static std::shared_ptr<Memory> CreateOfflineMemory(const uint8_t* data, uint64_t start,
                                                      uint64_t end);
+  // Reads [start, start + size) from data in place, such as the stack of a
+  // perf sample, and everything else from memory, which can be nullptr. The
+  // data is not copied and must outlive the object.
+  static std::shared_ptr<Memory> CreateStackOverlay(const uint8_t* data, uint64_t start,
+                                                    size_t size, std::shared_ptr<Memory> memory);
   static std::unique_ptr<Memory> CreateFileMemory(const std::string& path, uint64_t offset,
                                                   uint64_t size = UINT64_MAX);
 
+  // Sets the methods used to read the memory of other processes, in the
+  // order they are tried, for the objects created after this call. An
+  // object keeps using the first method that reads any data. When that
+  // method only reads part of a request, the methods after it are tried for
+  // the rest, except ptrace, which is too slow to be a fallback. The
+  // default is process_vm_readv, then /proc/<pid>/mem, then ptrace.
+  static void SetRemoteReadMethods(const MemoryRemoteMethod* methods, size_t count);
+
+  // Lets the memory of this process, created after this call, copy data
+  // directly instead of with process_vm_readv, through a SIGSEGV and SIGBUS
+  // handler that turns a fault into a failed read. Only a read that faults
+  // is done again with process_vm_readv. Enabling installs the handler,
+  // which passes any other fault to the handler installed before it, so
+  // this must be called after the handlers of the application are set.
+  // This is disabled by default.
+  static void SetLocalFaultSafeReads(bool enable);
+
+  // Wraps memory so that every read goes to tracer under name. Direct
+  // pointers are not handed out, so none of the reads bypass the tracer.
+  static std::shared_ptr<Memory> CreateTracedMemory(std::shared_ptr<Memory> memory,
+                                                    const char* name, MemoryTracer* tracer);
+
+  // Sets the tracer given the reads of the remote, cache, file, range and
+  // compressed memory objects, nullptr to stop. The reads are only traced
+  // when the library is built with UNWINDSTACK_MEMORY_TRACE defined.
+  static void SetTracer(MemoryTracer* tracer);
+
   virtual bool ReadString(uint64_t addr, std::string* dst, size_t max_read);
 
   virtual void Clear() {}
 
+  // Drops the cached data that can change while the process runs, by
+  // default everything. A cache that was given maps keeps the pages that
+  // lie in private read-only maps.
+  virtual void ClearWritable() { Clear(); }
+
+  // The maps a cache uses to tell read-only pages from writable ones. Call
+  // Clear if the maps are reparsed.
+  virtual void SetMaps(Maps* /*maps*/) {}
+
+  // Fills in the statistics of a cache, returns false if this object is not
+  // a cache. For a per thread cache, these are the statistics of the caller's
+  // thread.
+  virtual bool GetCacheStats(MemoryCacheStats* /*stats*/) { return false; }
+
+  // Tells this object that the size bytes at addr will be read soon, so a
+  // cache can start reading them in the background. Does nothing by default.
+  virtual void Prefetch(uint64_t /*addr*/, size_t /*size*/) {}
+
   // Get pointer to directly access the data for buffers that support it.
   virtual uint8_t* GetPtr(size_t /*addr*/ = 0) { return nullptr; }
 
+  // Returns a pointer to the size bytes at addr if they are stored in one
+  // contiguous buffer owned by this object, otherwise nullptr. The pointer
+  // is valid until Clear is called or the object is destroyed. Callers are
+  // expected to fall back to Read when this fails.
+  virtual const uint8_t* GetPointer(uint64_t /*addr*/, size_t /*size*/) { return nullptr; }
+
+  // Same as GetPointer for a table of count entries of entry_size bytes each.
+  const uint8_t* GetTablePointer(uint64_t addr, uint64_t count, uint64_t entry_size);
+
+  // The number of bytes of heap memory owned by this object, for example
+  // the data copied into a buffer. Mapped files are not counted.
+  virtual size_t MemoryUsage() { return 0; }
+
   virtual size_t Read(uint64_t addr, void* dst, size_t size) = 0;
   virtual long ReadTag(uint64_t) { return -1; }
 
+  // The bytes covered by one MTE tag.
+  static constexpr uint64_t kTagGranuleSize = 16;
+
+  // Reads the tags of count granules, starting with the one that holds
+  // addr, one tag per byte of tags. Returns the number of tags read, which
+  // stops at the first granule without a tag.
+  virtual size_t ReadTags(uint64_t addr, size_t count, uint8_t* tags);
+
   bool ReadFully(uint64_t addr, void* dst, size_t size);
 
+  // Does all of the reads, possibly with fewer calls into the underlying
+  // storage than doing each Read separately. Returns the number of requests
+  // that were read fully.
+  virtual size_t ReadBatch(MemoryReadRequest* requests, size_t count);
+
   inline bool Read32(uint64_t addr, uint32_t* dst) {
     return ReadFully(addr, dst, sizeof(uint32_t));
   }
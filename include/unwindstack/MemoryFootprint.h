@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_FOOTPRINT_H
+#define _LIBUNWINDSTACK_MEMORY_FOOTPRINT_H
+
+#include <stddef.h>
+
+namespace unwindstack {
+
+// Approximate bytes of heap memory held by elf objects, see
+// Elf::GetMemoryUsage.
+struct ElfMemoryUsage {
+  // The elf and interface objects, the program headers and the section
+  // tables.
+  size_t headers = 0;
+  // The symbol tables, with their sorted caches and remap tables.
+  size_t symbols = 0;
+  // The fde indices and search tables, the arm exidx tables, and the
+  // decoded cies and fdes.
+  size_t unwind_index = 0;
+  // The cached unwind rows and compiled fdes.
+  size_t unwind_rows = 0;
+  // The elf data read into memory, such as the data of elfs that are not
+  // files, decompressed sections and the xz blocks of gnu_debugdata.
+  size_t data = 0;
+
+  size_t Total() const { return headers + symbols + unwind_index + unwind_rows + data; }
+};
+
+// Approximate bytes of heap memory held for unwinding one or more
+// processes, see Unwinder::GetMemoryFootprint and
+// UnwindService::GetMemoryFootprint.
+struct MemoryFootprint {
+  // Every elf is counted once, however many maps use it.
+  ElfMemoryUsage elfs;
+  size_t num_elfs = 0;
+  // The map info objects and their names.
+  size_t maps = 0;
+  // The pages of the process memory caches.
+  size_t memory_cache = 0;
+  // The jit and dex entries, with their elf and dex files.
+  size_t jit = 0;
+  // The frames and caches of the unwinders.
+  size_t unwinder = 0;
+
+  size_t Total() const { return elfs.Total() + maps + memory_cache + jit + unwinder; }
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_FOOTPRINT_H
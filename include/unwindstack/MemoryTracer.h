@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_MEMORY_TRACER_H
+#define _LIBUNWINDSTACK_MEMORY_TRACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace unwindstack {
+
+// Receives the reads of traced memory, see Memory::CreateTracedMemory and
+// Memory::SetTracer. Can be called from several threads at once.
+class MemoryTracer {
+ public:
+  MemoryTracer() = default;
+  virtual ~MemoryTracer() = default;
+
+  // The memory called name was asked for size bytes at addr, and returned
+  // bytes_read of them.
+  virtual void Read(const char* name, uint64_t addr, size_t size, size_t bytes_read) = 0;
+};
+
+struct MemoryReadCounts {
+  static constexpr size_t kNumSizeBuckets = 16;
+
+  uint64_t reads = 0;
+  // Reads that returned fewer bytes than asked for.
+  uint64_t short_reads = 0;
+  uint64_t bytes_requested = 0;
+  uint64_t bytes_read = 0;
+  // size_buckets[i] counts the reads of more than 2^(i-1) and up to 2^i
+  // bytes, the last bucket also counts all of the larger reads.
+  uint64_t size_buckets[kNumSizeBuckets] = {};
+  // The number of reads that start in each region, keyed by the address
+  // of the region.
+  std::map<uint64_t, uint64_t> regions;
+};
+
+// Counts the reads of every memory name. Tracing a cache and the memory it
+// reads from, for example the "cache" and "remote" names of the process
+// memory, shows how much of the traffic the cache absorbs.
+class MemoryReadCounter : public MemoryTracer {
+ public:
+  // The address histogram uses regions of 2^region_shift bytes, pages by
+  // default.
+  explicit MemoryReadCounter(size_t region_shift = 12) : region_shift_(region_shift) {}
+  virtual ~MemoryReadCounter() = default;
+
+  void Read(const char* name, uint64_t addr, size_t size, size_t bytes_read) override;
+
+  // Calls callback with the counts of every name that was read.
+  void ForEach(const std::function<void(const std::string&, const MemoryReadCounts&)>& callback);
+
+  // Returns the counts of name, all zero if it was never read.
+  MemoryReadCounts Get(const std::string& name);
+
+  void Clear();
+
+ private:
+  size_t region_shift_;
+  std::mutex lock_;
+  std::map<std::string, MemoryReadCounts, std::less<>> counts_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_MEMORY_TRACER_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_OFFLINE_CAPTURE_H
+#define _LIBUNWINDSTACK_OFFLINE_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unwindstack/Arch.h>
+#include <unwindstack/Maps.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Memory;
+class MemoryFileAtOffset;
+class MemoryOfflineChunks;
+class Regs;
+class SymbolStore;
+
+// A capture file holds the maps of a process, with the build id of every
+// elf, followed by any number of samples. A sample is the registers of a
+// thread and the chunks of memory needed to unwind it, normally its stack.
+// All values are stored in the byte order of the machine writing the file.
+// The memory of a sample can be stored compressed, it is then decompressed
+// lazily as the sample is unwound.
+
+// Writes a capture file, samples are appended as they are added.
+class OfflineCaptureWriter {
+ public:
+  OfflineCaptureWriter() = default;
+  ~OfflineCaptureWriter();
+
+  // Writes the maps. The elf of every executable map is created, to record
+  // its build id.
+  bool Open(const std::string& file, ArchEnum arch, Maps* maps,
+            const std::shared_ptr<Memory>& process_memory);
+
+  // Compresses the memory of the samples added after this call with zlib.
+  void SetCompression(bool enable) { compression_ = enable; }
+
+  // Adds a sample made of regs and the [start, end) ranges of memory. A
+  // range that cannot be read completely is truncated.
+  bool AddSample(pid_t tid, Regs* regs, Memory* memory,
+                 std::vector<std::pair<uint64_t, uint64_t>> ranges);
+
+  // Writes the sample index. The file is not usable until this is called.
+  bool Finish();
+
+ private:
+  // Writes data and pads the file to a multiple of 8 bytes.
+  bool Write(const void* data, size_t size);
+
+  FILE* fp_ = nullptr;
+  ArchEnum arch_ = ARCH_UNKNOWN;
+  uint64_t offset_ = 0;
+  bool compression_ = false;
+  std::vector<uint64_t> sample_offsets_;
+  std::vector<uint8_t> buffer_;
+  std::vector<uint8_t> compressed_buffer_;
+};
+
+// Reads a capture file. The file is mapped, not copied, and the samples are
+// unwound directly from the mapped data:
+//
+//   OfflineCapture capture;
+//   capture.Init(file, &store);
+//   Unwinder unwinder(max_frames, capture.maps(), capture.regs(), capture.memory());
+//   for (size_t i = 0; i < capture.NumSamples(); i++) {
+//     capture.SetSample(i);
+//     unwinder.Unwind();
+//   }
+class OfflineCapture {
+ public:
+  OfflineCapture();
+  ~OfflineCapture();
+
+  // The elf of a map is looked up by build id in store, if there is one.
+  // Maps not found there use their original path.
+  bool Init(const std::string& file, SymbolStore* store = nullptr);
+
+  ArchEnum arch() { return arch_; }
+  size_t NumSamples() { return num_samples_; }
+
+  Maps* maps() { return &maps_; }
+
+  // Loads sample index into regs() and memory(). The same objects are
+  // reused for every sample, so only one sample can be unwound at a time.
+  bool SetSample(size_t index);
+
+  Regs* regs() { return regs_.get(); }
+  std::shared_ptr<Memory> memory() { return memory_; }
+  pid_t tid() { return tid_; }
+
+ private:
+  std::unique_ptr<MemoryFileAtOffset> file_;
+  const uint8_t* data_ = nullptr;
+  uint64_t size_ = 0;
+
+  ArchEnum arch_ = ARCH_UNKNOWN;
+  Maps maps_;
+
+  const uint64_t* sample_offsets_ = nullptr;
+  size_t num_samples_ = 0;
+
+  std::unique_ptr<Regs> regs_;
+  std::shared_ptr<Memory> memory_;
+  MemoryOfflineChunks* chunks_ = nullptr;
+  pid_t tid_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_OFFLINE_CAPTURE_H
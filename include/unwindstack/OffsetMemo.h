@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LIBUNWINDSTACK_OFFSET_MEMO_H
+#define _LIBUNWINDSTACK_OFFSET_MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace unwindstack {
+
+// A small value kept for the most recent offsets, for answers that are
+// otherwise found by reading the instructions or the unwind information at
+// the offset. Direct mapped, each entry is (offset + 1) << 8 with the value
+// in the low byte, zero if unused. Lock free, so it can be used from a
+// signal handler.
+template <size_t kSize = 32>
+class OffsetMemo {
+ public:
+  bool Find(uint64_t offset, uint8_t* value) {
+    uint64_t entry = entries_[Index(offset)].load(std::memory_order_relaxed);
+    if ((entry >> 8) != offset + 1) {
+      return false;
+    }
+    *value = entry & 0xff;
+    return true;
+  }
+
+  void Set(uint64_t offset, uint8_t value) {
+    entries_[Index(offset)].store(((offset + 1) << 8) | value, std::memory_order_relaxed);
+  }
+
+ private:
+  static size_t Index(uint64_t offset) {
+    return ((offset * 0x9e3779b97f4a7c15ULL) >> 32) % kSize;
+  }
+  std::atomic<uint64_t> entries_[kSize] = {};
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_OFFSET_MEMO_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_PARALLEL_UNWINDER_H
+#define _LIBUNWINDSTACK_PARALLEL_UNWINDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unwindstack/Arch.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+struct ThreadUnwindResult {
+  pid_t tid = 0;
+  // False if the thread could not be stopped or its registers could not be
+  // read, result is then empty.
+  bool captured = false;
+  UnwindBatchResult result;
+  // With ParallelUnwinder::SetGroupIdenticalStacks, the index of the first
+  // thread with the same pcs. The frames of this thread then have no names,
+  // those are only looked up for the first thread. SIZE_MAX otherwise.
+  size_t same_stack_as = SIZE_MAX;
+};
+
+// Unwinds a batch of captured samples from one process using a set of
+// worker threads. All of the workers share the maps, and therefore the
+// elf objects, of the process. The workers take small chunks of samples
+// from a shared counter, so a thread that finishes early keeps taking work
+// until all of the samples are done.
+//
+// The process memory, and the memory of every sample, must be safe to read
+// from multiple threads at the same time.
+class ParallelUnwinder {
+ public:
+  // If num_threads is zero, one thread per cpu is used.
+  ParallelUnwinder(size_t max_frames, Maps* maps, std::shared_ptr<Memory> process_memory,
+                   size_t num_threads = 0);
+  ~ParallelUnwinder() = default;
+
+  // Unwinds all of the samples and returns one result per sample, in the same
+  // order. The same restrictions as for Unwinder::UnwindBatch apply.
+  std::vector<UnwindBatchResult> Unwind(
+      const std::vector<UnwindSample>& samples,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Stops every thread of pid with ptrace, reads the registers of all of
+  // them, unwinds them in parallel and then lets them run again. The maps
+  // and process memory must be those of pid, and pid cannot be the current
+  // process. Returns false if the threads of pid could not be listed.
+  bool UnwindProcess(pid_t pid, std::vector<ThreadUnwindResult>* threads,
+                     const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+                     const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Same as UnwindProcess, using remote maps and a cached process memory
+  // created for pid. Returns false if the maps of pid could not be read.
+  static bool DumpProcess(pid_t pid, size_t max_frames, std::vector<ThreadUnwindResult>* threads,
+                          size_t num_threads = 0, bool group_identical_stacks = false);
+
+  // Formats the frames of threads like Unwinder::FormatFrame. A thread with
+  // the same stack as an earlier one only refers to it.
+  std::string FormatThreads(const std::vector<ThreadUnwindResult>& threads);
+
+  void SetResolveNames(bool resolve) { resolve_names_ = resolve; }
+
+  // Makes UnwindProcess unwind the threads without names, and then look up
+  // the names of each distinct stack of pcs only once, for the first thread
+  // that has it. Processes often have many idle threads with the same
+  // stack. This is disabled by default.
+  void SetGroupIdenticalStacks(bool enable) { group_identical_stacks_ = enable; }
+
+  void SetEmbeddedSoname(bool embedded_soname) { embedded_soname_ = embedded_soname; }
+
+  // Shared by all of the workers, so the jit entries are only read once.
+  void SetJitDebug(JitDebug* jit_debug) { jit_debug_ = jit_debug; }
+
+  size_t num_threads() { return num_threads_; }
+
+  // The number of samples a worker takes at a time.
+  static constexpr size_t kChunkSize = 16;
+
+ private:
+  // Sets same_stack_as of the threads, and the names of the first thread
+  // of every stack.
+  void GroupIdenticalStacks(std::vector<ThreadUnwindResult>* threads);
+
+  size_t max_frames_;
+  Maps* maps_;
+  std::shared_ptr<Memory> process_memory_;
+  size_t num_threads_;
+  bool resolve_names_ = true;
+  bool embedded_soname_ = true;
+  JitDebug* jit_debug_ = nullptr;
+  bool group_identical_stacks_ = false;
+  // The arch of the last threads unwound by UnwindProcess.
+  ArchEnum arch_ = ARCH_UNKNOWN;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_PARALLEL_UNWINDER_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_PERF_SAMPLE_H
+#define _LIBUNWINDSTACK_PERF_SAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <unwindstack/Arch.h>
+
+struct perf_event_header;
+struct perf_event_mmap_page;
+
+namespace unwindstack {
+
+// Forward declarations.
+class MemoryStackOverlay;
+class Regs;
+class Unwinder;
+struct UnwindBatchResult;
+
+// The fields of the perf_event_attr of an event that decide the layout of
+// its samples.
+struct PerfEventFormat {
+  // The arch of the kernel. Samples of 32 bit processes are unwound as the
+  // 32 bit arch.
+  ArchEnum arch = ARCH_UNKNOWN;
+  uint64_t sample_type = 0;
+  uint64_t read_format = 0;
+  uint64_t branch_sample_type = 0;
+  uint64_t sample_regs_user = 0;
+};
+
+// A PERF_RECORD_SAMPLE. The registers and stack point into the record.
+struct PerfSample {
+  uint32_t pid = 0;
+  uint32_t tid = 0;
+  uint32_t cpu = 0;
+  uint64_t ip = 0;
+  uint64_t time = 0;
+  uint64_t period = 0;
+
+  // The arch of the sampled process.
+  ArchEnum arch = ARCH_UNKNOWN;
+  // One value for every bit set in regs_mask, nullptr if the sample has no
+  // user registers, for example because it was taken in a kernel thread.
+  uint64_t regs_mask = 0;
+  const uint64_t* regs = nullptr;
+  // The stack copied from the sp of the registers.
+  const uint8_t* stack = nullptr;
+  uint64_t stack_size = 0;
+
+  // Parses a record of an event with format. Returns false if the record
+  // is not a sample, or is shorter than the format says.
+  static bool Parse(const PerfEventFormat& format, const perf_event_header* record,
+                    PerfSample* sample);
+};
+
+// Reads the records of the ring buffer of a perf event, the memory mapped
+// from its file descriptor. Only one reader at a time.
+class PerfRingBuffer {
+ public:
+  // size is the size of the mapping, one metadata page and a power of two
+  // number of data pages.
+  PerfRingBuffer(void* base, size_t size);
+  ~PerfRingBuffer();
+
+  // Returns the next record written by the kernel, nullptr if there are no
+  // more. The records stay valid until Release. A record that wraps around
+  // the end of the buffer is returned as a copy.
+  const perf_event_header* Next();
+
+  // Gives the space of the records returned by Next back to the kernel.
+  void Release();
+
+ private:
+  perf_event_mmap_page* page_;
+  uint8_t* data_;
+  uint64_t data_size_;
+  uint64_t head_ = 0;
+  uint64_t pos_ = 0;
+  std::vector<std::vector<uint8_t>> copies_;
+  size_t num_copies_ = 0;
+};
+
+// Unwinds the samples of a perf ring buffer with Unwinder::UnwindBatch, up
+// to max_batch samples at a time. The registers and stack overlays of the
+// samples are reused from batch to batch.
+class PerfSampleUnwinder {
+ public:
+  // Returns the unwinder of the process of the sample, or nullptr to skip
+  // it. The stack of the sample is read on top of the process memory of the
+  // unwinder, which can be file backed or nullptr when the process cannot
+  // be read, as the elf files are read through the maps.
+  using GetUnwinderCallback = std::function<Unwinder*(const PerfSample&)>;
+  using SampleCallback = std::function<void(const PerfSample&, UnwindBatchResult*)>;
+  // Called with the records that are not samples, such as
+  // PERF_RECORD_MMAP2, after unwinding the samples written before them.
+  using RecordCallback = std::function<void(const perf_event_header*)>;
+
+  explicit PerfSampleUnwinder(const PerfEventFormat& format, size_t max_batch = 64);
+  ~PerfSampleUnwinder();
+
+  // Unwinds all of the samples in buffer, and calls callback with each one
+  // and its frames. Returns the number of samples unwound.
+  size_t Unwind(PerfRingBuffer* buffer, const GetUnwinderCallback& get_unwinder,
+                const SampleCallback& callback, const RecordCallback& record_callback = nullptr);
+
+ private:
+  struct Entry;
+
+  void UnwindEntries(const SampleCallback& callback);
+
+  PerfEventFormat format_;
+  size_t max_batch_;
+  std::vector<Entry> entries_;
+  size_t num_entries_ = 0;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_PERF_SAMPLE_H
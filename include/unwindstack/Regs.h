@@ -18,6 +18,7 @@
 #define _LIBUNWINDSTACK_REGS_H
 
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <functional>
@@ -47,12 +48,29 @@ class Regs {
     int16_t value;
   };
 
+  // The most registers of any supported arch. The registers are kept
+  // inline, so that creating and copying them does not allocate.
+  static constexpr uint16_t MAX_REGISTERS = 34;
+  static constexpr uint16_t MAX_PSEUDO_REGISTERS = 1;
+
+  // A copy of the register state, see SaveSnapshot.
+  struct Snapshot {
+    uint64_t regs[MAX_REGISTERS];
+    uint64_t pseudo_regs[MAX_PSEUDO_REGISTERS];
+    uint64_t dex_pc;
+  };
+
   Regs(uint16_t total_regs, const Location& return_loc)
       : total_regs_(total_regs), return_loc_(return_loc) {}
   virtual ~Regs() = default;
 
   virtual ArchEnum Arch() = 0;
 
+  // True only for the regs class of CurrentArch(), such as RegsArm64 on
+  // arm64, or a class derived from it. Other classes can report the same
+  // Arch().
+  virtual bool IsCurrentArchRegs() { return false; }
+
   bool Is32Bit() { return ArchIs32Bit(Arch()); }
 
   virtual void* RawData() = 0;
@@ -71,10 +89,21 @@ class Regs {
 
   virtual bool StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) = 0;
 
+  // True if the code at elf_offset is a sigreturn trampoline that
+  // StepIfSignalHandler steps through. Only reads the elf memory, so the
+  // result can be kept for the elf.
+  virtual bool IsSignalHandler(uint64_t elf_offset, Elf* elf) = 0;
+
   virtual bool SetPcFromReturnAddress(Memory* process_memory) = 0;
 
   virtual void IterateRegisters(std::function<void(const char*, uint64_t)>) = 0;
 
+  // Copies the register state into snapshot and back, without allocating.
+  // Used to try a way of stepping that might fail part way, and put the
+  // registers back if it does.
+  virtual void SaveSnapshot(Snapshot* snapshot) = 0;
+  virtual void RestoreSnapshot(const Snapshot& snapshot) = 0;
+
   uint16_t total_regs() { return total_regs_; }
 
   virtual Regs* Clone() = 0;
@@ -83,6 +112,20 @@ class Regs {
   static Regs* RemoteGet(pid_t pid);
   static Regs* CreateFromUcontext(ArchEnum arch, void* ucontext);
   static Regs* CreateFromLocal();
+  // Fills in regs created by CreateFromLocal from a ucontext of the current
+  // process, without allocating.
+  static void SetFromLocalUcontext(Regs* regs, void* ucontext);
+
+  // Creates the registers of arch from the PERF_SAMPLE_REGS_USER part of a
+  // perf sample. mask is the sample_regs_user of the event, and values has
+  // one value for every bit set in it, lowest bit first. Registers not in
+  // the mask are zero. Returns nullptr if the pc or sp is not in the mask.
+  static Regs* CreateFromPerfRegs(ArchEnum arch, uint64_t mask, const uint64_t* values);
+  // Same as CreateFromPerfRegs, into existing regs, without allocating.
+  static bool SetFromPerfRegs(Regs* regs, uint64_t mask, const uint64_t* values);
+  // The sample_regs_user mask that records every register used to unwind
+  // arch.
+  static uint64_t PerfRegsMask(ArchEnum arch);
 
  protected:
   uint16_t total_regs_;
@@ -93,22 +136,31 @@ class Regs {
 template <typename AddressType>
 class RegsImpl : public Regs {
  public:
-  RegsImpl(uint16_t total_regs, Location return_loc)
-      : Regs(total_regs, return_loc), regs_(total_regs) {}
+  RegsImpl(uint16_t total_regs, Location return_loc) : Regs(total_regs, return_loc) {}
   virtual ~RegsImpl() = default;
 
   inline AddressType& operator[](size_t reg) { return regs_[reg]; }
 
-  void* RawData() override { return regs_.data(); }
+  void* RawData() override { return regs_; }
 
   virtual void IterateRegisters(std::function<void(const char*, uint64_t)> fn) override {
-    for (size_t i = 0; i < regs_.size(); ++i) {
+    for (size_t i = 0; i < total_regs_; ++i) {
       fn(std::to_string(i).c_str(), regs_[i]);
     }
   }
 
+  void SaveSnapshot(Snapshot* snapshot) override {
+    memcpy(snapshot->regs, regs_, total_regs_ * sizeof(AddressType));
+    snapshot->dex_pc = dex_pc_;
+  }
+
+  void RestoreSnapshot(const Snapshot& snapshot) override {
+    memcpy(regs_, snapshot.regs, total_regs_ * sizeof(AddressType));
+    dex_pc_ = snapshot.dex_pc;
+  }
+
  protected:
-  std::vector<AddressType> regs_;
+  AddressType regs_[MAX_REGISTERS] = {};
 };
 
 uint64_t GetPcAdjustment(uint64_t rel_pc, Elf* elf, ArchEnum arch);
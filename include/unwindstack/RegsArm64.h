@@ -36,29 +36,43 @@ class RegsArm64 : public RegsImpl<uint64_t> {
   virtual ~RegsArm64() = default;
 
   ArchEnum Arch() override final;
+  bool IsCurrentArchRegs() override;
 
   bool SetPcFromReturnAddress(Memory* process_memory) override;
 
   bool StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) override;
+  bool IsSignalHandler(uint64_t elf_offset, Elf* elf) override;
 
   void IterateRegisters(std::function<void(const char*, uint64_t)>) override final;
 
-  uint64_t pc() override;
-  uint64_t sp() override;
+  uint64_t pc() override final;
+  uint64_t sp() override final;
 
-  void set_pc(uint64_t pc) override;
-  void set_sp(uint64_t sp) override;
+  void set_pc(uint64_t pc) override final;
+  void set_sp(uint64_t sp) override final;
 
-  void ResetPseudoRegisters() override;
+  void ResetPseudoRegisters() override final;
 
-  bool SetPseudoRegister(uint16_t id, uint64_t value) override;
+  bool SetPseudoRegister(uint16_t id, uint64_t value) override final;
 
-  bool GetPseudoRegister(uint16_t id, uint64_t* value) override;
+  bool GetPseudoRegister(uint16_t id, uint64_t* value) override final;
+
+  void SaveSnapshot(Snapshot* snapshot) override;
+  void RestoreSnapshot(const Snapshot& snapshot) override;
 
   bool IsRASigned();
 
   void SetPACMask(uint64_t mask);
 
+  // Clears the pointer authentication code of a return address, which does
+  // not change an address that is not signed.
+  uint64_t StripPAC(uint64_t address) const { return address & ~pac_mask_; }
+
+  // The mask of the pointer authentication code of the return addresses of
+  // the processes on this device, zero if they are not signed. Computed once,
+  // and the default mask of every RegsArm64.
+  static uint64_t GetLocalPACMask();
+
   Regs* Clone() override final;
 
   static Regs* Read(void* data);
@@ -36,20 +36,22 @@ class RegsX86_64 : public RegsImpl<uint64_t> {
   virtual ~RegsX86_64() = default;
 
   ArchEnum Arch() override final;
+  bool IsCurrentArchRegs() override;
 
   bool SetPcFromReturnAddress(Memory* process_memory) override;
 
   bool StepIfSignalHandler(uint64_t elf_offset, Elf* elf, Memory* process_memory) override;
+  bool IsSignalHandler(uint64_t elf_offset, Elf* elf) override;
 
   void SetFromUcontext(x86_64_ucontext_t* ucontext);
 
   void IterateRegisters(std::function<void(const char*, uint64_t)>) override final;
 
-  uint64_t pc() override;
-  uint64_t sp() override;
+  uint64_t pc() override final;
+  uint64_t sp() override final;
 
-  void set_pc(uint64_t pc) override;
-  void set_sp(uint64_t sp) override;
+  void set_pc(uint64_t pc) override final;
+  void set_sp(uint64_t sp) override final;
 
   Regs* Clone() override final;
 
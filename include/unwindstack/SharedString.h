@@ -19,6 +19,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 
 namespace unwindstack {
 
@@ -31,6 +32,11 @@ class SharedString {
   SharedString(const std::string& s) : SharedString(std::string(s)) {}
   SharedString(const char* s) : SharedString(std::string(s)) {}
 
+  // Returns s from a process-wide pool, so that equal interned strings
+  // share one buffer and compare equal without looking at the characters.
+  // A string leaves the pool when its last reference is dropped.
+  static SharedString Intern(std::string_view s);
+
   void clear() { data_.reset(); }
   bool is_null() const { return data_.get() == nullptr; }
   bool empty() const { return is_null() ? true : data_->empty(); }
@@ -44,12 +50,17 @@ class SharedString {
 
   operator std::string_view() const { return static_cast<const std::string&>(*this); }
 
+  // True if both strings share one buffer.
+  bool SameData(const SharedString& other) const { return data_ == other.data_; }
+
  private:
+  explicit SharedString(std::shared_ptr<const std::string>&& data) : data_(std::move(data)) {}
+
   std::shared_ptr<const std::string> data_;
 };
 
 static inline bool operator==(const SharedString& a, SharedString& b) {
-  return static_cast<std::string_view>(a) == static_cast<std::string_view>(b);
+  return a.SameData(b) || static_cast<std::string_view>(a) == static_cast<std::string_view>(b);
 }
 static inline bool operator==(const SharedString& a, std::string_view b) {
   return static_cast<std::string_view>(a) == b;
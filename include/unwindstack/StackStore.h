@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_STACK_STORE_H
+#define _LIBUNWINDSTACK_STACK_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace unwindstack {
+
+// Interns stacks of pcs in a hash consed prefix tree. Every node is one
+// frame on top of its parent stack, starting from the outermost frame, so
+// stacks that share their outer frames share those nodes, and identical
+// stacks get the same id. Each node costs about 20 bytes.
+//
+// Not thread safe, callers have to serialize all access.
+class StackStore {
+ public:
+  using StackId = uint32_t;
+
+  // The id of the stack without any frames.
+  static constexpr StackId kEmptyStack = 0;
+
+  StackStore();
+  ~StackStore() = default;
+
+  // Returns the id of the stack made of parent with pc as a new innermost
+  // frame.
+  StackId Push(StackId parent, uint64_t pc);
+
+  // Interns a stack given innermost frame first, the order of the frames
+  // of an unwind.
+  StackId Intern(const uint64_t* pcs, size_t count);
+
+  // Works with the frames of both Unwinder and LocalUnwinder.
+  template <typename FrameType>
+  StackId Intern(const std::vector<FrameType>& frames) {
+    StackId id = kEmptyStack;
+    for (size_t i = frames.size(); i > 0; i--) {
+      id = Push(id, frames[i - 1].pc);
+    }
+    return id;
+  }
+
+  // Replaces pcs with the frames of the stack, innermost frame first.
+  void GetStack(StackId id, std::vector<uint64_t>* pcs) const;
+
+  // The innermost frame of the stack, and the stack below it.
+  uint64_t pc(StackId id) const { return pcs_[id]; }
+  StackId parent(StackId id) const { return parents_[id]; }
+
+  // The number of distinct non empty stacks, or prefixes of stacks.
+  size_t NumStacks() const { return pcs_.size() - 1; }
+
+  size_t MemoryUsage() const;
+
+  void Clear();
+
+ private:
+  void Grow();
+
+  // Indexed by stack id, the entries for kEmptyStack are not used.
+  std::vector<uint64_t> pcs_;
+  std::vector<StackId> parents_;
+  // Open addressed table of stack ids, kEmptyStack marks a free slot.
+  std::vector<StackId> slots_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_STACK_STORE_H
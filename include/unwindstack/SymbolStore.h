@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_SYMBOL_STORE_H
+#define _LIBUNWINDSTACK_SYMBOL_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unwindstack/Arch.h>
+
+namespace unwindstack {
+
+// Forward declarations.
+class Elf;
+class Memory;
+
+// Finds elf files by build id, so that maps can be unwound and symbolized
+// without the files at the paths in the maps. Every elf is opened once, and
+// shared by all of the maps with the same build id. Thread safe.
+//
+// Set it with Elf::SetSymbolStore to use it for every map with a known
+// build id, see MapInfo::SetBuildID.
+class SymbolStore {
+ public:
+  SymbolStore() = default;
+  ~SymbolStore();
+
+  // A directory of elf files. A file named with the printable build id is
+  // found directly. The build ids of the other files are only read the
+  // first time a build id is not found that way.
+  void AddDirectory(const std::string& directory);
+
+  // An archive written by WriteArchive. The archive is mapped, and the elf
+  // files are used in place.
+  bool AddArchive(const std::string& file);
+
+  // Packs elf_files into a single archive, indexed by build id. Files
+  // without a build id are skipped.
+  static bool WriteArchive(const std::string& file, const std::vector<std::string>& elf_files);
+
+  // Returns the elf with the raw build_id, or nullptr if there is none for
+  // arch.
+  std::shared_ptr<Elf> Find(const std::string& build_id, ArchEnum arch);
+
+ private:
+  struct Archive {
+    std::shared_ptr<Memory> memory;
+    const uint8_t* data;
+    uint64_t num_entries;
+    uint64_t entries_offset;
+  };
+
+  void ForgetMissing();
+  Memory* FindInArchives(const std::string& build_id);
+  Memory* FindInDirectories(const std::string& build_id);
+
+  std::mutex lock_;
+  std::vector<std::string> directories_;
+  // Build id to path, for the files read by a scan of the directories.
+  std::unordered_map<std::string, std::string> scanned_;
+  bool directories_scanned_ = false;
+  std::vector<Archive> archives_;
+  // Every build id looked up, nullptr if it was not found.
+  std::unordered_map<std::string, std::shared_ptr<Elf>> elfs_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_SYMBOL_STORE_H
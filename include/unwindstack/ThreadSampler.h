@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_THREAD_SAMPLER_H
+#define _LIBUNWINDSTACK_THREAD_SAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/StackStore.h>
+
+namespace unwindstack {
+
+// Periodically samples threads of the current process with
+// ThreadUnwinder::UnwindWithSignal from a dedicated thread. Every sample is
+// recorded as a list of pcs in a single producer, single consumer ring, and
+// Aggregate moves the samples from the ring into a StackStore, counting
+// the samples of each distinct stack. The maps and elf objects are kept for
+// the lifetime of the sampler, so only newly loaded libraries cost anything
+// after the first samples.
+class ThreadSampler {
+ public:
+  // ring_size is rounded up to a power of two. Samples taken while the ring
+  // is full are dropped.
+  ThreadSampler(size_t max_frames = 64, size_t ring_size = 4096);
+  ~ThreadSampler();
+
+  // Starts sampling the threads every interval, using signal to interrupt
+  // them. Returns false if the sampler is already running or the maps
+  // cannot be read.
+  bool Start(const std::vector<pid_t>& tids, std::chrono::microseconds interval, int signal);
+
+  void Stop();
+
+  // Moves the samples from the ring into the stack table and returns how
+  // many were moved. Only one thread at a time can call this, or any of
+  // the functions below.
+  size_t Aggregate();
+
+  // Calls callback with every distinct stack, innermost frame first, and
+  // the number of samples that had it.
+  void ForEachStack(
+      const std::function<void(const std::vector<uint64_t>& pcs, uint64_t count)>& callback);
+
+  // Returns the stacks in the folded format used by flame graph tools: one
+  // line per stack, function names from the outermost frame in separated
+  // by ';', then a space and the sample count.
+  std::string FoldedStacks();
+
+  void ClearStacks() {
+    counts_.clear();
+    stacks_.Clear();
+  }
+
+  const StackStore& stacks() { return stacks_; }
+  const std::unordered_map<StackStore::StackId, uint64_t>& counts() { return counts_; }
+
+  uint64_t num_samples() { return num_samples_; }
+  uint64_t num_dropped() { return num_dropped_; }
+
+ private:
+  struct Record {
+    pid_t tid;
+    size_t num_frames;
+  };
+
+  void Run(std::vector<pid_t> tids, std::chrono::microseconds interval, int signal);
+
+  size_t max_frames_;
+  size_t ring_mask_;
+  std::unique_ptr<Record[]> records_;
+  std::unique_ptr<uint64_t[]> pcs_;
+  // head_ is only written by the sampling thread, tail_ only by Aggregate.
+  std::atomic<size_t> head_ = 0;
+  std::atomic<size_t> tail_ = 0;
+  std::atomic<uint64_t> num_samples_ = 0;
+  std::atomic<uint64_t> num_dropped_ = 0;
+
+  std::unique_ptr<LocalUpdatableMaps> maps_;
+  std::shared_ptr<Memory> process_memory_;
+
+  std::thread thread_;
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cond_;
+  bool stop_ = false;
+
+  StackStore stacks_;
+  std::unordered_map<StackStore::StackId, uint64_t> counts_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_THREAD_SAMPLER_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_UNWIND_SERVICE_H
+#define _LIBUNWINDSTACK_UNWIND_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/MemoryFootprint.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+struct UnwindServiceConfig {
+  size_t max_frames = 256;
+  // The most processes kept at once, zero means no limit. Adding a process
+  // past the limit drops the least recently used one. The elf objects of a
+  // process are kept alive by its maps, so this also bounds the elf cache.
+  size_t max_processes = 0;
+  // The pages of memory cache of each process, zero means no limit.
+  size_t memory_cache_pages = 256;
+  // See Elf::SetCacheMemoryBudget, zero means no limit.
+  size_t elf_cache_memory_budget = 0;
+  // See Elf::SetIndexCacheDirectory, empty to not save the indices.
+  std::string index_cache_directory;
+  // See MapInfo::SetFailedFileCacheTtl, zero means files that failed are
+  // tried again for every map.
+  std::chrono::milliseconds failed_file_cache_ttl = std::chrono::seconds(10);
+  // Reads the jit and dex entries of every process, which is the only state
+  // kept per process besides the maps and the memory.
+  bool resolve_jit = false;
+  bool resolve_names = true;
+};
+
+struct UnwindServiceStats {
+  size_t processes = 0;
+  uint64_t processes_added = 0;
+  uint64_t processes_evicted = 0;
+  uint64_t unwinds = 0;
+  ElfCacheStats elf_cache;
+};
+
+// Unwinds the samples of many processes at once, such as in a daemon that
+// symbolizes the samples of a whole system. Only the maps and a memory
+// handle are kept for each process. The elf objects, their symbol tables
+// and their unwind indices live in the process wide elf cache, which this
+// enables, and are shared by every process that maps the same file, while
+// the fde indices of files without a search table are shared by build id.
+// The build ids and load biases of the files are cached the same way.
+//
+// Thread safe. Samples of different processes are unwound in parallel,
+// the samples of one process one call at a time.
+class UnwindService {
+ public:
+  explicit UnwindService(const UnwindServiceConfig& config = UnwindServiceConfig());
+  ~UnwindService();
+
+  // Reads the maps of pid, again if the process is already known, for
+  // example after it loaded a library. Returns false if the maps cannot be
+  // read.
+  bool AddProcess(pid_t pid);
+  void RemoveProcess(pid_t pid);
+
+  // Unwinds the samples of pid as Unwinder::UnwindBatch does, adding the
+  // process first if needed. A sample without its own memory reads from
+  // the cached memory of the process. Returns false if the maps of pid
+  // cannot be read.
+  bool Unwind(pid_t pid, const std::vector<UnwindSample>& samples,
+              std::vector<UnwindBatchResult>* results);
+
+  UnwindServiceStats GetStats();
+
+  // Approximate bytes of heap memory held by the elf cache and by every
+  // process. Waits for the process being unwound, if any.
+  MemoryFootprint GetMemoryFootprint();
+
+ private:
+  struct Process;
+
+  // Returns the process, creating it without maps if it is not known.
+  std::shared_ptr<Process> GetProcess(pid_t pid);
+  bool ParseMaps(pid_t pid, Process* process);
+  // Removes process, unless pid was added again since.
+  void Drop(pid_t pid, const Process* process);
+
+  UnwindServiceConfig config_;
+
+  std::mutex lock_;
+  std::unordered_map<pid_t, std::shared_ptr<Process>> processes_;
+  uint64_t clock_ = 0;
+  UnwindServiceStats stats_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_UNWIND_SERVICE_H
@@ -20,16 +20,20 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <unwindstack/Arch.h>
 #include <unwindstack/DexFiles.h>
 #include <unwindstack/Error.h>
 #include <unwindstack/JitDebug.h>
+#include <unwindstack/MapNameFilter.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/MemoryFootprint.h>
 #include <unwindstack/Regs.h>
 #include <unwindstack/SharedString.h>
 
@@ -37,6 +41,8 @@ namespace unwindstack {
 
 // Forward declarations.
 class Elf;
+class MemoryStackOverlay;
+class MemoryStackSnapshot;
 class ThreadEntry;
 
 struct FrameData {
@@ -48,6 +54,9 @@ struct FrameData {
 
   SharedString function_name;
   uint64_t function_offset = 0;
+  // The demangled function_name, only set when Unwinder::SetDemangleNames
+  // is enabled. The same as function_name if it is not a mangled name.
+  SharedString demangled_name;
 
   SharedString map_name;
   // The offset from the first map representing the frame. When there are
@@ -63,6 +72,136 @@ struct FrameData {
   int map_flags = 0;
 };
 
+// The fields of FrameData that an Unwinder can leave out, see
+// Unwinder::SetFrameFields. num, pc and rel_pc are always set.
+enum FrameField : uint8_t {
+  FRAME_FIELD_SP = 1 << 0,
+  // function_name, function_offset and demangled_name.
+  FRAME_FIELD_FUNCTION_NAME = 1 << 1,
+  // map_name, with the soname of an elf embedded in the file.
+  FRAME_FIELD_MAP_NAME = 1 << 2,
+  // map_start, map_end, map_exact_offset, map_elf_start_offset and
+  // map_flags.
+  FRAME_FIELD_MAP_RANGE = 1 << 3,
+  FRAME_FIELD_MAP_LOAD_BIAS = 1 << 4,
+  FRAME_FIELDS_ALL = 0x1f,
+};
+
+// A captured sample to unwind with Unwinder::UnwindBatch.
+struct UnwindSample {
+  Regs* regs = nullptr;
+  // The memory to use for this sample, for example a stack snapshot on top
+  // of the process memory. If not set, the unwinder's process memory is used.
+  std::shared_ptr<Memory> process_memory;
+};
+
+struct UnwindBatchResult {
+  std::vector<FrameData> frames;
+  ErrorData last_error{ERROR_NONE, 0};
+  uint64_t warnings = 0;
+};
+
+// The minimum kept per frame by Unwinder::UnwindCapture, to be turned into
+// full frames later by Unwinder::Symbolize.
+struct CapturedFrame {
+  uint64_t pc = 0;
+  uint64_t rel_pc = 0;
+  // Stays valid as long as the maps the frame was captured with.
+  MapInfo* map_info = nullptr;
+  size_t num = 0;
+};
+
+// The allocations made so far, as counted by the application, see
+// Unwinder::SetAllocationCounter.
+struct AllocationCounts {
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+
+  void Add(const AllocationCounts& other) {
+    allocs += other.allocs;
+    bytes += other.bytes;
+  }
+};
+
+// Where the time of an unwind went, and what it did, see
+// Unwinder::SetStatsEnabled. The times are in nanoseconds.
+struct UnwindStats {
+  uint64_t unwinds = 0;
+  uint64_t frames = 0;
+  uint64_t total_ns = 0;
+  uint64_t find_map_ns = 0;
+  // Includes creating the elf objects not created yet.
+  uint64_t get_elf_ns = 0;
+  uint64_t step_ns = 0;
+  uint64_t function_name_ns = 0;
+  // Looking up jit elfs and dex frames.
+  uint64_t jit_dex_ns = 0;
+
+  uint64_t map_cache_hits = 0;
+  uint64_t map_cache_misses = 0;
+  uint64_t elfs_created = 0;
+  uint64_t frame_cache_hits = 0;
+  uint64_t frame_cache_misses = 0;
+  // The frames copied from the stack suffix cache instead of unwound.
+  uint64_t suffix_frames_reused = 0;
+  // From the cache of the process memory, if it is one. Every miss and
+  // uncached read is a read of the process, normally one system call.
+  uint64_t memory_cache_hits = 0;
+  uint64_t memory_cache_misses = 0;
+  uint64_t memory_uncached_reads = 0;
+
+  // The allocations of the whole unwind and of each phase, only counted
+  // when there is an allocation counter.
+  AllocationCounts total_allocs;
+  AllocationCounts find_map_allocs;
+  AllocationCounts get_elf_allocs;
+  AllocationCounts step_allocs;
+  AllocationCounts function_name_allocs;
+  AllocationCounts jit_dex_allocs;
+
+  void Add(const UnwindStats& other);
+};
+
+// The frames of the last unwind of one thread, see
+// Unwinder::SetStackSuffixCache.
+struct StackSuffixCache {
+  struct Key {
+    // The registers the frame was unwound from, zero for dex frames.
+    uint64_t pc = 0;
+    uint64_t sp = 0;
+  };
+  std::vector<FrameData> frames;
+  // One per frame.
+  std::vector<Key> keys;
+  ErrorData last_error{ERROR_NONE, 0};
+  uint64_t warnings = 0;
+  uint64_t maps_generation = 0;
+  // The name options of the unwinder the frames were made with.
+  uint8_t options = 0;
+  bool valid = false;
+
+  void Clear() {
+    frames.clear();
+    keys.clear();
+    valid = false;
+  }
+};
+
+// Limits on the work of a single unwind, zero means no limit. When one is
+// reached, the unwind stops with the frames found so far and the error
+// ERROR_BUDGET_EXCEEDED.
+struct UnwindBudget {
+  // Checked before each frame after the first, so a single step can go
+  // over it.
+  uint64_t max_time_ns = 0;
+  // Bytes read from the process memory while stepping.
+  uint64_t max_bytes_read = 0;
+  // Elf objects created, which normally means files opened and parsed.
+  size_t max_elf_creations = 0;
+  // Stop at the first map whose elf was not created yet.
+  bool no_new_elfs = false;
+};
+
 class Unwinder {
  public:
   Unwinder(size_t max_frames, Maps* maps, Regs* regs, std::shared_ptr<Memory> process_memory)
@@ -73,6 +212,12 @@ class Unwinder {
         arch_(regs->Arch()) {}
   Unwinder(size_t max_frames, Maps* maps, std::shared_ptr<Memory> process_memory)
       : max_frames_(max_frames), maps_(maps), process_memory_(process_memory) {}
+  // The unwinder keeps the maps alive, see SetMaps.
+  Unwinder(size_t max_frames, std::shared_ptr<Maps> maps, std::shared_ptr<Memory> process_memory)
+      : max_frames_(max_frames),
+        maps_(maps.get()),
+        shared_maps_(std::move(maps)),
+        process_memory_(process_memory) {}
 
   virtual ~Unwinder() = default;
 
@@ -85,17 +230,68 @@ class Unwinder {
   // Intentionally mutable (which can be used to swap in reserved memory before unwinding).
   std::vector<FrameData>& frames() { return frames_; }
 
+  // Sizes the frame storage for max_frames frames. The storage is reused by
+  // every unwind, so warmed up unwinders that do not resolve names, or that
+  // use UnwindCapture with a reused vector, do not allocate per unwind.
+  void ReserveFrames() { frames_.reserve(max_frames_); }
+
   std::vector<FrameData> ConsumeFrames() {
     std::vector<FrameData> frames = std::move(frames_);
     frames_.clear();
     return frames;
   }
 
+  // Called with each frame once it is final, return false to stop the unwind.
+  using FrameCallback = std::function<bool(const FrameData& frame)>;
+
+  // Same as Unwind, but passes every frame to callback as soon as it can no
+  // longer change, so the frames can be serialized while the unwind goes on.
+  // A frame is final once the next one is being unwound, or the unwind is
+  // over. Stopping early leaves the error of the last completed step.
+  void UnwindWithCallback(const FrameCallback& callback,
+                          const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+                          const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Unwinds all of the samples and returns one result per sample, in the
+  // same order. Map lookups, elf objects and function names are shared
+  // between the samples, so all of them must come from the process described
+  // by the maps of this unwinder, and the maps must not change during the
+  // call. Every sample must have regs set. The regs and memory set on the
+  // unwinder are restored before returning.
+  virtual std::vector<UnwindBatchResult> UnwindBatch(
+      const std::vector<UnwindSample>& samples,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Unwinds without resolving any names and appends the frames to captured
+  // in compact form. Returns the number of frames appended. The frames are
+  // also available from frames(), without names.
+  size_t UnwindCapture(std::vector<CapturedFrame>* captured,
+                       const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+                       const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
+  // Returns one frame per captured frame, with the same map and function
+  // fields the unwind would have set. The frames can come from any number
+  // of unwinds using the maps of this unwinder. The names are looked up in
+  // bulk, grouped by elf and in address order, so symbolizing many frames
+  // at once is much cheaper than resolving names during each unwind.
+  std::vector<FrameData> Symbolize(const std::vector<CapturedFrame>& captured);
+
   std::string FormatFrame(size_t frame_num) const;
   std::string FormatFrame(const FrameData& frame) const;
 
+  // Same as FormatFrame, but writes into buffer without allocating or
+  // locking, so it can be used in a signal handler. Names are not demangled
+  // unless demangled_name is already set, and the build id is only shown
+  // once it has been read. Like snprintf, the output is truncated to fit
+  // and always terminated when size is not zero, and the return value is
+  // the full length of the frame text.
+  size_t FormatFrame(const FrameData& frame, char* buffer, size_t size) const;
+
   void SetArch(ArchEnum arch) { arch_ = arch; };
 
+  // The jit debug object can be shared by unwinders of the same process,
+  // and used from several threads at once.
   void SetJitDebug(JitDebug* jit_debug);
 
   void SetRegs(Regs* regs) {
@@ -103,6 +299,15 @@ class Unwinder {
     arch_ = regs_ != nullptr ? regs->Arch() : ARCH_UNKNOWN;
   }
   Maps* GetMaps() { return maps_; }
+
+  // Unwinds with maps shared with other unwinders, such as a list from
+  // SharedMaps, and keeps them alive until other maps are set or the
+  // unwinder is destroyed. Must not be called during an unwind.
+  void SetMaps(std::shared_ptr<Maps> maps) {
+    shared_maps_ = std::move(maps);
+    maps_ = shared_maps_.get();
+    ClearRecentMaps();
+  }
   std::shared_ptr<Memory>& GetProcessMemory() { return process_memory_; }
 
   // Disabling the resolving of names results in the function name being
@@ -116,10 +321,135 @@ class Unwinder {
 
   void SetDisplayBuildID(bool display_build_id) { display_build_id_ = display_build_id; }
 
+  // Only fills in the fields of the frames in fields, a mask of FrameField,
+  // the others are left zero or empty, and the work to find them, such as
+  // looking up function names and sonames, is not done. A sampler that
+  // only keeps the pc and the map needs FRAME_FIELD_MAP_RANGE alone. The
+  // names also need SetResolveNames. All of the fields by default.
+  void SetFrameFields(uint8_t fields) { frame_fields_ = fields; }
+  uint8_t frame_fields() const { return frame_fields_; }
+
+  // Demangle the function name of every frame while unwinding, into
+  // demangled_name, so that formatting the frames later, maybe more than
+  // once, does not demangle them again.
+  void SetDemangleNames(bool demangle_names) { demangle_names_ = demangle_names; }
+
+  // Returns the demangled name, or name itself if it is not a mangled name.
+  // The names are kept in a cache shared by every unwinder.
+  static SharedString Demangle(const SharedString& name);
+  // The most names kept in the demangle cache, 4096 by default. Zero
+  // disables the cache.
+  static void SetDemangleCacheSize(size_t entries);
+
+  // On arm64 and x86_64, step through the frame record pointed to by the
+  // frame pointer first, and only use the elf unwind information when the
+  // record does not look valid, or the unwind information says the function
+  // does not use a frame pointer. The first frame, and the frame that was
+  // interrupted by a signal, are always unwound using the unwind information.
+  // Registers other than the pc, sp and frame pointer are not restored by
+  // a frame pointer step. This is disabled by default.
+  void SetFramePointerUnwinding(bool enable) { frame_pointer_unwinding_ = enable; }
+
+  // On arm64, when the thread uses a shadow call stack, as built with
+  // -fsanitize=shadow-call-stack, x18 points just past the last return
+  // address pushed on it. The frames after the first are then taken from
+  // the return addresses on that stack, read with a single read, instead of
+  // stepping through the unwind information. The first frame is stepped as
+  // usual, so that the caller of a function that did not push its return
+  // address yet is not lost. The shadow stack is the map x18 points into,
+  // which must be a read-write map other than the stack, whose entries from
+  // its start are all return addresses, unless it is named as by bionic.
+  //
+  // The frames taken from the shadow stack have no sp, and no dex or jit
+  // frames are added. A thread that does not use a shadow call stack is unwound as
+  // usual if fallback is set, otherwise the unwind fails with
+  // ERROR_UNSUPPORTED. This is disabled by default.
+  void SetShadowCallStackUnwinding(bool enable, bool fallback = true) {
+    shadow_call_stack_unwinding_ = enable;
+    shadow_call_stack_fallback_ = fallback;
+  }
+
+  // Limits the work of every unwind, see UnwindBudget. There are no limits
+  // by default.
+  void SetBudget(const UnwindBudget& budget) { budget_ = budget; }
+
+  // The stack of the thread being unwound is [start, end). Before an unwind
+  // that starts with sp in this range, the stack from sp up, at most
+  // kMaxStackCopySize bytes, is copied with a single read, and the stack
+  // reads done while stepping are served from the copy. Other reads, such
+  // as on a signal stack, still go to the process memory. Not used by
+  // UnwindBatch. An empty range disables this.
+  void SetStackBounds(uint64_t start, uint64_t end) {
+    stack_start_ = start;
+    stack_end_ = end;
+    stack_in_place_ = false;
+  }
+
+  // Same as SetStackBounds with the stack of the calling thread, found with
+  // pthread_getattr_np, which is read in place instead of copied. Only for
+  // unwinding the calling thread from registers it captured itself.
+  // Returns false if the stack cannot be found.
+  bool SetStackBoundsFromCurrentThread();
+
+  static constexpr size_t kMaxStackCopySize = 64 * 1024;
+
+  // Keep the map and function fields of up to entries frames, keyed by the
+  // absolute pc and the maps generation, and reuse them when the same pc is
+  // unwound again. The size is rounded up to a power of two. Zero disables
+  // the cache, which is the default.
+  void SetFrameCacheSize(size_t entries);
+
+  // Remembers the frames of every unwind in cache, and when a later unwind
+  // steps into a frame with the same pc and sp, reached from a frame with
+  // the same sp, and stepping it gives the same caller, copies the rest of
+  // the frames from cache instead of unwinding them. Consecutive samples of a thread usually only differ in
+  // the top frames, so keep one cache per thread and set it before each
+  // unwind of that thread. The registers other than the pc and sp are not
+  // compared, so this relies on the callers saving them on the stack, as
+  // the bottom frames of a thread nearly always do. A recursion through
+  // frames of the same size can also match at the wrong depth. The cache
+  // is not used after the maps changed or with other name options.
+  // nullptr, the default, disables this.
+  void SetStackSuffixCache(StackSuffixCache* cache) { stack_suffix_cache_ = cache; }
+
   void SetDexFiles(DexFiles* dex_files);
 
   bool elf_from_memory_not_file() { return elf_from_memory_not_file_; }
 
+  // Map lookups first check the last few maps matched during the current
+  // unwind, these count how many lookups were answered that way, and how
+  // many had to search the maps.
+  struct MapCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+  const MapCacheStats& map_cache_stats() const { return map_cache_stats_; }
+  void ClearMapCacheStats() { map_cache_stats_ = MapCacheStats(); }
+
+  // Measure every unwind, the stats of the last one are in stats(), and
+  // are added to the process wide totals. Only costs a branch per phase
+  // when disabled, which is the default.
+  void SetStatsEnabled(bool enable) { stats_enabled_ = enable; }
+  const UnwindStats& stats() const { return stats_; }
+
+  // The totals of all of the measured unwinds of the process.
+  static UnwindStats GetGlobalStats();
+  static void ClearGlobalStats();
+
+  // Approximate bytes of heap memory held for this unwinder, by the elf
+  // objects created for its maps, the maps, the process memory, the jit
+  // and dex entries and its own frames and caches. Elf objects shared with
+  // other unwinders are counted in full. Must not be called during an
+  // unwind.
+  MemoryFootprint GetMemoryFootprint();
+
+  // Sets the function that returns the allocations made so far by the
+  // calling thread, for example from a replaced operator new, so that the
+  // stats include the allocations of every phase. nullptr, the default,
+  // disables counting.
+  using AllocationCounter = AllocationCounts (*)();
+  static void SetAllocationCounter(AllocationCounter counter);
+
   ErrorCode LastErrorCode() { return last_error_.code; }
   const char* LastErrorCodeString() { return GetErrorCodeString(last_error_.code); }
   uint64_t LastErrorAddress() { return last_error_.address; }
@@ -134,6 +464,21 @@ class Unwinder {
                                         std::shared_ptr<Memory> process_memory, bool resolve_names);
   FrameData BuildFrameFromPcOnly(uint64_t pc);
 
+  // Creates the elf of every executable file map for which filter returns
+  // true, or of all of them if there is no filter, and preloads it, see
+  // Elf::Preload. Later unwinds through these maps then do not open files
+  // or build lookup tables. Can run while other threads unwind with the
+  // same maps, but the maps must not be reparsed during the call. Returns
+  // the number of valid elf objects preloaded.
+  static size_t Preload(Maps* maps, ArchEnum arch, std::shared_ptr<Memory> process_memory,
+                        bool symbols, const std::function<bool(MapInfo*)>& filter = nullptr);
+  size_t Preload(bool symbols, const std::function<bool(MapInfo*)>& filter = nullptr);
+
+  // Same as Preload, but on a new thread, which the caller has to join
+  // before the maps are freed. The arch has to be known.
+  std::thread PreloadInBackground(bool symbols,
+                                  std::function<bool(MapInfo*)> filter = nullptr);
+
  protected:
   Unwinder(size_t max_frames, Maps* maps = nullptr) : max_frames_(max_frames), maps_(maps) {}
   Unwinder(size_t max_frames, ArchEnum arch, Maps* maps = nullptr)
@@ -146,10 +491,59 @@ class Unwinder {
   }
 
   void FillInDexFrame();
-  FrameData* FillInFrame(MapInfo* map_info, Elf* elf, uint64_t rel_pc, uint64_t pc_adjustment);
+  // If cached is not nullptr, the frame is looked up in the frame cache and
+  // cached is set to true when all of the fields came from it.
+  FrameData* FillInFrame(MapInfo* map_info, Elf* elf, uint64_t rel_pc, uint64_t pc_adjustment,
+                         bool* cached = nullptr);
+  void FillInMapFields(FrameData* frame, MapInfo* map_info, Elf* elf);
+  bool ResolveFunctionNames() const {
+    return resolve_names_ && (frame_fields_ & FRAME_FIELD_FUNCTION_NAME);
+  }
+  // The settings that decide the fields of a frame in the frame cache.
+  uint8_t FrameOptions() const {
+    return resolve_names_ | (embedded_soname_ << 1) | (demangle_names_ << 2) | (frame_fields_ << 3);
+  }
+  void AddToFrameCache(const FrameData& frame, uint64_t generation);
+
+  // Passes the frames after the first *emitted to frame_callback_. Returns
+  // false if the callback asked to stop.
+  bool EmitFrames(size_t* emitted);
+
+  // The recent maps are only valid for one unwind, the maps can change
+  // between unwinds.
+  void ClearRecentMaps() {
+    for (MapInfo*& map_info : recent_maps_) {
+      map_info = nullptr;
+    }
+  }
+
+  // Lookups that go through the batch cache while in UnwindBatch.
+  struct BatchCache;
+  // With is_pc, the maps are searched with Maps::FindPc.
+  MapInfo* FindMap(uint64_t addr, bool is_pc = false);
+  Elf* GetElf(MapInfo* map_info);
+  bool GetFunctionName(Elf* elf, uint64_t pc, SharedString* name, uint64_t* offset);
+  bool StepFramePointer(Elf* elf, uint64_t step_pc, Memory* memory);
+  // Adds the frames from the shadow call stack, returns false, without
+  // adding any frame, if the thread does not use one.
+  bool UnwindShadowCallStack(Memory* memory, bool skip_initial_maps);
+  // Adds the frame of pc, a return address if adjust_pc is set, used by
+  // UnwindShadowCallStack. sp is zero when it is not known. Returns false if
+  // pc is not in an executable map, or is in a map with a suffix to ignore.
+  bool AddReturnAddressFrame(uint64_t pc, uint64_t sp, bool adjust_pc, bool* skip_initial_maps,
+                             uint64_t maps_generation);
+  // Appends the frames of the stack suffix cache after the one unwound from
+  // pc and sp, which was just stepped to its caller in regs_, if the frame
+  // before it was unwound from caller_sp and the cache has the same caller.
+  // dex_pc is the one of the stepped frame. The cache is searched from
+  // *next, which only moves toward the bottom of the stack.
+  bool ReuseStackSuffix(uint64_t pc, uint64_t sp, uint64_t caller_sp, uint64_t dex_pc,
+                        size_t* next);
 
   size_t max_frames_;
   Maps* maps_;
+  // Set when the maps are shared, maps_ then points to them.
+  std::shared_ptr<Maps> shared_maps_;
   Regs* regs_;
   std::vector<FrameData> frames_;
   std::shared_ptr<Memory> process_memory_;
@@ -158,12 +552,51 @@ class Unwinder {
   bool resolve_names_ = true;
   bool embedded_soname_ = true;
   bool display_build_id_ = false;
+  bool demangle_names_ = false;
+  uint8_t frame_fields_ = FRAME_FIELDS_ALL;
+  bool frame_pointer_unwinding_ = false;
+  bool shadow_call_stack_unwinding_ = false;
+  bool shadow_call_stack_fallback_ = true;
   // True if at least one elf file is coming from memory and not the related
   // file. This is only true if there is an actual file backing up the elf.
   bool elf_from_memory_not_file_ = false;
   ErrorData last_error_;
   uint64_t warnings_;
   ArchEnum arch_ = ARCH_UNKNOWN;
+  BatchCache* batch_cache_ = nullptr;
+  struct FrameCache;
+  struct FrameCacheDeleter {
+    void operator()(FrameCache* cache) const;
+  };
+  std::unique_ptr<FrameCache, FrameCacheDeleter> frame_cache_;
+  StackSuffixCache* stack_suffix_cache_ = nullptr;
+  // The keys of the frames of the current unwind, one per frame.
+  std::vector<StackSuffixCache::Key> frame_keys_;
+  const FrameCallback* frame_callback_ = nullptr;
+  // The stack above sp handed to Memory::Prefetch at the start of an unwind.
+  static constexpr size_t kStackPrefetchSize = 16 * 1024;
+  MapNameFilter map_filter_;
+  // Most recently matched maps first.
+  static constexpr size_t kNumRecentMaps = 4;
+  MapInfo* recent_maps_[kNumRecentMaps] = {};
+  MapCacheStats map_cache_stats_;
+  bool stats_enabled_ = false;
+  UnwindStats stats_;
+  UnwindBudget budget_;
+  // If set, used instead of the process memory to read registers and
+  // stack data while stepping.
+  Memory* stack_memory_ = nullptr;
+
+  // Points stack_memory_ at the stack set with SetStackBounds, returns false
+  // if it is not used for this unwind.
+  bool UseStackBounds();
+  void ResetStackMemory();
+
+  uint64_t stack_start_ = 0;
+  uint64_t stack_end_ = 0;
+  bool stack_in_place_ = false;
+  std::shared_ptr<MemoryStackSnapshot> stack_snapshot_;
+  std::shared_ptr<MemoryStackOverlay> stack_overlay_;
 };
 
 class UnwinderFromPid : public Unwinder {
@@ -172,19 +605,52 @@ class UnwinderFromPid : public Unwinder {
       : Unwinder(max_frames, maps), pid_(pid) {}
   UnwinderFromPid(size_t max_frames, pid_t pid, ArchEnum arch, Maps* maps = nullptr)
       : Unwinder(max_frames, arch, maps), pid_(pid) {}
-  virtual ~UnwinderFromPid() = default;
+  virtual ~UnwinderFromPid();
 
   bool Init();
 
+  // Makes Init search for the jit and dex descriptors, and read their
+  // entries, on a new thread instead of on the first unwind that needs
+  // them. An unwind that needs them before the thread is done waits for it.
+  // Only applies to the objects created by Init. Must be called before
+  // Init. This is disabled by default.
+  void SetJitInitInBackground(bool enable) { jit_init_in_background_ = enable; }
+
+  // Prepares to unwind a new snapshot of the process, for example after it
+  // was stopped again, calling Init the first time. If the unwinder created
+  // the maps, they are only parsed again when the maps file changed, and the
+  // entries that did not change keep their elf objects. The jit and dex
+  // objects, and the cached data of read only maps, are kept. Returns false
+  // if the maps cannot be read.
+  bool Refresh();
+
+  // Returns true if the maps file of the process changed since the maps
+  // created by the unwinder were last parsed, without parsing it. Always
+  // false for maps given to the unwinder.
+  bool MapsChanged();
+
+  // Copy up to size bytes of the stack, starting at sp and stopping at the
+  // end of the stack map, with a single read before each unwind. Stack reads
+  // done while stepping then come from the copy. Zero disables this.
+  void SetStackSnapshotSize(size_t size) { stack_snapshot_size_ = size; }
+
   void Unwind(const std::vector<std::string>* initial_map_names_to_skip = nullptr,
               const std::vector<std::string>* map_suffixes_to_ignore = nullptr) override;
 
+  std::vector<UnwindBatchResult> UnwindBatch(
+      const std::vector<UnwindSample>& samples,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr) override;
+
  protected:
   pid_t pid_;
-  std::unique_ptr<Maps> maps_ptr_;
+  std::unique_ptr<RemoteUpdatableMaps> maps_ptr_;
   std::unique_ptr<JitDebug> jit_debug_ptr_;
   std::unique_ptr<DexFiles> dex_files_ptr_;
   bool initted_ = false;
+  size_t stack_snapshot_size_ = 0;
+  bool jit_init_in_background_ = false;
+  std::thread jit_init_thread_;
 };
 
 class ThreadUnwinder : public UnwinderFromPid {
@@ -201,6 +667,14 @@ class ThreadUnwinder : public UnwinderFromPid {
                         const std::vector<std::string>* initial_map_names_to_skip = nullptr,
                         const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
 
+  // Signals all of the threads at once, so that they are parked in the
+  // signal handler together, then unwinds each of them and lets it go.
+  // Returns one result per tid, in the same order.
+  std::vector<UnwindBatchResult> UnwindWithSignal(
+      int signal, const std::vector<pid_t>& tids,
+      const std::vector<std::string>* initial_map_names_to_skip = nullptr,
+      const std::vector<std::string>* map_suffixes_to_ignore = nullptr);
+
  protected:
   ThreadEntry* SendSignalToThread(int signal, pid_t tid);
 };
@@ -83,6 +83,28 @@ static inline bool PassXdigit(char** p) {
   return true;
 }
 
+// Hex parser for the address and offset fields, strtoull is noticeably
+// slower because it handles locales, signs and prefixes.
+static inline uint64_t ParseHex(char* p, char** end) {
+  uint64_t value = 0;
+  for (;; p++) {
+    char c = *p;
+    uint64_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      break;
+    }
+    value = (value << 4) | digit;
+  }
+  *end = p;
+  return value;
+}
+
 // Parses a line given p pointing at proc/<pid>/maps content buffer and returns true on success
 // and false on failure parsing. The next end of line will be replaced by null character and the
 // immediate offset after the parsed line will be returned in next_line.
@@ -100,13 +122,13 @@ static inline bool ParseMapsFileLine(char* p, uint64_t& start_addr, uint64_t& en
 
   char* end;
   // start_addr
-  start_addr = strtoull(p, &end, 16);
+  start_addr = ParseHex(p, &end);
   if (end == p || *end != '-') {
     return false;
   }
   p = end + 1;
   // end_addr
-  end_addr = strtoull(p, &end, 16);
+  end_addr = ParseHex(p, &end);
   if (end == p) {
     return false;
   }
@@ -144,7 +166,7 @@ static inline bool ParseMapsFileLine(char* p, uint64_t& start_addr, uint64_t& en
     return false;
   }
   // pgoff
-  pgoff = strtoull(p, &end, 16);
+  pgoff = ParseHex(p, &end);
   if (end == p) {
     return false;
   }
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LIBUNWINDSTACK_TOOLS_ELF_BATCH_H
+#define _LIBUNWINDSTACK_TOOLS_ELF_BATCH_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/Memory.h>
+
+namespace unwindstack {
+
+// Shared by the tools that can process a whole system image at once.
+struct ElfBatchOptions {
+  // Zero means one thread per cpu.
+  size_t threads = 0;
+  // When not empty, the index file of every elf is written there, see
+  // Elf::SetIndexCacheDirectory.
+  std::string index_directory;
+  // Elf files, directories searched recursively, and @FILE lists with one
+  // path per line.
+  std::vector<std::string> paths;
+};
+
+static inline void PrintElfBatchUsage(const char* tool) {
+  printf("Usage: %s [-j THREADS] [-i INDEX_DIR] <ELF_FILE|DIRECTORY|@LIST_FILE>...\n", tool);
+  printf("  Process every elf file given, found in a DIRECTORY, or listed one per\n");
+  printf("  line in LIST_FILE, using THREADS threads (default one per cpu).\n");
+  printf("  -i INDEX_DIR\n");
+  printf("    Write the index file of each elf file with a build id to INDEX_DIR,\n");
+  printf("    to be used with Elf::SetIndexCacheDirectory.\n");
+}
+
+// Returns true if the arguments ask for the batch mode rather than for the
+// single file mode of the tool: when the first one is an option, a
+// directory or a list, or when more than one path is given.
+static inline bool IsElfBatch(int argc, char** argv) {
+  auto is_batch_path = [](const char* arg, bool first) {
+    struct stat st;
+    if (arg[0] == '@' || (first && arg[0] == '-')) {
+      return true;
+    }
+    return stat(arg, &st) == 0 && (S_ISDIR(st.st_mode) || !first);
+  };
+  return argc > 3 || (argc > 1 && is_batch_path(argv[1], true)) ||
+         (argc == 3 && is_batch_path(argv[2], false));
+}
+
+static inline bool ParseElfBatchArgs(int argc, char** argv, ElfBatchOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-j" || arg == "-i") {
+      if (i + 1 == argc) {
+        printf("Missing value for %s\n", argv[i]);
+        return false;
+      }
+      const char* value = argv[++i];
+      if (arg == "-i") {
+        options->index_directory = value;
+        continue;
+      }
+      char* end;
+      options->threads = strtoul(value, &end, 10);
+      if (*end != '\0') {
+        printf("Malformed THREADS value: %s\n", value);
+        return false;
+      }
+    } else {
+      options->paths.push_back(arg);
+    }
+  }
+  if (options->paths.empty()) {
+    printf("No elf files given.\n");
+    return false;
+  }
+  return true;
+}
+
+// Paths given explicitly are followed if they are symbolic links, the ones
+// found in a directory are not, so that every file is processed once.
+static inline void FindElfFiles(const std::string& path, std::vector<std::string>* files,
+                                bool in_directory = false) {
+  if (!path.empty() && path[0] == '@') {
+    std::ifstream list(path.substr(1));
+    if (!list) {
+      printf("Cannot open list %s\n", path.c_str() + 1);
+      return;
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+      if (!line.empty()) {
+        FindElfFiles(line, files);
+      }
+    }
+    return;
+  }
+
+  struct stat st;
+  if ((in_directory ? lstat(path.c_str(), &st) : stat(path.c_str(), &st)) == -1) {
+    printf("Cannot stat %s: %s\n", path.c_str(), strerror(errno));
+    return;
+  }
+  if (S_ISREG(st.st_mode)) {
+    files->push_back(path);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return;
+  }
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    printf("Cannot open %s: %s\n", path.c_str(), strerror(errno));
+    return;
+  }
+  std::vector<std::string> entries;
+  while (struct dirent* entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      entries.push_back(path + '/' + entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end());
+  for (const std::string& entry : entries) {
+    FindElfFiles(entry, files, true);
+  }
+}
+
+// Called with each valid elf file, writes what the tool prints for the file
+// to output. Returns false if the file has errors.
+using ElfBatchCallback = std::function<bool(const std::string& path, Elf* elf, std::string* output)>;
+
+// Runs callback for every elf file of options in parallel, and prints the
+// outputs in the order of the files. Files that are not elf files are
+// skipped. Returns the number of files that are not valid or have errors.
+static inline size_t ProcessElfFiles(const ElfBatchOptions& options,
+                                     const ElfBatchCallback& callback) {
+  std::vector<std::string> files;
+  for (const std::string& path : options.paths) {
+    FindElfFiles(path, &files);
+  }
+  if (!options.index_directory.empty()) {
+    if (mkdir(options.index_directory.c_str(), 0755) == -1 && errno != EEXIST) {
+      printf("Cannot create %s: %s\n", options.index_directory.c_str(), strerror(errno));
+    }
+    Elf::SetIndexCacheDirectory(options.index_directory);
+  }
+
+  std::vector<std::string> outputs(files.size());
+  std::vector<char> failed(files.size());
+  std::atomic<size_t> next = 0;
+  auto work = [&]() {
+    for (size_t i = next++; i < files.size(); i = next++) {
+      std::unique_ptr<Memory> memory(Memory::CreateFileMemory(files[i], 0));
+      if (memory == nullptr || !Elf::IsValidElf(memory.get())) {
+        continue;
+      }
+      Elf elf(memory.release());
+      if (!elf.Init() || !elf.valid()) {
+        outputs[i] = files[i] + ": not a valid elf file\n";
+        failed[i] = true;
+        continue;
+      }
+      failed[i] = !callback(files[i], &elf, &outputs[i]);
+    }
+  };
+
+  size_t num_threads = options.threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, std::max<size_t>(files.size(), 1));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  size_t num_failed = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    fputs(outputs[i].c_str(), stdout);
+    num_failed += failed[i];
+  }
+  return num_failed;
+}
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_TOOLS_ELF_BATCH_H
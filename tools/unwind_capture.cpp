@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <unwindstack/OfflineCapture.h>
+#include <unwindstack/SymbolStore.h>
+#include <unwindstack/Unwinder.h>
+
+int main(int argc, char** argv) {
+  bool quiet = argc > 1 && strcmp(argv[1], "-q") == 0;
+  if (argc - quiet != 2 && argc - quiet != 3) {
+    printf("Usage: unwind_capture [-q] <CAPTURE_FILE> [<SYMBOL_STORE>]\n");
+    printf("  Unwind every sample in CAPTURE_FILE, using the elf files found\n");
+    printf("  by build id in SYMBOL_STORE, a directory or a symbol archive.\n");
+    printf("  With -q, only print how many samples were unwound and how fast.\n");
+    return 1;
+  }
+  const char* file = argv[1 + quiet];
+
+  unwindstack::SymbolStore store;
+  if (argc - quiet == 3) {
+    const char* store_path = argv[2 + quiet];
+    struct stat st;
+    if (stat(store_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      store.AddDirectory(store_path);
+    } else if (!store.AddArchive(store_path)) {
+      printf("%s is not a valid symbol archive.\n", store_path);
+      return 1;
+    }
+  }
+
+  unwindstack::OfflineCapture capture;
+  if (!capture.Init(file, &store)) {
+    printf("%s is not a valid capture file.\n", file);
+    return 1;
+  }
+
+  unwindstack::Unwinder unwinder(512, capture.maps(), capture.regs(), capture.memory());
+  unwinder.SetResolveNames(!quiet);
+  uint64_t total_frames = 0;
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < capture.NumSamples(); i++) {
+    if (!capture.SetSample(i)) {
+      printf("Sample %zu is not valid.\n", i);
+      return 1;
+    }
+    unwinder.Unwind();
+    total_frames += unwinder.NumFrames();
+    if (quiet) {
+      continue;
+    }
+    printf("Sample %zu tid %d:\n", i, capture.tid());
+    for (size_t j = 0; j < unwinder.NumFrames(); j++) {
+      printf("%s\n", unwinder.FormatFrame(j).c_str());
+    }
+  }
+  timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (quiet) {
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%zu samples, %" PRIu64 " frames in %.3fs\n", capture.NumSamples(), total_frames,
+           seconds);
+  }
+  return 0;
+}
@@ -38,6 +38,7 @@
 #include <unwindstack/JitDebug.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
+#include <unwindstack/OfflineCapture.h>
 #include <unwindstack/Regs.h>
 #include <unwindstack/Unwinder.h>
 
@@ -233,7 +234,7 @@ void SaveMapInformation(std::shared_ptr<unwindstack::Memory>& process_memory, ma
   }
 }
 
-int SaveData(pid_t pid) {
+int SaveData(pid_t pid, bool compress) {
   unwindstack::Regs* regs = unwindstack::Regs::RemoteGet(pid);
   if (regs == nullptr) {
     printf("Unable to get remote reg data.\n");
@@ -245,6 +246,9 @@ int SaveData(pid_t pid) {
     return 1;
   }
 
+  // The unwind changes the registers, keep a copy for the capture file.
+  std::unique_ptr<unwindstack::Regs> initial_regs(regs->Clone());
+
   // Do an unwind so we know how much of the stack to save, and what
   // elf files are involved.
   unwindstack::UnwinderFromPid unwinder(1024, pid);
@@ -300,6 +304,17 @@ int SaveData(pid_t pid) {
     return 1;
   }
 
+  // The same data in the format read by OfflineCapture, the elf files
+  // copied above can be used as its symbol directory.
+  unwindstack::OfflineCaptureWriter writer;
+  writer.SetCompression(compress);
+  if (!writer.Open("capture.bin", initial_regs->Arch(), maps, unwinder.GetProcessMemory()) ||
+      !writer.AddSample(pid, initial_regs.get(), unwinder.GetProcessMemory().get(), stacks) ||
+      !writer.Finish()) {
+    printf("Failed to create capture.bin\n");
+    return 1;
+  }
+
   std::vector<std::pair<uint64_t, map_info_t>> sorted_maps(maps_by_start.begin(),
                                                            maps_by_start.end());
   std::sort(sorted_maps.begin(), sorted_maps.end(),
@@ -335,18 +350,20 @@ int SaveData(pid_t pid) {
 }
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    printf("Usage: unwind_for_offline <PID>\n");
+  bool compress = argc > 1 && strcmp(argv[1], "-z") == 0;
+  if (argc - compress != 2) {
+    printf("Usage: unwind_for_offline [-z] <PID>\n");
+    printf("  With -z, the stacks in capture.bin are compressed.\n");
     return 1;
   }
 
-  pid_t pid = atoi(argv[1]);
+  pid_t pid = atoi(argv[1 + compress]);
   if (!Attach(pid)) {
     printf("Failed to attach to pid %d: %s\n", pid, strerror(errno));
     return 1;
   }
 
-  int return_code = SaveData(pid);
+  int return_code = SaveData(pid, compress);
 
   ptrace(PTRACE_DETACH, pid, 0, 0);
 
@@ -26,6 +26,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <string>
+
+#include <android-base/stringprintf.h>
+
 #include <unwindstack/DwarfSection.h>
 #include <unwindstack/DwarfStructs.h>
 #include <unwindstack/Elf.h>
@@ -34,6 +38,7 @@
 #include <unwindstack/Memory.h>
 
 #include "ArmExidx.h"
+#include "ElfBatch.h"
 #include "ElfInterfaceArm.h"
 
 namespace unwindstack {
@@ -72,7 +77,7 @@ void DumpArm(Elf* elf, ElfInterfaceArm* interface) {
         }
         continue;
       }
-      if (arm.data()->size() > 0) {
+      if (arm.data_size() > 0) {
         if (!arm.Eval() && arm.status() != ARM_STATUS_NO_UNWIND) {
           printf("      Error trying to evaluate dwarf data.\n");
         }
@@ -102,6 +107,73 @@ void DumpDwarfSection(Elf* elf, DwarfSection* section, uint64_t) {
   }
 }
 
+// Evaluates the cfa of every fde of the section, and adds a summary of it
+// to output. Returns the number of fdes that failed.
+size_t CheckDwarfSection(Elf* elf, DwarfSection* section, const char* name,
+                         std::string* output) {
+  if (section == nullptr) {
+    return 0;
+  }
+  size_t num_fdes = 0;
+  size_t num_errors = 0;
+  for (const DwarfFde* fde : *section) {
+    if (fde == nullptr || fde->pc_start == fde->pc_end) {
+      continue;
+    }
+    num_fdes++;
+    DwarfLocations loc_regs;
+    if (!section->GetCfaLocationInfo(fde->pc_start, fde, &loc_regs, elf->arch())) {
+      num_errors++;
+    }
+  }
+  *output += android::base::StringPrintf("%s %s %zu fdes", output->back() == ':' ? "" : ",",
+                                         name, num_fdes);
+  if (num_errors != 0) {
+    *output += android::base::StringPrintf(" (%zu errors)", num_errors);
+  }
+  return num_errors;
+}
+
+// Checks the unwind information of each elf, and prints a line for it.
+bool CheckElf(const std::string& path, Elf* elf, std::string* output) {
+  *output = path + ':';
+  size_t num_errors = 0;
+  ElfInterface* interface = elf->interface();
+  if (elf->machine_type() == EM_ARM) {
+    ElfInterfaceArm* arm_interface = reinterpret_cast<ElfInterfaceArm*>(interface);
+    size_t num_entries = 0;
+    size_t num_arm_errors = 0;
+    for (auto pc : *arm_interface) {
+      num_entries++;
+      uint64_t entry;
+      ArmExidx arm(nullptr, arm_interface->memory(), nullptr);
+      if (!arm_interface->FindEntry(pc, &entry) ||
+          (!arm.ExtractEntryData(entry) && arm.status() != ARM_STATUS_NO_UNWIND)) {
+        num_arm_errors++;
+      }
+    }
+    *output += android::base::StringPrintf(" exidx %zu entries", num_entries);
+    if (num_arm_errors != 0) {
+      *output += android::base::StringPrintf(" (%zu errors)", num_arm_errors);
+    }
+    num_errors += num_arm_errors;
+  }
+  num_errors += CheckDwarfSection(elf, interface->eh_frame(), "eh_frame", output);
+  num_errors += CheckDwarfSection(elf, interface->debug_frame(), "debug_frame", output);
+  ElfInterface* gnu_debugdata_interface = elf->gnu_debugdata_interface();
+  if (gnu_debugdata_interface != nullptr) {
+    num_errors += CheckDwarfSection(elf, gnu_debugdata_interface->eh_frame(),
+                                    "gnu_debugdata eh_frame", output);
+    num_errors += CheckDwarfSection(elf, gnu_debugdata_interface->debug_frame(),
+                                    "gnu_debugdata debug_frame", output);
+  }
+  if (output->back() == ':') {
+    *output += " no unwind information";
+  }
+  *output += '\n';
+  return num_errors == 0;
+}
+
 int GetElfInfo(const char* file, uint64_t offset) {
   // Send all log messages to stdout.
   log_to_stdout(true);
@@ -171,12 +243,24 @@ int GetElfInfo(const char* file, uint64_t offset) {
 }  // namespace unwindstack
 
 int main(int argc, char** argv) {
+  if (unwindstack::IsElfBatch(argc, argv)) {
+    unwindstack::ElfBatchOptions options;
+    if (!unwindstack::ParseElfBatchArgs(argc, argv, &options)) {
+      unwindstack::PrintElfBatchUsage("unwind_info");
+      return 1;
+    }
+    return unwindstack::ProcessElfFiles(options, unwindstack::CheckElf) == 0 ? 0 : 1;
+  }
+
   if (argc != 2 && argc != 3) {
     printf("Usage: unwind_info ELF_FILE [OFFSET]\n");
     printf("  ELF_FILE\n");
     printf("    The path to an elf file.\n");
     printf("  OFFSET\n");
     printf("    Use the offset into the ELF file as the beginning of the elf.\n");
+    printf("\n");
+    unwindstack::PrintElfBatchUsage("unwind_info");
+    printf("  Check the unwind information of each elf file, and print a summary.\n");
     return 1;
   }
 
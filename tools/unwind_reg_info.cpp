@@ -80,7 +80,7 @@ void PrintRegInformation(DwarfSection* section, Memory* memory, uint64_t pc, uin
 
   std::vector<std::pair<uint32_t, DwarfLocation>> loc_regs;
   for (auto& loc : regs) {
-    loc_regs.push_back(loc);
+    loc_regs.emplace_back(loc.first, loc.second);
   }
   std::sort(loc_regs.begin(), loc_regs.end(), [](auto a, auto b) {
     if (a.first == CFA_REG) {
@@ -164,7 +164,7 @@ void PrintArmRegInformation(ElfInterfaceArm* interface, uint64_t pc) {
     }
     return;
   }
-  if (arm.data()->size() != 0 && arm.Eval()) {
+  if (arm.data_size() != 0 && arm.Eval()) {
     arm.LogByReg();
   } else {
     printf("  Error tring to evaluate exidx data.\n");
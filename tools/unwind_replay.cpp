@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <unwindstack/OfflineCapture.h>
+#include <unwindstack/SymbolStore.h>
+#include <unwindstack/Unwinder.h>
+
+// Every allocation made through operator new is counted, including the
+// ones made by the library.
+static std::atomic<uint64_t> g_num_allocs;
+static std::atomic<uint64_t> g_alloc_bytes;
+
+static void* Allocate(size_t size) {
+  g_num_allocs.fetch_add(1, std::memory_order_relaxed);
+  g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+void* operator new(size_t size) {
+  return Allocate(size);
+}
+
+void* operator new[](size_t size) {
+  return Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+static uint64_t NowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t PeakRssKb() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+struct Phase {
+  explicit Phase(const char* name) : name(name) {}
+
+  const char* name;
+  uint64_t unwinds = 0;
+  uint64_t frames = 0;
+  uint64_t time_ns = 0;
+  uint64_t num_allocs = 0;
+  uint64_t alloc_bytes = 0;
+  uint64_t peak_rss_kb = 0;
+  std::vector<uint64_t> latencies_ns;
+
+  void Start() {
+    start_ns_ = NowNs();
+    start_allocs_ = g_num_allocs.load(std::memory_order_relaxed);
+    start_bytes_ = g_alloc_bytes.load(std::memory_order_relaxed);
+  }
+
+  void Stop() {
+    time_ns += NowNs() - start_ns_;
+    num_allocs += g_num_allocs.load(std::memory_order_relaxed) - start_allocs_;
+    alloc_bytes += g_alloc_bytes.load(std::memory_order_relaxed) - start_bytes_;
+    peak_rss_kb = PeakRssKb();
+  }
+
+  uint64_t Percentile(size_t percent) {
+    if (latencies_ns.empty()) {
+      return 0;
+    }
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    return latencies_ns[std::min(latencies_ns.size() - 1, latencies_ns.size() * percent / 100)];
+  }
+
+ private:
+  uint64_t start_ns_ = 0;
+  uint64_t start_allocs_ = 0;
+  uint64_t start_bytes_ = 0;
+};
+
+struct Snapshot {
+  std::string file;
+  unwindstack::OfflineCapture capture;
+  Phase init{"init"};
+  Phase cold{"cold"};
+  Phase warm{"warm"};
+};
+
+// Unwinds every sample of the snapshot once, and records it in phase.
+static bool UnwindAll(Snapshot* snapshot, Phase* phase) {
+  unwindstack::OfflineCapture* capture = &snapshot->capture;
+  unwindstack::Unwinder unwinder(512, capture->maps(), capture->regs(), capture->memory());
+  unwinder.SetResolveNames(true);
+  for (size_t i = 0; i < capture->NumSamples(); i++) {
+    if (!capture->SetSample(i)) {
+      printf("%s: sample %zu is not valid.\n", snapshot->file.c_str(), i);
+      return false;
+    }
+    phase->Start();
+    uint64_t start_ns = NowNs();
+    unwinder.Unwind();
+    phase->latencies_ns.push_back(NowNs() - start_ns);
+    phase->Stop();
+    phase->unwinds++;
+    phase->frames += unwinder.NumFrames();
+  }
+  return true;
+}
+
+static void PrintPhase(Phase* phase) {
+  double seconds = phase->time_ns / 1e9;
+  printf("  %-5s %8" PRIu64 " unwinds %8.0f/s  p50 %8.1fus  p99 %8.1fus  %8" PRIu64
+         " allocs %10" PRIu64 " bytes  peak rss %" PRIu64 "KB\n",
+         phase->name, phase->unwinds, seconds > 0 ? phase->unwinds / seconds : 0,
+         phase->Percentile(50) / 1e3, phase->Percentile(99) / 1e3, phase->num_allocs,
+         phase->alloc_bytes, phase->peak_rss_kb);
+}
+
+static void PrintPhaseJson(FILE* fp, Phase* phase, bool last) {
+  double seconds = phase->time_ns / 1e9;
+  fprintf(fp,
+          "      \"%s\": {\"unwinds\": %" PRIu64 ", \"frames\": %" PRIu64
+          ", \"time_ns\": %" PRIu64
+          ", \"unwinds_per_sec\": %.1f, \"p50_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+          ", \"allocs\": %" PRIu64 ", \"alloc_bytes\": %" PRIu64 ", \"peak_rss_kb\": %" PRIu64
+          "}%s\n",
+          phase->name, phase->unwinds, phase->frames, phase->time_ns,
+          seconds > 0 ? phase->unwinds / seconds : 0, phase->Percentile(50),
+          phase->Percentile(99), phase->num_allocs, phase->alloc_bytes, phase->peak_rss_kb,
+          last ? "" : ",");
+}
+
+// Only the characters that need it are escaped, the file names are the
+// only strings written.
+static std::string JsonString(const std::string& value) {
+  std::string escaped = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped + '"';
+}
+
+static bool WriteJson(const char* file, std::vector<Snapshot>* snapshots) {
+  FILE* fp = fopen(file, "w");
+  if (fp == nullptr) {
+    return false;
+  }
+  fprintf(fp, "{\n  \"snapshots\": [\n");
+  for (size_t i = 0; i < snapshots->size(); i++) {
+    Snapshot* snapshot = &(*snapshots)[i];
+    fprintf(fp, "    {\n      \"file\": %s,\n      \"samples\": %zu,\n",
+            JsonString(snapshot->file).c_str(), snapshot->capture.NumSamples());
+    PrintPhaseJson(fp, &snapshot->init, false);
+    PrintPhaseJson(fp, &snapshot->cold, false);
+    PrintPhaseJson(fp, &snapshot->warm, true);
+    fprintf(fp, "    }%s\n", i + 1 == snapshots->size() ? "" : ",");
+  }
+  fprintf(fp, "  ],\n  \"peak_rss_kb\": %" PRIu64 "\n}\n", PeakRssKb());
+  return fclose(fp) == 0;
+}
+
+static void Usage() {
+  printf("Usage: unwind_replay [-i <ITERATIONS>] [-s <SYMBOL_STORE>] [-j <JSON_FILE>]\n");
+  printf("                     <CAPTURE_FILE> [<CAPTURE_FILE>...]\n");
+  printf("  Replay the samples of every CAPTURE_FILE, such as the capture.bin written\n");
+  printf("  by unwind_for_offline, and report the speed, latency, allocations and\n");
+  printf("  peak rss of each phase:\n");
+  printf("    init  loading the capture file\n");
+  printf("    cold  the first unwind of every sample, creating the elfs\n");
+  printf("    warm  ITERATIONS more unwinds of every sample, 10 by default\n");
+  printf("  -s  Find the elf files by build id in SYMBOL_STORE, a directory or a\n");
+  printf("      symbol archive.\n");
+  printf("  -j  Also write the results as json to JSON_FILE.\n");
+}
+
+int main(int argc, char** argv) {
+  size_t iterations = 10;
+  const char* store_path = nullptr;
+  const char* json_file = nullptr;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (strcmp(argv[arg], "-i") == 0) {
+      iterations = strtoul(argv[arg + 1], nullptr, 10);
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      store_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-j") == 0) {
+      json_file = argv[arg + 1];
+    } else {
+      break;
+    }
+  }
+  if (arg == argc || argv[arg][0] == '-') {
+    Usage();
+    return 1;
+  }
+
+  unwindstack::SymbolStore store;
+  if (store_path != nullptr) {
+    struct stat st;
+    if (stat(store_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      store.AddDirectory(store_path);
+    } else if (!store.AddArchive(store_path)) {
+      printf("%s is not a valid symbol archive.\n", store_path);
+      return 1;
+    }
+  }
+
+  std::vector<Snapshot> snapshots(argc - arg);
+  for (Snapshot& snapshot : snapshots) {
+    snapshot.file = argv[arg++];
+    snapshot.init.Start();
+    bool valid = snapshot.capture.Init(snapshot.file, &store);
+    snapshot.init.Stop();
+    if (!valid) {
+      printf("%s is not a valid capture file.\n", snapshot.file.c_str());
+      return 1;
+    }
+
+    if (!UnwindAll(&snapshot, &snapshot.cold)) {
+      return 1;
+    }
+    for (size_t i = 0; i < iterations; i++) {
+      if (!UnwindAll(&snapshot, &snapshot.warm)) {
+        return 1;
+      }
+    }
+
+    printf("%s: %zu samples, %.1f frames per unwind\n", snapshot.file.c_str(),
+           snapshot.capture.NumSamples(),
+           snapshot.cold.unwinds ? static_cast<double>(snapshot.cold.frames) / snapshot.cold.unwinds
+                                 : 0);
+    printf("  init  %.3fms  %" PRIu64 " allocs %" PRIu64 " bytes  peak rss %" PRIu64 "KB\n",
+           snapshot.init.time_ns / 1e6, snapshot.init.num_allocs, snapshot.init.alloc_bytes,
+           snapshot.init.peak_rss_kb);
+    PrintPhase(&snapshot.cold);
+    PrintPhase(&snapshot.warm);
+  }
+
+  if (json_file != nullptr && !WriteJson(json_file, &snapshots)) {
+    printf("Failed to write %s.\n", json_file);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unwindstack/LocalUnwinder.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsGetLocal.h>
+#include <unwindstack/Unwinder.h>
+
+// The frames below the unwinds, so that every unwind has some work to do.
+static constexpr size_t kDepth = 16;
+static constexpr size_t kMaxFrames = 128;
+
+static uint64_t NowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// A thread that blocks on a lock held by another thread gives up the cpu,
+// which counts as a voluntary context switch. The library does not count
+// the waits on its locks, so this is the measure of the contention.
+static uint64_t VoluntaryContextSwitches() {
+  rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_nvcsw;
+}
+
+static size_t __attribute__((noinline)) Recurse(size_t depth, const std::function<void()>& func) {
+  if (depth == 0) {
+    func();
+    return 0;
+  }
+  size_t frames = Recurse(depth - 1, func);
+  // Keeps the compiler from turning the recursion into a loop, so that
+  // every level has its own frame.
+  asm volatile("" : "+r"(frames));
+  return frames + 1;
+}
+
+struct ThreadResult {
+  std::vector<uint64_t> latencies_ns;
+  uint64_t frames = 0;
+  uint64_t context_switches = 0;
+  bool has_stats = false;
+  unwindstack::UnwindStats stats;
+  bool failed = false;
+};
+
+// Does one unwind and returns the number of frames, or 0 if it failed.
+// stats is set to the stats of the unwind if the unwinder has them.
+using UnwindFunc = std::function<size_t(const unwindstack::UnwindStats** stats)>;
+
+// Makes the unwind function of one worker thread.
+using WorkerFactory = std::function<UnwindFunc(size_t index)>;
+
+struct Mode {
+  const char* name;
+  WorkerFactory factory;
+};
+
+struct Result {
+  const char* mode;
+  size_t threads = 0;
+  uint64_t unwinds = 0;
+  uint64_t frames = 0;
+  uint64_t time_ns = 0;
+  uint64_t context_switches = 0;
+  std::vector<uint64_t> latencies_ns;
+  bool has_stats = false;
+  unwindstack::UnwindStats stats;
+  bool failed = false;
+
+  uint64_t Percentile(size_t percent) {
+    if (latencies_ns.empty()) {
+      return 0;
+    }
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    return latencies_ns[std::min(latencies_ns.size() - 1, latencies_ns.size() * percent / 100)];
+  }
+};
+
+// Runs unwinds on every one of num_threads threads at the same time.
+static Result Run(const Mode& mode, size_t num_threads, size_t unwinds) {
+  std::vector<ThreadResult> thread_results(num_threads);
+  std::atomic<size_t> ready(0);
+  std::atomic<bool> start(false);
+  auto worker = [&](size_t index) {
+    ThreadResult* result = &thread_results[index];
+    UnwindFunc unwind = mode.factory(index);
+    Recurse(kDepth, [&]() {
+      // Not measured, so that the elf objects are created before.
+      const unwindstack::UnwindStats* stats;
+      if (unwind(&stats) == 0) {
+        result->failed = true;
+      }
+      ready.fetch_add(1);
+      while (!start.load()) {
+        std::this_thread::yield();
+      }
+
+      uint64_t start_switches = VoluntaryContextSwitches();
+      result->latencies_ns.reserve(unwinds);
+      for (size_t i = 0; i < unwinds && !result->failed; i++) {
+        uint64_t start_ns = NowNs();
+        size_t frames = unwind(&stats);
+        result->latencies_ns.push_back(NowNs() - start_ns);
+        if (frames == 0) {
+          result->failed = true;
+        }
+        result->frames += frames;
+        if (stats != nullptr) {
+          result->stats.Add(*stats);
+          result->has_stats = true;
+        }
+      }
+      result->context_switches = VoluntaryContextSwitches() - start_switches;
+    });
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++) {
+    threads.emplace_back(worker, i);
+  }
+  while (ready.load() != num_threads) {
+    std::this_thread::yield();
+  }
+  uint64_t start_ns = NowNs();
+  start.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  Result result;
+  result.mode = mode.name;
+  result.threads = num_threads;
+  result.time_ns = NowNs() - start_ns;
+  for (ThreadResult& thread_result : thread_results) {
+    result.unwinds += thread_result.latencies_ns.size();
+    result.frames += thread_result.frames;
+    result.context_switches += thread_result.context_switches;
+    result.latencies_ns.insert(result.latencies_ns.end(), thread_result.latencies_ns.begin(),
+                               thread_result.latencies_ns.end());
+    if (thread_result.has_stats) {
+      result.stats.Add(thread_result.stats);
+      result.has_stats = true;
+    }
+    result.failed |= thread_result.failed;
+  }
+  return result;
+}
+
+// Threads to be unwound with a signal, one per worker, parked below a few
+// frames until the benchmark is done.
+class Targets {
+ public:
+  ~Targets() {
+    stop_.store(true);
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Start(size_t num_threads) {
+    tids_.resize(num_threads);
+    std::atomic<size_t> started(0);
+    for (size_t i = 0; i < num_threads; i++) {
+      threads_.emplace_back([this, i, &started]() {
+        tids_[i] = syscall(__NR_gettid);
+        started.fetch_add(1);
+        Recurse(kDepth, [this]() {
+          while (!stop_.load()) {
+            usleep(1000);
+          }
+        });
+      });
+    }
+    while (started.load() != num_threads) {
+      std::this_thread::yield();
+    }
+  }
+
+  pid_t tid(size_t index) { return tids_[index]; }
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::vector<pid_t> tids_;
+  std::vector<std::thread> threads_;
+};
+
+static double PerUnwind(uint64_t value, uint64_t unwinds) {
+  return unwinds ? static_cast<double>(value) / unwinds : 0;
+}
+
+static void PrintResult(Result* result) {
+  double seconds = result->time_ns / 1e9;
+  printf("  %-6s threads %3zu  %9.0f unwinds/s  p50 %8.1fus  p99 %8.1fus  %6.3f cs/unwind",
+         result->mode, result->threads, seconds > 0 ? result->unwinds / seconds : 0,
+         result->Percentile(50) / 1e3, result->Percentile(99) / 1e3,
+         PerUnwind(result->context_switches, result->unwinds));
+  if (result->has_stats) {
+    const unwindstack::UnwindStats& stats = result->stats;
+    printf("  find map %6.2fus  get elf %6.2fus  step %6.2fus  memory cache %" PRIu64 "/%" PRIu64,
+           PerUnwind(stats.find_map_ns, stats.unwinds) / 1e3,
+           PerUnwind(stats.get_elf_ns, stats.unwinds) / 1e3,
+           PerUnwind(stats.step_ns, stats.unwinds) / 1e3, stats.memory_cache_hits,
+           stats.memory_cache_hits + stats.memory_cache_misses);
+  }
+  printf("%s\n", result->failed ? "  FAILED" : "");
+}
+
+static void PrintResultJson(FILE* fp, Result* result, bool last) {
+  double seconds = result->time_ns / 1e9;
+  fprintf(fp,
+          "    {\"mode\": \"%s\", \"threads\": %zu, \"unwinds\": %" PRIu64 ", \"frames\": %" PRIu64
+          ", \"time_ns\": %" PRIu64 ", \"unwinds_per_sec\": %.1f, \"p50_ns\": %" PRIu64
+          ", \"p99_ns\": %" PRIu64 ", \"context_switches\": %" PRIu64,
+          result->mode, result->threads, result->unwinds, result->frames, result->time_ns,
+          seconds > 0 ? result->unwinds / seconds : 0, result->Percentile(50),
+          result->Percentile(99), result->context_switches);
+  if (result->has_stats) {
+    const unwindstack::UnwindStats& stats = result->stats;
+    fprintf(fp,
+            ", \"find_map_ns\": %" PRIu64 ", \"get_elf_ns\": %" PRIu64 ", \"step_ns\": %" PRIu64
+            ", \"memory_cache_hits\": %" PRIu64 ", \"memory_cache_misses\": %" PRIu64,
+            stats.find_map_ns, stats.get_elf_ns, stats.step_ns, stats.memory_cache_hits,
+            stats.memory_cache_misses);
+  }
+  fprintf(fp, ", \"failed\": %s}%s\n", result->failed ? "true" : "false", last ? "" : ",");
+}
+
+static bool WriteJson(const char* file, std::vector<Result>* results) {
+  FILE* fp = fopen(file, "w");
+  if (fp == nullptr) {
+    return false;
+  }
+  fprintf(fp, "{\n  \"results\": [\n");
+  for (size_t i = 0; i < results->size(); i++) {
+    PrintResultJson(fp, &(*results)[i], i + 1 == results->size());
+  }
+  fprintf(fp, "  ]\n}\n");
+  return fclose(fp) == 0;
+}
+
+static void Usage() {
+  printf("Usage: unwind_scaling [-t <MAX_THREADS>] [-n <UNWINDS>] [-m <MODE>] [-j <JSON_FILE>]\n");
+  printf("  Unwind from 1, 2, 4, ... up to MAX_THREADS threads at the same time, all\n");
+  printf("  sharing the same maps and elf objects, and report for each number of\n");
+  printf("  threads the unwinds per second, the p50 and p99 latency, and the voluntary\n");
+  printf("  context switches per unwind, which are mostly waits for a lock. For the\n");
+  printf("  modes that use an Unwinder, also the time per unwind of the phases\n");
+  printf("  that take the shared locks, and the hits of the process memory cache.\n");
+  printf("  -t  The most threads, the number of cpus by default.\n");
+  printf("  -n  The unwinds of each thread, 1000 by default.\n");
+  printf("  -m  Only run MODE, one of:\n");
+  printf("        local   LocalUnwinder::Unwind of the calling thread\n");
+  printf("        signal  ThreadUnwinder::UnwindWithSignal of another thread\n");
+  printf("        shared  Unwinder::Unwind of the calling thread, an unwinder per\n");
+  printf("                thread sharing the maps and the process memory\n");
+  printf("  -j  Also write the results as json to JSON_FILE.\n");
+}
+
+int main(int argc, char** argv) {
+  size_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+  size_t unwinds = 1000;
+  const char* only_mode = nullptr;
+  const char* json_file = nullptr;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (strcmp(argv[arg], "-t") == 0) {
+      max_threads = strtoul(argv[arg + 1], nullptr, 10);
+    } else if (strcmp(argv[arg], "-n") == 0) {
+      unwinds = strtoul(argv[arg + 1], nullptr, 10);
+    } else if (strcmp(argv[arg], "-m") == 0) {
+      only_mode = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-j") == 0) {
+      json_file = argv[arg + 1];
+    } else {
+      break;
+    }
+  }
+  if (arg != argc || max_threads == 0 || unwinds == 0) {
+    Usage();
+    return 1;
+  }
+
+  unwindstack::LocalUnwinder local_unwinder;
+  if (!local_unwinder.Init()) {
+    printf("Failed to init the local unwinder.\n");
+    return 1;
+  }
+
+  unwindstack::ThreadUnwinder thread_unwinder(kMaxFrames);
+  if (!thread_unwinder.Init()) {
+    printf("Failed to init the thread unwinder.\n");
+    return 1;
+  }
+  Targets targets;
+  if (only_mode == nullptr || strcmp(only_mode, "signal") == 0) {
+    targets.Start(max_threads);
+  }
+
+  unwindstack::LocalMaps maps;
+  if (!maps.Parse()) {
+    printf("Failed to parse the maps.\n");
+    return 1;
+  }
+  std::shared_ptr<unwindstack::Memory> process_memory =
+      unwindstack::Memory::CreateProcessMemoryThreadCached(getpid());
+
+  std::vector<Mode> modes;
+  modes.push_back(Mode{"local", [&](size_t) -> UnwindFunc {
+                         auto frames = std::make_shared<std::vector<unwindstack::LocalFrameData>>();
+                         return [&local_unwinder, frames](const unwindstack::UnwindStats** stats) {
+                           *stats = nullptr;
+                           frames->clear();
+                           local_unwinder.Unwind(frames.get(), kMaxFrames);
+                           return frames->size();
+                         };
+                       }});
+  modes.push_back(Mode{"signal", [&](size_t index) -> UnwindFunc {
+                         auto unwinder = std::make_shared<unwindstack::ThreadUnwinder>(
+                             kMaxFrames, &thread_unwinder);
+                         unwinder->SetStatsEnabled(true);
+                         pid_t tid = targets.tid(index);
+                         return [unwinder, tid](const unwindstack::UnwindStats** stats) {
+                           unwinder->UnwindWithSignal(SIGRTMIN, tid);
+                           *stats = &unwinder->stats();
+                           return unwinder->NumFrames();
+                         };
+                       }});
+  modes.push_back(Mode{"shared", [&](size_t) -> UnwindFunc {
+                         auto unwinder = std::make_shared<unwindstack::Unwinder>(
+                             kMaxFrames, &maps, process_memory);
+                         unwinder->SetStatsEnabled(true);
+                         return [unwinder](const unwindstack::UnwindStats** stats) {
+                           std::unique_ptr<unwindstack::Regs> regs(
+                               unwindstack::Regs::CreateFromLocal());
+                           unwindstack::RegsGetLocal(regs.get());
+                           unwinder->SetRegs(regs.get());
+                           unwinder->Unwind();
+                           *stats = &unwinder->stats();
+                           return unwinder->NumFrames();
+                         };
+                       }});
+
+  std::vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  std::vector<Result> results;
+  bool failed = false;
+  for (const Mode& mode : modes) {
+    if (only_mode != nullptr && strcmp(only_mode, mode.name) != 0) {
+      continue;
+    }
+    printf("%s:\n", mode.name);
+    for (size_t threads : thread_counts) {
+      results.push_back(Run(mode, threads, unwinds));
+      PrintResult(&results.back());
+      failed |= results.back().failed;
+    }
+  }
+  if (results.empty()) {
+    Usage();
+    return 1;
+  }
+
+  if (json_file != nullptr && !WriteJson(json_file, &results)) {
+    printf("Failed to write %s.\n", json_file);
+    return 1;
+  }
+  return failed ? 1 : 0;
+}
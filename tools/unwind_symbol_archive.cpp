@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <unwindstack/SymbolStore.h>
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("Usage: unwind_symbol_archive <ARCHIVE> <ELF_FILE> [<ELF_FILE>...]\n");
+    printf("  Pack the ELF_FILEs into ARCHIVE, indexed by build id, to be used\n");
+    printf("  as a symbol store for offline unwinding.\n");
+    return 1;
+  }
+
+  std::vector<std::string> elf_files(&argv[2], &argv[argc]);
+  if (!unwindstack::SymbolStore::WriteArchive(argv[1], elf_files)) {
+    printf("Failed to create %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -23,16 +23,54 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+
 #include <unwindstack/Elf.h>
+#include <unwindstack/ElfInterface.h>
 #include <unwindstack/Log.h>
 #include <unwindstack/Memory.h>
 
+#include "ElfBatch.h"
+
+// Prints the number of function symbols with a size in each elf.
+static bool CountSymbols(const std::string& path, unwindstack::Elf* elf, std::string* output) {
+  std::vector<unwindstack::FunctionSymbol> functions;
+  elf->interface()->GetFunctionSymbols(&functions);
+  size_t num_functions = functions.size();
+  size_t num_gnu_debugdata = 0;
+  if (elf->gnu_debugdata_interface() != nullptr) {
+    elf->gnu_debugdata_interface()->GetFunctionSymbols(&functions);
+    num_gnu_debugdata = functions.size() - num_functions;
+  }
+  *output = android::base::StringPrintf("%s: %zu functions", path.c_str(), num_functions);
+  if (num_gnu_debugdata != 0) {
+    *output += android::base::StringPrintf(", %zu in gnu_debugdata", num_gnu_debugdata);
+  }
+  *output += '\n';
+  return true;
+}
+
 int main(int argc, char** argv) {
+  if (unwindstack::IsElfBatch(argc, argv)) {
+    unwindstack::ElfBatchOptions options;
+    if (!unwindstack::ParseElfBatchArgs(argc, argv, &options)) {
+      unwindstack::PrintElfBatchUsage("unwind_symbols");
+      return 1;
+    }
+    return unwindstack::ProcessElfFiles(options, CountSymbols) == 0 ? 0 : 1;
+  }
+
   if (argc != 2 && argc != 3) {
     printf("Usage: unwind_symbols <ELF_FILE> [<FUNC_ADDRESS>]\n");
     printf("  Dump all function symbols in ELF_FILE. If FUNC_ADDRESS is\n");
     printf("  specified, then get the function at that address.\n");
     printf("  FUNC_ADDRESS must be a hex number.\n");
+    printf("\n");
+    unwindstack::PrintElfBatchUsage("unwind_symbols");
+    printf("  Print the number of function symbols in each elf file.\n");
     return 1;
   }
 